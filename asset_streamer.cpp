@@ -0,0 +1,443 @@
+#include "asset_streamer.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <stdexcept>
+
+static uint64_t AlignStagingSize (uint64_t size)
+{
+	return (std::max<uint64_t>(size, 1) + stream_staging_alignment - 1) & ~(stream_staging_alignment - 1);
+}
+
+AssetStreamer::AssetStreamer (GpuDevice *copy_device, UploadBackend *upload_backend, uint64_t staging_size, uint32_t thread_count) :
+	copy_queue (copy_device),
+	backend (upload_backend),
+	staging_chunk (upload_backend->CreateChunk (AlignStagingSize (staging_size))),
+	staging (staging_chunk.size, stream_staging_alignment),
+	next_sequence (0),
+	fence_value (copy_device->GetCompletedFenceValue ()),
+	stop (false)
+{
+	memset (&stats, 0, sizeof (stats));
+	for (uint32_t i = 0; i < thread_count; i++)
+		threads.emplace_back (&AssetStreamer::IoThread, this);
+}
+
+AssetStreamer::~AssetStreamer ()
+{
+	{
+		std::lock_guard<std::mutex> lock (mutex);
+		stop = true;
+		read_queue.clear ();
+	}
+	queue_cv.notify_all ();
+	//the threads finish the reads they started before they exit
+	for (std::thread &thread : threads)
+		thread.join ();
+	copy_queue->WaitForFenceValue (fence_value);
+	backend->DestroyChunk (staging_chunk);
+}
+
+StreamId AssetStreamer::Request (const StreamRequest &request)
+{
+	if (!request.size || request.size > staging.GetSize ())
+		throw std::invalid_argument ("Stream request does not fit the staging memory");
+	for (const GpuTextureFootprint &footprint : request.footprints)
+		if (footprint.offset % stream_staging_alignment || footprint.offset >= request.size)
+			throw std::invalid_argument ("Stream request footprint is outside of its data");
+
+	StreamId id;
+	if (free_ids.empty ())
+	{
+		id = static_cast<StreamId>(entries.size ());
+		entries.emplace_back ();
+	}
+	else
+	{
+		id = free_ids.back ();
+		free_ids.pop_back ();
+	}
+	Entry &entry = entries[id];
+	entry.request = request;
+	entry.status = STREAM_STATUS_QUEUED;
+	entry.sequence = next_sequence++;
+	entry.in_batch = false;
+	entry.released = false;
+	entry.live = true;
+	entry.error.clear ();
+
+	heap.push_back (id);
+	SiftUp (static_cast<uint32_t>(heap.size () - 1));
+	stats.requests++;
+	return id;
+}
+
+void AssetStreamer::SetPriority (StreamId id, const StreamPriority &priority)
+{
+	Entry &entry = GetEntry (id);
+	entry.request.priority = priority;
+	//a running copy is handed over by the deadline of its batch
+	if (entry.status == STREAM_STATUS_COPYING)
+		for (Batch &batch : batches)
+			if (std::find (batch.ids.begin (), batch.ids.end (), id) != batch.ids.end ())
+			{
+				batch.deadline = std::min (batch.deadline, priority.deadline);
+				break;
+			}
+	//requests being read take the new deadline into their batch
+	if (entry.status != STREAM_STATUS_QUEUED)
+		return;
+	const uint32_t index = entry.heap_index;
+	SiftUp (index);
+	SiftDown (entry.heap_index);
+}
+
+StreamStatus AssetStreamer::GetStatus (StreamId id) const
+{
+	return GetEntry (id).status;
+}
+
+const std::string &AssetStreamer::GetError (StreamId id) const
+{
+	return GetEntry (id).error;
+}
+
+void AssetStreamer::Release (StreamId id)
+{
+	Entry &entry = GetEntry (id);
+	if (entry.status == STREAM_STATUS_QUEUED)
+	{
+		HeapRemove (entry.heap_index);
+		FreeEntry (id);
+	}
+	else if (entry.status == STREAM_STATUS_READING || entry.in_batch)
+		entry.released = true;
+	else
+		FreeEntry (id);
+}
+
+void AssetStreamer::Update (GpuDevice *direct_queue, uint64_t frame)
+{
+	const uint64_t completed_fence_value = copy_queue->GetCompletedFenceValue ();
+	Reclaim (completed_fence_value);
+	Dispatch ();
+
+	std::vector<ReadResult> results;
+	CollectReads (results);
+	SubmitCopies (results);
+	Handover (direct_queue, frame, completed_fence_value);
+}
+
+AssetStreamerStats AssetStreamer::GetStats () const
+{
+	AssetStreamerStats result = stats;
+	result.queued = static_cast<uint32_t>(heap.size ());
+	return result;
+}
+
+AssetStreamer::Entry &AssetStreamer::GetEntry (StreamId id)
+{
+	if (id >= entries.size () || !entries[id].live)
+		throw std::invalid_argument ("Unknown stream request");
+	return entries[id];
+}
+
+const AssetStreamer::Entry &AssetStreamer::GetEntry (StreamId id) const
+{
+	if (id >= entries.size () || !entries[id].live)
+		throw std::invalid_argument ("Unknown stream request");
+	return entries[id];
+}
+
+void AssetStreamer::FreeEntry (StreamId id)
+{
+	Entry &entry = entries[id];
+	entry.live = false;
+	//the read function may own a lot, e.g. a file mapping
+	entry.request.read = nullptr;
+	entry.error.clear ();
+	free_ids.push_back (id);
+}
+
+void AssetStreamer::FreeStaging (Entry &entry)
+{
+	staging.Free (entry.staging.block);
+	stats.staging_used = staging.GetUsedSize ();
+	stats.in_flight--;
+}
+
+bool AssetStreamer::IsBefore (StreamId a, StreamId b) const
+{
+	const Entry &entry_a = entries[a];
+	const Entry &entry_b = entries[b];
+	const StreamPriority &priority_a = entry_a.request.priority;
+	const StreamPriority &priority_b = entry_b.request.priority;
+	if (priority_a.deadline != priority_b.deadline)
+		return priority_a.deadline < priority_b.deadline;
+	if (priority_a.importance != priority_b.importance)
+		return priority_a.importance > priority_b.importance;
+	return entry_a.sequence < entry_b.sequence;
+}
+
+void AssetStreamer::HeapMove (uint32_t index, StreamId id)
+{
+	heap[index] = id;
+	entries[id].heap_index = index;
+}
+
+void AssetStreamer::SiftUp (uint32_t index)
+{
+	const StreamId id = heap[index];
+	while (index > 0)
+	{
+		const uint32_t parent = (index - 1) / 2;
+		if (!IsBefore (id, heap[parent]))
+			break;
+		HeapMove (index, heap[parent]);
+		index = parent;
+	}
+	HeapMove (index, id);
+}
+
+void AssetStreamer::SiftDown (uint32_t index)
+{
+	const StreamId id = heap[index];
+	const uint32_t count = static_cast<uint32_t>(heap.size ());
+	for (;;)
+	{
+		uint32_t child = 2 * index + 1;
+		if (child >= count)
+			break;
+		if (child + 1 < count && IsBefore (heap[child + 1], heap[child]))
+			child++;
+		if (!IsBefore (heap[child], id))
+			break;
+		HeapMove (index, heap[child]);
+		index = child;
+	}
+	HeapMove (index, id);
+}
+
+void AssetStreamer::HeapRemove (uint32_t index)
+{
+	const StreamId last = heap.back ();
+	heap.pop_back ();
+	if (index == heap.size ())
+		return;
+	HeapMove (index, last);
+	SiftUp (index);
+	SiftDown (entries[last].heap_index);
+}
+
+void AssetStreamer::Dispatch ()
+{
+	//strict priority order: a request that does not fit waits for memory instead of being
+	//overtaken by smaller ones, which could otherwise starve it
+	std::vector<ReadJob> jobs;
+	while (!heap.empty ())
+	{
+		const StreamId id = heap[0];
+		Entry &entry = entries[id];
+		if (!staging.Allocate (entry.request.size, stream_staging_alignment, id, entry.staging))
+		{
+			stats.budget_stalls++;
+			break;
+		}
+		HeapRemove (0);
+		entry.status = STREAM_STATUS_READING;
+		stats.in_flight++;
+		stats.staging_used = staging.GetUsedSize ();
+		stats.staging_peak = std::max (stats.staging_peak, stats.staging_used);
+
+		ReadJob job;
+		job.id = id;
+		job.read = entry.request.read;
+		job.destination = staging_chunk.cpu_address + entry.staging.offset;
+		job.size = entry.request.size;
+		jobs.push_back (std::move (job));
+	}
+	if (jobs.empty ())
+		return;
+
+	if (threads.empty ())
+	{
+		for (ReadJob &job : jobs)
+		{
+			ReadResult result;
+			Read (job, result);
+			read_results.push_back (std::move (result));
+		}
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock (mutex);
+		for (ReadJob &job : jobs)
+			read_queue.push_back (std::move (job));
+	}
+	queue_cv.notify_all ();
+}
+
+void AssetStreamer::CollectReads (std::vector<ReadResult> &results)
+{
+	results.swap (read_results);
+	std::lock_guard<std::mutex> lock (mutex);
+	for (ReadResult &result : finished_reads)
+		results.push_back (std::move (result));
+	finished_reads.clear ();
+}
+
+void AssetStreamer::SubmitCopies (const std::vector<ReadResult> &results)
+{
+	Batch batch;
+	batch.deadline = stream_no_deadline;
+	for (const ReadResult &result : results)
+	{
+		Entry &entry = entries[result.id];
+		if (result.error.empty ())
+			stats.read_bytes += entry.request.size;
+		if (entry.released)
+		{
+			FreeStaging (entry);
+			FreeEntry (result.id);
+			continue;
+		}
+		if (!result.error.empty ())
+		{
+			FreeStaging (entry);
+			entry.status = STREAM_STATUS_FAILED;
+			entry.error = result.error;
+			stats.failed++;
+			continue;
+		}
+
+		if (batch.ids.empty ())
+		{
+			if (free_allocators.empty ())
+				batch.allocator = copy_queue->CreateCommandAllocator ();
+			else
+			{
+				batch.allocator = std::move (free_allocators.back ());
+				free_allocators.pop_back ();
+			}
+			//lists are created open
+			if (command_list)
+				command_list->Reset (batch.allocator.get (), 0);
+			else
+				command_list = copy_queue->CreateCommandList (batch.allocator.get ());
+		}
+		if (entry.request.footprints.empty ())
+			command_list->CopyBufferRegion (entry.request.destination, entry.request.destination_offset,
+											staging_chunk.resource, entry.staging.offset, entry.request.size);
+		for (size_t i = 0; i < entry.request.footprints.size (); i++)
+		{
+			GpuTextureFootprint footprint = entry.request.footprints[i];
+			footprint.offset += entry.staging.offset;
+			command_list->CopyBufferToTexture (entry.request.destination, entry.request.first_subresource + static_cast<uint32_t>(i),
+											   staging_chunk.resource, footprint);
+		}
+		entry.status = STREAM_STATUS_COPYING;
+		entry.in_batch = true;
+		stats.copied_bytes += entry.request.size;
+		batch.deadline = std::min (batch.deadline, entry.request.priority.deadline);
+		batch.ids.push_back (result.id);
+	}
+	if (batch.ids.empty ())
+		return;
+
+	command_list->Close ();
+	GpuCommandList *lists[] = { command_list.get () };
+	copy_queue->ExecuteCommandLists (1, lists);
+	copy_queue->Signal (++fence_value);
+	batch.fence_value = fence_value;
+	batch.handed_over = false;
+	batches.push_back (std::move (batch));
+	stats.batches++;
+}
+
+void AssetStreamer::Handover (GpuDevice *direct_queue, uint64_t frame, uint64_t completed_fence_value)
+{
+	//one wait for the last batch that is finished or needed now covers every batch before it
+	uint64_t wait_value = 0;
+	for (const Batch &batch : batches)
+		if (!batch.handed_over && (batch.fence_value <= completed_fence_value || batch.deadline <= frame))
+			wait_value = batch.fence_value;
+	if (!wait_value)
+		return;
+
+	for (Batch &batch : batches)
+	{
+		if (batch.fence_value > wait_value)
+			break;
+		if (batch.handed_over)
+			continue;
+		batch.handed_over = true;
+		for (StreamId id : batch.ids)
+			entries[id].status = STREAM_STATUS_READY;
+	}
+	direct_queue->WaitForQueue (copy_queue, wait_value);
+	stats.handovers++;
+	if (wait_value > completed_fence_value)
+		stats.urgent_handovers++;
+}
+
+void AssetStreamer::Reclaim (uint64_t completed_fence_value)
+{
+	//batches that finished before their handover wait for it, it is at the end of this update
+	while (!batches.empty () && batches.front ().fence_value <= completed_fence_value && batches.front ().handed_over)
+	{
+		Batch &batch = batches.front ();
+		for (StreamId id : batch.ids)
+		{
+			Entry &entry = entries[id];
+			FreeStaging (entry);
+			entry.in_batch = false;
+			if (entry.released)
+				FreeEntry (id);
+		}
+		batch.allocator->Reset ();
+		free_allocators.push_back (std::move (batch.allocator));
+		batches.pop_front ();
+	}
+}
+
+void AssetStreamer::Read (ReadJob &job, ReadResult &result)
+{
+	result.id = job.id;
+	try
+	{
+		job.read (job.destination, job.size);
+	}
+	catch (const std::exception &err)
+	{
+		result.error = err.what ();
+		if (result.error.empty ())
+			result.error = "Stream read failed";
+	}
+	catch (...)
+	{
+		result.error = "Stream read failed";
+	}
+}
+
+void AssetStreamer::IoThread ()
+{
+	std::unique_lock<std::mutex> lock (mutex);
+	for (;;)
+	{
+		queue_cv.wait (lock, [this] { return stop || !read_queue.empty (); });
+		if (read_queue.empty ())
+			return;
+		ReadJob job = std::move (read_queue.front ());
+		read_queue.pop_front ();
+		lock.unlock ();
+
+		ReadResult result;
+		Read (job, result);
+		//drop the read function on this thread, it may own the source
+		job.read = nullptr;
+
+		lock.lock ();
+		finished_reads.push_back (std::move (result));
+	}
+}
@@ -0,0 +1,195 @@
+#pragma once
+#include "gpu_device.h"
+#include "gpu_memory.h"
+#include "upload_allocator.h"
+
+#include <stdint.h>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+//Asset streaming on a dedicated copy queue. Requests wait in a priority queue ordered by
+//deadline and screen importance; I/O threads read the most important ones into staging
+//memory as long as they fit the staging budget, and every Update () copies what was read
+//since the previous one in one batch on the copy queue. The direct queue picks finished
+//copies up with a GPU-side wait on the copy fence, so no thread blocks on the GPU.
+//
+//Destinations are buffers or textures in the common state: the copy queue promotes them
+//to the copy destination state, they decay back to common when the copy finished, and
+//their first use on the direct queue promotes them to the read state it needs.
+
+typedef uint32_t StreamId;
+static const StreamId stream_id_invalid = 0xffffffff;
+static const uint64_t stream_no_deadline = 0xffffffffffffffffull;
+//alignment of staging allocations, enough for texture data placement as well
+static const uint64_t stream_staging_alignment = 512;
+
+//fills size bytes of staging memory; runs on an I/O thread and throws on failure
+typedef std::function<void (void *destination, uint64_t size)> StreamReadFunction;
+
+struct StreamPriority
+{
+	uint64_t deadline;      //frame the asset is needed in, earlier deadlines go first
+	float importance;       //e.g. the screen area covered, higher goes first among equal deadlines
+};
+
+struct StreamRequest
+{
+	GpuResourceHandle destination;
+	uint64_t destination_offset;    //of buffers
+	uint64_t size;
+	StreamReadFunction read;
+	StreamPriority priority;
+	//texture destinations: one copy per footprint into consecutive subresources starting
+	//at first_subresource, footprint offsets relative to the read data, e.g. the data
+	//section of a texture file with GetTextureUploadFootprints
+	std::vector<GpuTextureFootprint> footprints;
+	uint32_t first_subresource;
+};
+
+enum StreamStatus
+{
+	STREAM_STATUS_QUEUED,
+	STREAM_STATUS_READING,
+	STREAM_STATUS_COPYING,
+	STREAM_STATUS_READY,        //usable by direct queue work executed after the Update () it became ready in
+	STREAM_STATUS_FAILED
+};
+
+struct AssetStreamerStats
+{
+	uint64_t requests;
+	uint64_t read_bytes;
+	uint64_t copied_bytes;
+	uint64_t batches;           //copy queue submissions
+	uint64_t handovers;         //waits of the direct queue for the copy queue
+	uint64_t urgent_handovers;  //handovers of copies still running because of a deadline
+	uint64_t budget_stalls;     //updates that left requests queued because the staging memory was in use
+	uint64_t failed;
+	uint64_t staging_used;
+	uint64_t staging_peak;
+	uint32_t queued;
+	uint32_t in_flight;         //reading or copying
+};
+
+//not thread-safe, every function is called from the thread that runs Update ()
+class AssetStreamer
+{
+public:
+	//copy_queue executes the copies; staging_size bytes of upload memory bound the bytes in
+	//flight. With 0 threads requests are read synchronously by Update ().
+	AssetStreamer (GpuDevice *copy_queue, UploadBackend *backend, uint64_t staging_size, uint32_t thread_count);
+	//drops queued requests and waits for the reads and copies in flight
+	~AssetStreamer ();
+
+	//throws std::invalid_argument if the request does not fit the staging memory
+	StreamId Request (const StreamRequest &request);
+	//reorders a queued request, e.g. when the camera moved; requests being read keep going.
+	//An earlier deadline hands a running copy over sooner.
+	void SetPriority (StreamId id, const StreamPriority &priority);
+	StreamStatus GetStatus (StreamId id) const;
+	//of a failed request
+	const std::string &GetError (StreamId id) const;
+	//forgets the request and reuses its id; queued requests are canceled, requests in
+	//flight are dropped once their copy finished
+	void Release (StreamId id);
+
+	//once per frame: reclaims the staging memory of finished copies, starts reads, submits
+	//what was read and hands finished copies over to the direct queue. Copies still running
+	//are handed over as well if a deadline is at or before frame, the direct queue then
+	//waits for them on the GPU.
+	void Update (GpuDevice *direct_queue, uint64_t frame);
+
+	AssetStreamerStats GetStats () const;
+private:
+	struct Entry
+	{
+		StreamRequest request;
+		StreamStatus status;
+		uint64_t sequence;          //request order, breaks priority ties
+		uint32_t heap_index;        //position in the priority queue while queued
+		TlsfAllocation staging;     //while reading or copying
+		bool in_batch;              //staging is held until the copy finished
+		bool released;
+		bool live;
+		std::string error;
+	};
+
+	struct ReadJob
+	{
+		StreamId id;
+		StreamReadFunction read;
+		uint8_t *destination;
+		uint64_t size;
+	};
+
+	struct ReadResult
+	{
+		StreamId id;
+		std::string error;          //empty on success
+	};
+
+	//requests copied by one submission of the copy queue
+	struct Batch
+	{
+		uint64_t fence_value;
+		std::unique_ptr<GpuCommandAllocator> allocator;
+		std::vector<StreamId> ids;
+		uint64_t deadline;          //earliest deadline of the requests
+		bool handed_over;
+	};
+
+	AssetStreamer (const AssetStreamer &) = delete;
+	AssetStreamer &operator= (const AssetStreamer &) = delete;
+
+	Entry &GetEntry (StreamId id);
+	const Entry &GetEntry (StreamId id) const;
+	void FreeEntry (StreamId id);
+	void FreeStaging (Entry &entry);
+
+	//binary heap of queued ids, the most urgent at the top
+	bool IsBefore (StreamId a, StreamId b) const;
+	void HeapMove (uint32_t index, StreamId id);
+	void SiftUp (uint32_t index);
+	void SiftDown (uint32_t index);
+	void HeapRemove (uint32_t index);
+
+	void Dispatch ();
+	void CollectReads (std::vector<ReadResult> &results);
+	void SubmitCopies (const std::vector<ReadResult> &results);
+	void Handover (GpuDevice *direct_queue, uint64_t frame, uint64_t completed_fence_value);
+	void Reclaim (uint64_t completed_fence_value);
+	static void Read (ReadJob &job, ReadResult &result);
+	void IoThread ();
+
+	GpuDevice *copy_queue;
+	UploadBackend *backend;
+	UploadChunk staging_chunk;
+	TlsfAllocator staging;
+
+	std::vector<Entry> entries;
+	std::vector<StreamId> free_ids;
+	std::vector<StreamId> heap;
+	uint64_t next_sequence;
+
+	std::unique_ptr<GpuCommandList> command_list;
+	std::vector<std::unique_ptr<GpuCommandAllocator>> free_allocators;
+	std::deque<Batch> batches;      //submitted, in fence order
+	uint64_t fence_value;           //last signaled on the copy queue
+	std::vector<ReadResult> read_results;    //of synchronous reads
+
+	std::vector<std::thread> threads;
+	std::mutex mutex;
+	std::condition_variable queue_cv;
+	std::deque<ReadJob> read_queue;
+	std::vector<ReadResult> finished_reads;
+	bool stop;
+
+	AssetStreamerStats stats;
+};
@@ -0,0 +1,53 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+//Helpers of the benchmarks. Every benchmark takes --quick to run small sizes only,
+//which is how ctest runs them to keep them building and working.
+
+inline bool IsQuickRun (int argc, char **argv)
+{
+	for (int i = 1; i < argc; i++)
+		if (strcmp (argv[i], "--quick") == 0)
+			return true;
+	return false;
+}
+
+inline uint64_t GetBenchNanoseconds ()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now ().time_since_epoch ()).count ();
+}
+
+inline double GetBenchSeconds ()
+{
+	return GetBenchNanoseconds () / 1e9;
+}
+
+//sorts the samples
+inline uint64_t GetPercentile (std::vector<uint64_t> &samples, double percentile)
+{
+	if (samples.empty ())
+		return 0;
+	std::sort (samples.begin (), samples.end ());
+	const size_t index = std::min (samples.size () - 1, static_cast<size_t>(samples.size () * percentile / 100.0));
+	return samples[index];
+}
+
+//keeps the optimizer from removing the computation of a value
+template <class T> inline void KeepValue (const T &value)
+{
+#ifdef _MSC_VER
+	//a volatile read needs the value in memory, the barrier keeps it there
+	static_cast<void>(*reinterpret_cast<const volatile char*>(&value));
+	_ReadWriteBarrier ();
+#else
+	asm volatile ("" : : "r" (&value) : "memory");
+#endif
+}
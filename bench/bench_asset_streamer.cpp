@@ -0,0 +1,153 @@
+#include "bench.h"
+#include "asset_streamer.h"
+#include "null_device.h"
+#include "memory_backends.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+
+//A level of 400 assets of 16 KB to 2 MB streamed while frames of 16.6 ms run, each asset
+//with a deadline frame and an importance. Reads are a memcpy after 200 us of latency that
+//stand in for the disk; frames are paced in real time so I/O threads overlap them, while
+//both null queues advance by the frame on their simulated timelines. For every staging
+//budget and I/O thread count: frames until everything is ready, deadlines missed, the time
+//Update () takes on the render thread, and the CPU time blocked on a fence, which is what
+//the baseline of recording every copy on the direct queue and waiting for it pays upfront.
+//Reads finished on I/O threads are submitted by the next Update (), so with a tight budget
+//the threads add a frame to every turn of the staging memory.
+
+static const uint64_t frame_ns = 16666667;
+static const uint32_t read_latency_us = 200;
+
+struct Asset
+{
+	uint64_t size;
+	uint64_t deadline;
+	float importance;
+};
+
+static StreamReadFunction MakeRead (const std::vector<uint8_t> &source)
+{
+	return [&source] (void *destination, uint64_t size)
+	{
+		std::this_thread::sleep_for (std::chrono::microseconds (read_latency_us));
+		memcpy (destination, source.data (), static_cast<size_t>(size));
+	};
+}
+
+static void StreamLevel (const std::vector<Asset> &assets, const std::vector<uint8_t> &source, uint64_t staging_size, uint32_t threads)
+{
+	NullDevice copy_queue, direct_queue;
+	MemoryUploadBackend backend;
+	AssetStreamer streamer (&copy_queue, &backend, staging_size, threads);
+	std::vector<StreamId> ids;
+	for (size_t i = 0; i < assets.size (); i++)
+	{
+		StreamRequest request;
+		request.destination = 1000 + i;
+		request.destination_offset = 0;
+		request.size = assets[i].size;
+		request.read = MakeRead (source);
+		request.priority.deadline = assets[i].deadline;
+		request.priority.importance = assets[i].importance;
+		request.first_subresource = 0;
+		ids.push_back (streamer.Request (request));
+	}
+
+	std::vector<uint64_t> update_ns;
+	std::vector<bool> ready (assets.size (), false);
+	uint32_t ready_count = 0, missed = 0;
+	uint64_t frame = 0;
+	auto next_frame = std::chrono::steady_clock::now ();
+	for (; ready_count < assets.size () && frame < 10000; frame++)
+	{
+		const uint64_t begin = GetBenchNanoseconds ();
+		streamer.Update (&direct_queue, frame);
+		update_ns.push_back (GetBenchNanoseconds () - begin);
+		for (size_t i = 0; i < assets.size (); i++)
+			if (!ready[i] && streamer.GetStatus (ids[i]) == STREAM_STATUS_READY)
+			{
+				ready[i] = true;
+				ready_count++;
+				missed += frame > assets[i].deadline;
+			}
+		copy_queue.AdvanceCpuTime (frame_ns);
+		direct_queue.AdvanceCpuTime (frame_ns);
+		next_frame += std::chrono::nanoseconds (frame_ns);
+		std::this_thread::sleep_until (next_frame);
+	}
+	const AssetStreamerStats stats = streamer.GetStats ();
+	const double longest_ms = *std::max_element (update_ns.begin (), update_ns.end ()) / 1e6;
+	printf ("%10llu %8u %8llu %8u %12.3f %12.3f %10.1f %8llu %8llu %10.3f\n",
+			static_cast<unsigned long long>(staging_size >> 20), threads, static_cast<unsigned long long>(frame), missed,
+			GetPercentile (update_ns, 50.0) / 1e6, longest_ms, stats.staging_peak / 1048576.0,
+			static_cast<unsigned long long>(stats.batches), static_cast<unsigned long long>(stats.urgent_handovers),
+			(direct_queue.GetStats ().stall_ns + copy_queue.GetStats ().stall_ns) / 1e6);
+}
+
+//the old LoadAssets: everything read, copied on the direct queue and waited for before the first frame
+static void LoadBlocking (const std::vector<Asset> &assets, const std::vector<uint8_t> &source)
+{
+	NullDevice direct_queue;
+	MemoryUploadBackend backend;
+	uint64_t total = 0;
+	for (const Asset &asset : assets)
+		total += asset.size;
+	const UploadChunk chunk = backend.CreateChunk (total);
+	NullCommandAllocator allocator;
+	std::unique_ptr<GpuCommandList> command_list = direct_queue.CreateCommandList (&allocator);
+	const StreamReadFunction read = MakeRead (source);
+	const uint64_t begin = GetBenchNanoseconds ();
+	uint64_t offset = 0;
+	for (size_t i = 0; i < assets.size (); i++)
+	{
+		read (chunk.cpu_address + offset, assets[i].size);
+		command_list->CopyBufferRegion (1000 + i, 0, chunk.resource, offset, assets[i].size);
+		offset += assets[i].size;
+	}
+	command_list->Close ();
+	GpuCommandList *lists[] = { command_list.get () };
+	direct_queue.ExecuteCommandLists (1, lists);
+	direct_queue.Signal (1);
+	const double read_ms = (GetBenchNanoseconds () - begin) / 1e6;
+	direct_queue.WaitForFenceValue (1);
+	backend.DestroyChunk (chunk);
+	printf ("blocking load: %.1f MB read on the render thread in %.1f ms, then %.3f ms blocked on the fence\n",
+			total / 1048576.0, read_ms, direct_queue.GetStats ().stall_ns / 1e6);
+}
+
+int main (int argc, char **argv)
+{
+	const bool quick = IsQuickRun (argc, argv);
+	const uint32_t asset_count = quick ? 40 : 400;
+	std::mt19937 random (11);
+	std::vector<Asset> assets (asset_count);
+	uint64_t total = 0;
+	for (Asset &asset : assets)
+	{
+		//mostly small, a few large textures
+		asset.size = random () % 8 ? 16384 + random () % (256 * 1024) : 1048576 + random () % (1024 * 1024);
+		asset.deadline = 2 + random () % 60;
+		asset.importance = (random () % 1000) / 1000.0f;
+		total += asset.size;
+	}
+	std::vector<uint8_t> source (2 * 1048576, 0x5a);
+
+	printf ("%u assets, %.1f MB, %u us read latency, frames of %.1f ms\n", asset_count, total / 1048576.0, read_latency_us, frame_ns / 1e6);
+	LoadBlocking (assets, source);
+	printf ("%10s %8s %8s %8s %12s %12s %10s %8s %8s %10s\n", "staging MB", "threads", "frames", "missed", "update ms", "longest ms",
+			"peak MB", "batches", "urgent", "stall ms");
+	const uint64_t budgets[] = { 8 << 20, 64 << 20 };
+	const uint32_t thread_counts[] = { 0, 4 };
+	for (uint64_t budget : budgets)
+		for (uint32_t threads : thread_counts)
+			if (!quick || (budget == budgets[0] && threads))
+				StreamLevel (assets, source, budget, threads);
+	return 0;
+}
@@ -0,0 +1,95 @@
+#include "bench.h"
+#include "command_recorder.h"
+#include "null_device.h"
+
+#include <stdio.h>
+
+#include <thread>
+
+//Recording time of a frame split into jobs by ParallelCommandRecorder on the null
+//device, from 1 to N threads with one job per thread, and the cost of a job at a fixed
+//thread count, which sets the fewest draws worth a job of their own.
+
+static const uint32_t frames_in_flight = 3;
+
+static void RecordDraws (uint32_t job, uint32_t job_count, uint32_t draws, GpuCommandList *command_list)
+{
+	const GpuViewport viewport = { 0.0f, 0.0f, 1920.0f, 1080.0f, 0.0f, 1.0f };
+	const GpuRect scissor = { 0, 0, 1920, 1080 };
+	const GpuDescriptorHandle render_target = 1;
+	command_list->SetViewports (1, &viewport);
+	command_list->SetScissorRects (1, &scissor);
+	command_list->SetRenderTargets (1, &render_target, nullptr);
+	command_list->SetGraphicsRootSignature (1);
+	const uint32_t first = static_cast<uint32_t>(static_cast<uint64_t>(draws) * job / job_count);
+	const uint32_t last = static_cast<uint32_t>(static_cast<uint64_t>(draws) * (job + 1) / job_count);
+	for (uint32_t draw = first; draw < last; draw++)
+	{
+		const float constants[4] = { static_cast<float>(draw), 0.0f, 0.0f, 1.0f };
+		command_list->SetGraphicsRoot32BitConstants (0, 4, constants, 0);
+		command_list->DrawIndexedInstanced (36, 1, 0, 0, 0);
+	}
+}
+
+//median milliseconds of Record () and Submit () of a frame
+static double MeasureFrames (uint32_t worker_count, uint32_t job_count, uint32_t draws, uint32_t frames)
+{
+	NullDevice device;
+	CommandAllocatorPool pool (&device);
+	JobSystem job_system (worker_count);
+	ResourceStateRegistry registry;
+	ParallelCommandRecorder recorder (&device, &pool, &job_system, &registry);
+
+	std::vector<uint64_t> samples;
+	uint64_t fence_value = 0;
+	for (uint32_t frame = 0; frame < frames; frame++)
+	{
+		if (fence_value >= frames_in_flight)
+			device.WaitForFenceValue (fence_value - frames_in_flight + 1);
+		const uint64_t begin = GetBenchNanoseconds ();
+		recorder.Record (job_count,
+						 [job_count, draws] (uint32_t job, GpuCommandList *command_list, ResourceStateTracker *)
+						 {
+							 RecordDraws (job, job_count, draws, command_list);
+						 },
+						 1, device.GetCompletedFenceValue ());
+		recorder.Submit (++fence_value);
+		device.Signal (fence_value);
+		samples.push_back (GetBenchNanoseconds () - begin);
+	}
+	return GetPercentile (samples, 50.0) / 1e6;
+}
+
+int main (int argc, char **argv)
+{
+	const bool quick = IsQuickRun (argc, argv);
+	const uint32_t frames = quick ? 5 : 50;
+	const uint32_t thread_count = std::max (std::thread::hardware_concurrency (), 1u);
+
+	printf ("recording scaling, one job per thread, %u hardware threads\n", thread_count);
+	for (uint32_t draws : { 10000u, 100000u })
+	{
+		std::vector<uint32_t> thread_counts;
+		for (uint32_t threads = 1; threads < thread_count; threads *= 2)
+			thread_counts.push_back (threads);
+		thread_counts.push_back (thread_count);
+		const double single = MeasureFrames (0, 1, draws, frames);
+		for (uint32_t threads : thread_counts)
+		{
+			const double time = threads == 1 ? single : MeasureFrames (threads - 1, threads, draws, frames);
+			printf ("%7u draws %3u threads: %8.3f ms, speedup %5.2f\n", draws, threads, time, single / time);
+		}
+	}
+
+	//extra jobs on the same threads only add the cost of their lists
+	const uint32_t workers = thread_count - 1;
+	const uint32_t draws = quick ? 1024 : 4096;
+	printf ("job overhead, %u draws on %u threads\n", draws, workers + 1);
+	const double base = MeasureFrames (workers, 1, draws, frames);
+	for (uint32_t jobs = 2; jobs <= 256; jobs *= 4)
+	{
+		const double time = MeasureFrames (workers, jobs, draws, frames);
+		printf ("%3u jobs: %8.3f ms, %6.2f us per extra job\n", jobs, time, (time - base) * 1000.0 / (jobs - 1));
+	}
+	return 0;
+}
@@ -0,0 +1,159 @@
+#include "bench.h"
+#include "draw_queue.h"
+#include "null_device.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+//A frame of 100k+ draws of 128 meshes of 4 submeshes each under 32 pipelines, submitted
+//in scene order. The radix sort against std::sort, the whole Build (), and the commands
+//recorded into a null command list: state set before every draw as the direct path does,
+//against the draw queue's filtered direct and indirect streams.
+
+static const uint32_t mesh_count = 128;
+static const uint32_t submesh_count = 4;
+static const uint32_t pipeline_count = 32;
+
+struct SceneDraw
+{
+	uint32_t pipeline;
+	uint32_t geometry;
+	float depth;
+};
+
+//every state of every draw, the way RecordCommandList issues them
+static void RecordDirect (GpuCommandList *command_list, const std::vector<SceneDraw> &draws, const std::vector<DrawGeometry> &geometries)
+{
+	for (size_t i = 0; i < draws.size (); i++)
+	{
+		const DrawGeometry &geometry = geometries[draws[i].geometry];
+		const uint32_t instance = static_cast<uint32_t>(i);
+		command_list->SetGraphicsRootSignature (1);
+		command_list->SetPipelineState (100 + draws[i].pipeline);
+		command_list->SetPrimitiveTopology (GPU_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+		command_list->SetVertexBuffers (0, 1, &geometry.vertex_buffer);
+		command_list->SetIndexBuffer (&geometry.index_buffer);
+		command_list->SetGraphicsRoot32BitConstants (geometry.constants_parameter, geometry.constant_count, geometry.constants, 0);
+		command_list->SetGraphicsRoot32BitConstants (2, 1, &instance, 0);
+		command_list->DrawIndexedInstanced (geometry.count, 1, geometry.start, geometry.base_vertex, 0);
+	}
+}
+
+int main (int argc, char **argv)
+{
+	const bool quick = IsQuickRun (argc, argv);
+	const uint32_t draw_count = quick ? 5000 : 131072;
+	const uint32_t iterations = quick ? 2 : 20;
+
+	DrawQueue queue;
+	const uint32_t root_signature = queue.AddRootSignature (1);
+	for (uint32_t p = 0; p < pipeline_count; p++)
+		queue.AddPipeline (100 + p, GPU_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	std::vector<DrawGeometry> geometries;
+	for (uint32_t m = 0; m < mesh_count; m++)
+		for (uint32_t s = 0; s < submesh_count; s++)
+		{
+			DrawGeometry geometry;
+			memset (&geometry, 0, sizeof (geometry));
+			geometry.vertex_buffer.location = 0x100000ull * (m + 1);
+			geometry.vertex_buffer.size = 65536;
+			geometry.vertex_buffer.stride = 20;
+			geometry.index_buffer.location = 0x100000ull * (m + 1) + 65536;
+			geometry.index_buffer.size = 65536;
+			geometry.index_buffer.format = 57;
+			geometry.count = 600;
+			geometry.start = s * 600;
+			geometry.constants_parameter = 1;
+			geometry.constant_count = 6;
+			geometry.constants[0] = m;
+			geometries.push_back (geometry);
+			queue.AddGeometry (geometry);
+		}
+
+	//objects in scene order, each object a mesh of one material
+	std::mt19937 random (1);
+	std::vector<SceneDraw> draws;
+	while (draws.size () < draw_count)
+	{
+		const uint32_t mesh = random () % mesh_count;
+		const float depth = (random () % 10000) / 10000.0f;
+		for (uint32_t s = 0; s < submesh_count && draws.size () < draw_count; s++)
+		{
+			const SceneDraw draw = { mesh % pipeline_count, mesh * submesh_count + s, depth };
+			draws.push_back (draw);
+		}
+	}
+	std::vector<DrawPacket> packets;
+	for (size_t i = 0; i < draws.size (); i++)
+	{
+		const DrawPacket packet = { MakeDrawSortKey (0, DRAW_ORDER_STATE, root_signature, draws[i].pipeline, draws[i].geometry, draws[i].depth),
+									static_cast<uint32_t>(i), 0 };
+		packets.push_back (packet);
+	}
+	printf ("%u draws of %u geometries, %u pipelines\n", draw_count, mesh_count * submesh_count, pipeline_count);
+
+	std::vector<uint64_t> radix_samples, std_samples, build_samples, indirect_samples;
+	std::vector<DrawPacket> sorted, scratch;
+	for (uint32_t i = 0; i < iterations; i++)
+	{
+		sorted = packets;
+		uint64_t begin = GetBenchNanoseconds ();
+		SortDrawPackets (sorted, scratch);
+		radix_samples.push_back (GetBenchNanoseconds () - begin);
+		KeepValue (sorted[i % sorted.size ()].key);
+
+		sorted = packets;
+		begin = GetBenchNanoseconds ();
+		std::sort (sorted.begin (), sorted.end (), [] (const DrawPacket &a, const DrawPacket &b) { return a.key < b.key; });
+		std_samples.push_back (GetBenchNanoseconds () - begin);
+		KeepValue (sorted[i % sorted.size ()].key);
+
+		for (int indirect = 0; indirect < 2; indirect++)
+		{
+			queue.Reset ();
+			begin = GetBenchNanoseconds ();
+			for (const DrawPacket &packet : packets)
+				queue.Submit (packet.key, packet.instance);
+			queue.Build (indirect != 0);
+			(indirect ? indirect_samples : build_samples).push_back (GetBenchNanoseconds () - begin);
+		}
+	}
+	const double radix = static_cast<double>(GetPercentile (radix_samples, 50.0));
+	printf ("sort:           radix %7.3f ms (%6.1f Mdraws/s), std::sort %7.3f ms (%6.1f Mdraws/s)\n", radix / 1e6, draw_count * 1e3 / radix,
+			GetPercentile (std_samples, 50.0) / 1e6, draw_count * 1e3 / GetPercentile (std_samples, 50.0));
+	printf ("submit + build: %7.3f ms direct, %7.3f ms with indirect arguments\n", GetPercentile (build_samples, 50.0) / 1e6,
+			GetPercentile (indirect_samples, 50.0) / 1e6);
+	printf ("%u instanced draws in %u groups\n", queue.GetBatchCount (), queue.GetGroupCount ());
+
+	//recording, the queue as left by the last indirect build
+	const GpuVertexBufferView instance_buffer = { 0x80000000ull, draw_count * 4, 4 };
+	const DrawIndirectBuffers indirect = { 1, 2, 3, 0 };
+	printf ("%-24s %12s %12s %10s\n", "recording", "commands", "bytes", "ms");
+	for (int mode = 0; mode < 3; mode++)
+	{
+		const char *names[] = { "state per draw", "draw queue", "draw queue indirect" };
+		std::vector<uint64_t> samples;
+		uint32_t commands = 0;
+		size_t bytes = 0;
+		for (uint32_t i = 0; i < iterations; i++)
+		{
+			NullCommandAllocator allocator;
+			NullCommandList command_list (&allocator);
+			const uint64_t begin = GetBenchNanoseconds ();
+			if (mode == 0)
+				RecordDirect (&command_list, draws, geometries);
+			else
+				queue.Record (&command_list, 0, queue.GetGroupCount (), &instance_buffer, mode == 2 ? &indirect : nullptr);
+			samples.push_back (GetBenchNanoseconds () - begin);
+			command_list.Close ();
+			commands = command_list.GetCommandCount ();
+			bytes = command_list.GetCommandsSize ();
+		}
+		printf ("%-24s %12u %12zu %10.3f\n", names[mode], commands, bytes, GetPercentile (samples, 50.0) / 1e6);
+	}
+	return 0;
+}
@@ -0,0 +1,48 @@
+#include "bench.h"
+#include "frame_scheduler.h"
+#include "null_device.h"
+
+#include <stdio.h>
+
+//CPU stall time and frame latency of the scheduler on the simulated timeline of a null
+//device, for 1 to 4 frames in flight, both policies and CPU/GPU cost ratios from CPU
+//bound to GPU bound. The times are simulated, only the frame count depends on --quick.
+
+static const uint64_t frame_ns = 10000000;
+
+static void RunSimulation (uint32_t frames_in_flight, FramePacingPolicy policy, uint64_t cpu_ns, uint64_t gpu_ns, uint32_t frames)
+{
+	NullDeviceDesc desc;
+	desc.gpu_ns_per_list = 0;
+	NullDevice device (desc);
+	FrameScheduler scheduler (&device, frames_in_flight, policy);
+	scheduler.SetClock ([&device]() { return device.GetCpuTime (); });
+	for (uint32_t frame = 0; frame < frames; frame++)
+	{
+		scheduler.BeginFrame ();
+		device.AdvanceCpuTime (cpu_ns);
+		device.AddGpuWork (gpu_ns);
+		device.ExecuteCommandLists (0, nullptr);
+		scheduler.EndFrame ();
+	}
+	scheduler.WaitForIdle ();
+
+	const FrameSchedulerStats &stats = scheduler.GetStats ();
+	printf ("%u %-10s cpu %4.1f gpu %4.1f ms: %6.2f ms/frame, stall %5.2f ms/frame, latency avg %5.2f max %5.2f ms, %llu/%llu retired\n",
+			frames_in_flight, policy == FRAME_POLICY_LOW_LATENCY ? "latency" : "throughput", cpu_ns / 1e6, gpu_ns / 1e6,
+			device.GetCpuTime () / 1e6 / frames, stats.stall_ns / 1e6 / frames,
+			stats.completed_frames ? stats.total_latency_ns / 1e6 / stats.completed_frames : 0.0, stats.max_latency_ns / 1e6,
+			static_cast<unsigned long long>(stats.completed_frames), static_cast<unsigned long long>(stats.frames));
+}
+
+int main (int argc, char **argv)
+{
+	const uint32_t frames = IsQuickRun (argc, argv) ? 50 : 1000;
+	//share of the frame time spent on the CPU, the GPU takes the rest
+	const uint64_t cpu_shares[] = { 8, 5, 2 };
+	for (FramePacingPolicy policy : { FRAME_POLICY_MAX_THROUGHPUT, FRAME_POLICY_LOW_LATENCY })
+		for (uint32_t frames_in_flight = 1; frames_in_flight <= max_frames_in_flight; frames_in_flight++)
+			for (uint64_t cpu_share : cpu_shares)
+				RunSimulation (frames_in_flight, policy, frame_ns * cpu_share / 10, frame_ns * (10 - cpu_share) / 10, frames);
+	return 0;
+}
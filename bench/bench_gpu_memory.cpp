@@ -0,0 +1,147 @@
+#include "bench.h"
+#include "gpu_memory.h"
+#include "null_device.h"
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <random>
+#include <unordered_map>
+
+//Allocation churn of buffers through the TLSF heaps against one heap per resource,
+//the way committed resources are placed. Heaps of the null backend are bookkeeping only,
+//so the baseline leaves out the driver cost of creating a heap; the heap creations and
+//the memory reserved for the live resources are printed to compare that cost.
+
+class CountingHeapBackend : public GpuHeapBackend
+{
+public:
+	explicit CountingHeapBackend (GpuHeapBackend *heap_backend) :
+		backend (heap_backend),
+		created (0),
+		reserved (0),
+		peak_reserved (0)
+	{
+	}
+	GpuHeapHandle CreateHeap (GpuHeapTier tier, uint64_t size) override
+	{
+		created++;
+		reserved += size;
+		peak_reserved = std::max (peak_reserved, reserved);
+		const GpuHeapHandle heap = backend->CreateHeap (tier, size);
+		sizes[heap] = size;
+		return heap;
+	}
+	void DestroyHeap (GpuHeapHandle heap) override
+	{
+		reserved -= sizes[heap];
+		sizes.erase (heap);
+		backend->DestroyHeap (heap);
+	}
+
+	GpuHeapBackend *backend;
+	uint64_t created;
+	uint64_t reserved;
+	uint64_t peak_reserved;
+	std::unordered_map<GpuHeapHandle, uint64_t> sizes;
+};
+
+struct ChurnResult
+{
+	double ns_per_operation;
+	uint64_t peak_requested;
+	uint64_t peak_reserved;
+	uint64_t heaps_created;
+};
+
+static void PrintResult (const char *name, const ChurnResult &result)
+{
+	printf ("%-14s %7.1f ns/op, peak %7.1f MB reserved for %7.1f MB requested (%.2fx), %llu heaps created\n",
+			name, result.ns_per_operation, result.peak_reserved / 1048576.0, result.peak_requested / 1048576.0,
+			static_cast<double>(result.peak_reserved) / result.peak_requested,
+			static_cast<unsigned long long>(result.heaps_created));
+}
+
+//placed buffers of 64 KB to 16 MB, as many of each power of two, a random live one is freed per allocation
+static uint64_t GetChurnSize (std::mt19937 &random)
+{
+	const uint32_t shift = 16 + random () % 8;
+	return (1ull << shift) + random () % (1ull << shift);
+}
+
+int main (int argc, char **argv)
+{
+	const bool quick = IsQuickRun (argc, argv);
+	const uint32_t operations = quick ? 20000 : 1000000;
+	const uint32_t live_count = 500;
+
+	NullMemory memory (1ull << 40);
+	{
+		CountingHeapBackend backend (&memory);
+		std::mt19937 random (11);
+		ChurnResult result = {};
+		{
+			GpuMemoryAllocator allocator (&backend, 64ull << 20);
+			std::vector<GpuMemoryAllocation> live;
+			uint64_t requested = 0;
+			const uint64_t begin = GetBenchNanoseconds ();
+			for (uint32_t i = 0; i < operations; i++)
+			{
+				if (live.size () >= live_count)
+				{
+					const size_t index = random () % live.size ();
+					requested -= live[index].size;
+					allocator.Free (live[index]);
+					live[index] = live.back ();
+					live.pop_back ();
+				}
+				live.push_back (allocator.Allocate (GPU_HEAP_TIER_BUFFERS, GetChurnSize (random), gpu_default_placement_alignment));
+				requested += live.back ().size;
+				result.peak_requested = std::max (result.peak_requested, requested);
+			}
+			result.ns_per_operation = static_cast<double>(GetBenchNanoseconds () - begin) / operations;
+			for (const GpuMemoryAllocation &allocation : live)
+				allocator.Free (allocation);
+		}
+		result.peak_reserved = backend.peak_reserved;
+		result.heaps_created = backend.created;
+		PrintResult ("tlsf heaps:", result);
+	}
+	{
+		CountingHeapBackend backend (&memory);
+		std::mt19937 random (11);
+		ChurnResult result = {};
+		struct Resource
+		{
+			GpuHeapHandle heap;
+			uint64_t size;
+		};
+		std::vector<Resource> live;
+		uint64_t requested = 0;
+		const uint64_t begin = GetBenchNanoseconds ();
+		for (uint32_t i = 0; i < operations; i++)
+		{
+			if (live.size () >= live_count)
+			{
+				const size_t index = random () % live.size ();
+				requested -= live[index].size;
+				backend.DestroyHeap (live[index].heap);
+				live[index] = live.back ();
+				live.pop_back ();
+			}
+			const uint64_t size = GetChurnSize (random);
+			const uint64_t heap_size = (size + gpu_default_placement_alignment - 1) / gpu_default_placement_alignment * gpu_default_placement_alignment;
+			const Resource resource = { backend.CreateHeap (GPU_HEAP_TIER_BUFFERS, heap_size), size };
+			live.push_back (resource);
+			requested += size;
+			result.peak_requested = std::max (result.peak_requested, requested);
+		}
+		result.ns_per_operation = static_cast<double>(GetBenchNanoseconds () - begin) / operations;
+		for (const Resource &resource : live)
+			backend.DestroyHeap (resource.heap);
+		result.peak_reserved = backend.peak_reserved;
+		result.heaps_created = backend.created;
+		PrintResult ("heap/resource:", result);
+	}
+	return 0;
+}
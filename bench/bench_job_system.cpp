@@ -0,0 +1,174 @@
+#include "bench.h"
+#include "job_system.h"
+
+#include <math.h>
+#include <stdio.h>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+//Spawn latency and ParallelFor scaling of the job system against a naive pool of
+//std::thread workers sharing one locked queue, from 1 to N threads.
+
+//the baseline: one mutex and condition variable guard a queue of tasks
+class NaivePool
+{
+public:
+	explicit NaivePool (uint32_t worker_count) :
+		pending (0),
+		stop (false)
+	{
+		for (uint32_t i = 0; i < worker_count; i++)
+			threads.emplace_back ([this]() { WorkerThread (); });
+	}
+	~NaivePool ()
+	{
+		{
+			std::lock_guard<std::mutex> lock (mutex);
+			stop = true;
+		}
+		work_cv.notify_all ();
+		for (std::thread &thread : threads)
+			thread.join ();
+	}
+	void Spawn (std::function<void ()> task)
+	{
+		{
+			std::lock_guard<std::mutex> lock (mutex);
+			tasks.push_back (std::move (task));
+			pending++;
+		}
+		work_cv.notify_one ();
+	}
+	//the calling thread runs tasks too while it waits
+	void Wait ()
+	{
+		std::unique_lock<std::mutex> lock (mutex);
+		while (pending)
+		{
+			if (!tasks.empty ())
+			{
+				RunTask (lock);
+				continue;
+			}
+			done_cv.wait (lock);
+		}
+	}
+	void ParallelFor (uint32_t count, uint32_t chunk, const std::function<void (uint32_t, uint32_t)> &body)
+	{
+		for (uint32_t begin = 0; begin < count; begin += chunk)
+		{
+			const uint32_t end = std::min (count, begin + chunk);
+			Spawn ([&body, begin, end]() { body (begin, end); });
+		}
+		Wait ();
+	}
+private:
+	void RunTask (std::unique_lock<std::mutex> &lock)
+	{
+		std::function<void ()> task = std::move (tasks.front ());
+		tasks.pop_front ();
+		lock.unlock ();
+		task ();
+		lock.lock ();
+		if (--pending == 0)
+			done_cv.notify_all ();
+	}
+	void WorkerThread ()
+	{
+		std::unique_lock<std::mutex> lock (mutex);
+		while (!stop)
+		{
+			if (tasks.empty ())
+				work_cv.wait (lock);
+			else
+				RunTask (lock);
+		}
+	}
+
+	std::vector<std::thread> threads;
+	std::mutex mutex;
+	std::condition_variable work_cv;
+	std::condition_variable done_cv;
+	std::deque<std::function<void ()>> tasks;
+	uint32_t pending;
+	bool stop;
+};
+
+static void Work (std::vector<float> &data, uint32_t begin, uint32_t end)
+{
+	for (uint32_t i = begin; i < end; i++)
+		data[i] = sqrtf (data[i] * 1.0001f + 1.0f);
+}
+
+int main (int argc, char **argv)
+{
+	const bool quick = IsQuickRun (argc, argv);
+	const uint32_t hardware_threads = std::max (std::thread::hardware_concurrency (), 1u);
+	std::vector<uint32_t> thread_counts;
+	for (uint32_t threads = 1; threads < hardware_threads; threads *= 2)
+		thread_counts.push_back (threads);
+	thread_counts.push_back (hardware_threads);
+
+	const uint32_t spawn_count = quick ? 1000 : 100000;
+	const uint32_t repeats = quick ? 2 : 10;
+	const uint32_t element_count = quick ? 1 << 16 : 1 << 22;
+	const uint32_t chunk = 1024;
+	std::vector<float> data (element_count, 1.0f);
+
+	printf ("%u hardware threads; spawn: empty jobs spawned and waited for, ns per job;\n"
+			"parallel for: %u elements in chunks of %u, ms\n", hardware_threads, element_count, chunk);
+	for (uint32_t threads : thread_counts)
+	{
+		double spawn_ns[2];
+		double for_ms[2];
+		{
+			JobSystem job_system (threads - 1);
+			const uint64_t begin = GetBenchNanoseconds ();
+			for (uint32_t repeat = 0; repeat < repeats; repeat++)
+			{
+				JobCounter counter;
+				for (uint32_t i = 0; i < spawn_count; i++)
+					job_system.Spawn ([]() {}, counter);
+				job_system.Wait (counter);
+			}
+			spawn_ns[0] = static_cast<double>(GetBenchNanoseconds () - begin) / (static_cast<double>(spawn_count) * repeats);
+
+			std::vector<uint64_t> samples;
+			for (uint32_t repeat = 0; repeat < repeats; repeat++)
+			{
+				const uint64_t for_begin = GetBenchNanoseconds ();
+				job_system.ParallelFor (element_count, chunk, [&data] (uint32_t range_begin, uint32_t range_end) { Work (data, range_begin, range_end); });
+				samples.push_back (GetBenchNanoseconds () - for_begin);
+			}
+			for_ms[0] = GetPercentile (samples, 50.0) / 1e6;
+		}
+		{
+			NaivePool pool (threads - 1);
+			const uint64_t begin = GetBenchNanoseconds ();
+			for (uint32_t repeat = 0; repeat < repeats; repeat++)
+			{
+				for (uint32_t i = 0; i < spawn_count; i++)
+					pool.Spawn ([]() {});
+				pool.Wait ();
+			}
+			spawn_ns[1] = static_cast<double>(GetBenchNanoseconds () - begin) / (static_cast<double>(spawn_count) * repeats);
+
+			std::vector<uint64_t> samples;
+			for (uint32_t repeat = 0; repeat < repeats; repeat++)
+			{
+				const uint64_t for_begin = GetBenchNanoseconds ();
+				pool.ParallelFor (element_count, chunk, [&data] (uint32_t range_begin, uint32_t range_end) { Work (data, range_begin, range_end); });
+				samples.push_back (GetBenchNanoseconds () - for_begin);
+			}
+			for_ms[1] = GetPercentile (samples, 50.0) / 1e6;
+		}
+		printf ("%3u threads: spawn %7.1f ns (naive %7.1f), parallel for %7.3f ms (naive %7.3f)\n",
+				threads, spawn_ns[0], spawn_ns[1], for_ms[0], for_ms[1]);
+	}
+	KeepValue (data[element_count / 2]);
+	return 0;
+}
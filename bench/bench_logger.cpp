@@ -0,0 +1,73 @@
+#include "bench.h"
+#include "logger.h"
+
+#include <thread>
+
+//Throughput of the logger and latency of its producers at 1 to 16 threads writing at
+//once, in blocking and in dropping overflow mode. The throughput counts the messages of
+//all threads until they are written to the file.
+
+static void WriteMessage (Logger &logger, const char *format_str, ...)
+{
+	va_list args;
+	va_start (args, format_str);
+	logger.Write (LOG_SEVERITY_INFO, format_str, args);
+	va_end (args);
+}
+
+static void RunBenchmark (LogOverflowMode overflow_mode, unsigned threads_count, unsigned messages_per_thread)
+{
+	LoggerDesc desc;
+	desc.file_name = "bench_logger.log";
+	desc.overflow_mode = overflow_mode;
+	Logger logger;
+	if (!logger.Open (desc))
+	{
+		printf ("cannot open %s\n", desc.file_name);
+		return;
+	}
+
+	std::vector<std::vector<uint64_t>> latencies (threads_count);
+	std::vector<std::thread> threads;
+	const uint64_t begin = GetBenchNanoseconds ();
+	for (unsigned t = 0; t < threads_count; t++)
+		threads.emplace_back ([&logger, &latencies, t, messages_per_thread]()
+		{
+			std::vector<uint64_t> &samples = latencies[t];
+			samples.reserve (messages_per_thread);
+			for (unsigned i = 0; i < messages_per_thread; i++)
+			{
+				const uint64_t write_begin = GetBenchNanoseconds ();
+				WriteMessage (logger, "thread %u frame %u value %f", t, i, i * 0.5);
+				samples.push_back (GetBenchNanoseconds () - write_begin);
+			}
+		});
+	for (std::thread &thread : threads)
+		thread.join ();
+	logger.Flush ();
+	const double seconds = (GetBenchNanoseconds () - begin) / 1e9;
+
+	std::vector<uint64_t> samples;
+	for (const std::vector<uint64_t> &thread_samples : latencies)
+		samples.insert (samples.end (), thread_samples.begin (), thread_samples.end ());
+	const uint64_t written = logger.GetWrittenCount ();
+	const uint64_t dropped = logger.GetDroppedCount ();
+	logger.Close ();
+
+	printf ("%-5s %2u threads: %10.0f msgs/s written, p50 %6llu ns, p99 %7llu ns, dropped %llu\n",
+			overflow_mode == LOG_OVERFLOW_BLOCK ? "block" : "drop", threads_count, written / seconds,
+			static_cast<unsigned long long>(GetPercentile (samples, 50.0)),
+			static_cast<unsigned long long>(GetPercentile (samples, 99.0)),
+			static_cast<unsigned long long>(dropped));
+}
+
+int main (int argc, char **argv)
+{
+	const bool quick = IsQuickRun (argc, argv);
+	const unsigned messages_count = quick ? 20000 : 1000000;
+	const unsigned threads_counts[] = { 1, 2, 4, 8, 16 };
+	for (LogOverflowMode overflow_mode : { LOG_OVERFLOW_BLOCK, LOG_OVERFLOW_DROP })
+		for (unsigned threads_count : threads_counts)
+			RunBenchmark (overflow_mode, threads_count, messages_count / threads_count);
+	return 0;
+}
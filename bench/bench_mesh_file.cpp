@@ -0,0 +1,150 @@
+#include "bench.h"
+#include "mesh_file.h"
+#include "mesh_import.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+//Loading a grid mesh with normals and texcoords into upload memory: the mesh container
+//mapped and copied from the mapping, the same file read into std::vectors stream by
+//stream as a naive loader would, and the OBJ text it was converted from. Throughput is
+//of the vertex and index bytes that reach upload memory, a preallocated buffer here.
+//The file is in the page cache, so the numbers leave out the disk.
+
+static const char *mesh_file_name = "bench_mesh_file.mesh";
+
+static std::string MakeGridObj (uint32_t size)
+{
+	std::string text;
+	char line[128];
+	for (uint32_t y = 0; y <= size; y++)
+		for (uint32_t x = 0; x <= size; x++)
+		{
+			snprintf (line, sizeof (line), "v %.4f %.4f 0\nvt %.5f %.5f\n", x * 0.1f, y * 0.1f, static_cast<float>(x) / size, static_cast<float>(y) / size);
+			text += line;
+		}
+	text += "vn 0 0 1\n";
+	const uint32_t row = size + 1;
+	for (uint32_t y = 0; y < size; y++)
+		for (uint32_t x = 0; x < size; x++)
+		{
+			const uint32_t a = y * row + x + 1;
+			const uint32_t b = a + 1;
+			const uint32_t c = a + row + 1;
+			const uint32_t d = a + row;
+			snprintf (line, sizeof (line), "f %u/%u/1 %u/%u/1 %u/%u/1 %u/%u/1\n", a, a, b, b, c, c, d, d);
+			text += line;
+		}
+	return text;
+}
+
+static bool WriteWholeFile (const char *file_name, const std::vector<uint8_t> &data)
+{
+	FILE *f = fopen (file_name, "wb");
+	if (!f)
+		return false;
+	const bool written = fwrite (data.data (), 1, data.size (), f) == data.size ();
+	return fclose (f) == 0 && written;
+}
+
+//the whole file through a mapping, streams copied once
+static uint64_t LoadMapped (uint8_t *upload)
+{
+	MappedFile mapped;
+	MeshView view;
+	if (!mapped.Open (mesh_file_name) || !ReadMeshFile (mapped.GetData (), mapped.GetSize (), view))
+		return 0;
+	mapped.Prefetch (static_cast<size_t>(view.header->vertex_offset), static_cast<size_t>(view.vertex_size + view.index_size));
+	memcpy (upload, view.vertices, static_cast<size_t>(view.vertex_size));
+	memcpy (upload + view.vertex_size, view.indices, static_cast<size_t>(view.index_size));
+	return view.vertex_size + view.index_size;
+}
+
+//fread into vectors of each part, indices widened to 32 bits, then copied to upload memory
+static uint64_t LoadIntoVectors (uint8_t *upload)
+{
+	FILE *f = fopen (mesh_file_name, "rb");
+	if (!f)
+		return 0;
+	MeshFileHeader header;
+	if (fread (&header, sizeof (header), 1, f) != 1)
+	{
+		fclose (f);
+		return 0;
+	}
+	std::vector<MeshSubmesh> submeshes (header.submesh_count);
+	std::vector<uint8_t> vertices (static_cast<size_t>(header.vertex_count) * header.vertex_stride);
+	std::vector<uint32_t> indices (header.index_count);
+	fseek (f, static_cast<long>(header.submesh_offset), SEEK_SET);
+	size_t read = fread (submeshes.data (), sizeof (MeshSubmesh), submeshes.size (), f);
+	fseek (f, static_cast<long>(header.vertex_offset), SEEK_SET);
+	read += fread (vertices.data (), 1, vertices.size (), f);
+	std::vector<uint8_t> stored_indices (static_cast<size_t>(header.index_count) * header.index_size);
+	fseek (f, static_cast<long>(header.index_offset), SEEK_SET);
+	read += fread (stored_indices.data (), 1, stored_indices.size (), f);
+	fclose (f);
+	for (uint32_t i = 0; i < header.index_count; i++)
+	{
+		uint32_t index = 0;
+		memcpy (&index, stored_indices.data () + i * header.index_size, header.index_size);
+		indices[i] = index;
+	}
+	KeepValue (read);
+	memcpy (upload, vertices.data (), vertices.size ());
+	memcpy (upload + vertices.size (), indices.data (), indices.size () * sizeof (uint32_t));
+	return vertices.size () + indices.size () * sizeof (uint32_t);
+}
+
+int main (int argc, char **argv)
+{
+	const bool quick = IsQuickRun (argc, argv);
+	const uint32_t grid_size = quick ? 32 : 700;
+	const uint32_t iterations = quick ? 2 : 10;
+
+	const std::string obj = MakeGridObj (grid_size);
+	MeshData mesh;
+	std::vector<std::string> materials;
+	ImportObj (obj, mesh, materials);
+	std::vector<uint8_t> file;
+	WriteMeshFile (mesh, file);
+	if (!WriteWholeFile (mesh_file_name, file))
+	{
+		printf ("Can not write %s\n", mesh_file_name);
+		return 1;
+	}
+	printf ("%u vertices of %u bytes, %zu indices, %.1f MB file, %.1f MB OBJ\n", mesh.GetVertexCount (), mesh.vertex_stride,
+			mesh.indices.size (), file.size () / 1e6, obj.size () / 1e6);
+
+	std::vector<uint8_t> upload (mesh.vertices.size () + mesh.indices.size () * sizeof (uint32_t), 1);
+	for (int loader = 0; loader < 3; loader++)
+	{
+		const char *names[] = { "mapped:", "read into vectors:", "OBJ import:" };
+		std::vector<uint64_t> samples;
+		uint64_t bytes = 0;
+		for (uint32_t i = 0; i < iterations; i++)
+		{
+			const uint64_t begin = GetBenchNanoseconds ();
+			if (loader == 0)
+				bytes = LoadMapped (upload.data ());
+			else if (loader == 1)
+				bytes = LoadIntoVectors (upload.data ());
+			else
+			{
+				MeshData imported;
+				ImportObj (obj, imported, materials);
+				memcpy (upload.data (), imported.vertices.data (), imported.vertices.size ());
+				memcpy (upload.data () + imported.vertices.size (), imported.indices.data (), imported.indices.size () * sizeof (uint32_t));
+				bytes = imported.vertices.size () + imported.indices.size () * sizeof (uint32_t);
+			}
+			samples.push_back (GetBenchNanoseconds () - begin);
+			KeepValue (upload[upload.size () / 2]);
+		}
+		const uint64_t median = GetPercentile (samples, 50.0);
+		printf ("%-20s %9.3f ms, %7.2f GB/s\n", names[loader], median / 1e6, bytes / static_cast<double>(median));
+	}
+	remove (mesh_file_name);
+	return 0;
+}
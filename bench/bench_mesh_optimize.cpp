@@ -0,0 +1,148 @@
+#include "bench.h"
+#include "mesh_optimize.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+//The mesh optimizer on a grid and on nested spheres with their triangles shuffled, as
+//an exporter that writes faces in no useful order would leave them: ACMR and ATVR of a
+//16 entry FIFO cache and the overdraw of the six axis views before and after each
+//stage, the time of each stage and of meshlet building. Only the nested spheres hide
+//triangles behind others, so only they can lose overdraw.
+
+struct Geometry
+{
+	std::vector<float> positions;
+	std::vector<uint32_t> indices;
+
+	uint32_t GetVertexCount () const
+	{
+		return static_cast<uint32_t>(positions.size () / 3);
+	}
+};
+
+static Geometry MakeGrid (uint32_t size)
+{
+	Geometry grid;
+	for (uint32_t y = 0; y <= size; y++)
+		for (uint32_t x = 0; x <= size; x++)
+			grid.positions.insert (grid.positions.end (), { static_cast<float>(x), static_cast<float>(y), 0.0f });
+	for (uint32_t y = 0; y < size; y++)
+		for (uint32_t x = 0; x < size; x++)
+		{
+			const uint32_t a = y * (size + 1) + x;
+			grid.indices.insert (grid.indices.end (), { a, a + size + 1, a + 1, a + 1, a + size + 1, a + size + 2 });
+		}
+	return grid;
+}
+
+//concentric spheres, innermost first, with clockwise front faces pointing outwards and
+//the degenerate triangles at the poles left out
+static Geometry MakeNestedSpheres (uint32_t count, uint32_t rings, uint32_t segments)
+{
+	Geometry spheres;
+	for (uint32_t sphere = 0; sphere < count; sphere++)
+	{
+		const uint32_t first = spheres.GetVertexCount ();
+		const float radius = static_cast<float>(sphere + 1) / count;
+		for (uint32_t ring = 0; ring <= rings; ring++)
+			for (uint32_t segment = 0; segment <= segments; segment++)
+			{
+				const float theta = 3.14159265f * ring / rings;
+				const float phi = 2.0f * 3.14159265f * segment / segments;
+				spheres.positions.insert (spheres.positions.end (), { radius * sinf (theta) * cosf (phi), radius * cosf (theta), radius * sinf (theta) * sinf (phi) });
+			}
+		for (uint32_t ring = 0; ring < rings; ring++)
+			for (uint32_t segment = 0; segment < segments; segment++)
+			{
+				const uint32_t a = first + ring * (segments + 1) + segment;
+				if (ring > 0)
+					spheres.indices.insert (spheres.indices.end (), { a, a + segments + 1, a + 1 });
+				if (ring < rings - 1)
+					spheres.indices.insert (spheres.indices.end (), { a + 1, a + segments + 1, a + segments + 2 });
+			}
+	}
+	return spheres;
+}
+
+static void ShuffleTriangles (std::vector<uint32_t> &indices)
+{
+	std::vector<uint32_t> order (indices.size () / 3);
+	for (uint32_t t = 0; t < order.size (); t++)
+		order[t] = t;
+	std::shuffle (order.begin (), order.end (), std::mt19937 (1));
+	const std::vector<uint32_t> source = indices;
+	for (size_t t = 0; t < order.size (); t++)
+		memcpy (&indices[t * 3], &source[order[t] * 3], 3 * sizeof (uint32_t));
+}
+
+static void PrintOrder (const char *name, const Geometry &geometry, const std::vector<uint32_t> &indices, double milliseconds)
+{
+	const VertexCacheStats cache = AnalyzeVertexCache (indices.data (), indices.size (), geometry.GetVertexCount ());
+	const OverdrawStats overdraw = AnalyzeOverdraw (indices.data (), indices.size (), geometry.positions.data (), 12, geometry.GetVertexCount ());
+	printf ("  %-16s ACMR %5.3f  ATVR %5.3f  overdraw %5.3f", name, cache.acmr, cache.atvr, overdraw.overdraw);
+	if (milliseconds > 0.0)
+		printf ("  %9.2f ms", milliseconds);
+	printf ("\n");
+}
+
+static void RunMesh (const char *name, Geometry geometry, uint32_t iterations)
+{
+	const size_t triangles = geometry.indices.size () / 3;
+	ShuffleTriangles (geometry.indices);
+	printf ("%s: %u vertices, %zu triangles\n", name, geometry.GetVertexCount (), triangles);
+	PrintOrder ("shuffled", geometry, geometry.indices, 0.0);
+
+	std::vector<uint32_t> cache_order (geometry.indices.size ());
+	std::vector<uint64_t> samples;
+	for (uint32_t i = 0; i < iterations; i++)
+	{
+		const uint64_t begin = GetBenchNanoseconds ();
+		OptimizeVertexCache (cache_order.data (), geometry.indices.data (), geometry.indices.size (), geometry.GetVertexCount ());
+		samples.push_back (GetBenchNanoseconds () - begin);
+		KeepValue (cache_order[i % cache_order.size ()]);
+	}
+	const uint64_t cache_time = GetPercentile (samples, 50.0);
+	PrintOrder ("vertex cache", geometry, cache_order, cache_time / 1e6);
+
+	std::vector<uint32_t> overdraw_order (geometry.indices.size ());
+	samples.clear ();
+	for (uint32_t i = 0; i < iterations; i++)
+	{
+		const uint64_t begin = GetBenchNanoseconds ();
+		OptimizeOverdraw (overdraw_order.data (), cache_order.data (), cache_order.size (), geometry.positions.data (), 12, geometry.GetVertexCount ());
+		samples.push_back (GetBenchNanoseconds () - begin);
+		KeepValue (overdraw_order[i % overdraw_order.size ()]);
+	}
+	const uint64_t overdraw_time = GetPercentile (samples, 50.0);
+	PrintOrder ("overdraw", geometry, overdraw_order, overdraw_time / 1e6);
+
+	samples.clear ();
+	size_t meshlet_count = 0;
+	for (uint32_t i = 0; i < iterations; i++)
+	{
+		MeshletData meshlets;
+		const uint64_t begin = GetBenchNanoseconds ();
+		BuildMeshlets (overdraw_order.data (), overdraw_order.size (), geometry.positions.data (), 12, geometry.GetVertexCount (),
+					   meshlet_max_vertices, meshlet_max_triangles, meshlets);
+		samples.push_back (GetBenchNanoseconds () - begin);
+		meshlet_count = meshlets.meshlets.size ();
+	}
+	const uint64_t meshlet_time = GetPercentile (samples, 50.0);
+	printf ("  meshlets         %zu, %.1f triangles each  %9.2f ms\n", meshlet_count, static_cast<double>(triangles) / meshlet_count, meshlet_time / 1e6);
+	printf ("  %.2f Mtriangles/s through both orders\n", triangles * 1e3 / (cache_time + overdraw_time));
+}
+
+int main (int argc, char **argv)
+{
+	const bool quick = IsQuickRun (argc, argv);
+	const uint32_t iterations = quick ? 1 : 5;
+	RunMesh ("grid", MakeGrid (quick ? 32 : 700), iterations);
+	RunMesh ("nested spheres", MakeNestedSpheres (4, quick ? 8 : 250, quick ? 16 : 500), iterations);
+	return 0;
+}
@@ -0,0 +1,86 @@
+#include "bench.h"
+#include "null_device.h"
+
+#include <stdio.h>
+
+//CPU cost of recording and submitting a frame on the null device at 10k to 1M draws,
+//shaped like Graphics::RecordCommandList: a pipeline per batch of draws, root
+//constants and an indexed draw per object, in frames that reuse their allocators.
+
+static const uint32_t frames_in_flight = 3;
+static const uint32_t draws_per_pipeline = 64;
+
+static void RecordFrame (GpuCommandList *command_list, uint32_t draws)
+{
+	const GpuBarrier to_target = GpuTransition (1, GPU_RESOURCE_STATE_PRESENT, GPU_RESOURCE_STATE_RENDER_TARGET);
+	const GpuBarrier to_present = GpuTransition (1, GPU_RESOURCE_STATE_RENDER_TARGET, GPU_RESOURCE_STATE_PRESENT);
+	const GpuViewport viewport = { 0.0f, 0.0f, 1920.0f, 1080.0f, 0.0f, 1.0f };
+	const GpuRect scissor = { 0, 0, 1920, 1080 };
+	const GpuDescriptorHandle render_target = 1;
+	const float clear_color[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+
+	command_list->ResourceBarrier (1, &to_target);
+	command_list->SetGraphicsRootSignature (1);
+	command_list->SetViewports (1, &viewport);
+	command_list->SetScissorRects (1, &scissor);
+	command_list->SetRenderTargets (1, &render_target, nullptr);
+	command_list->ClearRenderTargetView (render_target, clear_color);
+	command_list->SetPrimitiveTopology (GPU_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	for (uint32_t draw = 0; draw < draws; draw++)
+	{
+		if (draw % draws_per_pipeline == 0)
+			command_list->SetPipelineState (1 + draw / draws_per_pipeline % 16);
+		const float constants[4] = { static_cast<float>(draw), 0.0f, 0.0f, 1.0f };
+		command_list->SetGraphicsRoot32BitConstants (0, 4, constants, 0);
+		command_list->DrawIndexedInstanced (36, 1, 0, 0, 0);
+	}
+	command_list->ResourceBarrier (1, &to_present);
+	command_list->Close ();
+}
+
+static void RunBenchmark (uint32_t draws, uint32_t frames)
+{
+	NullDevice device;
+	std::unique_ptr<GpuCommandAllocator> allocators[frames_in_flight];
+	for (uint32_t i = 0; i < frames_in_flight; i++)
+		allocators[i] = device.CreateCommandAllocator ();
+	std::unique_ptr<GpuCommandList> command_list = device.CreateCommandList (allocators[0].get ());
+	command_list->Close ();
+
+	std::vector<uint64_t> samples;
+	uint64_t fence_value = 0;
+	for (uint32_t frame = 0; frame < frames; frame++)
+	{
+		const uint32_t slot = frame % frames_in_flight;
+		if (fence_value >= frames_in_flight)
+			device.WaitForFenceValue (fence_value - frames_in_flight + 1);
+
+		const uint64_t begin = GetBenchNanoseconds ();
+		allocators[slot]->Reset ();
+		command_list->Reset (allocators[slot].get (), 0);
+		RecordFrame (command_list.get (), draws);
+		GpuCommandList *lists[] = { command_list.get () };
+		device.ExecuteCommandLists (1, lists);
+		device.Signal (++fence_value);
+		samples.push_back (GetBenchNanoseconds () - begin);
+	}
+
+	//the first frames grow the allocator streams
+	const uint64_t median = GetPercentile (samples, 50.0);
+	const size_t stream_size = static_cast<NullCommandList*>(command_list.get ())->GetCommandsSize ();
+	printf ("%8u draws: %8.3f ms/frame (p99 %8.3f), %6.2f ns/draw, %6.1f MB stream\n", draws, median / 1e6,
+			GetPercentile (samples, 99.0) / 1e6, static_cast<double>(median) / draws, stream_size / (1024.0 * 1024.0));
+}
+
+int main (int argc, char **argv)
+{
+	const bool quick = IsQuickRun (argc, argv);
+	const uint32_t draw_counts[] = { 10000, 100000, 1000000 };
+	for (uint32_t draws : draw_counts)
+	{
+		if (quick && draws > 10000)
+			break;
+		RunBenchmark (draws, quick ? 4 : draws >= 1000000 ? 20 : 100);
+	}
+	return 0;
+}
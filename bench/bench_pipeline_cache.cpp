@@ -0,0 +1,151 @@
+#include "bench.h"
+#include "pipeline_cache.h"
+
+#include <stdio.h>
+
+#include <chrono>
+#include <mutex>
+#include <set>
+#include <thread>
+
+//Startup with material permutations: cold without a cache file, compiled synchronously
+//as LoadAssets did and on background threads, then warm from the saved library. Compiling
+//is modelled as 300 us of sleep, so background threads overlap even on one core, and
+//loading from the library as 10 us of spinning. Repeated requests of existing
+//descriptions measure the cost of normalizing, hashing the shaders and finding the entry.
+
+static const char *cache_file = "bench_pipeline_cache.bin";
+
+class SleepPipelineBackend : public PipelineBackend
+{
+public:
+	SleepPipelineBackend () :
+		next_pipeline (1)
+	{
+	}
+	uint64_t GetDeviceKey () override
+	{
+		return 1;
+	}
+	bool OpenLibrary (const void *blob, size_t size) override
+	{
+		const uint64_t *hashes = static_cast<const uint64_t*>(blob);
+		library = std::set<uint64_t>(hashes, hashes + size / sizeof (uint64_t));
+		return true;
+	}
+	GpuPipelineHandle CreatePipeline (const PipelineDesc &, uint64_t hash, bool &loaded) override
+	{
+		bool stored;
+		{
+			std::lock_guard<std::mutex> lock (mutex);
+			stored = library.count (hash) != 0;
+		}
+		if (stored)
+		{
+			const uint64_t end = GetBenchNanoseconds () + 10000;
+			while (GetBenchNanoseconds () < end)
+				;
+		}
+		else
+			std::this_thread::sleep_for (std::chrono::microseconds (300));
+		std::lock_guard<std::mutex> lock (mutex);
+		library.insert (hash);
+		loaded = stored;
+		return next_pipeline++;
+	}
+	void DestroyPipeline (GpuPipelineHandle) override
+	{
+	}
+	void SerializeLibrary (std::vector<uint8_t> &blob) override
+	{
+		std::lock_guard<std::mutex> lock (mutex);
+		blob.clear ();
+		for (uint64_t hash : library)
+			blob.insert (blob.end (), reinterpret_cast<const uint8_t*>(&hash), reinterpret_cast<const uint8_t*>(&hash + 1));
+	}
+private:
+	std::mutex mutex;
+	std::set<uint64_t> library;
+	GpuPipelineHandle next_pipeline;
+};
+
+static std::vector<uint8_t> vertex_shader (4096, 0x11);
+static std::vector<uint8_t> pixel_shader (8192, 0x22);
+static const PipelineInputElement input_elements[] =
+{
+	{ "POSITION", 0, 6, 0, 0, 0, 0 },
+	{ "NORMAL", 0, 6, 0, pipeline_append_aligned_element, 0, 0 },
+	{ "TEXCOORD", 0, 16, 0, pipeline_append_aligned_element, 0, 0 }
+};
+
+//permutations of blending, culling, depth and render target format
+static PipelineDesc GetPermutation (uint32_t index)
+{
+	PipelineDesc desc;
+	desc.root_signature = 1;
+	desc.root_signature_key = 7;
+	desc.shaders[PIPELINE_SHADER_VS].bytecode = vertex_shader.data ();
+	desc.shaders[PIPELINE_SHADER_VS].size = vertex_shader.size ();
+	desc.shaders[PIPELINE_SHADER_PS].bytecode = pixel_shader.data ();
+	desc.shaders[PIPELINE_SHADER_PS].size = pixel_shader.size ();
+	desc.input_elements = input_elements;
+	desc.input_element_count = 3;
+	desc.render_target_count = 1;
+	desc.render_target_formats[0] = 28 + index % 4;
+	desc.blend_targets[0].blend_enable = index / 4 % 2;
+	desc.raster.cull_mode = 1 + index / 8 % 3;
+	desc.depth_stencil.depth_func = 2 + index / 24 % 4;
+	desc.raster.depth_bias = static_cast<int32_t>(index / 96);
+	return desc;
+}
+
+static void RunStartup (const char *name, uint32_t thread_count, uint32_t permutations)
+{
+	SleepPipelineBackend backend;
+	PipelineCache cache (&backend, thread_count);
+	const bool warm = cache.Load (cache_file);
+	const uint64_t begin = GetBenchNanoseconds ();
+	const PipelineId fallback = cache.Create (GetPermutation (0));
+	for (uint32_t i = 1; i < permutations; i++)
+		cache.Request (GetPermutation (i), fallback);
+	const double request_ms = (GetBenchNanoseconds () - begin) / 1e6;
+	cache.WaitAll ();
+	const double ready_ms = (GetBenchNanoseconds () - begin) / 1e6;
+	const PipelineCacheStats stats = cache.GetStats ();
+	printf ("%-22s %8.1f ms until requested, %8.1f ms until all ready, %4llu compiled, %4llu loaded%s\n",
+			name, request_ms, ready_ms, static_cast<unsigned long long>(stats.compiled), static_cast<unsigned long long>(stats.loaded),
+			warm ? "" : ", no cache file");
+	cache.Save (cache_file);
+}
+
+int main (int argc, char **argv)
+{
+	const bool quick = IsQuickRun (argc, argv);
+	const uint32_t permutations = quick ? 48 : 480;
+
+	remove (cache_file);
+	RunStartup ("cold, synchronous:", 0, permutations);
+	remove (cache_file);
+	RunStartup ("cold, 4 threads:", 4, permutations);
+	RunStartup ("warm, 4 threads:", 4, permutations);
+	remove (cache_file);
+
+	//per draw lookups of descriptions the cache already has
+	SleepPipelineBackend backend;
+	PipelineCache cache (&backend, 0);
+	std::vector<PipelineDesc> descs;
+	for (uint32_t i = 0; i < 96; i++)
+	{
+		descs.push_back (GetPermutation (i));
+		cache.Request (descs.back ());
+	}
+	const uint32_t lookups = quick ? 1000 : 20000;
+	uint64_t sum = 0;
+	const uint64_t begin = GetBenchNanoseconds ();
+	for (uint32_t i = 0; i < lookups; i++)
+		sum += cache.Request (descs[i % descs.size ()]);
+	KeepValue (sum);
+	printf ("repeated request:      %8.1f ns with %u KB of shaders hashed\n",
+			static_cast<double>(GetBenchNanoseconds () - begin) / lookups, static_cast<unsigned>((vertex_shader.size () + pixel_shader.size ()) / 1024));
+	return 0;
+}
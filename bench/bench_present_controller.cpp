@@ -0,0 +1,102 @@
+#include "bench.h"
+#include "present_controller.h"
+#include "null_device.h"
+
+#include <stdio.h>
+
+#include <random>
+#include <vector>
+
+//Frames of a fixed CPU time and a GPU time with up to 2 ms of jitter presented to a
+//simulated 60 Hz swap chain, on the timeline of a null device. For every workload and
+//presentation: frames per simulated second, the latency from the frame start (where the
+//input is sampled) to the display as the average and the 99th percentile of the frames the
+//history keeps, late vsync frames, the final pacing delay, and the real time BeginFrame ()
+//and Present () take on the render thread, which is the cost of the controller since its
+//waits and sleeps only advance the simulated clock. The baseline is vsync with the DXGI
+//default of 3 queued presents and no pacing, which is how frames were presented before.
+//When the work nearly fills the refresh the low latency pacing has no room for a delay
+//and its late frames each cost a refresh.
+
+static const uint64_t ms = 1000000;
+static const uint64_t refresh = 16666667;
+
+struct Presentation
+{
+	const char *name;
+	PresentMode mode;
+	bool low_latency;
+	uint32_t max_latency;
+	float fps_cap;
+};
+
+static void RunPresentation (const Presentation &presentation, uint64_t cpu_ns, uint64_t gpu_ns, uint32_t frame_count)
+{
+	NullDeviceDesc device_desc;
+	device_desc.gpu_ns_per_list = 0;
+	NullDevice device (device_desc);
+	NullPresentDesc present_desc;
+	present_desc.refresh_interval = refresh;
+	NullPresentBackend backend (&device, present_desc);
+	PresentOptions options;
+	options.mode = presentation.mode;
+	options.low_latency = presentation.low_latency;
+	options.fps_cap = presentation.fps_cap;
+	PresentController controller (&backend, options);
+	controller.SetMaximumFrameLatency (presentation.max_latency);
+
+	std::mt19937 random (3);
+	std::vector<uint64_t> controller_ns;
+	for (uint32_t frame = 0; frame < frame_count; frame++)
+	{
+		uint64_t begin = GetBenchNanoseconds ();
+		controller.BeginFrame ();
+		uint64_t spent = GetBenchNanoseconds () - begin;
+		device.AdvanceCpuTime (cpu_ns);
+		device.AddGpuWork (gpu_ns + random () % (2 * ms));
+		device.ExecuteCommandLists (0, nullptr);
+		begin = GetBenchNanoseconds ();
+		controller.Present ();
+		spent += GetBenchNanoseconds () - begin;
+		controller_ns.push_back (spent);
+	}
+
+	std::vector<PresentFrameTiming> timings;
+	controller.GetTimings (timings);
+	std::vector<uint64_t> latencies;
+	for (const PresentFrameTiming &timing : timings)
+		if (timing.display_time)
+			latencies.push_back (timing.display_time - timing.start_time);
+	const PresentStats &stats = controller.GetStats ();
+	printf ("%-22s %8.1f %10.2f %10.2f %8llu %10.2f %12.0f\n", presentation.name,
+			stats.frames * 1e9 / device.GetCpuTime (), stats.total_display_latency_ns / 1e6 / stats.displayed_frames,
+			GetPercentile (latencies, 99.0) / 1e6, static_cast<unsigned long long>(stats.late_frames), stats.pacing_delay_ns / 1e6,
+			static_cast<double>(GetPercentile (controller_ns, 50.0)));
+}
+
+int main (int argc, char **argv)
+{
+	const bool quick = IsQuickRun (argc, argv);
+	const uint32_t frame_count = quick ? 300 : 3000;
+
+	const Presentation presentations[] = {
+		{ "vsync, 3 queued", PRESENT_MODE_VSYNC, false, 3, 0.0f },
+		{ "vsync, 1 queued", PRESENT_MODE_VSYNC, false, 1, 0.0f },
+		{ "vsync, low latency", PRESENT_MODE_VSYNC, true, 1, 0.0f },
+		{ "tearing", PRESENT_MODE_TEARING, false, 1, 0.0f },
+		{ "capped at 120 fps", PRESENT_MODE_CAPPED, false, 1, 120.0f },
+	};
+	//light, and GPU bound within the refresh
+	const uint64_t workloads[2][2] = { { 2 * ms, 3 * ms }, { 4 * ms, 10 * ms } };
+	for (uint32_t w = 0; w < 2; w++)
+	{
+		printf ("%u frames of %.0f ms CPU and %.0f to %.0f ms GPU at 60 Hz\n", frame_count, workloads[w][0] / 1e6,
+				workloads[w][1] / 1e6, (workloads[w][1] + 2 * ms) / 1e6);
+		printf ("%-22s %8s %10s %10s %8s %10s %12s\n", "presentation", "fps", "latency ms", "p99 ms", "late", "delay ms", "overhead ns");
+		for (const Presentation &presentation : presentations)
+			RunPresentation (presentation, workloads[w][0], workloads[w][1], frame_count);
+		if (quick)
+			break;
+	}
+	return 0;
+}
@@ -0,0 +1,65 @@
+#include "bench.h"
+#include "profiler.h"
+
+#include <stdio.h>
+
+#include <thread>
+
+//Overhead of the profiler: a scope while disabled and enabled, the gathering of a frame
+//at EndFrame () and the aggregation and export of the history.
+
+static double MeasureScopes (unsigned count)
+{
+	const uint64_t begin = GetBenchNanoseconds ();
+	for (unsigned i = 0; i < count; i++)
+	{
+		PROFILE_SCOPE ("Scope");
+	}
+	return static_cast<double>(GetBenchNanoseconds () - begin) / count;
+}
+
+int main (int argc, char **argv)
+{
+	const bool quick = IsQuickRun (argc, argv);
+	const unsigned scopes_count = quick ? 100000 : 10000000;
+	Profiler &profiler = Profiler::Get ();
+
+	profiler.SetEnabled (false);
+	printf ("disabled scope: %6.2f ns\n", MeasureScopes (scopes_count));
+
+	profiler.SetEnabled (true);
+	const unsigned frame_scopes = quick ? 1000 : 100000;
+	double scope_ns = 0.0;
+	double end_frame_ns = 0.0;
+	const unsigned frames_count = 20;
+	for (unsigned frame = 0; frame < frames_count; frame++)
+	{
+		scope_ns += MeasureScopes (frame_scopes);
+		const uint64_t begin = GetBenchNanoseconds ();
+		profiler.EndFrame ();
+		end_frame_ns += static_cast<double>(GetBenchNanoseconds () - begin);
+	}
+	printf ("enabled scope:  %6.2f ns\n", scope_ns / frames_count);
+	printf ("EndFrame:       %8.1f us for %u events\n", end_frame_ns / frames_count / 1000.0, frame_scopes);
+
+	//events of four threads gathered per frame
+	const uint64_t threads_begin = GetBenchNanoseconds ();
+	std::vector<std::thread> threads;
+	for (int t = 0; t < 4; t++)
+		threads.emplace_back ([frame_scopes]() { MeasureScopes (frame_scopes); });
+	for (std::thread &thread : threads)
+		thread.join ();
+	profiler.EndFrame ();
+	printf ("4 threads:      %8.1f us for %u events each and EndFrame\n",
+			(GetBenchNanoseconds () - threads_begin) / 1000.0, frame_scopes);
+
+	std::vector<ProfileZoneStats> stats;
+	uint64_t begin = GetBenchNanoseconds ();
+	profiler.GetZoneStats (stats);
+	printf ("GetZoneStats:   %8.1f us over %zu frames\n", (GetBenchNanoseconds () - begin) / 1000.0, profiler.GetFrameCount ());
+	begin = GetBenchNanoseconds ();
+	profiler.ExportChromeTrace ("bench_profiler.json");
+	printf ("export:         %8.1f ms\n", (GetBenchNanoseconds () - begin) / 1e6);
+	profiler.SetEnabled (false);
+	return 0;
+}
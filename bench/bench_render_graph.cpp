@@ -0,0 +1,120 @@
+#include "bench.h"
+#include "null_device.h"
+#include "render_graph.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <random>
+
+//Declaring and compiling a frame of post effect chains: every pass reads the outputs of
+//up to three earlier passes and writes a new transient of a random size, the last one
+//writes the back buffer. The frame is compiled from scratch with a size changed every
+//frame, and served from the cache with the structure unchanged. Placement of transients
+//is compared to one allocation per transient.
+
+class SizeGraphBackend : public RenderGraphBackend
+{
+public:
+	SizeGraphBackend () :
+		next_handle (100)
+	{
+	}
+	void GetAllocationInfo (const RenderGraphResourceDesc &desc, uint64_t &size, uint64_t &alignment) override
+	{
+		size = (desc.width * desc.height * 4 + gpu_default_placement_alignment - 1) / gpu_default_placement_alignment * gpu_default_placement_alignment;
+		alignment = gpu_default_placement_alignment;
+	}
+	GpuResourceHandle CreatePlacedResource (const RenderGraphResourceDesc &, GpuHeapHandle, uint64_t, GpuResourceStates) override
+	{
+		return ++next_handle;
+	}
+	void DestroyResource (GpuResourceHandle) override
+	{
+	}
+
+	GpuResourceHandle next_handle;
+};
+
+static void DeclareFrame (RenderGraph &graph, uint32_t pass_count, uint32_t frame, bool vary)
+{
+	std::mt19937 random (17);
+	graph.Reset ();
+	const RenderGraphResource back = graph.Import ("back", 1, GPU_RESOURCE_STATE_PRESENT, GPU_RESOURCE_STATE_PRESENT);
+	std::vector<RenderGraphResource> outputs;
+	for (uint32_t pass = 0; pass < pass_count; pass++)
+	{
+		RenderGraphResourceDesc desc;
+		memset (&desc, 0, sizeof (desc));
+		desc.type = RENDER_GRAPH_RESOURCE_TEXTURE_2D;
+		desc.width = 256u << random () % 4;
+		desc.height = static_cast<uint32_t>(desc.width);
+		desc.array_size = 1;
+		desc.mip_levels = 1;
+		desc.format = 28;
+		desc.flags = GPU_RESOURCE_FLAG_ALLOW_RENDER_TARGET;
+		if (vary && pass == 0)
+			desc.width += 64 * (frame % 2);
+		const RenderGraphPass graph_pass = graph.AddPass ("effect", 1, [] (uint32_t, GpuCommandList *) {});
+		const uint32_t reads = outputs.empty () ? 0 : 1 + random () % 3;
+		for (uint32_t i = 0; i < reads; i++)
+		{
+			//mostly recent outputs, so lifetimes are short and memory can be shared
+			const uint32_t back_step = std::min<uint32_t>(static_cast<uint32_t>(outputs.size ()), 1 + random () % 4);
+			graph.Read (graph_pass, outputs[outputs.size () - back_step], GPU_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+		}
+		if (pass + 1 == pass_count)
+			graph.Write (graph_pass, back, GPU_RESOURCE_STATE_RENDER_TARGET);
+		else
+		{
+			outputs.push_back (graph.CreateTransient ("output", desc));
+			graph.Write (graph_pass, outputs.back (), GPU_RESOURCE_STATE_RENDER_TARGET);
+		}
+	}
+}
+
+int main (int argc, char **argv)
+{
+	const bool quick = IsQuickRun (argc, argv);
+	const uint32_t frames = quick ? 10 : 200;
+	const uint32_t pass_counts[] = { 50, 200, 1000 };
+
+	for (uint32_t pass_count : pass_counts)
+		for (int vary = 1; vary >= 0; vary--)
+		{
+			NullDevice device;
+			FrameScheduler scheduler (&device, 2, FRAME_POLICY_MAX_THROUGHPUT);
+			NullMemory memory (1ull << 40);
+			GpuMemoryAllocator allocator (&memory, 256ull << 20);
+			SizeGraphBackend backend;
+			RenderGraph graph (&backend, &allocator, &scheduler);
+			NullCommandAllocator command_allocator;
+			NullCommandList command_list (&command_allocator);
+			command_list.Close ();
+
+			const uint64_t begin = GetBenchNanoseconds ();
+			for (uint32_t frame = 0; frame < frames; frame++)
+			{
+				scheduler.BeginFrame ();
+				DeclareFrame (graph, pass_count, frame, vary != 0);
+				graph.Compile ();
+				command_allocator.Reset ();
+				command_list.Reset (&command_allocator, 0);
+				for (uint32_t job = 0; job < graph.GetJobCount (); job++)
+					graph.RecordJob (job, &command_list);
+				command_list.Close ();
+				scheduler.EndFrame ();
+			}
+			const double us = (GetBenchNanoseconds () - begin) / 1e3 / frames;
+			scheduler.WaitForIdle ();
+
+			const RenderGraphStats &stats = graph.GetStats ();
+			printf ("%4u passes, %-9s %8.1f us/frame, %llu compilations; transients %6.1f MB aliased of %6.1f MB, "
+					"%u transitions and %u aliasing barriers in %u batches\n",
+					pass_count, vary ? "compiled:" : "cached:", us, static_cast<unsigned long long>(stats.compilations),
+					stats.transient_bytes / 1048576.0, stats.unaliased_bytes / 1048576.0,
+					stats.transitions, stats.aliasing_barriers, stats.barrier_batches);
+		}
+	return 0;
+}
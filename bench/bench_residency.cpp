@@ -0,0 +1,96 @@
+#include "bench.h"
+#include "residency.h"
+#include "null_device.h"
+
+#include <stdio.h>
+
+#include <random>
+#include <vector>
+
+//A level of 4 MB heaps, 2.5 times the 512 MB budget of the null memory, of which each
+//frame uses a working set of 0.5 to 2 times the budget: a window over the heaps that
+//moves by two heaps a frame, like a camera crossing the level, and a few random heaps.
+//Two frames are in flight, so the heaps of the last two frames cannot be evicted. For
+//every working set and for a target of 90% (hysteresis) and 100% (none) of the budget:
+//bytes evicted and made resident per frame, eviction batches per 100 frames, frames that
+//stayed over the budget, and the cost of Submit () with the Use () calls of the frame.
+//Without the manager every heap stays resident, which is what the last line shows. Once the
+//working sets of the frames in flight reach the budget, every frame is over it whatever
+//the target; hysteresis only changes how often the evictions below that run.
+
+static const uint64_t heap_size = 4ull << 20;
+static const uint64_t budget = 512ull << 20;
+static const uint32_t heap_count = static_cast<uint32_t>(budget / heap_size * 5 / 2);
+static const uint32_t frames_in_flight = 2;
+static const uint32_t window_step = 2;
+static const uint32_t random_uses = 4;
+
+static void RunWorkingSet (double working_set, float target_ratio, uint32_t frame_count)
+{
+	NullMemory memory (budget);
+	ResidencyOptions options;
+	options.evict_ratio = 1.0f;
+	options.target_ratio = target_ratio;
+	ResidencyManager manager (&memory, &memory, options);
+	std::vector<GpuHeapHandle> heaps;
+	for (uint32_t i = 0; i < heap_count; i++)
+		heaps.push_back (manager.CreateHeap (GPU_HEAP_TIER_TEXTURES, heap_size));
+
+	const uint32_t window = static_cast<uint32_t>(working_set * budget / heap_size);
+	std::mt19937 random (5);
+	std::vector<uint64_t> submit_ns;
+	uint32_t over_budget_frames = 0;
+	//the first frames settle the level into the budget and are not counted
+	const uint32_t warmup = frame_count / 10;
+	uint64_t evicted_before = 0, made_resident_before = 0, batches_before = 0;
+	for (uint32_t frame = 1; frame <= frame_count; frame++)
+	{
+		if (frame == warmup)
+		{
+			const ResidencyStats stats = manager.GetStats ();
+			evicted_before = stats.total_evicted_bytes;
+			made_resident_before = stats.total_made_resident_bytes;
+			batches_before = stats.eviction_batches;
+		}
+		const uint64_t begin = GetBenchNanoseconds ();
+		const uint32_t first = frame * window_step;
+		for (uint32_t i = 0; i < window; i++)
+			manager.Use (heaps[(first + i) % heap_count]);
+		for (uint32_t i = 0; i < random_uses; i++)
+			manager.Use (heaps[random () % heap_count]);
+		manager.Submit (frame, frame > frames_in_flight ? frame - frames_in_flight : 0);
+		if (frame > warmup)
+		{
+			submit_ns.push_back (GetBenchNanoseconds () - begin);
+			over_budget_frames += manager.GetStats ().over_budget_bytes != 0;
+		}
+	}
+	const ResidencyStats stats = manager.GetStats ();
+	const double counted = frame_count - warmup;
+	printf ("%8.2fx %7.0f%% %12.2f %12.2f %10.1f %8u %10.2f %10.2f\n", working_set, target_ratio * 100.0f,
+			(stats.total_evicted_bytes - evicted_before) / 1048576.0 / counted,
+			(stats.total_made_resident_bytes - made_resident_before) / 1048576.0 / counted,
+			(stats.eviction_batches - batches_before) * 100.0 / counted, over_budget_frames,
+			GetPercentile (submit_ns, 50.0) / 1e3, GetPercentile (submit_ns, 99.0) / 1e3);
+}
+
+int main (int argc, char **argv)
+{
+	const bool quick = IsQuickRun (argc, argv);
+	const uint32_t frame_count = quick ? 100 : 2000;
+
+	printf ("%u heaps of %llu MB, budget %llu MB, %u frames in flight, %u frames\n", heap_count,
+			static_cast<unsigned long long>(heap_size >> 20), static_cast<unsigned long long>(budget >> 20), frames_in_flight, frame_count);
+	printf ("%9s %8s %12s %12s %10s %8s %10s %10s\n", "working", "target", "evict MB/f", "resident MB/f", "batches%",
+			"over", "submit us", "p99 us");
+	const double working_sets[] = { 0.5, 0.9, 1.0, 1.2, 1.5, 2.0 };
+	const float targets[] = { 0.9f, 1.0f };
+	for (double working_set : working_sets)
+		for (float target : targets)
+			if (!quick || working_set == 1.2)
+				RunWorkingSet (working_set, target, frame_count);
+
+	printf ("no residency management: %llu MB resident for a budget of %llu MB\n",
+			static_cast<unsigned long long>(heap_count * heap_size >> 20), static_cast<unsigned long long>(budget >> 20));
+	return 0;
+}
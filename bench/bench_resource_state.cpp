@@ -0,0 +1,115 @@
+#include "bench.h"
+#include "null_device.h"
+#include "resource_state.h"
+
+#include <stdio.h>
+
+#include <random>
+#include <vector>
+
+//A frame of passes over a pool of textures: each pass renders into a few of them and
+//samples a few others, like a chain of post effects and shadow maps. The tracker batches
+//the barriers of a pass into one call and drops the ones a combined read state makes
+//redundant; the baseline writes one barrier per state change by hand, as
+//RecordCommandList did, with the states kept in a plain array.
+
+static const uint32_t texture_count = 256;
+static const uint32_t targets_per_pass = 3;
+static const uint32_t reads_per_pass = 6;
+static const uint32_t draws_per_pass = 16;
+static const GpuResourceStates shader_resource = GPU_RESOURCE_STATE_PIXEL_SHADER_RESOURCE | GPU_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE;
+
+struct PassUse
+{
+	GpuResourceHandle resource;
+	GpuResourceStates state;
+};
+
+int main (int argc, char **argv)
+{
+	const bool quick = IsQuickRun (argc, argv);
+	const uint32_t frames = quick ? 20 : 1000;
+	const uint32_t passes = 200;
+
+	//reads alternate between the pixel and the combined shader resource state
+	std::vector<PassUse> uses;
+	std::mt19937 random (3);
+	for (uint32_t pass = 0; pass < passes; pass++)
+		for (uint32_t i = 0; i < targets_per_pass + reads_per_pass; i++)
+		{
+			const PassUse use = { 1 + random () % texture_count, i < targets_per_pass ? GpuResourceStates (GPU_RESOURCE_STATE_RENDER_TARGET) :
+								  random () % 2 ? shader_resource : GpuResourceStates (GPU_RESOURCE_STATE_PIXEL_SHADER_RESOURCE) };
+			uses.push_back (use);
+		}
+	const uint32_t uses_per_pass = targets_per_pass + reads_per_pass;
+
+	NullDevice device;
+	NullCommandAllocator allocator;
+	NullCommandList command_list (&allocator);
+	command_list.Close ();
+	{
+		ResourceStateRegistry registry;
+		for (GpuResourceHandle texture = 1; texture <= texture_count; texture++)
+			registry.Register (texture, 1, shader_resource);
+		ResourceStateTracker tracker (&registry);
+		std::vector<GpuBarrier> hoisted, fixups;
+		uint64_t barriers = 0, batches = 0, fixup_barriers = 0;
+		const uint64_t begin = GetBenchNanoseconds ();
+		for (uint32_t frame = 1; frame <= frames; frame++)
+		{
+			allocator.Reset ();
+			command_list.Reset (&allocator, 0);
+			tracker.Reset ();
+			for (uint32_t pass = 0; pass < passes; pass++)
+			{
+				for (uint32_t i = 0; i < uses_per_pass; i++)
+					tracker.Transition (uses[pass * uses_per_pass + i].resource, uses[pass * uses_per_pass + i].state);
+				tracker.FlushBarriers (&command_list);
+				for (uint32_t draw = 0; draw < draws_per_pass; draw++)
+					command_list.DrawInstanced (3, 1, 0, 0);
+			}
+			command_list.Close ();
+			hoisted.clear ();
+			fixups.clear ();
+			tracker.Resolve (frame, hoisted, fixups);
+			barriers += tracker.GetStats ().barriers;
+			batches += tracker.GetStats ().batches;
+			fixup_barriers += tracker.GetStats ().fixups;
+		}
+		const double ns = static_cast<double>(GetBenchNanoseconds () - begin);
+		printf ("tracked:  %7.1f ns/transition, %6.1f barriers in %5.1f calls per frame, %.1f at submit\n",
+				ns / (static_cast<double>(frames) * uses.size ()), static_cast<double>(barriers) / frames,
+				static_cast<double>(batches) / frames, static_cast<double>(fixup_barriers) / frames);
+	}
+	{
+		std::vector<GpuResourceStates> states (texture_count + 1, shader_resource);
+		uint64_t barriers = 0;
+		const uint64_t begin = GetBenchNanoseconds ();
+		for (uint32_t frame = 1; frame <= frames; frame++)
+		{
+			allocator.Reset ();
+			command_list.Reset (&allocator, 0);
+			for (uint32_t pass = 0; pass < passes; pass++)
+			{
+				for (uint32_t i = 0; i < uses_per_pass; i++)
+				{
+					const PassUse &use = uses[pass * uses_per_pass + i];
+					if (states[use.resource] == use.state)
+						continue;
+					const GpuBarrier barrier = GpuTransition (use.resource, states[use.resource], use.state);
+					command_list.ResourceBarrier (1, &barrier);
+					states[use.resource] = use.state;
+					barriers++;
+				}
+				for (uint32_t draw = 0; draw < draws_per_pass; draw++)
+					command_list.DrawInstanced (3, 1, 0, 0);
+			}
+			command_list.Close ();
+		}
+		const double ns = static_cast<double>(GetBenchNanoseconds () - begin);
+		printf ("by hand:  %7.1f ns/transition, %6.1f barriers in %5.1f calls per frame\n",
+				ns / (static_cast<double>(frames) * uses.size ()), static_cast<double>(barriers) / frames,
+				static_cast<double>(barriers) / frames);
+	}
+	return 0;
+}
@@ -0,0 +1,114 @@
+#include "bench.h"
+#include "scene.h"
+
+#include <math.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <random>
+#include <thread>
+#include <vector>
+
+//Update () of scenes of 10k to 1M entities, forests of trees of 1 + 8 + 64 + 512 nodes
+//like characters with their bones and attachments, against the number of entities whose
+//local transform changed that frame: random entities anywhere in the trees, so most are
+//leaves. Every root changed recomputes every world matrix, which is what recomputing the
+//whole scene each frame costs. Times are the median per update in microseconds, on one
+//thread and on the job system.
+
+static const uint32_t tree_size = 1 + 8 + 64 + 512;
+
+static SceneTransform RandomTransform (std::mt19937 &random)
+{
+	std::uniform_real_distribution<float> unit (-1.0f, 1.0f);
+	SceneTransform transform = MakeIdentityTransform ();
+	const float angle = unit (random);
+	for (uint32_t c = 0; c < 3; c++)
+		transform.translation[c] = unit (random);
+	transform.rotation[1] = sinf (angle * 0.5f);
+	transform.rotation[3] = cosf (angle * 0.5f);
+	return transform;
+}
+
+static double TimeUpdates (Scene &scene, const std::vector<SceneEntity> &changed, const std::vector<SceneTransform> &transforms,
+						   JobSystem *job_system, uint32_t iterations, uint32_t &updated_nodes)
+{
+	std::vector<uint64_t> samples;
+	for (uint32_t i = 0; i < iterations; i++)
+	{
+		for (size_t e = 0; e < changed.size (); e++)
+			scene.SetLocalTransform (changed[e], transforms[(e + i) % transforms.size ()]);
+		const uint64_t begin = GetBenchNanoseconds ();
+		scene.Update (job_system);
+		samples.push_back (GetBenchNanoseconds () - begin);
+		updated_nodes = scene.GetStats ().updated_nodes;
+	}
+	KeepValue (scene.GetWorldMatrices ()[0].m[12]);
+	return GetPercentile (samples, 50.0) / 1e3;
+}
+
+int main (int argc, char **argv)
+{
+	const bool quick = IsQuickRun (argc, argv);
+	const uint32_t sizes[] = { 10000, 100000, 1000000 };
+	const uint32_t size_count = quick ? 1 : 3;
+	const uint32_t threads = std::max (2u, std::thread::hardware_concurrency ());
+	JobSystem job_system (threads);
+
+	std::mt19937 random (1);
+	std::vector<SceneTransform> transforms;
+	for (uint32_t i = 0; i < 1024; i++)
+		transforms.push_back (RandomTransform (random));
+
+	printf ("%u worker threads\n", threads);
+	for (uint32_t s = 0; s < size_count; s++)
+	{
+		const uint32_t size = sizes[s];
+		const uint32_t iterations = quick ? 3 : std::max (5u, 1000000 / size);
+		Scene scene;
+		std::vector<SceneEntity> entities, roots;
+		std::vector<SceneEntity> level;
+		while (entities.size () < size)
+		{
+			//breadth first, so each tree is a root, its 8 children, their 8 children each...
+			roots.push_back (scene.Create (scene_invalid_entity, RandomTransform (random)));
+			entities.push_back (roots.back ());
+			level.assign (1, roots.back ());
+			for (uint32_t depth = 1; depth < 4 && entities.size () < size; depth++)
+			{
+				std::vector<SceneEntity> next;
+				for (SceneEntity parent : level)
+					for (uint32_t c = 0; c < 8 && entities.size () < size; c++)
+					{
+						next.push_back (scene.Create (parent, RandomTransform (random)));
+						entities.push_back (next.back ());
+					}
+				level.swap (next);
+			}
+		}
+		uint64_t begin = GetBenchNanoseconds ();
+		scene.Update (nullptr);
+		printf ("%u entities in %zu trees of %u, first update with the depth-first reorder %.2f ms\n", size, roots.size (), tree_size,
+				(GetBenchNanoseconds () - begin) / 1e6);
+		printf ("%12s %12s %12s %12s\n", "changed", "updated", "1 thread us", "jobs us");
+
+		const uint32_t changed_counts[] = { 1, 10, 100, 1000, 10000, 100000 };
+		for (uint32_t changed_count : changed_counts)
+		{
+			if (changed_count > size / 10)
+				break;
+			std::vector<SceneEntity> changed (changed_count);
+			for (SceneEntity &entity : changed)
+				entity = entities[random () % entities.size ()];
+			uint32_t updated = 0;
+			const double single = TimeUpdates (scene, changed, transforms, nullptr, iterations, updated);
+			const double parallel = TimeUpdates (scene, changed, transforms, &job_system, iterations, updated);
+			printf ("%12u %12u %12.1f %12.1f\n", changed_count, updated, single, parallel);
+		}
+		uint32_t updated = 0;
+		const double single = TimeUpdates (scene, roots, transforms, nullptr, iterations, updated);
+		const double parallel = TimeUpdates (scene, roots, transforms, &job_system, iterations, updated);
+		printf ("%12s %12u %12.1f %12.1f\n", "all roots", updated, single, parallel);
+	}
+	return 0;
+}
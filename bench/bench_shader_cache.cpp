@@ -0,0 +1,125 @@
+#include "bench.h"
+#include "shader_cache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#include <chrono>
+#include <string>
+#include <thread>
+
+//Building the shader permutations of a material library: a cold build compiles every
+//permutation, serially as LoadAssets did and on the job system, and a warm build loads
+//them from the cache. Compiling is modelled as 2 ms of sleep so the job threads overlap
+//even on one core; the warm build reads and hashes the sources and the cache entries for real.
+
+static const char *root = "shader_cache_bench/";
+
+class SleepCompiler : public ShaderCompiler
+{
+public:
+	std::string GetIdentity () override
+	{
+		return "sleep 1.0";
+	}
+	bool Compile (const ShaderRequest &, const std::vector<ShaderSourceFile> &files, std::vector<uint8_t> &bytecode, std::string &) override
+	{
+		std::this_thread::sleep_for (std::chrono::milliseconds (2));
+		//bytecode of about the size of the sources
+		size_t size = 0;
+		for (const ShaderSourceFile &file : files)
+			size += file.contents.size ();
+		bytecode.assign (size / 2 + 256, 0xbc);
+		return true;
+	}
+};
+
+static void MakeDirectory (const std::string &path)
+{
+#ifdef _WIN32
+	_mkdir (path.c_str ());
+#else
+	mkdir (path.c_str (), 0755);
+#endif
+}
+
+static void WriteFile (const std::string &path, const std::string &contents)
+{
+	FILE *f = fopen (path.c_str (), "wb");
+	if (!f)
+	{
+		fprintf (stderr, "Cannot write %s\n", path.c_str ());
+		exit (1);
+	}
+	fwrite (contents.data (), 1, contents.size (), f);
+	fclose (f);
+}
+
+int main (int argc, char **argv)
+{
+	const bool quick = IsQuickRun (argc, argv);
+	const uint32_t permutations = quick ? 16 : 256;
+
+	//a shader with a chain of includes of a few KB each, the stamp separates runs
+	const std::string stamp = std::to_string (GetBenchNanoseconds ());
+	MakeDirectory (root);
+	MakeDirectory (std::string (root) + "cache");
+	const std::string filler (4096, ' ');
+	WriteFile (std::string (root) + "common.hlsli", "//" + stamp + "\n" + filler + "\nfloat4 Tint;\n");
+	WriteFile (std::string (root) + "lighting.hlsli", "#include \"common.hlsli\"\n" + filler + "\nfloat3 Light;\n");
+	WriteFile (std::string (root) + "material.hlsl", "#include \"lighting.hlsli\"\n" + filler + "\nfloat4 PSMain () : SV_Target { return Tint; }\n");
+
+	std::vector<ShaderRequest> requests (permutations);
+	for (uint32_t i = 0; i < permutations; i++)
+	{
+		requests[i].file = std::string (root) + "material.hlsl";
+		requests[i].entry_point = "PSMain";
+		requests[i].target = "ps_5_0";
+		requests[i].flags = 0;
+		for (uint32_t bit = 0; bit < 8; bit++)
+			if (i & (1u << bit))
+				requests[i].defines.push_back (ShaderDefine { "FEATURE_" + std::to_string (bit), "1" });
+	}
+	std::vector<ShaderResult> results (permutations);
+
+	SleepCompiler compiler;
+	JobSystem jobs (4);
+	std::vector<uint64_t> entries;
+	const char *names[] = { "cold, serial:", "cold, job system:", "warm:" };
+	for (int run = 0; run < 3; run++)
+	{
+		//the serial run compiles into its own cache
+		ShaderCache cache (&compiler, std::string (root) + "cache/", std::vector<std::string> ());
+		const uint64_t begin = GetBenchNanoseconds ();
+		cache.Build (requests.data (), requests.size (), run ? &jobs : nullptr, results.data ());
+		const double ms = (GetBenchNanoseconds () - begin) / 1e6;
+		const ShaderCacheStats stats = cache.GetStats ();
+		printf ("%-18s %8.1f ms for %u permutations, %llu compiled, %llu from the cache\n",
+				names[run], ms, permutations, static_cast<unsigned long long>(stats.compiled), static_cast<unsigned long long>(stats.hits));
+		for (const ShaderResult &result : results)
+		{
+			char name[24];
+			snprintf (name, sizeof (name), "%016llx.cso", static_cast<unsigned long long>(result.key_hash));
+			if (!run)
+				remove ((std::string (root) + "cache/" + name).c_str ());
+			else
+				entries.push_back (result.key_hash);
+		}
+	}
+
+	for (uint64_t key_hash : entries)
+	{
+		char name[24];
+		snprintf (name, sizeof (name), "%016llx.cso", static_cast<unsigned long long>(key_hash));
+		remove ((std::string (root) + "cache/" + name).c_str ());
+	}
+	remove ((std::string (root) + "common.hlsli").c_str ());
+	remove ((std::string (root) + "lighting.hlsli").c_str ());
+	remove ((std::string (root) + "material.hlsl").c_str ());
+	return 0;
+}
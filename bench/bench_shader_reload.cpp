@@ -0,0 +1,230 @@
+#include "bench.h"
+#include "null_device.h"
+#include "shader_reload.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+
+//Editing a header shared by every material: the frames of the render thread while the
+//reloader rebuilds them in the background, against rebuilding them on the render thread
+//at the frame boundary after waiting for the GPU. Compiling a shader is modelled as 1 ms
+//of sleep and creating a pipeline as 2 ms; a frame sleeps 2 ms besides its own work.
+
+static const char *root = "shader_reload_bench/";
+
+class SleepCompiler : public ShaderCompiler
+{
+public:
+	std::string GetIdentity () override
+	{
+		return "sleep 1.0";
+	}
+	bool Compile (const ShaderRequest &request, const std::vector<ShaderSourceFile> &files, std::vector<uint8_t> &bytecode, std::string &) override
+	{
+		std::this_thread::sleep_for (std::chrono::milliseconds (1));
+		bytecode.assign (request.entry_point.begin (), request.entry_point.end ());
+		for (const ShaderSourceFile &file : files)
+			bytecode.insert (bytecode.end (), file.contents.begin (), file.contents.end ());
+
+		//the cache names an entry by the FNV-1a hash of its key
+		std::vector<uint8_t> key;
+		BuildShaderKey (request, GetIdentity (), files, key);
+		std::lock_guard<std::mutex> lock (mutex);
+		entries.push_back (PipelineHash (key.data (), key.size ()));
+		return true;
+	}
+
+	std::mutex mutex;
+	std::vector<uint64_t> entries;
+};
+
+class SleepPipelineBackend : public PipelineBackend
+{
+public:
+	SleepPipelineBackend () :
+		next_pipeline (1)
+	{
+	}
+	uint64_t GetDeviceKey () override
+	{
+		return 1;
+	}
+	bool OpenLibrary (const void *, size_t) override
+	{
+		return false;
+	}
+	GpuPipelineHandle CreatePipeline (const PipelineDesc &, uint64_t, bool &loaded) override
+	{
+		std::this_thread::sleep_for (std::chrono::milliseconds (2));
+		loaded = false;
+		return next_pipeline++;
+	}
+	void DestroyPipeline (GpuPipelineHandle) override
+	{
+	}
+	void SerializeLibrary (std::vector<uint8_t> &blob) override
+	{
+		blob.clear ();
+	}
+
+	GpuPipelineHandle next_pipeline;
+};
+
+static void MakeDirectory (const std::string &path)
+{
+#ifdef _WIN32
+	_mkdir (path.c_str ());
+#else
+	mkdir (path.c_str (), 0755);
+#endif
+}
+
+static void WriteFile (const std::string &path, const std::string &contents)
+{
+	FILE *f = fopen (path.c_str (), "wb");
+	if (!f)
+	{
+		fprintf (stderr, "Cannot write %s\n", path.c_str ());
+		exit (1);
+	}
+	fwrite (contents.data (), 1, contents.size (), f);
+	fclose (f);
+}
+
+struct Material
+{
+	ShaderRequest requests[2];
+	ShaderResult results[2];
+	PipelineDesc desc;
+	PipelineId pipeline;
+};
+
+static void PrintFrames (const char *name, std::vector<uint64_t> &frame_ns, double reload_ms)
+{
+	const uint64_t p50 = GetPercentile (frame_ns, 50.0);
+	const uint64_t p99 = GetPercentile (frame_ns, 99.0);
+	printf ("%-22s %5zu frames, frame work p50 %7.3f ms, p99 %7.3f ms, max %7.3f ms, reloaded after %6.1f ms\n",
+			name, frame_ns.size (), p50 / 1e6, p99 / 1e6, frame_ns.back () / 1e6, reload_ms);
+}
+
+int main (int argc, char **argv)
+{
+	const bool quick = IsQuickRun (argc, argv);
+	const uint32_t material_count = quick ? 4 : 32;
+
+	MakeDirectory (root);
+	MakeDirectory (std::string (root) + "cache");
+	const std::string common = std::string (root) + "common.hlsli";
+	const std::string stamp = "//" + std::to_string (GetBenchNanoseconds ()) + "\n";
+	WriteFile (common, stamp + "float4 Tint;\n");
+
+	SleepCompiler compiler;
+	SleepPipelineBackend backend;
+	NullDevice device;
+	FrameScheduler scheduler (&device, 2, FRAME_POLICY_MAX_THROUGHPUT);
+	std::vector<Material> materials (material_count);
+	{
+		ShaderCache shader_cache (&compiler, std::string (root) + "cache/", std::vector<std::string> ());
+		PipelineCache pipelines (&backend, 1);
+		static const PipelineInputElement position = { "POSITION", 0, 6, 0, 0, 0, 0 };
+		for (uint32_t i = 0; i < material_count; i++)
+		{
+			Material &material = materials[i];
+			const std::string file = std::string (root) + "material" + std::to_string (i) + ".hlsl";
+			WriteFile (file, "#include \"common.hlsli\"\nfloat4 Material" + std::to_string (i) + ";\n");
+			material.requests[0] = ShaderRequest { file, "VSMain", "vs_5_0", std::vector<ShaderDefine> (), 0 };
+			material.requests[1] = ShaderRequest { file, "PSMain", "ps_5_0", std::vector<ShaderDefine> (), 0 };
+			shader_cache.Build (material.requests, 2, nullptr, material.results);
+			material.desc.shaders[PIPELINE_SHADER_VS] = { material.results[0].bytecode.data (), material.results[0].bytecode.size () };
+			material.desc.shaders[PIPELINE_SHADER_PS] = { material.results[1].bytecode.data (), material.results[1].bytecode.size () };
+			material.desc.input_elements = &position;
+			material.desc.input_element_count = 1;
+			material.desc.render_target_count = 1;
+			material.desc.render_target_formats[0] = 28;
+			material.pipeline = pipelines.Create (material.desc);
+		}
+
+		//hot reload: frames go on with the old pipelines until the new ones are ready
+		{
+			ShaderReloader reloader (&shader_cache, &pipelines, &scheduler, 5);
+			for (Material &material : materials)
+				reloader.Register (material.pipeline, material.desc, {
+					{ PIPELINE_SHADER_VS, material.requests[0], material.results[0].dependencies },
+					{ PIPELINE_SHADER_PS, material.requests[1], material.results[1].dependencies } });
+			while (reloader.GetStats ().files < material_count + 1)
+				std::this_thread::sleep_for (std::chrono::milliseconds (1));
+
+			WriteFile (common, stamp + "float4 Tint;\nfloat Exposure;\n");
+			const uint64_t edit = GetBenchNanoseconds ();
+			uint64_t reloaded = 0;
+			std::vector<uint64_t> frame_ns;
+			std::vector<ShaderReloadEvent> events;
+			while (reloader.GetStats ().swaps < material_count && GetBenchNanoseconds () - edit < 10000000000ull)
+			{
+				const uint64_t begin = GetBenchNanoseconds ();
+				scheduler.BeginFrame ();
+				reloader.Update (events);
+				for (uint32_t i = 0; i < material_count; i++)
+					KeepValue (reloader.Get (i));
+				scheduler.EndFrame ();
+				frame_ns.push_back (GetBenchNanoseconds () - begin);
+				reloaded = GetBenchNanoseconds () - edit;
+				std::this_thread::sleep_for (std::chrono::milliseconds (2));
+			}
+			PrintFrames ("background reload:", frame_ns, reloaded / 1e6);
+			scheduler.WaitForIdle ();
+		}
+
+		//the same edit rebuilt in the frame that notices it
+		WriteFile (common, stamp + "float4 Tint;\nfloat Exposure;\nfloat Gamma;\n");
+		const uint64_t edit = GetBenchNanoseconds ();
+		uint64_t reloaded = 0;
+		std::vector<uint64_t> frame_ns;
+		const uint32_t frames = 16;
+		for (uint32_t frame = 0; frame < frames; frame++)
+		{
+			const uint64_t begin = GetBenchNanoseconds ();
+			scheduler.BeginFrame ();
+			if (!frame)
+			{
+				scheduler.WaitForIdle ();
+				for (Material &material : materials)
+				{
+					ShaderResult results[2];
+					shader_cache.Build (material.requests, 2, nullptr, results);
+					PipelineDesc desc = material.desc;
+					desc.shaders[PIPELINE_SHADER_VS] = { results[0].bytecode.data (), results[0].bytecode.size () };
+					desc.shaders[PIPELINE_SHADER_PS] = { results[1].bytecode.data (), results[1].bytecode.size () };
+					material.pipeline = pipelines.Create (desc);
+				}
+				reloaded = GetBenchNanoseconds () - edit;
+			}
+			scheduler.EndFrame ();
+			frame_ns.push_back (GetBenchNanoseconds () - begin);
+			std::this_thread::sleep_for (std::chrono::milliseconds (2));
+		}
+		PrintFrames ("render thread rebuild:", frame_ns, reloaded / 1e6);
+		scheduler.WaitForIdle ();
+	}
+
+	for (uint64_t key_hash : compiler.entries)
+	{
+		char name[24];
+		snprintf (name, sizeof (name), "%016llx.cso", static_cast<unsigned long long>(key_hash));
+		remove ((std::string (root) + "cache/" + name).c_str ());
+	}
+	for (uint32_t i = 0; i < material_count; i++)
+		remove ((std::string (root) + "material" + std::to_string (i) + ".hlsl").c_str ());
+	remove (common.c_str ());
+	return 0;
+}
@@ -0,0 +1,90 @@
+#include "bench.h"
+#include "texture_compress.h"
+
+#include <math.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <random>
+#include <thread>
+#include <vector>
+
+//Block compression of a 512x512 synthetic photo, smooth gradients with sharp edges of a
+//few shapes, fine noise and an alpha mask, at every encoding and quality level. Throughput
+//is source megapixels per second of the median run on one thread and on the job system,
+//quality the PSNR of the decoded blocks over the channels the encoding stores; BC1 is
+//measured on the opaque image since it has no alpha.
+
+static TextureImage MakePhoto (uint32_t size)
+{
+	TextureImage image;
+	image.Resize (size, size);
+	std::mt19937 random (1);
+	for (uint32_t y = 0; y < size; y++)
+		for (uint32_t x = 0; x < size; x++)
+		{
+			const float u = static_cast<float>(x) / size, v = static_cast<float>(y) / size;
+			float colour[4] = { 255.0f * u, 255.0f * (0.5f + 0.5f * sinf (9.0f * v + 3.0f * u)), 255.0f * (1.0f - u * v), 255.0f };
+			//a disc and a bar with hard edges
+			if ((u - 0.3f) * (u - 0.3f) + (v - 0.6f) * (v - 0.6f) < 0.04f)
+			{
+				colour[0] = 240.0f;
+				colour[1] = 200.0f;
+				colour[2] = 30.0f;
+			}
+			if (u > 0.6f && u < 0.7f)
+				colour[3] = 0.0f;
+			uint8_t *pixel = image.GetPixel (x, y);
+			for (uint32_t c = 0; c < 4; c++)
+			{
+				const float value = colour[c] + (c < 3 ? static_cast<float>(random () % 9) - 4.0f : 0.0f);
+				pixel[c] = static_cast<uint8_t>(std::min (std::max (value, 0.0f), 255.0f));
+			}
+		}
+	return image;
+}
+
+static double MeasureMpixPerSecond (const TextureImage &image, TextureEncoding encoding, TextureQuality quality, JobSystem *job_system,
+									uint32_t iterations, std::vector<uint8_t> &blocks)
+{
+	std::vector<uint64_t> samples;
+	for (uint32_t i = 0; i < iterations; i++)
+	{
+		const uint64_t begin = GetBenchNanoseconds ();
+		EncodeTextureBlocks (image, encoding, quality, job_system, blocks);
+		samples.push_back (GetBenchNanoseconds () - begin);
+		KeepValue (blocks[0]);
+	}
+	return static_cast<double>(image.width) * image.height / (GetPercentile (samples, 50.0) / 1e3);
+}
+
+int main (int argc, char **argv)
+{
+	const bool quick = IsQuickRun (argc, argv);
+	const uint32_t size = quick ? 64 : 512;
+	const uint32_t iterations = quick ? 1 : 3;
+	const uint32_t threads = std::max (2u, std::thread::hardware_concurrency ());
+	JobSystem job_system (threads);
+	const TextureImage image = MakePhoto (size);
+	TextureImage opaque = image;
+	for (size_t i = 3; i < opaque.pixels.size (); i += 4)
+		opaque.pixels[i] = 255;
+
+	printf ("%ux%u, %u worker threads\n%-6s %-8s %14s %14s %10s\n", size, size, threads, "format", "quality", "1 thread MPix/s",
+			"jobs MPix/s", "PSNR dB");
+	std::vector<uint8_t> blocks;
+	TextureImage decoded;
+	for (uint32_t e = TEXTURE_ENCODING_BC1; e < TEXTURE_ENCODING_COUNT; e++)
+		for (uint32_t q = 0; q < TEXTURE_QUALITY_COUNT; q++)
+		{
+			const TextureEncoding encoding = static_cast<TextureEncoding>(e);
+			const TextureQuality quality = static_cast<TextureQuality>(q);
+			const TextureImage &source = encoding == TEXTURE_ENCODING_BC1 ? opaque : image;
+			const double single = MeasureMpixPerSecond (source, encoding, quality, nullptr, iterations, blocks);
+			const double parallel = MeasureMpixPerSecond (source, encoding, quality, &job_system, iterations, blocks);
+			DecodeTextureBlocks (blocks.data (), size, size, encoding, decoded);
+			printf ("%-6s %-8s %14.2f %14.2f %10.2f\n", GetTextureEncodingName (encoding), GetTextureQualityName (quality), single, parallel,
+					ComputeTexturePsnr (source, decoded, GetTextureEncodingChannels (encoding)));
+		}
+	return 0;
+}
@@ -0,0 +1,91 @@
+#include "bench.h"
+#include "null_device.h"
+#include "upload_allocator.h"
+#include "memory_backends.h"
+
+#include <stdio.h>
+
+#include <random>
+
+//Uploads through the ring against the old scheme of one upload resource per buffer,
+//modelled as a chunk created and destroyed per upload. Chunks here are plain system
+//memory, so the baseline leaves out the driver cost of a committed resource and map.
+//Waits for the GPU jump the simulated timeline of the null device and cost no time.
+
+int main (int argc, char **argv)
+{
+	const bool quick = IsQuickRun (argc, argv);
+	const uint32_t frames = quick ? 10 : 200;
+	const uint32_t uploads_per_frame = 2000;
+	std::vector<uint8_t> source (64 * 1024, 0x5a);
+	std::vector<uint64_t> sizes (uploads_per_frame);
+	std::mt19937 random (7);
+	uint64_t frame_bytes = 0;
+	for (uint64_t &size : sizes)
+	{
+		size = 256 + random () % (16 * 1024);
+		frame_bytes += size;
+	}
+
+	NullDevice device;
+	MemoryUploadBackend backend;
+	NullCommandAllocator command_allocator;
+	std::unique_ptr<GpuCommandList> command_list = device.CreateCommandList (&command_allocator);
+	command_list->Close ();
+	GpuCommandList *lists[] = { command_list.get () };
+
+	//ring sized for three frames in flight
+	{
+		UploadAllocator upload (&device, &backend, frame_bytes * 3 + (1 << 20));
+		const uint64_t begin = GetBenchNanoseconds ();
+		for (uint32_t frame = 1; frame <= frames; frame++)
+		{
+			command_allocator.Reset ();
+			command_list->Reset (&command_allocator, 0);
+			for (uint32_t i = 0; i < uploads_per_frame; i++)
+				upload.UploadBuffer (1 + i % 64, i / 64 * 16384, source.data (), sizes[i]);
+			upload.FlushCopies (command_list.get ());
+			command_list->Close ();
+			device.ExecuteCommandLists (1, lists);
+			upload.FinishFrame (frame);
+			device.Signal (frame);
+		}
+		const double seconds = (GetBenchNanoseconds () - begin) / 1e9;
+		const UploadStats stats = upload.GetStats ();
+		printf ("ring:          %7.1f ns/upload, %6.2f GB/s, %llu stalls, %llu copies recorded of %llu\n",
+				seconds * 1e9 / (static_cast<double>(frames) * uploads_per_frame), frame_bytes * frames / seconds / 1e9,
+				static_cast<unsigned long long>(stats.stalls), static_cast<unsigned long long>(stats.recorded_copies),
+				static_cast<unsigned long long>(stats.copies));
+	}
+
+	//one resource per upload, destroyed once the frame is done like the retired chunks
+	{
+		std::vector<std::vector<UploadChunk>> in_flight (3);
+		const uint64_t begin = GetBenchNanoseconds ();
+		for (uint32_t frame = 1; frame <= frames; frame++)
+		{
+			std::vector<UploadChunk> &chunks = in_flight[frame % in_flight.size ()];
+			for (const UploadChunk &chunk : chunks)
+				backend.DestroyChunk (chunk);
+			chunks.clear ();
+			command_allocator.Reset ();
+			command_list->Reset (&command_allocator, 0);
+			for (uint32_t i = 0; i < uploads_per_frame; i++)
+			{
+				chunks.push_back (backend.CreateChunk (sizes[i]));
+				memcpy (chunks.back ().cpu_address, source.data (), static_cast<size_t>(sizes[i]));
+				command_list->CopyBufferRegion (1 + i % 64, i / 64 * 16384, chunks.back ().resource, 0, sizes[i]);
+			}
+			command_list->Close ();
+			device.ExecuteCommandLists (1, lists);
+			device.Signal (frame);
+		}
+		const double seconds = (GetBenchNanoseconds () - begin) / 1e9;
+		printf ("per resource:  %7.1f ns/upload, %6.2f GB/s, %u copies recorded per frame\n",
+				seconds * 1e9 / (static_cast<double>(frames) * uploads_per_frame), frame_bytes * frames / seconds / 1e9, uploads_per_frame);
+		for (const std::vector<UploadChunk> &chunks : in_flight)
+			for (const UploadChunk &chunk : chunks)
+				backend.DestroyChunk (chunk);
+	}
+	return 0;
+}
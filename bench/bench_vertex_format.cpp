@@ -0,0 +1,137 @@
+#include "bench.h"
+#include "vertex_format.h"
+
+#include <math.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <random>
+
+//Encoding interleaved float vertices into the compact formats at every SIMD level the
+//CPU has, in millions of vertices per second, and the round-trip error of each format
+//over the same vertices: positions in units of the mesh extent, normals in degrees.
+
+struct FloatVertex
+{
+	float position[3];
+	float normal[3];
+	float texcoord[2];
+	float color[4];
+};
+
+enum Kernel
+{
+	KERNEL_SNORM16_POSITIONS,
+	KERNEL_OCTAHEDRAL_NORMALS,
+	KERNEL_HALF_TEXCOORDS,
+	KERNEL_UNORM8_COLORS,
+	KERNEL_COUNT
+};
+
+static const float scale[3] = { 100.0f, 100.0f, 100.0f };
+static const float bias[3] = { 0.0f, 0.0f, 0.0f };
+
+static void RunKernel (uint32_t kernel, const std::vector<FloatVertex> &vertices, uint8_t *dst, VertexSimdLevel level)
+{
+	const uint32_t count = static_cast<uint32_t>(vertices.size ());
+	const uint32_t stride = sizeof (FloatVertex);
+	switch (kernel)
+	{
+	case KERNEL_SNORM16_POSITIONS:
+		EncodeSnorm16Positions (vertices[0].position, stride, count, scale, bias, dst, 20, level);
+		break;
+	case KERNEL_OCTAHEDRAL_NORMALS:
+		EncodeOctahedralNormals (vertices[0].normal, stride, count, dst + 8, 20, level);
+		break;
+	case KERNEL_HALF_TEXCOORDS:
+		EncodeHalfs (vertices[0].texcoord, stride, 2, count, dst + 12, 20, level);
+		break;
+	case KERNEL_UNORM8_COLORS:
+		EncodeUnorm8Colors (vertices[0].color, stride, count, dst + 16, 20, level);
+		break;
+	}
+}
+
+int main (int argc, char **argv)
+{
+	const bool quick = IsQuickRun (argc, argv);
+	const uint32_t count = quick ? 10000 : 1000000;
+	const uint32_t iterations = quick ? 2 : 20;
+
+	std::mt19937 random (1);
+	std::uniform_real_distribution<float> unit (-1.0f, 1.0f);
+	std::vector<FloatVertex> vertices (count);
+	for (FloatVertex &vertex : vertices)
+	{
+		float length = 0.0f;
+		for (uint32_t c = 0; c < 3; c++)
+		{
+			vertex.position[c] = unit (random) * scale[c];
+			vertex.normal[c] = unit (random);
+			length += vertex.normal[c] * vertex.normal[c];
+		}
+		for (uint32_t c = 0; c < 3; c++)
+			vertex.normal[c] /= sqrtf (length);
+		vertex.texcoord[0] = unit (random) * 0.5f + 0.5f;
+		vertex.texcoord[1] = unit (random) * 0.5f + 0.5f;
+		for (uint32_t c = 0; c < 4; c++)
+			vertex.color[c] = unit (random) * 0.5f + 0.5f;
+	}
+	std::vector<uint8_t> encoded (static_cast<size_t>(count) * 20);
+
+	const char *names[KERNEL_COUNT] = { "snorm16 positions", "octahedral normals", "half texcoords", "unorm8 colours" };
+	printf ("%u vertices, %s CPU\n%-20s", count, GetVertexSimdLevelName (GetVertexSimdLevel ()), "Mvertices/s");
+	const VertexSimdLevel levels[] = { VERTEX_SIMD_SCALAR, VERTEX_SIMD_SSE2, VERTEX_SIMD_AVX2 };
+	for (VertexSimdLevel level : levels)
+		if (level <= GetVertexSimdLevel ())
+			printf ("%10s", GetVertexSimdLevelName (level));
+	printf ("\n");
+	for (uint32_t kernel = 0; kernel < KERNEL_COUNT; kernel++)
+	{
+		printf ("%-20s", names[kernel]);
+		for (VertexSimdLevel level : levels)
+		{
+			if (level > GetVertexSimdLevel ())
+				continue;
+			std::vector<uint64_t> samples;
+			for (uint32_t i = 0; i < iterations; i++)
+			{
+				const uint64_t begin = GetBenchNanoseconds ();
+				RunKernel (kernel, vertices, encoded.data (), level);
+				samples.push_back (GetBenchNanoseconds () - begin);
+				KeepValue (encoded[i % encoded.size ()]);
+			}
+			printf ("%10.1f", count * 1e3 / GetPercentile (samples, 50.0));
+		}
+		printf ("\n");
+	}
+
+	//round trip of the last encoding, which every level wrote with the same bits
+	std::vector<float> decoded (static_cast<size_t>(count) * 4);
+	double position_error = 0.0, normal_error = 0.0, texcoord_error = 0.0, color_error = 0.0;
+	DecodeSnorm16Positions (encoded.data (), 20, count, scale, bias, decoded.data (), 16);
+	for (uint32_t i = 0; i < count; i++)
+		for (uint32_t c = 0; c < 3; c++)
+			position_error = std::max (position_error, fabs (decoded[i * 4 + c] - vertices[i].position[c]) / (2.0 * scale[c]));
+	DecodeOctahedralNormals (encoded.data () + 8, 20, count, decoded.data (), 16);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		const float *normal = vertices[i].normal;
+		const float *result = &decoded[i * 4];
+		const double cross[3] = { normal[1] * result[2] - normal[2] * result[1], normal[2] * result[0] - normal[0] * result[2], normal[0] * result[1] - normal[1] * result[0] };
+		const double dot = normal[0] * result[0] + normal[1] * result[1] + normal[2] * result[2];
+		normal_error = std::max (normal_error, atan2 (sqrt (cross[0] * cross[0] + cross[1] * cross[1] + cross[2] * cross[2]), dot) * 180.0 / 3.14159265358979);
+	}
+	DecodeHalfs (encoded.data () + 12, 20, 2, count, decoded.data (), 16);
+	for (uint32_t i = 0; i < count; i++)
+		for (uint32_t c = 0; c < 2; c++)
+			texcoord_error = std::max (texcoord_error, static_cast<double>(fabsf (decoded[i * 4 + c] - vertices[i].texcoord[c])));
+	DecodeUnorm8Colors (encoded.data () + 16, 20, count, decoded.data (), 16);
+	for (uint32_t i = 0; i < count; i++)
+		for (uint32_t c = 0; c < 4; c++)
+			color_error = std::max (color_error, static_cast<double>(fabsf (decoded[i * 4 + c] - vertices[i].color[c])));
+	printf ("max round-trip error: positions %.2e of the extent, normals %.4f degrees, texcoords %.2e, colours %.2e\n",
+			position_error, normal_error, texcoord_error, color_error);
+	printf ("vertex size: %zu bytes as floats, 20 bytes compact\n", sizeof (FloatVertex));
+	return 0;
+}
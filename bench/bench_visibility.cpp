@@ -0,0 +1,132 @@
+#include "bench.h"
+#include "visibility.h"
+
+#include <math.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <random>
+#include <thread>
+#include <vector>
+
+//Frustum culling of 10k to 1M objects spread through a cube, seen by a 60 degree camera
+//at its centre that sees about a tenth of them. Every SIMD level the CPU has with and
+//without the hierarchy, for spheres and boxes, then the hierarchy culled on worker
+//threads and the cost of building and refitting it. Times are the median per cull.
+
+static Frustum MakeFrustum ()
+{
+	const float y_scale = 1.0f / tanf (0.5236f);
+	const float far_z = 1000.0f, near_z = 0.5f;
+	const float range = far_z / (far_z - near_z);
+	const float view_projection[16] =
+	{
+		y_scale / 1.7778f, 0.0f, 0.0f, 0.0f,
+		0.0f, y_scale, 0.0f, 0.0f,
+		0.0f, 0.0f, range, 1.0f,
+		0.0f, 0.0f, -range * near_z, 0.0f
+	};
+	return ExtractFrustum (view_projection);
+}
+
+static void SetObjects (VisibilityScene &scene, uint32_t count, float jitter, std::mt19937 &random)
+{
+	std::uniform_real_distribution<float> position (-500.0f, 500.0f);
+	std::uniform_real_distribution<float> size (0.2f, 4.0f);
+	std::uniform_real_distribution<float> move (-jitter, jitter);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		float box_min[3], box_max[3];
+		for (uint32_t c = 0; c < 3; c++)
+		{
+			const float center = position (random) + move (random);
+			const float extent = size (random);
+			box_min[c] = center - extent;
+			box_max[c] = center + extent;
+		}
+		scene.SetBox (i, box_min, box_max);
+	}
+}
+
+static double TimeCull (const VisibilityScene &scene, const Frustum &frustum, const CullOptions &options, uint32_t iterations,
+						CullStats &stats)
+{
+	std::vector<uint32_t> visible;
+	std::vector<uint64_t> samples;
+	for (uint32_t i = 0; i < iterations; i++)
+	{
+		const uint64_t begin = GetBenchNanoseconds ();
+		scene.Cull (frustum, options, visible, &stats);
+		samples.push_back (GetBenchNanoseconds () - begin);
+		KeepValue (visible.size ());
+	}
+	return GetPercentile (samples, 50.0) / 1e6;
+}
+
+int main (int argc, char **argv)
+{
+	const bool quick = IsQuickRun (argc, argv);
+	const uint32_t counts[] = { 10000, 100000, 1000000 };
+	const uint32_t size_count = quick ? 1 : 3;
+	const Frustum frustum = MakeFrustum ();
+	const uint32_t threads = std::max (2u, std::thread::hardware_concurrency ());
+	JobSystem job_system (threads);
+	const CullSimdLevel levels[] = { CULL_SIMD_SCALAR, CULL_SIMD_SSE2, CULL_SIMD_AVX };
+	const char *volume_names[] = { "sphere", "box" };
+
+	printf ("%s CPU, %u worker threads\n", GetCullSimdLevelName (GetCullSimdLevel ()), threads);
+	for (uint32_t s = 0; s < size_count; s++)
+	{
+		const uint32_t count = counts[s];
+		const uint32_t iterations = quick ? 3 : std::max (5u, 2000000 / count);
+		std::mt19937 random (1);
+		VisibilityScene scene;
+		scene.Resize (count);
+		SetObjects (scene, count, 0.0f, random);
+
+		//the flat layout in object order first, then in hierarchy order
+		printf ("%u objects\n%-8s %-10s %12s %12s %10s\n", count, "volume", "level", "flat ms", "BVH ms", "visible");
+		double flat[2][3] = {};
+		CullStats stats;
+		for (uint32_t volume = 0; volume < 2; volume++)
+			for (CullSimdLevel level : levels)
+				if (level <= GetCullSimdLevel ())
+				{
+					CullOptions options;
+					options.volume = static_cast<CullVolume>(volume);
+					options.level = level;
+					options.hierarchy = false;
+					flat[volume][level] = TimeCull (scene, frustum, options, iterations, stats);
+				}
+		uint64_t begin = GetBenchNanoseconds ();
+		scene.BuildHierarchy ();
+		const double build_ms = (GetBenchNanoseconds () - begin) / 1e6;
+		for (uint32_t volume = 0; volume < 2; volume++)
+			for (CullSimdLevel level : levels)
+				if (level <= GetCullSimdLevel ())
+				{
+					CullOptions options;
+					options.volume = static_cast<CullVolume>(volume);
+					options.level = level;
+					const double hierarchy_ms = TimeCull (scene, frustum, options, iterations, stats);
+					printf ("%-8s %-10s %12.3f %12.3f %10u\n", volume_names[volume], GetCullSimdLevelName (level), flat[volume][level],
+							hierarchy_ms, stats.visible);
+				}
+
+		CullOptions options;
+		options.volume = CULL_VOLUME_BOX;
+		const double single_ms = TimeCull (scene, frustum, options, iterations, stats);
+		options.job_system = &job_system;
+		const double parallel_ms = TimeCull (scene, frustum, options, iterations, stats);
+		printf ("box BVH %s: %.3f ms on one thread, %.3f ms on the job system; %u nodes and %u objects tested, %u accepted\n",
+				GetCullSimdLevelName (GetCullSimdLevel ()), single_ms, parallel_ms, stats.tested_nodes, stats.tested_objects, stats.accepted_objects);
+
+		//objects moved a little, as a frame of animation would
+		random.seed (1);
+		SetObjects (scene, count, 2.0f, random);
+		begin = GetBenchNanoseconds ();
+		scene.RefitHierarchy ();
+		printf ("hierarchy build %.2f ms, refit %.2f ms\n", build_ms, (GetBenchNanoseconds () - begin) / 1e6);
+	}
+	return 0;
+}
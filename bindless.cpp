@@ -0,0 +1,136 @@
+#include "bindless.h"
+
+#include <float.h>
+#include <string.h>
+#include <stdexcept>
+
+//D3D12 enumeration values of the canonical layout
+static const uint32_t root_signature_flag_input_layout = 0x1;
+static const uint32_t shader_visibility_all = 0;
+static const uint32_t filter_linear = 0x15;
+static const uint32_t filter_point = 0x0;
+static const uint32_t filter_anisotropic = 0x55;
+static const uint32_t address_wrap = 1;
+static const uint32_t address_clamp = 3;
+static const uint32_t comparison_less_equal = 4;
+static const uint32_t border_opaque_white = 2;
+
+RootSignatureDesc MakeBindlessRootSignatureDesc (BindlessRootSignatureType type)
+{
+	RootSignatureDesc desc;
+	memset (&desc, 0, sizeof (desc));
+	desc.flags = type == BINDLESS_ROOT_SIGNATURE_GRAPHICS ? root_signature_flag_input_layout : 0;
+
+	desc.parameter_count = 2;
+	RootParameter &constants = desc.parameters[bindless_constants_parameter];
+	constants.type = ROOT_PARAMETER_CONSTANTS;
+	constants.visibility = shader_visibility_all;
+	constants.constant_count = bindless_root_constant_count;
+	RootParameter &table = desc.parameters[bindless_table_parameter];
+	table.type = ROOT_PARAMETER_TABLE;
+	table.visibility = shader_visibility_all;
+	table.range_count = 1;
+	table.ranges[0].type = ROOT_RANGE_SRV;
+	table.ranges[0].count = root_unbounded_range;
+	table.ranges[0].space = bindless_table_space;
+
+	const uint32_t filters[BINDLESS_SAMPLER_COUNT] = { filter_linear, filter_linear, filter_point, filter_anisotropic };
+	const uint32_t addresses[BINDLESS_SAMPLER_COUNT] = { address_wrap, address_clamp, address_clamp, address_wrap };
+	desc.static_sampler_count = BINDLESS_SAMPLER_COUNT;
+	for (uint32_t i = 0; i < BINDLESS_SAMPLER_COUNT; i++)
+	{
+		RootStaticSampler &sampler = desc.static_samplers[i];
+		sampler.filter = filters[i];
+		sampler.address_u = sampler.address_v = sampler.address_w = addresses[i];
+		sampler.max_anisotropy = 16;
+		sampler.comparison_func = comparison_less_equal;
+		sampler.border_color = border_opaque_white;
+		sampler.max_lod = FLT_MAX;
+		sampler.shader_register = i;
+		sampler.visibility = shader_visibility_all;
+	}
+	return desc;
+}
+
+BindlessIndexAllocator::BindlessIndexAllocator (uint32_t index_capacity) :
+	capacity (index_capacity),
+	next_unused (0),
+	allocated ((index_capacity + 63) / 64),
+	allocated_count (0)
+{
+}
+
+uint32_t BindlessIndexAllocator::Allocate ()
+{
+	std::lock_guard<std::mutex> lock (mutex);
+	uint32_t index;
+	if (!free_indices.empty ())
+	{
+		index = free_indices.back ();
+		free_indices.pop_back ();
+	}
+	else if (next_unused < capacity)
+		index = next_unused++;
+	else
+		throw std::runtime_error (pending.empty () ? "Bindless table is full" : "Bindless table is full until frames in flight finish");
+	allocated[index / 64] |= 1ull << (index % 64);
+	allocated_count++;
+	return index;
+}
+
+void BindlessIndexAllocator::Free (uint32_t index, uint64_t fence_value)
+{
+	std::lock_guard<std::mutex> lock (mutex);
+	if (index >= capacity || !(allocated[index / 64] & (1ull << (index % 64))))
+		throw std::logic_error ("Bindless index is not allocated");
+	allocated[index / 64] &= ~(1ull << (index % 64));
+	allocated_count--;
+	//frames finish in order, so the queue stays sorted
+	pending.push_back (std::make_pair (fence_value, index));
+}
+
+void BindlessIndexAllocator::Recycle (uint64_t completed_fence_value)
+{
+	std::lock_guard<std::mutex> lock (mutex);
+	while (!pending.empty () && pending.front ().first <= completed_fence_value)
+	{
+		free_indices.push_back (pending.front ().second);
+		pending.pop_front ();
+	}
+}
+
+uint32_t BindlessIndexAllocator::GetAllocatedCount () const
+{
+	std::lock_guard<std::mutex> lock (mutex);
+	return allocated_count;
+}
+
+uint32_t BindlessIndexAllocator::GetPendingCount () const
+{
+	std::lock_guard<std::mutex> lock (mutex);
+	return static_cast<uint32_t>(pending.size ());
+}
+
+BindlessDescriptors::BindlessDescriptors (ShaderDescriptorHeap *descriptor_heap, uint32_t capacity) :
+	heap (descriptor_heap),
+	table (descriptor_heap->AllocatePersistent (capacity)),
+	indices (capacity)
+{
+}
+
+BindlessDescriptors::~BindlessDescriptors ()
+{
+	heap->FreePersistent (table);
+}
+
+uint32_t BindlessDescriptors::Add (GpuDescriptorHandle source)
+{
+	const uint32_t index = indices.Allocate ();
+	heap->StageCopy (table, index, 1, &source);
+	return index;
+}
+
+void BindlessDescriptors::Remove (uint32_t index, uint64_t fence_value)
+{
+	indices.Free (index, fence_value);
+}
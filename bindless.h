@@ -0,0 +1,116 @@
+#pragma once
+#include "gpu_device.h"
+#include "descriptor_heap.h"
+#include "root_signature.h"
+
+#include <stdint.h>
+
+#include <deque>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+//Bindless resources. Shader resource views live in one persistent table of the shader
+//visible heap that stays bound for the whole command list; shaders index it with 32 bit
+//indices passed as root constants, so a draw binds nothing but a few constants. All
+//users share the canonical root signatures below:
+//
+//  parameter 0: bindless_root_constant_count root constants at b0, space0
+//  parameter 1: the table, an unbounded SRV range at t0, space1, e.g.
+//               Texture2D bindless_textures[] : register(t0, space1)
+//  static samplers s0 to s3, space0, see BindlessSampler
+//
+//Shaders indexing the table need shader model 5.1 and resource binding tier 2.
+
+static const uint32_t bindless_constants_parameter = 0;
+static const uint32_t bindless_table_parameter = 1;
+static const uint32_t bindless_root_constant_count = 16;
+static const uint32_t bindless_table_space = 1;
+static const uint32_t bindless_invalid_index = 0xffffffff;
+
+enum BindlessSampler
+{
+	BINDLESS_SAMPLER_LINEAR_WRAP,
+	BINDLESS_SAMPLER_LINEAR_CLAMP,
+	BINDLESS_SAMPLER_POINT_CLAMP,
+	BINDLESS_SAMPLER_ANISOTROPIC_WRAP,
+	BINDLESS_SAMPLER_COUNT
+};
+
+enum BindlessRootSignatureType
+{
+	BINDLESS_ROOT_SIGNATURE_GRAPHICS,   //with input assembler input
+	BINDLESS_ROOT_SIGNATURE_COMPUTE
+};
+
+RootSignatureDesc MakeBindlessRootSignatureDesc (BindlessRootSignatureType type);
+
+//indices into a table of capacity descriptors. A freed index may still be read by frames
+//in flight, so it is only handed out again once the fence value of its frame completed.
+//Thread-safe.
+class BindlessIndexAllocator
+{
+public:
+	explicit BindlessIndexAllocator (uint32_t capacity);
+
+	//throws std::runtime_error if every index is in use or waiting for its fence
+	uint32_t Allocate ();
+	//throws std::logic_error for indices that are not allocated
+	void Free (uint32_t index, uint64_t fence_value);
+	//makes indices freed with fence values up to the completed one available again
+	void Recycle (uint64_t completed_fence_value);
+
+	uint32_t GetCapacity () const
+	{
+		return capacity;
+	}
+	uint32_t GetAllocatedCount () const;
+	uint32_t GetPendingCount () const;
+private:
+	uint32_t capacity;
+	mutable std::mutex mutex;
+	uint32_t next_unused;                           //indices from here on were never allocated
+	std::vector<uint32_t> free_indices;
+	std::deque<std::pair<uint64_t, uint32_t>> pending;  //fence value and index, in fence order
+	std::vector<uint64_t> allocated;                //one bit per index, catches double frees
+	uint32_t allocated_count;
+};
+
+//the bindless table inside the persistent region of a shader descriptor heap
+class BindlessDescriptors
+{
+public:
+	BindlessDescriptors (ShaderDescriptorHeap *heap, uint32_t capacity);
+	~BindlessDescriptors ();
+
+	//copies a CPU descriptor into a free slot and returns its shader index; the copy is
+	//staged with the other copies of the heap and done by its next FlushCopies ()
+	uint32_t Add (GpuDescriptorHandle source);
+	//the slot is reused once the fence value completed
+	void Remove (uint32_t index, uint64_t fence_value);
+	void Recycle (uint64_t completed_fence_value)
+	{
+		indices.Recycle (completed_fence_value);
+	}
+
+	//for bindless_table_parameter
+	GpuShaderDescriptorHandle GetTable () const
+	{
+		return table.gpu_handle;
+	}
+	GpuDescriptorHeapHandle GetHeap () const
+	{
+		return heap->GetHeap ();
+	}
+	uint32_t GetCount () const
+	{
+		return indices.GetAllocatedCount ();
+	}
+private:
+	BindlessDescriptors (const BindlessDescriptors &) = delete;
+	BindlessDescriptors &operator= (const BindlessDescriptors &) = delete;
+
+	ShaderDescriptorHeap *heap;
+	DescriptorTable table;
+	BindlessIndexAllocator indices;
+};
@@ -0,0 +1,205 @@
+#include "command_recorder.h"
+
+#include <string.h>
+#include <algorithm>
+#include <stdexcept>
+
+CommandAllocatorPool::CommandAllocatorPool (GpuDevice *gpu_device) :
+	device (gpu_device)
+{
+}
+
+GpuCommandAllocator *CommandAllocatorPool::Acquire (uint64_t completed_fence_value)
+{
+	GpuCommandAllocator *allocator = nullptr;
+	{
+		std::lock_guard<std::mutex> lock (mutex);
+		if (!retired.empty () && retired.front ().first <= completed_fence_value)
+		{
+			allocator = retired.front ().second;
+			retired.pop_front ();
+		}
+		else
+		{
+			allocators.push_back (device->CreateCommandAllocator ());
+			return allocators.back ().get ();
+		}
+	}
+	allocator->Reset ();
+	return allocator;
+}
+
+void CommandAllocatorPool::Release (GpuCommandAllocator *allocator, uint64_t fence_value)
+{
+	std::lock_guard<std::mutex> lock (mutex);
+	//releases come in fence order almost always, insert from the back
+	auto position = retired.end ();
+	while (position != retired.begin () && (position - 1)->first > fence_value)
+		--position;
+	retired.insert (position, std::make_pair (fence_value, allocator));
+}
+
+size_t CommandAllocatorPool::GetAllocatorCount () const
+{
+	std::lock_guard<std::mutex> lock (mutex);
+	return allocators.size ();
+}
+
+ParallelCommandRecorder::ParallelCommandRecorder (GpuDevice *gpu_device, CommandAllocatorPool *allocator_pool, JobSystem *job_scheduler, ResourceStateRegistry *state_registry) :
+	device (gpu_device),
+	pool (allocator_pool),
+	job_system (job_scheduler),
+	registry (state_registry),
+	recorded_count (0),
+	fixup_count (0),
+	submission (0),
+	record_function (nullptr),
+	record_initial_state (0),
+	record_completed_value (0)
+{
+	memset (&barrier_stats, 0, sizeof (barrier_stats));
+}
+
+uint32_t ParallelCommandRecorder::GetJobCount (uint32_t count, uint32_t min_items_per_job) const
+{
+	const uint32_t item_jobs = count / std::max<uint32_t>(min_items_per_job, 1);
+	return std::max<uint32_t>(std::min (job_system->GetThreadCount (), item_jobs), 1);
+}
+
+void ParallelCommandRecorder::Record (uint32_t count, const RecordFunction &record, GpuPipelineHandle initial_state, uint64_t completed_fence_value)
+{
+	if (recorded_count)
+		throw std::logic_error ("Recorded command lists were not submitted");
+	while (jobs.size () < count)
+	{
+		jobs.push_back (Job ());
+		jobs.back ().allocator = nullptr;
+		jobs.back ().tracker.reset (new ResourceStateTracker (registry));
+	}
+
+	record_function = &record;
+	record_initial_state = initial_state;
+	record_completed_value = completed_fence_value;
+	try
+	{
+		//one list per job, the calling thread records as well
+		job_system->ParallelFor (count, 1, [this] (uint32_t begin, uint32_t end)
+		{
+			for (uint32_t i = begin; i < end; i++)
+				RecordJob (i);
+		});
+	}
+	catch (...)
+	{
+		//lists of failed jobs may still be open, so nothing from this frame is submitted
+		record_function = nullptr;
+		ReleaseAllocators (jobs, count, 0);
+		throw;
+	}
+	record_function = nullptr;
+	recorded_count = count;
+}
+
+void ParallelCommandRecorder::Submit (uint64_t fence_value)
+{
+	submission++;
+	memset (&barrier_stats, 0, sizeof (barrier_stats));
+	submit_lists.clear ();
+	hoisted.clear ();
+	fixup_count = 0;
+	try
+	{
+		//the registry holds the states after the previous list, so lists are resolved in order
+		for (uint32_t i = 0; i < recorded_count; i++)
+		{
+			fixups.clear ();
+			jobs[i].tracker->Resolve (submission, hoisted, fixups);
+			if (!fixups.empty ())
+				submit_lists.push_back (RecordFixups (fixups));
+			submit_lists.push_back (jobs[i].command_list.get ());
+
+			const ResourceStateStats &stats = jobs[i].tracker->GetStats ();
+			barrier_stats.transitions += stats.transitions;
+			barrier_stats.redundant += stats.redundant;
+			barrier_stats.barriers += stats.barriers;
+			barrier_stats.batches += stats.batches;
+			barrier_stats.fixups += stats.fixups;
+			if (stats.max_batch > barrier_stats.max_batch)
+				barrier_stats.max_batch = stats.max_batch;
+		}
+		//barriers of resources first used by a later list can all go in front
+		if (!hoisted.empty ())
+			submit_lists.insert (submit_lists.begin (), RecordFixups (hoisted));
+	}
+	catch (...)
+	{
+		//nothing was executed, the allocators are free right away
+		ReleaseAllocators (jobs, recorded_count, 0);
+		ReleaseAllocators (fixup_jobs, fixup_count, 0);
+		recorded_count = 0;
+		throw;
+	}
+	if (!submit_lists.empty ())
+		device->ExecuteCommandLists (static_cast<uint32_t>(submit_lists.size ()), submit_lists.data ());
+
+	ReleaseAllocators (jobs, recorded_count, fence_value);
+	ReleaseAllocators (fixup_jobs, fixup_count, fence_value);
+	recorded_count = 0;
+}
+
+void ParallelCommandRecorder::RecordJob (uint32_t index)
+{
+	Job &job = jobs[index];
+	job.allocator = pool->Acquire (record_completed_value);
+	if (!job.command_list)
+	{
+		//new lists are created open
+		job.command_list = device->CreateCommandList (job.allocator);
+		if (record_initial_state)
+			job.command_list->SetPipelineState (record_initial_state);
+	}
+	else
+		job.command_list->Reset (job.allocator, record_initial_state);
+
+	job.tracker->Reset ();
+	try
+	{
+		(*record_function) (index, job.command_list.get (), job.tracker.get ());
+		job.tracker->FlushBarriers (job.command_list.get ());
+	}
+	catch (...)
+	{
+		//leave the list closed so it can be reset next frame
+		job.command_list->Close ();
+		throw;
+	}
+	job.command_list->Close ();
+}
+
+GpuCommandList *ParallelCommandRecorder::RecordFixups (const std::vector<GpuBarrier> &barriers)
+{
+	if (fixup_count == fixup_jobs.size ())
+	{
+		fixup_jobs.push_back (Job ());
+		fixup_jobs.back ().allocator = nullptr;
+	}
+	Job &job = fixup_jobs[fixup_count++];
+	job.allocator = pool->Acquire (record_completed_value);
+	if (!job.command_list)
+		job.command_list = device->CreateCommandList (job.allocator);
+	else
+		job.command_list->Reset (job.allocator, 0);
+	job.command_list->ResourceBarrier (static_cast<uint32_t>(barriers.size ()), barriers.data ());
+	job.command_list->Close ();
+	return job.command_list.get ();
+}
+
+void ParallelCommandRecorder::ReleaseAllocators (std::vector<Job> &list_jobs, uint32_t count, uint64_t fence_value)
+{
+	for (uint32_t i = 0; i < count; i++)
+		if (list_jobs[i].allocator)
+		{
+			pool->Release (list_jobs[i].allocator, fence_value);
+			list_jobs[i].allocator = nullptr;
+		}
+}
@@ -0,0 +1,99 @@
+#pragma once
+#include "gpu_device.h"
+#include "job_system.h"
+#include "resource_state.h"
+
+#include <stdint.h>
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+//Command allocators recycled by fence value. Thread-safe, so every recording job
+//can take its own allocator.
+class CommandAllocatorPool
+{
+public:
+	explicit CommandAllocatorPool (GpuDevice *device);
+
+	//returns a reset allocator whose last use finished at or before the completed fence value
+	GpuCommandAllocator *Acquire (uint64_t completed_fence_value);
+	//the allocator can be reused once the fence reaches the value
+	void Release (GpuCommandAllocator *allocator, uint64_t fence_value);
+	size_t GetAllocatorCount () const;
+private:
+	GpuDevice *device;
+	mutable std::mutex mutex;
+	std::vector<std::unique_ptr<GpuCommandAllocator>> allocators;
+	std::deque<std::pair<uint64_t, GpuCommandAllocator*>> retired;    //ordered by fence value
+};
+
+//Records a frame split into jobs on the job system, one command list per job,
+//and submits the lists in job order with a single ExecuteCommandLists call. Every job
+//gets a state tracker for its list; barriers for the states the lists start with are
+//resolved at submit and recorded into small extra lists.
+class ParallelCommandRecorder
+{
+public:
+	typedef std::function<void (uint32_t job, GpuCommandList *command_list, ResourceStateTracker *tracker)> RecordFunction;
+
+	ParallelCommandRecorder (GpuDevice *device, CommandAllocatorPool *pool, JobSystem *job_system, ResourceStateRegistry *registry);
+
+	//blocks until every job recorded and closed its list; rethrows the first job exception.
+	//Barriers still queued in a tracker are flushed at the end of its list.
+	void Record (uint32_t job_count, const RecordFunction &record, GpuPipelineHandle initial_state, uint64_t completed_fence_value);
+	//resolves the states, executes the recorded lists and returns their allocators to the pool
+	void Submit (uint64_t fence_value);
+
+	//jobs to split the recording of count items into: one per thread of the job system, the
+	//calling one included, as long as every job gets min_items_per_job items, and at least one
+	uint32_t GetJobCount (uint32_t count, uint32_t min_items_per_job) const;
+	uint32_t GetRecordedListCount () const
+	{
+		return recorded_count;
+	}
+	//barrier statistics of the last submission, summed over its lists
+	const ResourceStateStats &GetBarrierStats () const
+	{
+		return barrier_stats;
+	}
+private:
+	struct Job
+	{
+		std::unique_ptr<GpuCommandList> command_list;
+		GpuCommandAllocator *allocator;
+		std::unique_ptr<ResourceStateTracker> tracker;
+	};
+
+	void RecordJob (uint32_t index);
+	//records the barriers into a list of their own and returns it
+	GpuCommandList *RecordFixups (const std::vector<GpuBarrier> &barriers);
+	void ReleaseAllocators (std::vector<Job> &list_jobs, uint32_t count, uint64_t fence_value);
+
+	ParallelCommandRecorder (const ParallelCommandRecorder &) = delete;
+	ParallelCommandRecorder &operator= (const ParallelCommandRecorder &) = delete;
+
+	GpuDevice *device;
+	CommandAllocatorPool *pool;
+	JobSystem *job_system;
+	ResourceStateRegistry *registry;
+	std::vector<Job> jobs;
+	std::vector<GpuCommandList*> submit_lists;
+	uint32_t recorded_count;
+
+	//lists with barriers resolved at submit
+	std::vector<Job> fixup_jobs;
+	uint32_t fixup_count;
+	std::vector<GpuBarrier> hoisted;
+	std::vector<GpuBarrier> fixups;
+	uint64_t submission;
+	ResourceStateStats barrier_stats;
+
+	//state of the current Record () call
+	const RecordFunction *record_function;
+	GpuPipelineHandle record_initial_state;
+	uint64_t record_completed_value;
+};
@@ -0,0 +1,69 @@
+#include "cpu_features.h"
+
+#include <stdint.h>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define CPU_FEATURES_X64
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+static CpuFeatures DetectCpuFeatures ()
+{
+	CpuFeatures features = {};
+#ifdef CPU_FEATURES_X64
+	//every x64 CPU has SSE2
+	features.sse2 = true;
+	uint32_t info[4];
+#ifdef _MSC_VER
+	__cpuid (reinterpret_cast<int*>(info), 0);
+#else
+	__cpuid (0, info[0], info[1], info[2], info[3]);
+#endif
+	const uint32_t max_leaf = info[0];
+#ifdef _MSC_VER
+	__cpuid (reinterpret_cast<int*>(info), 1);
+#else
+	__cpuid (1, info[0], info[1], info[2], info[3]);
+#endif
+	features.sse41 = (info[2] & (1u << 19)) != 0;
+	const bool fma = (info[2] & (1u << 12)) != 0;
+	const bool osxsave = (info[2] & (1u << 27)) != 0;
+	const bool avx = (info[2] & (1u << 28)) != 0;
+	const bool f16c = (info[2] & (1u << 29)) != 0;
+	if (!osxsave || !avx)
+		return features;
+#ifdef _MSC_VER
+	const uint64_t xcr0 = _xgetbv (0);
+#else
+	uint32_t xcr0_low, xcr0_high;
+	__asm__ ("xgetbv" : "=a" (xcr0_low), "=d" (xcr0_high) : "c" (0));
+	const uint64_t xcr0 = (static_cast<uint64_t>(xcr0_high) << 32) | xcr0_low;
+#endif
+	//XMM and YMM state
+	if ((xcr0 & 6) != 6)
+		return features;
+	features.avx = true;
+	features.fma = fma;
+	features.f16c = f16c;
+	//older CPUs return the highest leaf for leaves past it
+	if (max_leaf < 7)
+		return features;
+#ifdef _MSC_VER
+	__cpuidex (reinterpret_cast<int*>(info), 7, 0);
+#else
+	__cpuid_count (7, 0, info[0], info[1], info[2], info[3]);
+#endif
+	features.avx2 = (info[1] & (1u << 5)) != 0;
+#endif
+	return features;
+}
+
+const CpuFeatures &GetCpuFeatures ()
+{
+	static const CpuFeatures features = DetectCpuFeatures ();
+	return features;
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+//Instruction set extensions of the CPU the process runs on, detected once. The AVX
+//family also requires the OS to save the YMM registers; every flag is false on
+//platforms other than x64.
+struct CpuFeatures
+{
+	bool sse2;
+	bool sse41;
+	bool avx;
+	bool avx2;
+	bool fma;
+	bool f16c;
+};
+
+const CpuFeatures &GetCpuFeatures ();
@@ -0,0 +1,934 @@
+#include "stdafx.h"
+#include "d3d12_device.h"
+
+#include <vector>
+
+static_assert (sizeof (GpuViewport) == sizeof (D3D12_VIEWPORT), "GpuViewport must match D3D12_VIEWPORT");
+static_assert (sizeof (GpuRect) == sizeof (D3D12_RECT), "GpuRect must match D3D12_RECT");
+static_assert (sizeof (GpuVertexBufferView) == sizeof (D3D12_VERTEX_BUFFER_VIEW), "GpuVertexBufferView must match D3D12_VERTEX_BUFFER_VIEW");
+static_assert (sizeof (GpuIndexBufferView) == sizeof (D3D12_INDEX_BUFFER_VIEW), "GpuIndexBufferView must match D3D12_INDEX_BUFFER_VIEW");
+static_assert (sizeof (GpuDrawArguments) == sizeof (D3D12_DRAW_ARGUMENTS), "GpuDrawArguments must match D3D12_DRAW_ARGUMENTS");
+static_assert (sizeof (GpuDrawIndexedArguments) == sizeof (D3D12_DRAW_INDEXED_ARGUMENTS), "GpuDrawIndexedArguments must match D3D12_DRAW_INDEXED_ARGUMENTS");
+static_assert (sizeof (GpuTextureFootprint) == sizeof (D3D12_PLACED_SUBRESOURCE_FOOTPRINT), "GpuTextureFootprint must match D3D12_PLACED_SUBRESOURCE_FOOTPRINT");
+
+D3D12CommandAllocator::D3D12CommandAllocator (ID3D12Device *device, D3D12_COMMAND_LIST_TYPE type)
+{
+	THROWIFFAILED (device->CreateCommandAllocator (type, IID_PPV_ARGS (&allocator)),
+				   "Can not create command allocator");
+}
+
+void D3D12CommandAllocator::Reset ()
+{
+	THROWIFFAILED (allocator->Reset (), "Can not reset command allocator");
+}
+
+D3D12CommandList::D3D12CommandList (ID3D12Device *device, D3D12CommandAllocator *allocator, D3D12_COMMAND_LIST_TYPE type)
+{
+	THROWIFFAILED (device->CreateCommandList (0,
+											  type,
+											  allocator->Get (),
+											  nullptr,
+											  IID_PPV_ARGS (&command_list)),
+				   "Can not create command list");
+}
+
+void D3D12CommandList::Reset (GpuCommandAllocator *allocator, GpuPipelineHandle initial_state)
+{
+	THROWIFFAILED (command_list->Reset (static_cast<D3D12CommandAllocator*>(allocator)->Get (),
+										FromGpuHandle<ID3D12PipelineState> (initial_state)),
+				   "Can not reset command list");
+}
+
+void D3D12CommandList::Close ()
+{
+	THROWIFFAILED (command_list->Close (), "Can not close command list");
+}
+
+void D3D12CommandList::SetPipelineState (GpuPipelineHandle pipeline_state)
+{
+	command_list->SetPipelineState (FromGpuHandle<ID3D12PipelineState> (pipeline_state));
+}
+
+void D3D12CommandList::SetGraphicsRootSignature (GpuRootSignatureHandle root_signature)
+{
+	command_list->SetGraphicsRootSignature (FromGpuHandle<ID3D12RootSignature> (root_signature));
+}
+
+void D3D12CommandList::SetGraphicsRoot32BitConstants (uint32_t root_parameter, uint32_t count, const void *values, uint32_t dest_offset)
+{
+	command_list->SetGraphicsRoot32BitConstants (root_parameter, count, values, dest_offset);
+}
+
+void D3D12CommandList::SetDescriptorHeaps (uint32_t count, const GpuDescriptorHeapHandle *heaps)
+{
+	//one CBV/SRV/UAV and one sampler heap at most
+	ID3D12DescriptorHeap *descriptor_heaps[2];
+	if (count > _countof (descriptor_heaps))
+		throw framework_err ("Too many descriptor heaps");
+	for (uint32_t i = 0; i < count; i++)
+		descriptor_heaps[i] = FromGpuHandle<ID3D12DescriptorHeap> (heaps[i]);
+	command_list->SetDescriptorHeaps (count, descriptor_heaps);
+}
+
+void D3D12CommandList::SetGraphicsRootDescriptorTable (uint32_t root_parameter, GpuShaderDescriptorHandle table)
+{
+	D3D12_GPU_DESCRIPTOR_HANDLE handle;
+	handle.ptr = table;
+	command_list->SetGraphicsRootDescriptorTable (root_parameter, handle);
+}
+
+void D3D12CommandList::SetPrimitiveTopology (GpuPrimitiveTopology topology)
+{
+	command_list->IASetPrimitiveTopology (static_cast<D3D12_PRIMITIVE_TOPOLOGY>(topology));
+}
+
+void D3D12CommandList::SetViewports (uint32_t count, const GpuViewport *viewports)
+{
+	command_list->RSSetViewports (count, reinterpret_cast<const D3D12_VIEWPORT*>(viewports));
+}
+
+void D3D12CommandList::SetScissorRects (uint32_t count, const GpuRect *rects)
+{
+	command_list->RSSetScissorRects (count, reinterpret_cast<const D3D12_RECT*>(rects));
+}
+
+void D3D12CommandList::SetRenderTargets (uint32_t count, const GpuDescriptorHandle *render_targets, const GpuDescriptorHandle *depth_stencil)
+{
+	D3D12_CPU_DESCRIPTOR_HANDLE rtv_handles[D3D12_SIMULTANEOUS_RENDER_TARGET_COUNT];
+	for (uint32_t i = 0; i < count && i < D3D12_SIMULTANEOUS_RENDER_TARGET_COUNT; i++)
+		rtv_handles[i].ptr = static_cast<SIZE_T>(render_targets[i]);
+	D3D12_CPU_DESCRIPTOR_HANDLE dsv_handle;
+	if (depth_stencil)
+		dsv_handle.ptr = static_cast<SIZE_T>(*depth_stencil);
+	command_list->OMSetRenderTargets (count, rtv_handles, FALSE, depth_stencil ? &dsv_handle : nullptr);
+}
+
+void D3D12CommandList::SetVertexBuffers (uint32_t start_slot, uint32_t count, const GpuVertexBufferView *views)
+{
+	command_list->IASetVertexBuffers (start_slot, count, reinterpret_cast<const D3D12_VERTEX_BUFFER_VIEW*>(views));
+}
+
+void D3D12CommandList::SetIndexBuffer (const GpuIndexBufferView *view)
+{
+	command_list->IASetIndexBuffer (reinterpret_cast<const D3D12_INDEX_BUFFER_VIEW*>(view));
+}
+
+void D3D12CommandList::ResourceBarrier (uint32_t count, const GpuBarrier *barriers)
+{
+	const uint32_t local_count = 16;
+	D3D12_RESOURCE_BARRIER local_barriers[local_count];
+	std::vector<D3D12_RESOURCE_BARRIER> heap_barriers;
+	D3D12_RESOURCE_BARRIER *d3d12_barriers = local_barriers;
+	if (count > local_count)
+	{
+		heap_barriers.resize (count);
+		d3d12_barriers = heap_barriers.data ();
+	}
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		D3D12_RESOURCE_BARRIER &barrier = d3d12_barriers[i];
+		barrier.Type = static_cast<D3D12_RESOURCE_BARRIER_TYPE>(barriers[i].type);
+		barrier.Flags = static_cast<D3D12_RESOURCE_BARRIER_FLAGS>(barriers[i].flags);
+		switch (barriers[i].type)
+		{
+		case GPU_BARRIER_TYPE_ALIASING:
+			barrier.Aliasing.pResourceBefore = FromGpuHandle<ID3D12Resource> (barriers[i].resource_before);
+			barrier.Aliasing.pResourceAfter = FromGpuHandle<ID3D12Resource> (barriers[i].resource);
+			break;
+		case GPU_BARRIER_TYPE_UAV:
+			barrier.UAV.pResource = FromGpuHandle<ID3D12Resource> (barriers[i].resource);
+			break;
+		default:
+			barrier.Transition.pResource = FromGpuHandle<ID3D12Resource> (barriers[i].resource);
+			barrier.Transition.StateBefore = static_cast<D3D12_RESOURCE_STATES>(barriers[i].state_before);
+			barrier.Transition.StateAfter = static_cast<D3D12_RESOURCE_STATES>(barriers[i].state_after);
+			barrier.Transition.Subresource = barriers[i].subresource;
+			break;
+		}
+	}
+	command_list->ResourceBarrier (count, d3d12_barriers);
+}
+
+void D3D12CommandList::ClearRenderTargetView (GpuDescriptorHandle render_target, const float color[4])
+{
+	D3D12_CPU_DESCRIPTOR_HANDLE rtv_handle;
+	rtv_handle.ptr = static_cast<SIZE_T>(render_target);
+	command_list->ClearRenderTargetView (rtv_handle, color, 0, nullptr);
+}
+
+void D3D12CommandList::DrawInstanced (uint32_t vertex_count, uint32_t instance_count, uint32_t start_vertex, uint32_t start_instance)
+{
+	command_list->DrawInstanced (vertex_count, instance_count, start_vertex, start_instance);
+}
+
+void D3D12CommandList::DrawIndexedInstanced (uint32_t index_count, uint32_t instance_count, uint32_t start_index, int32_t base_vertex, uint32_t start_instance)
+{
+	command_list->DrawIndexedInstanced (index_count, instance_count, start_index, base_vertex, start_instance);
+}
+
+void D3D12CommandList::ExecuteIndirect (GpuCommandSignatureHandle command_signature, uint32_t max_command_count, GpuResourceHandle arguments,
+										uint64_t arguments_offset, GpuResourceHandle count_buffer, uint64_t count_offset)
+{
+	command_list->ExecuteIndirect (FromGpuHandle<ID3D12CommandSignature> (command_signature), max_command_count,
+								   FromGpuHandle<ID3D12Resource> (arguments), arguments_offset,
+								   FromGpuHandle<ID3D12Resource> (count_buffer), count_offset);
+}
+
+void D3D12CommandList::CopyBufferRegion (GpuResourceHandle dst, uint64_t dst_offset, GpuResourceHandle src, uint64_t src_offset, uint64_t size)
+{
+	command_list->CopyBufferRegion (FromGpuHandle<ID3D12Resource> (dst), dst_offset,
+									FromGpuHandle<ID3D12Resource> (src), src_offset, size);
+}
+
+void D3D12CommandList::CopyBufferToTexture (GpuResourceHandle dst, uint32_t dst_subresource, GpuResourceHandle src, const GpuTextureFootprint &footprint)
+{
+	D3D12_TEXTURE_COPY_LOCATION dst_location = {};
+	dst_location.pResource = FromGpuHandle<ID3D12Resource> (dst);
+	dst_location.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
+	dst_location.SubresourceIndex = dst_subresource;
+	D3D12_TEXTURE_COPY_LOCATION src_location = {};
+	src_location.pResource = FromGpuHandle<ID3D12Resource> (src);
+	src_location.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
+	memcpy (&src_location.PlacedFootprint, &footprint, sizeof (footprint));
+	command_list->CopyTextureRegion (&dst_location, 0, 0, 0, &src_location, nullptr);
+}
+
+D3D12GpuDevice::D3D12GpuDevice (ID3D12Device *d3d12_device, ID3D12CommandQueue *queue) :
+	device (d3d12_device),
+	command_queue (queue),
+	list_type (queue->GetDesc ().Type),
+	fence_event (nullptr)
+{
+	THROWIFFAILED (device->CreateFence (0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS (&fence)),
+				   "Can not create fence");
+	fence_event = CreateEvent (nullptr, FALSE, FALSE, nullptr);
+	if (fence_event == nullptr)
+		THROWIFFAILED (HRESULT_FROM_WIN32 (GetLastError ()), "Can not create fence event");
+}
+
+D3D12GpuDevice::~D3D12GpuDevice ()
+{
+	if (fence_event)
+		CloseHandle (fence_event);
+}
+
+std::unique_ptr<GpuCommandAllocator> D3D12GpuDevice::CreateCommandAllocator ()
+{
+	return std::unique_ptr<GpuCommandAllocator> (new D3D12CommandAllocator (device.Get (), list_type));
+}
+
+std::unique_ptr<GpuCommandList> D3D12GpuDevice::CreateCommandList (GpuCommandAllocator *allocator)
+{
+	return std::unique_ptr<GpuCommandList> (new D3D12CommandList (device.Get (), static_cast<D3D12CommandAllocator*>(allocator), list_type));
+}
+
+void D3D12GpuDevice::ExecuteCommandLists (uint32_t count, GpuCommandList *const *command_lists)
+{
+	const uint32_t local_count = 16;
+	ID3D12CommandList *local_lists[local_count];
+	std::vector<ID3D12CommandList*> heap_lists;
+	ID3D12CommandList **d3d12_lists = local_lists;
+	if (count > local_count)
+	{
+		heap_lists.resize (count);
+		d3d12_lists = heap_lists.data ();
+	}
+	for (uint32_t i = 0; i < count; i++)
+		d3d12_lists[i] = static_cast<D3D12CommandList*>(command_lists[i])->Get ();
+	command_queue->ExecuteCommandLists (count, d3d12_lists);
+}
+
+void D3D12GpuDevice::Signal (uint64_t value)
+{
+	THROWIFFAILED (command_queue->Signal (fence.Get (), value), "Can not shedule a signal command");
+}
+
+uint64_t D3D12GpuDevice::GetCompletedFenceValue ()
+{
+	return fence->GetCompletedValue ();
+}
+
+void D3D12GpuDevice::WaitForFenceValue (uint64_t value)
+{
+	if (fence->GetCompletedValue () >= value)
+		return;
+	THROWIFFAILED (fence->SetEventOnCompletion (value, fence_event), "Can not set event");
+	WaitForSingleObjectEx (fence_event, INFINITE, FALSE);
+}
+
+void D3D12GpuDevice::WaitForQueue (GpuDevice *queue, uint64_t value)
+{
+	THROWIFFAILED (command_queue->Wait (static_cast<D3D12GpuDevice*>(queue)->GetFence (), value), "Can not shedule a wait command");
+}
+
+D3D12UploadBackend::D3D12UploadBackend (ID3D12Device *d3d12_device) :
+	device (d3d12_device)
+{
+}
+
+UploadChunk D3D12UploadBackend::CreateChunk (uint64_t size)
+{
+	D3D12_RESOURCE_DESC buffer_desc;
+	buffer_desc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+	buffer_desc.Alignment = 0;
+	buffer_desc.Width = size;
+	buffer_desc.Height = 1;
+	buffer_desc.DepthOrArraySize = 1;
+	buffer_desc.MipLevels = 1;
+	buffer_desc.Format = DXGI_FORMAT_UNKNOWN;
+	buffer_desc.SampleDesc.Count = 1;
+	buffer_desc.SampleDesc.Quality = 0;
+	buffer_desc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+	buffer_desc.Flags = D3D12_RESOURCE_FLAG_NONE;
+
+	D3D12_HEAP_PROPERTIES heap_properties;
+	heap_properties.Type = D3D12_HEAP_TYPE_UPLOAD;
+	heap_properties.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
+	heap_properties.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
+	heap_properties.CreationNodeMask = 1;
+	heap_properties.VisibleNodeMask = 1;
+
+	ComPtr<ID3D12Resource> resource;
+	THROWIFFAILED (device->CreateCommittedResource (&heap_properties,
+													D3D12_HEAP_FLAG_NONE,
+													&buffer_desc,
+													D3D12_RESOURCE_STATE_GENERIC_READ,
+													nullptr,
+													IID_PPV_ARGS (&resource)),
+				   "Can not create upload buffer");
+
+	//upload heaps may stay mapped for their whole lifetime
+	UploadChunk chunk;
+	void *cpu_address;
+	D3D12_RANGE read_range = { 0, 0 };
+	THROWIFFAILED (resource->Map (0, &read_range, &cpu_address), "Can not map upload buffer");
+	chunk.cpu_address = static_cast<uint8_t*>(cpu_address);
+	chunk.gpu_address = resource->GetGPUVirtualAddress ();
+	chunk.size = size;
+	chunk.resource = ToGpuHandle (resource.Detach ());
+	return chunk;
+}
+
+void D3D12UploadBackend::DestroyChunk (const UploadChunk &chunk)
+{
+	ID3D12Resource *resource = FromGpuHandle<ID3D12Resource> (chunk.resource);
+	resource->Unmap (0, nullptr);
+	resource->Release ();
+}
+
+D3D12HeapBackend::D3D12HeapBackend (ID3D12Device *d3d12_device) :
+	device (d3d12_device)
+{
+}
+
+GpuHeapHandle D3D12HeapBackend::CreateHeap (GpuHeapTier tier, uint64_t size)
+{
+	D3D12_HEAP_DESC heap_desc = {};
+	heap_desc.SizeInBytes = size;
+	heap_desc.Properties.Type = D3D12_HEAP_TYPE_DEFAULT;
+	heap_desc.Properties.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
+	heap_desc.Properties.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
+	heap_desc.Properties.CreationNodeMask = 1;
+	heap_desc.Properties.VisibleNodeMask = 1;
+	heap_desc.Alignment = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+	switch (tier)
+	{
+	case GPU_HEAP_TIER_BUFFERS:
+		heap_desc.Flags = D3D12_HEAP_FLAG_ALLOW_ONLY_BUFFERS;
+		break;
+	case GPU_HEAP_TIER_TEXTURES:
+		heap_desc.Flags = D3D12_HEAP_FLAG_ALLOW_ONLY_NON_RT_DS_TEXTURES;
+		break;
+	default:
+		heap_desc.Flags = D3D12_HEAP_FLAG_ALLOW_ONLY_RT_DS_TEXTURES;
+		break;
+	}
+
+	ComPtr<ID3D12Heap> heap;
+	THROWIFFAILED (device->CreateHeap (&heap_desc, IID_PPV_ARGS (&heap)), "Can not create GPU heap");
+	return ToGpuHandle (heap.Detach ());
+}
+
+void D3D12HeapBackend::DestroyHeap (GpuHeapHandle heap)
+{
+	FromGpuHandle<ID3D12Heap> (heap)->Release ();
+}
+
+D3D12ResidencyBackend::D3D12ResidencyBackend (ID3D12Device *d3d12_device, IDXGIAdapter3 *dxgi_adapter) :
+	device (d3d12_device),
+	adapter (dxgi_adapter)
+{
+}
+
+void D3D12ResidencyBackend::QueryBudget (uint64_t &budget, uint64_t &usage)
+{
+	DXGI_QUERY_VIDEO_MEMORY_INFO info;
+	THROWIFFAILED (adapter->QueryVideoMemoryInfo (0, DXGI_MEMORY_SEGMENT_GROUP_LOCAL, &info), "Can not query video memory info");
+	budget = info.Budget;
+	usage = info.CurrentUsage;
+}
+
+void D3D12ResidencyBackend::MakeResident (uint32_t count, const GpuHeapHandle *heaps)
+{
+	objects.resize (count);
+	for (uint32_t i = 0; i < count; i++)
+		objects[i] = FromGpuHandle<ID3D12Heap> (heaps[i]);
+	//blocks until the memory is paged in
+	THROWIFFAILED (device->MakeResident (count, objects.data ()), "Can not make heaps resident");
+}
+
+void D3D12ResidencyBackend::Evict (uint32_t count, const GpuHeapHandle *heaps)
+{
+	objects.resize (count);
+	for (uint32_t i = 0; i < count; i++)
+		objects[i] = FromGpuHandle<ID3D12Heap> (heaps[i]);
+	THROWIFFAILED (device->Evict (count, objects.data ()), "Can not evict heaps");
+}
+
+UINT GetPresentSwapChainFlags (IDXGIFactory4 *factory)
+{
+	UINT flags = DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT;
+#if ENABLE_DXGI_TEARING
+	ComPtr<IDXGIFactory5> factory5;
+	BOOL tearing = FALSE;
+	if (SUCCEEDED (factory->QueryInterface (IID_PPV_ARGS (&factory5))) &&
+		SUCCEEDED (factory5->CheckFeatureSupport (DXGI_FEATURE_PRESENT_ALLOW_TEARING, &tearing, sizeof (tearing))) && tearing)
+		flags |= DXGI_SWAP_CHAIN_FLAG_ALLOW_TEARING;
+#else
+	//built without the DXGI 1.5 header, see stdafx.h
+	UNREFERENCED_PARAMETER (factory);
+#endif
+	return flags;
+}
+
+D3D12PresentBackend::D3D12PresentBackend (IDXGISwapChain3 *dxgi_swap_chain) :
+	swap_chain (dxgi_swap_chain),
+	tearing_supported (false)
+{
+	DXGI_SWAP_CHAIN_DESC1 desc = {};
+	THROWIFFAILED (swap_chain->GetDesc1 (&desc), "Can not get swap chain description");
+	if (!(desc.Flags & DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT))
+		throw framework_err ("Swap chain has no frame latency waitable object");
+#if ENABLE_DXGI_TEARING
+	tearing_supported = (desc.Flags & DXGI_SWAP_CHAIN_FLAG_ALLOW_TEARING) != 0;
+#endif
+	waitable = swap_chain->GetFrameLatencyWaitableObject ();
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency (&frequency);
+	counter_frequency = frequency.QuadPart;
+}
+
+D3D12PresentBackend::~D3D12PresentBackend ()
+{
+	CloseHandle (waitable);
+}
+
+bool D3D12PresentBackend::IsTearingSupported ()
+{
+	return tearing_supported;
+}
+
+void D3D12PresentBackend::SetMaximumFrameLatency (uint32_t frames)
+{
+	THROWIFFAILED (swap_chain->SetMaximumFrameLatency (frames), "Can not set maximum frame latency");
+}
+
+bool D3D12PresentBackend::WaitForFrame (uint32_t timeout_ms)
+{
+	return WaitForSingleObjectEx (waitable, timeout_ms, TRUE) == WAIT_OBJECT_0;
+}
+
+uint64_t D3D12PresentBackend::Present (bool vsync)
+{
+	UINT flags = 0;
+#if ENABLE_DXGI_TEARING
+	//tearing presents are not allowed in exclusive fullscreen, where sync interval 0 tears anyway
+	BOOL fullscreen = FALSE;
+	if (!vsync && tearing_supported && SUCCEEDED (swap_chain->GetFullscreenState (&fullscreen, nullptr)) && !fullscreen)
+		flags = DXGI_PRESENT_ALLOW_TEARING;
+#endif
+	THROWIFFAILED (swap_chain->Present (vsync ? 1 : 0, flags), "Can not present frame");
+	UINT count = 0;
+	THROWIFFAILED (swap_chain->GetLastPresentCount (&count), "Can not get present count");
+	return count;
+}
+
+bool D3D12PresentBackend::GetDisplayInfo (PresentDisplayInfo &info)
+{
+	//fails before the first present was displayed and while the statistics are disjoint,
+	//e.g. after a display mode change
+	DXGI_FRAME_STATISTICS frame_stats;
+	if (FAILED (swap_chain->GetFrameStatistics (&frame_stats)) || !frame_stats.PresentCount)
+		return false;
+	//the sync time is of a later refresh than the one the present was displayed at
+	if (frame_stats.PresentRefreshCount != frame_stats.SyncRefreshCount)
+		return false;
+	info.present_count = frame_stats.PresentCount;
+	info.refresh_count = frame_stats.SyncRefreshCount;
+	info.time = ToNanoseconds (frame_stats.SyncQPCTime.QuadPart);
+	return true;
+}
+
+uint64_t D3D12PresentBackend::GetTime ()
+{
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter (&counter);
+	return ToNanoseconds (counter.QuadPart);
+}
+
+void D3D12PresentBackend::SleepUntil (uint64_t time)
+{
+	//Sleep wakes up to a scheduler tick late, the last two milliseconds are spun
+	for (uint64_t now = GetTime (); now < time; now = GetTime ())
+		if (time - now > 2000000)
+			Sleep (static_cast<DWORD>((time - now) / 1000000 - 1));
+		else
+			YieldProcessor ();
+}
+
+uint64_t D3D12PresentBackend::ToNanoseconds (LONGLONG counter) const
+{
+	return static_cast<uint64_t>(counter / counter_frequency) * 1000000000 +
+		static_cast<uint64_t>(counter % counter_frequency) * 1000000000 / counter_frequency;
+}
+
+static D3D12_DESCRIPTOR_HEAP_TYPE ToD3D12 (GpuDescriptorHeapType type)
+{
+	switch (type)
+	{
+	case GPU_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV:
+		return D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
+	case GPU_DESCRIPTOR_HEAP_TYPE_SAMPLER:
+		return D3D12_DESCRIPTOR_HEAP_TYPE_SAMPLER;
+	case GPU_DESCRIPTOR_HEAP_TYPE_RTV:
+		return D3D12_DESCRIPTOR_HEAP_TYPE_RTV;
+	case GPU_DESCRIPTOR_HEAP_TYPE_DSV:
+		return D3D12_DESCRIPTOR_HEAP_TYPE_DSV;
+	default:
+		throw framework_err ("Unknown descriptor heap type");
+	}
+}
+
+D3D12DescriptorBackend::D3D12DescriptorBackend (ID3D12Device *d3d12_device) :
+	device (d3d12_device)
+{
+}
+
+DescriptorHeapDesc D3D12DescriptorBackend::CreateHeap (GpuDescriptorHeapType type, uint32_t capacity, bool shader_visible)
+{
+	D3D12_DESCRIPTOR_HEAP_DESC heap_desc = {};
+	heap_desc.Type = ToD3D12 (type);
+	heap_desc.NumDescriptors = capacity;
+	heap_desc.Flags = shader_visible ? D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE : D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
+
+	ComPtr<ID3D12DescriptorHeap> heap;
+	THROWIFFAILED (device->CreateDescriptorHeap (&heap_desc, IID_PPV_ARGS (&heap)), "Can not create descriptor heap");
+
+	DescriptorHeapDesc desc;
+	desc.cpu_start = heap->GetCPUDescriptorHandleForHeapStart ().ptr;
+	desc.gpu_start = shader_visible ? heap->GetGPUDescriptorHandleForHeapStart ().ptr : 0;
+	desc.increment = device->GetDescriptorHandleIncrementSize (heap_desc.Type);
+	desc.capacity = capacity;
+	desc.heap = ToGpuHandle (heap.Detach ());
+	return desc;
+}
+
+void D3D12DescriptorBackend::DestroyHeap (const DescriptorHeapDesc &heap)
+{
+	FromGpuHandle<ID3D12DescriptorHeap> (heap.heap)->Release ();
+}
+
+void D3D12DescriptorBackend::CopyDescriptors (GpuDescriptorHeapType type,
+											  uint32_t dst_range_count, const GpuDescriptorHandle *dst_starts, const uint32_t *dst_sizes,
+											  uint32_t src_range_count, const GpuDescriptorHandle *src_starts, const uint32_t *src_sizes)
+{
+	dst_handles.resize (dst_range_count);
+	for (uint32_t i = 0; i < dst_range_count; i++)
+		dst_handles[i].ptr = static_cast<SIZE_T>(dst_starts[i]);
+	src_handles.resize (src_range_count);
+	for (uint32_t i = 0; i < src_range_count; i++)
+		src_handles[i].ptr = static_cast<SIZE_T>(src_starts[i]);
+	device->CopyDescriptors (dst_range_count, dst_handles.data (), dst_sizes,
+							 src_range_count, src_handles.data (), src_sizes,
+							 ToD3D12 (type));
+}
+
+static D3D12_RESOURCE_DESC ToD3D12 (const RenderGraphResourceDesc &desc)
+{
+	D3D12_RESOURCE_DESC resource_desc = {};
+	resource_desc.Width = desc.width;
+	resource_desc.SampleDesc.Count = 1;
+	//GpuResourceFlags match the D3D12 flag values
+	resource_desc.Flags = static_cast<D3D12_RESOURCE_FLAGS>(desc.flags);
+	if (desc.type == RENDER_GRAPH_RESOURCE_BUFFER)
+	{
+		resource_desc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+		resource_desc.Height = 1;
+		resource_desc.DepthOrArraySize = 1;
+		resource_desc.MipLevels = 1;
+		resource_desc.Format = DXGI_FORMAT_UNKNOWN;
+		resource_desc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+		return resource_desc;
+	}
+	resource_desc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
+	resource_desc.Height = desc.height;
+	resource_desc.DepthOrArraySize = desc.array_size;
+	resource_desc.MipLevels = desc.mip_levels;
+	resource_desc.Format = static_cast<DXGI_FORMAT>(desc.format);
+	resource_desc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
+	return resource_desc;
+}
+
+D3D12RenderGraphBackend::D3D12RenderGraphBackend (ID3D12Device *d3d12_device) :
+	device (d3d12_device)
+{
+}
+
+void D3D12RenderGraphBackend::GetAllocationInfo (const RenderGraphResourceDesc &desc, uint64_t &size, uint64_t &alignment)
+{
+	D3D12_RESOURCE_DESC resource_desc = ToD3D12 (desc);
+	D3D12_RESOURCE_ALLOCATION_INFO info = device->GetResourceAllocationInfo (0, 1, &resource_desc);
+	if (info.SizeInBytes == UINT64_MAX)
+		throw framework_err ("Invalid render graph resource description");
+	size = info.SizeInBytes;
+	alignment = info.Alignment;
+}
+
+GpuResourceHandle D3D12RenderGraphBackend::CreatePlacedResource (const RenderGraphResourceDesc &desc, GpuHeapHandle heap, uint64_t offset, GpuResourceStates initial_state)
+{
+	D3D12_RESOURCE_DESC resource_desc = ToD3D12 (desc);
+	D3D12_CLEAR_VALUE clear_value = {};
+	clear_value.Format = resource_desc.Format;
+	const D3D12_CLEAR_VALUE *optimized_clear = nullptr;
+	if (desc.flags & GPU_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL)
+	{
+		clear_value.DepthStencil.Depth = desc.clear_color[0];
+		clear_value.DepthStencil.Stencil = static_cast<UINT8>(desc.clear_color[1]);
+		optimized_clear = &clear_value;
+	}
+	else if (desc.flags & GPU_RESOURCE_FLAG_ALLOW_RENDER_TARGET)
+	{
+		memcpy (clear_value.Color, desc.clear_color, sizeof (clear_value.Color));
+		optimized_clear = &clear_value;
+	}
+
+	ComPtr<ID3D12Resource> resource;
+	THROWIFFAILED (device->CreatePlacedResource (FromGpuHandle<ID3D12Heap> (heap),
+												 offset,
+												 &resource_desc,
+												 static_cast<D3D12_RESOURCE_STATES>(initial_state),
+												 optimized_clear,
+												 IID_PPV_ARGS (&resource)),
+				   "Can not create render graph resource");
+	return ToGpuHandle (resource.Detach ());
+}
+
+void D3D12RenderGraphBackend::DestroyResource (GpuResourceHandle resource)
+{
+	FromGpuHandle<ID3D12Resource> (resource)->Release ();
+}
+
+D3D12RootSignatureBackend::D3D12RootSignatureBackend (ID3D12Device *d3d12_device) :
+	device (d3d12_device)
+{
+}
+
+RootSignature D3D12RootSignatureBackend::CreateRootSignature (const RootSignatureDesc &desc)
+{
+	D3D12_DESCRIPTOR_RANGE ranges[root_max_parameters][root_max_ranges];
+	D3D12_ROOT_PARAMETER parameters[root_max_parameters];
+	for (uint32_t i = 0; i < desc.parameter_count; i++)
+	{
+		const RootParameter &parameter = desc.parameters[i];
+		D3D12_ROOT_PARAMETER &d3d12_parameter = parameters[i];
+		d3d12_parameter.ParameterType = static_cast<D3D12_ROOT_PARAMETER_TYPE>(parameter.type);
+		d3d12_parameter.ShaderVisibility = static_cast<D3D12_SHADER_VISIBILITY>(parameter.visibility);
+		switch (parameter.type)
+		{
+		case ROOT_PARAMETER_TABLE:
+			for (uint32_t r = 0; r < parameter.range_count; r++)
+			{
+				const RootDescriptorRange &range = parameter.ranges[r];
+				ranges[i][r].RangeType = static_cast<D3D12_DESCRIPTOR_RANGE_TYPE>(range.type);
+				ranges[i][r].NumDescriptors = range.count;
+				ranges[i][r].BaseShaderRegister = range.base_register;
+				ranges[i][r].RegisterSpace = range.space;
+				ranges[i][r].OffsetInDescriptorsFromTableStart = range.offset;
+			}
+			d3d12_parameter.DescriptorTable.NumDescriptorRanges = parameter.range_count;
+			d3d12_parameter.DescriptorTable.pDescriptorRanges = ranges[i];
+			break;
+		case ROOT_PARAMETER_CONSTANTS:
+			d3d12_parameter.Constants.ShaderRegister = parameter.shader_register;
+			d3d12_parameter.Constants.RegisterSpace = parameter.space;
+			d3d12_parameter.Constants.Num32BitValues = parameter.constant_count;
+			break;
+		default:
+			d3d12_parameter.Descriptor.ShaderRegister = parameter.shader_register;
+			d3d12_parameter.Descriptor.RegisterSpace = parameter.space;
+			break;
+		}
+	}
+	D3D12_STATIC_SAMPLER_DESC samplers[root_max_static_samplers];
+	for (uint32_t i = 0; i < desc.static_sampler_count; i++)
+	{
+		const RootStaticSampler &sampler = desc.static_samplers[i];
+		samplers[i].Filter = static_cast<D3D12_FILTER>(sampler.filter);
+		samplers[i].AddressU = static_cast<D3D12_TEXTURE_ADDRESS_MODE>(sampler.address_u);
+		samplers[i].AddressV = static_cast<D3D12_TEXTURE_ADDRESS_MODE>(sampler.address_v);
+		samplers[i].AddressW = static_cast<D3D12_TEXTURE_ADDRESS_MODE>(sampler.address_w);
+		samplers[i].MipLODBias = sampler.mip_lod_bias;
+		samplers[i].MaxAnisotropy = sampler.max_anisotropy;
+		samplers[i].ComparisonFunc = static_cast<D3D12_COMPARISON_FUNC>(sampler.comparison_func);
+		samplers[i].BorderColor = static_cast<D3D12_STATIC_BORDER_COLOR>(sampler.border_color);
+		samplers[i].MinLOD = sampler.min_lod;
+		samplers[i].MaxLOD = sampler.max_lod;
+		samplers[i].ShaderRegister = sampler.shader_register;
+		samplers[i].RegisterSpace = sampler.space;
+		samplers[i].ShaderVisibility = static_cast<D3D12_SHADER_VISIBILITY>(sampler.visibility);
+	}
+
+	D3D12_ROOT_SIGNATURE_DESC root_signature_desc;
+	root_signature_desc.NumParameters = desc.parameter_count;
+	root_signature_desc.pParameters = parameters;
+	root_signature_desc.NumStaticSamplers = desc.static_sampler_count;
+	root_signature_desc.pStaticSamplers = samplers;
+	root_signature_desc.Flags = static_cast<D3D12_ROOT_SIGNATURE_FLAGS>(desc.flags);
+
+	ComPtr<ID3DBlob> signature;
+	ComPtr<ID3DBlob> error;
+	if (FAILED (D3D12SerializeRootSignature (&root_signature_desc, D3D_ROOT_SIGNATURE_VERSION_1, &signature, &error)))
+	{
+		if (error)
+			LogMessage (LOG_SEVERITY_ERROR, "%s", static_cast<const char*>(error->GetBufferPointer ()));
+		throw framework_err ("Can not serialize root signature");
+	}
+	ComPtr<ID3D12RootSignature> root_signature;
+	THROWIFFAILED (device->CreateRootSignature (0, signature->GetBufferPointer (), signature->GetBufferSize (), IID_PPV_ARGS (&root_signature)),
+				   "Can not create root signature");
+
+	RootSignature result;
+	//pipelines are cached by the contents of their root signature
+	result.key = PipelineHash (signature->GetBufferPointer (), signature->GetBufferSize ());
+	result.handle = ToGpuHandle (root_signature.Detach ());
+	return result;
+}
+
+void D3D12RootSignatureBackend::DestroyRootSignature (GpuRootSignatureHandle root_signature)
+{
+	FromGpuHandle<ID3D12RootSignature> (root_signature)->Release ();
+}
+
+D3D12PipelineBackend::D3D12PipelineBackend (ID3D12Device *d3d12_device) :
+	device (d3d12_device),
+	device_key (0)
+{
+#ifdef D3D12_PIPELINE_LIBRARY_SUPPORTED
+	//libraries need ID3D12Device1; without one every pipeline is compiled
+	if (SUCCEEDED (device.As (&library_device)) &&
+		FAILED (library_device->CreatePipelineLibrary (nullptr, 0, IID_PPV_ARGS (&library))))
+		library.Reset ();
+#endif
+
+	//library blobs depend on the adapter and its driver version
+	ComPtr<IDXGIFactory4> factory;
+	ComPtr<IDXGIAdapter1> adapter;
+	DXGI_ADAPTER_DESC1 adapter_desc;
+	LARGE_INTEGER driver_version;
+	if (SUCCEEDED (CreateDXGIFactory1 (IID_PPV_ARGS (&factory))) &&
+		SUCCEEDED (factory->EnumAdapterByLuid (device->GetAdapterLuid (), IID_PPV_ARGS (&adapter))) &&
+		SUCCEEDED (adapter->GetDesc1 (&adapter_desc)) &&
+		SUCCEEDED (adapter->CheckInterfaceSupport (__uuidof (IDXGIDevice), &driver_version)))
+	{
+		const uint64_t identity[] = { adapter_desc.VendorId, adapter_desc.DeviceId, adapter_desc.SubSysId, adapter_desc.Revision,
+									  static_cast<uint64_t>(driver_version.QuadPart) };
+		device_key = PipelineHash (identity, sizeof (identity));
+	}
+}
+
+uint64_t D3D12PipelineBackend::GetDeviceKey ()
+{
+	return device_key;
+}
+
+bool D3D12PipelineBackend::OpenLibrary (const void *blob, size_t size)
+{
+#ifdef D3D12_PIPELINE_LIBRARY_SUPPORTED
+	if (!library_device)
+		return false;
+	//fails with D3D12_ERROR_DRIVER_VERSION_MISMATCH and similar for outdated blobs, the empty library stays
+	ComPtr<ID3D12PipelineLibrary> opened;
+	if (FAILED (library_device->CreatePipelineLibrary (blob, size, IID_PPV_ARGS (&opened))))
+		return false;
+	library = opened;
+	return true;
+#else
+	UNREFERENCED_PARAMETER (blob);
+	UNREFERENCED_PARAMETER (size);
+	return false;
+#endif
+}
+
+GpuPipelineHandle D3D12PipelineBackend::CreatePipeline (const PipelineDesc &desc, uint64_t hash, bool &loaded)
+{
+	D3D12_INPUT_ELEMENT_DESC input_elements[D3D12_IA_VERTEX_INPUT_STRUCTURE_ELEMENT_COUNT];
+	if (desc.input_element_count > _countof (input_elements))
+		throw framework_err ("Pipeline has too many input elements");
+	for (UINT i = 0; i < desc.input_element_count; i++)
+	{
+		const PipelineInputElement &element = desc.input_elements[i];
+		input_elements[i].SemanticName = element.semantic_name;
+		input_elements[i].SemanticIndex = element.semantic_index;
+		input_elements[i].Format = static_cast<DXGI_FORMAT>(element.format);
+		input_elements[i].InputSlot = element.input_slot;
+		input_elements[i].AlignedByteOffset = element.aligned_byte_offset;
+		input_elements[i].InputSlotClass = static_cast<D3D12_INPUT_CLASSIFICATION>(element.classification);
+		input_elements[i].InstanceDataStepRate = element.instance_step_rate;
+	}
+
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC pso_desc = {};
+	pso_desc.pRootSignature = FromGpuHandle<ID3D12RootSignature> (desc.root_signature);
+	D3D12_SHADER_BYTECODE *stages[PIPELINE_SHADER_STAGE_COUNT] = { &pso_desc.VS, &pso_desc.PS, &pso_desc.DS, &pso_desc.HS, &pso_desc.GS };
+	for (UINT stage = 0; stage < PIPELINE_SHADER_STAGE_COUNT; stage++)
+	{
+		stages[stage]->pShaderBytecode = desc.shaders[stage].bytecode;
+		stages[stage]->BytecodeLength = static_cast<SIZE_T>(desc.shaders[stage].size);
+	}
+	pso_desc.InputLayout = { input_elements, desc.input_element_count };
+
+	pso_desc.RasterizerState.FillMode = static_cast<D3D12_FILL_MODE>(desc.raster.fill_mode);
+	pso_desc.RasterizerState.CullMode = static_cast<D3D12_CULL_MODE>(desc.raster.cull_mode);
+	pso_desc.RasterizerState.FrontCounterClockwise = desc.raster.front_counter_clockwise;
+	pso_desc.RasterizerState.DepthBias = desc.raster.depth_bias;
+	pso_desc.RasterizerState.DepthBiasClamp = desc.raster.depth_bias_clamp;
+	pso_desc.RasterizerState.SlopeScaledDepthBias = desc.raster.slope_scaled_depth_bias;
+	pso_desc.RasterizerState.DepthClipEnable = desc.raster.depth_clip_enable;
+	pso_desc.RasterizerState.MultisampleEnable = desc.raster.multisample_enable;
+	pso_desc.RasterizerState.AntialiasedLineEnable = desc.raster.antialiased_line_enable;
+	pso_desc.RasterizerState.ForcedSampleCount = desc.raster.forced_sample_count;
+	pso_desc.RasterizerState.ConservativeRaster = static_cast<D3D12_CONSERVATIVE_RASTERIZATION_MODE>(desc.raster.conservative_raster);
+
+	pso_desc.BlendState.AlphaToCoverageEnable = desc.alpha_to_coverage_enable;
+	pso_desc.BlendState.IndependentBlendEnable = desc.independent_blend_enable;
+	for (UINT i = 0; i < pipeline_max_render_targets; i++)
+	{
+		const PipelineBlendTarget &target = desc.blend_targets[i];
+		D3D12_RENDER_TARGET_BLEND_DESC &blend = pso_desc.BlendState.RenderTarget[i];
+		blend.BlendEnable = target.blend_enable;
+		blend.LogicOpEnable = target.logic_op_enable;
+		blend.SrcBlend = static_cast<D3D12_BLEND>(target.src_blend);
+		blend.DestBlend = static_cast<D3D12_BLEND>(target.dest_blend);
+		blend.BlendOp = static_cast<D3D12_BLEND_OP>(target.blend_op);
+		blend.SrcBlendAlpha = static_cast<D3D12_BLEND>(target.src_blend_alpha);
+		blend.DestBlendAlpha = static_cast<D3D12_BLEND>(target.dest_blend_alpha);
+		blend.BlendOpAlpha = static_cast<D3D12_BLEND_OP>(target.blend_op_alpha);
+		blend.LogicOp = static_cast<D3D12_LOGIC_OP>(target.logic_op);
+		blend.RenderTargetWriteMask = static_cast<UINT8>(target.write_mask);
+	}
+
+	const PipelineDepthStencilState &depth_stencil = desc.depth_stencil;
+	pso_desc.DepthStencilState.DepthEnable = depth_stencil.depth_enable;
+	pso_desc.DepthStencilState.DepthWriteMask = static_cast<D3D12_DEPTH_WRITE_MASK>(depth_stencil.depth_write_mask);
+	pso_desc.DepthStencilState.DepthFunc = static_cast<D3D12_COMPARISON_FUNC>(depth_stencil.depth_func);
+	pso_desc.DepthStencilState.StencilEnable = depth_stencil.stencil_enable;
+	pso_desc.DepthStencilState.StencilReadMask = static_cast<UINT8>(depth_stencil.stencil_read_mask);
+	pso_desc.DepthStencilState.StencilWriteMask = static_cast<UINT8>(depth_stencil.stencil_write_mask);
+	const PipelineStencilOp *faces[] = { &depth_stencil.front_face, &depth_stencil.back_face };
+	D3D12_DEPTH_STENCILOP_DESC *d3d12_faces[] = { &pso_desc.DepthStencilState.FrontFace, &pso_desc.DepthStencilState.BackFace };
+	for (UINT i = 0; i < 2; i++)
+	{
+		d3d12_faces[i]->StencilFailOp = static_cast<D3D12_STENCIL_OP>(faces[i]->fail_op);
+		d3d12_faces[i]->StencilDepthFailOp = static_cast<D3D12_STENCIL_OP>(faces[i]->depth_fail_op);
+		d3d12_faces[i]->StencilPassOp = static_cast<D3D12_STENCIL_OP>(faces[i]->pass_op);
+		d3d12_faces[i]->StencilFunc = static_cast<D3D12_COMPARISON_FUNC>(faces[i]->func);
+	}
+
+	pso_desc.SampleMask = desc.sample_mask;
+	pso_desc.IBStripCutValue = static_cast<D3D12_INDEX_BUFFER_STRIP_CUT_VALUE>(desc.ib_strip_cut_value);
+	pso_desc.PrimitiveTopologyType = static_cast<D3D12_PRIMITIVE_TOPOLOGY_TYPE>(desc.primitive_topology_type);
+	pso_desc.NumRenderTargets = desc.render_target_count;
+	for (UINT i = 0; i < pipeline_max_render_targets; i++)
+		pso_desc.RTVFormats[i] = static_cast<DXGI_FORMAT>(desc.render_target_formats[i]);
+	pso_desc.DSVFormat = static_cast<DXGI_FORMAT>(desc.depth_stencil_format);
+	pso_desc.SampleDesc.Count = desc.sample_count;
+	pso_desc.SampleDesc.Quality = desc.sample_quality;
+
+	ComPtr<ID3D12PipelineState> pipeline;
+#ifdef D3D12_PIPELINE_LIBRARY_SUPPORTED
+	//pipelines are stored in the library under their hash
+	WCHAR name[17];
+	swprintf_s (name, L"%016llx", hash);
+	loaded = library && SUCCEEDED (library->LoadGraphicsPipeline (name, &pso_desc, IID_PPV_ARGS (&pipeline)));
+	if (!loaded)
+	{
+		THROWIFFAILED (device->CreateGraphicsPipelineState (&pso_desc, IID_PPV_ARGS (&pipeline)),
+					   "Can not create pipeline state object");
+		if (library)
+			library->StorePipeline (name, pipeline.Get ());
+	}
+#else
+	UNREFERENCED_PARAMETER (hash);
+	loaded = false;
+	THROWIFFAILED (device->CreateGraphicsPipelineState (&pso_desc, IID_PPV_ARGS (&pipeline)),
+				   "Can not create pipeline state object");
+#endif
+	return ToGpuHandle (pipeline.Detach ());
+}
+
+void D3D12PipelineBackend::DestroyPipeline (GpuPipelineHandle pipeline)
+{
+	FromGpuHandle<ID3D12PipelineState> (pipeline)->Release ();
+}
+
+void D3D12PipelineBackend::SerializeLibrary (std::vector<uint8_t> &blob)
+{
+	blob.clear ();
+#ifdef D3D12_PIPELINE_LIBRARY_SUPPORTED
+	if (!library)
+		return;
+	blob.resize (library->GetSerializedSize ());
+	THROWIFFAILED (library->Serialize (blob.data (), blob.size ()), "Can not serialize pipeline library");
+#endif
+}
+
+ComPtr<ID3D12Resource> CreatePlacedResource (ID3D12Device *device,
+											 GpuMemoryAllocator *allocator,
+											 const D3D12_RESOURCE_DESC &resource_desc,
+											 D3D12_RESOURCE_STATES initial_state,
+											 const D3D12_CLEAR_VALUE *clear_value,
+											 GpuMemoryAllocation &allocation)
+{
+	D3D12_RESOURCE_DESC desc = resource_desc;
+	GpuHeapTier tier = GPU_HEAP_TIER_TEXTURES;
+	if (desc.Dimension == D3D12_RESOURCE_DIMENSION_BUFFER)
+		tier = GPU_HEAP_TIER_BUFFERS;
+	else if (desc.Flags & (D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET | D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL))
+		tier = GPU_HEAP_TIER_RENDER_TARGETS;
+
+	//the runtime reports whether the texture is small enough for 4 KB placement
+	D3D12_RESOURCE_ALLOCATION_INFO info = {};
+	if (tier == GPU_HEAP_TIER_TEXTURES && desc.SampleDesc.Count == 1)
+	{
+		desc.Alignment = D3D12_SMALL_RESOURCE_PLACEMENT_ALIGNMENT;
+		info = device->GetResourceAllocationInfo (0, 1, &desc);
+	}
+	if (info.Alignment != D3D12_SMALL_RESOURCE_PLACEMENT_ALIGNMENT)
+	{
+		desc.Alignment = 0;
+		info = device->GetResourceAllocationInfo (0, 1, &desc);
+	}
+
+	allocation = allocator->Allocate (tier, info.SizeInBytes, info.Alignment);
+	ComPtr<ID3D12Resource> resource;
+	HRESULT hr = device->CreatePlacedResource (FromGpuHandle<ID3D12Heap> (allocation.heap),
+											   allocation.offset,
+											   &desc,
+											   initial_state,
+											   clear_value,
+											   IID_PPV_ARGS (&resource));
+	if (FAILED (hr))
+		allocator->Free (allocation);
+	THROWIFFAILED (hr, "Can not create placed resource");
+	return resource;
+}
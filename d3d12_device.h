@@ -0,0 +1,246 @@
+#pragma once
+#include "stdafx.h"
+#include "errors.h"
+#include "gpu_device.h"
+#include "upload_allocator.h"
+#include "gpu_memory.h"
+#include "residency.h"
+#include "present_controller.h"
+#include "descriptor_heap.h"
+#include "render_graph.h"
+#include "pipeline_cache.h"
+#include "root_signature.h"
+
+using Microsoft::WRL::ComPtr;
+
+//GpuDevice backend on top of a D3D12 device and one of its command queues
+
+template <class T> inline uint64_t ToGpuHandle (T *object)
+{
+	return static_cast<uint64_t>(reinterpret_cast<uintptr_t>(object));
+}
+
+template <class T> inline T *FromGpuHandle (uint64_t handle)
+{
+	return reinterpret_cast<T*>(static_cast<uintptr_t>(handle));
+}
+
+inline GpuDescriptorHandle ToGpuHandle (D3D12_CPU_DESCRIPTOR_HANDLE handle)
+{
+	return static_cast<GpuDescriptorHandle>(handle.ptr);
+}
+
+class D3D12CommandAllocator : public GpuCommandAllocator
+{
+public:
+	D3D12CommandAllocator (ID3D12Device *device, D3D12_COMMAND_LIST_TYPE type);
+	void Reset () override;
+	ID3D12CommandAllocator *Get () const
+	{
+		return allocator.Get ();
+	}
+private:
+	ComPtr<ID3D12CommandAllocator> allocator;
+};
+
+class D3D12CommandList : public GpuCommandList
+{
+public:
+	D3D12CommandList (ID3D12Device *device, D3D12CommandAllocator *allocator, D3D12_COMMAND_LIST_TYPE type);
+
+	void Reset (GpuCommandAllocator *allocator, GpuPipelineHandle initial_state) override;
+	void Close () override;
+
+	void SetPipelineState (GpuPipelineHandle pipeline_state) override;
+	void SetGraphicsRootSignature (GpuRootSignatureHandle root_signature) override;
+	void SetGraphicsRoot32BitConstants (uint32_t root_parameter, uint32_t count, const void *values, uint32_t dest_offset) override;
+	void SetDescriptorHeaps (uint32_t count, const GpuDescriptorHeapHandle *heaps) override;
+	void SetGraphicsRootDescriptorTable (uint32_t root_parameter, GpuShaderDescriptorHandle table) override;
+	void SetPrimitiveTopology (GpuPrimitiveTopology topology) override;
+	void SetViewports (uint32_t count, const GpuViewport *viewports) override;
+	void SetScissorRects (uint32_t count, const GpuRect *rects) override;
+	void SetRenderTargets (uint32_t count, const GpuDescriptorHandle *render_targets, const GpuDescriptorHandle *depth_stencil) override;
+	void SetVertexBuffers (uint32_t start_slot, uint32_t count, const GpuVertexBufferView *views) override;
+	void SetIndexBuffer (const GpuIndexBufferView *view) override;
+	void ResourceBarrier (uint32_t count, const GpuBarrier *barriers) override;
+
+	void ClearRenderTargetView (GpuDescriptorHandle render_target, const float color[4]) override;
+	void DrawInstanced (uint32_t vertex_count, uint32_t instance_count, uint32_t start_vertex, uint32_t start_instance) override;
+	void DrawIndexedInstanced (uint32_t index_count, uint32_t instance_count, uint32_t start_index, int32_t base_vertex, uint32_t start_instance) override;
+	void ExecuteIndirect (GpuCommandSignatureHandle command_signature, uint32_t max_command_count, GpuResourceHandle arguments,
+						  uint64_t arguments_offset, GpuResourceHandle count_buffer, uint64_t count_offset) override;
+	void CopyBufferRegion (GpuResourceHandle dst, uint64_t dst_offset, GpuResourceHandle src, uint64_t src_offset, uint64_t size) override;
+	void CopyBufferToTexture (GpuResourceHandle dst, uint32_t dst_subresource, GpuResourceHandle src, const GpuTextureFootprint &footprint) override;
+
+	ID3D12GraphicsCommandList *Get () const
+	{
+		return command_list.Get ();
+	}
+private:
+	ComPtr<ID3D12GraphicsCommandList> command_list;
+};
+
+class D3D12GpuDevice : public GpuDevice
+{
+public:
+	D3D12GpuDevice (ID3D12Device *device, ID3D12CommandQueue *command_queue);
+	~D3D12GpuDevice ();
+
+	std::unique_ptr<GpuCommandAllocator> CreateCommandAllocator () override;
+	std::unique_ptr<GpuCommandList> CreateCommandList (GpuCommandAllocator *allocator) override;
+	void ExecuteCommandLists (uint32_t count, GpuCommandList *const *command_lists) override;
+
+	void Signal (uint64_t value) override;
+	uint64_t GetCompletedFenceValue () override;
+	void WaitForFenceValue (uint64_t value) override;
+	void WaitForQueue (GpuDevice *queue, uint64_t value) override;
+
+	ID3D12Fence *GetFence () const
+	{
+		return fence.Get ();
+	}
+private:
+	ComPtr<ID3D12Device> device;
+	ComPtr<ID3D12CommandQueue> command_queue;
+	D3D12_COMMAND_LIST_TYPE list_type;    //of the queue, allocators and lists must match it
+	ComPtr<ID3D12Fence> fence;
+	HANDLE fence_event;
+};
+
+//persistently mapped committed buffers in the upload heap
+class D3D12UploadBackend : public UploadBackend
+{
+public:
+	explicit D3D12UploadBackend (ID3D12Device *device);
+	UploadChunk CreateChunk (uint64_t size) override;
+	void DestroyChunk (const UploadChunk &chunk) override;
+private:
+	ComPtr<ID3D12Device> device;
+};
+
+//default heaps restricted to the resource kinds of their tier
+class D3D12HeapBackend : public GpuHeapBackend
+{
+public:
+	explicit D3D12HeapBackend (ID3D12Device *device);
+	GpuHeapHandle CreateHeap (GpuHeapTier tier, uint64_t size) override;
+	void DestroyHeap (GpuHeapHandle heap) override;
+private:
+	ComPtr<ID3D12Device> device;
+};
+
+//budget of the adapter's local memory segment; heaps are ID3D12Heap objects
+class D3D12ResidencyBackend : public ResidencyBackend
+{
+public:
+	D3D12ResidencyBackend (ID3D12Device *device, IDXGIAdapter3 *adapter);
+	void QueryBudget (uint64_t &budget, uint64_t &usage) override;
+	void MakeResident (uint32_t count, const GpuHeapHandle *heaps) override;
+	void Evict (uint32_t count, const GpuHeapHandle *heaps) override;
+private:
+	ComPtr<ID3D12Device> device;
+	ComPtr<IDXGIAdapter3> adapter;
+	//scratch for converting handles, the manager calls from one thread at a time
+	std::vector<ID3D12Pageable*> objects;
+};
+
+//flags a swap chain is created with for D3D12PresentBackend: the frame latency waitable
+//object, and tearing if the system supports it; tearing support needs ENABLE_DXGI_TEARING
+UINT GetPresentSwapChainFlags (IDXGIFactory4 *factory);
+
+//swap chain created with the flags of GetPresentSwapChainFlags (); display times are
+//converted from QueryPerformanceCounter
+class D3D12PresentBackend : public PresentBackend
+{
+public:
+	explicit D3D12PresentBackend (IDXGISwapChain3 *swap_chain);
+	~D3D12PresentBackend ();
+	bool IsTearingSupported () override;
+	void SetMaximumFrameLatency (uint32_t frames) override;
+	bool WaitForFrame (uint32_t timeout_ms) override;
+	uint64_t Present (bool vsync) override;
+	bool GetDisplayInfo (PresentDisplayInfo &info) override;
+	uint64_t GetTime () override;
+	void SleepUntil (uint64_t time) override;
+private:
+	uint64_t ToNanoseconds (LONGLONG counter) const;
+
+	ComPtr<IDXGISwapChain3> swap_chain;
+	HANDLE waitable;
+	bool tearing_supported;
+	LONGLONG counter_frequency;
+};
+
+//ID3D12DescriptorHeap objects with the increment of their type
+class D3D12DescriptorBackend : public DescriptorBackend
+{
+public:
+	explicit D3D12DescriptorBackend (ID3D12Device *device);
+	DescriptorHeapDesc CreateHeap (GpuDescriptorHeapType type, uint32_t capacity, bool shader_visible) override;
+	void DestroyHeap (const DescriptorHeapDesc &heap) override;
+	void CopyDescriptors (GpuDescriptorHeapType type,
+						  uint32_t dst_range_count, const GpuDescriptorHandle *dst_starts, const uint32_t *dst_sizes,
+						  uint32_t src_range_count, const GpuDescriptorHandle *src_starts, const uint32_t *src_sizes) override;
+private:
+	ComPtr<ID3D12Device> device;
+	//scratch for converting handles, CopyDescriptors is called from one thread at a time
+	std::vector<D3D12_CPU_DESCRIPTOR_HANDLE> dst_handles;
+	std::vector<D3D12_CPU_DESCRIPTOR_HANDLE> src_handles;
+};
+
+//placed resources of render graph transients
+class D3D12RenderGraphBackend : public RenderGraphBackend
+{
+public:
+	explicit D3D12RenderGraphBackend (ID3D12Device *device);
+	void GetAllocationInfo (const RenderGraphResourceDesc &desc, uint64_t &size, uint64_t &alignment) override;
+	GpuResourceHandle CreatePlacedResource (const RenderGraphResourceDesc &desc, GpuHeapHandle heap, uint64_t offset, GpuResourceStates initial_state) override;
+	void DestroyResource (GpuResourceHandle resource) override;
+private:
+	ComPtr<ID3D12Device> device;
+};
+
+//ID3D12Device1 and ID3D12PipelineLibrary are declared from the 10.0.14393 SDK on; with the
+//pinned 10.0.10240 SDK every pipeline is compiled and nothing is loaded from a library
+#if defined (__ID3D12Device1_INTERFACE_DEFINED__) && defined (__ID3D12PipelineLibrary_INTERFACE_DEFINED__)
+#define D3D12_PIPELINE_LIBRARY_SUPPORTED
+#endif
+
+//graphics pipelines, stored in an ID3D12PipelineLibrary when the SDK and the runtime support it
+class D3D12PipelineBackend : public PipelineBackend
+{
+public:
+	explicit D3D12PipelineBackend (ID3D12Device *device);
+	uint64_t GetDeviceKey () override;
+	bool OpenLibrary (const void *blob, size_t size) override;
+	GpuPipelineHandle CreatePipeline (const PipelineDesc &desc, uint64_t hash, bool &loaded) override;
+	void DestroyPipeline (GpuPipelineHandle pipeline) override;
+	void SerializeLibrary (std::vector<uint8_t> &blob) override;
+private:
+	ComPtr<ID3D12Device> device;
+#ifdef D3D12_PIPELINE_LIBRARY_SUPPORTED
+	ComPtr<ID3D12Device1> library_device;
+	ComPtr<ID3D12PipelineLibrary> library;
+#endif
+	uint64_t device_key;
+};
+
+//root signatures serialized with version 1.0, whose tables have volatile descriptors
+class D3D12RootSignatureBackend : public RootSignatureBackend
+{
+public:
+	explicit D3D12RootSignatureBackend (ID3D12Device *device);
+	RootSignature CreateRootSignature (const RootSignatureDesc &desc) override;
+	void DestroyRootSignature (GpuRootSignatureHandle root_signature) override;
+private:
+	ComPtr<ID3D12Device> device;
+};
+
+//places a resource into a heap of the allocator; textures that qualify get the 4 KB
+//small resource alignment. Free the allocation after the resource is released.
+ComPtr<ID3D12Resource> CreatePlacedResource (ID3D12Device *device,
+											 GpuMemoryAllocator *allocator,
+											 const D3D12_RESOURCE_DESC &resource_desc,
+											 D3D12_RESOURCE_STATES initial_state,
+											 const D3D12_CLEAR_VALUE *clear_value,
+											 GpuMemoryAllocation &allocation);
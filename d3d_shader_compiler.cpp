@@ -0,0 +1,76 @@
+#include "stdafx.h"
+#include "d3d_shader_compiler.h"
+
+using Microsoft::WRL::ComPtr;
+
+//resolves #include through the include lists of the loaded files
+class SourceFileInclude : public ID3DInclude
+{
+public:
+	explicit SourceFileInclude (const std::vector<ShaderSourceFile> &source_files) :
+		files (source_files)
+	{
+	}
+
+	HRESULT __stdcall Open (D3D_INCLUDE_TYPE, LPCSTR file_name, LPCVOID parent_data, LPCVOID *data, UINT *bytes) override
+	{
+		//the parent is identified by the buffer handed out for it, the shader itself has none
+		size_t parent = 0;
+		if (parent_data)
+			for (parent = 0; parent < files.size () && files[parent].contents.data () != parent_data; parent++);
+		if (parent == files.size ())
+			return E_FAIL;
+		for (const auto &include : files[parent].includes)
+			if (include.first == file_name && include.second != shader_include_missing)
+			{
+				const std::string &contents = files[include.second].contents;
+				*data = contents.data ();
+				*bytes = static_cast<UINT>(contents.size ());
+				return S_OK;
+			}
+		return E_FAIL;
+	}
+
+	HRESULT __stdcall Close (LPCVOID) override
+	{
+		return S_OK;
+	}
+private:
+	const std::vector<ShaderSourceFile> &files;
+};
+
+std::string D3DShaderCompiler::GetIdentity ()
+{
+	return "d3dcompiler " + std::to_string (D3D_COMPILER_VERSION);
+}
+
+bool D3DShaderCompiler::Compile (const ShaderRequest &request, const std::vector<ShaderSourceFile> &files, std::vector<uint8_t> &bytecode, std::string &errors)
+{
+	std::vector<D3D_SHADER_MACRO> macros;
+	for (const ShaderDefine &define : request.defines)
+		macros.push_back ({ define.name.c_str (), define.value.c_str () });
+	macros.push_back ({ nullptr, nullptr });
+
+	SourceFileInclude include (files);
+	ComPtr<ID3DBlob> code;
+	ComPtr<ID3DBlob> messages;
+	const std::string &source = files[0].contents;
+	HRESULT hr = D3DCompile (source.data (),
+							 source.size (),
+							 files[0].path.c_str (),
+							 macros.data (),
+							 &include,
+							 request.entry_point.c_str (),
+							 request.target.c_str (),
+							 request.flags,
+							 0,
+							 &code,
+							 &messages);
+	if (messages)
+		errors.assign (static_cast<const char*>(messages->GetBufferPointer ()), messages->GetBufferSize ());
+	if (FAILED (hr))
+		return false;
+	const uint8_t *data = static_cast<const uint8_t*>(code->GetBufferPointer ());
+	bytecode.assign (data, data + code->GetBufferSize ());
+	return true;
+}
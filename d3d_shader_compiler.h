@@ -0,0 +1,13 @@
+#pragma once
+#include "stdafx.h"
+#include "shader_cache.h"
+
+//ShaderCompiler on top of D3DCompile; includes are served from the sources the cache
+//loaded, so the compiled files are exactly the hashed ones. Has no device dependency
+//and is shared with the offline shader precompiler.
+class D3DShaderCompiler : public ShaderCompiler
+{
+public:
+	std::string GetIdentity () override;
+	bool Compile (const ShaderRequest &request, const std::vector<ShaderSourceFile> &files, std::vector<uint8_t> &bytecode, std::string &errors) override;
+};
@@ -0,0 +1,213 @@
+#include "descriptor_heap.h"
+
+#include <string.h>
+#include <stdexcept>
+
+CpuDescriptorHeap::CpuDescriptorHeap (DescriptorBackend *descriptor_backend, GpuDescriptorHeapType heap_type, uint32_t capacity) :
+	backend (descriptor_backend),
+	type (heap_type),
+	heap_capacity (capacity),
+	allocated_count (0)
+{
+	if (!heap_capacity)
+		throw std::invalid_argument ("Descriptor heap can not be empty");
+}
+
+CpuDescriptorHeap::~CpuDescriptorHeap ()
+{
+	for (auto &heap : heaps)
+		backend->DestroyHeap (heap->desc);
+}
+
+CpuDescriptor CpuDescriptorHeap::Allocate ()
+{
+	std::lock_guard<std::mutex> lock (mutex);
+	if (heaps_with_space.empty ())
+	{
+		std::unique_ptr<Heap> heap (new Heap ());
+		heap->free_indices.resize (heap_capacity);
+		//pop from the back hands out low indices first
+		for (uint32_t i = 0; i < heap_capacity; i++)
+			heap->free_indices[i] = heap_capacity - 1 - i;
+		heap->allocated.resize ((heap_capacity + 63) / 64, 0);
+		heap->desc = backend->CreateHeap (type, heap_capacity, false);
+		heaps.push_back (std::move (heap));
+		heaps_with_space.push_back (static_cast<uint32_t>(heaps.size () - 1));
+	}
+
+	const uint32_t heap_index = heaps_with_space.back ();
+	Heap &heap = *heaps[heap_index];
+	const uint32_t index = heap.free_indices.back ();
+	heap.free_indices.pop_back ();
+	if (heap.free_indices.empty ())
+		heaps_with_space.pop_back ();
+	heap.allocated[index / 64] |= uint64_t (1) << (index % 64);
+	allocated_count++;
+
+	CpuDescriptor descriptor;
+	descriptor.handle = heap.desc.cpu_start + static_cast<uint64_t>(index) * heap.desc.increment;
+	descriptor.heap = heap_index;
+	descriptor.index = index;
+	return descriptor;
+}
+
+void CpuDescriptorHeap::Free (const CpuDescriptor &descriptor)
+{
+	std::lock_guard<std::mutex> lock (mutex);
+	if (descriptor.heap >= heaps.size () || descriptor.index >= heap_capacity)
+		throw std::logic_error ("Descriptor does not belong to the heap");
+	Heap &heap = *heaps[descriptor.heap];
+	uint64_t &word = heap.allocated[descriptor.index / 64];
+	const uint64_t bit = uint64_t (1) << (descriptor.index % 64);
+	if (!(word & bit))
+		throw std::logic_error ("Descriptor is not allocated");
+	word &= ~bit;
+	if (heap.free_indices.empty ())
+		heaps_with_space.push_back (descriptor.heap);
+	heap.free_indices.push_back (descriptor.index);
+	allocated_count--;
+}
+
+uint32_t CpuDescriptorHeap::GetAllocatedCount () const
+{
+	std::lock_guard<std::mutex> lock (mutex);
+	return allocated_count;
+}
+
+uint32_t CpuDescriptorHeap::GetHeapCount () const
+{
+	std::lock_guard<std::mutex> lock (mutex);
+	return static_cast<uint32_t>(heaps.size ());
+}
+
+ShaderDescriptorHeap::ShaderDescriptorHeap (GpuDevice *gpu_device, DescriptorBackend *descriptor_backend, uint32_t persistent_count, uint32_t ring_count) :
+	device (gpu_device),
+	backend (descriptor_backend),
+	persistent_capacity (persistent_count),
+	ring (ring_count)
+{
+	memset (&stats, 0, sizeof (stats));
+	if (persistent_capacity)
+		persistent.reset (new TlsfAllocator (persistent_capacity, 1));
+	desc = backend->CreateHeap (GPU_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, persistent_capacity + ring_count, true);
+}
+
+ShaderDescriptorHeap::~ShaderDescriptorHeap ()
+{
+	backend->DestroyHeap (desc);
+}
+
+DescriptorTable ShaderDescriptorHeap::AllocatePersistent (uint32_t count)
+{
+	std::lock_guard<std::mutex> lock (mutex);
+	TlsfAllocation allocation;
+	if (!persistent || !persistent->Allocate (count, 1, 0, allocation))
+		throw std::runtime_error ("Persistent descriptor region is full");
+	DescriptorTable table = MakeTable (static_cast<uint32_t>(allocation.offset), count);
+	table.block = allocation.block;
+	return table;
+}
+
+void ShaderDescriptorHeap::FreePersistent (const DescriptorTable &table)
+{
+	std::lock_guard<std::mutex> lock (mutex);
+	if (!persistent || table.offset >= persistent_capacity)
+		throw std::logic_error ("Descriptor table is not persistent");
+	persistent->Free (table.block);
+}
+
+DescriptorTable ShaderDescriptorHeap::AllocateFrame (uint32_t count)
+{
+	std::lock_guard<std::mutex> lock (mutex);
+	uint64_t offset;
+	while (!ring.Allocate (count, 1, offset))
+	{
+		const uint64_t oldest = ring.GetOldestFence ();
+		if (!oldest)
+			throw std::runtime_error ("Descriptor ring is too small for one frame");
+		uint64_t completed = device->GetCompletedFenceValue ();
+		if (completed < oldest)
+		{
+			stats.stalls++;
+			device->WaitForFenceValue (oldest);
+			completed = oldest;
+		}
+		ring.Reclaim (completed);
+	}
+	return MakeTable (persistent_capacity + static_cast<uint32_t>(offset), count);
+}
+
+DescriptorTable ShaderDescriptorHeap::StageTable (uint32_t count, const GpuDescriptorHandle *sources)
+{
+	DescriptorTable table = AllocateFrame (count);
+	StageCopy (table, 0, count, sources);
+	std::lock_guard<std::mutex> lock (mutex);
+	stats.staged_tables++;
+	return table;
+}
+
+void ShaderDescriptorHeap::StageCopy (const DescriptorTable &table, uint32_t first, uint32_t count, const GpuDescriptorHandle *sources)
+{
+	if (!count)
+		return;
+	if (first + count > table.count)
+		throw std::out_of_range ("Staged descriptors do not fit the table");
+	std::lock_guard<std::mutex> lock (mutex);
+	dst_starts.push_back (table.cpu_handle + static_cast<uint64_t>(first) * desc.increment);
+	dst_sizes.push_back (count);
+	//sources that follow each other in their heap become one range
+	for (uint32_t i = 0; i < count; i++)
+	{
+		if (!src_starts.empty () && src_starts.back () + static_cast<uint64_t>(src_sizes.back ()) * desc.increment == sources[i])
+			src_sizes.back ()++;
+		else
+		{
+			src_starts.push_back (sources[i]);
+			src_sizes.push_back (1);
+		}
+	}
+}
+
+void ShaderDescriptorHeap::FlushCopies ()
+{
+	std::lock_guard<std::mutex> lock (mutex);
+	if (dst_starts.empty ())
+		return;
+	backend->CopyDescriptors (GPU_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV,
+							  static_cast<uint32_t>(dst_starts.size ()), dst_starts.data (), dst_sizes.data (),
+							  static_cast<uint32_t>(src_starts.size ()), src_starts.data (), src_sizes.data ());
+	dst_starts.clear ();
+	dst_sizes.clear ();
+	src_starts.clear ();
+	src_sizes.clear ();
+	stats.copy_batches++;
+}
+
+void ShaderDescriptorHeap::FinishFrame (uint64_t fence_value)
+{
+	std::lock_guard<std::mutex> lock (mutex);
+	if (!dst_starts.empty ())
+		throw std::logic_error ("Staged descriptor copies were not flushed");
+	ring.FinishFrame (fence_value);
+	ring.Reclaim (device->GetCompletedFenceValue ());
+}
+
+ShaderDescriptorStats ShaderDescriptorHeap::GetStats () const
+{
+	std::lock_guard<std::mutex> lock (mutex);
+	ShaderDescriptorStats result = stats;
+	result.persistent_used = persistent ? static_cast<uint32_t>(persistent->GetUsedSize ()) : 0;
+	result.ring_used = static_cast<uint32_t>(ring.GetUsedSize ());
+	return result;
+}
+
+DescriptorTable ShaderDescriptorHeap::MakeTable (uint32_t offset, uint32_t count) const
+{
+	DescriptorTable table;
+	table.cpu_handle = desc.cpu_start + static_cast<uint64_t>(offset) * desc.increment;
+	table.gpu_handle = desc.gpu_start + static_cast<uint64_t>(offset) * desc.increment;
+	table.offset = offset;
+	table.count = count;
+	table.block = 0;
+	return table;
+}
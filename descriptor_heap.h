@@ -0,0 +1,147 @@
+#pragma once
+#include "gpu_device.h"
+#include "upload_allocator.h"
+#include "gpu_memory.h"
+
+#include <stdint.h>
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+//Descriptor management. CPU-only heaps of every type hand out single descriptors from
+//free lists and grow by whole heaps. The shader visible CBV/SRV/UAV heap is split into a
+//persistent region for long-lived tables and a per-frame ring that staged tables are
+//copied into with batched CopyDescriptors calls.
+
+struct DescriptorHeapDesc
+{
+	GpuDescriptorHeapHandle heap;
+	GpuDescriptorHandle cpu_start;
+	GpuShaderDescriptorHandle gpu_start;    //0 for CPU-only heaps
+	uint32_t increment;
+	uint32_t capacity;
+};
+
+class DescriptorBackend
+{
+public:
+	virtual ~DescriptorBackend () {}
+	virtual DescriptorHeapDesc CreateHeap (GpuDescriptorHeapType type, uint32_t capacity, bool shader_visible) = 0;
+	virtual void DestroyHeap (const DescriptorHeapDesc &heap) = 0;
+	//same semantics as ID3D12Device::CopyDescriptors
+	virtual void CopyDescriptors (GpuDescriptorHeapType type,
+								  uint32_t dst_range_count, const GpuDescriptorHandle *dst_starts, const uint32_t *dst_sizes,
+								  uint32_t src_range_count, const GpuDescriptorHandle *src_starts, const uint32_t *src_sizes) = 0;
+};
+
+struct CpuDescriptor
+{
+	GpuDescriptorHandle handle;
+	uint32_t heap;
+	uint32_t index;
+};
+
+//O(1) single descriptor allocation from a list of fixed-size CPU-only heaps
+class CpuDescriptorHeap
+{
+public:
+	CpuDescriptorHeap (DescriptorBackend *backend, GpuDescriptorHeapType type, uint32_t heap_capacity);
+	~CpuDescriptorHeap ();
+
+	CpuDescriptor Allocate ();
+	void Free (const CpuDescriptor &descriptor);
+
+	uint32_t GetAllocatedCount () const;
+	uint32_t GetHeapCount () const;
+private:
+	struct Heap
+	{
+		DescriptorHeapDesc desc;
+		std::vector<uint32_t> free_indices;
+		std::vector<uint64_t> allocated;    //one bit per descriptor, catches double frees
+	};
+
+	CpuDescriptorHeap (const CpuDescriptorHeap &) = delete;
+	CpuDescriptorHeap &operator= (const CpuDescriptorHeap &) = delete;
+
+	DescriptorBackend *backend;
+	GpuDescriptorHeapType type;
+	uint32_t heap_capacity;
+	mutable std::mutex mutex;
+	std::vector<std::unique_ptr<Heap>> heaps;
+	std::vector<uint32_t> heaps_with_space;
+	uint32_t allocated_count;
+};
+
+//contiguous range of the shader visible heap
+struct DescriptorTable
+{
+	GpuDescriptorHandle cpu_handle;
+	GpuShaderDescriptorHandle gpu_handle;
+	uint32_t offset;    //first descriptor inside the heap
+	uint32_t count;
+	uint32_t block;     //persistent tables only
+};
+
+struct ShaderDescriptorStats
+{
+	uint32_t persistent_used;
+	uint32_t ring_used;
+	uint64_t staged_tables;
+	uint64_t copy_batches;
+	uint64_t stalls;
+};
+
+class ShaderDescriptorHeap
+{
+public:
+	//the device is used to wait for the GPU when the ring is full
+	ShaderDescriptorHeap (GpuDevice *device, DescriptorBackend *backend, uint32_t persistent_capacity, uint32_t ring_capacity);
+	~ShaderDescriptorHeap ();
+
+	GpuDescriptorHeapHandle GetHeap () const
+	{
+		return desc.heap;
+	}
+	uint32_t GetIncrement () const
+	{
+		return desc.increment;
+	}
+
+	DescriptorTable AllocatePersistent (uint32_t count);
+	void FreePersistent (const DescriptorTable &table);
+
+	//a table of the current frame; filled by StageTable or directly through cpu_handle
+	DescriptorTable AllocateFrame (uint32_t count);
+	//allocates a frame table and queues copying the source descriptors into it
+	DescriptorTable StageTable (uint32_t count, const GpuDescriptorHandle *sources);
+	//queues a copy into a table allocated before
+	void StageCopy (const DescriptorTable &table, uint32_t first, uint32_t count, const GpuDescriptorHandle *sources);
+	//copies everything staged with one CopyDescriptors call; before the tables are used by the GPU
+	void FlushCopies ();
+	//frame tables allocated since the previous call are reused once the fence reaches the value
+	void FinishFrame (uint64_t fence_value);
+
+	ShaderDescriptorStats GetStats () const;
+private:
+	ShaderDescriptorHeap (const ShaderDescriptorHeap &) = delete;
+	ShaderDescriptorHeap &operator= (const ShaderDescriptorHeap &) = delete;
+
+	DescriptorTable MakeTable (uint32_t offset, uint32_t count) const;
+
+	GpuDevice *device;
+	DescriptorBackend *backend;
+	DescriptorHeapDesc desc;
+	uint32_t persistent_capacity;
+	mutable std::mutex mutex;
+	std::unique_ptr<TlsfAllocator> persistent;
+	UploadRing ring;
+
+	//staged copies; destination ranges are tables, source ranges are merged runs
+	std::vector<GpuDescriptorHandle> dst_starts;
+	std::vector<uint32_t> dst_sizes;
+	std::vector<GpuDescriptorHandle> src_starts;
+	std::vector<uint32_t> src_sizes;
+	ShaderDescriptorStats stats;
+};
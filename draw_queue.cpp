@@ -0,0 +1,336 @@
+#include "draw_queue.h"
+
+#include <string.h>
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+//field positions; bit 0 holds the order, bit 1 is unused
+static const uint32_t draw_pass_shift = 60;
+static const uint64_t draw_depth_max = (1ull << draw_depth_bits) - 1;
+//DRAW_ORDER_STATE: pass, root signature, pipeline, geometry, depth
+static const uint32_t draw_state_depth_shift = 2;
+static const uint32_t draw_state_geometry_shift = draw_state_depth_shift + draw_depth_bits;
+static const uint32_t draw_state_pipeline_shift = draw_state_geometry_shift + draw_geometry_bits;
+static const uint32_t draw_state_root_signature_shift = draw_state_pipeline_shift + draw_pipeline_bits;
+//DRAW_ORDER_BACK_TO_FRONT: pass, inverted depth, root signature, pipeline, geometry
+static const uint32_t draw_blend_geometry_shift = 2;
+static const uint32_t draw_blend_pipeline_shift = draw_blend_geometry_shift + draw_geometry_bits;
+static const uint32_t draw_blend_root_signature_shift = draw_blend_pipeline_shift + draw_pipeline_bits;
+static const uint32_t draw_blend_depth_shift = draw_blend_root_signature_shift + draw_root_signature_bits;
+
+static_assert (draw_state_root_signature_shift + draw_root_signature_bits == draw_pass_shift, "Sort key fields must fill the key");
+static_assert (draw_blend_depth_shift + draw_depth_bits == draw_pass_shift, "Sort key fields must fill the key");
+static_assert (draw_pass_shift + draw_pass_bits == 64, "Sort key fields must fill the key");
+
+static uint32_t GetField (uint64_t key, uint32_t shift, uint32_t bits)
+{
+	return static_cast<uint32_t>((key >> shift) & ((1ull << bits) - 1));
+}
+
+//the key without its depth, equal for packets that can share an instanced draw
+static uint64_t GetStateBits (uint64_t key)
+{
+	if (key & 1)
+		return key & ~(draw_depth_max << draw_blend_depth_shift);
+	return key & ~(draw_depth_max << draw_state_depth_shift);
+}
+
+uint64_t MakeDrawSortKey (uint32_t pass, DrawOrder order, uint32_t root_signature, uint32_t pipeline, uint32_t geometry, float depth)
+{
+	if (pass >> draw_pass_bits || root_signature >> draw_root_signature_bits || pipeline >> draw_pipeline_bits ||
+		geometry >> draw_geometry_bits)
+		throw std::out_of_range ("Draw sort key field is out of range");
+	//NaN ends up nearest
+	const uint64_t quantized = depth > 0.0f ? static_cast<uint64_t>(std::min (depth, 1.0f) * static_cast<double>(draw_depth_max) + 0.5) : 0;
+	uint64_t key = static_cast<uint64_t>(pass) << draw_pass_shift;
+	if (order == DRAW_ORDER_BACK_TO_FRONT)
+	{
+		key |= (draw_depth_max - quantized) << draw_blend_depth_shift;
+		key |= static_cast<uint64_t>(root_signature) << draw_blend_root_signature_shift;
+		key |= static_cast<uint64_t>(pipeline) << draw_blend_pipeline_shift;
+		key |= static_cast<uint64_t>(geometry) << draw_blend_geometry_shift;
+		key |= 1;
+	}
+	else
+	{
+		key |= static_cast<uint64_t>(root_signature) << draw_state_root_signature_shift;
+		key |= static_cast<uint64_t>(pipeline) << draw_state_pipeline_shift;
+		key |= static_cast<uint64_t>(geometry) << draw_state_geometry_shift;
+		key |= quantized << draw_state_depth_shift;
+	}
+	return key;
+}
+
+DrawSortKeyFields DecodeDrawSortKey (uint64_t key)
+{
+	DrawSortKeyFields fields;
+	fields.pass = GetField (key, draw_pass_shift, draw_pass_bits);
+	if (key & 1)
+	{
+		fields.order = DRAW_ORDER_BACK_TO_FRONT;
+		fields.root_signature = GetField (key, draw_blend_root_signature_shift, draw_root_signature_bits);
+		fields.pipeline = GetField (key, draw_blend_pipeline_shift, draw_pipeline_bits);
+		fields.geometry = GetField (key, draw_blend_geometry_shift, draw_geometry_bits);
+		fields.depth = static_cast<uint32_t>(draw_depth_max) - GetField (key, draw_blend_depth_shift, draw_depth_bits);
+	}
+	else
+	{
+		fields.order = DRAW_ORDER_STATE;
+		fields.root_signature = GetField (key, draw_state_root_signature_shift, draw_root_signature_bits);
+		fields.pipeline = GetField (key, draw_state_pipeline_shift, draw_pipeline_bits);
+		fields.geometry = GetField (key, draw_state_geometry_shift, draw_geometry_bits);
+		fields.depth = GetField (key, draw_state_depth_shift, draw_depth_bits);
+	}
+	return fields;
+}
+
+void SortDrawPackets (std::vector<DrawPacket> &packets, std::vector<DrawPacket> &scratch)
+{
+	const size_t count = packets.size ();
+	scratch.resize (count);
+	if (count < 2)
+		return;
+
+	//one read for the histograms of all eight bytes
+	uint32_t histograms[8][256];
+	memset (histograms, 0, sizeof (histograms));
+	for (const DrawPacket &packet : packets)
+		for (uint32_t byte = 0; byte < 8; byte++)
+			histograms[byte][(packet.key >> (byte * 8)) & 0xff]++;
+
+	DrawPacket *source = packets.data ();
+	DrawPacket *destination = scratch.data ();
+	for (uint32_t byte = 0; byte < 8; byte++)
+	{
+		const uint32_t shift = byte * 8;
+		uint32_t *histogram = histograms[byte];
+		//pass, root signature and other high bytes are often the same for every packet
+		if (histogram[(source[0].key >> shift) & 0xff] == count)
+			continue;
+		uint32_t offset = 0;
+		for (uint32_t digit = 0; digit < 256; digit++)
+		{
+			const uint32_t digit_count = histogram[digit];
+			histogram[digit] = offset;
+			offset += digit_count;
+		}
+		for (size_t i = 0; i < count; i++)
+			destination[histogram[(source[i].key >> shift) & 0xff]++] = source[i];
+		std::swap (source, destination);
+	}
+	if (source != packets.data ())
+		packets.swap (scratch);
+}
+
+DrawQueue::DrawQueue ()
+{
+}
+
+uint32_t DrawQueue::AddRootSignature (GpuRootSignatureHandle root_signature, uint32_t table_count, const DrawRootTable *tables)
+{
+	if (root_signatures.size () >> draw_root_signature_bits)
+		throw std::out_of_range ("Too many root signatures for the draw sort key");
+	if (table_count > draw_max_root_tables)
+		throw std::out_of_range ("Too many descriptor tables for a draw root signature");
+	RootSignature entry;
+	entry.root_signature = root_signature;
+	entry.table_count = table_count;
+	for (uint32_t i = 0; i < table_count; i++)
+		entry.tables[i] = tables[i];
+	root_signatures.push_back (entry);
+	return static_cast<uint32_t>(root_signatures.size () - 1);
+}
+
+uint32_t DrawQueue::AddPipeline (GpuPipelineHandle pipeline, GpuPrimitiveTopology topology)
+{
+	if (pipelines.size () >> draw_pipeline_bits)
+		throw std::out_of_range ("Too many pipelines for the draw sort key");
+	const Pipeline entry = { pipeline, topology };
+	pipelines.push_back (entry);
+	return static_cast<uint32_t>(pipelines.size () - 1);
+}
+
+void DrawQueue::SetPipeline (uint32_t id, GpuPipelineHandle pipeline, GpuPrimitiveTopology topology)
+{
+	Pipeline &entry = pipelines.at (id);
+	entry.pipeline = pipeline;
+	entry.topology = topology;
+}
+
+uint32_t DrawQueue::AddGeometry (const DrawGeometry &geometry)
+{
+	if (geometries.size () >> draw_geometry_bits)
+		throw std::out_of_range ("Too many geometries for the draw sort key");
+	if (geometry.constant_count > draw_max_geometry_constants)
+		throw std::invalid_argument ("Too many geometry constants");
+	geometries.push_back (geometry);
+	return static_cast<uint32_t>(geometries.size () - 1);
+}
+
+void DrawQueue::Reset ()
+{
+	packets.clear ();
+}
+
+bool DrawQueue::SameBindings (const DrawGeometry &a, const DrawGeometry &b) const
+{
+	return a.vertex_buffer.location == b.vertex_buffer.location && a.vertex_buffer.size == b.vertex_buffer.size &&
+		   a.vertex_buffer.stride == b.vertex_buffer.stride && a.index_buffer.location == b.index_buffer.location &&
+		   a.index_buffer.size == b.index_buffer.size && a.index_buffer.format == b.index_buffer.format &&
+		   a.constants_parameter == b.constants_parameter && a.constant_count == b.constant_count &&
+		   memcmp (a.constants, b.constants, a.constant_count * sizeof (uint32_t)) == 0;
+}
+
+void DrawQueue::Build (bool indirect)
+{
+	SortDrawPackets (packets, scratch);
+
+	//runs of packets with the same state become one instanced draw
+	batches.clear ();
+	instances.resize (packets.size ());
+	uint64_t batch_state = 0;
+	for (size_t i = 0; i < packets.size (); i++)
+	{
+		const uint64_t state = GetStateBits (packets[i].key);
+		instances[i] = packets[i].instance;
+		if (i && state == batch_state)
+		{
+			batches.back ().instance_count++;
+			continue;
+		}
+		const DrawSortKeyFields fields = DecodeDrawSortKey (packets[i].key);
+		if (fields.root_signature >= root_signatures.size () || fields.pipeline >= pipelines.size () ||
+			fields.geometry >= geometries.size ())
+			throw std::out_of_range ("Draw packet names an unregistered state");
+		const DrawBatch batch = { fields.root_signature, fields.pipeline, fields.geometry, 1, static_cast<uint32_t>(i) };
+		batches.push_back (batch);
+		batch_state = state;
+	}
+
+	//draws that only differ in their arguments share a group
+	groups.clear ();
+	indirect_arguments.clear ();
+	for (size_t i = 0; i < batches.size (); i++)
+	{
+		const DrawBatch &batch = batches[i];
+		const DrawGeometry &geometry = geometries[batch.geometry];
+		if (!i || batch.root_signature != batches[i - 1].root_signature || batch.pipeline != batches[i - 1].pipeline ||
+			!SameBindings (geometry, geometries[batches[i - 1].geometry]))
+		{
+			const DrawGroup group = { static_cast<uint32_t>(i), 0, indirect_arguments.size (), geometry.index_buffer.location != 0 };
+			groups.push_back (group);
+		}
+		groups.back ().batch_count++;
+
+		if (!indirect)
+			continue;
+		if (geometry.index_buffer.location)
+		{
+			const GpuDrawIndexedArguments arguments = { geometry.count, batch.instance_count, geometry.start, geometry.base_vertex,
+														batch.start_instance };
+			const uint8_t *bytes = reinterpret_cast<const uint8_t*>(&arguments);
+			indirect_arguments.insert (indirect_arguments.end (), bytes, bytes + sizeof (arguments));
+		}
+		else
+		{
+			const GpuDrawArguments arguments = { geometry.count, batch.instance_count, geometry.start, batch.start_instance };
+			const uint8_t *bytes = reinterpret_cast<const uint8_t*>(&arguments);
+			indirect_arguments.insert (indirect_arguments.end (), bytes, bytes + sizeof (arguments));
+		}
+	}
+}
+
+DrawRecordStats DrawQueue::Record (GpuCommandList *command_list, uint32_t first_group, uint32_t group_count,
+								   const GpuVertexBufferView *instance_buffer, const DrawIndirectBuffers *indirect) const
+{
+	if (first_group > groups.size () || group_count > groups.size () - first_group)
+		throw std::out_of_range ("Draw group range is out of range");
+
+	DrawRecordStats stats;
+	memset (&stats, 0, sizeof (stats));
+	//state of the list, null until set
+	const RootSignature *root_signature = nullptr;
+	const Pipeline *pipeline = nullptr;
+	GpuPrimitiveTopology topology = GPU_PRIMITIVE_TOPOLOGY_UNDEFINED;
+	const DrawGeometry *vertex_buffer = nullptr;
+	const DrawGeometry *index_buffer = nullptr;
+	const DrawGeometry *constants = nullptr;
+
+	if (instance_buffer && group_count)
+	{
+		command_list->SetVertexBuffers (draw_instance_slot, 1, instance_buffer);
+		stats.vertex_buffers++;
+	}
+	for (uint32_t g = first_group; g < first_group + group_count; g++)
+	{
+		const DrawGroup &group = groups[g];
+		const DrawBatch &first = batches[group.first_batch];
+		const DrawGeometry &geometry = geometries[first.geometry];
+
+		const RootSignature *group_root_signature = &root_signatures[first.root_signature];
+		if (!root_signature || root_signature->root_signature != group_root_signature->root_signature)
+		{
+			command_list->SetGraphicsRootSignature (group_root_signature->root_signature);
+			stats.root_signatures++;
+			//setting a root signature clears the root arguments
+			constants = nullptr;
+			for (uint32_t t = 0; t < group_root_signature->table_count; t++)
+				command_list->SetGraphicsRootDescriptorTable (group_root_signature->tables[t].parameter, group_root_signature->tables[t].table);
+			stats.tables += group_root_signature->table_count;
+		}
+		root_signature = group_root_signature;
+		const Pipeline *group_pipeline = &pipelines[first.pipeline];
+		if (!pipeline || pipeline->pipeline != group_pipeline->pipeline)
+		{
+			command_list->SetPipelineState (group_pipeline->pipeline);
+			stats.pipelines++;
+		}
+		pipeline = group_pipeline;
+		if (topology != group_pipeline->topology)
+		{
+			command_list->SetPrimitiveTopology (group_pipeline->topology);
+			stats.topologies++;
+			topology = group_pipeline->topology;
+		}
+		if (!vertex_buffer || memcmp (&vertex_buffer->vertex_buffer, &geometry.vertex_buffer, sizeof (GpuVertexBufferView)) != 0)
+		{
+			command_list->SetVertexBuffers (0, 1, &geometry.vertex_buffer);
+			stats.vertex_buffers++;
+			vertex_buffer = &geometry;
+		}
+		if (group.indexed && (!index_buffer || memcmp (&index_buffer->index_buffer, &geometry.index_buffer, sizeof (GpuIndexBufferView)) != 0))
+		{
+			command_list->SetIndexBuffer (&geometry.index_buffer);
+			stats.index_buffers++;
+			index_buffer = &geometry;
+		}
+		if (geometry.constant_count && (!constants || constants->constants_parameter != geometry.constants_parameter ||
+										constants->constant_count != geometry.constant_count ||
+										memcmp (constants->constants, geometry.constants, geometry.constant_count * sizeof (uint32_t)) != 0))
+		{
+			command_list->SetGraphicsRoot32BitConstants (geometry.constants_parameter, geometry.constant_count, geometry.constants, 0);
+			stats.constants++;
+			constants = &geometry;
+		}
+
+		stats.draws += group.batch_count;
+		if (indirect)
+		{
+			command_list->ExecuteIndirect (group.indexed ? indirect->draw_indexed_signature : indirect->draw_signature, group.batch_count,
+										   indirect->arguments, indirect->arguments_offset + group.arguments_offset, 0, 0);
+			stats.indirect_calls++;
+			continue;
+		}
+		for (uint32_t b = group.first_batch; b < group.first_batch + group.batch_count; b++)
+		{
+			const DrawBatch &batch = batches[b];
+			const DrawGeometry &draw = geometries[batch.geometry];
+			if (group.indexed)
+				command_list->DrawIndexedInstanced (draw.count, batch.instance_count, draw.start, draw.base_vertex, batch.start_instance);
+			else
+				command_list->DrawInstanced (draw.count, batch.instance_count, draw.start, batch.start_instance);
+		}
+	}
+	return stats;
+}
@@ -0,0 +1,221 @@
+#pragma once
+#include "gpu_device.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+//Sort-key draw submission. Callers register their pipelines, root signatures and
+//geometry once and enqueue one packet per drawn instance: a 64 bit sort key naming the
+//pass, root signature, pipeline, geometry and depth, plus a 32 bit value for the
+//instance. Build () radix sorts the frame's packets, merges runs of packets with the
+//same state into instanced draws and groups draws that only differ in their draw
+//arguments. Record () emits a range of groups, setting only state that changed, either
+//as direct draws or as one ExecuteIndirect per group.
+//
+//Instanced draws read their instance values through a per-instance vertex buffer in
+//draw_instance_slot: StartInstanceLocation offsets per-instance data, SV_InstanceID does
+//not include it.
+
+//bits of the sort key fields, which also limit the number of registered states
+static const uint32_t draw_pass_bits = 4;
+static const uint32_t draw_root_signature_bits = 6;
+static const uint32_t draw_pipeline_bits = 12;
+static const uint32_t draw_geometry_bits = 16;
+static const uint32_t draw_depth_bits = 24;
+//root constants a geometry can set, e.g. the dequantization of its mesh
+static const uint32_t draw_max_geometry_constants = 16;
+//vertex buffer slot of the instance values
+static const uint32_t draw_instance_slot = 1;
+//descriptor tables a root signature can bind
+static const uint32_t draw_max_root_tables = 4;
+
+//order of the packets inside a pass; every packet of a pass must use the same one
+enum DrawOrder
+{
+	DRAW_ORDER_STATE,           //by state, front to back within the same state; opaque passes
+	DRAW_ORDER_BACK_TO_FRONT    //by depth, then state; blended passes
+};
+
+//depth is the normalized view depth, clamped to [0, 1].
+//Throws std::out_of_range if a field does not fit its bits.
+uint64_t MakeDrawSortKey (uint32_t pass, DrawOrder order, uint32_t root_signature, uint32_t pipeline, uint32_t geometry, float depth);
+
+struct DrawSortKeyFields
+{
+	uint32_t pass;
+	DrawOrder order;
+	uint32_t root_signature;
+	uint32_t pipeline;
+	uint32_t geometry;
+	uint32_t depth;             //quantized, 0 is nearest
+};
+
+DrawSortKeyFields DecodeDrawSortKey (uint64_t key);
+
+struct DrawPacket
+{
+	uint64_t key;
+	uint32_t instance;          //stored in the instance buffer
+	uint32_t padding;
+};
+
+//stable LSD radix sort by key; passes where every key has the same byte are skipped.
+//scratch is resized to the packet count.
+void SortDrawPackets (std::vector<DrawPacket> &packets, std::vector<DrawPacket> &scratch);
+
+//descriptor table bound whenever its root signature is set, e.g. a bindless table
+struct DrawRootTable
+{
+	uint32_t parameter;
+	GpuShaderDescriptorHandle table;
+};
+
+//buffers and draw range of a registered geometry
+struct DrawGeometry
+{
+	GpuVertexBufferView vertex_buffer;
+	GpuIndexBufferView index_buffer;    //location 0 draws without an index buffer
+	uint32_t count;                     //indices, or vertices without an index buffer
+	uint32_t start;                     //first index or vertex
+	int32_t base_vertex;
+	uint32_t constants_parameter;       //root parameter of the constants
+	uint32_t constant_count;
+	uint32_t constants[draw_max_geometry_constants];
+};
+
+//merged packets, drawn with one instanced draw
+struct DrawBatch
+{
+	uint32_t root_signature;
+	uint32_t pipeline;
+	uint32_t geometry;
+	uint32_t instance_count;
+	uint32_t start_instance;            //into the instance values
+};
+
+//consecutive batches with the same root signature, pipeline, buffers and constants
+struct DrawGroup
+{
+	uint32_t first_batch;
+	uint32_t batch_count;
+	uint64_t arguments_offset;          //into the indirect arguments
+	bool indexed;
+};
+
+//command signatures of one GpuDrawArguments or GpuDrawIndexedArguments each, and the
+//GPU copy of the arguments built by Build (true)
+struct DrawIndirectBuffers
+{
+	GpuCommandSignatureHandle draw_signature;
+	GpuCommandSignatureHandle draw_indexed_signature;
+	GpuResourceHandle arguments;
+	uint64_t arguments_offset;
+};
+
+//commands issued by Record ()
+struct DrawRecordStats
+{
+	uint32_t root_signatures;
+	uint32_t tables;
+	uint32_t pipelines;
+	uint32_t topologies;
+	uint32_t vertex_buffers;
+	uint32_t index_buffers;
+	uint32_t constants;
+	uint32_t draws;
+	uint32_t indirect_calls;
+};
+
+class DrawQueue
+{
+public:
+	DrawQueue ();
+
+	//registered states stay valid across frames; ids are the values of the sort key fields
+	//the tables are bound after every switch to the root signature; their heaps must be
+	//set on the command lists before Record ()
+	uint32_t AddRootSignature (GpuRootSignatureHandle root_signature, uint32_t table_count = 0, const DrawRootTable *tables = nullptr);
+	uint32_t AddPipeline (GpuPipelineHandle pipeline, GpuPrimitiveTopology topology);
+	//replaces a pipeline, e.g. after a shader reload
+	void SetPipeline (uint32_t id, GpuPipelineHandle pipeline, GpuPrimitiveTopology topology);
+	//geometries registered one after another share their key prefix, so register the
+	//submeshes of a mesh together
+	uint32_t AddGeometry (const DrawGeometry &geometry);
+
+	//clears the packets of the previous frame
+	void Reset ();
+	void Submit (uint64_t key, uint32_t instance)
+	{
+		const DrawPacket packet = { key, instance, 0 };
+		packets.push_back (packet);
+	}
+	//sorts and merges the packets; indirect also writes the indirect arguments.
+	//Throws std::out_of_range if a packet names a state that is not registered.
+	void Build (bool indirect);
+
+	//records groups [first_group, first_group + group_count) of the last Build () into a
+	//command list with unknown state. instance_buffer is bound to draw_instance_slot if it
+	//is not null; indirect selects ExecuteIndirect. Thread-safe for concurrent calls.
+	DrawRecordStats Record (GpuCommandList *command_list, uint32_t first_group, uint32_t group_count,
+							const GpuVertexBufferView *instance_buffer, const DrawIndirectBuffers *indirect) const;
+
+	size_t GetPacketCount () const
+	{
+		return packets.size ();
+	}
+	uint32_t GetBatchCount () const
+	{
+		return static_cast<uint32_t>(batches.size ());
+	}
+	uint32_t GetGroupCount () const
+	{
+		return static_cast<uint32_t>(groups.size ());
+	}
+	const std::vector<DrawBatch> &GetBatches () const
+	{
+		return batches;
+	}
+	const std::vector<DrawGroup> &GetGroups () const
+	{
+		return groups;
+	}
+	//instance values in draw order, for a per-instance vertex buffer of R32_UINT
+	const std::vector<uint32_t> &GetInstances () const
+	{
+		return instances;
+	}
+	//GpuDrawArguments or GpuDrawIndexedArguments of every batch in group order
+	const std::vector<uint8_t> &GetIndirectArguments () const
+	{
+		return indirect_arguments;
+	}
+private:
+	struct RootSignature
+	{
+		GpuRootSignatureHandle root_signature;
+		uint32_t table_count;
+		DrawRootTable tables[draw_max_root_tables];
+	};
+
+	struct Pipeline
+	{
+		GpuPipelineHandle pipeline;
+		GpuPrimitiveTopology topology;
+	};
+
+	//same buffers and constants, so the draws only differ in their arguments
+	bool SameBindings (const DrawGeometry &a, const DrawGeometry &b) const;
+
+	std::vector<RootSignature> root_signatures;
+	std::vector<Pipeline> pipelines;
+	std::vector<DrawGeometry> geometries;
+
+	std::vector<DrawPacket> packets;
+	std::vector<DrawPacket> scratch;
+	std::vector<DrawBatch> batches;
+	std::vector<DrawGroup> groups;
+	std::vector<uint32_t> instances;
+	std::vector<uint8_t> indirect_arguments;
+};
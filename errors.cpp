@@ -1,7 +1,7 @@
 #include "stdafx.h"
 #include "errors.h"
 
-static FILE *f;
+static Logger logger;
 
 void PrintMessage (const char *str)
 {
@@ -10,7 +10,12 @@ void PrintMessage (const char *str)
 
 void InitLog ()
 {
-	if (fopen_s (&f, "log.txt", "w"))
+	LoggerDesc desc;
+	desc.file_name = "log.txt";
+	#ifdef _DEBUG
+	desc.min_severity = LOG_SEVERITY_DEBUG;
+	#endif
+	if (!logger.Open (desc))
 	{
 		PrintMessage ("Can not open log file!");
 		exit (EXIT_FAILURE);
@@ -19,23 +24,26 @@ void InitLog ()
 
 void CloseLog ()
 {
-	fclose (f);
+	logger.Close ();
+}
+
+void FlushLog ()
+{
+	logger.Flush ();
 }
 
 void Log (const char *format_str, ...)
 {
-	time_t rawtime;
-	tm t;
-	time (&rawtime);
-	char time_str[40];
-	localtime_s (&t, &rawtime);
-	strftime (time_str, 40, "[%D %T] ", &t);
-	fputs (time_str, f);
+	va_list args;
+	va_start (args, format_str);
+	logger.Write (LOG_SEVERITY_INFO, format_str, args);
+	va_end (args);
+}
 
+void LogMessage (LogSeverity severity, const char *format_str, ...)
+{
 	va_list args;
 	va_start (args, format_str);
-	vfprintf (f, format_str, args);
-	fputc ('\n', f);
+	logger.Write (severity, format_str, args);
 	va_end (args);
-	fflush (f);
 }
\ No newline at end of file
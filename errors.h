@@ -1,5 +1,6 @@
 #pragma once
 #include "stdafx.h"
+#include "logger.h"
 
 #define THROWIFFAILED(func, str) if (FAILED(func)) throw framework_err (str)
 
@@ -7,6 +8,8 @@ void PrintMessage (const char *str);
 
 void InitLog ();
 void Log (const char *format_str, ...);
+void LogMessage (LogSeverity severity, const char *format_str, ...);
+void FlushLog ();
 void CloseLog ();
 
 class framework_err:public std::exception
@@ -15,7 +18,7 @@ public:
 	framework_err (const char *str) throw () :
 		err_msg (str)
 	{
-		Log ("%s", str);
+		LogMessage (LOG_SEVERITY_ERROR, "%s", str);
 	};
 	virtual ~framework_err () throw ()
 	{
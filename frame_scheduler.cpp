@@ -0,0 +1,181 @@
+#include "frame_scheduler.h"
+
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+
+static uint64_t GetSteadyNanoseconds ()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now ().time_since_epoch ()).count ();
+}
+
+FrameScheduler::FrameScheduler (GpuDevice *gpu_device, uint32_t frames_in_flight, FramePacingPolicy frame_policy) :
+	device (gpu_device),
+	frame_slots (1),
+	policy (frame_policy),
+	clock (GetSteadyNanoseconds),
+	slot (0),
+	frame_number (0),
+	next_fence_value (device->GetCompletedFenceValue () + 1),
+	last_signaled_value (next_fence_value - 1),
+	in_frame (false)
+{
+	memset (slots, 0, sizeof (slots));
+	ResetStats ();
+	SetFramesInFlight (frames_in_flight);
+}
+
+FrameScheduler::~FrameScheduler ()
+{
+	//run pending releases without touching the GPU, the owner waits for idle before destruction
+	for (auto &release : releases)
+		release.second ();
+}
+
+void FrameScheduler::SetFramesInFlight (uint32_t frames_in_flight)
+{
+	if (frames_in_flight < 1 || frames_in_flight > max_frames_in_flight)
+		throw std::out_of_range ("Frames in flight must be between 1 and 4");
+	if (frames_in_flight == frame_slots)
+		return;
+	WaitForIdle ();
+	frame_slots = frames_in_flight;
+	slot = static_cast<uint32_t>(frame_number % frame_slots);
+}
+
+void FrameScheduler::SetClock (std::function<uint64_t ()> clock_function)
+{
+	clock = clock_function ? clock_function : GetSteadyNanoseconds;
+}
+
+uint32_t FrameScheduler::BeginFrame ()
+{
+	if (in_frame)
+		throw std::logic_error ("BeginFrame is called twice without EndFrame");
+	frame_number++;
+	slot = static_cast<uint32_t>(frame_number % frame_slots);
+
+	//the slot is free once the frame that used it last is finished, which the wait retires
+	uint64_t wait_value = slots[slot].fence_value;
+	if (policy == FRAME_POLICY_LOW_LATENCY && last_signaled_value > 0)
+		wait_value = std::max (wait_value, last_signaled_value - 1);
+	Wait (wait_value);
+	ProcessReleases ();
+
+	in_frame = true;
+	slots[slot].fence_value = 0;
+	slots[slot].begin_time = clock ();
+	slots[slot].pending = true;
+	stats.frames++;
+	return slot;
+}
+
+uint64_t FrameScheduler::EndFrame ()
+{
+	if (!in_frame)
+		throw std::logic_error ("EndFrame is called without BeginFrame");
+	in_frame = false;
+	const uint64_t value = next_fence_value++;
+	device->Signal (value);
+	slots[slot].fence_value = value;
+	last_signaled_value = value;
+	return value;
+}
+
+void FrameScheduler::WaitForIdle ()
+{
+	//work submitted inside an open frame is covered by an extra signal
+	const uint64_t value = next_fence_value++;
+	device->Signal (value);
+	last_signaled_value = value;
+	device->WaitForFenceValue (value);
+	RetireFrames (value);
+	ProcessReleases ();
+}
+
+uint64_t FrameScheduler::GetCompletedFenceValue ()
+{
+	const uint64_t completed = device->GetCompletedFenceValue ();
+	RetireFrames (completed);
+	return completed;
+}
+
+void FrameScheduler::DeferRelease (std::function<void ()> release)
+{
+	//the current frame signals next_fence_value; outside a frame the next frame does
+	DeferRelease (next_fence_value, std::move (release));
+}
+
+void FrameScheduler::DeferRelease (uint64_t fence_value, std::function<void ()> release)
+{
+	if (fence_value <= device->GetCompletedFenceValue ())
+	{
+		release ();
+		stats.releases++;
+		return;
+	}
+	//keep the queue ordered by fence value so retirement can stop at the first pending entry
+	auto position = std::upper_bound (releases.begin (), releases.end (), fence_value,
+									  [] (uint64_t value, const std::pair<uint64_t, std::function<void ()>> &entry)
+	{
+		return value < entry.first;
+	});
+	releases.insert (position, std::make_pair (fence_value, std::move (release)));
+}
+
+void FrameScheduler::ProcessReleases ()
+{
+	if (releases.empty ())
+		return;
+	const uint64_t completed = GetCompletedFenceValue ();
+	while (!releases.empty () && releases.front ().first <= completed)
+	{
+		std::function<void ()> release = std::move (releases.front ().second);
+		releases.pop_front ();
+		release ();
+		stats.releases++;
+	}
+}
+
+void FrameScheduler::ResetStats ()
+{
+	memset (&stats, 0, sizeof (stats));
+}
+
+void FrameScheduler::Wait (uint64_t fence_value)
+{
+	if (fence_value == 0)
+		return;
+	uint64_t completed = device->GetCompletedFenceValue ();
+	if (completed < fence_value)
+	{
+		const uint64_t begin = clock ();
+		device->WaitForFenceValue (fence_value);
+		const uint64_t stall = clock () - begin;
+		stats.stalls++;
+		stats.stall_ns += stall;
+		stats.max_stall_ns = std::max (stats.max_stall_ns, stall);
+		completed = fence_value;
+	}
+	RetireFrames (completed);
+}
+
+void FrameScheduler::RetireFrames (uint64_t completed_value)
+{
+	uint64_t now = 0;
+	for (uint32_t i = 0; i < max_frames_in_flight; i++)
+	{
+		Slot &frame_slot = slots[i];
+		//the open frame has no fence value until EndFrame ()
+		if (!frame_slot.pending || frame_slot.fence_value == 0 || frame_slot.fence_value > completed_value)
+			continue;
+		if (!now)
+			now = clock ();
+		const uint64_t latency = now - frame_slot.begin_time;
+		frame_slot.pending = false;
+		stats.completed_frames++;
+		stats.total_latency_ns += latency;
+		stats.max_latency_ns = std::max (stats.max_latency_ns, latency);
+	}
+}
@@ -0,0 +1,114 @@
+#pragma once
+#include "gpu_device.h"
+
+#include <stdint.h>
+
+#include <deque>
+#include <functional>
+#include <utility>
+
+//Frames-in-flight scheduler on the single monotonically increasing queue fence of a
+//GpuDevice. Every frame owns one of GetFramesInFlight () resource slots; BeginFrame ()
+//waits until the slot is free again and runs deferred releases whose fence passed.
+
+static const uint32_t max_frames_in_flight = 4;
+
+enum FramePacingPolicy
+{
+	FRAME_POLICY_MAX_THROUGHPUT,    //the CPU may run ahead until every slot is busy
+	FRAME_POLICY_LOW_LATENCY        //the CPU never runs more than one submitted frame ahead of the GPU
+};
+
+struct FrameSchedulerStats
+{
+	uint64_t frames;
+	uint64_t stalls;
+	uint64_t stall_ns;              //time spent waiting in BeginFrame ()
+	uint64_t max_stall_ns;
+	uint64_t completed_frames;
+	uint64_t total_latency_ns;      //BeginFrame () to observed fence completion, summed over completed frames
+	uint64_t max_latency_ns;
+	uint64_t releases;
+};
+
+class FrameScheduler
+{
+public:
+	FrameScheduler (GpuDevice *device, uint32_t frames_in_flight, FramePacingPolicy policy);
+	~FrameScheduler ();
+
+	//waits for the GPU to go idle before changing the number of slots
+	void SetFramesInFlight (uint32_t frames_in_flight);
+	uint32_t GetFramesInFlight () const
+	{
+		return frame_slots;
+	}
+	void SetPolicy (FramePacingPolicy frame_policy)
+	{
+		policy = frame_policy;
+	}
+	FramePacingPolicy GetPolicy () const
+	{
+		return policy;
+	}
+	//timestamps in nanoseconds; replace to measure against a simulated timeline
+	void SetClock (std::function<uint64_t ()> clock_function);
+
+	//waits for the slot of the next frame and returns its index
+	uint32_t BeginFrame ();
+	//signals the fence for everything submitted during the frame
+	uint64_t EndFrame ();
+	//signals and waits until all submitted work is finished, then runs every deferred release
+	void WaitForIdle ();
+
+	uint32_t GetSlot () const
+	{
+		return slot;
+	}
+	uint64_t GetFrameNumber () const
+	{
+		return frame_number;
+	}
+	//value the current frame signals in EndFrame ()
+	uint64_t GetFrameFenceValue () const
+	{
+		return next_fence_value;
+	}
+	uint64_t GetCompletedFenceValue ();
+
+	//runs the function once the GPU finished the current frame
+	void DeferRelease (std::function<void ()> release);
+	//runs the function once the fence reaches the value
+	void DeferRelease (uint64_t fence_value, std::function<void ()> release);
+	void ProcessReleases ();
+
+	const FrameSchedulerStats &GetStats () const
+	{
+		return stats;
+	}
+	void ResetStats ();
+private:
+	struct Slot
+	{
+		uint64_t fence_value;       //0 while the frame is open
+		uint64_t begin_time;
+		bool pending;
+	};
+
+	void Wait (uint64_t fence_value);
+	void RetireFrames (uint64_t completed_value);
+
+	GpuDevice *device;
+	uint32_t frame_slots;
+	FramePacingPolicy policy;
+	std::function<uint64_t ()> clock;
+
+	Slot slots[max_frames_in_flight];
+	uint32_t slot;
+	uint64_t frame_number;
+	uint64_t next_fence_value;
+	uint64_t last_signaled_value;
+	bool in_frame;
+	std::deque<std::pair<uint64_t, std::function<void ()>>> releases;
+	FrameSchedulerStats stats;
+};
@@ -9,6 +9,7 @@ Application::Application (int window_width, int window_height, const char *windo
 	try
 	{
 		InitLog ();
+		PROFILE_THREAD_NAME ("Main thread");
 		InitWindow (window_caption);
 	}
 	catch (std::exception err)
@@ -29,10 +30,13 @@ void Application::Run ()
 {
 	try
 	{
-		MSG msg;
+		MSG msg = {};
 		while (true)
 		{
-			if (PeekMessage (&msg, d3d12.hWnd, 0, 0, PM_REMOVE))
+			//the input of a frame is sampled once the swap chain takes it, so it is as recent as possible
+			if (!is_minimized)
+				d3d12.WaitForFrame ();
+			while (msg.message != WM_QUIT && PeekMessage (&msg, d3d12.hWnd, 0, 0, PM_REMOVE))
 			{
 				TranslateMessage (&msg);
 				DispatchMessage (&msg);
@@ -43,8 +47,12 @@ void Application::Run ()
 
 			if (!is_minimized)
 			{
-				d3d12.Update ();
-				d3d12.Render ();
+				{
+					PROFILE_SCOPE ("Frame");
+					d3d12.Update ();
+					d3d12.Render ();
+				}
+				PROFILE_END_FRAME ();
 			}
 		}
 	}
@@ -54,6 +62,33 @@ void Application::Run ()
 	}
 }
 
+void Application::ToggleProfiler ()
+{
+	#if ENABLE_PROFILER
+	Profiler &profiler = Profiler::Get ();
+	if (!profiler.IsEnabled ())
+	{
+		profiler.Clear ();
+		profiler.SetEnabled (true);
+		Log ("Profiler capture started");
+		return;
+	}
+	profiler.SetEnabled (false);
+
+	std::vector<ProfileZoneStats> stats;
+	profiler.GetZoneStats (stats);
+	Log ("Profiler capture finished, %u frames:", static_cast<unsigned>(profiler.GetFrameCount ()));
+	for (const ProfileZoneStats &zone : stats)
+		Log ("\t%s: min %.3f ms, avg %.3f ms, p99 %.3f ms, %u calls",
+			 zone.zone->name, zone.min_us / 1000.0, zone.avg_us / 1000.0, zone.p99_us / 1000.0, zone.calls);
+	d3d12.LogMemoryStats ();
+	if (profiler.ExportChromeTrace ("profile.json"))
+		Log ("Profiler trace saved to profile.json");
+	else
+		LogMessage (LOG_SEVERITY_WARNING, "Can not save profiler trace");
+	#endif
+}
+
 void Application::InitWindow (const char *caption)
 {
 	TCHAR WinName[] = _T ("Direct3D 12 Framework");
@@ -120,6 +155,18 @@ LRESULT CALLBACK Application::WndProc (HWND hWnd, UINT msg, WPARAM wParam, LPARA
 	case WM_KEYDOWN:
 		if (wParam == VK_ESCAPE)
 			PostQuitMessage (0);
+		else if (wParam == VK_F9 && app)
+			app->ToggleProfiler ();
+		else if (wParam == VK_F5 && app)
+			app->d3d12.SetFrameLatency (app->d3d12.GetFramesInFlight () % max_frames_in_flight + 1,
+										app->d3d12.GetFramePolicy ());
+		else if (wParam == VK_F6 && app)
+			app->d3d12.SetFrameLatency (app->d3d12.GetFramesInFlight (),
+										app->d3d12.GetFramePolicy () == FRAME_POLICY_LOW_LATENCY ?
+										FRAME_POLICY_MAX_THROUGHPUT : FRAME_POLICY_LOW_LATENCY);
+		else if (wParam == VK_F7 && app)
+			app->d3d12.SetPresentMode (static_cast<PresentMode>((app->d3d12.GetPresentMode () + 1) % (PRESENT_MODE_CAPPED + 1)),
+									   app->d3d12.GetFpsCap ());
 		break;
 	case WM_SIZE:
 		if (app)
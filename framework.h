@@ -14,6 +14,7 @@ public:
 	bool is_minimized;
 private:
 	void InitWindow (const char *caption);
+	void ToggleProfiler ();
 
 	static LRESULT CALLBACK WndProc (HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam);
 };
\ No newline at end of file
@@ -0,0 +1,249 @@
+#pragma once
+#include <stdint.h>
+
+#include <memory>
+
+//Thin backend-neutral device and command list interface used for frame construction.
+//Handles, structures and enum values mirror their D3D12 counterparts so the D3D12
+//backend passes them through without translation; the null backend (null_device.h)
+//records them into a compact in-memory stream instead.
+
+//D3D12 backend: the interface pointer / descriptor pointer; null backend: an id
+typedef uint64_t GpuResourceHandle;
+typedef uint64_t GpuPipelineHandle;
+typedef uint64_t GpuRootSignatureHandle;
+typedef uint64_t GpuDescriptorHandle;
+typedef uint64_t GpuShaderDescriptorHandle;    //D3D12_GPU_DESCRIPTOR_HANDLE of a shader visible heap
+typedef uint64_t GpuDescriptorHeapHandle;
+typedef uint64_t GpuVirtualAddress;
+typedef uint64_t GpuCommandSignatureHandle;
+
+//mirrors D3D12_RESOURCE_STATES
+typedef uint32_t GpuResourceStates;
+enum GpuResourceState
+{
+	GPU_RESOURCE_STATE_COMMON = 0,
+	GPU_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER = 0x1,
+	GPU_RESOURCE_STATE_INDEX_BUFFER = 0x2,
+	GPU_RESOURCE_STATE_RENDER_TARGET = 0x4,
+	GPU_RESOURCE_STATE_UNORDERED_ACCESS = 0x8,
+	GPU_RESOURCE_STATE_DEPTH_WRITE = 0x10,
+	GPU_RESOURCE_STATE_DEPTH_READ = 0x20,
+	GPU_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE = 0x40,
+	GPU_RESOURCE_STATE_PIXEL_SHADER_RESOURCE = 0x80,
+	GPU_RESOURCE_STATE_STREAM_OUT = 0x100,
+	GPU_RESOURCE_STATE_INDIRECT_ARGUMENT = 0x200,
+	GPU_RESOURCE_STATE_COPY_DEST = 0x400,
+	GPU_RESOURCE_STATE_COPY_SOURCE = 0x800,
+	GPU_RESOURCE_STATE_RESOLVE_DEST = 0x1000,
+	GPU_RESOURCE_STATE_RESOLVE_SOURCE = 0x2000,
+	GPU_RESOURCE_STATE_GENERIC_READ = 0xac3,
+	GPU_RESOURCE_STATE_PRESENT = 0
+};
+
+//read-only states, they can be combined and used together without barriers
+static const GpuResourceStates gpu_read_only_states = GPU_RESOURCE_STATE_GENERIC_READ |
+													  GPU_RESOURCE_STATE_DEPTH_READ |
+													  GPU_RESOURCE_STATE_RESOLVE_SOURCE;
+
+//mirrors D3D12_RESOURCE_BARRIER_FLAGS
+enum GpuBarrierFlags
+{
+	GPU_BARRIER_FLAG_NONE = 0,
+	GPU_BARRIER_FLAG_BEGIN_ONLY = 0x1,
+	GPU_BARRIER_FLAG_END_ONLY = 0x2
+};
+
+//mirrors D3D12_RESOURCE_BARRIER_TYPE
+enum GpuBarrierType
+{
+	GPU_BARRIER_TYPE_TRANSITION = 0,
+	GPU_BARRIER_TYPE_ALIASING = 1,
+	GPU_BARRIER_TYPE_UAV = 2
+};
+
+static const uint32_t gpu_all_subresources = 0xffffffff;
+
+//mirrors D3D12_RESOURCE_FLAGS
+enum GpuResourceFlags
+{
+	GPU_RESOURCE_FLAG_NONE = 0,
+	GPU_RESOURCE_FLAG_ALLOW_RENDER_TARGET = 0x1,
+	GPU_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL = 0x2,
+	GPU_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS = 0x4
+};
+
+//mirrors D3D12_DESCRIPTOR_HEAP_TYPE
+enum GpuDescriptorHeapType
+{
+	GPU_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV = 0,
+	GPU_DESCRIPTOR_HEAP_TYPE_SAMPLER = 1,
+	GPU_DESCRIPTOR_HEAP_TYPE_RTV = 2,
+	GPU_DESCRIPTOR_HEAP_TYPE_DSV = 3,
+	GPU_DESCRIPTOR_HEAP_TYPE_COUNT
+};
+
+//mirrors D3D_PRIMITIVE_TOPOLOGY
+enum GpuPrimitiveTopology
+{
+	GPU_PRIMITIVE_TOPOLOGY_UNDEFINED = 0,
+	GPU_PRIMITIVE_TOPOLOGY_POINTLIST = 1,
+	GPU_PRIMITIVE_TOPOLOGY_LINELIST = 2,
+	GPU_PRIMITIVE_TOPOLOGY_LINESTRIP = 3,
+	GPU_PRIMITIVE_TOPOLOGY_TRIANGLELIST = 4,
+	GPU_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP = 5
+};
+
+//transition barrier; aliasing barriers use resource as the resource after and
+//resource_before (0 for any placed resource), UAV barriers only resource
+struct GpuBarrier
+{
+	GpuResourceHandle resource;
+	uint32_t subresource;
+	GpuResourceStates state_before;
+	GpuResourceStates state_after;
+	uint32_t flags;
+	uint32_t type;
+	GpuResourceHandle resource_before;
+};
+
+//same layout as D3D12_VIEWPORT
+struct GpuViewport
+{
+	float top_left_x;
+	float top_left_y;
+	float width;
+	float height;
+	float min_depth;
+	float max_depth;
+};
+
+//same layout as D3D12_RECT
+struct GpuRect
+{
+	int32_t left;
+	int32_t top;
+	int32_t right;
+	int32_t bottom;
+};
+
+//same layout as D3D12_VERTEX_BUFFER_VIEW
+struct GpuVertexBufferView
+{
+	GpuVirtualAddress location;
+	uint32_t size;
+	uint32_t stride;
+};
+
+//same layout as D3D12_INDEX_BUFFER_VIEW
+struct GpuIndexBufferView
+{
+	GpuVirtualAddress location;
+	uint32_t size;
+	uint32_t format;    //DXGI_FORMAT_R16_UINT or DXGI_FORMAT_R32_UINT
+};
+
+//same layout as D3D12_DRAW_ARGUMENTS
+struct GpuDrawArguments
+{
+	uint32_t vertex_count;
+	uint32_t instance_count;
+	uint32_t start_vertex;
+	uint32_t start_instance;
+};
+
+//same layout as D3D12_DRAW_INDEXED_ARGUMENTS
+struct GpuDrawIndexedArguments
+{
+	uint32_t index_count;
+	uint32_t instance_count;
+	uint32_t start_index;
+	int32_t base_vertex;
+	uint32_t start_instance;
+};
+
+//same layout as D3D12_PLACED_SUBRESOURCE_FOOTPRINT: subresource data at offset of a
+//buffer, offset and row_pitch aligned as D3D12 texture copies require
+struct GpuTextureFootprint
+{
+	uint64_t offset;
+	uint32_t format;    //DXGI_FORMAT value
+	uint32_t width;
+	uint32_t height;
+	uint32_t depth;
+	uint32_t row_pitch;
+};
+
+class GpuCommandAllocator
+{
+public:
+	virtual ~GpuCommandAllocator () {}
+	//must only be called once the GPU finished every list recorded from this allocator
+	virtual void Reset () = 0;
+};
+
+class GpuCommandList
+{
+public:
+	virtual ~GpuCommandList () {}
+	virtual void Reset (GpuCommandAllocator *allocator, GpuPipelineHandle initial_state) = 0;
+	virtual void Close () = 0;
+
+	virtual void SetPipelineState (GpuPipelineHandle pipeline_state) = 0;
+	virtual void SetGraphicsRootSignature (GpuRootSignatureHandle root_signature) = 0;
+	virtual void SetGraphicsRoot32BitConstants (uint32_t root_parameter, uint32_t count, const void *values, uint32_t dest_offset) = 0;
+	//shader visible heaps, at most one per type; tables are set after the heaps they are in
+	virtual void SetDescriptorHeaps (uint32_t count, const GpuDescriptorHeapHandle *heaps) = 0;
+	virtual void SetGraphicsRootDescriptorTable (uint32_t root_parameter, GpuShaderDescriptorHandle table) = 0;
+	virtual void SetPrimitiveTopology (GpuPrimitiveTopology topology) = 0;
+	virtual void SetViewports (uint32_t count, const GpuViewport *viewports) = 0;
+	virtual void SetScissorRects (uint32_t count, const GpuRect *rects) = 0;
+	virtual void SetRenderTargets (uint32_t count, const GpuDescriptorHandle *render_targets, const GpuDescriptorHandle *depth_stencil) = 0;
+	virtual void SetVertexBuffers (uint32_t start_slot, uint32_t count, const GpuVertexBufferView *views) = 0;
+	virtual void SetIndexBuffer (const GpuIndexBufferView *view) = 0;
+	virtual void ResourceBarrier (uint32_t count, const GpuBarrier *barriers) = 0;
+
+	virtual void ClearRenderTargetView (GpuDescriptorHandle render_target, const float color[4]) = 0;
+	virtual void DrawInstanced (uint32_t vertex_count, uint32_t instance_count, uint32_t start_vertex, uint32_t start_instance) = 0;
+	virtual void DrawIndexedInstanced (uint32_t index_count, uint32_t instance_count, uint32_t start_index, int32_t base_vertex, uint32_t start_instance) = 0;
+	//count_buffer may be 0, then max_command_count commands are executed
+	virtual void ExecuteIndirect (GpuCommandSignatureHandle command_signature, uint32_t max_command_count, GpuResourceHandle arguments,
+								  uint64_t arguments_offset, GpuResourceHandle count_buffer, uint64_t count_offset) = 0;
+	virtual void CopyBufferRegion (GpuResourceHandle dst, uint64_t dst_offset, GpuResourceHandle src, uint64_t src_offset, uint64_t size) = 0;
+	//copies a whole subresource from a buffer
+	virtual void CopyBufferToTexture (GpuResourceHandle dst, uint32_t dst_subresource, GpuResourceHandle src, const GpuTextureFootprint &footprint) = 0;
+};
+
+//a command queue of the device and its fence; copy queues are separate instances
+class GpuDevice
+{
+public:
+	virtual ~GpuDevice () {}
+	virtual std::unique_ptr<GpuCommandAllocator> CreateCommandAllocator () = 0;
+	virtual std::unique_ptr<GpuCommandList> CreateCommandList (GpuCommandAllocator *allocator) = 0;
+	virtual void ExecuteCommandLists (uint32_t count, GpuCommandList *const *command_lists) = 0;
+
+	//queues a fence signal with the given value after all previously executed work
+	virtual void Signal (uint64_t value) = 0;
+	virtual uint64_t GetCompletedFenceValue () = 0;
+	//blocks the calling thread until the fence reaches the value
+	virtual void WaitForFenceValue (uint64_t value) = 0;
+	//work executed after the call starts once the fence of the other queue reaches the
+	//value; the wait happens on the GPU, the calling thread does not block
+	virtual void WaitForQueue (GpuDevice *queue, uint64_t value) = 0;
+};
+
+//helper transition barrier
+inline GpuBarrier GpuTransition (GpuResourceHandle resource, GpuResourceStates before, GpuResourceStates after,
+								 uint32_t subresource = gpu_all_subresources)
+{
+	GpuBarrier barrier = { resource, subresource, before, after, GPU_BARRIER_FLAG_NONE, GPU_BARRIER_TYPE_TRANSITION, 0 };
+	return barrier;
+}
+
+//helper aliasing barrier between placed resources sharing memory
+inline GpuBarrier GpuAliasing (GpuResourceHandle resource_before, GpuResourceHandle resource_after)
+{
+	GpuBarrier barrier = { resource_after, gpu_all_subresources, 0, 0, GPU_BARRIER_FLAG_NONE, GPU_BARRIER_TYPE_ALIASING, resource_before };
+	return barrier;
+}
@@ -0,0 +1,488 @@
+#include "gpu_memory.h"
+
+#include <string.h>
+#include <algorithm>
+#include <stdexcept>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+static uint32_t FindLastSet (uint64_t value)
+{
+	#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+	unsigned long index;
+	_BitScanReverse64 (&index, value);
+	return index;
+	#elif defined(_MSC_VER)
+	unsigned long index;
+	if (_BitScanReverse (&index, static_cast<unsigned long>(value >> 32)))
+		return index + 32;
+	_BitScanReverse (&index, static_cast<unsigned long>(value));
+	return index;
+	#else
+	return 63 - __builtin_clzll (value);
+	#endif
+}
+
+static uint32_t FindFirstSet (uint64_t value)
+{
+	#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+	unsigned long index;
+	_BitScanForward64 (&index, value);
+	return index;
+	#elif defined(_MSC_VER)
+	unsigned long index;
+	if (_BitScanForward (&index, static_cast<unsigned long>(value)))
+		return index;
+	_BitScanForward (&index, static_cast<unsigned long>(value >> 32));
+	return index + 32;
+	#else
+	return __builtin_ctzll (value);
+	#endif
+}
+
+static uint64_t AlignUp (uint64_t value, uint64_t alignment)
+{
+	return (value + alignment - 1) & ~(alignment - 1);
+}
+
+static bool IsPowerOfTwo (uint64_t value)
+{
+	return value && !(value & (value - 1));
+}
+
+TlsfAllocator::TlsfAllocator (uint64_t heap_size, uint64_t heap_granularity) :
+	size (heap_size),
+	granularity (heap_granularity),
+	used_size (0),
+	allocation_count (0),
+	fl_bitmap (0)
+{
+	if (!IsPowerOfTwo (granularity))
+		throw std::invalid_argument ("Allocator granularity must be a power of two");
+	if (!size || size % granularity)
+		throw std::invalid_argument ("Allocator size must be a multiple of its granularity");
+	granularity_log2 = FindLastSet (granularity);
+	memset (sl_bitmap, 0, sizeof (sl_bitmap));
+	memset (free_heads, 0xFF, sizeof (free_heads));
+
+	//block 0 always starts at offset 0, merges keep the lower block
+	const uint32_t block = NewBlock ();
+	blocks[block].offset = 0;
+	blocks[block].size = size;
+	InsertFreeBlock (block);
+}
+
+bool TlsfAllocator::Allocate (uint64_t allocation_size, uint64_t alignment, uint64_t user_data, TlsfAllocation &allocation)
+{
+	if (!IsPowerOfTwo (alignment))
+		throw std::invalid_argument ("Alignment must be a power of two");
+	const uint64_t units = allocation_size ? (allocation_size + granularity - 1) >> granularity_log2 : 1;
+	const uint64_t align = std::max (alignment, granularity);
+	if (units > (size >> granularity_log2))
+		return false;
+
+	uint32_t block = FindFreeBlock (units, align);
+	if (block == invalid_block)
+		return false;
+	RemoveFreeBlock (block);
+
+	const uint64_t padding = AlignUp (blocks[block].offset, align) - blocks[block].offset;
+	if (padding)
+	{
+		const uint32_t rest = Split (block, padding);
+		InsertFreeBlock (block);
+		block = rest;
+	}
+	const uint64_t bytes = units << granularity_log2;
+	if (blocks[block].size > bytes)
+		InsertFreeBlock (Split (block, bytes));
+
+	Block &used = blocks[block];
+	used.is_free = false;
+	used.user_data = user_data;
+	used_size += used.size;
+	allocation_count++;
+
+	allocation.offset = used.offset;
+	allocation.size = used.size;
+	allocation.block = block;
+	return true;
+}
+
+void TlsfAllocator::Free (uint32_t block)
+{
+	if (block >= blocks.size () || blocks[block].is_free)
+		throw std::logic_error ("Block is not allocated");
+	blocks[block].is_free = true;
+	used_size -= blocks[block].size;
+	allocation_count--;
+
+	const uint32_t next = blocks[block].next_physical;
+	if (next != invalid_block && blocks[next].is_free)
+	{
+		RemoveFreeBlock (next);
+		blocks[block].size += blocks[next].size;
+		blocks[block].next_physical = blocks[next].next_physical;
+		if (blocks[block].next_physical != invalid_block)
+			blocks[blocks[block].next_physical].prev_physical = block;
+		DeleteBlock (next);
+	}
+	const uint32_t prev = blocks[block].prev_physical;
+	if (prev != invalid_block && blocks[prev].is_free)
+	{
+		RemoveFreeBlock (prev);
+		blocks[prev].size += blocks[block].size;
+		blocks[prev].next_physical = blocks[block].next_physical;
+		if (blocks[prev].next_physical != invalid_block)
+			blocks[blocks[prev].next_physical].prev_physical = prev;
+		DeleteBlock (block);
+		block = prev;
+	}
+	InsertFreeBlock (block);
+}
+
+uint64_t TlsfAllocator::GetLargestFreeBlock () const
+{
+	if (!fl_bitmap)
+		return 0;
+	const uint32_t fl = FindLastSet (fl_bitmap);
+	const uint32_t sl = FindLastSet (sl_bitmap[fl]);
+	uint64_t largest = 0;
+	for (uint32_t block = free_heads[fl][sl]; block != invalid_block; block = blocks[block].next_free)
+		largest = std::max (largest, blocks[block].size);
+	return largest;
+}
+
+void TlsfAllocator::GetAllocations (std::vector<TlsfAllocation> &allocations) const
+{
+	allocations.clear ();
+	for (uint32_t block = 0; block != invalid_block; block = blocks[block].next_physical)
+		if (!blocks[block].is_free)
+		{
+			TlsfAllocation allocation = { blocks[block].offset, blocks[block].size, block };
+			allocations.push_back (allocation);
+		}
+}
+
+void TlsfAllocator::Mapping (uint64_t units, uint32_t &fl, uint32_t &sl) const
+{
+	if (units < sl_count)
+	{
+		fl = 0;
+		sl = static_cast<uint32_t>(units);
+		return;
+	}
+	const uint32_t last = FindLastSet (units);
+	sl = static_cast<uint32_t>(units >> (last - sl_count_log2)) ^ sl_count;
+	fl = last - sl_count_log2 + 1;
+}
+
+uint32_t TlsfAllocator::FindFreeBlock (uint64_t units, uint64_t alignment) const
+{
+	//any block of the size plus worst case padding fits; round up to the next class so
+	//that every block found in it is large enough
+	uint64_t search = units + ((alignment - granularity) >> granularity_log2);
+	if (search >= sl_count)
+		search += (uint64_t (1) << (FindLastSet (search) - sl_count_log2)) - 1;
+	uint32_t search_fl, search_sl;
+	Mapping (search, search_fl, search_sl);
+	if (search_fl < fl_count)
+	{
+		uint32_t sl_map = sl_bitmap[search_fl] & (~0u << search_sl);
+		uint64_t fl_map = search_fl + 1 < fl_count ? fl_bitmap & (~uint64_t (0) << (search_fl + 1)) : 0;
+		if (sl_map)
+			return free_heads[search_fl][FindFirstSet (sl_map)];
+		if (fl_map)
+		{
+			const uint32_t fl = FindFirstSet (fl_map);
+			return free_heads[fl][FindFirstSet (sl_bitmap[fl])];
+		}
+	}
+
+	//the classes from the exact size up to the searched one may still hold a block that
+	//fits with the padding it needs, e.g. an aligned block of exactly the size
+	uint32_t fl, sl;
+	Mapping (units, fl, sl);
+	const uint64_t bytes = units << granularity_log2;
+	while (fl < fl_count && (fl < search_fl || (fl == search_fl && sl < search_sl)))
+	{
+		for (uint32_t block = free_heads[fl][sl]; block != invalid_block; block = blocks[block].next_free)
+		{
+			const uint64_t padding = AlignUp (blocks[block].offset, alignment) - blocks[block].offset;
+			if (blocks[block].size >= bytes + padding)
+				return block;
+		}
+		if (++sl == sl_count)
+		{
+			sl = 0;
+			fl++;
+		}
+	}
+	return invalid_block;
+}
+
+void TlsfAllocator::InsertFreeBlock (uint32_t block)
+{
+	uint32_t fl, sl;
+	Mapping (blocks[block].size >> granularity_log2, fl, sl);
+	const uint32_t head = free_heads[fl][sl];
+	blocks[block].is_free = true;
+	blocks[block].prev_free = invalid_block;
+	blocks[block].next_free = head;
+	if (head != invalid_block)
+		blocks[head].prev_free = block;
+	free_heads[fl][sl] = block;
+	fl_bitmap |= uint64_t (1) << fl;
+	sl_bitmap[fl] |= 1u << sl;
+}
+
+void TlsfAllocator::RemoveFreeBlock (uint32_t block)
+{
+	uint32_t fl, sl;
+	Mapping (blocks[block].size >> granularity_log2, fl, sl);
+	const uint32_t prev = blocks[block].prev_free;
+	const uint32_t next = blocks[block].next_free;
+	if (prev != invalid_block)
+		blocks[prev].next_free = next;
+	else
+		free_heads[fl][sl] = next;
+	if (next != invalid_block)
+		blocks[next].prev_free = prev;
+
+	if (free_heads[fl][sl] == invalid_block)
+	{
+		sl_bitmap[fl] &= ~(1u << sl);
+		if (!sl_bitmap[fl])
+			fl_bitmap &= ~(uint64_t (1) << fl);
+	}
+}
+
+uint32_t TlsfAllocator::NewBlock ()
+{
+	uint32_t block;
+	if (!unused_blocks.empty ())
+	{
+		block = unused_blocks.back ();
+		unused_blocks.pop_back ();
+	}
+	else
+	{
+		block = static_cast<uint32_t>(blocks.size ());
+		blocks.push_back (Block ());
+	}
+	Block &new_block = blocks[block];
+	new_block.offset = 0;
+	new_block.size = 0;
+	new_block.user_data = 0;
+	new_block.prev_physical = new_block.next_physical = invalid_block;
+	new_block.prev_free = new_block.next_free = invalid_block;
+	new_block.is_free = true;
+	return block;
+}
+
+void TlsfAllocator::DeleteBlock (uint32_t block)
+{
+	blocks[block].is_free = true;
+	blocks[block].size = 0;
+	unused_blocks.push_back (block);
+}
+
+uint32_t TlsfAllocator::Split (uint32_t block, uint64_t front_size)
+{
+	const uint32_t rest = NewBlock ();
+	blocks[rest].offset = blocks[block].offset + front_size;
+	blocks[rest].size = blocks[block].size - front_size;
+	blocks[rest].prev_physical = block;
+	blocks[rest].next_physical = blocks[block].next_physical;
+	if (blocks[rest].next_physical != invalid_block)
+		blocks[blocks[rest].next_physical].prev_physical = rest;
+	blocks[block].size = front_size;
+	blocks[block].next_physical = rest;
+	return rest;
+}
+
+GpuMemoryAllocator::GpuMemoryAllocator (GpuHeapBackend *heap_backend, uint64_t heap_bytes) :
+	backend (heap_backend),
+	heap_size (AlignUp (heap_bytes, gpu_default_placement_alignment))
+{
+}
+
+GpuMemoryAllocator::~GpuMemoryAllocator ()
+{
+	for (auto &tier_heaps : heaps)
+		for (Heap &heap : tier_heaps)
+			if (heap.allocator)
+				DestroyHeap (heap);
+}
+
+GpuMemoryAllocation GpuMemoryAllocator::Allocate (GpuHeapTier tier, uint64_t size, uint64_t alignment, uint64_t user_data)
+{
+	std::lock_guard<std::mutex> lock (mutex);
+	GpuMemoryAllocation allocation;
+	if (size > heap_size)
+	{
+		const uint32_t heap_index = CreateHeap (tier, AlignUp (size, gpu_default_placement_alignment), true);
+		if (!AllocateFrom (tier, heap_index, size, alignment, user_data, allocation))
+			throw std::runtime_error ("Can not allocate from a dedicated GPU heap");
+		return allocation;
+	}
+
+	//first fit over the heaps keeps the later ones free to be released
+	std::vector<Heap> &tier_heaps = heaps[tier];
+	for (uint32_t i = 0; i < tier_heaps.size (); i++)
+		if (tier_heaps[i].allocator && !tier_heaps[i].dedicated &&
+			AllocateFrom (tier, i, size, alignment, user_data, allocation))
+			return allocation;
+
+	const uint32_t heap_index = CreateHeap (tier, heap_size, false);
+	if (!AllocateFrom (tier, heap_index, size, alignment, user_data, allocation))
+		throw std::runtime_error ("Can not allocate from a new GPU heap");
+	return allocation;
+}
+
+void GpuMemoryAllocator::Free (const GpuMemoryAllocation &allocation)
+{
+	std::lock_guard<std::mutex> lock (mutex);
+	if (allocation.tier >= GPU_HEAP_TIER_COUNT || allocation.heap_index >= heaps[allocation.tier].size ())
+		throw std::logic_error ("GPU allocation does not belong to the allocator");
+	Heap &heap = heaps[allocation.tier][allocation.heap_index];
+	if (!heap.allocator || heap.handle != allocation.heap)
+		throw std::logic_error ("GPU allocation does not belong to the allocator");
+	heap.allocator->Free (allocation.block);
+	if (heap.dedicated)
+		DestroyHeap (heap);
+}
+
+void GpuMemoryAllocator::ReleaseEmptyHeaps ()
+{
+	std::lock_guard<std::mutex> lock (mutex);
+	for (auto &tier_heaps : heaps)
+	{
+		bool kept = false;
+		for (Heap &heap : tier_heaps)
+			if (heap.allocator && !heap.allocator->GetAllocationCount ())
+			{
+				if (kept)
+					DestroyHeap (heap);
+				kept = true;
+			}
+	}
+}
+
+GpuMemoryStats GpuMemoryAllocator::GetStats (GpuHeapTier tier) const
+{
+	std::lock_guard<std::mutex> lock (mutex);
+	GpuMemoryStats stats = {};
+	uint64_t largest_free_in_heaps = 0;
+	for (const Heap &heap : heaps[tier])
+		if (heap.allocator)
+		{
+			stats.heap_count++;
+			stats.allocation_count += heap.allocator->GetAllocationCount ();
+			stats.reserved_bytes += heap.allocator->GetSize ();
+			stats.used_bytes += heap.allocator->GetUsedSize ();
+			largest_free_in_heaps = std::max (largest_free_in_heaps, heap.allocator->GetLargestFreeBlock ());
+		}
+	stats.largest_free_block = largest_free_in_heaps;
+	const uint64_t free_bytes = stats.reserved_bytes - stats.used_bytes;
+	stats.fragmentation = free_bytes ? 1.0 - static_cast<double>(largest_free_in_heaps) / free_bytes : 0.0;
+	return stats;
+}
+
+size_t GpuMemoryAllocator::Defragment (GpuHeapTier tier, uint64_t max_bytes, std::vector<GpuMemoryMove> &moves)
+{
+	std::lock_guard<std::mutex> lock (mutex);
+	std::vector<Heap> &tier_heaps = heaps[tier];
+	std::vector<uint32_t> order;
+	for (uint32_t i = 0; i < tier_heaps.size (); i++)
+		if (tier_heaps[i].allocator && !tier_heaps[i].dedicated && tier_heaps[i].allocator->GetAllocationCount ())
+			order.push_back (i);
+	std::sort (order.begin (), order.end (), [&] (uint32_t a, uint32_t b)
+	{
+		return tier_heaps[a].allocator->GetUsedSize () < tier_heaps[b].allocator->GetUsedSize ();
+	});
+
+	const size_t first_move = moves.size ();
+	uint64_t moved_bytes = 0;
+	std::vector<TlsfAllocation> allocations;
+	for (size_t source = 0; source < order.size (); source++)
+	{
+		const uint32_t src_index = order[source];
+		tier_heaps[src_index].allocator->GetAllocations (allocations);
+		//move from the end of the heap first so the space frees up in one piece
+		for (auto it = allocations.rbegin (); it != allocations.rend (); ++it)
+		{
+			if (moved_bytes + it->size > max_bytes)
+				return moves.size () - first_move;
+
+			GpuMemoryMove move;
+			move.user_data = tier_heaps[src_index].allocator->GetUserData (it->block);
+			move.src.heap = tier_heaps[src_index].handle;
+			move.src.offset = it->offset;
+			move.src.size = it->size;
+			move.src.tier = tier;
+			move.src.heap_index = src_index;
+			move.src.block = it->block;
+
+			//the original alignment is not stored, the offset is aligned at least as much
+			const uint64_t alignment = it->offset ? std::min (it->offset & (~it->offset + 1), gpu_default_placement_alignment) :
+				gpu_default_placement_alignment;
+
+			bool placed = false;
+			for (size_t target = order.size () - 1; target > source && !placed; target--)
+				placed = AllocateFrom (tier, order[target], it->size, alignment, move.user_data, move.dst);
+			if (!placed && AllocateFrom (tier, src_index, it->size, alignment, move.user_data, move.dst))
+			{
+				placed = move.dst.offset < move.src.offset;
+				if (!placed)
+					tier_heaps[src_index].allocator->Free (move.dst.block);
+			}
+			if (!placed)
+				continue;
+			moves.push_back (move);
+			moved_bytes += it->size;
+		}
+	}
+	return moves.size () - first_move;
+}
+
+uint32_t GpuMemoryAllocator::CreateHeap (GpuHeapTier tier, uint64_t heap_bytes, bool dedicated)
+{
+	std::vector<Heap> &tier_heaps = heaps[tier];
+	uint32_t index = 0;
+	while (index < tier_heaps.size () && tier_heaps[index].allocator)
+		index++;
+	if (index == tier_heaps.size ())
+		tier_heaps.push_back (Heap ());
+
+	Heap &heap = tier_heaps[index];
+	std::unique_ptr<TlsfAllocator> allocator (new TlsfAllocator (heap_bytes, gpu_small_placement_alignment));
+	heap.handle = backend->CreateHeap (tier, heap_bytes);
+	heap.allocator = std::move (allocator);
+	heap.dedicated = dedicated;
+	return index;
+}
+
+bool GpuMemoryAllocator::AllocateFrom (GpuHeapTier tier, uint32_t heap_index, uint64_t size, uint64_t alignment, uint64_t user_data, GpuMemoryAllocation &allocation)
+{
+	Heap &heap = heaps[tier][heap_index];
+	TlsfAllocation block;
+	if (!heap.allocator->Allocate (size, alignment, user_data, block))
+		return false;
+	allocation.heap = heap.handle;
+	allocation.offset = block.offset;
+	allocation.size = block.size;
+	allocation.tier = tier;
+	allocation.heap_index = heap_index;
+	allocation.block = block.block;
+	return true;
+}
+
+void GpuMemoryAllocator::DestroyHeap (Heap &heap)
+{
+	backend->DestroyHeap (heap.handle);
+	heap.handle = 0;
+	heap.allocator.reset ();
+}
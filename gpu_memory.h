@@ -0,0 +1,177 @@
+#pragma once
+#include <stdint.h>
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+//GPU memory sub-allocation. Large heaps are reserved per tier and resources are placed
+//into them by a TLSF allocator, so creating a resource does not cost a heap of its own.
+//The code only deals with offsets; the backend creates and destroys the real heaps.
+
+//Two-level segregated fit allocator over [0, size): O(1) allocation and free with
+//immediate coalescing of free neighbours
+struct TlsfAllocation
+{
+	uint64_t offset;
+	uint64_t size;
+	uint32_t block;
+};
+
+class TlsfAllocator
+{
+public:
+	//sizes and offsets are multiples of the granularity, a power of two
+	TlsfAllocator (uint64_t size, uint64_t granularity);
+
+	bool Allocate (uint64_t size, uint64_t alignment, uint64_t user_data, TlsfAllocation &allocation);
+	void Free (uint32_t block);
+
+	uint64_t GetSize () const
+	{
+		return size;
+	}
+	uint64_t GetUsedSize () const
+	{
+		return used_size;
+	}
+	uint32_t GetAllocationCount () const
+	{
+		return allocation_count;
+	}
+	uint64_t GetLargestFreeBlock () const;
+	uint64_t GetUserData (uint32_t block) const
+	{
+		return blocks[block].user_data;
+	}
+	//allocated blocks in address order
+	void GetAllocations (std::vector<TlsfAllocation> &allocations) const;
+private:
+	static const uint32_t sl_count_log2 = 5;
+	static const uint32_t sl_count = 1 << sl_count_log2;
+	static const uint32_t fl_count = 64;
+	static const uint32_t invalid_block = 0xFFFFFFFF;
+
+	struct Block
+	{
+		uint64_t offset;
+		uint64_t size;
+		uint64_t user_data;
+		uint32_t prev_physical;
+		uint32_t next_physical;
+		uint32_t prev_free;
+		uint32_t next_free;
+		bool is_free;
+	};
+
+	void Mapping (uint64_t units, uint32_t &fl, uint32_t &sl) const;
+	uint32_t FindFreeBlock (uint64_t units, uint64_t alignment) const;
+	void InsertFreeBlock (uint32_t block);
+	void RemoveFreeBlock (uint32_t block);
+	uint32_t NewBlock ();
+	void DeleteBlock (uint32_t block);
+	//cuts size bytes off the front of the block into a new block placed after it
+	uint32_t Split (uint32_t block, uint64_t size);
+
+	uint64_t size;
+	uint64_t granularity;
+	uint32_t granularity_log2;
+	uint64_t used_size;
+	uint32_t allocation_count;
+	uint64_t fl_bitmap;
+	uint32_t sl_bitmap[fl_count];
+	uint32_t free_heads[fl_count][sl_count];
+	std::vector<Block> blocks;
+	std::vector<uint32_t> unused_blocks;
+};
+
+typedef uint64_t GpuHeapHandle;
+
+//resource heap tier 1 hardware can not mix these in one heap
+enum GpuHeapTier
+{
+	GPU_HEAP_TIER_BUFFERS,
+	GPU_HEAP_TIER_TEXTURES,
+	GPU_HEAP_TIER_RENDER_TARGETS,    //render target and depth stencil textures
+	GPU_HEAP_TIER_COUNT
+};
+
+//alignment of placed resources without the small resource rules
+static const uint64_t gpu_default_placement_alignment = 64 * 1024;
+//small textures may be placed at 4 KB
+static const uint64_t gpu_small_placement_alignment = 4 * 1024;
+
+class GpuHeapBackend
+{
+public:
+	virtual ~GpuHeapBackend () {}
+	virtual GpuHeapHandle CreateHeap (GpuHeapTier tier, uint64_t size) = 0;
+	virtual void DestroyHeap (GpuHeapHandle heap) = 0;
+};
+
+struct GpuMemoryAllocation
+{
+	GpuHeapHandle heap;
+	uint64_t offset;
+	uint64_t size;
+	GpuHeapTier tier;
+	uint32_t heap_index;
+	uint32_t block;
+};
+
+struct GpuMemoryStats
+{
+	uint32_t heap_count;
+	uint32_t allocation_count;
+	uint64_t reserved_bytes;
+	uint64_t used_bytes;
+	uint64_t largest_free_block;
+	double fragmentation;    //1 - largest free block / free bytes, over all heaps of the tier
+};
+
+//relocation planned by Defragment (): the caller recreates the resource at dst, copies
+//the contents and frees src once the GPU is done with it
+struct GpuMemoryMove
+{
+	uint64_t user_data;
+	GpuMemoryAllocation src;
+	GpuMemoryAllocation dst;
+};
+
+class GpuMemoryAllocator
+{
+public:
+	GpuMemoryAllocator (GpuHeapBackend *backend, uint64_t heap_size);
+	//destroys all heaps; resources placed into them must be released before
+	~GpuMemoryAllocator ();
+
+	//allocations larger than the heap size get a dedicated heap
+	GpuMemoryAllocation Allocate (GpuHeapTier tier, uint64_t size, uint64_t alignment, uint64_t user_data = 0);
+	void Free (const GpuMemoryAllocation &allocation);
+	//destroys heaps without allocations, one per tier is kept
+	void ReleaseEmptyHeaps ();
+
+	GpuMemoryStats GetStats (GpuHeapTier tier) const;
+	//packs allocations of the emptiest heaps of the tier into fuller heaps or lower
+	//offsets, up to max_bytes in total; returns the number of planned moves
+	size_t Defragment (GpuHeapTier tier, uint64_t max_bytes, std::vector<GpuMemoryMove> &moves);
+private:
+	struct Heap
+	{
+		GpuHeapHandle handle;
+		std::unique_ptr<TlsfAllocator> allocator;
+		bool dedicated;
+	};
+
+	GpuMemoryAllocator (const GpuMemoryAllocator &) = delete;
+	GpuMemoryAllocator &operator= (const GpuMemoryAllocator &) = delete;
+
+	uint32_t CreateHeap (GpuHeapTier tier, uint64_t heap_bytes, bool dedicated);
+	bool AllocateFrom (GpuHeapTier tier, uint32_t heap_index, uint64_t size, uint64_t alignment, uint64_t user_data, GpuMemoryAllocation &allocation);
+	void DestroyHeap (Heap &heap);
+
+	GpuHeapBackend *backend;
+	uint64_t heap_size;
+	mutable std::mutex mutex;
+	std::vector<Heap> heaps[GPU_HEAP_TIER_COUNT];    //destroyed heaps leave empty slots so indices stay valid
+};
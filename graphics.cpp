@@ -14,10 +14,47 @@ inline void SetName (ID3D12Object*, LPCWSTR)
 
 #define NAME_D3D12_OBJECT(x) SetName(x.Get(), L#x)
 
+//persistently mapped upload memory shared by all frames
+static const uint64_t upload_ring_size = 4 * 1024 * 1024;
+//staging memory of the asset streamer, it bounds the bytes being read and copied, and its I/O threads
+static const uint64_t stream_staging_size = 32 * 1024 * 1024;
+static const uint32_t stream_thread_count = 2;
+//default heaps that resources are placed into
+static const uint64_t gpu_heap_size = 16 * 1024 * 1024;
+//descriptors per CPU-only heap and sizes of the shader visible heap regions
+static const uint32_t cpu_descriptor_heap_size = 256;
+static const uint32_t persistent_descriptor_count = 4096;
+static const uint32_t frame_descriptor_ring_size = 16384;
+//part of the persistent region that shaders index as the bindless table
+static const uint32_t bindless_descriptor_count = 2048;
+//background threads compiling pipelines and the file their library is kept in
+static const uint32_t pipeline_thread_count = 2;
+static const LPCWSTR pipeline_cache_name = L"pipelines.cache";
+//directory of the shader bytecode cache, filled offline by shader_precompile for shipping builds
+static const LPCWSTR shader_cache_name = L"shader_cache";
+//mesh of the scene, converted from its source on the first run if mesh_convert did not create it
+static const LPCWSTR mesh_name = L"triangle.mesh";
+static const LPCWSTR mesh_source_name = L"triangle.obj";
+//the mesh constants are the first of the bindless root constants
+static const UINT mesh_constants_parameter = bindless_constants_parameter;
+//fewest draw groups a scene recording job gets, fewer ones cost more in command lists than they save
+static const uint32_t min_scene_groups_per_job = 64;
+//milliseconds between checks of the shader sources for hot reload
+static const uint32_t shader_reload_interval = 250;
+
 Graphics::Graphics () :
-	is_resize (true)
+	frames_in_flight (2),
+	frame_policy (FRAME_POLICY_MAX_THROUGHPUT),
+	scene_jobs (1),
+	is_resize (true),
+	scene_pipeline (0),
+	scene_root_signature_id (0),
+	scene_pipeline_id (0),
+	indirect_draws (false),
+	mesh_stream (stream_id_invalid),
+	mesh_ready (false)
 {
-
+	present_options.low_latency = frame_policy == FRAME_POLICY_LOW_LATENCY;
 }
 
 Graphics::~Graphics ()
@@ -42,9 +79,14 @@ void Graphics::Init ()
 		Log ("Assets located at: %s", CW2A(assets_path.c_str ()).m_psz);
 	}
 
+	//worker threads for the remaining cores, the calling thread works too
+	{
+		const UINT core_count = std::thread::hardware_concurrency ();
+		job_system.reset (new JobSystem (core_count > 1 ? core_count - 1 : 0));
+		Log ("Job system with %u threads created successfully", job_system->GetThreadCount ());
+	}
+
 	//init graphics
-	for (size_t i = 0; i < frame_count; i++)
-		fence_values[i] = 0;
 	LoadPipeline ();
 	LoadAssets ();
 	Log ("Direct3D 12 initialized successfully");
@@ -54,26 +96,150 @@ void Graphics::Destroy ()
 {
 	WaitForGpu ();
 	THROWIFFAILED (swap_chain->SetFullscreenState (FALSE, nullptr), "Can not set fullscreen state");
-	CloseHandle (fence_event);
+	presenter.reset ();
+	present_backend.reset ();
+	recorder.reset ();
+	allocator_pool.reset ();
+	shader_reloader.reset ();
+	try
+	{
+		pipeline_cache->Save (CW2A (GetAssetPath (pipeline_cache_name).c_str ()));
+	}
+	catch (const std::exception &err)
+	{
+		LogMessage (LOG_SEVERITY_WARNING, "Pipeline library is not saved: %s", err.what ());
+	}
+	pipeline_cache.reset ();
+	pipeline_backend.reset ();
+	root_signature_cache.reset ();
+	root_signature_backend.reset ();
+	shader_cache.reset ();
+	shader_compiler.reset ();
+	//waits for the copies in flight
+	streamer.reset ();
+	copy_gpu.reset ();
+	mesh_file.Close ();
+	upload.reset ();
+	upload_backend.reset ();
+	bindless.reset ();
+	shader_descriptors.reset ();
+	rtv_heap.reset ();
+	descriptor_backend.reset ();
+	//placed resources go before their heaps
+	render_graph.reset ();
+	render_graph_backend.reset ();
+	resource_states.Unregister (ToGpuHandle (mesh_buffer.Get ()));
+	mesh_buffer.Reset ();
+	gpu_memory->Free (mesh_buffer_memory);
+	gpu_memory.reset ();
+	residency.reset ();
+	residency_backend.reset ();
+	heap_backend.reset ();
+	scheduler.reset ();
+	gpu.reset ();
+	job_system.reset ();
 }
 
 void Graphics::Update ()
 {
+	PROFILE_FUNCTION ();
+	//wait for the swap chain and a free frame slot before doing any work for the new frame
+	WaitForFrame ();
+	scheduler->BeginFrame ();
+
+	//copies handed over here are waited for by the direct queue before the frame executes
+	{
+		PROFILE_SCOPE ("Streaming");
+		streamer->Update (gpu.get (), scheduler->GetFrameFenceValue ());
+		if (mesh_stream != stream_id_invalid)
+		{
+			const StreamStatus status = streamer->GetStatus (mesh_stream);
+			if (status == STREAM_STATUS_FAILED)
+			{
+				LogMessage (LOG_SEVERITY_ERROR, "%s", streamer->GetError (mesh_stream).c_str ());
+				throw framework_err ("Can not stream mesh");
+			}
+			if (status == STREAM_STATUS_READY)
+			{
+				//the streams were read, the mapping is not needed anymore
+				streamer->Release (mesh_stream);
+				mesh_stream = stream_id_invalid;
+				mesh_file.Close ();
+				mesh_ready = true;
+				Log ("Mesh streamed successfully");
+			}
+		}
+	}
 
+	//swap in pipelines of edited shaders, the replaced ones are released once their frames finished
+	{
+		PROFILE_SCOPE ("ShaderReload");
+		std::vector<ShaderReloadEvent> reload_events;
+		shader_reloader->Update (reload_events);
+		for (const ShaderReloadEvent &event : reload_events)
+			if (event.succeeded)
+				Log ("Shaders reloaded successfully");
+			else
+				LogMessage (LOG_SEVERITY_WARNING, "Shaders are not reloaded, the last pipeline is kept:\n%s", event.errors.c_str ());
+	}
+
+	{
+		PROFILE_SCOPE ("UpdateGraph");
+		job_system->Run (update_graph);
+	}
+
+	{
+		PROFILE_SCOPE ("SceneUpdate");
+		scene.Update (job_system.get ());
+	}
+
+	//the vertex shader outputs the mesh positions as clip space, so the frustum is the clip volume
+	{
+		PROFILE_SCOPE ("Culling");
+		static const float clip_space[16] =
+		{
+			1.0f, 0.0f, 0.0f, 0.0f,
+			0.0f, 1.0f, 0.0f, 0.0f,
+			0.0f, 0.0f, 1.0f, 0.0f,
+			0.0f, 0.0f, 0.0f, 1.0f
+		};
+		CullOptions cull_options;
+		cull_options.volume = CULL_VOLUME_BOX;
+		cull_options.job_system = job_system.get ();
+		mesh_visibility.Cull (ExtractFrustum (clip_space), cull_options, visible_submeshes);
+	}
 }
 
 void Graphics::Render ()
 {
+	PROFILE_FUNCTION ();
 	//Record command list for current scene
 	RecordCommandList ();
 
+	//the heaps of the frame are made resident and the budget is enforced before the GPU sees the work
+	{
+		PROFILE_SCOPE ("Residency");
+		frame_heaps.clear ();
+		frame_heaps.push_back (mesh_buffer_memory.heap);
+		render_graph->GetTransientHeaps (frame_heaps);
+		for (GpuHeapHandle heap : frame_heaps)
+			residency->Use (heap);
+		residency->Submit (scheduler->GetFrameFenceValue (), scheduler->GetCompletedFenceValue ());
+	}
+
 	//Execute the command list
-	ID3D12CommandList *command_lists[] = { command_list.Get () };
-	command_queue->ExecuteCommandLists (_countof (command_lists), command_lists);
+	{
+		PROFILE_SCOPE ("ExecuteCommandLists");
+		//staged descriptor tables must be in place before the GPU reads them
+		shader_descriptors->FlushCopies ();
+		recorder->Submit (scheduler->GetFrameFenceValue ());
+	}
 
 	//Present the frame.
-	THROWIFFAILED (swap_chain->Present (1, 0),
-				   "Can not present frame");
+	{
+		PROFILE_SCOPE ("Present");
+		presenter->Present ();
+	}
 
 	NextFrame ();
 }
@@ -87,18 +253,77 @@ void Graphics::Resize (int window_width, int window_height)
 
 	//flush current GPU programs
 	WaitForGpu ();
+	ResizeSwapChain ();
+}
 
-	//release swap chain resources
-	for (UINT n = 0; n < frame_count; n++)
+void Graphics::SetFrameLatency (UINT frames_count, FramePacingPolicy policy)
+{
+	if (frames_count < 1 || frames_count > max_frames_in_flight)
+		throw framework_err ("Unsupported number of frames in flight");
+	Log ("Setting %u frames in flight, %s policy", frames_count,
+		 policy == FRAME_POLICY_LOW_LATENCY ? "low latency" : "max throughput");
+
+	frame_policy = policy;
+	present_options.low_latency = policy == FRAME_POLICY_LOW_LATENCY;
+	if (!scheduler)
 	{
-		render_targets[n].Reset ();
-		fence_values[n] = fence_values[frame_index];
+		frames_in_flight = frames_count;
+		return;
 	}
+	scheduler->SetPolicy (policy);
+	presenter->SetOptions (present_options);
+	if (frames_count == frames_in_flight)
+	{
+		presenter->SetMaximumFrameLatency (GetMaxFrameLatency ());
+		return;
+	}
+
+	WaitForGpu ();
+	const UINT buffer_count = GetBufferCount ();
+	frames_in_flight = frames_count;
+	scheduler->SetFramesInFlight (frames_in_flight);
+	presenter->SetMaximumFrameLatency (GetMaxFrameLatency ());
+	if (GetBufferCount () != buffer_count)
+		ResizeSwapChain ();
+}
+
+void Graphics::WaitForFrame ()
+{
+	PROFILE_FUNCTION ();
+	if (!presenter->IsInFrame ())
+		presenter->BeginFrame ();
+}
+
+void Graphics::SetPresentMode (PresentMode mode, float fps_cap)
+{
+	static const char *mode_names[] = { "vsync", "tearing", "capped" };
+	if (mode == PRESENT_MODE_CAPPED && !(fps_cap > 0.0f))
+		throw framework_err ("Frame rate cap must be positive");
+	present_options.mode = mode;
+	if (fps_cap > 0.0f)
+		present_options.fps_cap = fps_cap;
+	Log ("Setting %s presentation, %.0f fps cap", mode_names[mode], present_options.fps_cap);
+	if (!presenter)
+		return;
+	if (mode != PRESENT_MODE_VSYNC && !present_backend->IsTearingSupported ())
+		LogMessage (LOG_SEVERITY_WARNING, "Tearing is not supported, frames without vsync wait for the next refresh");
+	presenter->SetOptions (present_options);
+}
+
+void Graphics::ResizeSwapChain ()
+{
+	//release swap chain resources
+	for (UINT n = 0; n < max_frames_in_flight; n++)
+		if (render_targets[n])
+		{
+			resource_states.Unregister (ToGpuHandle (render_targets[n].Get ()));
+			render_targets[n].Reset ();
+		}
 
 	//resize swap chain
 	DXGI_SWAP_CHAIN_DESC desc = {};
 	swap_chain->GetDesc (&desc);
-	THROWIFFAILED (swap_chain->ResizeBuffers (frame_count, width, height, desc.BufferDesc.Format, desc.Flags),
+	THROWIFFAILED (swap_chain->ResizeBuffers (GetBufferCount (), width, height, desc.BufferDesc.Format, desc.Flags),
 				   "Can not resize swap chain buffers");
 
 	//reset frame index
@@ -107,6 +332,59 @@ void Graphics::Resize (int window_width, int window_height)
 	is_resize = true;
 }
 
+void Graphics::LogMemoryStats () const
+{
+	const char *tier_names[GPU_HEAP_TIER_COUNT] = { "buffers", "textures", "render targets" };
+	for (UINT tier = 0; tier < GPU_HEAP_TIER_COUNT; tier++)
+	{
+		GpuMemoryStats stats = gpu_memory->GetStats (static_cast<GpuHeapTier>(tier));
+		Log ("GPU memory, %s: %u heaps, %u allocations, %.2f of %.2f MB used, fragmentation %.2f",
+			 tier_names[tier], stats.heap_count, stats.allocation_count,
+			 stats.used_bytes / (1024.0 * 1024.0), stats.reserved_bytes / (1024.0 * 1024.0), stats.fragmentation);
+	}
+	const ResidencyStats residency_stats = residency->GetStats ();
+	Log ("Residency: %.2f of %.2f MB budget, %u of %u heaps resident (%.2f of %.2f MB), last frame used %u heaps, evicted %u and restored %u, %.2f MB over budget; %llu eviction batches, %.2f MB evicted and %.2f MB restored in total",
+		 residency_stats.usage / (1024.0 * 1024.0), residency_stats.budget / (1024.0 * 1024.0),
+		 residency_stats.resident_heaps, residency_stats.heaps,
+		 residency_stats.resident_bytes / (1024.0 * 1024.0), residency_stats.tracked_bytes / (1024.0 * 1024.0),
+		 residency_stats.used_heaps, residency_stats.evicted_heaps, residency_stats.made_resident_heaps,
+		 residency_stats.over_budget_bytes / (1024.0 * 1024.0), residency_stats.eviction_batches,
+		 residency_stats.total_evicted_bytes / (1024.0 * 1024.0), residency_stats.total_made_resident_bytes / (1024.0 * 1024.0));
+	const PresentStats &present_stats = presenter->GetStats ();
+	Log ("Present: %llu frames, %llu displayed, %llu late, %llu wait timeouts, %.2f ms to present (max %.2f), %.2f ms to display (max %.2f), %.2f ms refresh, %.2f ms pacing delay",
+		 present_stats.frames, present_stats.displayed_frames, present_stats.late_frames, present_stats.wait_timeouts,
+		 present_stats.frames ? present_stats.total_present_latency_ns / 1e6 / present_stats.frames : 0.0,
+		 present_stats.max_present_latency_ns / 1e6,
+		 present_stats.displayed_frames ? present_stats.total_display_latency_ns / 1e6 / present_stats.displayed_frames : 0.0,
+		 present_stats.max_display_latency_ns / 1e6, present_stats.refresh_interval_ns / 1e6, present_stats.pacing_delay_ns / 1e6);
+	const ResourceStateStats &barrier_stats = recorder->GetBarrierStats ();
+	Log ("Barriers of the last frame: %llu transitions, %llu redundant, %llu barriers in %llu batches (max %llu), %llu resolved at submit",
+		 barrier_stats.transitions, barrier_stats.redundant, barrier_stats.barriers,
+		 barrier_stats.batches, barrier_stats.max_batch, barrier_stats.fixups);
+	const RenderGraphStats &graph_stats = render_graph->GetStats ();
+	Log ("Render graph: %u passes, %u culled, %u transients in %.2f of %.2f MB, %u transitions and %u aliasing barriers in %u batches, %llu compilations, %llu cache hits",
+		 graph_stats.passes, graph_stats.culled_passes, graph_stats.transient_resources,
+		 graph_stats.transient_bytes / (1024.0 * 1024.0), graph_stats.unaliased_bytes / (1024.0 * 1024.0),
+		 graph_stats.transitions, graph_stats.aliasing_barriers, graph_stats.barrier_batches,
+		 graph_stats.compilations, graph_stats.cache_hits);
+	PipelineCacheStats pipeline_stats = pipeline_cache->GetStats ();
+	Log ("Pipelines: %u in cache, %llu requests, %llu deduplicated, %llu compiled, %llu loaded from library, %llu failed, %u pending",
+		 pipeline_stats.pipelines, pipeline_stats.requests, pipeline_stats.deduplicated,
+		 pipeline_stats.compiled, pipeline_stats.loaded, pipeline_stats.failed, pipeline_stats.pending);
+	const ShaderReloadStats reload_stats = shader_reloader->GetStats ();
+	Log ("Shader reload: %u files watched, %llu changes, %llu recompiles, %llu swaps, %llu failures",
+		 reload_stats.files, reload_stats.changes, reload_stats.recompiles, reload_stats.swaps, reload_stats.failures);
+	ShaderDescriptorStats descriptor_stats = shader_descriptors->GetStats ();
+	Log ("Descriptors: %u persistent, %u in frame ring, %llu staged tables in %llu copy batches, %llu stalls",
+		 descriptor_stats.persistent_used, descriptor_stats.ring_used,
+		 descriptor_stats.staged_tables, descriptor_stats.copy_batches, descriptor_stats.stalls);
+	const AssetStreamerStats stream_stats = streamer->GetStats ();
+	Log ("Streaming: %llu requests, %u queued, %u in flight, %.2f MB copied in %llu batches, %llu handovers (%llu urgent), %llu budget stalls, %llu failed, staging peak %.2f MB",
+		 stream_stats.requests, stream_stats.queued, stream_stats.in_flight, stream_stats.copied_bytes / (1024.0 * 1024.0),
+		 stream_stats.batches, stream_stats.handovers, stream_stats.urgent_handovers, stream_stats.budget_stalls,
+		 stream_stats.failed, stream_stats.staging_peak / (1024.0 * 1024.0));
+}
+
 void Graphics::LoadPipeline ()
 {
 	//enable debug layer
@@ -121,6 +399,7 @@ void Graphics::LoadPipeline ()
 	
 	ComPtr<IDXGIFactory4> factory = nullptr;
 	ComPtr<IDXGIAdapter1> adapter = nullptr;
+	ComPtr<IDXGIAdapter1> selected_adapter = nullptr;
 	//get hardware adapter
 	{
 		THROWIFFAILED (CreateDXGIFactory1 (IID_PPV_ARGS (&factory)), "Can not create dxgi factory");
@@ -148,7 +427,10 @@ void Graphics::LoadPipeline ()
 				if (FAILED (D3D12CreateDevice (adapter.Get (), D3D_FEATURE_LEVEL_11_0, __uuidof (ID3D12Device), &device)))
 					device = nullptr;
 				else
+				{
+					selected_adapter = adapter;
 					Log ("\tThis card was selected for Direct3D 12");
+				}
 			}
 		}
 		if (device == nullptr)
@@ -162,19 +444,34 @@ void Graphics::LoadPipeline ()
 		queue_desc.Type = D3D12_COMMAND_LIST_TYPE_DIRECT;
 		THROWIFFAILED (device->CreateCommandQueue (&queue_desc, IID_PPV_ARGS (&command_queue)),
 					   "Can not create command queue");
+		gpu.reset (new D3D12GpuDevice (device.Get (), command_queue.Get ()));
+		scheduler.reset (new FrameScheduler (gpu.get (), frames_in_flight, frame_policy));
 		Log ("Command queue created successfully");
 	}
 
+	//create copy queue for streaming, it has its own fence
+	{
+		D3D12_COMMAND_QUEUE_DESC queue_desc = {};
+		queue_desc.Flags = D3D12_COMMAND_QUEUE_FLAG_NONE;
+		queue_desc.Type = D3D12_COMMAND_LIST_TYPE_COPY;
+		THROWIFFAILED (device->CreateCommandQueue (&queue_desc, IID_PPV_ARGS (&copy_command_queue)),
+					   "Can not create copy command queue");
+		NAME_D3D12_OBJECT (copy_command_queue);
+		copy_gpu.reset (new D3D12GpuDevice (device.Get (), copy_command_queue.Get ()));
+		Log ("Copy command queue created successfully");
+	}
+
 	//create swapchain
 	{
 		DXGI_SWAP_CHAIN_DESC1 swap_chain_desc = {};
-		swap_chain_desc.BufferCount = frame_count;
+		swap_chain_desc.BufferCount = GetBufferCount ();
 		swap_chain_desc.Width = width;
 		swap_chain_desc.Height = height;
 		swap_chain_desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
 		swap_chain_desc.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;
 		swap_chain_desc.SwapEffect = DXGI_SWAP_EFFECT_FLIP_DISCARD;
 		swap_chain_desc.SampleDesc.Count = 1;
+		swap_chain_desc.Flags = GetPresentSwapChainFlags (factory.Get ());
 
 		ComPtr<IDXGISwapChain1> temp_swap_chain;
 		THROWIFFAILED (factory->CreateSwapChainForHwnd (command_queue.Get (),
@@ -186,29 +483,81 @@ void Graphics::LoadPipeline ()
 					   "Can not create swap chain");
 		THROWIFFAILED (temp_swap_chain.As (&swap_chain), "Can not create swap chain");
 		frame_index = swap_chain->GetCurrentBackBufferIndex ();
-		Log ("Swap chain created successfully");
+		present_backend.reset (new D3D12PresentBackend (swap_chain.Get ()));
+		presenter.reset (new PresentController (present_backend.get (), present_options));
+		presenter->SetMaximumFrameLatency (GetMaxFrameLatency ());
+		Log ("Swap chain created successfully, tearing %s", present_backend->IsTearingSupported () ? "supported" : "not supported");
 	}
 
 	//create descriptor heaps
-	//create render target view descriptor heap
 	{
-		D3D12_DESCRIPTOR_HEAP_DESC descriptor_heap_desc = {};
-		descriptor_heap_desc.NumDescriptors = frame_count;
-		descriptor_heap_desc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_RTV;
-		descriptor_heap_desc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
-		THROWIFFAILED (device->CreateDescriptorHeap (&descriptor_heap_desc, IID_PPV_ARGS (&rtv_heap)),
-					   "Can not create render target view descriptor heap");
-		rtv_descriptor_size = device->GetDescriptorHandleIncrementSize (D3D12_DESCRIPTOR_HEAP_TYPE_RTV);
-		Log ("Render target view descriptor heap created successfully");
+		descriptor_backend.reset (new D3D12DescriptorBackend (device.Get ()));
+		rtv_heap.reset (new CpuDescriptorHeap (descriptor_backend.get (), GPU_DESCRIPTOR_HEAP_TYPE_RTV, cpu_descriptor_heap_size));
+		for (UINT n = 0; n < max_frames_in_flight; n++)
+			render_target_views[n] = rtv_heap->Allocate ();
+		shader_descriptors.reset (new ShaderDescriptorHeap (gpu.get (), descriptor_backend.get (),
+															persistent_descriptor_count, frame_descriptor_ring_size));
+		Log ("Descriptor heaps created successfully");
+	}
+
+	//create command allocator pool and parallel recorder
+	{
+		allocator_pool.reset (new CommandAllocatorPool (gpu.get ()));
+		recorder.reset (new ParallelCommandRecorder (gpu.get (), allocator_pool.get (), job_system.get (), &resource_states));
+		Log ("Command recorder created successfully");
+	}
+
+	//create upload ring
+	{
+		upload_backend.reset (new D3D12UploadBackend (device.Get ()));
+		upload.reset (new UploadAllocator (gpu.get (), upload_backend.get (), upload_ring_size));
+		Log ("Upload ring of %u KB created successfully", static_cast<unsigned>(upload_ring_size / 1024));
+	}
+
+	//create asset streamer
+	{
+		streamer.reset (new AssetStreamer (copy_gpu.get (), upload_backend.get (), stream_staging_size, stream_thread_count));
+		Log ("Asset streamer with %u MB of staging memory created successfully", static_cast<unsigned>(stream_staging_size / (1024 * 1024)));
 	}
 
-	//create command allocators
+	//create shader cache next to the executable
 	{
-		for (int i = 0; i < frame_count; i++)
-			THROWIFFAILED (device->CreateCommandAllocator (D3D12_COMMAND_LIST_TYPE_DIRECT,
-														   IID_PPV_ARGS (&command_allocators[i])),
-						   "Can not create command allocator");
-		Log ("Command allocators for %u frames created successfully", frame_count);
+		const std::wstring shader_cache_path = GetAssetPath (shader_cache_name);
+		if (!CreateDirectory (shader_cache_path.c_str (), nullptr) && GetLastError () != ERROR_ALREADY_EXISTS)
+			throw framework_err ("Can not create shader cache directory");
+		shader_compiler.reset (new D3DShaderCompiler ());
+		shader_cache.reset (new ShaderCache (shader_compiler.get (), CW2A (shader_cache_path.c_str ()).m_psz, std::vector<std::string> ()));
+		Log ("Shader cache created successfully");
+	}
+
+	//create pipeline cache, warm starts load the pipelines of the last run from its library
+	{
+		pipeline_backend.reset (new D3D12PipelineBackend (device.Get ()));
+		pipeline_cache.reset (new PipelineCache (pipeline_backend.get (), pipeline_thread_count));
+		if (pipeline_cache->Load (CW2A (GetAssetPath (pipeline_cache_name).c_str ())))
+			Log ("Pipeline library loaded");
+		Log ("Pipeline cache created successfully");
+	}
+
+	//create GPU memory allocator, its heaps are evicted and restored to fit the budget of the adapter
+	{
+		ComPtr<IDXGIAdapter3> budget_adapter;
+		THROWIFFAILED (selected_adapter.As (&budget_adapter), "Can not query video memory budget");
+		heap_backend.reset (new D3D12HeapBackend (device.Get ()));
+		residency_backend.reset (new D3D12ResidencyBackend (device.Get (), budget_adapter.Get ()));
+		residency.reset (new ResidencyManager (heap_backend.get (), residency_backend.get ()));
+		uint64_t budget, usage;
+		residency_backend->QueryBudget (budget, usage);
+		Log ("Video memory budget: %u MB, %u MB in use", static_cast<unsigned>(budget / (1024 * 1024)), static_cast<unsigned>(usage / (1024 * 1024)));
+		gpu_memory.reset (new GpuMemoryAllocator (residency.get (), gpu_heap_size));
+		Log ("GPU memory allocator with %u MB heaps created successfully", static_cast<unsigned>(gpu_heap_size / (1024 * 1024)));
+	}
+
+	//create render graph, its transients share the GPU heaps
+	{
+		render_graph_backend.reset (new D3D12RenderGraphBackend (device.Get ()));
+		render_graph.reset (new RenderGraph (render_graph_backend.get (), gpu_memory.get (), scheduler.get ()));
+		Log ("Render graph created successfully");
 	}
 
 	Log ("Direct3D 12 pipeline initialized successfully");
@@ -218,163 +567,113 @@ void Graphics::LoadAssets ()
 {
 	try
 	{
-		//create an empty root signature
+		//every draw uses the canonical bindless root signature: resources are indices into the
+		//bindless table, passed with the mesh constants
 		{
-			D3D12_ROOT_SIGNATURE_DESC root_signature_desc;
-
-			root_signature_desc.NumParameters = 0;
-			root_signature_desc.pParameters = nullptr;
-			root_signature_desc.NumStaticSamplers = 0;
-			root_signature_desc.pStaticSamplers = nullptr;
-			root_signature_desc.Flags = D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT;
-
-			ComPtr<ID3DBlob> signature;
-			ComPtr<ID3DBlob> error;
-			THROWIFFAILED (D3D12SerializeRootSignature (&root_signature_desc,
-														D3D_ROOT_SIGNATURE_VERSION_1,
-														&signature,
-														&error),
-						   "Can not serialize root signature");
-			THROWIFFAILED (device->CreateRootSignature (0,
-														signature->GetBufferPointer (),
-														signature->GetBufferSize (),
-														IID_PPV_ARGS (&root_signature)),
-						   "Can not create root signature");
-			Log ("root signature created successfully");
+			static_assert (sizeof (MeshConstants) <= bindless_root_constant_count * sizeof (uint32_t), "Mesh constants do not fit the root constants");
+			root_signature_backend.reset (new D3D12RootSignatureBackend (device.Get ()));
+			root_signature_cache.reset (new RootSignatureCache (root_signature_backend.get ()));
+			scene_root_signature = root_signature_cache->Get (MakeBindlessRootSignatureDesc (BINDLESS_ROOT_SIGNATURE_GRAPHICS));
+			bindless.reset (new BindlessDescriptors (shader_descriptors.get (), bindless_descriptor_count));
+			Log ("Root signature created successfully");
 		}
 
+		//the draw queue records the scene; ExecuteIndirect needs a command signature per type of draw
+		{
+			draw_queue.reset (new DrawQueue ());
+			const DrawRootTable bindless_table = { bindless_table_parameter, bindless->GetTable () };
+			scene_root_signature_id = draw_queue->AddRootSignature (scene_root_signature.handle, 1, &bindless_table);
+
+			D3D12_INDIRECT_ARGUMENT_DESC argument_desc;
+			D3D12_COMMAND_SIGNATURE_DESC signature_desc;
+			signature_desc.NumArgumentDescs = 1;
+			signature_desc.pArgumentDescs = &argument_desc;
+			signature_desc.NodeMask = 0;
+			argument_desc.Type = D3D12_INDIRECT_ARGUMENT_TYPE_DRAW;
+			signature_desc.ByteStride = sizeof (GpuDrawArguments);
+			THROWIFFAILED (device->CreateCommandSignature (&signature_desc, nullptr, IID_PPV_ARGS (&draw_signature)),
+						   "Can not create command signature");
+			argument_desc.Type = D3D12_INDIRECT_ARGUMENT_TYPE_DRAW_INDEXED;
+			signature_desc.ByteStride = sizeof (GpuDrawIndexedArguments);
+			THROWIFFAILED (device->CreateCommandSignature (&signature_desc, nullptr, IID_PPV_ARGS (&draw_indexed_signature)),
+						   "Can not create command signature");
+			indirect_buffers.draw_signature = ToGpuHandle (draw_signature.Get ());
+			indirect_buffers.draw_indexed_signature = ToGpuHandle (draw_indexed_signature.Get ());
+			indirect_buffers.arguments = 0;
+			indirect_buffers.arguments_offset = 0;
+			Log ("Draw queue created successfully");
+		}
+
+		//map the mesh, its vertex layout is the pipeline's input layout
+		OpenMesh ();
+
 		//create pipeline state object
 		{
-			//compile shaders
-			ComPtr<ID3DBlob> vertex_shader;
-			ComPtr<ID3DBlob> pixel_shader;
-			ComPtr<ID3DBlob> error;
-			
+			//compile shaders; unchanged ones are loaded from the shader cache, the others compile in parallel
 			#ifdef _DEBUG
 			UINT compile_flags = D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION;
 			#else
 			UINT compile_flags = 0;
 			#endif
 
-			THROWIFFAILED (D3DCompileFromFile (GetAssetPath (L"shaders.hlsl").c_str(),
-											   nullptr,
-											   nullptr,
-											   "VSMain",
-											   "vs_5_0",
-											   compile_flags,
-											   0,
-											   &vertex_shader,
-											   &error),
-						   "Can not compile vertex shader");
-			Log ("Vertex shader compiled successfully");
-
-			THROWIFFAILED (D3DCompileFromFile (GetAssetPath (L"shaders.hlsl").c_str(),
-											   nullptr,
-											   nullptr,
-											   "PSMain",
-											   "ps_5_0",
-											   compile_flags,
-											   0,
-											   &pixel_shader,
-											   &error),
-						   "Can not compile pixel shader");
-			Log ("Pixel shader compiled successfully");
+			const std::string shader_file = CW2A (GetAssetPath (L"shaders.hlsl").c_str ()).m_psz;
+			const ShaderRequest shader_requests[] =
+			{
+				{ shader_file, "VSMain", "vs_5_0", {}, compile_flags },
+				{ shader_file, "PSMain", "ps_5_0", {}, compile_flags }
+			};
+			ShaderResult shaders[_countof (shader_requests)];
+			shader_cache->Build (shader_requests, _countof (shader_requests), job_system.get (), shaders);
+			for (const ShaderResult &shader : shaders)
+				if (!shader.succeeded)
+				{
+					LogMessage (LOG_SEVERITY_ERROR, "%s", shader.errors.c_str ());
+					throw framework_err ("Can not compile shader");
+				}
+			const ShaderCacheStats shader_stats = shader_cache->GetStats ();
+			Log ("Shaders loaded successfully, %llu from cache, %llu compiled", shader_stats.hits, shader_stats.compiled);
 
 			//Describe vertex input layout
-			D3D12_INPUT_ELEMENT_DESC input_element_desc[]=
+			std::vector<PipelineInputElement> input_elements;
+			for (uint32_t i = 0; i < mesh.header->attribute_count; i++)
 			{
-				{"POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0},
-				{"COLOR", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0}
-			};
+				const MeshAttribute &attribute = mesh.header->attributes[i];
+				input_elements.push_back ({ GetMeshSemanticName (attribute.semantic), attribute.semantic_index, attribute.format,
+											0, attribute.offset, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 });
+			}
 
-			//Describe and create pipeline state object; a little bit complicated)
+			//Describe and request the pipeline state object; the remaining states keep the D3D12 defaults
 			{
-				D3D12_GRAPHICS_PIPELINE_STATE_DESC pso_desc = {};
-				pso_desc.InputLayout = { input_element_desc, _countof (input_element_desc) };
-				pso_desc.pRootSignature = root_signature.Get ();
-				//vertex shader
-				pso_desc.VS.pShaderBytecode = vertex_shader.Get ()->GetBufferPointer ();
-				pso_desc.VS.BytecodeLength = vertex_shader.Get ()->GetBufferSize ();
-				//pixel shader
-				pso_desc.PS.pShaderBytecode = pixel_shader.Get ()->GetBufferPointer ();
-				pso_desc.PS.BytecodeLength = pixel_shader.Get ()->GetBufferSize ();
-				//rasterization state
-				pso_desc.RasterizerState.FillMode = D3D12_FILL_MODE_SOLID;
-				pso_desc.RasterizerState.CullMode = D3D12_CULL_MODE_BACK;
-				pso_desc.RasterizerState.FrontCounterClockwise = FALSE;
-				pso_desc.RasterizerState.DepthBias = D3D12_DEFAULT_DEPTH_BIAS;
-				pso_desc.RasterizerState.DepthBiasClamp = D3D12_DEFAULT_DEPTH_BIAS_CLAMP;
-				pso_desc.RasterizerState.SlopeScaledDepthBias = D3D12_DEFAULT_SLOPE_SCALED_DEPTH_BIAS;
-				pso_desc.RasterizerState.DepthClipEnable = TRUE;
-				pso_desc.RasterizerState.MultisampleEnable = FALSE;
-				pso_desc.RasterizerState.AntialiasedLineEnable = FALSE;
-				pso_desc.RasterizerState.ForcedSampleCount = 0;
-				pso_desc.RasterizerState.ConservativeRaster = D3D12_CONSERVATIVE_RASTERIZATION_MODE_OFF;
-				//blend state
-				pso_desc.BlendState.AlphaToCoverageEnable = FALSE;
-				pso_desc.BlendState.IndependentBlendEnable = FALSE;
-				const D3D12_RENDER_TARGET_BLEND_DESC default_render_target_blend_desc =
-				{
-					FALSE,FALSE,
-					D3D12_BLEND_ONE, D3D12_BLEND_ZERO, D3D12_BLEND_OP_ADD,
-					D3D12_BLEND_ONE, D3D12_BLEND_ZERO, D3D12_BLEND_OP_ADD,
-					D3D12_LOGIC_OP_NOOP,
-					D3D12_COLOR_WRITE_ENABLE_ALL,
-				};
-				for (UINT i = 0; i < D3D12_SIMULTANEOUS_RENDER_TARGET_COUNT; i++)
-					pso_desc.BlendState.RenderTarget[i] = default_render_target_blend_desc;
-
-				pso_desc.DepthStencilState.DepthEnable = FALSE;
-				pso_desc.DepthStencilState.StencilEnable = FALSE;
-				pso_desc.SampleMask = UINT_MAX;
-				pso_desc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
-				pso_desc.NumRenderTargets = 1;
-				pso_desc.RTVFormats[0] = DXGI_FORMAT_R8G8B8A8_UNORM;
-				pso_desc.SampleDesc.Count = 1;
-
-				THROWIFFAILED (device->CreateGraphicsPipelineState(&pso_desc, IID_PPV_ARGS(&pipeline_state)),
-							   "Can not create pipeline state object");
-				NAME_D3D12_OBJECT (pipeline_state);
+				PipelineDesc pipeline_desc;
+				pipeline_desc.root_signature = scene_root_signature.handle;
+				pipeline_desc.root_signature_key = scene_root_signature.key;
+				pipeline_desc.shaders[PIPELINE_SHADER_VS] = { shaders[0].bytecode.data (), shaders[0].bytecode.size () };
+				pipeline_desc.shaders[PIPELINE_SHADER_PS] = { shaders[1].bytecode.data (), shaders[1].bytecode.size () };
+				pipeline_desc.input_elements = input_elements.data ();
+				pipeline_desc.input_element_count = static_cast<uint32_t>(input_elements.size ());
+				pipeline_desc.depth_stencil.depth_enable = FALSE;
+				pipeline_desc.primitive_topology_type = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
+				pipeline_desc.render_target_count = 1;
+				pipeline_desc.render_target_formats[0] = DXGI_FORMAT_R8G8B8A8_UNORM;
+
+				//needed for the first frame, so wait for it
+				const PipelineId pipeline = pipeline_cache->Create (pipeline_desc);
 				Log ("Pipeline state object created successfully");
+
+				//edits of the shader files are picked up while running
+				std::vector<ReloadableShader> reloadable_shaders;
+				reloadable_shaders.push_back ({ PIPELINE_SHADER_VS, shader_requests[0], shaders[0].dependencies });
+				reloadable_shaders.push_back ({ PIPELINE_SHADER_PS, shader_requests[1], shaders[1].dependencies });
+				shader_reloader.reset (new ShaderReloader (shader_cache.get (), pipeline_cache.get (), scheduler.get (), shader_reload_interval));
+				scene_pipeline = shader_reloader->Register (pipeline, pipeline_desc, reloadable_shaders);
+				scene_pipeline_id = draw_queue->AddPipeline (shader_reloader->Get (scene_pipeline), GPU_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 			}
-			
 		}
 
-		//create command list
+		//create frame and mesh buffers; the mesh streams in on the copy queue while the first frames render
 		{
-			THROWIFFAILED (device->CreateCommandList (0,
-													  D3D12_COMMAND_LIST_TYPE_DIRECT,
-													  command_allocators[frame_index].Get (),
-													  nullptr,
-													  IID_PPV_ARGS (&command_list)),
-						   "Can not create command list");
-
-			//optionally record something
 			CreateFrameBuffers ();
-			CreateVertexBuffers ();
-
-			//close command list
-			THROWIFFAILED (command_list->Close (), "Can not close command list");
-			Log ("Command buffer created successfully");
-		}
-
-		//create frame and vertex buffers by executing a command list
-		ID3D12CommandList *command_lists[] = { command_list.Get () };
-		command_queue->ExecuteCommandLists (_countof (command_lists), command_lists);
-		Log ("Command list executed successfully");
-
-		//Create synchronization objects
-		{
-			THROWIFFAILED (device->CreateFence (0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS (&fence)),
-						   "Can not create fence");
-			fence_values[frame_index]++;
-			fence_event = CreateEvent (nullptr, FALSE, FALSE, nullptr);
-			if (fence_event == nullptr)
-				THROWIFFAILED (HRESULT_FROM_WIN32 (GetLastError ()), "Can not create fence event");
-
-			WaitForGpu ();
-
-			Log ("Fence created successfully");
+			CreateMeshBuffers ();
 		}
 	}
 	catch (framework_err err)
@@ -393,15 +692,15 @@ void Graphics::CreateFrameBuffers ()
 	scissor_rect.right = static_cast<LONG>(width);
 	scissor_rect.bottom = static_cast<LONG>(height);
 
-	D3D12_CPU_DESCRIPTOR_HANDLE rtv_handle = rtv_heap->GetCPUDescriptorHandleForHeapStart ();
-
 	//create render target for each frame
-	for (UINT n = 0; n < frame_count; n++)
+	for (UINT n = 0; n < GetBufferCount (); n++)
 	{
 		THROWIFFAILED (swap_chain->GetBuffer (n, IID_PPV_ARGS (&render_targets[n])),
 					   "Can not get render target buffer");
+		D3D12_CPU_DESCRIPTOR_HANDLE rtv_handle;
+		rtv_handle.ptr = static_cast<SIZE_T>(render_target_views[n].handle);
 		device->CreateRenderTargetView (render_targets[n].Get (), nullptr, rtv_handle);
-		rtv_handle.ptr += 1 * rtv_descriptor_size;  //offset on 1 descriptor
+		resource_states.Register (ToGpuHandle (render_targets[n].Get ()), 1, GPU_RESOURCE_STATE_PRESENT);
 
 		//set name for render targets
 		WCHAR name[25];
@@ -414,162 +713,252 @@ void Graphics::CreateFrameBuffers ()
 	Log ("Framebuffers created successfully");
 }
 
-void Graphics::CreateVertexBuffers ()
+void Graphics::OpenMesh ()
 {
-	Vertex triangle_vertices[] =
-	{
-		{ { 0.0f, 0.5f, 0.0f }, { 1.0f, 0.0f, 0.0f, 1.0f } },
-		{ { 0.5f, -0.5f, 0.0f },{ 0.0f, 1.0f, 0.0f, 1.0f } },
-		{ { -0.5f, -0.5f, 0.0f },{ 0.0f, 0.0f, 1.0f, 1.0f } }
-	};
-
-	const UINT vertex_buffer_size = sizeof (triangle_vertices);
-
-	D3D12_RESOURCE_DESC vertex_buffer_desc;
-	vertex_buffer_desc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
-	vertex_buffer_desc.Alignment = 0;
-	vertex_buffer_desc.Width = vertex_buffer_size;
-	vertex_buffer_desc.Height = 1;
-	vertex_buffer_desc.DepthOrArraySize = 1;
-	vertex_buffer_desc.MipLevels = 1;
-	vertex_buffer_desc.Format = DXGI_FORMAT_UNKNOWN;
-	vertex_buffer_desc.SampleDesc.Count = 1;
-	vertex_buffer_desc.SampleDesc.Quality = 0;
-	vertex_buffer_desc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
-	vertex_buffer_desc.Flags = D3D12_RESOURCE_FLAG_NONE;
-
-
-	D3D12_HEAP_PROPERTIES heap_properties;
-	heap_properties.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
-	heap_properties.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
-	heap_properties.CreationNodeMask = 1;
-	heap_properties.VisibleNodeMask = 1;
-
-	heap_properties.Type = D3D12_HEAP_TYPE_DEFAULT;
-	THROWIFFAILED (device->CreateCommittedResource (&heap_properties,
-													D3D12_HEAP_FLAG_NONE,
-													&vertex_buffer_desc,
-													D3D12_RESOURCE_STATE_COPY_DEST,
-													nullptr,
-													IID_PPV_ARGS (&vertex_buffer)),
-				   "Can not create vertex buffer resource");
-
-	heap_properties.Type = D3D12_HEAP_TYPE_UPLOAD;
-	THROWIFFAILED (device->CreateCommittedResource (&heap_properties,
-													D3D12_HEAP_FLAG_NONE,
-													&vertex_buffer_desc,
-													D3D12_RESOURCE_STATE_GENERIC_READ,
-													nullptr,
-													IID_PPV_ARGS (&vertex_buffer_upload)),
-				   "Can not create vertex buffer resource for upload");
-
-	NAME_D3D12_OBJECT (vertex_buffer);
-
-	//copy data to the upload heap and than copy to the vertex buffer
-	UINT8 *vertex_data_begin;
-	D3D12_RANGE read_range = { 0, 0 };
-	THROWIFFAILED (vertex_buffer_upload->Map (0, &read_range, reinterpret_cast<void**>(&vertex_data_begin)),
-				   "Can not get CPU pointer to vertex_buffer_upload");
-	memcpy (vertex_data_begin, triangle_vertices, vertex_buffer_size);
-	vertex_buffer_upload->Unmap (0, nullptr);
-
-	command_list->CopyBufferRegion (vertex_buffer.Get (), 0, vertex_buffer_upload.Get (), 0, vertex_buffer_size);
-	D3D12_RESOURCE_BARRIER barrier;
-	barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;;
-	barrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
-	barrier.Transition.pResource = vertex_buffer.Get ();
-	barrier.Transition.StateBefore = D3D12_RESOURCE_STATE_COPY_DEST;
-	barrier.Transition.StateAfter = D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER;
-	barrier.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
-	
-	command_list->ResourceBarrier (1, &barrier);
+	const std::string mesh_path = CW2A (GetAssetPath (mesh_name).c_str ()).m_psz;
+	if (mesh_file.Open (mesh_path.c_str ()) && ReadMeshFile (mesh_file.GetData (), mesh_file.GetSize (), mesh))
+	{
+		Log ("Mesh mapped successfully");
+	}
+	else
+	{
+		//missing or written by another version
+		mesh_file.Close ();
+		const std::string source_path = CW2A (GetAssetPath (mesh_source_name).c_str ()).m_psz;
+		FILE *f = fopen (source_path.c_str (), "rb");
+		if (!f)
+			throw framework_err ("Can not open mesh source");
+		std::string text;
+		char buffer[65536];
+		size_t read;
+		while ((read = fread (buffer, 1, sizeof (buffer), f)) > 0)
+			text.append (buffer, read);
+		fclose (f);
+
+		std::vector<uint8_t> file;
+		try
+		{
+			MeshData data;
+			std::vector<std::string> materials;
+			ImportObj (text, data, materials);
+			OptimizeMesh (data, mesh_overdraw_threshold, nullptr);
+			QuantizeMesh (data, GetCompactVertexQuantization (), data);
+			WriteMeshFile (data, file);
+		}
+		catch (const std::exception &err)
+		{
+			LogMessage (LOG_SEVERITY_ERROR, "%s", err.what ());
+			throw framework_err ("Can not convert mesh");
+		}
+		f = fopen (mesh_path.c_str (), "wb");
+		bool written = f && fwrite (file.data (), 1, file.size (), f) == file.size ();
+		if (f)
+			written = fclose (f) == 0 && written;
+		if (!written || !mesh_file.Open (mesh_path.c_str ()) || !ReadMeshFile (mesh_file.GetData (), mesh_file.GetSize (), mesh))
+			throw framework_err ("Can not write mesh");
+		Log ("Mesh converted successfully");
+	}
+	if (!mesh.header->vertex_count || !mesh.header->index_count)
+		throw framework_err ("Mesh is empty");
+	//the streams are read while the pipeline is created
+	mesh_file.Prefetch (static_cast<size_t>(mesh.header->vertex_offset), static_cast<size_t>(mesh.vertex_size + mesh.index_size));
+}
+
+void Graphics::CreateMeshBuffers ()
+{
+	//the buffer is laid out like the streams in the file, so both are a single copy from the mapping
+	const MeshFileHeader &header = *mesh.header;
+	const uint64_t index_buffer_offset = header.index_offset - header.vertex_offset;
+	const uint64_t mesh_buffer_size = index_buffer_offset + mesh.index_size;
+	if (mesh_buffer_size > stream_staging_size)
+		throw framework_err ("Mesh does not fit the streaming staging memory");
+
+	D3D12_RESOURCE_DESC mesh_buffer_desc;
+	mesh_buffer_desc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+	mesh_buffer_desc.Alignment = 0;
+	mesh_buffer_desc.Width = mesh_buffer_size;
+	mesh_buffer_desc.Height = 1;
+	mesh_buffer_desc.DepthOrArraySize = 1;
+	mesh_buffer_desc.MipLevels = 1;
+	mesh_buffer_desc.Format = DXGI_FORMAT_UNKNOWN;
+	mesh_buffer_desc.SampleDesc.Count = 1;
+	mesh_buffer_desc.SampleDesc.Quality = 0;
+	mesh_buffer_desc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+	mesh_buffer_desc.Flags = D3D12_RESOURCE_FLAG_NONE;
+
+	//the copy queue writes it from the common state, the direct queue promotes it to the buffer states
+	mesh_buffer = CreatePlacedResource (device.Get (),
+										gpu_memory.get (),
+										mesh_buffer_desc,
+										D3D12_RESOURCE_STATE_COMMON,
+										nullptr,
+										mesh_buffer_memory);
+	NAME_D3D12_OBJECT (mesh_buffer);
+	resource_states.Register (ToGpuHandle (mesh_buffer.Get ()), 1, GPU_RESOURCE_STATE_COMMON);
+
+	//an I/O thread copies the mapped streams to staging memory, the mapping stays open until then
+	{
+		const uint8_t *streams = mesh.vertices;
+		StreamRequest request;
+		request.destination = ToGpuHandle (mesh_buffer.Get ());
+		request.destination_offset = 0;
+		request.first_subresource = 0;
+		request.size = mesh_buffer_size;
+		request.read = [streams] (void *destination, uint64_t size)
+		{
+			memcpy (destination, streams, static_cast<size_t>(size));
+		};
+		//the only mesh of the scene is needed right away
+		request.priority.deadline = 0;
+		request.priority.importance = 1.0f;
+		mesh_stream = streamer->Request (request);
+	}
 
-	//init vertex buffer view
-	vertex_buffer_view.BufferLocation = vertex_buffer->GetGPUVirtualAddress ();
-	vertex_buffer_view.StrideInBytes = sizeof (Vertex);
-	vertex_buffer_view.SizeInBytes = vertex_buffer_size;
+	//every submesh is a draw queue geometry sharing the buffer views and the mesh constants
+	const D3D12_GPU_VIRTUAL_ADDRESS mesh_buffer_address = mesh_buffer->GetGPUVirtualAddress ();
+	DrawGeometry geometry;
+	geometry.vertex_buffer.location = mesh_buffer_address;
+	geometry.vertex_buffer.stride = header.vertex_stride;
+	geometry.vertex_buffer.size = static_cast<uint32_t>(mesh.vertex_size);
+	geometry.index_buffer.location = mesh_buffer_address + index_buffer_offset;
+	geometry.index_buffer.size = static_cast<uint32_t>(mesh.index_size);
+	geometry.index_buffer.format = header.index_size == 2 ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT;
+	MeshConstants mesh_constants;
+	for (uint32_t i = 0; i < 3; i++)
+	{
+		mesh_constants.position_scale[i] = header.position_scale[i];
+		mesh_constants.position_bias[i] = header.position_bias[i];
+	}
+	mesh_constants.position_scale[3] = 1.0f;
+	mesh_constants.position_bias[3] = 0.0f;
+	geometry.constants_parameter = mesh_constants_parameter;
+	geometry.constant_count = sizeof (MeshConstants) / sizeof (uint32_t);
+	memcpy (geometry.constants, &mesh_constants, sizeof (MeshConstants));
+	mesh_geometries.clear ();
+	mesh_visibility.Resize (header.submesh_count);
+	for (uint32_t i = 0; i < header.submesh_count; i++)
+	{
+		const MeshSubmesh &submesh = mesh.submeshes[i];
+		geometry.count = submesh.index_count;
+		geometry.start = submesh.start_index;
+		geometry.base_vertex = submesh.base_vertex;
+		mesh_geometries.push_back (draw_queue->AddGeometry (geometry));
+		mesh_visibility.SetBox (i, submesh.bounds_min, submesh.bounds_max);
+	}
+	mesh_visibility.BuildHierarchy ();
 
-	Log ("Vertex buffers created successfully");
+	Log ("Mesh buffers created successfully: %u vertices of %u bytes, %u indices, %u submeshes",
+		 header.vertex_count, header.vertex_stride, header.index_count, header.submesh_count);
+
+	//the view is not needed anymore, the mapping is closed once the streams were read
+	mesh = MeshView ();
 }
 
 void Graphics::RecordCommandList ()
 {
-	//reset command allocator for current frame
-	THROWIFFAILED (command_allocators[frame_index]->Reset (), "Can not reset command allocator");
-	THROWIFFAILED (command_list->Reset (command_allocators[frame_index].Get (), pipeline_state.Get ()),
-				   "Can not reset command list");
-
+	PROFILE_FUNCTION ();
 	//add commands to resize buffers
 	if (is_resize)
 		CreateFrameBuffers ();
 
-	//set states
-	command_list->SetGraphicsRootSignature (root_signature.Get ());
-
-	command_list->IASetPrimitiveTopology (D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-	command_list->RSSetViewports (1, &viewport);
-	command_list->RSSetScissorRects (1, &scissor_rect);
-
-	//set back buffer as render target
-	D3D12_RESOURCE_BARRIER barrier;
-	barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;;
-	barrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
-	barrier.Transition.pResource = render_targets[frame_index].Get ();
-	barrier.Transition.StateBefore = D3D12_RESOURCE_STATE_PRESENT;
-	barrier.Transition.StateAfter = D3D12_RESOURCE_STATE_RENDER_TARGET;
-	barrier.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
-
-	command_list->ResourceBarrier (1, &barrier);
-
-	D3D12_CPU_DESCRIPTOR_HANDLE rtv_handle;
-	rtv_handle.ptr = rtv_heap->GetCPUDescriptorHandleForHeapStart ().ptr + frame_index * rtv_descriptor_size;
-	command_list->OMSetRenderTargets (1, &rtv_handle, FALSE, nullptr);
-
-	//record commands
-	const float clear_color[] = { 0.0f, 0.0f, 0.0f, 1.0f };
-	command_list->ClearRenderTargetView (rtv_handle, clear_color, 0, nullptr);
-	command_list->IASetPrimitiveTopology (D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-	command_list->IASetVertexBuffers (0, 1, &vertex_buffer_view);
-
-	//draw our triangle
-	command_list->DrawInstanced (3, 1, 0, 0);
-
-	//indicate that the back buffer will now be used to present
-	barrier.Transition.pResource = render_targets[frame_index].Get ();
-	barrier.Transition.StateBefore = D3D12_RESOURCE_STATE_RENDER_TARGET;
-	barrier.Transition.StateAfter = D3D12_RESOURCE_STATE_PRESENT;
-	command_list->ResourceBarrier (1, &barrier);
+	//the frame is declared as a graph of passes; imported resources leave the graph in
+	//the state they came in, so the registry stays valid without the trackers
+	const GpuResourceHandle back_buffer_handle = ToGpuHandle (render_targets[frame_index].Get ());
+	const GpuResourceHandle mesh_buffer_handle = ToGpuHandle (mesh_buffer.Get ());
+	const GpuResourceStates back_buffer_state = resource_states.GetState (back_buffer_handle);
+	const GpuResourceStates mesh_buffer_state = resource_states.GetState (mesh_buffer_handle);
+
+	//one packet per visible submesh; the queue sorts and instances them and the scene jobs record its groups
+	draw_queue->Reset ();
+	draw_queue->SetPipeline (scene_pipeline_id, shader_reloader->Get (scene_pipeline), GPU_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	//the mesh is drawn from the frame its copy is handed over in
+	if (mesh_ready)
+		for (uint32_t submesh : visible_submeshes)
+			draw_queue->Submit (MakeDrawSortKey (0, DRAW_ORDER_STATE, scene_root_signature_id, scene_pipeline_id, mesh_geometries[submesh], 0.0f), 0);
+	draw_queue->Build (indirect_draws);
+	//one scene job per thread of the job system, as far as there are groups to share
+	scene_jobs = recorder->GetJobCount (draw_queue->GetGroupCount (), min_scene_groups_per_job);
+	indirect_buffers.arguments = 0;
+	const std::vector<uint8_t> &indirect_arguments = draw_queue->GetIndirectArguments ();
+	if (!indirect_arguments.empty ())
+	{
+		//upload memory is in the generic read state, which includes indirect arguments
+		const UploadAllocation arguments = upload->Allocate (indirect_arguments.size (), sizeof (uint32_t));
+		memcpy (arguments.cpu_address, indirect_arguments.data (), indirect_arguments.size ());
+		indirect_buffers.arguments = arguments.resource;
+		indirect_buffers.arguments_offset = arguments.offset;
+	}
+	render_graph->Reset ();
+	const RenderGraphResource back_buffer = render_graph->Import ("back_buffer", back_buffer_handle, back_buffer_state, back_buffer_state);
+	const RenderGraphResource mesh_data = render_graph->Import ("mesh_buffer", mesh_buffer_handle, mesh_buffer_state, mesh_buffer_state);
+
+	const RenderGraphPass clear_pass = render_graph->AddPass ("clear", 1,
+															  [this] (uint32_t, GpuCommandList *job_command_list)
+															  {
+																  const float clear_color[] = { 0.0f, 0.0f, 0.0f, 1.0f };
+																  job_command_list->ClearRenderTargetView (render_target_views[frame_index].handle, clear_color);
+															  });
+	render_graph->Write (clear_pass, back_buffer, GPU_RESOURCE_STATE_RENDER_TARGET);
+
+	const RenderGraphPass scene_pass = render_graph->AddPass ("scene", scene_jobs,
+															  [this] (uint32_t job, GpuCommandList *job_command_list)
+															  {
+																  RecordScene (job, job_command_list);
+															  });
+	if (mesh_ready)
+		render_graph->Read (scene_pass, mesh_data, GPU_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER | GPU_RESOURCE_STATE_INDEX_BUFFER);
+	render_graph->Write (scene_pass, back_buffer, GPU_RESOURCE_STATE_RENDER_TARGET);
+	render_graph->Compile ();
+
+	//every job of the graph is recorded into its own command list in parallel
+	recorder->Record (render_graph->GetJobCount (),
+					  [this] (uint32_t job, GpuCommandList *job_command_list, ResourceStateTracker *)
+					  {
+						  render_graph->RecordJob (job, job_command_list);
+					  },
+					  shader_reloader->Get (scene_pipeline),
+					  scheduler->GetCompletedFenceValue ());
+}
 
-	THROWIFFAILED (command_list->Close (), "Can not close command list");
+void Graphics::RecordScene (UINT job, GpuCommandList *job_command_list)
+{
+	PROFILE_SCOPE ("RecordScene");
+	const GpuDescriptorHandle rtv_handle = render_target_views[frame_index].handle;
+
+	//states do not carry over between command lists, so every scene job sets the pass state;
+	//the draw queue sets the rest of it when it changes
+	job_command_list->SetViewports (1, reinterpret_cast<const GpuViewport*>(&viewport));
+	job_command_list->SetScissorRects (1, reinterpret_cast<const GpuRect*>(&scissor_rect));
+	job_command_list->SetRenderTargets (1, &rtv_handle, nullptr);
+	//the bindless table is in the shader visible heap
+	const GpuDescriptorHeapHandle descriptor_heap = shader_descriptors->GetHeap ();
+	job_command_list->SetDescriptorHeaps (1, &descriptor_heap);
+
+	//each job records its share of the draw groups
+	const UINT group_count = draw_queue->GetGroupCount ();
+	const UINT first_group = group_count * job / scene_jobs;
+	const UINT last_group = group_count * (job + 1) / scene_jobs;
+	draw_queue->Record (job_command_list, first_group, last_group - first_group, nullptr,
+						indirect_buffers.arguments ? &indirect_buffers : nullptr);
 }
 
 void Graphics::WaitForGpu ()
 {
-	THROWIFFAILED (command_queue->Signal (fence.Get (), fence_values[frame_index]), "Can not shedule a signal command");
-
-	THROWIFFAILED (fence->SetEventOnCompletion (fence_values[frame_index], fence_event), "Can not set event");
-	WaitForSingleObjectEx (fence_event, INFINITE, FALSE);
-
-	fence_values[frame_index]++;
+	PROFILE_FUNCTION ();
+	scheduler->WaitForIdle ();
 }
 
 void Graphics::NextFrame ()
 {
-	const UINT64 current_fence_value = fence_values[frame_index];
-	THROWIFFAILED (command_queue->Signal (fence.Get (), current_fence_value), "Can not shedule a signal command");
-
-	//update the frame index
+	PROFILE_FUNCTION ();
+	//upload memory and descriptor tables of the frame are reused once its fence passes
+	upload->FinishFrame (scheduler->GetFrameFenceValue ());
+	shader_descriptors->FinishFrame (scheduler->GetFrameFenceValue ());
+	bindless->Recycle (scheduler->GetCompletedFenceValue ());
+	scheduler->EndFrame ();
+
+	//update the frame index; the wait for a free slot happens in the next Update ()
 	frame_index = swap_chain->GetCurrentBackBufferIndex ();
-
-	//wait until the next frame is ready to be rendered
-	if (fence->GetCompletedValue () < fence_values[frame_index])
-	{
-		THROWIFFAILED (fence->SetEventOnCompletion (fence_values[frame_index], fence_event), "Can not set event");
-		WaitForSingleObjectEx (fence_event, INFINITE, FALSE);
-	}
-
-	//set the fence value for the next frame
-	fence_values[frame_index] = current_fence_value + 1;
 }
 
 std::wstring Graphics::GetAssetPath (LPCWSTR name)
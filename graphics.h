@@ -1,6 +1,21 @@
 #pragma once
 #include "stdafx.h"
 #include "errors.h"
+#include "profiler.h"
+#include "d3d12_device.h"
+#include "d3d_shader_compiler.h"
+#include "shader_reload.h"
+#include "mesh_import.h"
+#include "mesh_optimize.h"
+#include "vertex_format.h"
+#include "frame_scheduler.h"
+#include "job_system.h"
+#include "command_recorder.h"
+#include "draw_queue.h"
+#include "visibility.h"
+#include "scene.h"
+#include "bindless.h"
+#include "asset_streamer.h"
 
 using namespace DirectX;
 using Microsoft::WRL::ComPtr;
@@ -18,47 +33,155 @@ public:
 	void Update ();
 	void Render ();
 	void Resize (int window_width, int window_height);
+	//1 to max_frames_in_flight frames; may be called before Init
+	void SetFrameLatency (UINT frames_count, FramePacingPolicy policy);
+	UINT GetFramesInFlight () const
+	{
+		return frames_in_flight;
+	}
+	FramePacingPolicy GetFramePolicy () const
+	{
+		return frame_policy;
+	}
+	//waits until the swap chain takes another frame and paces its start, the input of the
+	//frame is sampled after it; Update calls it if the application did not
+	void WaitForFrame ();
+	//the frame rate cap is used by capped mode, 0 keeps the last one; may be called before Init
+	void SetPresentMode (PresentMode mode, float fps_cap);
+	PresentMode GetPresentMode () const
+	{
+		return present_options.mode;
+	}
+	float GetFpsCap () const
+	{
+		return present_options.fps_cap;
+	}
+	//available after Init; jobs can be used from the thread that called Init
+	JobSystem *GetJobSystem ()
+	{
+		return job_system.get ();
+	}
+	void LogMemoryStats () const;
+	//tasks run in parallel by Update every frame
+	JobGraph &GetUpdateGraph ()
+	{
+		return update_graph;
+	}
+	//entities moved by the update graph get their world matrices in the same Update
+	Scene &GetScene ()
+	{
+		return scene;
+	}
+	//draws the scene with ExecuteIndirect instead of direct draws, from the next frame
+	void SetIndirectDraws (bool enabled)
+	{
+		indirect_draws = enabled;
+	}
 private:
 	void LoadPipeline ();
 	void LoadAssets ();
 	void CreateFrameBuffers ();
-	void CreateVertexBuffers ();
+	void OpenMesh ();
+	void CreateMeshBuffers ();
 	void RecordCommandList ();
+	void RecordScene (UINT job, GpuCommandList *job_command_list);
 	void WaitForGpu ();
 	void NextFrame ();
+	void ResizeSwapChain ();
 	std::wstring GetAssetPath (LPCWSTR name);
 
 	std::wstring assets_path;
 
-	struct Vertex
-	{
-		XMFLOAT3 position;
-		XMFLOAT4 color;
-	};
+	std::unique_ptr<JobSystem> job_system;
+	JobGraph update_graph;
+	Scene scene;
 
-	static const UINT frame_count = 2;
+	UINT frames_in_flight;
+	FramePacingPolicy frame_policy;
+	//flip model swap chains need at least two buffers
+	UINT GetBufferCount () const
+	{
+		return frames_in_flight < 2 ? 2 : frames_in_flight;
+	}
+	//low latency frames are not queued behind another one, which the vsync pacing relies on
+	UINT GetMaxFrameLatency () const
+	{
+		return frame_policy == FRAME_POLICY_LOW_LATENCY ? 1 : frames_in_flight;
+	}
+	PresentOptions present_options;
 
 	D3D12_VIEWPORT viewport;
 	D3D12_RECT scissor_rect;
 	bool is_resize;
 	ComPtr<ID3D12Device> device;
 	ComPtr<ID3D12CommandQueue> command_queue;
+	std::unique_ptr<D3D12GpuDevice> gpu;
+	ComPtr<ID3D12CommandQueue> copy_command_queue;
+	std::unique_ptr<D3D12GpuDevice> copy_gpu;
 	ComPtr<IDXGISwapChain3> swap_chain;
-	ComPtr<ID3D12DescriptorHeap> rtv_heap;
-	UINT rtv_descriptor_size;
-	ComPtr<ID3D12CommandAllocator> command_allocators[frame_count];
-	ComPtr<ID3D12GraphicsCommandList> command_list;
-	ComPtr<ID3D12RootSignature> root_signature;
-	ComPtr<ID3D12PipelineState> pipeline_state;
-	ComPtr<ID3D12Resource> render_targets[frame_count];
+	std::unique_ptr<D3D12PresentBackend> present_backend;
+	std::unique_ptr<PresentController> presenter;
+	std::unique_ptr<D3D12DescriptorBackend> descriptor_backend;
+	std::unique_ptr<CpuDescriptorHeap> rtv_heap;
+	std::unique_ptr<ShaderDescriptorHeap> shader_descriptors;
+	std::unique_ptr<BindlessDescriptors> bindless;
+	CpuDescriptor render_target_views[max_frames_in_flight];
+	ResourceStateRegistry resource_states;
+	std::unique_ptr<CommandAllocatorPool> allocator_pool;
+	std::unique_ptr<ParallelCommandRecorder> recorder;
+	UINT scene_jobs;
+	std::unique_ptr<D3D12RootSignatureBackend> root_signature_backend;
+	std::unique_ptr<RootSignatureCache> root_signature_cache;
+	RootSignature scene_root_signature;
+	std::unique_ptr<D3DShaderCompiler> shader_compiler;
+	std::unique_ptr<ShaderCache> shader_cache;
+	std::unique_ptr<D3D12PipelineBackend> pipeline_backend;
+	std::unique_ptr<PipelineCache> pipeline_cache;
+	std::unique_ptr<ShaderReloader> shader_reloader;
+	ReloadablePipeline scene_pipeline;
+	//scene draws are sorted, instanced and recorded by the draw queue
+	std::unique_ptr<DrawQueue> draw_queue;
+	uint32_t scene_root_signature_id;
+	uint32_t scene_pipeline_id;
+	bool indirect_draws;
+	ComPtr<ID3D12CommandSignature> draw_signature;
+	ComPtr<ID3D12CommandSignature> draw_indexed_signature;
+	DrawIndirectBuffers indirect_buffers;     //arguments of the current frame
+	ComPtr<ID3D12Resource> render_targets[max_frames_in_flight];
 
-	ComPtr<ID3D12Resource> vertex_buffer;
-	ComPtr<ID3D12Resource> vertex_buffer_upload;
-	D3D12_VERTEX_BUFFER_VIEW vertex_buffer_view;
+	std::unique_ptr<D3D12UploadBackend> upload_backend;
+	std::unique_ptr<UploadAllocator> upload;
+	std::unique_ptr<AssetStreamer> streamer;
+	std::unique_ptr<D3D12HeapBackend> heap_backend;
+	//heaps of the allocator are tracked for residency under the video memory budget
+	std::unique_ptr<D3D12ResidencyBackend> residency_backend;
+	std::unique_ptr<ResidencyManager> residency;
+	std::vector<GpuHeapHandle> frame_heaps;     //used by the current frame
+	std::unique_ptr<GpuMemoryAllocator> gpu_memory;
+	std::unique_ptr<D3D12RenderGraphBackend> render_graph_backend;
+	std::unique_ptr<RenderGraph> render_graph;
+
+	//mapped until the streamer read the streams from it
+	MappedFile mesh_file;
+	StreamId mesh_stream;
+	bool mesh_ready;
+	MeshView mesh;
+	//vertex and index streams in one buffer
+	ComPtr<ID3D12Resource> mesh_buffer;
+	GpuMemoryAllocation mesh_buffer_memory;
+	//draw queue geometry of every submesh
+	std::vector<uint32_t> mesh_geometries;
+	//submesh bounds, culled by Update for the draws of the frame
+	VisibilityScene mesh_visibility;
+	std::vector<uint32_t> visible_submeshes;
+	//root constants of the vertex shader, they expand the quantized positions
+	struct MeshConstants
+	{
+		float position_scale[4];
+		float position_bias[4];
+	};
 
 	//for synchronization
-	UINT frame_index;
-	HANDLE fence_event;
-	ComPtr<ID3D12Fence> fence;
-	UINT64 fence_values[frame_count];
+	UINT frame_index;    //current back buffer
+	std::unique_ptr<FrameScheduler> scheduler;
 };
@@ -0,0 +1,454 @@
+#include "job_system.h"
+#include "profiler.h"
+
+#include <stdio.h>
+#include <stdexcept>
+
+//spin rounds of an idle worker before it goes to sleep
+static const uint32_t idle_spin_count = 64;
+
+static thread_local JobSystem *current_system = nullptr;
+static thread_local uint32_t current_index = 0;
+
+JobGraph::JobGraph () :
+	validated (false)
+{
+}
+
+JobGraph::Node JobGraph::AddNode (std::function<void ()> task)
+{
+	nodes.emplace_back ();
+	NodeData &node = nodes.back ();
+	node.task = std::move (task);
+	node.dependency_count = 0;
+	node.pending_dependencies.store (0, std::memory_order_relaxed);
+	validated = false;
+	return static_cast<Node>(nodes.size () - 1);
+}
+
+void JobGraph::AddDependency (Node before, Node after)
+{
+	if (before >= nodes.size () || after >= nodes.size ())
+		throw std::out_of_range ("Job graph node does not exist");
+	if (before == after)
+		throw std::logic_error ("Job graph node can not depend on itself");
+	nodes[before].successors.push_back (after);
+	nodes[after].dependency_count++;
+	validated = false;
+}
+
+void JobGraph::Clear ()
+{
+	nodes.clear ();
+	roots.clear ();
+	validated = false;
+}
+
+JobSystem::JobDeque::JobDeque () :
+	top (0),
+	bottom (0),
+	items (new std::atomic<Job*>[job_ring_size])
+{
+	for (uint32_t i = 0; i < job_ring_size; i++)
+		items[i].store (nullptr, std::memory_order_relaxed);
+}
+
+//owner only; never overflows since every queued job holds a slot of the owner's job ring
+void JobSystem::JobDeque::Push (Job *job)
+{
+	const int64_t b = bottom.load (std::memory_order_relaxed);
+	items[b & (job_ring_size - 1)].store (job, std::memory_order_release);
+	std::atomic_thread_fence (std::memory_order_release);
+	bottom.store (b + 1, std::memory_order_relaxed);
+}
+
+//owner only
+JobSystem::Job *JobSystem::JobDeque::Pop ()
+{
+	const int64_t b = bottom.load (std::memory_order_relaxed) - 1;
+	bottom.store (b, std::memory_order_relaxed);
+	std::atomic_thread_fence (std::memory_order_seq_cst);
+	int64_t t = top.load (std::memory_order_relaxed);
+	if (t > b)
+	{
+		bottom.store (b + 1, std::memory_order_relaxed);
+		return nullptr;
+	}
+	Job *job = items[b & (job_ring_size - 1)].load (std::memory_order_relaxed);
+	if (t == b)
+	{
+		//last item, race against thieves
+		if (!top.compare_exchange_strong (t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+			job = nullptr;
+		bottom.store (b + 1, std::memory_order_relaxed);
+	}
+	return job;
+}
+
+JobSystem::Job *JobSystem::JobDeque::Steal ()
+{
+	int64_t t = top.load (std::memory_order_acquire);
+	std::atomic_thread_fence (std::memory_order_seq_cst);
+	const int64_t b = bottom.load (std::memory_order_acquire);
+	if (t >= b)
+		return nullptr;
+	Job *job = items[t & (job_ring_size - 1)].load (std::memory_order_acquire);
+	if (!top.compare_exchange_strong (t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+		return nullptr;
+	return job;
+}
+
+bool JobSystem::JobDeque::IsEmpty () const
+{
+	return bottom.load (std::memory_order_seq_cst) <= top.load (std::memory_order_seq_cst);
+}
+
+JobSystem::JobSystem (uint32_t worker_count) :
+	sleeping (0),
+	stop (false)
+{
+	if (current_system)
+		throw std::logic_error ("Thread already belongs to a job system");
+	for (uint32_t i = 0; i <= worker_count; i++)
+	{
+		workers.push_back (std::unique_ptr<Worker> (new Worker ()));
+		Worker &worker = *workers.back ();
+		worker.jobs.reset (new Job[job_ring_size]);
+		for (uint32_t j = 0; j < job_ring_size; j++)
+			worker.jobs[j].busy.store (false, std::memory_order_relaxed);
+		worker.next_job = 0;
+		worker.random_state = 0x9E3779B9u * (i + 1);
+		worker.executed_jobs.store (0, std::memory_order_relaxed);
+		worker.stolen_jobs.store (0, std::memory_order_relaxed);
+		worker.sleeps.store (0, std::memory_order_relaxed);
+	}
+	current_system = this;
+	current_index = 0;
+	for (uint32_t i = 1; i <= worker_count; i++)
+		workers[i]->thread = std::thread (&JobSystem::WorkerThread, this, i);
+}
+
+JobSystem::~JobSystem ()
+{
+	{
+		std::lock_guard<std::mutex> lock (sleep_mutex);
+		stop.store (true, std::memory_order_seq_cst);
+	}
+	sleep_cv.notify_all ();
+	for (size_t i = 1; i < workers.size (); i++)
+		workers[i]->thread.join ();
+	if (current_system == this)
+		current_system = nullptr;
+}
+
+uint32_t JobSystem::GetCurrentThreadIndex () const
+{
+	if (current_system != this)
+		throw std::logic_error ("Thread does not belong to the job system");
+	return current_index;
+}
+
+void JobSystem::Spawn (std::function<void ()> task, JobCounter &counter)
+{
+	Worker &worker = GetCurrentWorker ();
+	Job *job = AllocateJob (worker, ExecuteTask, nullptr, 0, 0, &counter);
+	job->task = std::move (task);
+	counter.pending.fetch_add (1, std::memory_order_relaxed);
+	Push (worker, job);
+}
+
+void JobSystem::Wait (JobCounter &counter)
+{
+	Worker &worker = GetCurrentWorker ();
+	while (!counter.IsDone ())
+		if (!RunOne (worker))
+			std::this_thread::yield ();
+
+	if (counter.failed.load (std::memory_order_acquire))
+	{
+		std::exception_ptr exception = counter.exception;
+		counter.exception = nullptr;
+		counter.failed.store (false, std::memory_order_relaxed);
+		std::rethrow_exception (exception);
+	}
+}
+
+void JobSystem::Run (JobGraph &graph)
+{
+	if (graph.nodes.empty ())
+		return;
+	if (!graph.validated)
+		ValidateGraph (graph);
+
+	Worker &worker = GetCurrentWorker ();
+	for (JobGraph::NodeData &node : graph.nodes)
+		node.pending_dependencies.store (node.dependency_count, std::memory_order_relaxed);
+	graph.counter.pending.store (static_cast<uint32_t>(graph.nodes.size ()), std::memory_order_relaxed);
+	for (JobGraph::Node root : graph.roots)
+		Push (worker, AllocateJob (worker, ExecuteGraphNode, &graph, root, root + 1, &graph.counter));
+	Wait (graph.counter);
+}
+
+void JobSystem::ParallelFor (uint32_t count, uint32_t min_chunk, const RangeFunction &body)
+{
+	const uint32_t grain = min_chunk ? min_chunk : 1;
+	if (count <= grain || workers.size () == 1)
+	{
+		if (count)
+			body (0, count);
+		return;
+	}
+
+	Worker &worker = GetCurrentWorker ();
+	RangeData data = { &body, grain };
+	JobCounter counter;
+	try
+	{
+		RunRange (worker, data, counter, 0, count);
+	}
+	catch (...)
+	{
+		SetException (counter);
+	}
+	//spawned subranges point into this frame, so always wait for them
+	Wait (counter);
+}
+
+JobSystemStats JobSystem::GetStats () const
+{
+	JobSystemStats stats = {};
+	for (const auto &worker : workers)
+	{
+		stats.executed_jobs += worker->executed_jobs.load (std::memory_order_relaxed);
+		stats.stolen_jobs += worker->stolen_jobs.load (std::memory_order_relaxed);
+		stats.sleeps += worker->sleeps.load (std::memory_order_relaxed);
+	}
+	return stats;
+}
+
+void JobSystem::WorkerThread (uint32_t index)
+{
+	current_system = this;
+	current_index = index;
+	#if ENABLE_PROFILER
+	char name[32];
+	snprintf (name, sizeof (name), "Job worker %u", index);
+	PROFILE_THREAD_NAME (name);
+	#endif
+
+	Worker &worker = *workers[index];
+	uint32_t idle_rounds = 0;
+	while (!stop.load (std::memory_order_relaxed))
+	{
+		if (RunOne (worker))
+		{
+			idle_rounds = 0;
+			continue;
+		}
+		if (++idle_rounds < idle_spin_count)
+		{
+			std::this_thread::yield ();
+			continue;
+		}
+
+		//pushers check the sleeper count after publishing a job, so either they see us
+		//here or we see their job in HasWork ()
+		std::unique_lock<std::mutex> lock (sleep_mutex);
+		sleeping.fetch_add (1, std::memory_order_seq_cst);
+		if (!HasWork () && !stop.load (std::memory_order_relaxed))
+		{
+			worker.sleeps.fetch_add (1, std::memory_order_relaxed);
+			sleep_cv.wait (lock);
+		}
+		sleeping.fetch_sub (1, std::memory_order_relaxed);
+		idle_rounds = 0;
+	}
+}
+
+JobSystem::Worker &JobSystem::GetCurrentWorker () const
+{
+	if (current_system != this)
+		throw std::logic_error ("Jobs can only be used on threads of the job system");
+	return *workers[current_index];
+}
+
+JobSystem::Job *JobSystem::AllocateJob (Worker &worker, void (*execute) (JobSystem&, Worker&, Job&), void *data, uint32_t begin, uint32_t end, JobCounter *counter)
+{
+	Job *job = &worker.jobs[worker.next_job & (job_ring_size - 1)];
+	//the slot is still queued or running, help until it is free
+	while (job->busy.load (std::memory_order_acquire))
+		if (!RunOne (worker))
+			std::this_thread::yield ();
+	worker.next_job++;
+
+	job->busy.store (true, std::memory_order_relaxed);
+	job->execute = execute;
+	job->data = data;
+	job->begin = begin;
+	job->end = end;
+	job->counter = counter;
+	return job;
+}
+
+void JobSystem::Push (Worker &worker, Job *job)
+{
+	worker.deque.Push (job);
+	std::atomic_thread_fence (std::memory_order_seq_cst);
+	if (sleeping.load (std::memory_order_relaxed))
+	{
+		std::lock_guard<std::mutex> lock (sleep_mutex);
+		sleep_cv.notify_one ();
+	}
+}
+
+bool JobSystem::RunOne (Worker &worker)
+{
+	Job *job = worker.deque.Pop ();
+	if (!job)
+		job = Steal (worker);
+	if (!job)
+		return false;
+	Execute (worker, job);
+	return true;
+}
+
+JobSystem::Job *JobSystem::Steal (Worker &worker)
+{
+	const uint32_t count = static_cast<uint32_t>(workers.size ());
+	if (count == 1)
+		return nullptr;
+	//xorshift to spread thieves over victims
+	worker.random_state ^= worker.random_state << 13;
+	worker.random_state ^= worker.random_state >> 17;
+	worker.random_state ^= worker.random_state << 5;
+	const uint32_t start = worker.random_state % count;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		Worker &victim = *workers[(start + i) % count];
+		if (&victim == &worker)
+			continue;
+		Job *job = victim.deque.Steal ();
+		if (job)
+		{
+			worker.stolen_jobs.fetch_add (1, std::memory_order_relaxed);
+			return job;
+		}
+	}
+	return nullptr;
+}
+
+void JobSystem::Execute (Worker &worker, Job *job)
+{
+	JobCounter *counter = job->counter;
+	try
+	{
+		job->execute (*this, worker, *job);
+	}
+	catch (...)
+	{
+		SetException (*counter);
+	}
+	job->task = nullptr;
+	worker.executed_jobs.fetch_add (1, std::memory_order_relaxed);
+	counter->pending.fetch_sub (1, std::memory_order_acq_rel);
+	job->busy.store (false, std::memory_order_release);
+}
+
+bool JobSystem::HasWork () const
+{
+	for (const auto &worker : workers)
+		if (!worker->deque.IsEmpty ())
+			return true;
+	return false;
+}
+
+void JobSystem::RunRange (Worker &worker, RangeData &data, JobCounter &counter, uint32_t begin, uint32_t end)
+{
+	//ranges shorter than two grains are not split, so no call gets less than a grain
+	while (end - begin >= 2ull * data.grain)
+	{
+		if (worker.deque.IsEmpty ())
+		{
+			//nothing left for thieves, offer them the upper half
+			const uint32_t middle = begin + (end - begin) / 2;
+			counter.pending.fetch_add (1, std::memory_order_relaxed);
+			Push (worker, AllocateJob (worker, ExecuteRange, &data, middle, end, &counter));
+			end = middle;
+		}
+		else
+		{
+			(*data.body) (begin, begin + data.grain);
+			begin += data.grain;
+		}
+	}
+	(*data.body) (begin, end);
+}
+
+void JobSystem::SetException (JobCounter &counter)
+{
+	if (!counter.failed.exchange (true, std::memory_order_acq_rel))
+		counter.exception = std::current_exception ();
+}
+
+void JobSystem::ValidateGraph (JobGraph &graph)
+{
+	//Kahn's algorithm: every node must be reachable in topological order
+	const size_t count = graph.nodes.size ();
+	std::vector<uint32_t> dependencies (count);
+	std::vector<JobGraph::Node> ready;
+	graph.roots.clear ();
+	for (size_t i = 0; i < count; i++)
+	{
+		dependencies[i] = graph.nodes[i].dependency_count;
+		if (!dependencies[i])
+		{
+			graph.roots.push_back (static_cast<JobGraph::Node>(i));
+			ready.push_back (static_cast<JobGraph::Node>(i));
+		}
+	}
+	size_t visited = 0;
+	while (!ready.empty ())
+	{
+		const JobGraph::Node node = ready.back ();
+		ready.pop_back ();
+		visited++;
+		for (JobGraph::Node successor : graph.nodes[node].successors)
+			if (--dependencies[successor] == 0)
+				ready.push_back (successor);
+	}
+	if (visited != count)
+		throw std::logic_error ("Job graph has a dependency cycle");
+	graph.validated = true;
+}
+
+void JobSystem::ExecuteTask (JobSystem &, Worker &, Job &job)
+{
+	job.task ();
+}
+
+void JobSystem::ExecuteRange (JobSystem &system, Worker &worker, Job &job)
+{
+	RangeData &data = *static_cast<RangeData*>(job.data);
+	system.RunRange (worker, data, *job.counter, job.begin, job.end);
+}
+
+void JobSystem::ExecuteGraphNode (JobSystem &system, Worker &worker, Job &job)
+{
+	JobGraph &graph = *static_cast<JobGraph*>(job.data);
+	JobGraph::NodeData &node = graph.nodes[job.begin];
+	if (!graph.counter.failed.load (std::memory_order_relaxed))
+	{
+		try
+		{
+			node.task ();
+		}
+		catch (...)
+		{
+			SetException (graph.counter);
+		}
+	}
+	//continuations: the last finished dependency starts the successor
+	for (JobGraph::Node successor : node.successors)
+		if (graph.nodes[successor].pending_dependencies.fetch_sub (1, std::memory_order_acq_rel) == 1)
+			system.Push (worker, system.AllocateJob (worker, ExecuteGraphNode, &graph, successor, successor + 1, &graph.counter));
+}
@@ -0,0 +1,183 @@
+#pragma once
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//Work-stealing job system. Every thread owns a Chase-Lev deque: the owner pushes and
+//pops jobs at the bottom, idle threads steal from the top. The thread that creates the
+//system becomes worker 0 and runs jobs while it waits; jobs may only be spawned and
+//waited for on threads of the system.
+
+//jobs a thread may have in flight at once; also the capacity of its deque
+static const uint32_t job_ring_size = 4096;
+
+//unfinished jobs of a group and the first exception thrown by one of them
+class JobCounter
+{
+public:
+	JobCounter () :
+		pending (0),
+		failed (false)
+	{
+	}
+	bool IsDone () const
+	{
+		return pending.load (std::memory_order_acquire) == 0;
+	}
+private:
+	friend class JobSystem;
+	JobCounter (const JobCounter &) = delete;
+	JobCounter &operator= (const JobCounter &) = delete;
+
+	std::atomic<uint32_t> pending;
+	std::atomic<bool> failed;
+	std::exception_ptr exception;
+};
+
+//tasks with explicit dependencies; built once and run as many times as needed
+class JobGraph
+{
+public:
+	typedef uint32_t Node;
+
+	JobGraph ();
+	Node AddNode (std::function<void ()> task);
+	//after starts only once before is finished
+	void AddDependency (Node before, Node after);
+	void Clear ();
+	size_t GetNodeCount () const
+	{
+		return nodes.size ();
+	}
+private:
+	friend class JobSystem;
+	struct NodeData
+	{
+		std::function<void ()> task;
+		std::vector<Node> successors;
+		uint32_t dependency_count;
+		std::atomic<uint32_t> pending_dependencies;    //continuation counter of the current run
+	};
+
+	JobGraph (const JobGraph &) = delete;
+	JobGraph &operator= (const JobGraph &) = delete;
+
+	std::deque<NodeData> nodes;
+	std::vector<Node> roots;
+	bool validated;
+	JobCounter counter;
+};
+
+struct JobSystemStats
+{
+	uint64_t executed_jobs;
+	uint64_t stolen_jobs;
+	uint64_t sleeps;
+};
+
+class JobSystem
+{
+public:
+	typedef std::function<void (uint32_t begin, uint32_t end)> RangeFunction;
+
+	//worker_count threads in addition to the calling one
+	explicit JobSystem (uint32_t worker_count);
+	~JobSystem ();
+
+	uint32_t GetThreadCount () const
+	{
+		return static_cast<uint32_t>(workers.size ());
+	}
+	//index of the calling thread inside the system
+	uint32_t GetCurrentThreadIndex () const;
+
+	void Spawn (std::function<void ()> task, JobCounter &counter);
+	//runs other jobs until the counter reaches zero, then rethrows the first job exception
+	void Wait (JobCounter &counter);
+	//runs the graph to completion; nodes after a failed one are skipped
+	void Run (JobGraph &graph);
+	//calls body on disjoint subranges of [0, count) of at least min_chunk items; ranges are
+	//split in halves lazily, only while the splitting thread has no queued work of its own
+	void ParallelFor (uint32_t count, uint32_t min_chunk, const RangeFunction &body);
+
+	JobSystemStats GetStats () const;
+private:
+	struct Worker;
+	struct Job
+	{
+		void (*execute) (JobSystem &system, Worker &worker, Job &job);
+		void *data;
+		uint32_t begin;
+		uint32_t end;
+		JobCounter *counter;
+		std::function<void ()> task;
+		std::atomic<bool> busy;
+	};
+
+	//Chase-Lev deque of a fixed capacity, following Le et al. "Correct and efficient
+	//work-stealing for weak memory models"
+	class JobDeque
+	{
+	public:
+		JobDeque ();
+		void Push (Job *job);
+		Job *Pop ();
+		Job *Steal ();
+		bool IsEmpty () const;
+	private:
+		std::atomic<int64_t> top;
+		std::atomic<int64_t> bottom;
+		std::unique_ptr<std::atomic<Job*>[]> items;
+	};
+
+	struct Worker
+	{
+		JobDeque deque;
+		std::unique_ptr<Job[]> jobs;    //ring of job slots owned by the thread
+		uint32_t next_job;
+		uint32_t random_state;
+		std::atomic<uint64_t> executed_jobs;
+		std::atomic<uint64_t> stolen_jobs;
+		std::atomic<uint64_t> sleeps;
+		std::thread thread;
+	};
+
+	struct RangeData
+	{
+		const RangeFunction *body;
+		uint32_t grain;
+	};
+
+	JobSystem (const JobSystem &) = delete;
+	JobSystem &operator= (const JobSystem &) = delete;
+
+	void WorkerThread (uint32_t index);
+	Worker &GetCurrentWorker () const;
+	Job *AllocateJob (Worker &worker, void (*execute) (JobSystem&, Worker&, Job&), void *data, uint32_t begin, uint32_t end, JobCounter *counter);
+	void Push (Worker &worker, Job *job);
+	bool RunOne (Worker &worker);
+	Job *Steal (Worker &worker);
+	void Execute (Worker &worker, Job *job);
+	bool HasWork () const;
+	void RunRange (Worker &worker, RangeData &data, JobCounter &counter, uint32_t begin, uint32_t end);
+	static void SetException (JobCounter &counter);
+	static void ValidateGraph (JobGraph &graph);
+
+	static void ExecuteTask (JobSystem &system, Worker &worker, Job &job);
+	static void ExecuteRange (JobSystem &system, Worker &worker, Job &job);
+	static void ExecuteGraphNode (JobSystem &system, Worker &worker, Job &job);
+
+	std::vector<std::unique_ptr<Worker>> workers;
+	std::mutex sleep_mutex;
+	std::condition_variable sleep_cv;
+	std::atomic<uint32_t> sleeping;
+	std::atomic<bool> stop;
+};
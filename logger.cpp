@@ -0,0 +1,338 @@
+#include "logger.h"
+
+#include <string.h>
+#include <chrono>
+
+static const char *const severity_prefix[] =
+{
+	"DEBUG: ",
+	"",
+	"WARNING: ",
+	"ERROR: "
+};
+
+static const size_t max_batch_size = 256;
+static const char truncation_marker[] = "...";
+
+LoggerDesc::LoggerDesc () :
+	file_name ("log.txt"),
+	capacity (4096),
+	min_severity (LOG_SEVERITY_INFO),
+	flush_policy (LOG_FLUSH_INTERVAL),
+	flush_interval_ms (100),
+	overflow_mode (LOG_OVERFLOW_BLOCK)
+{
+}
+
+Logger::Logger () :
+	f (nullptr),
+	records (nullptr),
+	mask (0),
+	enqueue_pos (0),
+	min_severity (LOG_SEVERITY_INFO),
+	dropped (0),
+	truncated (0),
+	dequeue_pos (0),
+	written (0),
+	reported_dropped (0),
+	cached_time (0),
+	cached_time_length (0),
+	writer_waiting (false),
+	flush_requested (false),
+	flushed_pos (0),
+	stop (false)
+{
+	cached_time_str[0] = '\0';
+}
+
+Logger::~Logger ()
+{
+	Close ();
+}
+
+bool Logger::Open (const LoggerDesc &logger_desc)
+{
+	if (IsOpen ())
+		return false;
+
+	#ifdef _WIN32
+	if (fopen_s (&f, logger_desc.file_name, "w"))
+		f = nullptr;
+	#else
+	f = fopen (logger_desc.file_name, "w");
+	#endif
+	if (!f)
+		return false;
+	//the writer thread batches on its own, so give stdio a large buffer
+	setvbuf (f, nullptr, _IOFBF, 64 * 1024);
+
+	desc = logger_desc;
+	size_t capacity = 2;
+	while (capacity < desc.capacity)
+		capacity <<= 1;
+	records = new Record[capacity];
+	for (size_t i = 0; i < capacity; i++)
+		records[i].sequence.store (i, std::memory_order_relaxed);
+	mask = capacity - 1;
+
+	enqueue_pos.store (0, std::memory_order_relaxed);
+	dequeue_pos = 0;
+	flushed_pos.store (0, std::memory_order_relaxed);
+	min_severity.store (desc.min_severity, std::memory_order_relaxed);
+	dropped.store (0, std::memory_order_relaxed);
+	truncated.store (0, std::memory_order_relaxed);
+	written.store (0, std::memory_order_relaxed);
+	reported_dropped = 0;
+	cached_time = 0;
+	stop = false;
+
+	writer = std::thread (&Logger::WriterThread, this);
+	return true;
+}
+
+void Logger::Close ()
+{
+	if (!IsOpen ())
+		return;
+	{
+		std::lock_guard<std::mutex> lock (mutex);
+		stop = true;
+	}
+	wake_cv.notify_one ();
+	writer.join ();
+
+	fclose (f);
+	f = nullptr;
+	delete[] records;
+	records = nullptr;
+}
+
+bool Logger::IsOpen () const
+{
+	return f != nullptr;
+}
+
+void Logger::SetMinSeverity (LogSeverity severity)
+{
+	min_severity.store (severity, std::memory_order_relaxed);
+}
+
+bool Logger::IsEnabled (LogSeverity severity) const
+{
+	return records != nullptr && severity >= min_severity.load (std::memory_order_relaxed);
+}
+
+void Logger::Write (LogSeverity severity, const char *format_str, va_list args)
+{
+	if (!IsEnabled (severity))
+		return;
+
+	//reserve a slot (Vyukov bounded queue, multiple producers)
+	Record *record;
+	size_t pos = enqueue_pos.load (std::memory_order_relaxed);
+	for (;;)
+	{
+		record = &records[pos & mask];
+		size_t sequence = record->sequence.load (std::memory_order_acquire);
+		intptr_t dif = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+		if (dif == 0)
+		{
+			if (enqueue_pos.compare_exchange_weak (pos, pos + 1, std::memory_order_relaxed))
+				break;
+		}
+		else if (dif < 0)
+		{
+			//ring is full
+			if (desc.overflow_mode == LOG_OVERFLOW_DROP)
+			{
+				dropped.fetch_add (1, std::memory_order_relaxed);
+				if (writer_waiting.load (std::memory_order_relaxed))
+					WakeWriter ();
+				return;
+			}
+			WakeWriter ();
+			std::this_thread::yield ();
+			pos = enqueue_pos.load (std::memory_order_relaxed);
+		}
+		else
+			pos = enqueue_pos.load (std::memory_order_relaxed);
+	}
+
+	//arguments can not outlive the call, so the message text is formatted here;
+	//timestamp formatting and file output are left to the writer thread
+	record->timestamp = time (nullptr);
+	record->severity = severity;
+	const int length = vsnprintf (record->message, max_message_length, format_str, args);
+	if (length >= static_cast<int>(max_message_length))
+	{
+		//the marker and its terminator replace the end of the cut message
+		memcpy (record->message + max_message_length - sizeof (truncation_marker), truncation_marker, sizeof (truncation_marker));
+		truncated.fetch_add (1, std::memory_order_relaxed);
+	}
+	record->sequence.store (pos + 1, std::memory_order_release);
+
+	if (severity == LOG_SEVERITY_ERROR)
+	{
+		flush_requested.store (true, std::memory_order_relaxed);
+		WakeWriter ();
+	}
+	else if (writer_waiting.load (std::memory_order_relaxed) && desc.flush_policy == LOG_FLUSH_EVERY_BATCH)
+		WakeWriter ();
+}
+
+void Logger::Flush ()
+{
+	if (!IsOpen ())
+		return;
+	const size_t target = enqueue_pos.load (std::memory_order_acquire);
+	std::unique_lock<std::mutex> lock (mutex);
+	//a record reserved before the call may still be in flight, so keep re-requesting
+	while (flushed_pos.load (std::memory_order_acquire) < target)
+	{
+		flush_requested.store (true, std::memory_order_release);
+		wake_cv.notify_one ();
+		flushed_cv.wait_for (lock, std::chrono::milliseconds (desc.flush_interval_ms ? desc.flush_interval_ms : 1));
+	}
+}
+
+uint64_t Logger::GetWrittenCount () const
+{
+	return written.load (std::memory_order_relaxed);
+}
+
+uint64_t Logger::GetDroppedCount () const
+{
+	return dropped.load (std::memory_order_relaxed);
+}
+
+uint64_t Logger::GetTruncatedCount () const
+{
+	return truncated.load (std::memory_order_relaxed);
+}
+
+void Logger::WakeWriter ()
+{
+	//notify without taking the mutex; a lost wakeup is bounded by the wait timeout
+	wake_cv.notify_one ();
+}
+
+void Logger::WriterThread ()
+{
+	typedef std::chrono::steady_clock clock;
+	const std::chrono::milliseconds interval (desc.flush_interval_ms ? desc.flush_interval_ms : 1);
+	clock::time_point last_flush = clock::now ();
+	bool dirty = false;
+	bool flush_pending = false;
+
+	for (;;)
+	{
+		//take the request before draining so that everything published before it is covered
+		if (flush_requested.exchange (false, std::memory_order_acquire))
+			flush_pending = true;
+		bool stopping;
+		{
+			std::lock_guard<std::mutex> lock (mutex);
+			stopping = stop;
+		}
+
+		size_t count = WriteBatch ();
+		if (stopping)
+		{
+			//drain whatever was published before Close ()
+			size_t batch;
+			while ((batch = WriteBatch ()) > 0)
+				count += batch;
+		}
+		//summarize drops once the ring is drained rather than between every batch
+		if ((count == 0 || stopping) && reported_dropped != dropped.load (std::memory_order_relaxed))
+		{
+			uint64_t current = dropped.load (std::memory_order_relaxed);
+			fprintf (f, "%s%s%llu log messages dropped\n", cached_time_str, severity_prefix[LOG_SEVERITY_WARNING],
+					 static_cast<unsigned long long>(current - reported_dropped));
+			reported_dropped = current;
+			count++;
+		}
+		if (count)
+			dirty = true;
+
+		bool do_flush = flush_pending || stopping;
+		if (!do_flush && dirty)
+		{
+			switch (desc.flush_policy)
+			{
+			case LOG_FLUSH_EVERY_BATCH:
+				do_flush = true;
+				break;
+			case LOG_FLUSH_INTERVAL:
+				do_flush = clock::now () - last_flush >= interval;
+				break;
+			case LOG_FLUSH_ON_ERROR:
+				break;
+			}
+		}
+		if (do_flush)
+		{
+			if (dirty)
+				fflush (f);
+			last_flush = clock::now ();
+			dirty = false;
+			flush_pending = false;
+			{
+				std::lock_guard<std::mutex> lock (mutex);
+				flushed_pos.store (dequeue_pos, std::memory_order_release);
+			}
+			flushed_cv.notify_all ();
+		}
+		if (stopping)
+			break;
+
+		if (count == 0)
+		{
+			std::unique_lock<std::mutex> lock (mutex);
+			if (stop || flush_requested.load (std::memory_order_relaxed))
+				continue;
+			writer_waiting.store (true, std::memory_order_relaxed);
+			wake_cv.wait_for (lock, interval);
+			writer_waiting.store (false, std::memory_order_relaxed);
+		}
+	}
+}
+
+size_t Logger::WriteBatch ()
+{
+	size_t count = 0;
+	while (count < max_batch_size)
+	{
+		Record &record = records[dequeue_pos & mask];
+		if (record.sequence.load (std::memory_order_acquire) != dequeue_pos + 1)
+			break;
+		WriteRecord (record);
+		record.sequence.store (dequeue_pos + mask + 1, std::memory_order_release);
+		dequeue_pos++;
+		count++;
+	}
+	if (count)
+		written.fetch_add (count, std::memory_order_relaxed);
+	return count;
+}
+
+void Logger::WriteRecord (const Record &record)
+{
+	//timestamp strings only change once per second, so cache the last one
+	if (record.timestamp != cached_time || cached_time_length == 0)
+	{
+		tm t;
+		#ifdef _WIN32
+		localtime_s (&t, &record.timestamp);
+		#else
+		localtime_r (&record.timestamp, &t);
+		#endif
+		cached_time_length = strftime (cached_time_str, sizeof (cached_time_str), "[%D %T] ", &t);
+		cached_time = record.timestamp;
+	}
+	fwrite (cached_time_str, 1, cached_time_length, f);
+	const char *prefix = severity_prefix[record.severity];
+	fwrite (prefix, 1, strlen (prefix), f);
+	fwrite (record.message, 1, strnlen (record.message, max_message_length), f);
+	fputc ('\n', f);
+}
@@ -0,0 +1,113 @@
+#pragma once
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+//Portable asynchronous logger. Producers format their message into a fixed size
+//record and push it into a lock-free bounded MPSC ring; a background thread adds
+//timestamps, writes records in batches and flushes according to the flush policy.
+
+enum LogSeverity
+{
+	LOG_SEVERITY_DEBUG,
+	LOG_SEVERITY_INFO,
+	LOG_SEVERITY_WARNING,
+	LOG_SEVERITY_ERROR
+};
+
+enum LogFlushPolicy
+{
+	LOG_FLUSH_EVERY_BATCH,   //flush the file after every written batch
+	LOG_FLUSH_INTERVAL,      //flush at most once per flush_interval_ms
+	LOG_FLUSH_ON_ERROR       //flush only after errors, explicit Flush () and Close ()
+};
+
+enum LogOverflowMode
+{
+	LOG_OVERFLOW_DROP,       //drop the message and count it
+	LOG_OVERFLOW_BLOCK       //spin until the writer thread frees a slot
+};
+
+struct LoggerDesc
+{
+	const char *file_name;
+	size_t capacity;                 //number of records in the ring, rounded up to a power of two
+	LogSeverity min_severity;
+	LogFlushPolicy flush_policy;
+	unsigned flush_interval_ms;
+	LogOverflowMode overflow_mode;
+
+	LoggerDesc ();
+};
+
+class Logger
+{
+public:
+	//longer messages are cut and end with "..."
+	static const size_t max_message_length = 240;
+
+	Logger ();
+	~Logger ();
+	bool Open (const LoggerDesc &desc);
+	void Close ();
+	bool IsOpen () const;
+
+	void SetMinSeverity (LogSeverity severity);
+	bool IsEnabled (LogSeverity severity) const;
+	void Write (LogSeverity severity, const char *format_str, va_list args);
+	//blocks until every record pushed before the call is written and flushed
+	void Flush ();
+
+	uint64_t GetWrittenCount () const;
+	uint64_t GetDroppedCount () const;
+	uint64_t GetTruncatedCount () const;
+private:
+	struct Record
+	{
+		std::atomic<size_t> sequence;
+		time_t timestamp;
+		LogSeverity severity;
+		char message[max_message_length];
+	};
+
+	void WriterThread ();
+	size_t WriteBatch ();
+	void WriteRecord (const Record &record);
+	void WakeWriter ();
+
+	Logger (const Logger &) = delete;
+	Logger &operator= (const Logger &) = delete;
+
+	FILE *f;
+	LoggerDesc desc;
+	Record *records;
+	size_t mask;
+
+	//producers
+	std::atomic<size_t> enqueue_pos;
+	std::atomic<int> min_severity;
+	std::atomic<uint64_t> dropped;
+	std::atomic<uint64_t> truncated;
+	//writer
+	size_t dequeue_pos;
+	std::atomic<uint64_t> written;
+	uint64_t reported_dropped;
+	time_t cached_time;
+	char cached_time_str[40];
+	size_t cached_time_length;
+
+	std::thread writer;
+	std::mutex mutex;
+	std::condition_variable wake_cv;
+	std::condition_variable flushed_cv;
+	std::atomic<bool> writer_waiting;
+	std::atomic<bool> flush_requested;
+	std::atomic<size_t> flushed_pos;
+	bool stop;
+};
@@ -14,6 +14,7 @@ int WINAPI WinMain (HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR cmd, int
 	}
 	catch (std::exception err)
 	{
+		FlushLog ();
 		PrintMessage ("An error occured. See log.txt for more information");
 		return 1;
 	}
@@ -0,0 +1,133 @@
+#include "mesh_import.h"
+#include "mesh_optimize.h"
+#include "vertex_format.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+//Offline mesh converter. Imports a source asset, optimizes it for the vertex cache,
+//overdraw and vertex fetch, quantizes its vertices and writes it as a mesh container
+//that the framework maps and uploads without parsing.
+//usage: mesh_convert [-float] [-no-optimize] <input.obj> <output.mesh>
+//  -float        keeps 32 bit float attributes
+//  -no-optimize  keeps the triangle and vertex order of the source
+
+static bool ReadText (const char *file_name, std::string &text)
+{
+	FILE *f = fopen (file_name, "rb");
+	if (!f)
+		return false;
+	char buffer[65536];
+	size_t read;
+	while ((read = fread (buffer, 1, sizeof (buffer), f)) > 0)
+		text.append (buffer, read);
+	const bool failed = ferror (f) != 0;
+	fclose (f);
+	return !failed;
+}
+
+static bool WriteFile (const char *file_name, const std::vector<uint8_t> &data)
+{
+	FILE *f = fopen (file_name, "wb");
+	if (!f)
+		return false;
+	bool written = fwrite (data.data (), 1, data.size (), f) == data.size ();
+	written = fclose (f) == 0 && written;
+	return written;
+}
+
+static bool HasExtension (const char *file_name, const char *extension)
+{
+	const size_t length = strlen (file_name);
+	const size_t extension_length = strlen (extension);
+	if (length < extension_length)
+		return false;
+	for (size_t i = 0; i < extension_length; i++)
+	{
+		char c = file_name[length - extension_length + i];
+		if (c >= 'A' && c <= 'Z')
+			c = c - 'A' + 'a';
+		if (c != extension[i])
+			return false;
+	}
+	return true;
+}
+
+int main (int argc, char **argv)
+{
+	VertexQuantization quantization = GetCompactVertexQuantization ();
+	bool optimize = true;
+	for (; argc > 3 && argv[1][0] == '-'; argv++, argc--)
+	{
+		if (strcmp (argv[1], "-float") == 0)
+			quantization = GetFloatVertexQuantization ();
+		else if (strcmp (argv[1], "-no-optimize") == 0)
+			optimize = false;
+		else
+			break;
+	}
+	if (argc != 3)
+	{
+		printf ("usage: mesh_convert [-float] [-no-optimize] <input.obj> <output.mesh>\n");
+		return 2;
+	}
+	if (!HasExtension (argv[1], ".obj"))
+	{
+		printf ("Unsupported input format %s, only .obj files are imported\n", argv[1]);
+		return 2;
+	}
+
+	try
+	{
+		std::string text;
+		if (!ReadText (argv[1], text))
+		{
+			printf ("Can not read %s\n", argv[1]);
+			return 1;
+		}
+		MeshData mesh;
+		std::vector<std::string> materials;
+		ImportObj (text, mesh, materials);
+		const uint32_t source_stride = mesh.vertex_stride;
+		MeshOptimizeStats stats;
+		if (optimize)
+			OptimizeMesh (mesh, mesh_overdraw_threshold, &stats);
+		MeshletData meshlets;
+		BuildMeshlets (mesh, meshlet_max_vertices, meshlet_max_triangles, meshlets);
+		QuantizeMesh (mesh, quantization, mesh);
+		std::vector<uint8_t> file;
+		WriteMeshFile (mesh, file);
+		if (!WriteFile (argv[2], file))
+		{
+			printf ("Can not write %s\n", argv[2]);
+			return 1;
+		}
+
+		printf ("%s: %u vertices of %u bytes (%u as floats), %u indices, %u submeshes, %zu bytes\n",
+				argv[2], mesh.GetVertexCount (), mesh.vertex_stride, source_stride, static_cast<uint32_t>(mesh.indices.size ()),
+				static_cast<uint32_t>(mesh.submeshes.size ()), file.size ());
+		for (const MeshSubmesh &submesh : mesh.submeshes)
+			printf ("  %s: %u triangles\n", materials[submesh.material].c_str (), submesh.index_count / 3);
+		if (optimize)
+		{
+			printf ("  vertices %u -> %u\n", stats.vertices_before, stats.vertices_after);
+			printf ("  ACMR %.3f -> %.3f, ATVR %.3f -> %.3f (%u entry FIFO)\n", stats.cache_before.acmr, stats.cache_after.acmr,
+					stats.cache_before.atvr, stats.cache_after.atvr, mesh_vertex_cache_size);
+			printf ("  overdraw %.3f -> %.3f\n", stats.overdraw_before.overdraw, stats.overdraw_after.overdraw);
+		}
+		const size_t meshlet_count = meshlets.meshlets.size ();
+		if (meshlet_count)
+			printf ("  %zu meshlets of %u/%u, %.1f vertices and %.1f triangles on average\n", meshlet_count,
+					meshlet_max_vertices, meshlet_max_triangles, static_cast<double>(meshlets.vertices.size ()) / meshlet_count,
+					static_cast<double>(meshlets.triangles.size ()) / 3 / meshlet_count);
+	}
+	catch (const std::exception &err)
+	{
+		printf ("%s: %s\n", argv[1], err.what ());
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,328 @@
+#include "mesh_file.h"
+
+#include <string.h>
+#include <algorithm>
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static_assert (sizeof (MeshFileHeader) == 240, "Mesh file header must not have padding");
+static_assert (sizeof (MeshSubmesh) == 40, "Mesh submesh must not have padding");
+
+//DXGI_FORMAT_R32G32B32_FLOAT
+static const uint32_t position_float3_format = 6;
+
+const char *GetMeshSemanticName (uint32_t semantic)
+{
+	static const char *const names[MESH_ATTRIBUTE_SEMANTIC_COUNT] = { "POSITION", "NORMAL", "TEXCOORD", "COLOR" };
+	if (semantic >= MESH_ATTRIBUTE_SEMANTIC_COUNT)
+		throw std::out_of_range ("Unknown mesh attribute semantic");
+	return names[semantic];
+}
+
+MeshData::MeshData () :
+	vertex_stride (0)
+{
+	for (uint32_t i = 0; i < 3; i++)
+	{
+		bounds_min[i] = bounds_max[i] = position_bias[i] = 0.0f;
+		position_scale[i] = 1.0f;
+	}
+}
+
+static uint64_t AlignOffset (uint64_t offset, uint64_t alignment)
+{
+	return (offset + alignment - 1) & ~(alignment - 1);
+}
+
+static void ResetBounds (float bounds_min[3], float bounds_max[3])
+{
+	for (uint32_t i = 0; i < 3; i++)
+	{
+		bounds_min[i] = 3.402823466e+38f;
+		bounds_max[i] = -3.402823466e+38f;
+	}
+}
+
+static void AddBounds (float bounds_min[3], float bounds_max[3], const float point[3])
+{
+	for (uint32_t i = 0; i < 3; i++)
+	{
+		bounds_min[i] = std::min (bounds_min[i], point[i]);
+		bounds_max[i] = std::max (bounds_max[i], point[i]);
+	}
+}
+
+//empty bounds collapse to the origin
+static void FinishBounds (float bounds_min[3], float bounds_max[3])
+{
+	if (bounds_min[0] > bounds_max[0])
+		for (uint32_t i = 0; i < 3; i++)
+			bounds_min[i] = bounds_max[i] = 0.0f;
+}
+
+void ComputeMeshBounds (MeshData &mesh)
+{
+	const MeshAttribute *position = nullptr;
+	for (const MeshAttribute &attribute : mesh.attributes)
+		if (attribute.semantic == MESH_ATTRIBUTE_POSITION && attribute.semantic_index == 0)
+			position = &attribute;
+	if (!position || position->format != position_float3_format)
+		throw std::invalid_argument ("Mesh bounds need R32G32B32_FLOAT positions");
+
+	const uint32_t vertex_count = mesh.GetVertexCount ();
+	ResetBounds (mesh.bounds_min, mesh.bounds_max);
+	for (MeshSubmesh &submesh : mesh.submeshes)
+	{
+		ResetBounds (submesh.bounds_min, submesh.bounds_max);
+		if (static_cast<uint64_t>(submesh.start_index) + submesh.index_count > mesh.indices.size ())
+			throw std::out_of_range ("Submesh indices are out of range");
+		for (uint32_t i = 0; i < submesh.index_count; i++)
+		{
+			const int64_t vertex = static_cast<int64_t>(mesh.indices[submesh.start_index + i]) + submesh.base_vertex;
+			if (vertex < 0 || vertex >= vertex_count)
+				throw std::out_of_range ("Mesh index is out of range");
+			float point[3];
+			memcpy (point, mesh.vertices.data () + vertex * mesh.vertex_stride + position->offset, sizeof (point));
+			AddBounds (submesh.bounds_min, submesh.bounds_max, point);
+		}
+		FinishBounds (submesh.bounds_min, submesh.bounds_max);
+		if (submesh.index_count)
+		{
+			AddBounds (mesh.bounds_min, mesh.bounds_max, submesh.bounds_min);
+			AddBounds (mesh.bounds_min, mesh.bounds_max, submesh.bounds_max);
+		}
+	}
+	FinishBounds (mesh.bounds_min, mesh.bounds_max);
+}
+
+void WriteMeshFile (const MeshData &mesh, std::vector<uint8_t> &file)
+{
+	if (mesh.attributes.size () > mesh_max_attributes)
+		throw std::invalid_argument ("Mesh has too many vertex attributes");
+	if (!mesh.vertex_stride || mesh.vertices.size () % mesh.vertex_stride)
+		throw std::invalid_argument ("Mesh vertex data is not a multiple of the stride");
+	if (mesh.vertices.size () / mesh.vertex_stride > 0xffffffffull || mesh.indices.size () > 0xffffffffull)
+		throw std::invalid_argument ("Mesh is too large");
+	uint32_t max_index = 0;
+	for (uint32_t index : mesh.indices)
+		max_index = std::max (max_index, index);
+
+	MeshFileHeader header;
+	memset (&header, 0, sizeof (header));
+	header.magic = mesh_file_magic;
+	header.version = mesh_file_version;
+	header.attribute_count = static_cast<uint32_t>(mesh.attributes.size ());
+	header.vertex_stride = mesh.vertex_stride;
+	header.vertex_count = mesh.GetVertexCount ();
+	header.index_size = max_index <= 0xffff ? 2 : 4;
+	header.index_count = static_cast<uint32_t>(mesh.indices.size ());
+	header.submesh_count = static_cast<uint32_t>(mesh.submeshes.size ());
+	memcpy (header.bounds_min, mesh.bounds_min, sizeof (header.bounds_min));
+	memcpy (header.bounds_max, mesh.bounds_max, sizeof (header.bounds_max));
+	memcpy (header.position_scale, mesh.position_scale, sizeof (header.position_scale));
+	memcpy (header.position_bias, mesh.position_bias, sizeof (header.position_bias));
+	if (!mesh.attributes.empty ())
+		memcpy (header.attributes, mesh.attributes.data (), mesh.attributes.size () * sizeof (MeshAttribute));
+	header.submesh_offset = sizeof (header);
+	header.vertex_offset = AlignOffset (header.submesh_offset + mesh.submeshes.size () * sizeof (MeshSubmesh), mesh_stream_alignment);
+	header.index_offset = AlignOffset (header.vertex_offset + mesh.vertices.size (), mesh_stream_alignment);
+	header.file_size = header.index_offset + static_cast<uint64_t>(header.index_count) * header.index_size;
+
+	file.assign (static_cast<size_t>(header.file_size), 0);
+	memcpy (file.data (), &header, sizeof (header));
+	if (!mesh.submeshes.empty ())
+		memcpy (file.data () + header.submesh_offset, mesh.submeshes.data (), mesh.submeshes.size () * sizeof (MeshSubmesh));
+	if (!mesh.vertices.empty ())
+		memcpy (file.data () + header.vertex_offset, mesh.vertices.data (), mesh.vertices.size ());
+	uint8_t *indices = file.data () + header.index_offset;
+	if (header.index_size == 4)
+	{
+		if (!mesh.indices.empty ())
+			memcpy (indices, mesh.indices.data (), mesh.indices.size () * sizeof (uint32_t));
+	}
+	else
+	{
+		for (size_t i = 0; i < mesh.indices.size (); i++)
+		{
+			const uint16_t index = static_cast<uint16_t>(mesh.indices[i]);
+			memcpy (indices + i * sizeof (index), &index, sizeof (index));
+		}
+	}
+}
+
+//the range lies inside a file of file_size bytes
+static bool IsInside (uint64_t offset, uint64_t size, uint64_t file_size)
+{
+	return offset <= file_size && size <= file_size - offset;
+}
+
+bool ReadMeshFile (const void *file, size_t file_size, MeshView &view)
+{
+	const uint8_t *bytes = static_cast<const uint8_t*>(file);
+	if (file_size < sizeof (MeshFileHeader) || reinterpret_cast<uintptr_t>(bytes) % 8)
+		return false;
+	const MeshFileHeader *header = reinterpret_cast<const MeshFileHeader*>(bytes);
+	if (header->magic != mesh_file_magic || header->version != mesh_file_version || header->file_size != file_size)
+		return false;
+	if (header->attribute_count > mesh_max_attributes || (header->index_size != 2 && header->index_size != 4))
+		return false;
+	if (!header->vertex_stride && header->vertex_count)
+		return false;
+	for (uint32_t i = 0; i < header->attribute_count; i++)
+		if (header->attributes[i].semantic >= MESH_ATTRIBUTE_SEMANTIC_COUNT || header->attributes[i].offset >= header->vertex_stride)
+			return false;
+
+	const uint64_t vertex_size = static_cast<uint64_t>(header->vertex_count) * header->vertex_stride;
+	const uint64_t index_size = static_cast<uint64_t>(header->index_count) * header->index_size;
+	if (header->submesh_offset % 8 || header->vertex_offset % mesh_stream_alignment || header->index_offset % mesh_stream_alignment)
+		return false;
+	if (!IsInside (header->submesh_offset, static_cast<uint64_t>(header->submesh_count) * sizeof (MeshSubmesh), file_size) ||
+		!IsInside (header->vertex_offset, vertex_size, file_size) ||
+		!IsInside (header->index_offset, index_size, file_size))
+		return false;
+
+	const MeshSubmesh *submeshes = reinterpret_cast<const MeshSubmesh*>(bytes + header->submesh_offset);
+	for (uint32_t i = 0; i < header->submesh_count; i++)
+		if (static_cast<uint64_t>(submeshes[i].start_index) + submeshes[i].index_count > header->index_count)
+			return false;
+
+	view.header = header;
+	view.submeshes = submeshes;
+	view.vertices = bytes + header->vertex_offset;
+	view.indices = bytes + header->index_offset;
+	view.vertex_size = vertex_size;
+	view.index_size = index_size;
+	return true;
+}
+
+#ifdef _WIN32
+
+MappedFile::MappedFile () :
+	data (nullptr),
+	size (0),
+	file_handle (INVALID_HANDLE_VALUE),
+	mapping (nullptr)
+{
+}
+
+bool MappedFile::Open (const char *file_name)
+{
+	Close ();
+	file_handle = CreateFileA (file_name, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file_handle == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx (file_handle, &file_size) || static_cast<uint64_t>(file_size.QuadPart) > SIZE_MAX)
+	{
+		Close ();
+		return false;
+	}
+	size = static_cast<size_t>(file_size.QuadPart);
+	//empty files can not be mapped
+	if (!size)
+		return true;
+	mapping = CreateFileMappingA (file_handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping)
+		data = static_cast<const uint8_t*>(MapViewOfFile (mapping, FILE_MAP_READ, 0, 0, 0));
+	if (!data)
+	{
+		Close ();
+		return false;
+	}
+	return true;
+}
+
+void MappedFile::Close ()
+{
+	if (data)
+		UnmapViewOfFile (data);
+	if (mapping)
+		CloseHandle (mapping);
+	if (file_handle != INVALID_HANDLE_VALUE)
+		CloseHandle (file_handle);
+	data = nullptr;
+	size = 0;
+	mapping = nullptr;
+	file_handle = INVALID_HANDLE_VALUE;
+}
+
+void MappedFile::Prefetch (size_t offset, size_t range_size) const
+{
+#if _WIN32_WINNT >= 0x0602
+	if (!data || offset >= size)
+		return;
+	WIN32_MEMORY_RANGE_ENTRY range;
+	range.VirtualAddress = const_cast<uint8_t*>(data + offset);
+	range.NumberOfBytes = std::min (range_size, size - offset);
+	PrefetchVirtualMemory (GetCurrentProcess (), 1, &range, 0);
+#else
+	(void)offset;
+	(void)range_size;
+#endif
+}
+
+#else
+
+MappedFile::MappedFile () :
+	data (nullptr),
+	size (0)
+{
+}
+
+bool MappedFile::Open (const char *file_name)
+{
+	Close ();
+	const int fd = open (file_name, O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat info;
+	bool opened = fstat (fd, &info) == 0;
+	if (opened && info.st_size > 0)
+	{
+		void *address = mmap (nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+		opened = address != MAP_FAILED;
+		if (opened)
+		{
+			data = static_cast<const uint8_t*>(address);
+			size = static_cast<size_t>(info.st_size);
+		}
+	}
+	//the mapping keeps the file open
+	close (fd);
+	return opened;
+}
+
+void MappedFile::Close ()
+{
+	if (data)
+		munmap (const_cast<uint8_t*>(data), size);
+	data = nullptr;
+	size = 0;
+}
+
+void MappedFile::Prefetch (size_t offset, size_t range_size) const
+{
+	if (!data || offset >= size)
+		return;
+	const size_t page_size = static_cast<size_t>(sysconf (_SC_PAGESIZE));
+	const size_t begin = offset & ~(page_size - 1);
+	const size_t end = offset + std::min (range_size, size - offset);
+	madvise (const_cast<uint8_t*>(data + begin), end - begin, MADV_WILLNEED);
+}
+
+#endif
+
+MappedFile::~MappedFile ()
+{
+	Close ();
+}
@@ -0,0 +1,140 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+//Binary mesh container. The file is laid out the way the GPU consumes it: a fixed
+//header with the vertex layout, the submesh table, then the vertex and index streams,
+//each aligned so they can be copied straight from a memory mapping into upload memory.
+//Loading only validates the header, nothing is parsed or converted.
+//
+//file: header | submeshes | vertices | indices, streams start at mesh_stream_alignment
+
+static const uint32_t mesh_file_magic = 0x4853454d;    //"MESH"
+static const uint32_t mesh_file_version = 2;
+static const uint32_t mesh_stream_alignment = 64;
+static const uint32_t mesh_max_attributes = 8;
+
+enum MeshAttributeSemantic
+{
+	MESH_ATTRIBUTE_POSITION,
+	MESH_ATTRIBUTE_NORMAL,
+	MESH_ATTRIBUTE_TEXCOORD,
+	MESH_ATTRIBUTE_COLOR,
+	MESH_ATTRIBUTE_SEMANTIC_COUNT
+};
+
+//HLSL semantic name of the attribute, e.g. "POSITION"
+const char *GetMeshSemanticName (uint32_t semantic);
+
+struct MeshAttribute
+{
+	uint32_t semantic;          //MeshAttributeSemantic
+	uint32_t semantic_index;
+	uint32_t format;            //DXGI_FORMAT value
+	uint32_t offset;            //inside the vertex
+};
+
+struct MeshSubmesh
+{
+	uint32_t start_index;
+	uint32_t index_count;
+	int32_t base_vertex;
+	uint32_t material;          //index of the material in the source asset
+	float bounds_min[3];
+	float bounds_max[3];
+};
+
+struct MeshFileHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t attribute_count;
+	uint32_t vertex_stride;
+	uint32_t vertex_count;
+	uint32_t index_size;        //2 or 4 bytes
+	uint32_t index_count;
+	uint32_t submesh_count;
+	float bounds_min[3];
+	float bounds_max[3];
+	float position_scale[3];    //dequantization of snorm16 positions, see vertex_format.h
+	float position_bias[3];
+	MeshAttribute attributes[mesh_max_attributes];
+	uint64_t submesh_offset;
+	uint64_t vertex_offset;
+	uint64_t index_offset;
+	uint64_t file_size;
+};
+
+//mesh in memory, the input of WriteMeshFile
+struct MeshData
+{
+	std::vector<MeshAttribute> attributes;
+	uint32_t vertex_stride;
+	std::vector<uint8_t> vertices;
+	std::vector<uint32_t> indices;      //relative to the base vertex of their submesh
+	std::vector<MeshSubmesh> submeshes;
+	float bounds_min[3];
+	float bounds_max[3];
+	float position_scale[3];    //position = stored position * scale + bias
+	float position_bias[3];
+
+	MeshData ();
+	uint32_t GetVertexCount () const
+	{
+		return vertex_stride ? static_cast<uint32_t>(vertices.size () / vertex_stride) : 0;
+	}
+};
+
+//pointers into a loaded file
+struct MeshView
+{
+	const MeshFileHeader *header;
+	const MeshSubmesh *submeshes;
+	const uint8_t *vertices;
+	const uint8_t *indices;
+	uint64_t vertex_size;       //bytes of the streams
+	uint64_t index_size;
+};
+
+//computes the mesh and submesh bounds from a R32G32B32_FLOAT position attribute
+void ComputeMeshBounds (MeshData &mesh);
+//indices are stored with 16 bits if every submesh's vertices can be addressed with them
+void WriteMeshFile (const MeshData &mesh, std::vector<uint8_t> &file);
+//false if the file is damaged or of another version; the data must stay 8 byte aligned.
+//Index values are not checked, vertex fetches out of range read zero on the GPU.
+bool ReadMeshFile (const void *file, size_t file_size, MeshView &view);
+
+//read-only memory mapping of a whole file
+class MappedFile
+{
+public:
+	MappedFile ();
+	~MappedFile ();
+
+	//false if the file can not be opened or mapped
+	bool Open (const char *file_name);
+	void Close ();
+
+	const uint8_t *GetData () const
+	{
+		return data;
+	}
+	size_t GetSize () const
+	{
+		return size;
+	}
+	//asks the system to read the range ahead of its use
+	void Prefetch (size_t offset, size_t range_size) const;
+private:
+	MappedFile (const MappedFile &) = delete;
+	MappedFile &operator= (const MappedFile &) = delete;
+
+	const uint8_t *data;
+	size_t size;
+#ifdef _WIN32
+	void *file_handle;
+	void *mapping;
+#endif
+};
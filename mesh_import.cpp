@@ -0,0 +1,310 @@
+#include "mesh_import.h"
+#include "vertex_format.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace
+{
+	struct ObjCorner
+	{
+		int32_t position;
+		int32_t texcoord;    //-1 if not given
+		int32_t normal;
+	};
+
+	struct ObjCornerHash
+	{
+		size_t operator() (const ObjCorner &corner) const
+		{
+			uint64_t hash = static_cast<uint32_t>(corner.position);
+			hash = hash * 0x9e3779b97f4a7c15ull + static_cast<uint32_t>(corner.texcoord);
+			hash = hash * 0x9e3779b97f4a7c15ull + static_cast<uint32_t>(corner.normal);
+			return static_cast<size_t>(hash ^ (hash >> 29));
+		}
+	};
+
+	struct ObjCornerEqual
+	{
+		bool operator() (const ObjCorner &a, const ObjCorner &b) const
+		{
+			return a.position == b.position && a.texcoord == b.texcoord && a.normal == b.normal;
+		}
+	};
+
+	class ObjParser
+	{
+	public:
+		ObjParser (const char *text_begin, const char *text_end) :
+			current (text_begin),
+			line_end (text_end),
+			end (text_end),
+			line (0)
+		{
+		}
+
+		//moves to the next line, false at the end of the text
+		bool NextLine ()
+		{
+			if (line && line_end < end)
+				current = line_end + 1;
+			if (current >= end)
+				return false;
+			const char *newline = static_cast<const char*>(memchr (current, '\n', end - current));
+			line_end = newline ? newline : end;
+			line++;
+			return true;
+		}
+
+		//next token of the line, empty at its end
+		bool Token (const char *&token, size_t &length)
+		{
+			while (current < line_end && (*current == ' ' || *current == '\t' || *current == '\r'))
+				current++;
+			token = current;
+			while (current < line_end && *current != ' ' && *current != '\t' && *current != '\r')
+				current++;
+			length = current - token;
+			return length != 0;
+		}
+
+		float Float ()
+		{
+			float value;
+			if (!TryFloat (value))
+				Fail ("number expected");
+			return value;
+		}
+
+		//false at the end of the line
+		bool TryFloat (float &value)
+		{
+			const char *token;
+			size_t length;
+			if (!Token (token, length))
+				return false;
+			char buffer[64];
+			const size_t copied = length < sizeof (buffer) - 1 ? length : sizeof (buffer) - 1;
+			memcpy (buffer, token, copied);
+			buffer[copied] = '\0';
+			char *parsed;
+			value = strtof (buffer, &parsed);
+			if (parsed != buffer + length)
+				Fail ("invalid number");
+			return true;
+		}
+
+		//rest of the line without surrounding spaces
+		std::string Rest ()
+		{
+			const char *begin = current;
+			const char *last = line_end;
+			while (begin < last && (*begin == ' ' || *begin == '\t'))
+				begin++;
+			while (last > begin && (last[-1] == ' ' || last[-1] == '\t' || last[-1] == '\r'))
+				last--;
+			current = line_end;
+			return std::string (begin, last);
+		}
+
+		void Fail (const char *message) const
+		{
+			throw std::runtime_error ("OBJ line " + std::to_string (line) + ": " + message);
+		}
+	private:
+		const char *current;
+		const char *line_end;
+		const char *end;
+		uint32_t line;
+	};
+}
+
+//resolves a 1-based or negative relative OBJ index; empty components give -1
+static int32_t ParseObjIndex (const char *&token, const char *token_end, size_t count, const ObjParser &parser)
+{
+	if (token == token_end || *token == '/')
+		return -1;
+	char *parsed;
+	const long value = strtol (token, &parsed, 10);
+	if (parsed == token || parsed > token_end)
+		parser.Fail ("invalid face index");
+	token = parsed;
+	const long index = value < 0 ? static_cast<long>(count) + value : value - 1;
+	if (value == 0 || index < 0 || index >= static_cast<long>(count))
+		parser.Fail ("face index out of range");
+	return static_cast<int32_t>(index);
+}
+
+void ImportObj (const std::string &text, MeshData &mesh, std::vector<std::string> &materials)
+{
+	std::vector<float> positions;    //x y z r g b
+	std::vector<float> texcoords;
+	std::vector<float> normals;
+	std::vector<std::vector<ObjCorner>> triangles;    //corners per material
+	uint32_t material = 0;
+	materials.clear ();
+
+	ObjParser parser (text.data (), text.data () + text.size ());
+	std::vector<ObjCorner> polygon;
+	while (parser.NextLine ())
+	{
+		const char *token;
+		size_t length;
+		if (!parser.Token (token, length) || token[0] == '#')
+			continue;
+		if (length == 1 && token[0] == 'v')
+		{
+			float values[6] = { 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f };
+			for (uint32_t i = 0; i < 3; i++)
+				values[i] = parser.Float ();
+			//a fourth value is the weight, six values are a position and a colour
+			float extra[3];
+			uint32_t extra_count = 0;
+			while (extra_count < 3 && parser.TryFloat (extra[extra_count]))
+				extra_count++;
+			if (extra_count == 3)
+				memcpy (values + 3, extra, sizeof (extra));
+			positions.insert (positions.end (), values, values + 6);
+		}
+		else if (length == 2 && token[0] == 'v' && token[1] == 't')
+		{
+			float texcoord[2] = { parser.Float (), 0.0f };
+			parser.TryFloat (texcoord[1]);
+			texcoords.insert (texcoords.end (), texcoord, texcoord + 2);
+		}
+		else if (length == 2 && token[0] == 'v' && token[1] == 'n')
+		{
+			for (uint32_t i = 0; i < 3; i++)
+				normals.push_back (parser.Float ());
+		}
+		else if (length == 1 && token[0] == 'f')
+		{
+			polygon.clear ();
+			while (parser.Token (token, length))
+			{
+				const char *token_end = token + length;
+				ObjCorner corner;
+				corner.position = ParseObjIndex (token, token_end, positions.size () / 6, parser);
+				if (corner.position < 0)
+					parser.Fail ("face corner without position");
+				corner.texcoord = corner.normal = -1;
+				if (token < token_end && *token == '/')
+				{
+					token++;
+					corner.texcoord = ParseObjIndex (token, token_end, texcoords.size () / 2, parser);
+					if (token < token_end && *token == '/')
+					{
+						token++;
+						corner.normal = ParseObjIndex (token, token_end, normals.size () / 3, parser);
+					}
+				}
+				if (token != token_end)
+					parser.Fail ("invalid face corner");
+				polygon.push_back (corner);
+			}
+			if (polygon.size () < 3)
+				parser.Fail ("face with less than 3 corners");
+			if (materials.empty ())
+			{
+				materials.push_back ("default");
+				triangles.emplace_back ();
+			}
+			//fan triangulation, reversed for clockwise front faces
+			std::vector<ObjCorner> &material_triangles = triangles[material];
+			for (size_t i = 2; i < polygon.size (); i++)
+			{
+				material_triangles.push_back (polygon[0]);
+				material_triangles.push_back (polygon[i]);
+				material_triangles.push_back (polygon[i - 1]);
+			}
+		}
+		else if (length == 6 && memcmp (token, "usemtl", 6) == 0)
+		{
+			const std::string name = parser.Rest ();
+			material = 0;
+			while (material < materials.size () && materials[material] != name)
+				material++;
+			if (material == materials.size ())
+			{
+				materials.push_back (name);
+				triangles.emplace_back ();
+			}
+		}
+		//groups, objects, smoothing groups, material libraries, lines and points are ignored
+	}
+
+	//vertex layout from the data present in the file
+	const bool has_texcoords = !texcoords.empty ();
+	const bool has_normals = !normals.empty ();
+	mesh = MeshData ();
+	uint32_t offset = 0;
+	mesh.attributes.push_back ({ MESH_ATTRIBUTE_POSITION, 0, vertex_format_float3, offset });
+	offset += 12;
+	if (has_normals)
+	{
+		mesh.attributes.push_back ({ MESH_ATTRIBUTE_NORMAL, 0, vertex_format_float3, offset });
+		offset += 12;
+	}
+	if (has_texcoords)
+	{
+		mesh.attributes.push_back ({ MESH_ATTRIBUTE_TEXCOORD, 0, vertex_format_float2, offset });
+		offset += 8;
+	}
+	mesh.attributes.push_back ({ MESH_ATTRIBUTE_COLOR, 0, vertex_format_float4, offset });
+	offset += 16;
+	mesh.vertex_stride = offset;
+
+	std::unordered_map<ObjCorner, uint32_t, ObjCornerHash, ObjCornerEqual> vertices;
+	for (uint32_t m = 0; m < triangles.size (); m++)
+	{
+		if (triangles[m].empty ())
+			continue;
+		MeshSubmesh submesh;
+		memset (&submesh, 0, sizeof (submesh));
+		submesh.start_index = static_cast<uint32_t>(mesh.indices.size ());
+		submesh.index_count = static_cast<uint32_t>(triangles[m].size ());
+		submesh.material = m;
+		for (const ObjCorner &corner : triangles[m])
+		{
+			auto found = vertices.find (corner);
+			if (found != vertices.end ())
+			{
+				mesh.indices.push_back (found->second);
+				continue;
+			}
+			const uint32_t index = static_cast<uint32_t>(vertices.size ());
+			vertices.emplace (corner, index);
+			mesh.indices.push_back (index);
+
+			float vertex[16];
+			uint32_t count = 0;
+			const float *position = &positions[corner.position * 6];
+			vertex[count++] = position[0];
+			vertex[count++] = position[1];
+			vertex[count++] = -position[2];
+			if (has_normals)
+			{
+				const float *normal = corner.normal >= 0 ? &normals[corner.normal * 3] : nullptr;
+				vertex[count++] = normal ? normal[0] : 0.0f;
+				vertex[count++] = normal ? normal[1] : 0.0f;
+				vertex[count++] = normal ? -normal[2] : 0.0f;
+			}
+			if (has_texcoords)
+			{
+				const float *texcoord = corner.texcoord >= 0 ? &texcoords[corner.texcoord * 2] : nullptr;
+				vertex[count++] = texcoord ? texcoord[0] : 0.0f;
+				vertex[count++] = texcoord ? 1.0f - texcoord[1] : 0.0f;
+			}
+			vertex[count++] = position[3];
+			vertex[count++] = position[4];
+			vertex[count++] = position[5];
+			vertex[count++] = 1.0f;
+			const uint8_t *bytes = reinterpret_cast<const uint8_t*>(vertex);
+			mesh.vertices.insert (mesh.vertices.end (), bytes, bytes + count * sizeof (float));
+		}
+		mesh.submeshes.push_back (submesh);
+	}
+	ComputeMeshBounds (mesh);
+}
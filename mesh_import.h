@@ -0,0 +1,16 @@
+#pragma once
+#include "mesh_file.h"
+
+#include <string>
+#include <vector>
+
+//Conversion of source assets into MeshData for the mesh container.
+
+//Wavefront OBJ: v (with an optional r g b colour), vt, vn, f with any polygon size and
+//negative indices, usemtl starts a submesh per material. Corners with equal position,
+//texcoord and normal indices share a vertex. The vertices hold float3 positions, float3
+//normals and float2 texcoords if the file has any, and a float4 colour, white if none is
+//given. OBJ is right-handed with counter-clockwise front faces and texcoords starting at
+//the bottom, so z is mirrored, triangles are reversed and v is flipped for D3D.
+//Throws std::runtime_error with the line of the first error.
+void ImportObj (const std::string &text, MeshData &mesh, std::vector<std::string> &materials);
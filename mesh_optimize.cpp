@@ -0,0 +1,742 @@
+#include "mesh_optimize.h"
+#include "vertex_format.h"
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <stdexcept>
+#include <unordered_map>
+
+//LRU cache of the Forsyth scoring and its weights
+static const uint32_t forsyth_cache_size = 32;
+static const float forsyth_last_triangle_score = 0.75f;
+static const float forsyth_cache_decay_power = 1.5f;
+static const float forsyth_valence_boost_scale = 2.0f;
+static const float forsyth_valence_boost_power = 0.5f;
+static const uint32_t forsyth_max_valence = 32;
+
+//side of the overdraw analysis grid and its subpixel precision
+static const int32_t overdraw_grid_size = 256;
+static const int32_t overdraw_subpixel_bits = 4;
+
+static void ValidateTriangles (const uint32_t *indices, size_t index_count, uint32_t vertex_count)
+{
+	if (index_count % 3)
+		throw std::invalid_argument ("Index count is not a multiple of 3");
+	for (size_t i = 0; i < index_count; i++)
+		if (indices[i] >= vertex_count)
+			throw std::out_of_range ("Mesh index is out of range");
+}
+
+static void LoadPosition (const void *positions, uint32_t position_stride, uint32_t vertex, float position[3])
+{
+	memcpy (position, static_cast<const uint8_t*>(positions) + static_cast<size_t>(vertex) * position_stride, 3 * sizeof (float));
+}
+
+static void TriangleNormal (const float a[3], const float b[3], const float c[3], float normal[3])
+{
+	const float ab[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+	const float ac[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+	normal[0] = ab[1] * ac[2] - ab[2] * ac[1];
+	normal[1] = ab[2] * ac[0] - ab[0] * ac[2];
+	normal[2] = ab[0] * ac[1] - ab[1] * ac[0];
+}
+
+//FIFO cache in which a vertex stays for cache_size misses
+class FifoCacheSimulator
+{
+public:
+	FifoCacheSimulator (uint32_t vertex_count, uint32_t cache_size) :
+		timestamps (vertex_count, 0),
+		time (cache_size + 1),
+		size (cache_size)
+	{
+	}
+
+	//misses of the triangle's vertices
+	uint32_t Triangle (const uint32_t *triangle)
+	{
+		uint32_t misses = 0;
+		for (uint32_t k = 0; k < 3; k++)
+			if (time - timestamps[triangle[k]] > size)
+			{
+				timestamps[triangle[k]] = time++;
+				misses++;
+			}
+		return misses;
+	}
+
+	void Flush ()
+	{
+		time += size + 1;
+	}
+private:
+	std::vector<uint32_t> timestamps;
+	uint32_t time;
+	uint32_t size;
+};
+
+VertexCacheStats AnalyzeVertexCache (const uint32_t *indices, size_t index_count, uint32_t vertex_count, uint32_t cache_size)
+{
+	ValidateTriangles (indices, index_count, vertex_count);
+	if (!cache_size)
+		throw std::invalid_argument ("Vertex cache size must not be 0");
+
+	VertexCacheStats stats;
+	stats.transformed = 0;
+	FifoCacheSimulator cache (vertex_count, cache_size);
+	for (size_t i = 0; i < index_count; i += 3)
+		stats.transformed += cache.Triangle (indices + i);
+
+	std::vector<bool> referenced (vertex_count, false);
+	uint32_t referenced_count = 0;
+	for (size_t i = 0; i < index_count; i++)
+		if (!referenced[indices[i]])
+		{
+			referenced[indices[i]] = true;
+			referenced_count++;
+		}
+	stats.acmr = index_count ? static_cast<float>(stats.transformed) / (index_count / 3) : 0.0f;
+	stats.atvr = referenced_count ? static_cast<float>(stats.transformed) / referenced_count : 0.0f;
+	return stats;
+}
+
+namespace
+{
+	struct RasterPoint
+	{
+		int64_t x;      //subpixels
+		int64_t y;
+		double depth;
+	};
+
+	//point on the edge from a to b belongs to the triangle; shared edges run in opposite
+	//directions in their two triangles, so exactly one of them owns the points on it
+	bool OwnsEdge (const RasterPoint &a, const RasterPoint &b)
+	{
+		return b.y > a.y || (b.y == a.y && b.x < a.x);
+	}
+
+	int64_t Edge (const RasterPoint &a, const RasterPoint &b, int64_t x, int64_t y)
+	{
+		return (b.x - a.x) * (y - a.y) - (b.y - a.y) * (x - a.x);
+	}
+
+	void RasterizeTriangle (RasterPoint a, RasterPoint b, RasterPoint c, std::vector<float> &depth_buffer, uint64_t &shaded)
+	{
+		int64_t area = Edge (a, b, c.x, c.y);
+		if (!area)
+			return;
+		if (area < 0)
+		{
+			std::swap (b, c);
+			area = -area;
+		}
+		const int64_t one = 1 << overdraw_subpixel_bits;
+		const int64_t half = one / 2;
+		const int64_t min_x = std::max<int64_t>(0, (std::min (a.x, std::min (b.x, c.x)) - half + one - 1) / one);
+		const int64_t min_y = std::max<int64_t>(0, (std::min (a.y, std::min (b.y, c.y)) - half + one - 1) / one);
+		const int64_t max_x = std::min<int64_t>(overdraw_grid_size - 1, (std::max (a.x, std::max (b.x, c.x)) - half) / one);
+		const int64_t max_y = std::min<int64_t>(overdraw_grid_size - 1, (std::max (a.y, std::max (b.y, c.y)) - half) / one);
+		//points exactly on an edge only count for its owner
+		const int64_t bias_a = OwnsEdge (b, c) ? 0 : -1;
+		const int64_t bias_b = OwnsEdge (c, a) ? 0 : -1;
+		const int64_t bias_c = OwnsEdge (a, b) ? 0 : -1;
+		for (int64_t y = min_y; y <= max_y; y++)
+			for (int64_t x = min_x; x <= max_x; x++)
+			{
+				const int64_t px = x * one + half;
+				const int64_t py = y * one + half;
+				const int64_t weight_a = Edge (b, c, px, py);
+				const int64_t weight_b = Edge (c, a, px, py);
+				const int64_t weight_c = Edge (a, b, px, py);
+				if (weight_a + bias_a < 0 || weight_b + bias_b < 0 || weight_c + bias_c < 0)
+					continue;
+				const float depth = static_cast<float>((weight_a * a.depth + weight_b * b.depth + weight_c * c.depth) / area);
+				float &stored = depth_buffer[y * overdraw_grid_size + x];
+				if (depth < stored)
+				{
+					stored = depth;
+					shaded++;
+				}
+			}
+	}
+}
+
+OverdrawStats AnalyzeOverdraw (const uint32_t *indices, size_t index_count, const void *positions, uint32_t position_stride,
+							   uint32_t vertex_count)
+{
+	ValidateTriangles (indices, index_count, vertex_count);
+	OverdrawStats stats;
+	stats.covered = stats.shaded = 0;
+	stats.overdraw = 0.0f;
+	if (!index_count)
+		return stats;
+
+	//fit the referenced vertices into the grid, keeping the aspect ratio
+	float bounds_min[3] = { 3.402823466e+38f, 3.402823466e+38f, 3.402823466e+38f };
+	float bounds_max[3] = { -3.402823466e+38f, -3.402823466e+38f, -3.402823466e+38f };
+	for (size_t i = 0; i < index_count; i++)
+	{
+		float position[3];
+		LoadPosition (positions, position_stride, indices[i], position);
+		for (uint32_t c = 0; c < 3; c++)
+		{
+			bounds_min[c] = std::min (bounds_min[c], position[c]);
+			bounds_max[c] = std::max (bounds_max[c], position[c]);
+		}
+	}
+	const float extent = std::max (bounds_max[0] - bounds_min[0], std::max (bounds_max[1] - bounds_min[1], bounds_max[2] - bounds_min[2]));
+	const double scale = extent > 0.0f ? (overdraw_grid_size << overdraw_subpixel_bits) / static_cast<double>(extent) * 0.999 : 0.0;
+
+	std::vector<float> depth_buffer (overdraw_grid_size * overdraw_grid_size);
+	for (uint32_t view = 0; view < 6; view++)
+	{
+		//looking along +axis or -axis, the other two axes span the grid
+		const uint32_t axis = view / 2;
+		const float direction = view % 2 ? -1.0f : 1.0f;
+		const uint32_t axis_x = (axis + 1) % 3;
+		const uint32_t axis_y = (axis + 2) % 3;
+		std::fill (depth_buffer.begin (), depth_buffer.end (), 3.402823466e+38f);
+		for (size_t i = 0; i < index_count; i += 3)
+		{
+			float corners[3][3];
+			for (uint32_t k = 0; k < 3; k++)
+				LoadPosition (positions, position_stride, indices[i + k], corners[k]);
+			//clockwise front faces have this normal pointing outwards
+			float normal[3];
+			TriangleNormal (corners[0], corners[1], corners[2], normal);
+			if (normal[axis] * direction >= 0.0f)
+				continue;
+			RasterPoint points[3];
+			for (uint32_t k = 0; k < 3; k++)
+			{
+				points[k].x = static_cast<int64_t>((corners[k][axis_x] - bounds_min[axis_x]) * scale);
+				points[k].y = static_cast<int64_t>((corners[k][axis_y] - bounds_min[axis_y]) * scale);
+				points[k].depth = corners[k][axis] * direction;
+			}
+			RasterizeTriangle (points[0], points[1], points[2], depth_buffer, stats.shaded);
+		}
+		for (float depth : depth_buffer)
+			if (depth != 3.402823466e+38f)
+				stats.covered++;
+	}
+	stats.overdraw = stats.covered ? static_cast<float>(static_cast<double>(stats.shaded) / stats.covered) : 0.0f;
+	return stats;
+}
+
+namespace
+{
+	class ForsythScores
+	{
+	public:
+		ForsythScores ()
+		{
+			for (uint32_t i = 0; i < forsyth_cache_size; i++)
+			{
+				//the last triangle's vertices score the same so its order does not matter
+				if (i < 3)
+					cache[i] = forsyth_last_triangle_score;
+				else
+					cache[i] = powf (1.0f - static_cast<float>(i - 3) / (forsyth_cache_size - 3), forsyth_cache_decay_power);
+			}
+			for (uint32_t i = 0; i <= forsyth_max_valence; i++)
+				valence[i] = i ? forsyth_valence_boost_scale * powf (static_cast<float>(i), -forsyth_valence_boost_power) : 0.0f;
+		}
+
+		//vertices with few remaining triangles are preferred so they do not get stranded
+		float Vertex (int32_t cache_position, uint32_t remaining) const
+		{
+			if (!remaining)
+				return -1.0f;
+			const float valence_score = remaining <= forsyth_max_valence ? valence[remaining] :
+				forsyth_valence_boost_scale * powf (static_cast<float>(remaining), -forsyth_valence_boost_power);
+			return (cache_position >= 0 ? cache[cache_position] : 0.0f) + valence_score;
+		}
+	private:
+		float cache[forsyth_cache_size];
+		float valence[forsyth_max_valence + 1];
+	};
+}
+
+void OptimizeVertexCache (uint32_t *destination, const uint32_t *indices, size_t index_count, uint32_t vertex_count)
+{
+	ValidateTriangles (indices, index_count, vertex_count);
+	const std::vector<uint32_t> source (indices, indices + index_count);
+	const size_t triangle_count = index_count / 3;
+	static const ForsythScores scores;
+
+	//triangles of every vertex; the first remaining[v] entries are not emitted yet
+	std::vector<uint32_t> remaining (vertex_count, 0);
+	for (uint32_t index : source)
+		remaining[index]++;
+	std::vector<uint32_t> adjacency_offsets (vertex_count + 1, 0);
+	for (uint32_t v = 0; v < vertex_count; v++)
+		adjacency_offsets[v + 1] = adjacency_offsets[v] + remaining[v];
+	std::vector<uint32_t> adjacency (index_count);
+	{
+		std::vector<uint32_t> cursor (adjacency_offsets.begin (), adjacency_offsets.end () - 1);
+		for (size_t i = 0; i < index_count; i++)
+			adjacency[cursor[source[i]]++] = static_cast<uint32_t>(i / 3);
+	}
+
+	std::vector<int32_t> cache_positions (vertex_count, -1);
+	std::vector<float> vertex_scores (vertex_count);
+	for (uint32_t v = 0; v < vertex_count; v++)
+		vertex_scores[v] = scores.Vertex (-1, remaining[v]);
+	std::vector<float> triangle_scores (triangle_count);
+	for (size_t t = 0; t < triangle_count; t++)
+		triangle_scores[t] = vertex_scores[source[t * 3]] + vertex_scores[source[t * 3 + 1]] + vertex_scores[source[t * 3 + 2]];
+	std::vector<bool> emitted (triangle_count, false);
+
+	uint32_t cache[forsyth_cache_size + 3];
+	uint32_t cache_count = 0;
+	size_t next_unemitted = 0;
+	size_t best = triangle_count ? std::max_element (triangle_scores.begin (), triangle_scores.end ()) - triangle_scores.begin () : 0;
+	for (size_t out = 0; out < triangle_count; out++)
+	{
+		//no cached vertex has triangles left, continue with the next one in input order
+		if (best == triangle_count)
+		{
+			while (emitted[next_unemitted])
+				next_unemitted++;
+			best = next_unemitted;
+		}
+		const uint32_t *triangle = &source[best * 3];
+		memcpy (destination + out * 3, triangle, 3 * sizeof (uint32_t));
+		emitted[best] = true;
+
+		for (uint32_t k = 0; k < 3; k++)
+		{
+			const uint32_t vertex = triangle[k];
+			uint32_t *vertex_triangles = &adjacency[adjacency_offsets[vertex]];
+			const uint32_t count = remaining[vertex];
+			for (uint32_t j = 0; j < count; j++)
+				if (vertex_triangles[j] == best)
+				{
+					std::swap (vertex_triangles[j], vertex_triangles[count - 1]);
+					break;
+				}
+			remaining[vertex]--;
+		}
+
+		//move the triangle's vertices to the front, the rest keeps its order
+		uint32_t new_cache[forsyth_cache_size + 3];
+		uint32_t new_cache_count = 0;
+		for (uint32_t k = 0; k < 3; k++)
+			new_cache[new_cache_count++] = triangle[k];
+		for (uint32_t i = 0; i < cache_count; i++)
+		{
+			const uint32_t vertex = cache[i];
+			if (vertex != triangle[0] && vertex != triangle[1] && vertex != triangle[2])
+				new_cache[new_cache_count++] = vertex;
+		}
+
+		//rescore the cached and evicted vertices and their triangles, the best one goes next
+		for (uint32_t i = 0; i < new_cache_count; i++)
+		{
+			const uint32_t vertex = new_cache[i];
+			cache_positions[vertex] = i < forsyth_cache_size ? static_cast<int32_t>(i) : -1;
+			const float score = scores.Vertex (cache_positions[vertex], remaining[vertex]);
+			const float delta = score - vertex_scores[vertex];
+			vertex_scores[vertex] = score;
+			const uint32_t *vertex_triangles = &adjacency[adjacency_offsets[vertex]];
+			for (uint32_t j = 0; j < remaining[vertex]; j++)
+				triangle_scores[vertex_triangles[j]] += delta;
+		}
+		cache_count = std::min (new_cache_count, forsyth_cache_size);
+		memcpy (cache, new_cache, cache_count * sizeof (uint32_t));
+
+		best = triangle_count;
+		float best_score = -1.0f;
+		for (uint32_t i = 0; i < cache_count; i++)
+		{
+			const uint32_t vertex = cache[i];
+			const uint32_t *vertex_triangles = &adjacency[adjacency_offsets[vertex]];
+			for (uint32_t j = 0; j < remaining[vertex]; j++)
+				if (triangle_scores[vertex_triangles[j]] > best_score)
+				{
+					best_score = triangle_scores[vertex_triangles[j]];
+					best = vertex_triangles[j];
+				}
+		}
+	}
+}
+
+void OptimizeOverdraw (uint32_t *destination, const uint32_t *indices, size_t index_count, const void *positions,
+					   uint32_t position_stride, uint32_t vertex_count, float threshold)
+{
+	ValidateTriangles (indices, index_count, vertex_count);
+	if (threshold < 1.0f)
+		throw std::invalid_argument ("Overdraw threshold must be at least 1");
+	const std::vector<uint32_t> source (indices, indices + index_count);
+	const size_t triangle_count = index_count / 3;
+	if (!triangle_count)
+		return;
+
+	//hard boundaries where the cache misses a whole triangle, the order starts over there
+	std::vector<size_t> hard_boundaries;
+	{
+		FifoCacheSimulator cache (vertex_count, mesh_vertex_cache_size);
+		for (size_t t = 0; t < triangle_count; t++)
+			if (cache.Triangle (&source[t * 3]) == 3)
+				hard_boundaries.push_back (t);
+	}
+	hard_boundaries.push_back (triangle_count);
+
+	//soft boundaries inside each: a cluster ends once its ACMR from a cold cache is within
+	//the threshold of the whole hard cluster's, so reordering clusters loses at most that
+	std::vector<size_t> clusters;
+	{
+		FifoCacheSimulator cache (vertex_count, mesh_vertex_cache_size);
+		for (size_t h = 0; h + 1 < hard_boundaries.size (); h++)
+		{
+			const size_t begin = hard_boundaries[h];
+			const size_t end = hard_boundaries[h + 1];
+			cache.Flush ();
+			uint32_t misses = 0;
+			for (size_t t = begin; t < end; t++)
+				misses += cache.Triangle (&source[t * 3]);
+			const float cluster_threshold = threshold * misses / (end - begin);
+
+			cache.Flush ();
+			clusters.push_back (begin);
+			size_t start = begin;
+			misses = 0;
+			for (size_t t = begin; t < end; t++)
+			{
+				misses += cache.Triangle (&source[t * 3]);
+				if (t + 1 < end && misses <= cluster_threshold * (t + 1 - start))
+				{
+					clusters.push_back (t + 1);
+					start = t + 1;
+					misses = 0;
+					cache.Flush ();
+				}
+			}
+		}
+	}
+	clusters.push_back (triangle_count);
+
+	//clusters facing away from the mesh centre are the likely occluders, they draw first
+	float mesh_center[3] = { 0.0f, 0.0f, 0.0f };
+	std::vector<float> triangle_data (triangle_count * 6);     //area weighted normal, centroid
+	for (size_t t = 0; t < triangle_count; t++)
+	{
+		float corners[3][3];
+		for (uint32_t k = 0; k < 3; k++)
+			LoadPosition (positions, position_stride, source[t * 3 + k], corners[k]);
+		float *data = &triangle_data[t * 6];
+		TriangleNormal (corners[0], corners[1], corners[2], data);
+		for (uint32_t c = 0; c < 3; c++)
+		{
+			data[3 + c] = (corners[0][c] + corners[1][c] + corners[2][c]) / 3.0f;
+			mesh_center[c] += data[3 + c] / triangle_count;
+		}
+	}
+	const size_t cluster_count = clusters.size () - 1;
+	std::vector<float> sort_keys (cluster_count);
+	for (size_t i = 0; i < cluster_count; i++)
+	{
+		float normal[3] = { 0.0f, 0.0f, 0.0f };
+		float center[3] = { 0.0f, 0.0f, 0.0f };
+		float area_sum = 0.0f;
+		for (size_t t = clusters[i]; t < clusters[i + 1]; t++)
+		{
+			const float *data = &triangle_data[t * 6];
+			const float area = sqrtf (data[0] * data[0] + data[1] * data[1] + data[2] * data[2]);
+			for (uint32_t c = 0; c < 3; c++)
+			{
+				normal[c] += data[c];
+				center[c] += data[3 + c] * area;
+			}
+			area_sum += area;
+		}
+		const float normal_length = sqrtf (normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+		float key = 0.0f;
+		if (area_sum > 0.0f && normal_length > 0.0f)
+			for (uint32_t c = 0; c < 3; c++)
+				key += (center[c] / area_sum - mesh_center[c]) * normal[c] / normal_length;
+		sort_keys[i] = key;
+	}
+	std::vector<uint32_t> order (cluster_count);
+	for (size_t i = 0; i < cluster_count; i++)
+		order[i] = static_cast<uint32_t>(i);
+	std::stable_sort (order.begin (), order.end (), [&sort_keys] (uint32_t a, uint32_t b) { return sort_keys[a] > sort_keys[b]; });
+
+	size_t out = 0;
+	for (uint32_t cluster : order)
+	{
+		const size_t begin = clusters[cluster] * 3;
+		const size_t end = clusters[cluster + 1] * 3;
+		memcpy (destination + out, &source[begin], (end - begin) * sizeof (uint32_t));
+		out += end - begin;
+	}
+}
+
+void BuildMeshlets (const uint32_t *indices, size_t index_count, const void *positions, uint32_t position_stride,
+					uint32_t vertex_count, uint32_t max_vertices, uint32_t max_triangles, MeshletData &meshlets)
+{
+	ValidateTriangles (indices, index_count, vertex_count);
+	if (max_vertices < 3 || max_vertices > 256 || !max_triangles)
+		throw std::invalid_argument ("Meshlets need 3 to 256 vertices and at least one triangle");
+
+	std::vector<int32_t> local (vertex_count, -1);
+	Meshlet meshlet = {};
+	meshlet.vertex_offset = static_cast<uint32_t>(meshlets.vertices.size ());
+	meshlet.triangle_offset = static_cast<uint32_t>(meshlets.triangles.size ());
+	auto finish = [&] ()
+	{
+		if (!meshlet.triangle_count)
+			return;
+		float bounds_min[3], bounds_max[3];
+		LoadPosition (positions, position_stride, meshlets.vertices[meshlet.vertex_offset], bounds_min);
+		memcpy (bounds_max, bounds_min, sizeof (bounds_max));
+		for (uint32_t i = 0; i < meshlet.vertex_count; i++)
+		{
+			const uint32_t vertex = meshlets.vertices[meshlet.vertex_offset + i];
+			local[vertex] = -1;
+			float position[3];
+			LoadPosition (positions, position_stride, vertex, position);
+			for (uint32_t c = 0; c < 3; c++)
+			{
+				bounds_min[c] = std::min (bounds_min[c], position[c]);
+				bounds_max[c] = std::max (bounds_max[c], position[c]);
+			}
+		}
+		float radius = 0.0f;
+		for (uint32_t c = 0; c < 3; c++)
+			meshlet.center[c] = 0.5f * (bounds_min[c] + bounds_max[c]);
+		for (uint32_t i = 0; i < meshlet.vertex_count; i++)
+		{
+			float position[3];
+			LoadPosition (positions, position_stride, meshlets.vertices[meshlet.vertex_offset + i], position);
+			float distance = 0.0f;
+			for (uint32_t c = 0; c < 3; c++)
+				distance += (position[c] - meshlet.center[c]) * (position[c] - meshlet.center[c]);
+			radius = std::max (radius, distance);
+		}
+		meshlet.radius = sqrtf (radius);
+		meshlets.meshlets.push_back (meshlet);
+		meshlet = Meshlet ();
+		meshlet.vertex_offset = static_cast<uint32_t>(meshlets.vertices.size ());
+		meshlet.triangle_offset = static_cast<uint32_t>(meshlets.triangles.size ());
+	};
+
+	for (size_t i = 0; i < index_count; i += 3)
+	{
+		uint32_t new_vertices = 0;
+		for (uint32_t k = 0; k < 3; k++)
+			if (local[indices[i + k]] < 0)
+				new_vertices++;
+		if (meshlet.vertex_count + new_vertices > max_vertices || meshlet.triangle_count == max_triangles)
+			finish ();
+		for (uint32_t k = 0; k < 3; k++)
+		{
+			const uint32_t vertex = indices[i + k];
+			if (local[vertex] < 0)
+			{
+				local[vertex] = static_cast<int32_t>(meshlet.vertex_count++);
+				meshlets.vertices.push_back (vertex);
+			}
+			meshlets.triangles.push_back (static_cast<uint8_t>(local[vertex]));
+		}
+		meshlet.triangle_count++;
+	}
+	finish ();
+}
+
+//mesh operations work on absolute indices and give every submesh its lowest vertex as base
+
+static const MeshAttribute &GetFloat3Position (const MeshData &mesh)
+{
+	for (const MeshAttribute &attribute : mesh.attributes)
+		if (attribute.semantic == MESH_ATTRIBUTE_POSITION && attribute.semantic_index == 0 && attribute.format == vertex_format_float3)
+			return attribute;
+	throw std::invalid_argument ("Mesh optimization needs R32G32B32_FLOAT positions");
+}
+
+static void MakeIndicesAbsolute (MeshData &mesh)
+{
+	const uint32_t vertex_count = mesh.GetVertexCount ();
+	for (MeshSubmesh &submesh : mesh.submeshes)
+	{
+		if (static_cast<uint64_t>(submesh.start_index) + submesh.index_count > mesh.indices.size () || submesh.index_count % 3)
+			throw std::out_of_range ("Submesh indices are out of range");
+		for (uint32_t i = 0; i < submesh.index_count; i++)
+		{
+			uint32_t &index = mesh.indices[submesh.start_index + i];
+			const int64_t vertex = static_cast<int64_t>(index) + submesh.base_vertex;
+			if (vertex < 0 || vertex >= vertex_count)
+				throw std::out_of_range ("Mesh index is out of range");
+			index = static_cast<uint32_t>(vertex);
+		}
+		submesh.base_vertex = 0;
+	}
+}
+
+static void RebaseSubmeshes (MeshData &mesh)
+{
+	for (MeshSubmesh &submesh : mesh.submeshes)
+	{
+		if (!submesh.index_count)
+			continue;
+		uint32_t *indices = &mesh.indices[submesh.start_index];
+		const uint32_t base = *std::min_element (indices, indices + submesh.index_count);
+		for (uint32_t i = 0; i < submesh.index_count; i++)
+			indices[i] -= base;
+		submesh.base_vertex = static_cast<int32_t>(base);
+	}
+}
+
+//vertices in the order of remap, which holds new vertices for every old one or ~0u for unused ones
+static void RemapVertices (MeshData &mesh, const std::vector<uint32_t> &remap, uint32_t new_count)
+{
+	std::vector<uint8_t> vertices (static_cast<size_t>(new_count) * mesh.vertex_stride);
+	for (size_t v = 0; v < remap.size (); v++)
+		if (remap[v] != ~0u)
+			memcpy (&vertices[static_cast<size_t>(remap[v]) * mesh.vertex_stride], &mesh.vertices[v * mesh.vertex_stride], mesh.vertex_stride);
+	mesh.vertices.swap (vertices);
+	for (MeshSubmesh &submesh : mesh.submeshes)
+		for (uint32_t i = 0; i < submesh.index_count; i++)
+		{
+			uint32_t &index = mesh.indices[submesh.start_index + i];
+			index = remap[index];
+		}
+}
+
+namespace
+{
+	struct VertexBytesHash
+	{
+		const uint8_t *vertices;
+		uint32_t stride;
+
+		size_t operator() (uint32_t vertex) const
+		{
+			//FNV-1a
+			const uint8_t *bytes = vertices + static_cast<size_t>(vertex) * stride;
+			uint64_t hash = 0xcbf29ce484222325ull;
+			for (uint32_t i = 0; i < stride; i++)
+				hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+			return static_cast<size_t>(hash);
+		}
+	};
+
+	struct VertexBytesEqual
+	{
+		const uint8_t *vertices;
+		uint32_t stride;
+
+		bool operator() (uint32_t a, uint32_t b) const
+		{
+			return memcmp (vertices + static_cast<size_t>(a) * stride, vertices + static_cast<size_t>(b) * stride, stride) == 0;
+		}
+	};
+}
+
+static uint32_t DeduplicateAbsolute (MeshData &mesh)
+{
+	const uint32_t vertex_count = mesh.GetVertexCount ();
+	std::unordered_map<uint32_t, uint32_t, VertexBytesHash, VertexBytesEqual> unique (vertex_count,
+		VertexBytesHash { mesh.vertices.data (), mesh.vertex_stride }, VertexBytesEqual { mesh.vertices.data (), mesh.vertex_stride });
+	std::vector<uint32_t> remap (vertex_count);
+	for (uint32_t v = 0; v < vertex_count; v++)
+		remap[v] = unique.emplace (v, static_cast<uint32_t>(unique.size ())).first->second;
+	const uint32_t unique_count = static_cast<uint32_t>(unique.size ());
+	if (unique_count != vertex_count)
+		RemapVertices (mesh, remap, unique_count);
+	return vertex_count - unique_count;
+}
+
+static void OptimizeVertexFetchAbsolute (MeshData &mesh)
+{
+	std::vector<uint32_t> remap (mesh.GetVertexCount (), ~0u);
+	uint32_t next = 0;
+	for (const MeshSubmesh &submesh : mesh.submeshes)
+		for (uint32_t i = 0; i < submesh.index_count; i++)
+		{
+			uint32_t &vertex = remap[mesh.indices[submesh.start_index + i]];
+			if (vertex == ~0u)
+				vertex = next++;
+		}
+	RemapVertices (mesh, remap, next);
+}
+
+uint32_t DeduplicateVertices (MeshData &mesh)
+{
+	MakeIndicesAbsolute (mesh);
+	const uint32_t removed = DeduplicateAbsolute (mesh);
+	RebaseSubmeshes (mesh);
+	return removed;
+}
+
+void OptimizeVertexFetch (MeshData &mesh)
+{
+	MakeIndicesAbsolute (mesh);
+	OptimizeVertexFetchAbsolute (mesh);
+	RebaseSubmeshes (mesh);
+}
+
+//indices of all submeshes in submesh order
+static std::vector<uint32_t> GatherIndices (const MeshData &mesh)
+{
+	std::vector<uint32_t> indices;
+	for (const MeshSubmesh &submesh : mesh.submeshes)
+		indices.insert (indices.end (), mesh.indices.begin () + submesh.start_index, mesh.indices.begin () + submesh.start_index + submesh.index_count);
+	return indices;
+}
+
+static void AnalyzeMesh (const MeshData &mesh, VertexCacheStats &cache, OverdrawStats &overdraw)
+{
+	const std::vector<uint32_t> indices = GatherIndices (mesh);
+	const MeshAttribute &position = GetFloat3Position (mesh);
+	cache = AnalyzeVertexCache (indices.data (), indices.size (), mesh.GetVertexCount ());
+	overdraw = AnalyzeOverdraw (indices.data (), indices.size (), mesh.vertices.data () + position.offset, mesh.vertex_stride, mesh.GetVertexCount ());
+}
+
+void OptimizeMesh (MeshData &mesh, float overdraw_threshold, MeshOptimizeStats *stats)
+{
+	const MeshAttribute &position = GetFloat3Position (mesh);
+	MakeIndicesAbsolute (mesh);
+	if (stats)
+	{
+		stats->vertices_before = mesh.GetVertexCount ();
+		AnalyzeMesh (mesh, stats->cache_before, stats->overdraw_before);
+	}
+
+	DeduplicateAbsolute (mesh);
+	const uint32_t vertex_count = mesh.GetVertexCount ();
+	for (const MeshSubmesh &submesh : mesh.submeshes)
+	{
+		uint32_t *indices = mesh.indices.data () + submesh.start_index;
+		OptimizeVertexCache (indices, indices, submesh.index_count, vertex_count);
+		OptimizeOverdraw (indices, indices, submesh.index_count, mesh.vertices.data () + position.offset, mesh.vertex_stride,
+						  vertex_count, overdraw_threshold);
+	}
+	OptimizeVertexFetchAbsolute (mesh);
+
+	if (stats)
+	{
+		stats->vertices_after = mesh.GetVertexCount ();
+		AnalyzeMesh (mesh, stats->cache_after, stats->overdraw_after);
+	}
+	RebaseSubmeshes (mesh);
+	ComputeMeshBounds (mesh);
+}
+
+void BuildMeshlets (const MeshData &mesh, uint32_t max_vertices, uint32_t max_triangles, MeshletData &meshlets)
+{
+	const MeshAttribute &position = GetFloat3Position (mesh);
+	meshlets = MeshletData ();
+	for (const MeshSubmesh &submesh : mesh.submeshes)
+	{
+		if (static_cast<uint64_t>(submesh.start_index) + submesh.index_count > mesh.indices.size ())
+			throw std::out_of_range ("Submesh indices are out of range");
+		std::vector<uint32_t> indices (mesh.indices.begin () + submesh.start_index, mesh.indices.begin () + submesh.start_index + submesh.index_count);
+		for (uint32_t &index : indices)
+			index += submesh.base_vertex;
+		BuildMeshlets (indices.data (), indices.size (), mesh.vertices.data () + position.offset, mesh.vertex_stride,
+					   mesh.GetVertexCount (), max_vertices, max_triangles, meshlets);
+	}
+}
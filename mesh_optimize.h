@@ -0,0 +1,95 @@
+#pragma once
+#include "mesh_file.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+//Mesh optimization for the GPU's vertex pipeline and meshlet generation. The triangle
+//functions take one triangle list of absolute vertex indices; the MeshData functions
+//work on every submesh and need R32G32B32_FLOAT positions, so they run before
+//QuantizeMesh.
+//
+//OptimizeVertexCache orders triangles with Tom Forsyth's linear-speed vertex cache
+//optimization. OptimizeOverdraw then splits that order into clusters whose vertex cache
+//efficiency does not depend on their neighbours and sorts the clusters so that
+//outward-facing ones draw first (Sander, Nehab and Barczak, "Fast Triangle Reordering
+//for Vertex Locality and Reduced Overdraw"). OptimizeVertexFetch stores vertices in the
+//order the index buffer first uses them.
+
+//FIFO cache size of the analysis and of the overdraw clusters
+static const uint32_t mesh_vertex_cache_size = 16;
+//ACMR the overdraw order may lose against the vertex cache order
+static const float mesh_overdraw_threshold = 1.05f;
+//meshlet limits of the mesh shader paths, triangles stay a multiple of 4
+static const uint32_t meshlet_max_vertices = 64;
+static const uint32_t meshlet_max_triangles = 124;
+
+struct VertexCacheStats
+{
+	uint32_t transformed;       //vertex shader invocations
+	float acmr;                 //transformed per triangle, 0.5 is ideal for large grids, 3 is the worst
+	float atvr;                 //transformed per referenced vertex, 1 is ideal
+};
+
+struct OverdrawStats
+{
+	uint64_t covered;           //pixels covered by at least one triangle
+	uint64_t shaded;            //fragments passing the depth test
+	float overdraw;             //shaded per covered, 1 is ideal
+};
+
+struct MeshOptimizeStats
+{
+	uint32_t vertices_before;
+	uint32_t vertices_after;    //after removing duplicates and unused vertices
+	VertexCacheStats cache_before;
+	VertexCacheStats cache_after;
+	OverdrawStats overdraw_before;
+	OverdrawStats overdraw_after;
+};
+
+struct Meshlet
+{
+	uint32_t vertex_offset;     //into MeshletData::vertices
+	uint32_t triangle_offset;   //into MeshletData::triangles, 3 bytes per triangle
+	uint32_t vertex_count;
+	uint32_t triangle_count;
+	float center[3];            //bounding sphere
+	float radius;
+};
+
+struct MeshletData
+{
+	std::vector<Meshlet> meshlets;
+	std::vector<uint32_t> vertices;     //mesh vertices of each meshlet
+	std::vector<uint8_t> triangles;     //indices into the meshlet's vertices
+};
+
+//simulates a FIFO post-transform cache of cache_size vertices
+VertexCacheStats AnalyzeVertexCache (const uint32_t *indices, size_t index_count, uint32_t vertex_count,
+									 uint32_t cache_size = mesh_vertex_cache_size);
+//rasterizes the mesh from the six axis directions with depth testing and back face culling
+//(clockwise front faces), in the order of the index buffer
+OverdrawStats AnalyzeOverdraw (const uint32_t *indices, size_t index_count, const void *positions, uint32_t position_stride,
+							   uint32_t vertex_count);
+
+//destination may be indices; out of range indices throw std::out_of_range
+void OptimizeVertexCache (uint32_t *destination, const uint32_t *indices, size_t index_count, uint32_t vertex_count);
+//expects the output of OptimizeVertexCache; threshold is the allowed ACMR ratio, at least 1
+void OptimizeOverdraw (uint32_t *destination, const uint32_t *indices, size_t index_count, const void *positions,
+					   uint32_t position_stride, uint32_t vertex_count, float threshold = mesh_overdraw_threshold);
+//greedy split in index order appended to meshlets, max_vertices is at most 256
+void BuildMeshlets (const uint32_t *indices, size_t index_count, const void *positions, uint32_t position_stride,
+					uint32_t vertex_count, uint32_t max_vertices, uint32_t max_triangles, MeshletData &meshlets);
+
+//merges vertices with identical bytes, returns the number removed
+uint32_t DeduplicateVertices (MeshData &mesh);
+//orders vertices by their first use and drops unused ones
+void OptimizeVertexFetch (MeshData &mesh);
+//all of the above in order; afterwards each submesh's base vertex is its lowest vertex,
+//so small submeshes keep 16 bit indices. Stats may be null.
+void OptimizeMesh (MeshData &mesh, float overdraw_threshold, MeshOptimizeStats *stats);
+//meshlets of every submesh, in submesh order
+void BuildMeshlets (const MeshData &mesh, uint32_t max_vertices, uint32_t max_triangles, MeshletData &meshlets);
@@ -0,0 +1,642 @@
+#include "null_device.h"
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+
+static const size_t max_payload_size = 0xffff;
+static const uint32_t max_barriers_per_command = 1024;
+static const uint32_t max_root_constants = 64;
+
+static uint64_t GetSteadyNanoseconds ()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now ().time_since_epoch ()).count ();
+}
+
+void NullCommandAllocator::Reset ()
+{
+	//keep the capacity, reusing allocator memory is the point of resetting it
+	stream.clear ();
+}
+
+NullCommandList::NullCommandList (NullCommandAllocator *command_allocator) :
+	allocator (command_allocator),
+	begin (command_allocator->stream.size ()),
+	end (begin),
+	closed (false),
+	command_count (0),
+	draw_count (0),
+	barrier_count (0),
+	copy_bytes (0)
+{
+}
+
+void NullCommandList::Reset (GpuCommandAllocator *command_allocator, GpuPipelineHandle initial_state)
+{
+	if (!closed)
+		throw std::logic_error ("Null command list is reset while recording");
+	allocator = static_cast<NullCommandAllocator*>(command_allocator);
+	begin = end = allocator->stream.size ();
+	closed = false;
+	command_count = draw_count = barrier_count = 0;
+	copy_bytes = 0;
+	if (initial_state)
+		SetPipelineState (initial_state);
+}
+
+void NullCommandList::Close ()
+{
+	if (closed)
+		throw std::logic_error ("Null command list is closed twice");
+	closed = true;
+}
+
+const uint8_t *NullCommandList::GetCommands () const
+{
+	return allocator->stream.data () + begin;
+}
+
+uint8_t *NullCommandList::Allocate (NullCommandType type, size_t size)
+{
+	if (closed)
+		throw std::logic_error ("Null command list is recorded while closed");
+	if (size > max_payload_size)
+		throw std::length_error ("Null command payload is too large");
+
+	std::vector<uint8_t> &stream = allocator->stream;
+	if (stream.size () != end)
+		throw std::logic_error ("Two null command lists record into one allocator");
+	NullCommandHeader header = { static_cast<uint16_t>(type), static_cast<uint16_t>(size) };
+	stream.resize (end + sizeof (header) + size);
+	memcpy (stream.data () + end, &header, sizeof (header));
+	uint8_t *payload = stream.data () + end + sizeof (header);
+	end = stream.size ();
+	command_count++;
+	return payload;
+}
+
+void NullCommandList::SetPipelineState (GpuPipelineHandle pipeline_state)
+{
+	Write (NULL_COMMAND_SET_PIPELINE_STATE, pipeline_state);
+}
+
+void NullCommandList::SetGraphicsRootSignature (GpuRootSignatureHandle root_signature)
+{
+	Write (NULL_COMMAND_SET_ROOT_SIGNATURE, root_signature);
+}
+
+void NullCommandList::SetGraphicsRoot32BitConstants (uint32_t root_parameter, uint32_t count, const void *values, uint32_t dest_offset)
+{
+	//the destination offset is stored before the values, root signatures hold at most 64 of them
+	uint32_t payload[1 + max_root_constants];
+	count = std::min (count, max_root_constants);
+	payload[0] = dest_offset;
+	if (count)
+		memcpy (payload + 1, values, count * sizeof (uint32_t));
+	WriteArray (NULL_COMMAND_SET_ROOT_CONSTANTS, root_parameter, count + 1, payload);
+}
+
+void NullCommandList::SetDescriptorHeaps (uint32_t count, const GpuDescriptorHeapHandle *heaps)
+{
+	WriteArray (NULL_COMMAND_SET_DESCRIPTOR_HEAPS, 0, count, heaps);
+}
+
+void NullCommandList::SetGraphicsRootDescriptorTable (uint32_t root_parameter, GpuShaderDescriptorHandle table)
+{
+	NullRootTablePayload payload = { table, root_parameter, 0 };
+	Write (NULL_COMMAND_SET_ROOT_TABLE, payload);
+}
+
+void NullCommandList::SetPrimitiveTopology (GpuPrimitiveTopology topology)
+{
+	Write (NULL_COMMAND_SET_PRIMITIVE_TOPOLOGY, static_cast<uint32_t>(topology));
+}
+
+void NullCommandList::SetViewports (uint32_t count, const GpuViewport *viewports)
+{
+	WriteArray (NULL_COMMAND_SET_VIEWPORTS, 0, count, viewports);
+}
+
+void NullCommandList::SetScissorRects (uint32_t count, const GpuRect *rects)
+{
+	WriteArray (NULL_COMMAND_SET_SCISSOR_RECTS, 0, count, rects);
+}
+
+void NullCommandList::SetRenderTargets (uint32_t count, const GpuDescriptorHandle *render_targets, const GpuDescriptorHandle *depth_stencil)
+{
+	//the depth stencil handle is stored after the render targets, the extra field tells if it is present
+	GpuDescriptorHandle handles[9] = {};
+	count = std::min<uint32_t>(count, 8);
+	if (count)
+		memcpy (handles, render_targets, count * sizeof (GpuDescriptorHandle));
+	handles[count] = depth_stencil ? *depth_stencil : 0;
+	WriteArray (NULL_COMMAND_SET_RENDER_TARGETS, depth_stencil ? 1 : 0, count + 1, handles);
+}
+
+void NullCommandList::SetVertexBuffers (uint32_t start_slot, uint32_t count, const GpuVertexBufferView *views)
+{
+	WriteArray (NULL_COMMAND_SET_VERTEX_BUFFERS, start_slot, count, views);
+}
+
+void NullCommandList::SetIndexBuffer (const GpuIndexBufferView *view)
+{
+	//a null view unbinds the index buffer
+	GpuIndexBufferView payload = {};
+	if (view)
+		payload = *view;
+	Write (NULL_COMMAND_SET_INDEX_BUFFER, payload);
+}
+
+void NullCommandList::ResourceBarrier (uint32_t count, const GpuBarrier *barriers)
+{
+	while (count)
+	{
+		uint32_t batch = std::min (count, max_barriers_per_command);
+		WriteArray (NULL_COMMAND_RESOURCE_BARRIER, 0, batch, barriers);
+		barrier_count += batch;
+		barriers += batch;
+		count -= batch;
+	}
+}
+
+void NullCommandList::ClearRenderTargetView (GpuDescriptorHandle render_target, const float color[4])
+{
+	NullClearPayload payload;
+	payload.render_target = render_target;
+	memcpy (payload.color, color, sizeof (payload.color));
+	Write (NULL_COMMAND_CLEAR_RENDER_TARGET, payload);
+}
+
+void NullCommandList::DrawInstanced (uint32_t vertex_count, uint32_t instance_count, uint32_t start_vertex, uint32_t start_instance)
+{
+	NullDrawPayload payload = { vertex_count, instance_count, start_vertex, start_instance };
+	Write (NULL_COMMAND_DRAW_INSTANCED, payload);
+	draw_count++;
+}
+
+void NullCommandList::DrawIndexedInstanced (uint32_t index_count, uint32_t instance_count, uint32_t start_index, int32_t base_vertex, uint32_t start_instance)
+{
+	NullDrawIndexedPayload payload = { index_count, instance_count, start_index, base_vertex, start_instance };
+	Write (NULL_COMMAND_DRAW_INDEXED_INSTANCED, payload);
+	draw_count++;
+}
+
+void NullCommandList::ExecuteIndirect (GpuCommandSignatureHandle command_signature, uint32_t max_command_count, GpuResourceHandle arguments,
+									   uint64_t arguments_offset, GpuResourceHandle count_buffer, uint64_t count_offset)
+{
+	NullExecuteIndirectPayload payload = { command_signature, arguments, arguments_offset, count_buffer, count_offset, max_command_count, 0 };
+	Write (NULL_COMMAND_EXECUTE_INDIRECT, payload);
+	//the arguments are not read, every command is costed as a draw
+	draw_count += max_command_count;
+}
+
+void NullCommandList::CopyBufferRegion (GpuResourceHandle dst, uint64_t dst_offset, GpuResourceHandle src, uint64_t src_offset, uint64_t size)
+{
+	NullCopyPayload payload = { dst, dst_offset, src, src_offset, size };
+	Write (NULL_COMMAND_COPY_BUFFER_REGION, payload);
+	copy_bytes += size;
+}
+
+void NullCommandList::CopyBufferToTexture (GpuResourceHandle dst, uint32_t dst_subresource, GpuResourceHandle src, const GpuTextureFootprint &footprint)
+{
+	NullTextureCopyPayload payload = { dst, src, footprint, dst_subresource, 0 };
+	Write (NULL_COMMAND_COPY_BUFFER_TO_TEXTURE, payload);
+	//the format is not known here, rows of blocks are costed as rows of pixels
+	copy_bytes += static_cast<uint64_t>(footprint.row_pitch) * footprint.height * footprint.depth;
+}
+
+NullCommandReader::NullCommandReader (const NullCommandList &command_list) :
+	current (command_list.GetCommands ()),
+	end (command_list.GetCommands () + command_list.GetCommandsSize ())
+{
+}
+
+bool NullCommandReader::Next (NullCommandHeader &header, const uint8_t *&payload)
+{
+	if (current + sizeof (NullCommandHeader) > end)
+		return false;
+	memcpy (&header, current, sizeof (header));
+	payload = current + sizeof (header);
+	current = payload + header.size;
+	return true;
+}
+
+NullDeviceDesc::NullDeviceDesc () :
+	real_time_clock (false),
+	gpu_ns_per_list (2000),
+	gpu_ns_per_command (50),
+	gpu_ns_per_draw (500),
+	gpu_ns_per_copy_kb (100)
+{
+}
+
+NullDevice::NullDevice (const NullDeviceDesc &device_desc) :
+	desc (device_desc),
+	clock_origin (GetSteadyNanoseconds ()),
+	manual_time (0),
+	gpu_idle_time (0),
+	pending_gpu_work (0),
+	completed_value (0),
+	next_address (0x10000)
+{
+	ResetStats ();
+}
+
+std::unique_ptr<GpuCommandAllocator> NullDevice::CreateCommandAllocator ()
+{
+	return std::unique_ptr<GpuCommandAllocator> (new NullCommandAllocator);
+}
+
+std::unique_ptr<GpuCommandList> NullDevice::CreateCommandList (GpuCommandAllocator *allocator)
+{
+	return std::unique_ptr<GpuCommandList> (new NullCommandList (static_cast<NullCommandAllocator*>(allocator)));
+}
+
+void NullDevice::ExecuteCommandLists (uint32_t count, GpuCommandList *const *command_lists)
+{
+	std::lock_guard<std::mutex> lock (mutex);
+	uint64_t cost = pending_gpu_work;
+	pending_gpu_work = 0;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		const NullCommandList *command_list = static_cast<const NullCommandList*>(command_lists[i]);
+		if (!command_list->IsClosed ())
+			throw std::logic_error ("Null command list is executed while recording");
+		cost += desc.gpu_ns_per_list +
+			command_list->GetCommandCount () * desc.gpu_ns_per_command +
+			command_list->GetDrawCount () * desc.gpu_ns_per_draw +
+			command_list->GetCopyBytes () * desc.gpu_ns_per_copy_kb / 1024;
+
+		stats.executed_lists++;
+		stats.executed_commands += command_list->GetCommandCount ();
+		stats.draws += command_list->GetDrawCount ();
+		stats.barriers += command_list->GetBarrierCount ();
+		stats.bytes += command_list->GetCommandsSize ();
+		stats.copy_bytes += command_list->GetCopyBytes ();
+	}
+	//the GPU starts the batch once it is submitted and the previous work is done
+	gpu_idle_time = std::max (gpu_idle_time, CpuTime ()) + cost;
+	stats.gpu_busy_ns += cost;
+}
+
+void NullDevice::Signal (uint64_t value)
+{
+	std::lock_guard<std::mutex> lock (mutex);
+	pending_signals.push_back (std::make_pair (value, std::max (gpu_idle_time, CpuTime ())));
+}
+
+uint64_t NullDevice::GetCompletedFenceValue ()
+{
+	std::lock_guard<std::mutex> lock (mutex);
+	RetireSignals (CpuTime ());
+	return completed_value;
+}
+
+void NullDevice::WaitForFenceValue (uint64_t value)
+{
+	std::lock_guard<std::mutex> lock (mutex);
+	const uint64_t now = CpuTime ();
+	RetireSignals (now);
+	if (completed_value >= value)
+		return;
+
+	auto signal = std::find_if (pending_signals.begin (), pending_signals.end (),
+								[value] (const std::pair<uint64_t, uint64_t> &pending) { return pending.first >= value; });
+	if (signal == pending_signals.end ())
+		throw std::logic_error ("Waiting for a fence value that is never signaled");
+
+	//jump the CPU timeline forward instead of sleeping
+	const uint64_t stall = signal->second - now;
+	manual_time += stall;
+	stats.waits++;
+	stats.stall_ns += stall;
+	RetireSignals (now + stall);
+}
+
+void NullDevice::WaitForQueue (GpuDevice *queue, uint64_t value)
+{
+	const uint64_t signal_time = static_cast<NullDevice*>(queue)->GetSignalTime (value);
+	std::lock_guard<std::mutex> lock (mutex);
+	//later batches start no earlier than the signal of the other queue
+	stats.queue_waits++;
+	const uint64_t start = std::max (gpu_idle_time, CpuTime ());
+	if (signal_time > start)
+	{
+		stats.queue_wait_ns += signal_time - start;
+		gpu_idle_time = signal_time;
+	}
+}
+
+GpuResourceHandle NullDevice::CreateResource (uint64_t size)
+{
+	std::lock_guard<std::mutex> lock (mutex);
+	resource_addresses.push_back (next_address);
+	//keep fake addresses 64 KB aligned like committed resources
+	next_address += (std::max<uint64_t>(size, 1) + 0xffff) & ~static_cast<uint64_t>(0xffff);
+	return resource_addresses.size ();
+}
+
+GpuVirtualAddress NullDevice::GetGpuVirtualAddress (GpuResourceHandle resource) const
+{
+	std::lock_guard<std::mutex> lock (mutex);
+	if (resource == 0 || resource > resource_addresses.size ())
+		return 0;
+	return resource_addresses[resource - 1];
+}
+
+uint64_t NullDevice::GetCpuTime () const
+{
+	std::lock_guard<std::mutex> lock (mutex);
+	return CpuTime ();
+}
+
+void NullDevice::AdvanceCpuTime (uint64_t ns)
+{
+	std::lock_guard<std::mutex> lock (mutex);
+	manual_time += ns;
+}
+
+uint64_t NullDevice::GetGpuIdleTime () const
+{
+	std::lock_guard<std::mutex> lock (mutex);
+	return gpu_idle_time;
+}
+
+void NullDevice::AddGpuWork (uint64_t ns)
+{
+	std::lock_guard<std::mutex> lock (mutex);
+	pending_gpu_work += ns;
+}
+
+NullDeviceStats NullDevice::GetStats () const
+{
+	std::lock_guard<std::mutex> lock (mutex);
+	return stats;
+}
+
+void NullDevice::ResetStats ()
+{
+	std::lock_guard<std::mutex> lock (mutex);
+	memset (&stats, 0, sizeof (stats));
+}
+
+uint64_t NullDevice::CpuTime () const
+{
+	if (desc.real_time_clock)
+		return GetSteadyNanoseconds () - clock_origin + manual_time;
+	return manual_time;
+}
+
+void NullDevice::RetireSignals (uint64_t cpu_time)
+{
+	while (!pending_signals.empty () && pending_signals.front ().second <= cpu_time)
+	{
+		completed_value = std::max (completed_value, pending_signals.front ().first);
+		pending_signals.pop_front ();
+	}
+}
+
+uint64_t NullDevice::GetSignalTime (uint64_t value)
+{
+	std::lock_guard<std::mutex> lock (mutex);
+	RetireSignals (CpuTime ());
+	if (completed_value >= value)
+		return 0;
+	auto signal = std::find_if (pending_signals.begin (), pending_signals.end (),
+								[value] (const std::pair<uint64_t, uint64_t> &pending) { return pending.first >= value; });
+	//a D3D12 queue would wait for a later signal, the simulation needs it to be queued already
+	if (signal == pending_signals.end ())
+		throw std::logic_error ("Waiting for a queue fence value that is not signaled yet");
+	return signal->second;
+}
+
+NullMemory::NullMemory (uint64_t memory_budget) :
+	budget (memory_budget),
+	external_usage (0),
+	heap_usage (0)
+{
+	memset (&stats, 0, sizeof (stats));
+}
+
+GpuHeapHandle NullMemory::CreateHeap (GpuHeapTier, uint64_t size)
+{
+	std::lock_guard<std::mutex> lock (mutex);
+	//like D3D12 heaps, new heaps are resident
+	const Heap heap = { size, true, true };
+	heaps.push_back (heap);
+	heap_usage += size;
+	stats.heaps++;
+	stats.resident_heaps++;
+	UpdateUsage ();
+	return heaps.size ();
+}
+
+void NullMemory::DestroyHeap (GpuHeapHandle handle)
+{
+	std::lock_guard<std::mutex> lock (mutex);
+	Heap &heap = GetHeap (handle);
+	if (heap.resident)
+	{
+		heap_usage -= heap.size;
+		stats.resident_heaps--;
+	}
+	heap.live = false;
+	stats.heaps--;
+	UpdateUsage ();
+}
+
+void NullMemory::QueryBudget (uint64_t &memory_budget, uint64_t &usage)
+{
+	std::lock_guard<std::mutex> lock (mutex);
+	memory_budget = budget;
+	usage = stats.usage;
+}
+
+void NullMemory::MakeResident (uint32_t count, const GpuHeapHandle *handles)
+{
+	std::lock_guard<std::mutex> lock (mutex);
+	stats.make_resident_calls++;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		Heap &heap = GetHeap (handles[i]);
+		if (heap.resident)
+		{
+			stats.redundant++;
+			continue;
+		}
+		heap.resident = true;
+		heap_usage += heap.size;
+		stats.resident_heaps++;
+		stats.made_resident_bytes += heap.size;
+	}
+	UpdateUsage ();
+}
+
+void NullMemory::Evict (uint32_t count, const GpuHeapHandle *handles)
+{
+	std::lock_guard<std::mutex> lock (mutex);
+	stats.evict_calls++;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		Heap &heap = GetHeap (handles[i]);
+		if (!heap.resident)
+		{
+			stats.redundant++;
+			continue;
+		}
+		heap.resident = false;
+		heap_usage -= heap.size;
+		stats.resident_heaps--;
+		stats.evicted_bytes += heap.size;
+	}
+	UpdateUsage ();
+}
+
+void NullMemory::SetBudget (uint64_t memory_budget)
+{
+	std::lock_guard<std::mutex> lock (mutex);
+	budget = memory_budget;
+}
+
+void NullMemory::SetExternalUsage (uint64_t bytes)
+{
+	std::lock_guard<std::mutex> lock (mutex);
+	external_usage = bytes;
+	UpdateUsage ();
+}
+
+bool NullMemory::IsResident (GpuHeapHandle heap) const
+{
+	std::lock_guard<std::mutex> lock (mutex);
+	return GetHeap (heap).resident;
+}
+
+NullMemoryStats NullMemory::GetStats () const
+{
+	std::lock_guard<std::mutex> lock (mutex);
+	return stats;
+}
+
+NullMemory::Heap &NullMemory::GetHeap (GpuHeapHandle heap)
+{
+	if (heap == 0 || heap > heaps.size () || !heaps[heap - 1].live)
+		throw std::invalid_argument ("Unknown heap");
+	return heaps[heap - 1];
+}
+
+const NullMemory::Heap &NullMemory::GetHeap (GpuHeapHandle heap) const
+{
+	if (heap == 0 || heap > heaps.size () || !heaps[heap - 1].live)
+		throw std::invalid_argument ("Unknown heap");
+	return heaps[heap - 1];
+}
+
+void NullMemory::UpdateUsage ()
+{
+	stats.usage = heap_usage + external_usage;
+	stats.peak_usage = std::max (stats.peak_usage, stats.usage);
+}
+
+NullPresentDesc::NullPresentDesc () :
+	refresh_interval (16666667),
+	tearing_supported (true)
+{
+}
+
+NullPresentBackend::NullPresentBackend (NullDevice *null_device, const NullPresentDesc &present_desc) :
+	device (null_device),
+	desc (present_desc),
+	//the DXGI default
+	max_latency (3),
+	present_count (0),
+	last_display_time (0),
+	displayed (false)
+{
+	if (!desc.refresh_interval)
+		throw std::invalid_argument ("Null swap chain needs a refresh interval");
+	memset (&display_info, 0, sizeof (display_info));
+}
+
+bool NullPresentBackend::IsTearingSupported ()
+{
+	return desc.tearing_supported;
+}
+
+void NullPresentBackend::SetMaximumFrameLatency (uint32_t frames)
+{
+	max_latency = frames;
+}
+
+bool NullPresentBackend::WaitForFrame (uint32_t timeout_ms)
+{
+	const uint64_t now = device->GetCpuTime ();
+	RetirePresents (now);
+	if (queued_presents.size () < max_latency)
+		return true;
+	//the wait ends when the present that makes room is displayed
+	const uint64_t signal_time = queued_presents[queued_presents.size () - max_latency].second;
+	const uint64_t timeout = static_cast<uint64_t>(timeout_ms) * 1000000;
+	if (signal_time - now > timeout)
+	{
+		device->AdvanceCpuTime (timeout);
+		return false;
+	}
+	device->AdvanceCpuTime (signal_time - now);
+	RetirePresents (signal_time);
+	return true;
+}
+
+uint64_t NullPresentBackend::Present (bool vsync)
+{
+	const uint64_t now = device->GetCpuTime ();
+	RetirePresents (now);
+	const uint64_t done = std::max (device->GetGpuIdleTime (), now);
+	uint64_t display_time;
+	if (vsync)
+		display_time = GetNextVblank (std::max (done, last_display_time + 1));
+	else if (desc.tearing_supported)
+		display_time = done;
+	else
+		display_time = GetNextVblank (done);
+	//flips are displayed in order
+	display_time = std::max (display_time, last_display_time);
+	last_display_time = display_time;
+	queued_presents.push_back (std::make_pair (++present_count, display_time));
+	return present_count;
+}
+
+bool NullPresentBackend::GetDisplayInfo (PresentDisplayInfo &info)
+{
+	RetirePresents (device->GetCpuTime ());
+	info = display_info;
+	return displayed;
+}
+
+uint64_t NullPresentBackend::GetTime ()
+{
+	return device->GetCpuTime ();
+}
+
+void NullPresentBackend::SleepUntil (uint64_t time)
+{
+	const uint64_t now = device->GetCpuTime ();
+	if (time > now)
+		device->AdvanceCpuTime (time - now);
+}
+
+uint64_t NullPresentBackend::GetNextVblank (uint64_t time) const
+{
+	return (time + desc.refresh_interval - 1) / desc.refresh_interval * desc.refresh_interval;
+}
+
+void NullPresentBackend::RetirePresents (uint64_t time)
+{
+	while (!queued_presents.empty () && queued_presents.front ().second <= time)
+	{
+		display_info.present_count = queued_presents.front ().first;
+		display_info.time = queued_presents.front ().second;
+		display_info.refresh_count = display_info.time / desc.refresh_interval;
+		displayed = true;
+		queued_presents.pop_front ();
+	}
+}
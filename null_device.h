@@ -0,0 +1,382 @@
+#pragma once
+#include "gpu_device.h"
+#include "gpu_memory.h"
+#include "present_controller.h"
+#include "residency.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#include <deque>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+//Headless GpuDevice backend. Command lists are encoded into a compact byte stream
+//owned by their allocator, and the queue fence is simulated on a nanosecond timeline
+//driven by a configurable GPU cost model, so frame construction can be measured and
+//tested without a GPU or a window.
+
+enum NullCommandType
+{
+	NULL_COMMAND_SET_PIPELINE_STATE,
+	NULL_COMMAND_SET_ROOT_SIGNATURE,
+	NULL_COMMAND_SET_ROOT_CONSTANTS,
+	NULL_COMMAND_SET_DESCRIPTOR_HEAPS,
+	NULL_COMMAND_SET_ROOT_TABLE,
+	NULL_COMMAND_SET_PRIMITIVE_TOPOLOGY,
+	NULL_COMMAND_SET_VIEWPORTS,
+	NULL_COMMAND_SET_SCISSOR_RECTS,
+	NULL_COMMAND_SET_RENDER_TARGETS,
+	NULL_COMMAND_SET_VERTEX_BUFFERS,
+	NULL_COMMAND_SET_INDEX_BUFFER,
+	NULL_COMMAND_RESOURCE_BARRIER,
+	NULL_COMMAND_CLEAR_RENDER_TARGET,
+	NULL_COMMAND_DRAW_INSTANCED,
+	NULL_COMMAND_DRAW_INDEXED_INSTANCED,
+	NULL_COMMAND_EXECUTE_INDIRECT,
+	NULL_COMMAND_COPY_BUFFER_REGION,
+	NULL_COMMAND_COPY_BUFFER_TO_TEXTURE,
+	NULL_COMMAND_COUNT
+};
+
+//every command is a header followed by size bytes of payload; payloads of variable
+//length commands start with a uint32_t element count
+struct NullCommandHeader
+{
+	uint16_t type;
+	uint16_t size;
+};
+
+struct NullDrawPayload
+{
+	uint32_t vertex_count;
+	uint32_t instance_count;
+	uint32_t start_vertex;
+	uint32_t start_instance;
+};
+
+struct NullDrawIndexedPayload
+{
+	uint32_t index_count;
+	uint32_t instance_count;
+	uint32_t start_index;
+	int32_t base_vertex;
+	uint32_t start_instance;
+};
+
+struct NullRootTablePayload
+{
+	GpuShaderDescriptorHandle table;
+	uint32_t root_parameter;
+	uint32_t padding;
+};
+
+struct NullExecuteIndirectPayload
+{
+	GpuCommandSignatureHandle command_signature;
+	GpuResourceHandle arguments;
+	uint64_t arguments_offset;
+	GpuResourceHandle count_buffer;
+	uint64_t count_offset;
+	uint32_t max_command_count;
+	uint32_t padding;
+};
+
+struct NullCopyPayload
+{
+	GpuResourceHandle dst;
+	uint64_t dst_offset;
+	GpuResourceHandle src;
+	uint64_t src_offset;
+	uint64_t size;
+};
+
+struct NullTextureCopyPayload
+{
+	GpuResourceHandle dst;
+	GpuResourceHandle src;
+	GpuTextureFootprint footprint;
+	uint32_t dst_subresource;
+	uint32_t padding;
+};
+
+struct NullClearPayload
+{
+	GpuDescriptorHandle render_target;
+	float color[4];
+};
+
+class NullCommandAllocator : public GpuCommandAllocator
+{
+public:
+	void Reset () override;
+	const std::vector<uint8_t> &GetStream () const
+	{
+		return stream;
+	}
+private:
+	friend class NullCommandList;
+	std::vector<uint8_t> stream;
+};
+
+class NullCommandList : public GpuCommandList
+{
+public:
+	explicit NullCommandList (NullCommandAllocator *allocator);
+
+	void Reset (GpuCommandAllocator *allocator, GpuPipelineHandle initial_state) override;
+	void Close () override;
+
+	void SetPipelineState (GpuPipelineHandle pipeline_state) override;
+	void SetGraphicsRootSignature (GpuRootSignatureHandle root_signature) override;
+	void SetGraphicsRoot32BitConstants (uint32_t root_parameter, uint32_t count, const void *values, uint32_t dest_offset) override;
+	void SetDescriptorHeaps (uint32_t count, const GpuDescriptorHeapHandle *heaps) override;
+	void SetGraphicsRootDescriptorTable (uint32_t root_parameter, GpuShaderDescriptorHandle table) override;
+	void SetPrimitiveTopology (GpuPrimitiveTopology topology) override;
+	void SetViewports (uint32_t count, const GpuViewport *viewports) override;
+	void SetScissorRects (uint32_t count, const GpuRect *rects) override;
+	void SetRenderTargets (uint32_t count, const GpuDescriptorHandle *render_targets, const GpuDescriptorHandle *depth_stencil) override;
+	void SetVertexBuffers (uint32_t start_slot, uint32_t count, const GpuVertexBufferView *views) override;
+	void SetIndexBuffer (const GpuIndexBufferView *view) override;
+	void ResourceBarrier (uint32_t count, const GpuBarrier *barriers) override;
+
+	void ClearRenderTargetView (GpuDescriptorHandle render_target, const float color[4]) override;
+	void DrawInstanced (uint32_t vertex_count, uint32_t instance_count, uint32_t start_vertex, uint32_t start_instance) override;
+	void DrawIndexedInstanced (uint32_t index_count, uint32_t instance_count, uint32_t start_index, int32_t base_vertex, uint32_t start_instance) override;
+	void ExecuteIndirect (GpuCommandSignatureHandle command_signature, uint32_t max_command_count, GpuResourceHandle arguments,
+						  uint64_t arguments_offset, GpuResourceHandle count_buffer, uint64_t count_offset) override;
+	void CopyBufferRegion (GpuResourceHandle dst, uint64_t dst_offset, GpuResourceHandle src, uint64_t src_offset, uint64_t size) override;
+	void CopyBufferToTexture (GpuResourceHandle dst, uint32_t dst_subresource, GpuResourceHandle src, const GpuTextureFootprint &footprint) override;
+
+	bool IsClosed () const
+	{
+		return closed;
+	}
+	//recorded range inside the allocator stream
+	const uint8_t *GetCommands () const;
+	size_t GetCommandsSize () const
+	{
+		return end - begin;
+	}
+	uint32_t GetCommandCount () const
+	{
+		return command_count;
+	}
+	uint32_t GetDrawCount () const
+	{
+		return draw_count;
+	}
+	uint32_t GetBarrierCount () const
+	{
+		return barrier_count;
+	}
+	uint64_t GetCopyBytes () const
+	{
+		return copy_bytes;
+	}
+private:
+	uint8_t *Allocate (NullCommandType type, size_t size);
+	template <class T> void Write (NullCommandType type, const T &payload)
+	{
+		memcpy (Allocate (type, sizeof (T)), &payload, sizeof (T));
+	}
+	template <class T> void WriteArray (NullCommandType type, uint32_t extra, uint32_t count, const T *items)
+	{
+		uint8_t *dst = Allocate (type, 2 * sizeof (uint32_t) + count * sizeof (T));
+		memcpy (dst, &extra, sizeof (uint32_t));
+		memcpy (dst + sizeof (uint32_t), &count, sizeof (uint32_t));
+		if (count)
+			memcpy (dst + 2 * sizeof (uint32_t), items, count * sizeof (T));
+	}
+
+	NullCommandAllocator *allocator;
+	size_t begin;
+	size_t end;
+	bool closed;
+	uint32_t command_count;
+	uint32_t draw_count;
+	uint32_t barrier_count;
+	uint64_t copy_bytes;
+};
+
+//sequential decoder for a closed NullCommandList
+class NullCommandReader
+{
+public:
+	explicit NullCommandReader (const NullCommandList &command_list);
+	bool Next (NullCommandHeader &header, const uint8_t *&payload);
+	template <class T> static T Read (const uint8_t *payload, size_t offset = 0)
+	{
+		T value;
+		memcpy (&value, payload + offset, sizeof (T));
+		return value;
+	}
+private:
+	const uint8_t *current;
+	const uint8_t *end;
+};
+
+struct NullDeviceDesc
+{
+	bool real_time_clock;        //CPU timeline follows steady_clock; otherwise only AdvanceCpuTime () moves it
+	uint64_t gpu_ns_per_list;
+	uint64_t gpu_ns_per_command;
+	uint64_t gpu_ns_per_draw;
+	uint64_t gpu_ns_per_copy_kb;
+
+	NullDeviceDesc ();
+};
+
+struct NullDeviceStats
+{
+	uint64_t executed_lists;
+	uint64_t executed_commands;
+	uint64_t draws;
+	uint64_t barriers;
+	uint64_t bytes;
+	uint64_t copy_bytes;
+	uint64_t waits;
+	uint64_t queue_waits;
+	uint64_t queue_wait_ns;      //simulated GPU time spent waiting for other queues
+	uint64_t stall_ns;           //simulated CPU time spent in WaitForFenceValue
+	uint64_t gpu_busy_ns;
+};
+
+class NullDevice : public GpuDevice
+{
+public:
+	explicit NullDevice (const NullDeviceDesc &desc = NullDeviceDesc ());
+
+	std::unique_ptr<GpuCommandAllocator> CreateCommandAllocator () override;
+	std::unique_ptr<GpuCommandList> CreateCommandList (GpuCommandAllocator *allocator) override;
+	void ExecuteCommandLists (uint32_t count, GpuCommandList *const *command_lists) override;
+
+	void Signal (uint64_t value) override;
+	uint64_t GetCompletedFenceValue () override;
+	void WaitForFenceValue (uint64_t value) override;
+	//the other queue must be a null device on the same timeline, real time or advanced in step
+	void WaitForQueue (GpuDevice *queue, uint64_t value) override;
+
+	//fake resources are plain ids with a fake GPU address range
+	GpuResourceHandle CreateResource (uint64_t size);
+	GpuVirtualAddress GetGpuVirtualAddress (GpuResourceHandle resource) const;
+
+	//simulated timeline in nanoseconds
+	uint64_t GetCpuTime () const;
+	void AdvanceCpuTime (uint64_t ns);
+	uint64_t GetGpuIdleTime () const;
+	//extra GPU time added to the next executed batch, e.g. to model jitter
+	void AddGpuWork (uint64_t ns);
+
+	NullDeviceStats GetStats () const;
+	void ResetStats ();
+private:
+	uint64_t CpuTime () const;
+	void RetireSignals (uint64_t cpu_time);
+	//GPU time the fence reaches the value, 0 if it already did
+	uint64_t GetSignalTime (uint64_t value);
+
+	NullDeviceDesc desc;
+	mutable std::mutex mutex;
+	uint64_t clock_origin;
+	uint64_t manual_time;
+	uint64_t gpu_idle_time;
+	uint64_t pending_gpu_work;
+	uint64_t completed_value;
+	std::deque<std::pair<uint64_t, uint64_t>> pending_signals;    //fence value, completion time
+	std::vector<GpuVirtualAddress> resource_addresses;
+	GpuVirtualAddress next_address;
+	NullDeviceStats stats;
+};
+
+struct NullMemoryStats
+{
+	uint32_t heaps;
+	uint32_t resident_heaps;
+	uint64_t usage;              //resident heaps and external usage
+	uint64_t peak_usage;
+	uint64_t made_resident_bytes;
+	uint64_t evicted_bytes;
+	uint64_t make_resident_calls;
+	uint64_t evict_calls;
+	uint64_t redundant;          //heaps made resident or evicted that already were
+};
+
+//Simulated video memory: heaps are ids whose sizes count against the usage while they
+//are resident, under a budget that can change at any time like the one the OS hands out
+class NullMemory : public GpuHeapBackend, public ResidencyBackend
+{
+public:
+	explicit NullMemory (uint64_t budget);
+
+	GpuHeapHandle CreateHeap (GpuHeapTier tier, uint64_t size) override;
+	void DestroyHeap (GpuHeapHandle heap) override;
+
+	void QueryBudget (uint64_t &budget, uint64_t &usage) override;
+	void MakeResident (uint32_t count, const GpuHeapHandle *heaps) override;
+	void Evict (uint32_t count, const GpuHeapHandle *heaps) override;
+
+	void SetBudget (uint64_t budget);
+	//memory used besides the heaps, e.g. by committed resources
+	void SetExternalUsage (uint64_t bytes);
+	bool IsResident (GpuHeapHandle heap) const;
+	NullMemoryStats GetStats () const;
+private:
+	struct Heap
+	{
+		uint64_t size;
+		bool resident;
+		bool live;
+	};
+
+	Heap &GetHeap (GpuHeapHandle heap);
+	const Heap &GetHeap (GpuHeapHandle heap) const;
+	void UpdateUsage ();
+
+	mutable std::mutex mutex;
+	uint64_t budget;
+	uint64_t external_usage;
+	uint64_t heap_usage;
+	std::vector<Heap> heaps;     //handle - 1, destroyed heaps are not reused
+	NullMemoryStats stats;
+};
+
+struct NullPresentDesc
+{
+	uint64_t refresh_interval;   //nanoseconds between vblanks, starting at time 0
+	bool tearing_supported;
+
+	NullPresentDesc ();
+};
+
+//Simulated swap chain on the timeline of a null device. A present is done once the GPU
+//executed the work submitted before it; vsync presents are displayed at the following
+//vblank, one per refresh, tearing ones right away and others at the following vblank.
+//The wait blocks while the maximum latency of presents is not displayed yet, and
+//sleeping advances the CPU timeline of the device.
+class NullPresentBackend : public PresentBackend
+{
+public:
+	explicit NullPresentBackend (NullDevice *device, const NullPresentDesc &desc = NullPresentDesc ());
+
+	bool IsTearingSupported () override;
+	void SetMaximumFrameLatency (uint32_t frames) override;
+	bool WaitForFrame (uint32_t timeout_ms) override;
+	uint64_t Present (bool vsync) override;
+	bool GetDisplayInfo (PresentDisplayInfo &info) override;
+	uint64_t GetTime () override;
+	void SleepUntil (uint64_t time) override;
+private:
+	uint64_t GetNextVblank (uint64_t time) const;
+	void RetirePresents (uint64_t time);
+
+	NullDevice *device;
+	NullPresentDesc desc;
+	uint32_t max_latency;
+	uint64_t present_count;
+	uint64_t last_display_time;
+	std::deque<std::pair<uint64_t, uint64_t>> queued_presents;    //present count, display time
+	bool displayed;
+	PresentDisplayInfo display_info;
+};
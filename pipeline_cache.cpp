@@ -0,0 +1,565 @@
+#include "pipeline_cache.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <stdexcept>
+
+static_assert (sizeof (PipelineCacheFileHeader) == 40, "Cache file header must not have padding");
+
+PipelineDesc::PipelineDesc ()
+{
+	memset (this, 0, sizeof (*this));
+	raster.fill_mode = 3;          //D3D12_FILL_MODE_SOLID
+	raster.cull_mode = 3;          //D3D12_CULL_MODE_BACK
+	raster.depth_clip_enable = 1;
+	for (uint32_t i = 0; i < pipeline_max_render_targets; i++)
+	{
+		PipelineBlendTarget &target = blend_targets[i];
+		target.src_blend = target.src_blend_alpha = 2;      //D3D12_BLEND_ONE
+		target.dest_blend = target.dest_blend_alpha = 1;    //D3D12_BLEND_ZERO
+		target.blend_op = target.blend_op_alpha = 1;        //D3D12_BLEND_OP_ADD
+		target.logic_op = 4;                                //D3D12_LOGIC_OP_NOOP
+		target.write_mask = 0xf;                            //D3D12_COLOR_WRITE_ENABLE_ALL
+	}
+	depth_stencil.depth_enable = 1;
+	depth_stencil.depth_write_mask = 1;    //D3D12_DEPTH_WRITE_MASK_ALL
+	depth_stencil.depth_func = 2;          //D3D12_COMPARISON_FUNC_LESS
+	depth_stencil.stencil_read_mask = 0xff;
+	depth_stencil.stencil_write_mask = 0xff;
+	//D3D12_STENCIL_OP_KEEP and D3D12_COMPARISON_FUNC_ALWAYS
+	depth_stencil.front_face.fail_op = depth_stencil.front_face.depth_fail_op = depth_stencil.front_face.pass_op = 1;
+	depth_stencil.front_face.func = 8;
+	depth_stencil.back_face = depth_stencil.front_face;
+	sample_mask = 0xffffffff;
+	primitive_topology_type = 3;    //D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE
+	sample_count = 1;
+}
+
+uint64_t PipelineHash (const void *data, size_t size, uint64_t seed)
+{
+	const uint8_t *bytes = static_cast<const uint8_t*>(data);
+	uint64_t hash = seed;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 0x100000001b3ull;
+	}
+	return hash;
+}
+
+void NormalizePipelineDesc (PipelineDesc &desc)
+{
+	static const PipelineDesc defaults;
+
+	for (uint32_t stage = 0; stage < PIPELINE_SHADER_STAGE_COUNT; stage++)
+		if (!desc.shaders[stage].bytecode || !desc.shaders[stage].size)
+		{
+			desc.shaders[stage].bytecode = nullptr;
+			desc.shaders[stage].size = 0;
+		}
+	if (!desc.input_elements)
+		desc.input_element_count = 0;
+
+	if (desc.render_target_count > pipeline_max_render_targets)
+		throw std::invalid_argument ("Pipeline has too many render targets");
+	for (uint32_t i = desc.render_target_count; i < pipeline_max_render_targets; i++)
+		desc.render_target_formats[i] = 0;
+
+	//without independent blending only the first target state is used
+	const uint32_t blend_target_count = desc.independent_blend_enable ? desc.render_target_count : 1;
+	for (uint32_t i = 0; i < pipeline_max_render_targets; i++)
+	{
+		PipelineBlendTarget &target = desc.blend_targets[i];
+		const PipelineBlendTarget &default_target = defaults.blend_targets[i];
+		if (i >= blend_target_count)
+		{
+			target = default_target;
+			continue;
+		}
+		if (!target.blend_enable)
+		{
+			target.src_blend = default_target.src_blend;
+			target.dest_blend = default_target.dest_blend;
+			target.blend_op = default_target.blend_op;
+			target.src_blend_alpha = default_target.src_blend_alpha;
+			target.dest_blend_alpha = default_target.dest_blend_alpha;
+			target.blend_op_alpha = default_target.blend_op_alpha;
+		}
+		if (!target.logic_op_enable)
+			target.logic_op = default_target.logic_op;
+	}
+	if (desc.render_target_count < 2)
+		desc.independent_blend_enable = 0;
+
+	PipelineDepthStencilState &depth_stencil = desc.depth_stencil;
+	if (!depth_stencil.depth_enable)
+	{
+		depth_stencil.depth_write_mask = defaults.depth_stencil.depth_write_mask;
+		depth_stencil.depth_func = defaults.depth_stencil.depth_func;
+	}
+	if (!depth_stencil.stencil_enable)
+	{
+		depth_stencil.stencil_read_mask = defaults.depth_stencil.stencil_read_mask;
+		depth_stencil.stencil_write_mask = defaults.depth_stencil.stencil_write_mask;
+		depth_stencil.front_face = defaults.depth_stencil.front_face;
+		depth_stencil.back_face = defaults.depth_stencil.back_face;
+	}
+}
+
+static void PutU32 (std::vector<uint8_t> &key, uint32_t value)
+{
+	for (uint32_t i = 0; i < 4; i++)
+		key.push_back (static_cast<uint8_t>(value >> (i * 8)));
+}
+
+static void PutU64 (std::vector<uint8_t> &key, uint64_t value)
+{
+	PutU32 (key, static_cast<uint32_t>(value));
+	PutU32 (key, static_cast<uint32_t>(value >> 32));
+}
+
+static void PutFloat (std::vector<uint8_t> &key, float value)
+{
+	uint32_t bits;
+	memcpy (&bits, &value, sizeof (bits));
+	PutU32 (key, bits);
+}
+
+void BuildPipelineKey (const PipelineDesc &desc, std::vector<uint8_t> &key)
+{
+	//fields are written one by one in little endian, so the key does not depend on padding or the platform
+	key.clear ();
+	PutU64 (key, desc.root_signature_key);
+	for (uint32_t stage = 0; stage < PIPELINE_SHADER_STAGE_COUNT; stage++)
+	{
+		const PipelineShader &shader = desc.shaders[stage];
+		PutU64 (key, shader.size);
+		PutU64 (key, shader.size ? PipelineHash (shader.bytecode, static_cast<size_t>(shader.size)) : 0);
+	}
+
+	PutU32 (key, desc.input_element_count);
+	for (uint32_t i = 0; i < desc.input_element_count; i++)
+	{
+		const PipelineInputElement &element = desc.input_elements[i];
+		const size_t name_length = element.semantic_name ? strlen (element.semantic_name) : 0;
+		PutU32 (key, static_cast<uint32_t>(name_length));
+		key.insert (key.end (), element.semantic_name, element.semantic_name + name_length);
+		PutU32 (key, element.semantic_index);
+		PutU32 (key, element.format);
+		PutU32 (key, element.input_slot);
+		PutU32 (key, element.aligned_byte_offset);
+		PutU32 (key, element.classification);
+		//the step rate has no meaning for per vertex data
+		PutU32 (key, element.classification ? element.instance_step_rate : 0);
+	}
+
+	const PipelineRasterState &raster = desc.raster;
+	PutU32 (key, raster.fill_mode);
+	PutU32 (key, raster.cull_mode);
+	PutU32 (key, raster.front_counter_clockwise);
+	PutU32 (key, static_cast<uint32_t>(raster.depth_bias));
+	PutFloat (key, raster.depth_bias_clamp);
+	PutFloat (key, raster.slope_scaled_depth_bias);
+	PutU32 (key, raster.depth_clip_enable);
+	PutU32 (key, raster.multisample_enable);
+	PutU32 (key, raster.antialiased_line_enable);
+	PutU32 (key, raster.forced_sample_count);
+	PutU32 (key, raster.conservative_raster);
+
+	PutU32 (key, desc.alpha_to_coverage_enable);
+	PutU32 (key, desc.independent_blend_enable);
+	for (uint32_t i = 0; i < pipeline_max_render_targets; i++)
+	{
+		const PipelineBlendTarget &target = desc.blend_targets[i];
+		PutU32 (key, target.blend_enable);
+		PutU32 (key, target.logic_op_enable);
+		PutU32 (key, target.src_blend);
+		PutU32 (key, target.dest_blend);
+		PutU32 (key, target.blend_op);
+		PutU32 (key, target.src_blend_alpha);
+		PutU32 (key, target.dest_blend_alpha);
+		PutU32 (key, target.blend_op_alpha);
+		PutU32 (key, target.logic_op);
+		PutU32 (key, target.write_mask);
+	}
+
+	const PipelineDepthStencilState &depth_stencil = desc.depth_stencil;
+	PutU32 (key, depth_stencil.depth_enable);
+	PutU32 (key, depth_stencil.depth_write_mask);
+	PutU32 (key, depth_stencil.depth_func);
+	PutU32 (key, depth_stencil.stencil_enable);
+	PutU32 (key, depth_stencil.stencil_read_mask);
+	PutU32 (key, depth_stencil.stencil_write_mask);
+	const PipelineStencilOp *faces[] = { &depth_stencil.front_face, &depth_stencil.back_face };
+	for (const PipelineStencilOp *face : faces)
+	{
+		PutU32 (key, face->fail_op);
+		PutU32 (key, face->depth_fail_op);
+		PutU32 (key, face->pass_op);
+		PutU32 (key, face->func);
+	}
+
+	PutU32 (key, desc.sample_mask);
+	PutU32 (key, desc.ib_strip_cut_value);
+	PutU32 (key, desc.primitive_topology_type);
+	PutU32 (key, desc.render_target_count);
+	for (uint32_t i = 0; i < pipeline_max_render_targets; i++)
+		PutU32 (key, desc.render_target_formats[i]);
+	PutU32 (key, desc.depth_stencil_format);
+	PutU32 (key, desc.sample_count);
+	PutU32 (key, desc.sample_quality);
+}
+
+static uint64_t GetCacheChecksum (const uint64_t *pipelines, size_t pipeline_count, const void *blob, size_t blob_size)
+{
+	return PipelineHash (blob, blob_size, PipelineHash (pipelines, pipeline_count * sizeof (uint64_t)));
+}
+
+void WritePipelineCacheFile (uint64_t device_key, const std::vector<uint64_t> &pipelines, const void *blob, size_t blob_size, std::vector<uint8_t> &file)
+{
+	PipelineCacheFileHeader header;
+	header.magic = pipeline_cache_magic;
+	header.version = pipeline_cache_version;
+	header.device_key = device_key;
+	header.pipeline_count = static_cast<uint32_t>(pipelines.size ());
+	header.reserved = 0;
+	header.blob_size = blob_size;
+	header.checksum = GetCacheChecksum (pipelines.data (), pipelines.size (), blob, blob_size);
+
+	const size_t pipelines_size = pipelines.size () * sizeof (uint64_t);
+	file.resize (sizeof (header) + pipelines_size + blob_size);
+	memcpy (file.data (), &header, sizeof (header));
+	if (pipelines_size)
+		memcpy (file.data () + sizeof (header), pipelines.data (), pipelines_size);
+	if (blob_size)
+		memcpy (file.data () + sizeof (header) + pipelines_size, blob, blob_size);
+}
+
+bool ReadPipelineCacheFile (const void *file, size_t file_size, uint64_t device_key, std::vector<uint64_t> &pipelines, size_t &blob_offset, size_t &blob_size)
+{
+	PipelineCacheFileHeader header;
+	if (file_size < sizeof (header))
+		return false;
+	memcpy (&header, file, sizeof (header));
+	if (header.magic != pipeline_cache_magic || header.version != pipeline_cache_version || header.device_key != device_key)
+		return false;
+	const size_t payload_size = file_size - sizeof (header);
+	if (header.pipeline_count > payload_size / sizeof (uint64_t) ||
+		header.blob_size != payload_size - header.pipeline_count * sizeof (uint64_t))
+		return false;
+
+	const uint8_t *bytes = static_cast<const uint8_t*>(file);
+	pipelines.resize (header.pipeline_count);
+	if (header.pipeline_count)
+		memcpy (pipelines.data (), bytes + sizeof (header), header.pipeline_count * sizeof (uint64_t));
+	blob_offset = sizeof (header) + header.pipeline_count * sizeof (uint64_t);
+	blob_size = static_cast<size_t>(header.blob_size);
+	if (GetCacheChecksum (pipelines.data (), pipelines.size (), bytes + blob_offset, blob_size) != header.checksum)
+	{
+		pipelines.clear ();
+		return false;
+	}
+	return true;
+}
+
+PipelineCache::PipelineCache (PipelineBackend *pipeline_backend, uint32_t thread_count) :
+	backend (pipeline_backend),
+	saved_compiled (0),
+	requests (0),
+	deduplicated (0),
+	evicted (0),
+	pending (0),
+	stop (false),
+	compiled (0),
+	loaded (0),
+	failed (0)
+{
+	for (uint32_t i = 0; i < thread_count; i++)
+		threads.emplace_back (&PipelineCache::WorkerThread, this);
+}
+
+PipelineCache::~PipelineCache ()
+{
+	{
+		std::lock_guard<std::mutex> lock (mutex);
+		stop = true;
+	}
+	queue_cv.notify_all ();
+	//the threads finish the queue before they exit
+	for (std::thread &thread : threads)
+		thread.join ();
+	for (Entry &entry : entries)
+		if (entry.status.load (std::memory_order_acquire) == ENTRY_READY)
+			backend->DestroyPipeline (entry.pipeline);
+}
+
+bool PipelineCache::Load (const char *file_name)
+{
+	if (!entries.empty ())
+		throw std::logic_error ("Pipeline library must be loaded before the first request");
+
+	FILE *f = fopen (file_name, "rb");
+	if (!f)
+		return false;
+	std::vector<uint8_t> file;
+	bool read = fseek (f, 0, SEEK_END) == 0;
+	const long file_size = read ? ftell (f) : -1;
+	if (file_size > 0 && fseek (f, 0, SEEK_SET) == 0)
+	{
+		file.resize (static_cast<size_t>(file_size));
+		read = fread (file.data (), 1, file.size (), f) == file.size ();
+	}
+	fclose (f);
+
+	std::vector<uint64_t> pipelines;
+	size_t blob_offset, blob_size;
+	if (!read || !ReadPipelineCacheFile (file.data (), file.size (), backend->GetDeviceKey (), pipelines, blob_offset, blob_size))
+		return false;
+	//the library keeps using the blob, it is kept alive with the cache
+	library_file.swap (file);
+	if (!backend->OpenLibrary (library_file.data () + blob_offset, blob_size))
+	{
+		library_file.clear ();
+		return false;
+	}
+	library_pipelines.clear ();
+	library_pipelines.insert (pipelines.begin (), pipelines.end ());
+	saved_compiled = compiled.load ();
+	return true;
+}
+
+void PipelineCache::Save (const char *file_name)
+{
+	WaitAll ();
+	if (compiled.load () == saved_compiled)
+		return;
+
+	std::vector<uint8_t> blob;
+	backend->SerializeLibrary (blob);
+	if (blob.empty ())
+		return;
+	std::unordered_set<uint64_t> stored (library_pipelines);
+	for (const Entry &entry : entries)
+		if (entry.status.load (std::memory_order_acquire) == ENTRY_READY)
+			stored.insert (entry.hash);
+	std::vector<uint64_t> pipelines (stored.begin (), stored.end ());
+	std::sort (pipelines.begin (), pipelines.end ());
+
+	std::vector<uint8_t> file;
+	WritePipelineCacheFile (backend->GetDeviceKey (), pipelines, blob.data (), blob.size (), file);
+	FILE *f = fopen (file_name, "wb");
+	if (!f)
+		throw std::runtime_error ("Can not open pipeline cache file for writing");
+	const bool written = fwrite (file.data (), 1, file.size (), f) == file.size ();
+	if (fclose (f) != 0 || !written)
+		throw std::runtime_error ("Can not write pipeline cache file");
+	saved_compiled = compiled.load ();
+}
+
+PipelineId PipelineCache::Request (const PipelineDesc &desc, PipelineId fallback)
+{
+	if (fallback != pipeline_id_invalid && fallback >= entries.size ())
+		throw std::out_of_range ("Fallback pipeline does not exist");
+	requests++;
+
+	PipelineDesc normalized = desc;
+	NormalizePipelineDesc (normalized);
+	std::vector<uint8_t> entry_key;
+	BuildPipelineKey (normalized, entry_key);
+	const uint64_t hash = PipelineHash (entry_key.data (), entry_key.size ());
+
+	const PipelineId found = Find (hash, entry_key);
+	if (found != pipeline_id_invalid)
+	{
+		deduplicated++;
+		return found;
+	}
+
+	const PipelineId id = AddEntry (normalized, hash, entry_key, fallback);
+	Entry &entry = entries[id];
+	if (threads.empty () || library_pipelines.count (hash))
+	{
+		CreateEntry (entry);
+		return id;
+	}
+	{
+		std::lock_guard<std::mutex> lock (mutex);
+		queue.push_back (&entry);
+		pending++;
+	}
+	queue_cv.notify_one ();
+	return id;
+}
+
+PipelineId PipelineCache::Create (const PipelineDesc &desc)
+{
+	const PipelineId id = Request (desc);
+	Entry &entry = entries[id];
+	WaitEntry (entry);
+	if (entry.status.load (std::memory_order_acquire) == ENTRY_FAILED)
+		throw std::runtime_error ("Can not create pipeline: " + entry.error);
+	return id;
+}
+
+GpuPipelineHandle PipelineCache::Get (PipelineId id) const
+{
+	//fallbacks always are older entries, the chain ends
+	while (id != pipeline_id_invalid)
+	{
+		const Entry &entry = entries.at (id);
+		if (entry.status.load (std::memory_order_acquire) == ENTRY_READY)
+			return entry.pipeline;
+		id = entry.fallback;
+	}
+	return 0;
+}
+
+bool PipelineCache::IsReady (PipelineId id) const
+{
+	return entries.at (id).status.load (std::memory_order_acquire) == ENTRY_READY;
+}
+
+bool PipelineCache::HasFailed (PipelineId id) const
+{
+	return entries.at (id).status.load (std::memory_order_acquire) == ENTRY_FAILED;
+}
+
+void PipelineCache::Evict (PipelineId id, FrameScheduler *scheduler)
+{
+	Entry &entry = entries.at (id);
+	WaitEntry (entry);
+	const uint32_t status = entry.status.load (std::memory_order_acquire);
+	if (status == ENTRY_EVICTED)
+		throw std::logic_error ("Pipeline is already evicted");
+
+	auto range = lookup.equal_range (entry.hash);
+	for (auto it = range.first; it != range.second; ++it)
+		if (it->second == id)
+		{
+			lookup.erase (it);
+			break;
+		}
+	if (status == ENTRY_READY)
+	{
+		PipelineBackend *pipeline_backend = backend;
+		const GpuPipelineHandle pipeline = entry.pipeline;
+		scheduler->DeferRelease ([pipeline_backend, pipeline] { pipeline_backend->DestroyPipeline (pipeline); });
+	}
+	entry.status.store (ENTRY_EVICTED, std::memory_order_release);
+	evicted++;
+
+	//only the fallback is needed from now on
+	entry.pipeline = 0;
+	std::vector<uint8_t> ().swap (entry.key);
+	for (std::vector<uint8_t> &bytecode : entry.bytecode)
+		std::vector<uint8_t> ().swap (bytecode);
+	std::vector<PipelineInputElement> ().swap (entry.input_elements);
+	entry.semantic_names.clear ();
+}
+
+void PipelineCache::WaitAll ()
+{
+	std::unique_lock<std::mutex> lock (mutex);
+	done_cv.wait (lock, [this] { return pending == 0; });
+}
+
+PipelineCacheStats PipelineCache::GetStats () const
+{
+	PipelineCacheStats stats;
+	stats.requests = requests;
+	stats.deduplicated = deduplicated;
+	stats.compiled = compiled.load ();
+	stats.loaded = loaded.load ();
+	stats.failed = failed.load ();
+	{
+		std::lock_guard<std::mutex> lock (mutex);
+		stats.pending = pending;
+	}
+	stats.pipelines = static_cast<uint32_t>(entries.size ()) - evicted;
+	return stats;
+}
+
+PipelineId PipelineCache::Find (uint64_t hash, const std::vector<uint8_t> &entry_key) const
+{
+	auto range = lookup.equal_range (hash);
+	for (auto it = range.first; it != range.second; ++it)
+		if (entries[it->second].key == entry_key)
+			return it->second;
+	return pipeline_id_invalid;
+}
+
+PipelineId PipelineCache::AddEntry (const PipelineDesc &normalized, uint64_t hash, std::vector<uint8_t> &entry_key, PipelineId fallback)
+{
+	const PipelineId id = static_cast<PipelineId>(entries.size ());
+	entries.emplace_back ();
+	Entry &entry = entries.back ();
+	entry.hash = hash;
+	entry.key.swap (entry_key);
+	entry.fallback = fallback;
+	entry.status.store (ENTRY_PENDING, std::memory_order_relaxed);
+	entry.pipeline = 0;
+
+	//copy what the description points to
+	entry.desc = normalized;
+	for (uint32_t stage = 0; stage < PIPELINE_SHADER_STAGE_COUNT; stage++)
+	{
+		PipelineShader &shader = entry.desc.shaders[stage];
+		if (!shader.size)
+			continue;
+		const uint8_t *bytecode = static_cast<const uint8_t*>(shader.bytecode);
+		entry.bytecode[stage].assign (bytecode, bytecode + shader.size);
+		shader.bytecode = entry.bytecode[stage].data ();
+	}
+	entry.input_elements.assign (normalized.input_elements, normalized.input_elements + normalized.input_element_count);
+	for (PipelineInputElement &element : entry.input_elements)
+	{
+		entry.semantic_names.push_back (element.semantic_name ? element.semantic_name : "");
+		element.semantic_name = entry.semantic_names.back ().c_str ();
+	}
+	entry.desc.input_elements = entry.input_elements.data ();
+
+	lookup.emplace (hash, id);
+	return id;
+}
+
+void PipelineCache::CreateEntry (Entry &entry)
+{
+	try
+	{
+		bool from_library = false;
+		entry.pipeline = backend->CreatePipeline (entry.desc, entry.hash, from_library);
+		(from_library ? loaded : compiled)++;
+		entry.status.store (ENTRY_READY, std::memory_order_release);
+	}
+	catch (const std::exception &err)
+	{
+		entry.error = err.what ();
+		failed++;
+		entry.status.store (ENTRY_FAILED, std::memory_order_release);
+	}
+}
+
+void PipelineCache::WaitEntry (Entry &entry)
+{
+	std::unique_lock<std::mutex> lock (mutex);
+	done_cv.wait (lock, [&entry] { return entry.status.load (std::memory_order_acquire) != ENTRY_PENDING; });
+}
+
+void PipelineCache::WorkerThread ()
+{
+	std::unique_lock<std::mutex> lock (mutex);
+	for (;;)
+	{
+		queue_cv.wait (lock, [this] { return stop || !queue.empty (); });
+		if (queue.empty ())
+			return;
+		Entry *entry = queue.front ();
+		queue.pop_front ();
+		lock.unlock ();
+		CreateEntry (*entry);
+		lock.lock ();
+		pending--;
+		done_cv.notify_all ();
+	}
+}
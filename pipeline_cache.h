@@ -0,0 +1,280 @@
+#pragma once
+#include "gpu_device.h"
+#include "frame_scheduler.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+//Pipeline state cache. Requests are normalized, so descriptions that only differ in
+//fields the GPU ignores map to one pipeline, and keyed by a stable hash of the result.
+//Identical requests share one entry; new pipelines are created on background threads
+//while draws use a fallback pipeline. Created pipelines go into a pipeline library
+//that is saved to disk, so later runs load them instead of compiling.
+
+//values of the state fields are the D3D12 enumeration values
+
+enum PipelineShaderStage
+{
+	PIPELINE_SHADER_VS,
+	PIPELINE_SHADER_PS,
+	PIPELINE_SHADER_DS,
+	PIPELINE_SHADER_HS,
+	PIPELINE_SHADER_GS,
+	PIPELINE_SHADER_STAGE_COUNT
+};
+
+static const uint32_t pipeline_max_render_targets = 8;
+//aligned_byte_offset of an element that directly follows the previous one
+static const uint32_t pipeline_append_aligned_element = 0xffffffff;
+
+typedef uint32_t PipelineId;
+static const PipelineId pipeline_id_invalid = 0xffffffff;
+
+struct PipelineShader
+{
+	const void *bytecode;
+	uint64_t size;
+};
+
+struct PipelineInputElement
+{
+	const char *semantic_name;
+	uint32_t semantic_index;
+	uint32_t format;
+	uint32_t input_slot;
+	uint32_t aligned_byte_offset;
+	uint32_t classification;    //0 per vertex, 1 per instance
+	uint32_t instance_step_rate;
+};
+
+struct PipelineRasterState
+{
+	uint32_t fill_mode;
+	uint32_t cull_mode;
+	uint32_t front_counter_clockwise;
+	int32_t depth_bias;
+	float depth_bias_clamp;
+	float slope_scaled_depth_bias;
+	uint32_t depth_clip_enable;
+	uint32_t multisample_enable;
+	uint32_t antialiased_line_enable;
+	uint32_t forced_sample_count;
+	uint32_t conservative_raster;
+};
+
+struct PipelineBlendTarget
+{
+	uint32_t blend_enable;
+	uint32_t logic_op_enable;
+	uint32_t src_blend;
+	uint32_t dest_blend;
+	uint32_t blend_op;
+	uint32_t src_blend_alpha;
+	uint32_t dest_blend_alpha;
+	uint32_t blend_op_alpha;
+	uint32_t logic_op;
+	uint32_t write_mask;
+};
+
+struct PipelineStencilOp
+{
+	uint32_t fail_op;
+	uint32_t depth_fail_op;
+	uint32_t pass_op;
+	uint32_t func;
+};
+
+struct PipelineDepthStencilState
+{
+	uint32_t depth_enable;
+	uint32_t depth_write_mask;
+	uint32_t depth_func;
+	uint32_t stencil_enable;
+	uint32_t stencil_read_mask;
+	uint32_t stencil_write_mask;
+	PipelineStencilOp front_face;
+	PipelineStencilOp back_face;
+};
+
+//graphics pipeline without stream output; pointers only need to be valid during the request
+struct PipelineDesc
+{
+	GpuRootSignatureHandle root_signature;
+	uint64_t root_signature_key;    //stable identity of the root signature, e.g. the hash of its serialized blob
+	PipelineShader shaders[PIPELINE_SHADER_STAGE_COUNT];
+	const PipelineInputElement *input_elements;
+	uint32_t input_element_count;
+	PipelineRasterState raster;
+	PipelineBlendTarget blend_targets[pipeline_max_render_targets];
+	uint32_t alpha_to_coverage_enable;
+	uint32_t independent_blend_enable;
+	PipelineDepthStencilState depth_stencil;
+	uint32_t sample_mask;
+	uint32_t ib_strip_cut_value;
+	uint32_t primitive_topology_type;
+	uint32_t render_target_count;
+	uint32_t render_target_formats[pipeline_max_render_targets];
+	uint32_t depth_stencil_format;
+	uint32_t sample_count;
+	uint32_t sample_quality;
+
+	//D3D12 defaults: solid back face culling, blending and stencil off, depth test less
+	PipelineDesc ();
+};
+
+//64 bit FNV-1a, the same on every platform
+uint64_t PipelineHash (const void *data, size_t size, uint64_t seed = 0xcbf29ce484222325ull);
+
+//resets fields the pipeline ignores to their defaults: formats and blend states of unused
+//render targets, blend factors of disabled blending, depth and stencil state of disabled tests
+void NormalizePipelineDesc (PipelineDesc &desc);
+//byte key of a normalized description; shaders enter with the hash of their bytecode
+void BuildPipelineKey (const PipelineDesc &desc, std::vector<uint8_t> &key);
+
+//Cache file: header, hashes of the pipelines in the library, library blob. The blob
+//is only valid for the device and driver it was written with.
+static const uint32_t pipeline_cache_magic = 0x434f5350;    //"PSOC"
+static const uint32_t pipeline_cache_version = 1;
+
+struct PipelineCacheFileHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t device_key;
+	uint32_t pipeline_count;
+	uint32_t reserved;
+	uint64_t blob_size;
+	uint64_t checksum;    //PipelineHash of the hashes and the blob
+};
+
+void WritePipelineCacheFile (uint64_t device_key, const std::vector<uint64_t> &pipelines, const void *blob, size_t blob_size, std::vector<uint8_t> &file);
+//false if the file is damaged, of another version or of another device
+bool ReadPipelineCacheFile (const void *file, size_t file_size, uint64_t device_key, std::vector<uint64_t> &pipelines, size_t &blob_offset, size_t &blob_size);
+
+//creates pipelines, optionally through a pipeline library; CreatePipeline is called
+//from several threads at once, with a different hash each time
+class PipelineBackend
+{
+public:
+	virtual ~PipelineBackend () {}
+	//identifies device and driver version, library blobs of other devices are not loaded
+	virtual uint64_t GetDeviceKey () = 0;
+	//false if there is no library support or the blob is rejected, the library starts empty then;
+	//the blob stays valid as long as the backend uses the library
+	virtual bool OpenLibrary (const void *blob, size_t size) = 0;
+	//loads the pipeline from the library or compiles it and stores it there
+	virtual GpuPipelineHandle CreatePipeline (const PipelineDesc &desc, uint64_t hash, bool &loaded) = 0;
+	virtual void DestroyPipeline (GpuPipelineHandle pipeline) = 0;
+	virtual void SerializeLibrary (std::vector<uint8_t> &blob) = 0;
+};
+
+struct PipelineCacheStats
+{
+	uint64_t requests;
+	uint64_t deduplicated;    //requests served by an existing entry
+	uint64_t compiled;
+	uint64_t loaded;          //taken from the pipeline library
+	uint64_t failed;
+	uint32_t pending;
+	uint32_t pipelines;       //entries that are not evicted
+};
+
+class PipelineCache
+{
+public:
+	//thread_count background threads create the pipelines; with 0 all requests are synchronous
+	PipelineCache (PipelineBackend *backend, uint32_t thread_count);
+	//waits for pending creations and destroys all pipelines
+	~PipelineCache ();
+
+	//opens the pipeline library saved by Save (); false if there is no valid file
+	bool Load (const char *file_name);
+	//writes the library if pipelines were added since it was loaded or saved
+	void Save (const char *file_name);
+
+	//returns the entry of the description, creating it in the background if it is new;
+	//until it is ready Get () returns the pipeline of fallback. Pipelines found in the
+	//loaded library are created right away, loading them is cheap.
+	PipelineId Request (const PipelineDesc &desc, PipelineId fallback = pipeline_id_invalid);
+	//like Request but waits for the pipeline; throws if it can not be created
+	PipelineId Create (const PipelineDesc &desc);
+
+	//pipeline to draw with: the entry's if it is ready, otherwise its fallback's; 0 if none is ready
+	GpuPipelineHandle Get (PipelineId id) const;
+	bool IsReady (PipelineId id) const;
+	//true if the pipeline can not be created, Get () keeps returning the fallback's
+	bool HasFailed (PipelineId id) const;
+	void WaitAll ();
+
+	//removes the entry, later requests of its description create a new one; the pipeline
+	//is destroyed once the GPU finished the current frame. The id must not be used anymore,
+	//entries falling back to it fall back to its fallback.
+	void Evict (PipelineId id, FrameScheduler *scheduler);
+
+	PipelineCacheStats GetStats () const;
+private:
+	enum EntryStatus
+	{
+		ENTRY_PENDING,
+		ENTRY_READY,
+		ENTRY_FAILED,
+		ENTRY_EVICTED
+	};
+
+	//owns copies of everything the description points to, creation may happen after the request returned
+	struct Entry
+	{
+		uint64_t hash;
+		std::vector<uint8_t> key;
+		PipelineDesc desc;
+		std::vector<uint8_t> bytecode[PIPELINE_SHADER_STAGE_COUNT];
+		std::vector<PipelineInputElement> input_elements;
+		std::deque<std::string> semantic_names;
+		PipelineId fallback;
+		std::atomic<uint32_t> status;
+		GpuPipelineHandle pipeline;    //written before status becomes ready
+		std::string error;
+	};
+
+	PipelineCache (const PipelineCache &) = delete;
+	PipelineCache &operator= (const PipelineCache &) = delete;
+
+	PipelineId Find (uint64_t hash, const std::vector<uint8_t> &entry_key) const;
+	PipelineId AddEntry (const PipelineDesc &normalized, uint64_t hash, std::vector<uint8_t> &entry_key, PipelineId fallback);
+	void CreateEntry (Entry &entry);
+	void WaitEntry (Entry &entry);
+	void WorkerThread ();
+
+	PipelineBackend *backend;
+
+	//entries are only added by the requesting thread; the deque keeps them in place
+	std::deque<Entry> entries;
+	std::unordered_multimap<uint64_t, PipelineId> lookup;
+	std::unordered_set<uint64_t> library_pipelines;    //hashes stored in the loaded library
+	std::vector<uint8_t> library_file;    //holds the blob the library was opened with
+	uint64_t saved_compiled;    //compiled count when the library was loaded or saved
+	uint64_t requests;
+	uint64_t deduplicated;
+	uint32_t evicted;
+
+	std::vector<std::thread> threads;
+	mutable std::mutex mutex;
+	std::condition_variable queue_cv;
+	std::condition_variable done_cv;
+	std::deque<Entry*> queue;
+	uint32_t pending;
+	bool stop;
+	std::atomic<uint64_t> compiled;
+	std::atomic<uint64_t> loaded;
+	std::atomic<uint64_t> failed;
+};
@@ -0,0 +1,206 @@
+#include "present_controller.h"
+
+#include <string.h>
+#include <algorithm>
+#include <stdexcept>
+
+//vsync pacing: the delay grows by this share of the refresh per frame on time, up to the
+//largest share; a late frame takes back the larger share and holds the delay for a while
+static const uint64_t delay_step_divisor = 256;
+static const uint64_t delay_backoff_divisor = 8;
+static const uint64_t max_delay_numerator = 3;
+static const uint64_t max_delay_denominator = 4;
+static const uint32_t delay_hold_frames = 240;
+//waits returning this share of a refresh before a vblank count as returning at it
+static const uint64_t vblank_slack_divisor = 8;
+
+PresentOptions::PresentOptions () :
+	mode (PRESENT_MODE_VSYNC),
+	fps_cap (60.0f),
+	low_latency (true),
+	wait_timeout_ms (100)
+{
+}
+
+PresentController::PresentController (PresentBackend *present_backend, const PresentOptions &present_options) :
+	backend (present_backend),
+	in_frame (false),
+	has_display_info (false),
+	refresh_interval (0),
+	delay (0),
+	hold_frames (0),
+	next_start (0),
+	frames (0)
+{
+	memset (&display_info, 0, sizeof (display_info));
+	memset (&current, 0, sizeof (current));
+	memset (history, 0, sizeof (history));
+	ResetStats ();
+	SetOptions (present_options);
+}
+
+void PresentController::SetOptions (const PresentOptions &present_options)
+{
+	if (present_options.mode == PRESENT_MODE_CAPPED && !(present_options.fps_cap > 0.0f))
+		throw std::invalid_argument ("Capped presentation needs a positive frame rate");
+	options = present_options;
+	delay = 0;
+	hold_frames = 0;
+	next_start = 0;
+	stats.pacing_delay_ns = 0;
+}
+
+void PresentController::SetMaximumFrameLatency (uint32_t frames_count)
+{
+	if (frames_count < 1)
+		throw std::invalid_argument ("Maximum frame latency must be at least 1");
+	backend->SetMaximumFrameLatency (frames_count);
+}
+
+uint64_t PresentController::BeginFrame ()
+{
+	if (in_frame)
+		throw std::logic_error ("BeginFrame is called twice without Present");
+	const uint64_t wait_begin = backend->GetTime ();
+	if (!backend->WaitForFrame (options.wait_timeout_ms))
+		stats.wait_timeouts++;
+	uint64_t now = backend->GetTime ();
+	CollectDisplayInfo ();
+
+	memset (&current, 0, sizeof (current));
+	current.wait_ns = now - wait_begin;
+	const uint64_t start = GetPacedStart (now, current.target_vblank);
+	if (start > now)
+	{
+		backend->SleepUntil (start);
+		const uint64_t woken = backend->GetTime ();
+		current.pace_ns = woken - now;
+		now = woken;
+	}
+	current.start_time = now;
+	stats.total_wait_ns += current.wait_ns;
+	stats.total_pace_ns += current.pace_ns;
+	in_frame = true;
+	return now;
+}
+
+void PresentController::Present ()
+{
+	if (!in_frame)
+		throw std::logic_error ("Present is called without BeginFrame");
+	in_frame = false;
+	current.present_count = backend->Present (options.mode == PRESENT_MODE_VSYNC);
+	current.present_time = backend->GetTime ();
+
+	history[frames % history_size] = current;
+	pending.push_back (frames);
+	//frames the statistics never reported are dropped with their history entry
+	if (pending.size () > history_size)
+		pending.pop_front ();
+	frames++;
+
+	const uint64_t latency = current.present_time - current.start_time;
+	stats.frames++;
+	stats.total_present_latency_ns += latency;
+	stats.max_present_latency_ns = std::max (stats.max_present_latency_ns, latency);
+}
+
+void PresentController::GetTimings (std::vector<PresentFrameTiming> &timings) const
+{
+	timings.clear ();
+	const uint64_t count = std::min<uint64_t>(frames, history_size);
+	for (uint64_t frame = frames - count; frame < frames; frame++)
+		timings.push_back (history[frame % history_size]);
+}
+
+void PresentController::ResetStats ()
+{
+	memset (&stats, 0, sizeof (stats));
+	stats.refresh_interval_ns = refresh_interval;
+	stats.pacing_delay_ns = delay;
+}
+
+void PresentController::CollectDisplayInfo ()
+{
+	PresentDisplayInfo info;
+	if (!backend->GetDisplayInfo (info))
+		return;
+	if (has_display_info && info.present_count == display_info.present_count)
+		return;
+	//tearing presents are displayed between vblanks, only vsync ones measure the refresh
+	if (has_display_info && options.mode == PRESENT_MODE_VSYNC &&
+		info.refresh_count > display_info.refresh_count && info.time > display_info.time)
+	{
+		const uint64_t sample = (info.time - display_info.time) / (info.refresh_count - display_info.refresh_count);
+		refresh_interval = refresh_interval ? (refresh_interval * 7 + sample) / 8 : sample;
+		stats.refresh_interval_ns = refresh_interval;
+	}
+	has_display_info = true;
+	display_info = info;
+
+	//presents before the reported one were displayed at times the statistics passed over
+	while (!pending.empty ())
+	{
+		PresentFrameTiming &timing = history[pending.front () % history_size];
+		if (timing.present_count > info.present_count)
+			break;
+		pending.pop_front ();
+		if (timing.present_count != info.present_count)
+			continue;
+		timing.display_time = std::max (info.time, timing.present_time);
+		const uint64_t latency = timing.display_time - timing.start_time;
+		stats.displayed_frames++;
+		stats.total_display_latency_ns += latency;
+		stats.max_display_latency_ns = std::max (stats.max_display_latency_ns, latency);
+		if (timing.target_vblank && refresh_interval)
+		{
+			timing.late = timing.display_time > timing.target_vblank + refresh_interval + refresh_interval / 2;
+			if (timing.late)
+				stats.late_frames++;
+			AdaptDelay (timing.late);
+		}
+	}
+}
+
+void PresentController::AdaptDelay (bool late)
+{
+	if (!options.low_latency)
+		return;
+	if (late)
+	{
+		delay -= std::min (delay, refresh_interval / delay_backoff_divisor);
+		hold_frames = delay_hold_frames;
+	}
+	else if (hold_frames)
+		hold_frames--;
+	else
+		delay = std::min (delay + refresh_interval / delay_step_divisor,
+						  refresh_interval * max_delay_numerator / max_delay_denominator);
+	stats.pacing_delay_ns = delay;
+}
+
+uint64_t PresentController::GetPacedStart (uint64_t now, uint64_t &target_vblank)
+{
+	switch (options.mode)
+	{
+	case PRESENT_MODE_VSYNC:
+		//the refresh grid needs an estimate and a display time at or before the wait
+		if (!options.low_latency || !refresh_interval || !has_display_info || now < display_info.time)
+			return now;
+		target_vblank = display_info.time + (now - display_info.time + refresh_interval / vblank_slack_divisor) /
+						refresh_interval * refresh_interval;
+		return target_vblank + delay;
+	case PRESENT_MODE_CAPPED:
+	{
+		const uint64_t interval = static_cast<uint64_t>(1e9 / options.fps_cap);
+		//a frame more than an interval late restarts the grid instead of rushing to catch up
+		if (!next_start || now > next_start + interval)
+			next_start = now;
+		const uint64_t start = next_start;
+		next_start += interval;
+		return start;
+	}
+	default:
+		return now;
+	}
+}
@@ -0,0 +1,148 @@
+#pragma once
+#include <stdint.h>
+
+#include <deque>
+#include <vector>
+
+//Presentation of the frames of a swap chain. BeginFrame () waits until the swap chain
+//accepts another frame within its maximum latency, so no frame is queued behind others,
+//and then delays the start of the frame by the pacing of the mode; the application
+//samples input after it. Present () hands the frame to the swap chain. The display time
+//the swap chain reports for a present gives the latency from the frame start to the
+//screen, and in vsync mode tells if the frame made the refresh it was paced for.
+//
+//Vsync pacing starts frames on a grid of refreshes anchored at the reported display
+//times, delayed into the refresh as far as frames keep making it: the delay grows a
+//little with every frame on time and backs off on a late one, then holds for a while. The
+//start times follow the grid rather than the jitter of the wait, and the input is as
+//recent as the GPU time of the frames allows without knowing that time.
+
+enum PresentMode
+{
+	PRESENT_MODE_VSYNC,         //one frame per refresh
+	PRESENT_MODE_TEARING,       //presents as soon as the frame is done, tearing without variable refresh
+	PRESENT_MODE_CAPPED         //like tearing with frames started at a fixed rate
+};
+
+struct PresentDisplayInfo
+{
+	uint64_t present_count;     //of the last present that reached the screen
+	uint64_t refresh_count;     //vblanks of the display when it did
+	uint64_t time;              //nanoseconds on the clock of the backend
+};
+
+class PresentBackend
+{
+public:
+	virtual ~PresentBackend () {}
+	virtual bool IsTearingSupported () = 0;
+	//presents the swap chain may queue before the wait blocks
+	virtual void SetMaximumFrameLatency (uint32_t frames) = 0;
+	//returns false on timeout
+	virtual bool WaitForFrame (uint32_t timeout_ms) = 0;
+	//sync interval 1, or 0 with tearing allowed if supported; returns the count of the present
+	virtual uint64_t Present (bool vsync) = 0;
+	//false until a present reached the screen or while the statistics are unavailable
+	virtual bool GetDisplayInfo (PresentDisplayInfo &info) = 0;
+	//nanoseconds
+	virtual uint64_t GetTime () = 0;
+	virtual void SleepUntil (uint64_t time) = 0;
+};
+
+struct PresentOptions
+{
+	PresentMode mode;
+	float fps_cap;              //frames per second of capped mode
+	bool low_latency;           //vsync frames start late in the refresh; needs a maximum frame latency of 1
+	uint32_t wait_timeout_ms;   //the frame starts anyway, e.g. while the window is occluded
+
+	PresentOptions ();
+};
+
+struct PresentFrameTiming
+{
+	uint64_t present_count;
+	uint64_t wait_ns;           //for the swap chain
+	uint64_t pace_ns;           //slept by the pacing
+	uint64_t start_time;        //BeginFrame () returned
+	uint64_t present_time;      //Present () was called
+	uint64_t display_time;      //0 until the swap chain reported it
+	uint64_t target_vblank;     //vsync pacing: refresh the frame started in, 0 without an estimate
+	bool late;                  //vsync: displayed after the refresh following the target
+};
+
+struct PresentStats
+{
+	uint64_t frames;
+	uint64_t displayed_frames;  //with a reported display time; the others were passed by the statistics
+	uint64_t late_frames;
+	uint64_t wait_timeouts;
+	uint64_t total_wait_ns;
+	uint64_t total_pace_ns;
+	uint64_t total_present_latency_ns;  //start to Present (), over all frames
+	uint64_t max_present_latency_ns;
+	uint64_t total_display_latency_ns;  //start to display, over the displayed frames
+	uint64_t max_display_latency_ns;
+	uint64_t refresh_interval_ns;       //estimated from the display times
+	uint64_t pacing_delay_ns;           //current delay of vsync frame starts after their refresh
+};
+
+class PresentController
+{
+public:
+	static const uint32_t history_size = 128;
+
+	PresentController (PresentBackend *backend, const PresentOptions &options = PresentOptions ());
+
+	//resets the pacing; tearing modes present with vsync off but without tearing if the backend does not support it
+	void SetOptions (const PresentOptions &options);
+	const PresentOptions &GetOptions () const
+	{
+		return options;
+	}
+	void SetMaximumFrameLatency (uint32_t frames);
+
+	//before sampling the input of the frame; returns its start time
+	uint64_t BeginFrame ();
+	bool IsInFrame () const
+	{
+		return in_frame;
+	}
+	//after the work of the frame was submitted
+	void Present ();
+
+	//the last frames, oldest first; display times arrive up to a few frames late
+	void GetTimings (std::vector<PresentFrameTiming> &timings) const;
+	const PresentStats &GetStats () const
+	{
+		return stats;
+	}
+	void ResetStats ();
+private:
+	void CollectDisplayInfo ();
+	void AdaptDelay (bool late);
+	uint64_t GetPacedStart (uint64_t now, uint64_t &target_vblank);
+
+	PresentController (const PresentController &) = delete;
+	PresentController &operator= (const PresentController &) = delete;
+
+	PresentBackend *backend;
+	PresentOptions options;
+	bool in_frame;
+
+	//display feedback
+	bool has_display_info;
+	PresentDisplayInfo display_info;
+	uint64_t refresh_interval;
+	//vsync pacing
+	uint64_t delay;
+	uint32_t hold_frames;
+	//capped pacing
+	uint64_t next_start;
+
+	PresentFrameTiming current;
+	PresentFrameTiming history[history_size];   //ring indexed by the count of frames
+	uint64_t frames;
+	std::deque<uint64_t> pending;               //frames without a display time
+	PresentStats stats;
+};
@@ -0,0 +1,283 @@
+#include "profiler.h"
+
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <unordered_map>
+
+static const size_t default_history_size = 300;
+
+static int64_t GetSteadyNanoseconds ()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now ().time_since_epoch ()).count ();
+}
+
+Profiler &Profiler::Get ()
+{
+	static Profiler profiler;
+	return profiler;
+}
+
+uint32_t &Profiler::ThreadDepth ()
+{
+	static thread_local uint32_t depth = 0;
+	return depth;
+}
+
+Profiler::Profiler () :
+	enabled (false),
+	history_size (default_history_size),
+	next_frame (0),
+	ticks_per_us (0.0)
+{
+	calibration_ticks = GetTimestamp ();
+	calibration_ns = GetSteadyNanoseconds ();
+	frame_begin = calibration_ticks;
+}
+
+void Profiler::SetEnabled (bool enable)
+{
+	std::lock_guard<std::mutex> lock (mutex);
+	if (enable && !enabled.load (std::memory_order_relaxed))
+	{
+		//drop whatever was recorded by scopes that were open while disabling
+		ClearThreadBuffers ();
+		frame_begin = GetTimestamp ();
+	}
+	enabled.store (enable, std::memory_order_relaxed);
+}
+
+void Profiler::SetHistorySize (size_t frame_count)
+{
+	std::lock_guard<std::mutex> lock (mutex);
+	history_size = frame_count ? frame_count : 1;
+	frames.clear ();
+	next_frame = 0;
+}
+
+void Profiler::SetThreadName (const char *name)
+{
+	ThreadBuffer &buffer = GetThreadBuffer ();
+	std::lock_guard<std::mutex> lock (mutex);
+	buffer.name = name;
+}
+
+void Profiler::Clear ()
+{
+	std::lock_guard<std::mutex> lock (mutex);
+	frames.clear ();
+	next_frame = 0;
+	ClearThreadBuffers ();
+}
+
+void Profiler::ClearThreadBuffers ()
+{
+	for (auto &buffer : thread_buffers)
+	{
+		while (buffer->lock.test_and_set (std::memory_order_acquire))
+			;
+		buffer->events.clear ();
+		buffer->lock.clear (std::memory_order_release);
+	}
+}
+
+Profiler::ThreadBuffer &Profiler::GetThreadBuffer ()
+{
+	//buffers are owned by the profiler so events survive thread exit
+	static thread_local ThreadBuffer *thread_buffer = nullptr;
+	if (!thread_buffer)
+	{
+		std::unique_ptr<ThreadBuffer> buffer (new ThreadBuffer);
+		buffer->lock.clear ();
+		buffer->events.reserve (1024);
+		std::lock_guard<std::mutex> lock (mutex);
+		buffer->thread_id = static_cast<uint32_t>(thread_buffers.size () + 1);
+		thread_buffer = buffer.get ();
+		thread_buffers.push_back (std::move (buffer));
+	}
+	return *thread_buffer;
+}
+
+void Profiler::Record (const ProfileZone *zone, uint64_t begin, uint64_t end, uint32_t depth)
+{
+	ThreadBuffer &buffer = GetThreadBuffer ();
+	//the lock is only contended while EndFrame () collects this buffer
+	while (buffer.lock.test_and_set (std::memory_order_acquire))
+		;
+	ProfileEvent event = { zone, begin, end, buffer.thread_id, depth };
+	buffer.events.push_back (event);
+	buffer.lock.clear (std::memory_order_release);
+}
+
+void Profiler::EndFrame ()
+{
+	if (!IsEnabled ())
+		return;
+
+	const uint64_t now = GetTimestamp ();
+	std::lock_guard<std::mutex> lock (mutex);
+
+	Frame *frame;
+	if (frames.size () < history_size)
+	{
+		frames.push_back (Frame ());
+		frame = &frames.back ();
+	}
+	else
+	{
+		frame = &frames[next_frame];
+		frame->events.clear ();
+	}
+	next_frame = (next_frame + 1) % history_size;
+	frame->begin = frame_begin;
+	frame->end = now;
+	frame_begin = now;
+
+	for (auto &buffer : thread_buffers)
+	{
+		while (buffer->lock.test_and_set (std::memory_order_acquire))
+			;
+		frame->events.insert (frame->events.end (), buffer->events.begin (), buffer->events.end ());
+		buffer->events.clear ();
+		buffer->lock.clear (std::memory_order_release);
+	}
+}
+
+size_t Profiler::GetFrameCount () const
+{
+	std::lock_guard<std::mutex> lock (mutex);
+	return frames.size ();
+}
+
+void Profiler::CalibrateClock () const
+{
+	#if PROFILER_USE_RDTSC
+	//measure the tick rate over the whole lifetime of the profiler for accuracy
+	const uint64_t ticks = GetTimestamp () - calibration_ticks;
+	const int64_t ns = GetSteadyNanoseconds () - calibration_ns;
+	if (ns > 0)
+		ticks_per_us = static_cast<double>(ticks) * 1000.0 / static_cast<double>(ns);
+	#else
+	ticks_per_us = static_cast<double>(std::chrono::steady_clock::period::den) /
+		(static_cast<double>(std::chrono::steady_clock::period::num) * 1000000.0);
+	#endif
+}
+
+double Profiler::TicksToMicroseconds (uint64_t ticks) const
+{
+	return ticks_per_us > 0.0 ? static_cast<double>(ticks) / ticks_per_us : 0.0;
+}
+
+void Profiler::GetZoneStats (std::vector<ProfileZoneStats> &stats) const
+{
+	std::lock_guard<std::mutex> lock (mutex);
+	CalibrateClock ();
+	stats.clear ();
+
+	//per frame totals of every zone
+	struct ZoneSamples
+	{
+		uint32_t calls;
+		std::vector<double> totals;
+	};
+	std::unordered_map<const ProfileZone*, ZoneSamples> zones;
+	std::unordered_map<const ProfileZone*, double> frame_totals;
+	for (const Frame &frame : frames)
+	{
+		frame_totals.clear ();
+		for (const ProfileEvent &event : frame.events)
+		{
+			frame_totals[event.zone] += TicksToMicroseconds (event.end - event.begin);
+			zones[event.zone].calls++;
+		}
+		for (const auto &total : frame_totals)
+			zones[total.first].totals.push_back (total.second);
+	}
+
+	for (auto &zone : zones)
+	{
+		std::vector<double> &totals = zone.second.totals;
+		std::sort (totals.begin (), totals.end ());
+		ProfileZoneStats zone_stats;
+		zone_stats.zone = zone.first;
+		zone_stats.frames = static_cast<uint32_t>(totals.size ());
+		zone_stats.calls = zone.second.calls;
+		zone_stats.min_us = totals.front ();
+		zone_stats.max_us = totals.back ();
+		double sum = 0.0;
+		for (double total : totals)
+			sum += total;
+		zone_stats.avg_us = sum / totals.size ();
+		size_t p99_index = (totals.size () * 99 + 99) / 100;
+		zone_stats.p99_us = totals[std::min (p99_index, totals.size ()) - 1];
+		stats.push_back (zone_stats);
+	}
+	std::sort (stats.begin (), stats.end (), [] (const ProfileZoneStats &a, const ProfileZoneStats &b)
+	{
+		return a.avg_us > b.avg_us;
+	});
+}
+
+static void WriteJsonString (FILE *f, const char *str)
+{
+	fputc ('"', f);
+	for (; *str; str++)
+	{
+		if (*str == '"' || *str == '\\')
+			fputc ('\\', f);
+		if (static_cast<unsigned char>(*str) >= 0x20)
+			fputc (*str, f);
+	}
+	fputc ('"', f);
+}
+
+bool Profiler::ExportChromeTrace (const char *file_name) const
+{
+	FILE *f;
+	#ifdef _WIN32
+	if (fopen_s (&f, file_name, "w"))
+		return false;
+	#else
+	f = fopen (file_name, "w");
+	if (!f)
+		return false;
+	#endif
+
+	std::lock_guard<std::mutex> lock (mutex);
+	CalibrateClock ();
+	fputs ("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", f);
+	fputs ("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"Frames\"}}", f);
+	for (const auto &buffer : thread_buffers)
+	{
+		fprintf (f, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":", buffer->thread_id);
+		if (buffer->name.empty ())
+			fprintf (f, "\"Thread %u\"", buffer->thread_id);
+		else
+			WriteJsonString (f, buffer->name.c_str ());
+		fputs ("}}", f);
+	}
+
+	//frames are stored in a ring, start from the oldest one
+	const size_t count = frames.size ();
+	const size_t first = count < history_size ? 0 : next_frame;
+	for (size_t i = 0; i < count; i++)
+	{
+		const Frame &frame = frames[(first + i) % count];
+		fprintf (f, ",\n{\"name\":\"Frame\",\"cat\":\"frame\",\"ph\":\"X\",\"pid\":1,\"tid\":0,\"ts\":%.3f,\"dur\":%.3f}",
+				 TicksToMicroseconds (frame.begin - calibration_ticks),
+				 TicksToMicroseconds (frame.end - frame.begin));
+		for (const ProfileEvent &event : frame.events)
+		{
+			fputs (",\n{\"name\":", f);
+			WriteJsonString (f, event.zone->name);
+			fprintf (f, ",\"cat\":\"cpu\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+					 event.thread_id,
+					 TicksToMicroseconds (event.begin - calibration_ticks),
+					 TicksToMicroseconds (event.end - event.begin));
+		}
+	}
+	fputs ("\n]}\n", f);
+	bool success = ferror (f) == 0;
+	fclose (f);
+	return success;
+}
@@ -0,0 +1,173 @@
+#pragma once
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+//Portable scoped CPU profiler. Zones are recorded into thread-local buffers,
+//gathered once per frame by EndFrame () and kept for a window of frames, which
+//can be aggregated per zone or exported as Chrome trace JSON (also read by Perfetto).
+//Define ENABLE_PROFILER to 0 to compile the macros out completely.
+
+#ifndef ENABLE_PROFILER
+#define ENABLE_PROFILER 1
+#endif
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define PROFILER_USE_RDTSC 1
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#else
+#define PROFILER_USE_RDTSC 0
+#include <chrono>
+#endif
+
+//static description of an instrumented site
+struct ProfileZone
+{
+	const char *name;
+	const char *file;
+	int line;
+};
+
+struct ProfileEvent
+{
+	const ProfileZone *zone;
+	uint64_t begin;
+	uint64_t end;
+	uint32_t thread_id;
+	uint32_t depth;
+};
+
+//per zone statistics over the recorded frames; times are per frame totals in microseconds
+struct ProfileZoneStats
+{
+	const ProfileZone *zone;
+	uint32_t frames;
+	uint32_t calls;
+	double min_us;
+	double avg_us;
+	double p99_us;
+	double max_us;
+};
+
+class Profiler
+{
+public:
+	static Profiler &Get ();
+
+	static uint64_t GetTimestamp ()
+	{
+		#if PROFILER_USE_RDTSC
+		return __rdtsc ();
+		#else
+		return std::chrono::steady_clock::now ().time_since_epoch ().count ();
+		#endif
+	}
+	bool IsEnabled () const
+	{
+		return enabled.load (std::memory_order_relaxed);
+	}
+
+	void SetEnabled (bool enable);
+	void SetHistorySize (size_t frame_count);
+	void SetThreadName (const char *name);
+	void Clear ();
+
+	//gathers the events of all threads into the frame history and starts a new frame
+	void EndFrame ();
+	void Record (const ProfileZone *zone, uint64_t begin, uint64_t end, uint32_t depth);
+
+	size_t GetFrameCount () const;
+	void GetZoneStats (std::vector<ProfileZoneStats> &stats) const;
+	bool ExportChromeTrace (const char *file_name) const;
+
+	//scope nesting level of the calling thread; maintained by ProfileScope
+	static uint32_t &ThreadDepth ();
+private:
+	struct ThreadBuffer
+	{
+		std::atomic_flag lock;
+		uint32_t thread_id;
+		std::string name;
+		std::vector<ProfileEvent> events;
+	};
+	struct Frame
+	{
+		uint64_t begin;
+		uint64_t end;
+		std::vector<ProfileEvent> events;
+	};
+
+	Profiler ();
+	Profiler (const Profiler &) = delete;
+	Profiler &operator= (const Profiler &) = delete;
+	ThreadBuffer &GetThreadBuffer ();
+	void ClearThreadBuffers ();
+	void CalibrateClock () const;
+	double TicksToMicroseconds (uint64_t ticks) const;
+
+	std::atomic<bool> enabled;
+	mutable std::mutex mutex;
+	std::vector<std::unique_ptr<ThreadBuffer>> thread_buffers;
+	std::vector<Frame> frames;    //ring of the last history_size frames
+	size_t history_size;
+	size_t next_frame;
+	uint64_t frame_begin;
+
+	uint64_t calibration_ticks;
+	int64_t calibration_ns;
+	mutable double ticks_per_us;
+};
+
+class ProfileScope
+{
+public:
+	explicit ProfileScope (const ProfileZone *zone_desc) :
+		zone (Profiler::Get ().IsEnabled () ? zone_desc : nullptr)
+	{
+		if (zone)
+		{
+			depth = Profiler::ThreadDepth ()++;
+			begin = Profiler::GetTimestamp ();
+		}
+	}
+	~ProfileScope ()
+	{
+		if (zone)
+		{
+			Profiler::Get ().Record (zone, begin, Profiler::GetTimestamp (), depth);
+			Profiler::ThreadDepth ()--;
+		}
+	}
+private:
+	ProfileScope (const ProfileScope &) = delete;
+	ProfileScope &operator= (const ProfileScope &) = delete;
+
+	const ProfileZone *zone;
+	uint64_t begin;
+	uint32_t depth;
+};
+
+#define PROFILE_CONCAT_IMPL(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_IMPL (a, b)
+
+#if ENABLE_PROFILER
+#define PROFILE_SCOPE(name) \
+	static const ProfileZone PROFILE_CONCAT (profile_zone_, __LINE__) = { name, __FILE__, __LINE__ }; \
+	ProfileScope PROFILE_CONCAT (profile_scope_, __LINE__) (&PROFILE_CONCAT (profile_zone_, __LINE__))
+#define PROFILE_FUNCTION() PROFILE_SCOPE (__FUNCTION__)
+#define PROFILE_END_FRAME() Profiler::Get ().EndFrame ()
+#define PROFILE_THREAD_NAME(name) Profiler::Get ().SetThreadName (name)
+#else
+#define PROFILE_SCOPE(name)
+#define PROFILE_FUNCTION()
+#define PROFILE_END_FRAME()
+#define PROFILE_THREAD_NAME(name)
+#endif
@@ -0,0 +1,607 @@
+#include "render_graph.h"
+#include "resource_state.h"
+
+#include <string.h>
+#include <algorithm>
+#include <stdexcept>
+
+//barriers of one batch up to this count are converted on the stack
+static const uint32_t local_barrier_count = 32;
+
+static uint64_t AlignUp (uint64_t value, uint64_t alignment)
+{
+	return (value + alignment - 1) & ~(alignment - 1);
+}
+
+static GpuHeapTier GetTier (const RenderGraphResourceDesc &desc)
+{
+	if (desc.type == RENDER_GRAPH_RESOURCE_BUFFER)
+		return GPU_HEAP_TIER_BUFFERS;
+	if (desc.flags & (GPU_RESOURCE_FLAG_ALLOW_RENDER_TARGET | GPU_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL))
+		return GPU_HEAP_TIER_RENDER_TARGETS;
+	return GPU_HEAP_TIER_TEXTURES;
+}
+
+RenderGraph::RenderGraph (RenderGraphBackend *graph_backend, GpuMemoryAllocator *memory_allocator, FrameScheduler *frame_scheduler) :
+	backend (graph_backend),
+	memory (memory_allocator),
+	scheduler (frame_scheduler),
+	compiled (false),
+	final_barrier (0)
+{
+	memset (&stats, 0, sizeof (stats));
+	memset (transient_memory, 0, sizeof (transient_memory));
+	for (uint32_t tier = 0; tier < GPU_HEAP_TIER_COUNT; tier++)
+		has_transient_memory[tier] = false;
+}
+
+RenderGraph::~RenderGraph ()
+{
+	//the owner waits for the GPU before destruction
+	ReleaseTransients (false);
+}
+
+void RenderGraph::Reset ()
+{
+	passes.clear ();
+	resources.clear ();
+	accesses.clear ();
+}
+
+RenderGraphResource RenderGraph::Import (const char *name, GpuResourceHandle handle, GpuResourceStates initial_state, GpuResourceStates final_state)
+{
+	Resource resource;
+	memset (&resource.desc, 0, sizeof (resource.desc));
+	resource.name = name;
+	resource.imported = true;
+	resource.handle = handle;
+	resource.initial_state = initial_state;
+	resource.final_state = final_state;
+	resources.push_back (resource);
+	return static_cast<RenderGraphResource>(resources.size () - 1);
+}
+
+RenderGraphResource RenderGraph::CreateTransient (const char *name, const RenderGraphResourceDesc &desc)
+{
+	if (!desc.width)
+		throw std::invalid_argument ("Transient resource can not be empty");
+	Resource resource;
+	resource.name = name;
+	resource.imported = false;
+	resource.desc = desc;
+	resource.handle = 0;
+	resource.initial_state = GPU_RESOURCE_STATE_COMMON;
+	resource.final_state = GPU_RESOURCE_STATE_COMMON;
+	resources.push_back (resource);
+	return static_cast<RenderGraphResource>(resources.size () - 1);
+}
+
+RenderGraphPass RenderGraph::AddPass (const char *name, uint32_t job_count, ExecuteFunction execute)
+{
+	if (!job_count)
+		throw std::invalid_argument ("Pass needs at least one job");
+	Pass pass;
+	pass.name = name;
+	pass.job_count = job_count;
+	pass.execute = std::move (execute);
+	pass.side_effect = false;
+	passes.push_back (std::move (pass));
+	return static_cast<RenderGraphPass>(passes.size () - 1);
+}
+
+void RenderGraph::Read (RenderGraphPass pass, RenderGraphResource resource, GpuResourceStates state)
+{
+	AddAccess (pass, resource, state, false);
+}
+
+void RenderGraph::Write (RenderGraphPass pass, RenderGraphResource resource, GpuResourceStates state)
+{
+	AddAccess (pass, resource, state, true);
+}
+
+void RenderGraph::SetSideEffect (RenderGraphPass pass)
+{
+	passes.at (pass).side_effect = true;
+}
+
+void RenderGraph::Compile ()
+{
+	BuildKey (key);
+	if (compiled && key == compiled_key)
+	{
+		stats.cache_hits++;
+		return;
+	}
+
+	ReleaseTransients (true);
+	Schedule ();
+	PlaceTransients ();
+	PlanBarriers (false);
+	PlanBarriers (true);
+	CreateTransients ();
+	compiled_key.swap (key);
+	compiled = true;
+	stats.compilations++;
+}
+
+void RenderGraph::RecordJob (uint32_t job, GpuCommandList *command_list) const
+{
+	if (job >= jobs.size ())
+		throw std::out_of_range ("Render graph job is out of range");
+	const Job &pass_job = jobs[job];
+	const CompiledPass &compiled_pass = schedule[pass_job.compiled_pass];
+	if (!pass_job.pass_job && compiled_pass.barrier_count)
+		EmitBarriers (compiled_pass.first_barrier, compiled_pass.barrier_count, command_list);
+
+	passes[compiled_pass.pass].execute (pass_job.pass_job, command_list);
+
+	if (job == jobs.size () - 1 && final_barrier < barriers.size ())
+		EmitBarriers (final_barrier, static_cast<uint32_t>(barriers.size ()) - final_barrier, command_list);
+}
+
+GpuResourceHandle RenderGraph::GetHandle (RenderGraphResource resource) const
+{
+	if (resource >= resources.size ())
+		throw std::out_of_range ("Render graph resource is out of range");
+	if (resources[resource].imported)
+		return resources[resource].handle;
+	return transients.at (resource).handle;
+}
+
+void RenderGraph::BuildKey (std::vector<uint64_t> &graph_key) const
+{
+	//everything the compilation depends on; names, imported handles and pass functions are not part of it
+	graph_key.clear ();
+	graph_key.push_back (resources.size ());
+	graph_key.push_back (passes.size ());
+	graph_key.push_back (accesses.size ());
+	for (const Resource &resource : resources)
+	{
+		if (resource.imported)
+		{
+			graph_key.push_back (1);
+			graph_key.push_back (resource.initial_state | static_cast<uint64_t>(resource.final_state) << 32);
+			continue;
+		}
+		const RenderGraphResourceDesc &desc = resource.desc;
+		uint64_t clear_color[2];
+		memcpy (clear_color, desc.clear_color, sizeof (clear_color));
+		graph_key.push_back (0);
+		graph_key.push_back (desc.type);
+		graph_key.push_back (desc.width);
+		graph_key.push_back (desc.height | static_cast<uint64_t>(desc.array_size) << 32 | static_cast<uint64_t>(desc.mip_levels) << 48);
+		graph_key.push_back (desc.format | static_cast<uint64_t>(desc.flags) << 32);
+		graph_key.push_back (clear_color[0]);
+		graph_key.push_back (clear_color[1]);
+	}
+	for (const Pass &pass : passes)
+		graph_key.push_back (pass.job_count | static_cast<uint64_t>(pass.side_effect) << 32);
+	for (const Access &access : accesses)
+	{
+		graph_key.push_back (access.pass | static_cast<uint64_t>(access.resource) << 32);
+		graph_key.push_back (access.state | static_cast<uint64_t>(access.write) << 32);
+	}
+}
+
+void RenderGraph::Schedule ()
+{
+	const uint32_t pass_count = static_cast<uint32_t>(passes.size ());
+	const uint32_t resource_count = static_cast<uint32_t>(resources.size ());
+
+	//group the accesses by pass, keeping their order inside a pass
+	pass_access_begin.assign (pass_count + 1, 0);
+	for (const Access &access : accesses)
+		pass_access_begin[access.pass + 1]++;
+	for (uint32_t pass = 0; pass < pass_count; pass++)
+		pass_access_begin[pass + 1] += pass_access_begin[pass];
+	pass_accesses.resize (accesses.size ());
+	std::vector<uint32_t> cursor (pass_access_begin.begin (), pass_access_begin.end () - 1);
+	for (const Access &access : accesses)
+		pass_accesses[cursor[access.pass]++] = access;
+
+	//in declaration order a pass depends on the last writer of every resource it
+	//accesses and a writer also on the readers since that write; edges only point
+	//forward, so the graph has no cycles
+	struct Edge
+	{
+		uint32_t from;
+		uint32_t to;
+		bool data;    //the later pass uses what the earlier one wrote
+	};
+	std::vector<Edge> edges;
+	std::vector<uint32_t> last_writer (resource_count, render_graph_invalid);
+	std::vector<std::vector<uint32_t>> readers (resource_count);
+	for (uint32_t pass = 0; pass < pass_count; pass++)
+		for (uint32_t i = pass_access_begin[pass]; i < pass_access_begin[pass + 1]; i++)
+		{
+			const Access &access = pass_accesses[i];
+			const uint32_t writer = last_writer[access.resource];
+			if (writer != render_graph_invalid && writer != pass)
+				edges.push_back (Edge { writer, pass, true });
+			if (!access.write)
+			{
+				readers[access.resource].push_back (pass);
+				continue;
+			}
+			for (uint32_t reader : readers[access.resource])
+				if (reader != pass)
+					edges.push_back (Edge { reader, pass, false });
+			readers[access.resource].clear ();
+			last_writer[access.resource] = pass;
+		}
+
+	//adjacency lists in both directions
+	std::vector<uint32_t> in_begin (pass_count + 1, 0);
+	std::vector<uint32_t> out_begin (pass_count + 1, 0);
+	for (const Edge &edge : edges)
+	{
+		in_begin[edge.to + 1]++;
+		out_begin[edge.from + 1]++;
+	}
+	for (uint32_t pass = 0; pass < pass_count; pass++)
+	{
+		in_begin[pass + 1] += in_begin[pass];
+		out_begin[pass + 1] += out_begin[pass];
+	}
+	std::vector<uint32_t> in_edges (edges.size ());
+	std::vector<uint32_t> out_edges (edges.size ());
+	{
+		std::vector<uint32_t> in_cursor (in_begin.begin (), in_begin.end () - 1);
+		std::vector<uint32_t> out_cursor (out_begin.begin (), out_begin.end () - 1);
+		for (uint32_t i = 0; i < edges.size (); i++)
+		{
+			in_edges[in_cursor[edges[i].to]++] = i;
+			out_edges[out_cursor[edges[i].from]++] = i;
+		}
+	}
+
+	//culling: a pass is needed for its side effects, for writing an imported resource
+	//or for producing data a needed pass uses
+	std::vector<uint8_t> alive (pass_count, 0);
+	std::vector<uint32_t> stack;
+	for (uint32_t pass = 0; pass < pass_count; pass++)
+	{
+		bool root = passes[pass].side_effect;
+		for (uint32_t i = pass_access_begin[pass]; i < pass_access_begin[pass + 1] && !root; i++)
+			root = pass_accesses[i].write && resources[pass_accesses[i].resource].imported;
+		if (root)
+		{
+			alive[pass] = 1;
+			stack.push_back (pass);
+		}
+	}
+	while (!stack.empty ())
+	{
+		const uint32_t pass = stack.back ();
+		stack.pop_back ();
+		for (uint32_t i = in_begin[pass]; i < in_begin[pass + 1]; i++)
+		{
+			const Edge &edge = edges[in_edges[i]];
+			if (edge.data && !alive[edge.from])
+			{
+				alive[edge.from] = 1;
+				stack.push_back (edge.from);
+			}
+		}
+	}
+
+	//topological order of the needed passes (Kahn)
+	std::vector<uint32_t> in_degree (pass_count, 0);
+	uint32_t alive_count = 0;
+	for (const Edge &edge : edges)
+		if (alive[edge.from] && alive[edge.to])
+			in_degree[edge.to]++;
+	std::vector<uint32_t> ready;
+	for (uint32_t pass = 0; pass < pass_count; pass++)
+		if (alive[pass])
+		{
+			alive_count++;
+			if (!in_degree[pass])
+				ready.push_back (pass);
+		}
+	schedule.clear ();
+	for (size_t head = 0; head < ready.size (); head++)
+	{
+		const uint32_t pass = ready[head];
+		CompiledPass compiled_pass = { pass, 0, 0 };
+		schedule.push_back (compiled_pass);
+		for (uint32_t i = out_begin[pass]; i < out_begin[pass + 1]; i++)
+		{
+			const Edge &edge = edges[out_edges[i]];
+			if (alive[edge.to] && !--in_degree[edge.to])
+				ready.push_back (edge.to);
+		}
+	}
+	if (schedule.size () != alive_count)
+		throw std::logic_error ("Render graph has a cycle");
+
+	jobs.clear ();
+	for (uint32_t position = 0; position < schedule.size (); position++)
+		for (uint32_t i = 0; i < passes[schedule[position].pass].job_count; i++)
+		{
+			Job job = { position, i };
+			jobs.push_back (job);
+		}
+
+	stats.passes = pass_count;
+	stats.culled_passes = pass_count - alive_count;
+}
+
+void RenderGraph::PlaceTransients ()
+{
+	const uint32_t resource_count = static_cast<uint32_t>(resources.size ());
+	Transient unused;
+	memset (&unused, 0, sizeof (unused));
+	unused.first_use = render_graph_invalid;
+	transients.assign (resource_count, unused);
+
+	//lifetimes in schedule positions
+	for (uint32_t position = 0; position < schedule.size (); position++)
+	{
+		const uint32_t pass = schedule[position].pass;
+		for (uint32_t i = pass_access_begin[pass]; i < pass_access_begin[pass + 1]; i++)
+		{
+			const RenderGraphResource resource = pass_accesses[i].resource;
+			if (resources[resource].imported)
+				continue;
+			Transient &transient = transients[resource];
+			if (transient.first_use == render_graph_invalid)
+				transient.first_use = position;
+			transient.last_use = position;
+		}
+	}
+
+	std::vector<uint32_t> order;
+	uint64_t unaliased_bytes = 0;
+	for (uint32_t resource = 0; resource < resource_count; resource++)
+	{
+		Transient &transient = transients[resource];
+		if (resources[resource].imported || transient.first_use == render_graph_invalid)
+			continue;
+		backend->GetAllocationInfo (resources[resource].desc, transient.size, transient.alignment);
+		transient.tier = GetTier (resources[resource].desc);
+		unaliased_bytes += transient.size;
+		order.push_back (resource);
+	}
+
+	//largest first, each at the lowest offset free during its whole lifetime
+	std::sort (order.begin (), order.end (), [this] (uint32_t a, uint32_t b)
+	{
+		if (transients[a].size != transients[b].size)
+			return transients[a].size > transients[b].size;
+		return a < b;
+	});
+	uint64_t peak[GPU_HEAP_TIER_COUNT] = {};
+	uint64_t alignment[GPU_HEAP_TIER_COUNT];
+	for (uint32_t tier = 0; tier < GPU_HEAP_TIER_COUNT; tier++)
+		alignment[tier] = gpu_default_placement_alignment;
+	std::vector<std::pair<uint64_t, uint64_t>> busy;
+	for (size_t i = 0; i < order.size (); i++)
+	{
+		Transient &transient = transients[order[i]];
+		busy.clear ();
+		for (size_t j = 0; j < i; j++)
+		{
+			const Transient &placed = transients[order[j]];
+			if (placed.tier == transient.tier && placed.first_use <= transient.last_use && transient.first_use <= placed.last_use)
+				busy.push_back (std::make_pair (placed.offset, placed.offset + placed.size));
+		}
+		std::sort (busy.begin (), busy.end ());
+		uint64_t offset = 0;
+		for (const auto &range : busy)
+		{
+			if (AlignUp (offset, transient.alignment) + transient.size <= range.first)
+				break;
+			offset = std::max (offset, range.second);
+		}
+		transient.offset = AlignUp (offset, transient.alignment);
+		peak[transient.tier] = std::max (peak[transient.tier], transient.offset + transient.size);
+		alignment[transient.tier] = std::max (alignment[transient.tier], transient.alignment);
+	}
+
+	stats.transient_resources = static_cast<uint32_t>(order.size ());
+	stats.transient_bytes = 0;
+	stats.unaliased_bytes = unaliased_bytes;
+	for (uint32_t tier = 0; tier < GPU_HEAP_TIER_COUNT; tier++)
+	{
+		if (!peak[tier])
+			continue;
+		transient_memory[tier] = memory->Allocate (static_cast<GpuHeapTier>(tier), peak[tier], alignment[tier]);
+		has_transient_memory[tier] = true;
+		stats.transient_bytes += peak[tier];
+	}
+}
+
+void RenderGraph::PlanBarriers (bool emit)
+{
+	const uint32_t resource_count = static_cast<uint32_t>(resources.size ());
+	std::vector<GpuResourceStates> current (resource_count);
+	std::vector<GpuResourceStates> required (resource_count);
+	std::vector<uint32_t> marker (resource_count, render_graph_invalid);
+	std::vector<uint8_t> used (resource_count, 0);
+	std::vector<RenderGraphResource> touched;
+	//transients are in the state of their last access when the frame starts, which is
+	//found by a first walk without barriers; their placed resources are created in it
+	for (uint32_t resource = 0; resource < resource_count; resource++)
+		current[resource] = resources[resource].imported ? resources[resource].initial_state :
+							emit ? transients[resource].state : gpu_resource_state_unknown;
+
+	barriers.clear ();
+	for (uint32_t position = 0; position < schedule.size (); position++)
+	{
+		CompiledPass &compiled_pass = schedule[position];
+		const uint32_t pass = compiled_pass.pass;
+
+		//the state a pass needs; several reads of a resource combine
+		touched.clear ();
+		for (uint32_t i = pass_access_begin[pass]; i < pass_access_begin[pass + 1]; i++)
+		{
+			const Access &access = pass_accesses[i];
+			if (marker[access.resource] != position)
+			{
+				marker[access.resource] = position;
+				required[access.resource] = access.state;
+				touched.push_back (access.resource);
+				continue;
+			}
+			GpuResourceStates &state = required[access.resource];
+			if (state == access.state)
+				continue;
+			if ((state | access.state) & ~gpu_read_only_states)
+				throw std::logic_error ("Pass accesses a resource in conflicting states");
+			state |= access.state;
+		}
+
+		compiled_pass.first_barrier = static_cast<uint32_t>(barriers.size ());
+		for (RenderGraphResource resource : touched)
+		{
+			used[resource] = 1;
+			if (emit && !resources[resource].imported && transients[resource].first_use == position)
+			{
+				//the memory may have held another transient since the last use of this one
+				const Transient &transient = transients[resource];
+				uint32_t overlaps = 0;
+				RenderGraphResource before = render_graph_invalid;
+				for (uint32_t other = 0; other < resource_count; other++)
+				{
+					const Transient &placed = transients[other];
+					if (other == resource || resources[other].imported || placed.first_use == render_graph_invalid || placed.tier != transient.tier)
+						continue;
+					if (placed.offset < transient.offset + transient.size && transient.offset < placed.offset + placed.size)
+					{
+						overlaps++;
+						before = other;
+					}
+				}
+				if (overlaps)
+				{
+					PlannedBarrier barrier = { resource, overlaps == 1 ? before : render_graph_invalid, 0, 0, true };
+					barriers.push_back (barrier);
+				}
+			}
+
+			GpuResourceStates &state = current[resource];
+			if (state != required[resource])
+			{
+				if (emit)
+				{
+					PlannedBarrier barrier = { resource, render_graph_invalid, state, required[resource], false };
+					barriers.push_back (barrier);
+				}
+				state = required[resource];
+			}
+		}
+		compiled_pass.barrier_count = static_cast<uint32_t>(barriers.size ()) - compiled_pass.first_barrier;
+	}
+
+	if (!emit)
+	{
+		for (uint32_t resource = 0; resource < resource_count; resource++)
+			if (!resources[resource].imported && used[resource])
+				transients[resource].state = current[resource];
+		return;
+	}
+
+	//imported resources leave the graph in their final state
+	final_barrier = static_cast<uint32_t>(barriers.size ());
+	for (uint32_t resource = 0; resource < resource_count; resource++)
+		if (resources[resource].imported && used[resource] && current[resource] != resources[resource].final_state)
+		{
+			PlannedBarrier barrier = { resource, render_graph_invalid, current[resource], resources[resource].final_state, false };
+			barriers.push_back (barrier);
+		}
+
+	stats.transitions = 0;
+	stats.aliasing_barriers = 0;
+	stats.barrier_batches = final_barrier < barriers.size () ? 1 : 0;
+	for (const PlannedBarrier &barrier : barriers)
+		if (barrier.aliasing)
+			stats.aliasing_barriers++;
+		else
+			stats.transitions++;
+	for (const CompiledPass &compiled_pass : schedule)
+		if (compiled_pass.barrier_count)
+			stats.barrier_batches++;
+}
+
+void RenderGraph::CreateTransients ()
+{
+	for (uint32_t resource = 0; resource < resources.size (); resource++)
+	{
+		Transient &transient = transients[resource];
+		if (resources[resource].imported || transient.first_use == render_graph_invalid)
+			continue;
+		const GpuMemoryAllocation &allocation = transient_memory[transient.tier];
+		transient.handle = backend->CreatePlacedResource (resources[resource].desc,
+														  allocation.heap,
+														  allocation.offset + transient.offset,
+														  transient.state);
+	}
+}
+
+void RenderGraph::ReleaseTransients (bool deferred)
+{
+	compiled = false;
+	RenderGraphBackend *graph_backend = backend;
+	for (const Transient &transient : transients)
+	{
+		if (!transient.handle)
+			continue;
+		const GpuResourceHandle handle = transient.handle;
+		if (deferred)
+			scheduler->DeferRelease ([graph_backend, handle] () { graph_backend->DestroyResource (handle); });
+		else
+			backend->DestroyResource (handle);
+	}
+	transients.clear ();
+
+	GpuMemoryAllocator *allocator = memory;
+	for (uint32_t tier = 0; tier < GPU_HEAP_TIER_COUNT; tier++)
+	{
+		if (!has_transient_memory[tier])
+			continue;
+		const GpuMemoryAllocation allocation = transient_memory[tier];
+		if (deferred)
+			scheduler->DeferRelease ([allocator, allocation] () { allocator->Free (allocation); });
+		else
+			memory->Free (allocation);
+		has_transient_memory[tier] = false;
+	}
+}
+
+void RenderGraph::GetTransientHeaps (std::vector<GpuHeapHandle> &heaps) const
+{
+	for (uint32_t tier = 0; tier < GPU_HEAP_TIER_COUNT; tier++)
+		if (has_transient_memory[tier])
+			heaps.push_back (transient_memory[tier].heap);
+}
+
+void RenderGraph::AddAccess (RenderGraphPass pass, RenderGraphResource resource, GpuResourceStates state, bool write)
+{
+	if (pass >= passes.size () || resource >= resources.size ())
+		throw std::out_of_range ("Render graph pass or resource is out of range");
+	Access access = { pass, resource, state, write };
+	accesses.push_back (access);
+}
+
+void RenderGraph::EmitBarriers (uint32_t first, uint32_t count, GpuCommandList *command_list) const
+{
+	GpuBarrier local_barriers[local_barrier_count];
+	std::vector<GpuBarrier> heap_barriers;
+	GpuBarrier *gpu_barriers = local_barriers;
+	if (count > local_barrier_count)
+	{
+		heap_barriers.resize (count);
+		gpu_barriers = heap_barriers.data ();
+	}
+	for (uint32_t i = 0; i < count; i++)
+	{
+		const PlannedBarrier &barrier = barriers[first + i];
+		if (barrier.aliasing)
+			gpu_barriers[i] = GpuAliasing (barrier.resource_before == render_graph_invalid ? 0 : GetHandle (barrier.resource_before),
+										   GetHandle (barrier.resource));
+		else
+			gpu_barriers[i] = GpuTransition (GetHandle (barrier.resource), barrier.state_before, barrier.state_after);
+	}
+	command_list->ResourceBarrier (count, gpu_barriers);
+}
@@ -0,0 +1,212 @@
+#pragma once
+#include "gpu_device.h"
+#include "gpu_memory.h"
+#include "frame_scheduler.h"
+
+#include <stdint.h>
+
+#include <functional>
+#include <vector>
+
+//Frame graph. Every frame the passes are declared again together with the resources
+//they read and write; Compile () orders them, culls passes whose results are never
+//used, infers the transition barriers between them and places transient resources
+//with disjoint lifetimes into the same memory. The result is cached while the declared
+//structure stays the same. Execution maps the passes to recording jobs, so a pass can
+//be split over several command lists recorded in parallel.
+
+typedef uint32_t RenderGraphResource;
+typedef uint32_t RenderGraphPass;
+
+static const uint32_t render_graph_invalid = 0xffffffff;
+
+enum RenderGraphResourceType
+{
+	RENDER_GRAPH_RESOURCE_BUFFER,
+	RENDER_GRAPH_RESOURCE_TEXTURE_2D
+};
+
+struct RenderGraphResourceDesc
+{
+	RenderGraphResourceType type;
+	uint64_t width;             //bytes for buffers
+	uint32_t height;
+	uint16_t array_size;
+	uint16_t mip_levels;
+	uint32_t format;            //DXGI_FORMAT value, unused for buffers
+	uint32_t flags;             //GpuResourceFlags
+	float clear_color[4];       //optimized clear value of render targets; depth in [0], stencil in [1]
+};
+
+//creates the placed resources of transients
+class RenderGraphBackend
+{
+public:
+	virtual ~RenderGraphBackend () {}
+	virtual void GetAllocationInfo (const RenderGraphResourceDesc &desc, uint64_t &size, uint64_t &alignment) = 0;
+	virtual GpuResourceHandle CreatePlacedResource (const RenderGraphResourceDesc &desc, GpuHeapHandle heap, uint64_t offset, GpuResourceStates initial_state) = 0;
+	virtual void DestroyResource (GpuResourceHandle resource) = 0;
+};
+
+struct RenderGraphStats
+{
+	uint32_t passes;
+	uint32_t culled_passes;
+	uint32_t transient_resources;
+	uint64_t transient_bytes;           //memory reserved for transients, all tiers
+	uint64_t unaliased_bytes;           //memory transients would take without aliasing
+	uint32_t transitions;               //barriers per execution
+	uint32_t aliasing_barriers;
+	uint32_t barrier_batches;
+	uint64_t compilations;
+	uint64_t cache_hits;
+};
+
+class RenderGraph
+{
+public:
+	//job is the index of the job inside the pass; the graph records the barriers of the pass before job 0
+	typedef std::function<void (uint32_t job, GpuCommandList *command_list)> ExecuteFunction;
+
+	//transient memory comes from the allocator; memory and resources of an outdated
+	//compilation are released through the scheduler once the GPU is done with them
+	RenderGraph (RenderGraphBackend *backend, GpuMemoryAllocator *memory, FrameScheduler *scheduler);
+	~RenderGraph ();
+
+	//starts the declaration of a frame; names are not copied and must outlive it
+	void Reset ();
+
+	//external resource; it is in the initial state when the graph starts and gets
+	//the final state after the last pass that uses it
+	RenderGraphResource Import (const char *name, GpuResourceHandle handle, GpuResourceStates initial_state, GpuResourceStates final_state);
+	//resource owned by the graph, valid during the frame only; its first access must
+	//initialize it completely (clear, discard or full overwrite) as memory is shared
+	RenderGraphResource CreateTransient (const char *name, const RenderGraphResourceDesc &desc);
+
+	//passes run in a valid order of their dependencies; job_count command lists are recorded for the pass
+	RenderGraphPass AddPass (const char *name, uint32_t job_count, ExecuteFunction execute);
+	void Read (RenderGraphPass pass, RenderGraphResource resource, GpuResourceStates state);
+	//a write keeps the previous contents, the pass depends on the previous writer
+	void Write (RenderGraphPass pass, RenderGraphResource resource, GpuResourceStates state);
+	//the pass is never culled, for passes with effects outside the graph
+	void SetSideEffect (RenderGraphPass pass);
+
+	void Compile ();
+
+	//number of recording jobs of the compiled graph
+	uint32_t GetJobCount () const
+	{
+		return static_cast<uint32_t>(jobs.size ());
+	}
+	//records the barriers of the pass and one job of it; jobs may be recorded in parallel
+	//as long as their lists are executed in job order
+	void RecordJob (uint32_t job, GpuCommandList *command_list) const;
+
+	GpuResourceHandle GetHandle (RenderGraphResource resource) const;
+	//appends the heaps of the transient memory of the compiled graph, e.g. for residency
+	void GetTransientHeaps (std::vector<GpuHeapHandle> &heaps) const;
+	const RenderGraphStats &GetStats () const
+	{
+		return stats;
+	}
+private:
+	struct Access
+	{
+		RenderGraphPass pass;
+		RenderGraphResource resource;
+		GpuResourceStates state;
+		bool write;
+	};
+
+	struct Pass
+	{
+		const char *name;
+		uint32_t job_count;
+		ExecuteFunction execute;
+		bool side_effect;
+	};
+
+	struct Resource
+	{
+		const char *name;
+		bool imported;
+		RenderGraphResourceDesc desc;
+		GpuResourceHandle handle;
+		GpuResourceStates initial_state;
+		GpuResourceStates final_state;
+	};
+
+	//barrier of the compiled graph; handles are looked up when recording
+	struct PlannedBarrier
+	{
+		RenderGraphResource resource;
+		RenderGraphResource resource_before;    //aliasing only, render_graph_invalid for any resource
+		GpuResourceStates state_before;
+		GpuResourceStates state_after;
+		bool aliasing;
+	};
+
+	struct CompiledPass
+	{
+		uint32_t pass;
+		uint32_t first_barrier;
+		uint32_t barrier_count;
+	};
+
+	struct Job
+	{
+		uint32_t compiled_pass;
+		uint32_t pass_job;
+	};
+
+	//placement of a transient, kept with its resource while the compilation is cached
+	struct Transient
+	{
+		GpuHeapTier tier;
+		uint64_t size;
+		uint64_t alignment;
+		uint64_t offset;        //inside the memory of the tier
+		uint32_t first_use;     //positions in the schedule
+		uint32_t last_use;
+		GpuResourceStates state;
+		GpuResourceHandle handle;
+	};
+
+	RenderGraph (const RenderGraph &) = delete;
+	RenderGraph &operator= (const RenderGraph &) = delete;
+
+	void BuildKey (std::vector<uint64_t> &graph_key) const;
+	void Schedule ();
+	void PlaceTransients ();
+	//walks the schedule; with emit set it records the barriers, otherwise it only
+	//finds the states transients end the frame in
+	void PlanBarriers (bool emit);
+	void CreateTransients ();
+	void ReleaseTransients (bool deferred);
+	void AddAccess (RenderGraphPass pass, RenderGraphResource resource, GpuResourceStates state, bool write);
+	void EmitBarriers (uint32_t first, uint32_t count, GpuCommandList *command_list) const;
+
+	RenderGraphBackend *backend;
+	GpuMemoryAllocator *memory;
+	FrameScheduler *scheduler;
+
+	//declared frame
+	std::vector<Pass> passes;
+	std::vector<Resource> resources;
+	std::vector<Access> accesses;
+
+	//compiled graph
+	std::vector<uint64_t> key;    //of the declared frame
+	std::vector<uint64_t> compiled_key;
+	bool compiled;
+	std::vector<CompiledPass> schedule;
+	std::vector<uint32_t> pass_access_begin;    //accesses grouped by pass, index by pass
+	std::vector<Access> pass_accesses;
+	std::vector<PlannedBarrier> barriers;
+	uint32_t final_barrier;     //barriers from here on follow the last pass
+	std::vector<Job> jobs;
+	std::vector<Transient> transients;    //by resource index, unused for imported
+	GpuMemoryAllocation transient_memory[GPU_HEAP_TIER_COUNT];
+	bool has_transient_memory[GPU_HEAP_TIER_COUNT];
+	RenderGraphStats stats;
+};
@@ -0,0 +1,230 @@
+#include "residency.h"
+
+#include <string.h>
+#include <algorithm>
+#include <stdexcept>
+
+ResidencyOptions::ResidencyOptions () :
+	evict_ratio (1.0f),
+	target_ratio (0.9f)
+{
+}
+
+ResidencyManager::ResidencyManager (GpuHeapBackend *gpu_heap_backend, ResidencyBackend *residency_backend, const ResidencyOptions &residency_options) :
+	heap_backend (gpu_heap_backend),
+	backend (residency_backend),
+	options (residency_options),
+	lru_head (invalid_heap),
+	lru_tail (invalid_heap),
+	last_fence_value (0)
+{
+	if (!(options.target_ratio > 0.0f && options.target_ratio <= options.evict_ratio))
+		throw std::invalid_argument ("Residency target must be positive and not above the eviction threshold");
+	memset (&stats, 0, sizeof (stats));
+}
+
+ResidencyManager::~ResidencyManager ()
+{
+}
+
+GpuHeapHandle ResidencyManager::CreateHeap (GpuHeapTier tier, uint64_t size)
+{
+	const GpuHeapHandle handle = heap_backend->CreateHeap (tier, size);
+	std::lock_guard<std::mutex> lock (mutex);
+	uint32_t index;
+	if (free_heaps.empty ())
+	{
+		index = static_cast<uint32_t>(heaps.size ());
+		heaps.emplace_back ();
+	}
+	else
+	{
+		index = free_heaps.back ();
+		free_heaps.pop_back ();
+	}
+	Heap &heap = heaps[index];
+	heap.handle = handle;
+	heap.size = size;
+	//counts as used by the last submission: it is not evicted until that submission finished,
+	//and then after the heaps used before it. A heap not used by then may be evicted unused.
+	heap.last_use = last_fence_value;
+	heap.used_submission = 0;
+	heap.resident = true;
+	heap.live = true;
+	LinkTail (index);
+	heap_indices[handle] = index;
+	stats.heaps++;
+	stats.resident_heaps++;
+	stats.tracked_bytes += size;
+	stats.resident_bytes += size;
+	return handle;
+}
+
+void ResidencyManager::DestroyHeap (GpuHeapHandle handle)
+{
+	{
+		std::lock_guard<std::mutex> lock (mutex);
+		const uint32_t index = GetHeapIndex (handle);
+		Heap &heap = heaps[index];
+		if (heap.resident)
+		{
+			Unlink (index);
+			stats.resident_heaps--;
+			stats.resident_bytes -= heap.size;
+		}
+		//a pending use of the heap is dropped by Submit ()
+		heap.live = false;
+		stats.heaps--;
+		stats.tracked_bytes -= heap.size;
+		heap_indices.erase (handle);
+		free_heaps.push_back (index);
+	}
+	heap_backend->DestroyHeap (handle);
+}
+
+void ResidencyManager::Use (GpuHeapHandle handle)
+{
+	std::lock_guard<std::mutex> lock (mutex);
+	const uint32_t index = GetHeapIndex (handle);
+	Heap &heap = heaps[index];
+	const uint64_t submission = stats.submissions + 1;
+	if (heap.used_submission == submission)
+		return;
+	heap.used_submission = submission;
+	used_heaps.push_back (index);
+}
+
+void ResidencyManager::Submit (uint64_t fence_value, uint64_t completed_fence_value)
+{
+	std::lock_guard<std::mutex> lock (mutex);
+	if (fence_value <= last_fence_value || completed_fence_value >= fence_value)
+		throw std::invalid_argument ("Residency submissions need growing fence values");
+	last_fence_value = fence_value;
+	const uint64_t submission = ++stats.submissions;
+
+	//heaps of the submission move to the tail; evicted ones are restored after the evictions
+	stats.used_heaps = 0;
+	stats.used_bytes = 0;
+	stats.made_resident_heaps = 0;
+	stats.made_resident_bytes = 0;
+	for (uint32_t index : used_heaps)
+	{
+		Heap &heap = heaps[index];
+		//skips destroyed heaps, slots reused by heaps that were not used and slots listed
+		//twice because their heap was destroyed and the new one used as well
+		if (!heap.live || heap.used_submission != submission || heap.last_use == fence_value)
+			continue;
+		heap.last_use = fence_value;
+		stats.used_heaps++;
+		stats.used_bytes += heap.size;
+		if (heap.resident)
+		{
+			Unlink (index);
+			LinkTail (index);
+		}
+		else
+		{
+			stats.made_resident_heaps++;
+			stats.made_resident_bytes += heap.size;
+		}
+	}
+
+	//the backend usage includes memory the manager does not track, e.g. committed resources
+	uint64_t budget, usage;
+	backend->QueryBudget (budget, usage);
+	usage += stats.made_resident_bytes;
+	stats.budget = budget;
+	stats.evicted_heaps = 0;
+	stats.evicted_bytes = 0;
+	if (usage > static_cast<uint64_t>(budget * static_cast<double>(options.evict_ratio)))
+	{
+		const uint64_t target = static_cast<uint64_t>(budget * static_cast<double>(options.target_ratio));
+		batch.clear ();
+		//the list is ordered by last use, so the first heap the GPU may still use ends the search
+		while (usage > target && lru_head != invalid_heap && heaps[lru_head].last_use <= completed_fence_value)
+		{
+			const uint32_t index = lru_head;
+			Heap &heap = heaps[index];
+			Unlink (index);
+			heap.resident = false;
+			batch.push_back (heap.handle);
+			usage -= std::min (usage, heap.size);
+			stats.evicted_heaps++;
+			stats.evicted_bytes += heap.size;
+			stats.resident_heaps--;
+			stats.resident_bytes -= heap.size;
+		}
+		if (!batch.empty ())
+		{
+			backend->Evict (static_cast<uint32_t>(batch.size ()), batch.data ());
+			stats.eviction_batches++;
+			stats.total_evicted_bytes += stats.evicted_bytes;
+		}
+	}
+	stats.usage = usage;
+	stats.over_budget_bytes = usage > budget ? usage - budget : 0;
+
+	if (stats.made_resident_heaps)
+	{
+		batch.clear ();
+		for (uint32_t index : used_heaps)
+		{
+			Heap &heap = heaps[index];
+			if (!heap.live || heap.used_submission != submission || heap.resident)
+				continue;
+			heap.resident = true;
+			LinkTail (index);
+			batch.push_back (heap.handle);
+			stats.resident_heaps++;
+			stats.resident_bytes += heap.size;
+		}
+		backend->MakeResident (static_cast<uint32_t>(batch.size ()), batch.data ());
+		stats.total_made_resident_bytes += stats.made_resident_bytes;
+	}
+	used_heaps.clear ();
+}
+
+bool ResidencyManager::IsResident (GpuHeapHandle heap) const
+{
+	std::lock_guard<std::mutex> lock (mutex);
+	return heaps[GetHeapIndex (heap)].resident;
+}
+
+ResidencyStats ResidencyManager::GetStats () const
+{
+	std::lock_guard<std::mutex> lock (mutex);
+	return stats;
+}
+
+uint32_t ResidencyManager::GetHeapIndex (GpuHeapHandle heap) const
+{
+	const auto found = heap_indices.find (heap);
+	if (found == heap_indices.end ())
+		throw std::invalid_argument ("Heap is not tracked for residency");
+	return found->second;
+}
+
+void ResidencyManager::LinkTail (uint32_t index)
+{
+	Heap &heap = heaps[index];
+	heap.prev = lru_tail;
+	heap.next = invalid_heap;
+	if (lru_tail != invalid_heap)
+		heaps[lru_tail].next = index;
+	else
+		lru_head = index;
+	lru_tail = index;
+}
+
+void ResidencyManager::Unlink (uint32_t index)
+{
+	Heap &heap = heaps[index];
+	if (heap.prev != invalid_heap)
+		heaps[heap.prev].next = heap.next;
+	else
+		lru_head = heap.next;
+	if (heap.next != invalid_heap)
+		heaps[heap.next].prev = heap.prev;
+	else
+		lru_tail = heap.prev;
+}
@@ -0,0 +1,122 @@
+#pragma once
+#include "gpu_memory.h"
+
+#include <stdint.h>
+
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+//Residency of GPU heaps under the video memory budget of the process. Every heap is
+//tracked with its size and the fence value of the last submission that used it; resident
+//heaps form a list in the order of their last use. Before each submission the heaps it
+//uses are made resident in one batch, and if the memory usage is above the eviction
+//threshold the least recently used heaps the GPU is done with are evicted in one batch,
+//down to the lower target. The gap between the two is the hysteresis that keeps a usage
+//near the budget from evicting and restoring heaps every frame.
+
+class ResidencyBackend
+{
+public:
+	virtual ~ResidencyBackend () {}
+	//budget of the local video memory segment of the process and its current usage in bytes
+	virtual void QueryBudget (uint64_t &budget, uint64_t &usage) = 0;
+	//returns once the heaps can be used by work executed after the call
+	virtual void MakeResident (uint32_t count, const GpuHeapHandle *heaps) = 0;
+	virtual void Evict (uint32_t count, const GpuHeapHandle *heaps) = 0;
+};
+
+struct ResidencyOptions
+{
+	float evict_ratio;          //eviction starts once the usage is above this share of the budget
+	float target_ratio;         //and evicts down to this share
+
+	ResidencyOptions ();
+};
+
+//counts of the last Submit () unless noted
+struct ResidencyStats
+{
+	uint64_t budget;
+	uint64_t usage;             //estimated after the changes of the submission
+	uint64_t over_budget_bytes; //usage left above the budget because the GPU still uses every resident heap
+	uint64_t tracked_bytes;     //current
+	uint64_t resident_bytes;    //current
+	uint32_t heaps;             //current
+	uint32_t resident_heaps;    //current
+	uint32_t used_heaps;
+	uint64_t used_bytes;
+	uint32_t made_resident_heaps;
+	uint64_t made_resident_bytes;
+	uint32_t evicted_heaps;
+	uint64_t evicted_bytes;
+	//since creation
+	uint64_t submissions;
+	uint64_t eviction_batches;
+	uint64_t total_made_resident_bytes;
+	uint64_t total_evicted_bytes;
+};
+
+//Heap backend that tracks the heaps it creates through another backend, so the memory
+//allocator hands it every heap; heaps start resident. Heaps written by other queues must
+//be used by the submissions of this queue as long as those queues may use them.
+class ResidencyManager : public GpuHeapBackend
+{
+public:
+	ResidencyManager (GpuHeapBackend *heap_backend, ResidencyBackend *residency_backend, const ResidencyOptions &options = ResidencyOptions ());
+	~ResidencyManager ();
+
+	GpuHeapHandle CreateHeap (GpuHeapTier tier, uint64_t size) override;
+	//the heap may be resident or evicted
+	void DestroyHeap (GpuHeapHandle heap) override;
+
+	//the heap is used by the work of the next Submit (); thread-safe, e.g. for recording
+	//jobs. Throws std::invalid_argument for heaps the manager did not create.
+	void Use (GpuHeapHandle heap);
+	//before the work that signals fence_value is executed: evicts what is needed to fit
+	//the budget among the heaps completed_fence_value finished with, then makes the heaps
+	//used since the last call resident
+	void Submit (uint64_t fence_value, uint64_t completed_fence_value);
+
+	bool IsResident (GpuHeapHandle heap) const;
+	ResidencyStats GetStats () const;
+private:
+	static const uint32_t invalid_heap = 0xffffffff;
+
+	struct Heap
+	{
+		GpuHeapHandle handle;
+		uint64_t size;
+		uint64_t last_use;          //fence value
+		uint64_t used_submission;   //Submit () the heap was last marked for by Use ()
+		uint32_t prev;              //in the resident list
+		uint32_t next;
+		bool resident;
+		bool live;
+	};
+
+	ResidencyManager (const ResidencyManager &) = delete;
+	ResidencyManager &operator= (const ResidencyManager &) = delete;
+
+	uint32_t GetHeapIndex (GpuHeapHandle heap) const;
+	void LinkTail (uint32_t index);
+	void Unlink (uint32_t index);
+
+	GpuHeapBackend *heap_backend;
+	ResidencyBackend *backend;
+	ResidencyOptions options;
+
+	mutable std::mutex mutex;
+	std::vector<Heap> heaps;
+	std::vector<uint32_t> free_heaps;
+	std::unordered_map<GpuHeapHandle, uint32_t> heap_indices;
+	//resident heaps, least recently used first; last uses only grow towards the tail
+	uint32_t lru_head;
+	uint32_t lru_tail;
+	std::vector<uint32_t> used_heaps;    //since the last Submit ()
+	uint64_t last_fence_value;
+	//scratch of Submit ()
+	std::vector<GpuHeapHandle> batch;
+
+	ResidencyStats stats;
+};
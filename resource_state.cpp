@@ -0,0 +1,287 @@
+#include "resource_state.h"
+
+#include <string.h>
+#include <stdexcept>
+
+//per subresource slots of the tracker
+enum TrackerSlot
+{
+	SLOT_CURRENT,
+	SLOT_INITIAL,    //state the list expects at its start
+	SLOT_SPLIT,      //target of a begun split transition
+	SLOT_CHANGED,    //nonzero once the list recorded a barrier
+	SLOT_COUNT
+};
+
+//true if a resource in the current state can be used in the requested state without a barrier
+static bool IsCompatible (GpuResourceStates current, GpuResourceStates requested)
+{
+	if (current == requested)
+		return true;
+	//COMMON is 0, a combined read state does not include it
+	return requested && current && !(current & ~gpu_read_only_states) && (current & requested) == requested;
+}
+
+//replaces per-subresource barriers that cover the whole resource the same way with one barrier
+static void Collapse (std::vector<GpuBarrier> &barriers, size_t begin, uint32_t subresource_count)
+{
+	if (barriers.size () - begin != subresource_count)
+		return;
+	const GpuBarrier &first = barriers[begin];
+	for (size_t i = begin + 1; i < barriers.size (); i++)
+		if (barriers[i].state_before != first.state_before || barriers[i].state_after != first.state_after || barriers[i].flags != first.flags)
+			return;
+	barriers.resize (begin + 1);
+	barriers[begin].subresource = gpu_all_subresources;
+}
+
+void ResourceStateRegistry::Register (GpuResourceHandle resource, uint32_t subresource_count, GpuResourceStates state)
+{
+	if (!subresource_count)
+		throw std::invalid_argument ("Resource must have subresources");
+	std::lock_guard<std::mutex> lock (mutex);
+	Resource &entry = resources[resource];
+	entry.states.assign (subresource_count, state);
+	entry.submission = 0;
+}
+
+void ResourceStateRegistry::Unregister (GpuResourceHandle resource)
+{
+	std::lock_guard<std::mutex> lock (mutex);
+	if (!resources.erase (resource))
+		throw std::logic_error ("Resource is not registered");
+}
+
+uint32_t ResourceStateRegistry::GetSubresourceCount (GpuResourceHandle resource) const
+{
+	std::lock_guard<std::mutex> lock (mutex);
+	auto entry = resources.find (resource);
+	if (entry == resources.end ())
+		throw std::invalid_argument ("Resource is not registered");
+	return static_cast<uint32_t>(entry->second.states.size ());
+}
+
+GpuResourceStates ResourceStateRegistry::GetState (GpuResourceHandle resource, uint32_t subresource) const
+{
+	std::lock_guard<std::mutex> lock (mutex);
+	auto entry = resources.find (resource);
+	if (entry == resources.end ())
+		throw std::invalid_argument ("Resource is not registered");
+	return entry->second.states.at (subresource);
+}
+
+size_t ResourceStateRegistry::GetResourceCount () const
+{
+	std::lock_guard<std::mutex> lock (mutex);
+	return resources.size ();
+}
+
+ResourceStateTracker::ResourceStateTracker (ResourceStateRegistry *state_registry) :
+	registry (state_registry),
+	open_splits (0)
+{
+	memset (&stats, 0, sizeof (stats));
+}
+
+void ResourceStateTracker::Reset ()
+{
+	lookup.clear ();
+	resources.clear ();
+	slots.clear ();
+	pending.clear ();
+	open_splits = 0;
+	memset (&stats, 0, sizeof (stats));
+}
+
+void ResourceStateTracker::Transition (GpuResourceHandle resource, GpuResourceStates state, uint32_t subresource)
+{
+	Resource &entry = Find (resource);
+	uint32_t begin, end;
+	CheckRange (entry, subresource, begin, end);
+	stats.transitions++;
+
+	scratch.clear ();
+	bool known = false;
+	for (uint32_t i = begin; i < end; i++)
+	{
+		GpuResourceStates *slot = &slots[entry.first_slot + i * SLOT_COUNT];
+		if (slot[SLOT_SPLIT] != gpu_resource_state_unknown)
+			throw std::logic_error ("Resource is in a split transition");
+		if (slot[SLOT_CURRENT] == gpu_resource_state_unknown)
+		{
+			//first use in the list, the barrier is left to Resolve ()
+			slot[SLOT_CURRENT] = slot[SLOT_INITIAL] = state;
+			continue;
+		}
+		known = true;
+		if (IsCompatible (slot[SLOT_CURRENT], state))
+			continue;
+		scratch.push_back (GpuTransition (resource, slot[SLOT_CURRENT], state, i));
+		slot[SLOT_CURRENT] = state;
+		slot[SLOT_CHANGED] = 1;
+	}
+	if (known && scratch.empty ())
+		stats.redundant++;
+	QueueBarriers (entry.subresource_count);
+}
+
+void ResourceStateTracker::BeginTransition (GpuResourceHandle resource, GpuResourceStates state, uint32_t subresource)
+{
+	Resource &entry = Find (resource);
+	uint32_t begin, end;
+	CheckRange (entry, subresource, begin, end);
+	stats.transitions++;
+
+	scratch.clear ();
+	for (uint32_t i = begin; i < end; i++)
+	{
+		GpuResourceStates *slot = &slots[entry.first_slot + i * SLOT_COUNT];
+		if (slot[SLOT_CURRENT] == gpu_resource_state_unknown)
+			throw std::logic_error ("Split transitions need a state known to the list, use Transition () first");
+		if (slot[SLOT_SPLIT] != gpu_resource_state_unknown)
+			throw std::logic_error ("Resource is in a split transition");
+		if (IsCompatible (slot[SLOT_CURRENT], state))
+			continue;
+		GpuBarrier barrier = GpuTransition (resource, slot[SLOT_CURRENT], state, i);
+		barrier.flags = GPU_BARRIER_FLAG_BEGIN_ONLY;
+		scratch.push_back (barrier);
+		slot[SLOT_SPLIT] = state;
+		slot[SLOT_CHANGED] = 1;
+		open_splits++;
+	}
+	if (scratch.empty ())
+		stats.redundant++;
+	QueueBarriers (entry.subresource_count);
+}
+
+void ResourceStateTracker::EndTransition (GpuResourceHandle resource, uint32_t subresource)
+{
+	Resource &entry = Find (resource);
+	uint32_t begin, end;
+	CheckRange (entry, subresource, begin, end);
+
+	scratch.clear ();
+	for (uint32_t i = begin; i < end; i++)
+	{
+		GpuResourceStates *slot = &slots[entry.first_slot + i * SLOT_COUNT];
+		if (slot[SLOT_SPLIT] == gpu_resource_state_unknown)
+			continue;
+		GpuBarrier barrier = GpuTransition (resource, slot[SLOT_CURRENT], slot[SLOT_SPLIT], i);
+		barrier.flags = GPU_BARRIER_FLAG_END_ONLY;
+		scratch.push_back (barrier);
+		slot[SLOT_CURRENT] = slot[SLOT_SPLIT];
+		slot[SLOT_SPLIT] = gpu_resource_state_unknown;
+		open_splits--;
+	}
+	QueueBarriers (entry.subresource_count);
+}
+
+void ResourceStateTracker::FlushBarriers (GpuCommandList *command_list)
+{
+	if (pending.empty ())
+		return;
+	command_list->ResourceBarrier (static_cast<uint32_t>(pending.size ()), pending.data ());
+	stats.barriers += pending.size ();
+	stats.batches++;
+	if (pending.size () > stats.max_batch)
+		stats.max_batch = pending.size ();
+	pending.clear ();
+}
+
+void ResourceStateTracker::Resolve (uint64_t submission, std::vector<GpuBarrier> &hoisted, std::vector<GpuBarrier> &fixups)
+{
+	if (!pending.empty ())
+		throw std::logic_error ("Queued barriers were not flushed");
+	if (open_splits)
+		throw std::logic_error ("Split transition was not ended");
+
+	std::lock_guard<std::mutex> lock (registry->mutex);
+	for (const Resource &entry : resources)
+	{
+		auto found = registry->resources.find (entry.handle);
+		if (found == registry->resources.end ())
+			throw std::logic_error ("Resource was unregistered while in use");
+		ResourceStateRegistry::Resource &global = found->second;
+
+		//an earlier list of the submission may leave the resource in another state
+		std::vector<GpuBarrier> &target = global.submission == submission ? fixups : hoisted;
+		const size_t begin = target.size ();
+		for (uint32_t i = 0; i < entry.subresource_count; i++)
+		{
+			const GpuResourceStates *slot = &slots[entry.first_slot + i * SLOT_COUNT];
+			if (slot[SLOT_INITIAL] == gpu_resource_state_unknown)
+				continue;
+			//a combined read state the list only read from stays as it is; barriers
+			//recorded in the list need the exact state they start from
+			if (!slot[SLOT_CHANGED] && IsCompatible (global.states[i], slot[SLOT_INITIAL]))
+				continue;
+			if (global.states[i] != slot[SLOT_INITIAL])
+				target.push_back (GpuTransition (entry.handle, global.states[i], slot[SLOT_INITIAL], i));
+			global.states[i] = slot[SLOT_CURRENT];
+		}
+		stats.fixups += target.size () - begin;
+		Collapse (target, begin, entry.subresource_count);
+		global.submission = submission;
+	}
+}
+
+ResourceStateTracker::Resource &ResourceStateTracker::Find (GpuResourceHandle resource)
+{
+	auto found = lookup.find (resource);
+	if (found != lookup.end ())
+		return resources[found->second];
+
+	Resource entry;
+	entry.handle = resource;
+	entry.subresource_count = registry->GetSubresourceCount (resource);
+	entry.first_slot = static_cast<uint32_t>(slots.size ());
+	slots.resize (slots.size () + entry.subresource_count * SLOT_COUNT, gpu_resource_state_unknown);
+	for (uint32_t i = 0; i < entry.subresource_count; i++)
+		slots[entry.first_slot + i * SLOT_COUNT + SLOT_CHANGED] = 0;
+	lookup.emplace (resource, static_cast<uint32_t>(resources.size ()));
+	resources.push_back (entry);
+	return resources.back ();
+}
+
+void ResourceStateTracker::CheckRange (const Resource &resource, uint32_t subresource, uint32_t &begin, uint32_t &end) const
+{
+	if (subresource == gpu_all_subresources)
+	{
+		begin = 0;
+		end = resource.subresource_count;
+		return;
+	}
+	if (subresource >= resource.subresource_count)
+		throw std::out_of_range ("Subresource index is out of range");
+	begin = subresource;
+	end = subresource + 1;
+}
+
+void ResourceStateTracker::QueueBarriers (uint32_t subresource_count)
+{
+	Collapse (scratch, 0, subresource_count);
+	for (size_t i = 0; i < scratch.size (); i++)
+	{
+		const GpuBarrier &barrier = scratch[i];
+		//a second transition of the same subresource before the flush extends the first one
+		bool merged = false;
+		if (barrier.flags == GPU_BARRIER_FLAG_NONE)
+			for (size_t j = pending.size (); j-- > 0;)
+			{
+				GpuBarrier &queued = pending[j];
+				if (queued.resource != barrier.resource)
+					continue;
+				if (queued.type == GPU_BARRIER_TYPE_TRANSITION && queued.subresource == barrier.subresource && queued.flags == GPU_BARRIER_FLAG_NONE)
+				{
+					queued.state_after = barrier.state_after;
+					if (queued.state_before == queued.state_after)
+						pending.erase (pending.begin () + j);
+					merged = true;
+				}
+				//other barriers of the resource keep their order
+				break;
+			}
+		if (!merged)
+			pending.push_back (barrier);
+	}
+}
@@ -0,0 +1,108 @@
+#pragma once
+#include "gpu_device.h"
+
+#include <stdint.h>
+
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+//Automatic resource state tracking. The registry keeps the state every resource is in
+//between command lists; a tracker follows the states inside one list while it is
+//recorded. A resource is not known to the tracker until its first use, so that use
+//only records the state the list expects it in; the difference to the registry is
+//resolved with extra barriers when the lists are submitted in order.
+
+//state of subresources the tracker has not seen yet
+static const GpuResourceStates gpu_resource_state_unknown = 0xffffffff;
+
+struct ResourceStateStats
+{
+	uint64_t transitions;    //requested state changes
+	uint64_t redundant;      //dropped, the resource already was in a matching state
+	uint64_t barriers;       //recorded into command lists, fixups excluded
+	uint64_t batches;        //ResourceBarrier calls
+	uint64_t max_batch;
+	uint64_t fixups;         //barriers resolved at submit
+};
+
+class ResourceStateRegistry
+{
+public:
+	//subresource_count is the number of mips times array slices times planes
+	void Register (GpuResourceHandle resource, uint32_t subresource_count, GpuResourceStates state);
+	void Unregister (GpuResourceHandle resource);
+
+	uint32_t GetSubresourceCount (GpuResourceHandle resource) const;
+	GpuResourceStates GetState (GpuResourceHandle resource, uint32_t subresource = 0) const;
+	size_t GetResourceCount () const;
+private:
+	friend class ResourceStateTracker;
+
+	struct Resource
+	{
+		std::vector<GpuResourceStates> states;
+		uint64_t submission;    //last submission with a list that used the resource
+	};
+
+	mutable std::mutex mutex;
+	std::unordered_map<GpuResourceHandle, Resource> resources;
+};
+
+//per command list tracker; not thread-safe, every list being recorded has its own
+class ResourceStateTracker
+{
+public:
+	explicit ResourceStateTracker (ResourceStateRegistry *registry);
+
+	//forgets all states, for a list that is recorded anew
+	void Reset ();
+
+	//queues a transition into the state; redundant transitions are dropped and repeated
+	//transitions of a resource between two flushes collapse into one barrier
+	void Transition (GpuResourceHandle resource, GpuResourceStates state, uint32_t subresource = gpu_all_subresources);
+	//split barrier: the GPU may start the transition at the next flush and must finish it at
+	//the flush after EndTransition (); the resource can not be used in between
+	void BeginTransition (GpuResourceHandle resource, GpuResourceStates state, uint32_t subresource = gpu_all_subresources);
+	void EndTransition (GpuResourceHandle resource, uint32_t subresource = gpu_all_subresources);
+	//records all queued barriers with one ResourceBarrier call; call before the commands
+	//that use the resources
+	void FlushBarriers (GpuCommandList *command_list);
+
+	//called at submit for the lists in execution order. Adds the barriers that bring the
+	//resources into the states this list starts with and writes the final states to the
+	//registry. Barriers of resources no earlier list of the same submission touched go to
+	//hoisted, which may run before all lists of the submission; the rest to fixups, which
+	//must run right before this list.
+	void Resolve (uint64_t submission, std::vector<GpuBarrier> &hoisted, std::vector<GpuBarrier> &fixups);
+
+	const ResourceStateStats &GetStats () const
+	{
+		return stats;
+	}
+private:
+	//the states of subresource i are at first_slot + i * SLOT_COUNT
+	struct Resource
+	{
+		GpuResourceHandle handle;
+		uint32_t subresource_count;
+		uint32_t first_slot;
+	};
+
+	ResourceStateTracker (const ResourceStateTracker &) = delete;
+	ResourceStateTracker &operator= (const ResourceStateTracker &) = delete;
+
+	Resource &Find (GpuResourceHandle resource);
+	void CheckRange (const Resource &resource, uint32_t subresource, uint32_t &begin, uint32_t &end) const;
+	//moves the barriers in scratch to the pending batch
+	void QueueBarriers (uint32_t subresource_count);
+
+	ResourceStateRegistry *registry;
+	std::unordered_map<GpuResourceHandle, uint32_t> lookup;
+	std::vector<Resource> resources;
+	std::vector<GpuResourceStates> slots;
+	std::vector<GpuBarrier> pending;
+	std::vector<GpuBarrier> scratch;
+	uint32_t open_splits;
+	ResourceStateStats stats;
+};
@@ -0,0 +1,94 @@
+#include "root_signature.h"
+#include "pipeline_cache.h"
+
+#include <string.h>
+#include <stdexcept>
+
+void NormalizeRootSignatureDesc (RootSignatureDesc &desc)
+{
+	if (desc.parameter_count > root_max_parameters)
+		throw std::invalid_argument ("Root signature has too many parameters");
+	if (desc.static_sampler_count > root_max_static_samplers)
+		throw std::invalid_argument ("Root signature has too many static samplers");
+
+	for (uint32_t i = 0; i < desc.parameter_count; i++)
+	{
+		RootParameter &parameter = desc.parameters[i];
+		if (parameter.type == ROOT_PARAMETER_TABLE)
+		{
+			if (parameter.range_count == 0 || parameter.range_count > root_max_ranges)
+				throw std::invalid_argument ("Root descriptor table has no or too many ranges");
+			parameter.shader_register = 0;
+			parameter.space = 0;
+			parameter.constant_count = 0;
+			memset (parameter.ranges + parameter.range_count, 0, (root_max_ranges - parameter.range_count) * sizeof (RootDescriptorRange));
+			continue;
+		}
+		if (parameter.type != ROOT_PARAMETER_CONSTANTS)
+			parameter.constant_count = 0;
+		parameter.range_count = 0;
+		memset (parameter.ranges, 0, sizeof (parameter.ranges));
+	}
+	memset (desc.parameters + desc.parameter_count, 0, (root_max_parameters - desc.parameter_count) * sizeof (RootParameter));
+	memset (desc.static_samplers + desc.static_sampler_count, 0,
+			(root_max_static_samplers - desc.static_sampler_count) * sizeof (RootStaticSampler));
+}
+
+uint64_t HashRootSignatureDesc (const RootSignatureDesc &desc)
+{
+	//every field is 32 bits, so the structures have no padding to skip
+	uint64_t hash = PipelineHash (&desc.flags, sizeof (desc.flags));
+	hash = PipelineHash (&desc.parameter_count, sizeof (desc.parameter_count), hash);
+	hash = PipelineHash (desc.parameters, desc.parameter_count * sizeof (RootParameter), hash);
+	hash = PipelineHash (&desc.static_sampler_count, sizeof (desc.static_sampler_count), hash);
+	return PipelineHash (desc.static_samplers, desc.static_sampler_count * sizeof (RootStaticSampler), hash);
+}
+
+RootSignatureCache::RootSignatureCache (RootSignatureBackend *root_signature_backend) :
+	backend (root_signature_backend),
+	count (0)
+{
+	memset (&stats, 0, sizeof (stats));
+}
+
+RootSignatureCache::~RootSignatureCache ()
+{
+	for (auto &bucket : entries)
+		for (const Entry &entry : bucket.second)
+			backend->DestroyRootSignature (entry.root_signature.handle);
+}
+
+RootSignature RootSignatureCache::Get (const RootSignatureDesc &desc)
+{
+	RootSignatureDesc normalized = desc;
+	NormalizeRootSignatureDesc (normalized);
+	const uint64_t hash = HashRootSignatureDesc (normalized);
+
+	std::lock_guard<std::mutex> lock (mutex);
+	stats.lookups++;
+	std::vector<Entry> &bucket = entries[hash];
+	for (const Entry &entry : bucket)
+		if (memcmp (&entry.desc, &normalized, sizeof (RootSignatureDesc)) == 0)
+			return entry.root_signature;
+
+	//creation is rare, every layout is created once at startup
+	Entry entry;
+	entry.desc = normalized;
+	entry.root_signature = backend->CreateRootSignature (normalized);
+	bucket.push_back (entry);
+	count++;
+	stats.creations++;
+	return entry.root_signature;
+}
+
+uint32_t RootSignatureCache::GetCount () const
+{
+	std::lock_guard<std::mutex> lock (mutex);
+	return count;
+}
+
+RootSignatureCacheStats RootSignatureCache::GetStats () const
+{
+	std::lock_guard<std::mutex> lock (mutex);
+	return stats;
+}
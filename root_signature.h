@@ -0,0 +1,140 @@
+#pragma once
+#include "gpu_device.h"
+
+#include <stdint.h>
+
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+//Root signature cache. Layouts are described backend-neutrally, normalized so fields
+//the parameter type ignores do not matter, and keyed by a hash of the result; every
+//distinct layout is serialized and created once and shared by all users.
+
+//values of the type, visibility, filter and flag fields are the D3D12 enumeration values
+
+static const uint32_t root_max_parameters = 16;
+static const uint32_t root_max_ranges = 4;
+static const uint32_t root_max_static_samplers = 8;
+//descriptor count of a range that extends to the end of the heap
+static const uint32_t root_unbounded_range = 0xffffffff;
+
+enum RootParameterType
+{
+	ROOT_PARAMETER_TABLE = 0,
+	ROOT_PARAMETER_CONSTANTS = 1,
+	ROOT_PARAMETER_CBV = 2,
+	ROOT_PARAMETER_SRV = 3,
+	ROOT_PARAMETER_UAV = 4
+};
+
+enum RootRangeType
+{
+	ROOT_RANGE_SRV = 0,
+	ROOT_RANGE_UAV = 1,
+	ROOT_RANGE_CBV = 2,
+	ROOT_RANGE_SAMPLER = 3
+};
+
+struct RootDescriptorRange
+{
+	uint32_t type;              //RootRangeType
+	uint32_t count;
+	uint32_t base_register;
+	uint32_t space;
+	uint32_t offset;            //descriptors from the start of the table
+};
+
+struct RootParameter
+{
+	uint32_t type;              //RootParameterType
+	uint32_t visibility;
+	uint32_t shader_register;   //constants and root descriptors
+	uint32_t space;
+	uint32_t constant_count;    //32 bit values of constants
+	uint32_t range_count;       //tables
+	RootDescriptorRange ranges[root_max_ranges];
+};
+
+struct RootStaticSampler
+{
+	uint32_t filter;
+	uint32_t address_u;
+	uint32_t address_v;
+	uint32_t address_w;
+	float mip_lod_bias;
+	uint32_t max_anisotropy;
+	uint32_t comparison_func;
+	uint32_t border_color;
+	float min_lod;
+	float max_lod;
+	uint32_t shader_register;
+	uint32_t space;
+	uint32_t visibility;
+};
+
+struct RootSignatureDesc
+{
+	uint32_t flags;
+	uint32_t parameter_count;
+	RootParameter parameters[root_max_parameters];
+	uint32_t static_sampler_count;
+	RootStaticSampler static_samplers[root_max_static_samplers];
+};
+
+//zeroes the fields a parameter type ignores and everything past the counts.
+//Throws std::invalid_argument if a count is out of range.
+void NormalizeRootSignatureDesc (RootSignatureDesc &desc);
+//of a normalized description, the same on every platform
+uint64_t HashRootSignatureDesc (const RootSignatureDesc &desc);
+
+struct RootSignature
+{
+	GpuRootSignatureHandle handle;
+	uint64_t key;               //hash of the serialized blob, the root_signature_key of pipeline requests
+};
+
+class RootSignatureBackend
+{
+public:
+	virtual ~RootSignatureBackend () {}
+	//desc is normalized
+	virtual RootSignature CreateRootSignature (const RootSignatureDesc &desc) = 0;
+	virtual void DestroyRootSignature (GpuRootSignatureHandle root_signature) = 0;
+};
+
+struct RootSignatureCacheStats
+{
+	uint64_t lookups;
+	uint64_t creations;
+};
+
+class RootSignatureCache
+{
+public:
+	explicit RootSignatureCache (RootSignatureBackend *backend);
+	//destroys every root signature; they must no longer be in use
+	~RootSignatureCache ();
+
+	//creates the root signature on first use; thread-safe
+	RootSignature Get (const RootSignatureDesc &desc);
+
+	uint32_t GetCount () const;
+	RootSignatureCacheStats GetStats () const;
+private:
+	struct Entry
+	{
+		RootSignatureDesc desc;
+		RootSignature root_signature;
+	};
+
+	RootSignatureCache (const RootSignatureCache &) = delete;
+	RootSignatureCache &operator= (const RootSignatureCache &) = delete;
+
+	RootSignatureBackend *backend;
+	mutable std::mutex mutex;
+	//entries with the same hash are told apart by their description
+	std::unordered_map<uint64_t, std::vector<Entry>> entries;
+	uint32_t count;
+	RootSignatureCacheStats stats;
+};
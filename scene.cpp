@@ -0,0 +1,413 @@
+#include "scene.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#if defined(_M_X64) || defined(__x86_64__)
+//SSE2 is part of x64, so no detection is needed
+#define SCENE_X64
+#include <immintrin.h>
+#endif
+
+static const uint32_t scene_no_parent = 0xffffffff;
+static const uint32_t scene_no_slot = 0xffffffff;
+//changes above one in this many nodes are found by flags instead of sorting
+static const uint32_t scene_dense_dirty_ratio = 64;
+
+SceneTransform MakeIdentityTransform ()
+{
+	const SceneTransform transform = { { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f, 1.0f }, { 1.0f, 1.0f, 1.0f } };
+	return transform;
+}
+
+static SceneMatrix MakeIdentityMatrix ()
+{
+	SceneMatrix matrix = {};
+	matrix.m[0] = matrix.m[5] = matrix.m[10] = matrix.m[15] = 1.0f;
+	return matrix;
+}
+
+Scene::Scene () : free_slot (scene_no_slot), live_count (0), dead_nodes (0), order_changed (false)
+{
+	stats = SceneUpdateStats ();
+}
+
+uint32_t Scene::GetSlot (SceneEntity entity) const
+{
+	const uint32_t slot = static_cast<uint32_t>(entity);
+	if (slot >= slots.size () || !slots[slot].alive || slots[slot].generation != static_cast<uint32_t>(entity >> 32))
+		throw std::invalid_argument ("Scene entity is destroyed");
+	return slot;
+}
+
+bool Scene::IsAlive (SceneEntity entity) const
+{
+	const uint32_t slot = static_cast<uint32_t>(entity);
+	return slot < slots.size () && slots[slot].alive && slots[slot].generation == static_cast<uint32_t>(entity >> 32);
+}
+
+void Scene::MarkDirty (uint32_t slot)
+{
+	if (slots[slot].dirty)
+		return;
+	slots[slot].dirty = true;
+	dirty_slots.push_back (slot);
+}
+
+SceneEntity Scene::Create (SceneEntity parent, const SceneTransform &local)
+{
+	const uint32_t parent_node = parent == scene_invalid_entity ? scene_no_parent : slots[GetSlot (parent)].node;
+
+	uint32_t slot = free_slot;
+	if (slot == scene_no_slot)
+	{
+		slot = static_cast<uint32_t>(slots.size ());
+		slots.push_back (Slot ());
+		slots[slot].generation = 1;
+	}
+	else
+		free_slot = slots[slot].node;
+	const uint32_t node = static_cast<uint32_t>(world.size ());
+	slots[slot].node = node;
+	slots[slot].alive = true;
+	slots[slot].dirty = false;
+
+	node_slots.push_back (slot);
+	parents.push_back (parent_node);
+	subtree_sizes.push_back (1);
+	translation_x.push_back (local.translation[0]);
+	translation_y.push_back (local.translation[1]);
+	translation_z.push_back (local.translation[2]);
+	rotation_x.push_back (local.rotation[0]);
+	rotation_y.push_back (local.rotation[1]);
+	rotation_z.push_back (local.rotation[2]);
+	rotation_w.push_back (local.rotation[3]);
+	scale_x.push_back (local.scale[0]);
+	scale_y.push_back (local.scale[1]);
+	scale_z.push_back (local.scale[2]);
+	world.push_back (MakeIdentityMatrix ());
+
+	//roots and children of the last subtree extend the depth-first order; other children
+	//need a reorder
+	if (parent_node != scene_no_parent && !order_changed)
+	{
+		if (parent_node + subtree_sizes[parent_node] == node)
+			for (uint32_t ancestor = parent_node; ancestor != scene_no_parent; ancestor = parents[ancestor])
+				subtree_sizes[ancestor]++;
+		else
+			order_changed = true;
+	}
+	live_count++;
+	MarkDirty (slot);
+	return MakeEntity (slot);
+}
+
+void Scene::Destroy (SceneEntity entity)
+{
+	const uint32_t slot = GetSlot (entity);
+	if (order_changed)
+		Reorder ();
+
+	//the subtree stays in the arrays with its slots cleared until the next reorder
+	const uint32_t node = slots[slot].node;
+	const uint32_t end = node + subtree_sizes[node];
+	for (uint32_t i = node; i < end; i++)
+	{
+		const uint32_t dead_slot = node_slots[i];
+		if (dead_slot == scene_no_slot)
+			continue;
+		Slot &dead = slots[dead_slot];
+		dead.alive = false;
+		dead.dirty = false;
+		dead.generation = dead.generation == 0xffffffff ? 1 : dead.generation + 1;
+		dead.node = free_slot;
+		free_slot = dead_slot;
+		node_slots[i] = scene_no_slot;
+		live_count--;
+		dead_nodes++;
+	}
+}
+
+void Scene::SetParent (SceneEntity entity, SceneEntity parent)
+{
+	const uint32_t slot = GetSlot (entity);
+	const uint32_t node = slots[slot].node;
+	const uint32_t parent_node = parent == scene_invalid_entity ? scene_no_parent : slots[GetSlot (parent)].node;
+	if (parent_node == parents[node])
+		return;
+	for (uint32_t ancestor = parent_node; ancestor != scene_no_parent; ancestor = parents[ancestor])
+		if (ancestor == node)
+			throw std::invalid_argument ("Scene entity can not be parented to its own subtree");
+	parents[node] = parent_node;
+	order_changed = true;
+	MarkDirty (slot);
+}
+
+SceneEntity Scene::GetParent (SceneEntity entity) const
+{
+	const uint32_t parent_node = parents[slots[GetSlot (entity)].node];
+	return parent_node == scene_no_parent ? scene_invalid_entity : MakeEntity (node_slots[parent_node]);
+}
+
+void Scene::SetLocalTransform (SceneEntity entity, const SceneTransform &local)
+{
+	const uint32_t slot = GetSlot (entity);
+	const uint32_t node = slots[slot].node;
+	translation_x[node] = local.translation[0];
+	translation_y[node] = local.translation[1];
+	translation_z[node] = local.translation[2];
+	rotation_x[node] = local.rotation[0];
+	rotation_y[node] = local.rotation[1];
+	rotation_z[node] = local.rotation[2];
+	rotation_w[node] = local.rotation[3];
+	scale_x[node] = local.scale[0];
+	scale_y[node] = local.scale[1];
+	scale_z[node] = local.scale[2];
+	MarkDirty (slot);
+}
+
+SceneTransform Scene::GetLocalTransform (SceneEntity entity) const
+{
+	const uint32_t node = slots[GetSlot (entity)].node;
+	const SceneTransform local =
+	{
+		{ translation_x[node], translation_y[node], translation_z[node] },
+		{ rotation_x[node], rotation_y[node], rotation_z[node], rotation_w[node] },
+		{ scale_x[node], scale_y[node], scale_z[node] }
+	};
+	return local;
+}
+
+const SceneMatrix &Scene::GetWorldMatrix (SceneEntity entity) const
+{
+	return world[slots[GetSlot (entity)].node];
+}
+
+SceneEntity Scene::GetNodeEntity (uint32_t node) const
+{
+	if (node >= node_slots.size ())
+		throw std::out_of_range ("Scene node out of range");
+	return node_slots[node] == scene_no_slot ? scene_invalid_entity : MakeEntity (node_slots[node]);
+}
+
+void Scene::Reorder ()
+{
+	const uint32_t node_count = static_cast<uint32_t>(world.size ());
+	//children lists of the live nodes, in dense order
+	std::vector<uint32_t> first_child (node_count, scene_no_parent);
+	std::vector<uint32_t> next_sibling (node_count, scene_no_parent);
+	for (uint32_t i = node_count; i-- > 0;)
+		if (node_slots[i] != scene_no_slot && parents[i] != scene_no_parent)
+		{
+			next_sibling[i] = first_child[parents[i]];
+			first_child[parents[i]] = i;
+		}
+
+	//depth-first walk from every root; order lists the old positions in the new order
+	std::vector<uint32_t> order;
+	order.reserve (live_count);
+	for (uint32_t root = 0; root < node_count; root++)
+	{
+		if (node_slots[root] == scene_no_slot || parents[root] != scene_no_parent)
+			continue;
+		uint32_t node = root;
+		for (;;)
+		{
+			order.push_back (node);
+			if (first_child[node] != scene_no_parent)
+			{
+				node = first_child[node];
+				continue;
+			}
+			while (node != root && next_sibling[node] == scene_no_parent)
+				node = parents[node];
+			if (node == root)
+				break;
+			node = next_sibling[node];
+		}
+	}
+
+	const uint32_t live_nodes = static_cast<uint32_t>(order.size ());
+	std::vector<uint32_t> new_nodes (node_count, scene_no_parent);
+	for (uint32_t i = 0; i < live_nodes; i++)
+		new_nodes[order[i]] = i;
+
+	std::vector<float> reordered (live_nodes);
+	std::vector<float> *streams[] =
+	{
+		&translation_x, &translation_y, &translation_z, &rotation_x, &rotation_y, &rotation_z, &rotation_w, &scale_x, &scale_y, &scale_z
+	};
+	for (std::vector<float> *stream : streams)
+	{
+		for (uint32_t i = 0; i < live_nodes; i++)
+			reordered[i] = (*stream)[order[i]];
+		stream->assign (reordered.begin (), reordered.end ());
+	}
+	std::vector<SceneMatrix> reordered_world (live_nodes);
+	std::vector<uint32_t> reordered_slots (live_nodes);
+	std::vector<uint32_t> reordered_parents (live_nodes);
+	for (uint32_t i = 0; i < live_nodes; i++)
+	{
+		reordered_world[i] = world[order[i]];
+		reordered_slots[i] = node_slots[order[i]];
+		const uint32_t parent = parents[order[i]];
+		reordered_parents[i] = parent == scene_no_parent ? scene_no_parent : new_nodes[parent];
+		slots[reordered_slots[i]].node = i;
+	}
+	world.swap (reordered_world);
+	node_slots.swap (reordered_slots);
+	parents.swap (reordered_parents);
+
+	//children come after their parents
+	subtree_sizes.assign (live_nodes, 1);
+	for (uint32_t i = live_nodes; i-- > 0;)
+		if (parents[i] != scene_no_parent)
+			subtree_sizes[parents[i]] += subtree_sizes[i];
+
+	dead_nodes = 0;
+	order_changed = false;
+}
+
+void Scene::UpdateSubtree (const Subtree &subtree)
+{
+	for (uint32_t i = subtree.first; i < subtree.first + subtree.count; i++)
+	{
+		//rows of rotation times scale, from the quaternion as XMMatrixRotationQuaternion does
+		const float x = rotation_x[i], y = rotation_y[i], z = rotation_z[i], w = rotation_w[i];
+		const float xx = x * x, yy = y * y, zz = z * z;
+		const float xy = x * y, xz = x * z, yz = y * z, wx = w * x, wy = w * y, wz = w * z;
+		const float sx = scale_x[i], sy = scale_y[i], sz = scale_z[i];
+		const float local[12] =
+		{
+			(1.0f - 2.0f * (yy + zz)) * sx, 2.0f * (xy + wz) * sx, 2.0f * (xz - wy) * sx,
+			2.0f * (xy - wz) * sy, (1.0f - 2.0f * (xx + zz)) * sy, 2.0f * (yz + wx) * sy,
+			2.0f * (xz + wy) * sz, 2.0f * (yz - wx) * sz, (1.0f - 2.0f * (xx + yy)) * sz,
+			translation_x[i], translation_y[i], translation_z[i]
+		};
+
+		float *out = world[i].m;
+		const uint32_t parent = parents[i];
+		if (parent == scene_no_parent)
+		{
+			for (uint32_t row = 0; row < 4; row++)
+			{
+				out[row * 4 + 0] = local[row * 3 + 0];
+				out[row * 4 + 1] = local[row * 3 + 1];
+				out[row * 4 + 2] = local[row * 3 + 2];
+				out[row * 4 + 3] = row == 3 ? 1.0f : 0.0f;
+			}
+			continue;
+		}
+
+		//world = local * parent world; the local matrix has a last column of 0 0 0 1
+		const float *p = world[parent].m;
+#ifdef SCENE_X64
+		const __m128 p0 = _mm_loadu_ps (p), p1 = _mm_loadu_ps (p + 4), p2 = _mm_loadu_ps (p + 8), p3 = _mm_loadu_ps (p + 12);
+		for (uint32_t row = 0; row < 4; row++)
+		{
+			__m128 value = _mm_add_ps (_mm_add_ps (_mm_mul_ps (_mm_set1_ps (local[row * 3 + 0]), p0),
+												   _mm_mul_ps (_mm_set1_ps (local[row * 3 + 1]), p1)),
+									   _mm_mul_ps (_mm_set1_ps (local[row * 3 + 2]), p2));
+			if (row == 3)
+				value = _mm_add_ps (value, p3);
+			_mm_storeu_ps (out + row * 4, value);
+		}
+#else
+		for (uint32_t row = 0; row < 4; row++)
+			for (uint32_t c = 0; c < 4; c++)
+				out[row * 4 + c] = local[row * 3 + 0] * p[c] + local[row * 3 + 1] * p[4 + c] + local[row * 3 + 2] * p[8 + c] +
+								   (row == 3 ? p[12 + c] : 0.0f);
+#endif
+	}
+}
+
+void Scene::Update (JobSystem *job_system)
+{
+	stats = SceneUpdateStats ();
+	stats.dirty_entities = static_cast<uint32_t>(dirty_slots.size ());
+	if (order_changed || dead_nodes > 0)
+	{
+		Reorder ();
+		stats.reordered = true;
+	}
+
+	//positions of the changed nodes; a slot may be listed twice if it was destroyed and reused
+	uint32_t dirty_count = 0;
+	for (uint32_t slot : dirty_slots)
+		if (slots[slot].alive && slots[slot].dirty)
+		{
+			slots[slot].dirty = false;
+			dirty_slots[dirty_count++] = slots[slot].node;
+		}
+	//changed nodes inside the subtree of another one are covered by it. Few changes are
+	//sorted, many are flagged and found by a pass over the nodes.
+	subtrees.clear ();
+	const uint32_t node_count = static_cast<uint32_t>(world.size ());
+	if (dirty_count > node_count / scene_dense_dirty_ratio)
+	{
+		dirty_nodes.assign (node_count, 0);
+		for (uint32_t i = 0; i < dirty_count; i++)
+			dirty_nodes[dirty_slots[i]] = 1;
+		for (uint32_t node = 0; node < node_count;)
+			if (dirty_nodes[node])
+			{
+				const Subtree subtree = { node, subtree_sizes[node] };
+				subtrees.push_back (subtree);
+				node += subtree.count;
+			}
+			else
+				node++;
+	}
+	else
+	{
+		std::sort (dirty_slots.begin (), dirty_slots.begin () + dirty_count);
+		uint32_t covered_end = 0;
+		for (uint32_t i = 0; i < dirty_count; i++)
+		{
+			const uint32_t node = dirty_slots[i];
+			if (node < covered_end)
+				continue;
+			const Subtree subtree = { node, subtree_sizes[node] };
+			subtrees.push_back (subtree);
+			covered_end = node + subtree.count;
+		}
+	}
+	for (const Subtree &subtree : subtrees)
+		stats.updated_nodes += subtree.count;
+	dirty_slots.clear ();
+	stats.updated_subtrees = static_cast<uint32_t>(subtrees.size ());
+
+	if (!job_system || stats.updated_nodes <= scene_job_size)
+	{
+		for (const Subtree &subtree : subtrees)
+			UpdateSubtree (subtree);
+		return;
+	}
+
+	//split large subtrees into their child subtrees after updating the root, which they
+	//all read; deep chains end up updated here node by node
+	for (size_t i = 0; i < subtrees.size ();)
+	{
+		const Subtree subtree = subtrees[i];
+		if (subtree.count <= scene_job_size)
+		{
+			i++;
+			continue;
+		}
+		const Subtree root = { subtree.first, 1 };
+		UpdateSubtree (root);
+		subtrees[i] = subtrees.back ();
+		subtrees.pop_back ();
+		const uint32_t end = subtree.first + subtree.count;
+		for (uint32_t child = subtree.first + 1; child < end; child += subtree_sizes[child])
+		{
+			const Subtree child_subtree = { child, subtree_sizes[child] };
+			subtrees.push_back (child_subtree);
+		}
+	}
+	job_system->ParallelFor (static_cast<uint32_t>(subtrees.size ()), 1, [this] (uint32_t begin, uint32_t end)
+	{
+		for (uint32_t i = begin; i < end; i++)
+			UpdateSubtree (subtrees[i]);
+	});
+}
@@ -0,0 +1,138 @@
+#pragma once
+#include "job_system.h"
+
+#include <stdint.h>
+
+#include <vector>
+
+//Transform hierarchy. Entities are generational handles to nodes stored densely in
+//depth-first order, so every subtree is a contiguous range behind its root and parents
+//come before their children. Local transforms are kept as structure of arrays; world
+//matrices are recomputed by Update () only for the subtrees of entities changed since the
+//last update, and independent subtrees are updated in parallel. Creating, destroying and
+//reparenting entities reorders the arrays once in the next update.
+
+//0 is never a live entity
+typedef uint64_t SceneEntity;
+static const SceneEntity scene_invalid_entity = 0;
+
+//subtrees up to this size are updated by one job
+static const uint32_t scene_job_size = 1024;
+
+struct SceneTransform
+{
+	float translation[3];
+	float rotation[4];          //unit quaternion, x y z w
+	float scale[3];
+};
+
+SceneTransform MakeIdentityTransform ();
+
+//row-major for row vectors, translation in the last row (the DirectXMath layout)
+struct alignas (16) SceneMatrix
+{
+	float m[16];
+};
+
+struct SceneUpdateStats
+{
+	uint32_t dirty_entities;
+	uint32_t updated_subtrees;
+	uint32_t updated_nodes;
+	bool reordered;
+};
+
+class Scene
+{
+public:
+	Scene ();
+
+	//parent may be scene_invalid_entity for a root.
+	//Functions taking entities throw std::invalid_argument for destroyed ones.
+	SceneEntity Create (SceneEntity parent, const SceneTransform &local);
+	//destroys the entity and its descendants
+	void Destroy (SceneEntity entity);
+	bool IsAlive (SceneEntity entity) const;
+	//throws std::invalid_argument if the parent is in the subtree of the entity
+	void SetParent (SceneEntity entity, SceneEntity parent);
+	SceneEntity GetParent (SceneEntity entity) const;
+
+	void SetLocalTransform (SceneEntity entity, const SceneTransform &local);
+	SceneTransform GetLocalTransform (SceneEntity entity) const;
+	//as of the last Update ()
+	const SceneMatrix &GetWorldMatrix (SceneEntity entity) const;
+
+	//recomputes the world matrices of changed subtrees; job_system may be null
+	void Update (JobSystem *job_system);
+
+	uint32_t GetEntityCount () const
+	{
+		return live_count;
+	}
+	//dense order of the last update, for systems iterating every entity
+	uint32_t GetNodeCount () const
+	{
+		return static_cast<uint32_t>(world.size ());
+	}
+	SceneEntity GetNodeEntity (uint32_t node) const;
+	const SceneMatrix *GetWorldMatrices () const
+	{
+		return world.data ();
+	}
+	const SceneUpdateStats &GetStats () const
+	{
+		return stats;
+	}
+private:
+	struct Slot
+	{
+		uint32_t generation;
+		uint32_t node;          //dense position, or the next free slot if dead
+		bool alive;
+		bool dirty;
+	};
+
+	//nodes [first, first + count) whose first node's parent is up to date
+	struct Subtree
+	{
+		uint32_t first;
+		uint32_t count;
+	};
+
+	uint32_t GetSlot (SceneEntity entity) const;
+	SceneEntity MakeEntity (uint32_t slot) const
+	{
+		return (static_cast<uint64_t>(slots[slot].generation) << 32) | slot;
+	}
+	void MarkDirty (uint32_t slot);
+	void Reorder ();
+	void UpdateSubtree (const Subtree &subtree);
+
+	std::vector<Slot> slots;
+	uint32_t free_slot;
+	uint32_t live_count;
+	uint32_t dead_nodes;        //destroyed nodes still in the arrays
+	bool order_changed;         //depth-first order and subtree sizes are outdated
+	std::vector<uint32_t> dirty_slots;
+
+	//by dense position
+	std::vector<uint32_t> node_slots;
+	std::vector<uint32_t> parents;          //dense position of the parent, all ones for roots
+	std::vector<uint32_t> subtree_sizes;    //including the node
+	std::vector<float> translation_x;
+	std::vector<float> translation_y;
+	std::vector<float> translation_z;
+	std::vector<float> rotation_x;
+	std::vector<float> rotation_y;
+	std::vector<float> rotation_z;
+	std::vector<float> rotation_w;
+	std::vector<float> scale_x;
+	std::vector<float> scale_y;
+	std::vector<float> scale_z;
+	std::vector<SceneMatrix> world;
+
+	//scratch of Update ()
+	std::vector<Subtree> subtrees;
+	std::vector<uint8_t> dirty_nodes;
+	SceneUpdateStats stats;
+};
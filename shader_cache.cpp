@@ -0,0 +1,475 @@
+#include "shader_cache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdexcept>
+
+struct ShaderCacheEntryHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t key_size;
+	uint32_t reserved;
+	uint64_t bytecode_size;
+	uint64_t checksum;    //of key and bytecode
+};
+
+static_assert (sizeof (ShaderCacheEntryHeader) == 32, "Cache entry header must not have padding");
+
+//64 bit FNV-1a
+static uint64_t HashBytes (const void *data, size_t size, uint64_t hash = 0xcbf29ce484222325ull)
+{
+	const uint8_t *bytes = static_cast<const uint8_t*>(data);
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 0x100000001b3ull;
+	}
+	return hash;
+}
+
+static bool ReadWholeFile (const std::string &path, std::string &contents)
+{
+	FILE *f = fopen (path.c_str (), "rb");
+	if (!f)
+		return false;
+	bool read = fseek (f, 0, SEEK_END) == 0;
+	const long size = read ? ftell (f) : -1;
+	read = size >= 0 && fseek (f, 0, SEEK_SET) == 0;
+	if (read)
+	{
+		contents.resize (static_cast<size_t>(size));
+		read = contents.empty () || fread (&contents[0], 1, contents.size (), f) == contents.size ();
+	}
+	fclose (f);
+	return read;
+}
+
+static bool IsAbsolutePath (const std::string &path)
+{
+	return (!path.empty () && (path[0] == '/' || path[0] == '\\')) || (path.size () > 1 && path[1] == ':');
+}
+
+//directory part including the separator, empty for a bare file name
+static std::string GetDirectory (const std::string &path)
+{
+	const size_t separator = path.find_last_of ("/\\");
+	return separator == std::string::npos ? std::string () : path.substr (0, separator + 1);
+}
+
+void ScanShaderIncludes (const std::string &source, std::vector<std::string> &names)
+{
+	names.clear ();
+	const size_t size = source.size ();
+	bool line_start = true;
+	size_t i = 0;
+	while (i < size)
+	{
+		const char c = source[i];
+		if (c == '\n')
+		{
+			line_start = true;
+			i++;
+			continue;
+		}
+		if (c == '/' && i + 1 < size && source[i + 1] == '/')
+		{
+			while (i < size && source[i] != '\n')
+				i++;
+			continue;
+		}
+		if (c == '/' && i + 1 < size && source[i + 1] == '*')
+		{
+			const size_t end = source.find ("*/", i + 2);
+			i = end == std::string::npos ? size : end + 2;
+			continue;
+		}
+		if (c == ' ' || c == '\t' || c == '\r')
+		{
+			i++;
+			continue;
+		}
+		if (c == '"')
+		{
+			//string literal, may hold comment markers
+			for (i++; i < size && source[i] != '"' && source[i] != '\n'; i++)
+				if (source[i] == '\\')
+					i++;
+			i++;
+			line_start = false;
+			continue;
+		}
+		if (c != '#' || !line_start)
+		{
+			line_start = false;
+			i++;
+			continue;
+		}
+
+		//directive
+		line_start = false;
+		for (i++; i < size && (source[i] == ' ' || source[i] == '\t'); i++);
+		if (source.compare (i, 7, "include") != 0)
+			continue;
+		for (i += 7; i < size && (source[i] == ' ' || source[i] == '\t'); i++);
+		if (i >= size || (source[i] != '"' && source[i] != '<'))
+			continue;
+		const char terminator = source[i] == '"' ? '"' : '>';
+		const size_t begin = i + 1;
+		size_t end = begin;
+		while (end < size && source[end] != terminator && source[end] != '\n')
+			end++;
+		if (end < size && source[end] == terminator && end > begin)
+			names.push_back (source.substr (begin, end - begin));
+		i = end + 1;
+	}
+}
+
+static void PutU32 (std::vector<uint8_t> &key, uint32_t value)
+{
+	for (uint32_t i = 0; i < 4; i++)
+		key.push_back (static_cast<uint8_t>(value >> (i * 8)));
+}
+
+static void PutU64 (std::vector<uint8_t> &key, uint64_t value)
+{
+	PutU32 (key, static_cast<uint32_t>(value));
+	PutU32 (key, static_cast<uint32_t>(value >> 32));
+}
+
+static void PutString (std::vector<uint8_t> &key, const std::string &value)
+{
+	PutU32 (key, static_cast<uint32_t>(value.size ()));
+	key.insert (key.end (), value.begin (), value.end ());
+}
+
+void BuildShaderKey (const ShaderRequest &request, const std::string &compiler_identity, const std::vector<ShaderSourceFile> &files, std::vector<uint8_t> &key)
+{
+	//files enter with their include names instead of their paths, so the cache survives moving the sources
+	key.clear ();
+	PutU32 (key, shader_cache_version);
+	PutString (key, compiler_identity);
+	PutString (key, request.entry_point);
+	PutString (key, request.target);
+	PutU32 (key, request.flags);
+	PutU32 (key, static_cast<uint32_t>(request.defines.size ()));
+	for (const ShaderDefine &define : request.defines)
+	{
+		PutString (key, define.name);
+		PutString (key, define.value);
+	}
+	PutU32 (key, static_cast<uint32_t>(files.size ()));
+	for (const ShaderSourceFile &file : files)
+	{
+		PutString (key, file.name);
+		PutU64 (key, file.hash);
+		PutU32 (key, static_cast<uint32_t>(file.includes.size ()));
+		for (const auto &include : file.includes)
+		{
+			PutString (key, include.first);
+			PutU32 (key, include.second);
+		}
+	}
+}
+
+void WriteShaderCacheEntry (const std::vector<uint8_t> &key, const std::vector<uint8_t> &bytecode, std::vector<uint8_t> &entry)
+{
+	ShaderCacheEntryHeader header;
+	header.magic = shader_cache_magic;
+	header.version = shader_cache_version;
+	header.key_size = static_cast<uint32_t>(key.size ());
+	header.reserved = 0;
+	header.bytecode_size = bytecode.size ();
+	header.checksum = HashBytes (bytecode.data (), bytecode.size (), HashBytes (key.data (), key.size ()));
+
+	entry.resize (sizeof (header) + key.size () + bytecode.size ());
+	memcpy (entry.data (), &header, sizeof (header));
+	if (!key.empty ())
+		memcpy (entry.data () + sizeof (header), key.data (), key.size ());
+	if (!bytecode.empty ())
+		memcpy (entry.data () + sizeof (header) + key.size (), bytecode.data (), bytecode.size ());
+}
+
+bool ReadShaderCacheEntry (const void *entry, size_t entry_size, const std::vector<uint8_t> &key, std::vector<uint8_t> &bytecode)
+{
+	ShaderCacheEntryHeader header;
+	if (entry_size < sizeof (header))
+		return false;
+	memcpy (&header, entry, sizeof (header));
+	if (header.magic != shader_cache_magic || header.version != shader_cache_version || header.key_size != key.size () ||
+		entry_size - sizeof (header) < key.size () || header.bytecode_size != entry_size - sizeof (header) - key.size ())
+		return false;
+
+	//a different key with the same hash is a miss
+	const uint8_t *bytes = static_cast<const uint8_t*>(entry) + sizeof (header);
+	if (!key.empty () && memcmp (bytes, key.data (), key.size ()) != 0)
+		return false;
+	bytes += key.size ();
+	const size_t bytecode_size = static_cast<size_t>(header.bytecode_size);
+	if (HashBytes (bytes, bytecode_size, HashBytes (key.data (), key.size ())) != header.checksum)
+		return false;
+	bytecode.assign (bytes, bytes + bytecode_size);
+	return true;
+}
+
+void ParseShaderManifest (const std::string &text, std::vector<ShaderRequest> &requests)
+{
+	requests.clear ();
+	size_t line_begin = 0;
+	for (uint32_t line_number = 1; line_begin < text.size (); line_number++)
+	{
+		size_t line_end = text.find ('\n', line_begin);
+		if (line_end == std::string::npos)
+			line_end = text.size ();
+		std::string line = text.substr (line_begin, line_end - line_begin);
+		line_begin = line_end + 1;
+		const size_t comment = line.find ('#');
+		if (comment != std::string::npos)
+			line.resize (comment);
+
+		std::vector<std::string> tokens;
+		size_t i = 0;
+		for (;;)
+		{
+			i = line.find_first_not_of (" \t\r", i);
+			if (i == std::string::npos)
+				break;
+			const size_t end = line.find_first_of (" \t\r", i);
+			tokens.push_back (line.substr (i, end == std::string::npos ? std::string::npos : end - i));
+			i = end;
+		}
+		if (tokens.empty ())
+			continue;
+		if (tokens.size () < 3)
+			throw std::invalid_argument ("Shader manifest line " + std::to_string (line_number) + " needs a file, an entry point and a target");
+
+		ShaderRequest request;
+		request.file = tokens[0];
+		request.entry_point = tokens[1];
+		request.target = tokens[2];
+		request.flags = 0;
+		size_t token = 3;
+		if (token < tokens.size () && tokens[token][0] >= '0' && tokens[token][0] <= '9')
+		{
+			char *end;
+			request.flags = static_cast<uint32_t>(strtoul (tokens[token].c_str (), &end, 0));
+			if (*end)
+				throw std::invalid_argument ("Shader manifest line " + std::to_string (line_number) + " has invalid flags");
+			token++;
+		}
+		for (; token < tokens.size (); token++)
+		{
+			ShaderDefine define;
+			const size_t equals = tokens[token].find ('=');
+			define.name = tokens[token].substr (0, equals);
+			define.value = equals == std::string::npos ? "1" : tokens[token].substr (equals + 1);
+			if (define.name.empty ())
+				throw std::invalid_argument ("Shader manifest line " + std::to_string (line_number) + " has a define without a name");
+			request.defines.push_back (define);
+		}
+		requests.push_back (request);
+	}
+}
+
+ShaderCache::ShaderCache (ShaderCompiler *shader_compiler, const std::string &cache_directory, const std::vector<std::string> &include_dirs) :
+	compiler (shader_compiler),
+	identity (shader_compiler->GetIdentity ()),
+	directory (cache_directory),
+	include_directories (include_dirs),
+	requests (0),
+	hits (0),
+	compiled (0),
+	failed (0),
+	store_failures (0),
+	temp_counter (0)
+{
+	if (!directory.empty () && directory.back () != '/' && directory.back () != '\\')
+		directory += '/';
+	for (std::string &include_directory : include_directories)
+		if (!include_directory.empty () && include_directory.back () != '/' && include_directory.back () != '\\')
+			include_directory += '/';
+}
+
+void ShaderCache::Build (const ShaderRequest *shader_requests, size_t count, JobSystem *jobs, ShaderResult *results)
+{
+	std::lock_guard<std::mutex> lock (build_mutex);
+	requests += count;
+	//closures are loaded on the calling thread, files shared by several shaders are read once
+	std::vector<Item> items (count);
+	sources.clear ();
+	try
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			LoadClosure (shader_requests[i], items[i].files);
+			BuildShaderKey (shader_requests[i], identity, items[i].files, items[i].key);
+		}
+	}
+	catch (...)
+	{
+		sources.clear ();
+		throw;
+	}
+	sources.clear ();
+
+	if (!jobs)
+	{
+		for (size_t i = 0; i < count; i++)
+			BuildOne (shader_requests[i], items[i], results[i]);
+		return;
+	}
+	jobs->ParallelFor (static_cast<uint32_t>(count), 1,
+					   [this, shader_requests, &items, results] (uint32_t begin, uint32_t end)
+					   {
+						   for (uint32_t i = begin; i < end; i++)
+							   BuildOne (shader_requests[i], items[i], results[i]);
+					   });
+}
+
+ShaderCacheStats ShaderCache::GetStats () const
+{
+	ShaderCacheStats stats;
+	stats.requests = requests.load ();
+	stats.hits = hits.load ();
+	stats.compiled = compiled.load ();
+	stats.failed = failed.load ();
+	stats.store_failures = store_failures.load ();
+	return stats;
+}
+
+const ShaderCache::File *ShaderCache::ReadSource (const std::string &path)
+{
+	auto found = sources.find (path);
+	if (found != sources.end ())
+		return found->second.exists ? &found->second : nullptr;
+
+	//missing files are remembered too, include lookups try many paths
+	File &file = sources[path];
+	file.exists = ReadWholeFile (path, file.contents);
+	if (!file.exists)
+		return nullptr;
+	file.hash = HashBytes (file.contents.data (), file.contents.size ());
+	ScanShaderIncludes (file.contents, file.includes);
+	return &file;
+}
+
+void ShaderCache::LoadClosure (const ShaderRequest &request, std::vector<ShaderSourceFile> &files)
+{
+	files.clear ();
+	std::unordered_map<std::string, uint32_t> indices;
+	if (!ReadSource (request.file))
+		throw std::runtime_error ("Can not read shader " + request.file);
+	ShaderSourceFile shader;
+	shader.name = request.file.substr (request.file.find_last_of ("/\\") + 1);
+	shader.path = request.file;
+	files.push_back (shader);
+	indices.emplace (request.file, 0);
+
+	//breadth first, so the order of the files only depends on the sources
+	for (size_t index = 0; index < files.size (); index++)
+	{
+		const File &file = *ReadSource (files[index].path);
+		files[index].contents = file.contents;
+		files[index].hash = file.hash;
+		for (const std::string &name : file.includes)
+		{
+			std::string path;
+			uint32_t include_index = shader_include_missing;
+			if (ResolveInclude (name, files[index].path, path))
+			{
+				auto found = indices.find (path);
+				if (found == indices.end ())
+				{
+					ShaderSourceFile include;
+					include.name = name;
+					include.path = path;
+					include_index = static_cast<uint32_t>(files.size ());
+					files.push_back (include);
+					indices.emplace (path, include_index);
+				}
+				else
+					include_index = found->second;
+			}
+			files[index].includes.push_back (std::make_pair (name, include_index));
+		}
+	}
+}
+
+bool ShaderCache::ResolveInclude (const std::string &name, const std::string &including_path, std::string &path)
+{
+	if (IsAbsolutePath (name))
+	{
+		path = name;
+		return ReadSource (path) != nullptr;
+	}
+	path = GetDirectory (including_path) + name;
+	if (ReadSource (path))
+		return true;
+	for (const std::string &include_directory : include_directories)
+	{
+		path = include_directory + name;
+		if (ReadSource (path))
+			return true;
+	}
+	return false;
+}
+
+void ShaderCache::BuildOne (const ShaderRequest &request, Item &item, ShaderResult &result)
+{
+	result.key_hash = HashBytes (item.key.data (), item.key.size ());
+	result.dependencies.clear ();
+	for (const ShaderSourceFile &file : item.files)
+		result.dependencies.push_back (file.path);
+	result.errors.clear ();
+
+	const std::string entry_path = GetEntryPath (result.key_hash);
+	std::string entry;
+	if (ReadWholeFile (entry_path, entry) && ReadShaderCacheEntry (entry.data (), entry.size (), item.key, result.bytecode))
+	{
+		result.succeeded = true;
+		result.compiled = false;
+		hits++;
+		return;
+	}
+
+	result.compiled = true;
+	result.bytecode.clear ();
+	result.succeeded = compiler->Compile (request, item.files, result.bytecode, result.errors);
+	if (!result.succeeded)
+	{
+		failed++;
+		return;
+	}
+	compiled++;
+
+	//written to a temporary file first, readers never see a partial entry
+	std::vector<uint8_t> data;
+	WriteShaderCacheEntry (item.key, result.bytecode, data);
+	const std::string temp_path = entry_path + "." + std::to_string (temp_counter++) + ".tmp";
+	FILE *f = fopen (temp_path.c_str (), "wb");
+	bool stored = f != nullptr;
+	if (f)
+	{
+		stored = fwrite (data.data (), 1, data.size (), f) == data.size ();
+		stored = fclose (f) == 0 && stored;
+	}
+	if (stored)
+	{
+		//rename does not replace on every platform; an existing entry belongs to a colliding key
+		remove (entry_path.c_str ());
+		stored = rename (temp_path.c_str (), entry_path.c_str ()) == 0;
+	}
+	if (!stored)
+	{
+		remove (temp_path.c_str ());
+		store_failures++;
+	}
+}
+
+std::string ShaderCache::GetEntryPath (uint64_t key_hash) const
+{
+	char name[24];
+	snprintf (name, sizeof (name), "%016llx.cso", static_cast<unsigned long long>(key_hash));
+	return directory + name;
+}
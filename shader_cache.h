@@ -0,0 +1,148 @@
+#pragma once
+#include "job_system.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+//Content-addressed shader bytecode cache. The key of a shader covers the contents of its
+//source and of every file it includes, the entry point, target, defines, flags and the
+//compiler; unchanged shaders load their bytecode from the cache directory, the rest are
+//compiled in parallel on the job system and stored there. Paths use '/' or '\' and are
+//passed to the file system as they are.
+
+static const uint32_t shader_cache_magic = 0x48534353;    //"SCSH"
+static const uint32_t shader_cache_version = 1;
+
+struct ShaderDefine
+{
+	std::string name;
+	std::string value;
+};
+
+struct ShaderRequest
+{
+	std::string file;
+	std::string entry_point;
+	std::string target;
+	std::vector<ShaderDefine> defines;    //in the order the compiler sees them
+	uint32_t flags;                       //compiler flags
+};
+
+//a file of the include closure; files[0] is the shader itself
+struct ShaderSourceFile
+{
+	std::string name;        //as written in the #include, the file name of the request for files[0]
+	std::string path;
+	std::string contents;
+	uint64_t hash;
+	//include names of the file with the index of the file they resolve to, invalid if not found
+	std::vector<std::pair<std::string, uint32_t>> includes;
+};
+
+static const uint32_t shader_include_missing = 0xffffffff;
+
+//compiles from the loaded sources only, so the compiled files are the hashed ones;
+//called from several threads at once
+class ShaderCompiler
+{
+public:
+	virtual ~ShaderCompiler () {}
+	//name and version, part of every key
+	virtual std::string GetIdentity () = 0;
+	virtual bool Compile (const ShaderRequest &request, const std::vector<ShaderSourceFile> &files, std::vector<uint8_t> &bytecode, std::string &errors) = 0;
+};
+
+struct ShaderResult
+{
+	bool succeeded;
+	bool compiled;                 //false if the bytecode came from the cache
+	uint64_t key_hash;
+	std::vector<uint8_t> bytecode;
+	std::string errors;
+	std::vector<std::string> dependencies;    //paths of the include closure, the shader first
+};
+
+struct ShaderCacheStats
+{
+	uint64_t requests;
+	uint64_t hits;
+	uint64_t compiled;
+	uint64_t failed;
+	uint64_t store_failures;    //compiled bytecode that could not be written to the cache
+};
+
+//names of the files included by a source, in order; comments are skipped, conditional
+//blocks are not evaluated so includes of inactive branches are listed too
+void ScanShaderIncludes (const std::string &source, std::vector<std::string> &names);
+
+//key material of a request with its closure loaded; equal keys mean equal bytecode
+void BuildShaderKey (const ShaderRequest &request, const std::string &compiler_identity, const std::vector<ShaderSourceFile> &files, std::vector<uint8_t> &key);
+
+//cache entry: header, key, bytecode
+void WriteShaderCacheEntry (const std::vector<uint8_t> &key, const std::vector<uint8_t> &bytecode, std::vector<uint8_t> &entry);
+//false if the entry is damaged or was written for another key
+bool ReadShaderCacheEntry (const void *entry, size_t entry_size, const std::vector<uint8_t> &key, std::vector<uint8_t> &bytecode);
+
+//shader manifest for the offline compiler, one shader per line:
+//file entry_point target [flags] [NAME=VALUE ...]; '#' starts a comment. Throws on errors.
+void ParseShaderManifest (const std::string &text, std::vector<ShaderRequest> &requests);
+
+class ShaderCache
+{
+public:
+	//the cache directory must exist; includes are looked up next to the including file first
+	ShaderCache (ShaderCompiler *compiler, const std::string &cache_directory, const std::vector<std::string> &include_directories);
+
+	//loads or compiles the requests into results; misses are compiled on the job system if one
+	//is given, which must be called from a thread of the job system then. Calls from several
+	//threads run one after another. Shader errors are reported in the results, a missing
+	//shader file throws.
+	void Build (const ShaderRequest *requests, size_t count, JobSystem *jobs, ShaderResult *results);
+
+	ShaderCacheStats GetStats () const;
+private:
+	struct File
+	{
+		bool exists;
+		std::string contents;
+		uint64_t hash;
+		std::vector<std::string> includes;
+	};
+
+	struct Item
+	{
+		std::vector<ShaderSourceFile> files;
+		std::vector<uint8_t> key;
+	};
+
+	ShaderCache (const ShaderCache &) = delete;
+	ShaderCache &operator= (const ShaderCache &) = delete;
+
+	//reads the file once per Build (); nullptr if it does not exist
+	const File *ReadSource (const std::string &path);
+	void LoadClosure (const ShaderRequest &request, std::vector<ShaderSourceFile> &files);
+	bool ResolveInclude (const std::string &name, const std::string &including_path, std::string &path);
+	void BuildOne (const ShaderRequest &request, Item &item, ShaderResult &result);
+	std::string GetEntryPath (uint64_t key_hash) const;
+
+	ShaderCompiler *compiler;
+	std::string identity;
+	std::string directory;
+	std::vector<std::string> include_directories;
+	std::mutex build_mutex;
+	std::unordered_map<std::string, File> sources;    //of the running Build ()
+
+	std::atomic<uint64_t> requests;
+	std::atomic<uint64_t> hits;
+	std::atomic<uint64_t> compiled;
+	std::atomic<uint64_t> failed;
+	std::atomic<uint64_t> store_failures;
+	std::atomic<uint32_t> temp_counter;
+};
@@ -0,0 +1,91 @@
+#include "stdafx.h"
+#include "d3d_shader_compiler.h"
+
+#include <thread>
+
+//Offline shader precompiler. Compiles the shaders of a manifest into a cache directory,
+//so shipping builds start with every shader in the cache. Only shaders whose sources
+//changed since the last run are compiled again.
+//usage: shader_precompile <manifest> <cache directory> [-I <include directory>]...
+
+static bool ReadText (const char *file_name, std::string &text)
+{
+	FILE *f = nullptr;
+	if (fopen_s (&f, file_name, "rb") != 0 || !f)
+		return false;
+	char buffer[4096];
+	size_t read;
+	while ((read = fread (buffer, 1, sizeof (buffer), f)) > 0)
+		text.append (buffer, read);
+	fclose (f);
+	return true;
+}
+
+int main (int argc, char **argv)
+{
+	if (argc < 3)
+	{
+		printf ("usage: shader_precompile <manifest> <cache directory> [-I <include directory>]...\n");
+		return 2;
+	}
+	std::vector<std::string> include_directories;
+	for (int i = 3; i < argc; i++)
+	{
+		if (strcmp (argv[i], "-I") != 0 || i + 1 == argc)
+		{
+			printf ("Unknown argument %s\n", argv[i]);
+			return 2;
+		}
+		include_directories.push_back (argv[++i]);
+	}
+
+	try
+	{
+		std::string manifest;
+		if (!ReadText (argv[1], manifest))
+		{
+			printf ("Can not read manifest %s\n", argv[1]);
+			return 1;
+		}
+		std::vector<ShaderRequest> requests;
+		ParseShaderManifest (manifest, requests);
+
+		//shader files are relative to the manifest
+		const std::string manifest_path = argv[1];
+		const size_t separator = manifest_path.find_last_of ("/\\");
+		const std::string base = separator == std::string::npos ? std::string () : manifest_path.substr (0, separator + 1);
+		for (ShaderRequest &request : requests)
+			request.file = base + request.file;
+
+		CreateDirectoryA (argv[2], nullptr);
+		D3DShaderCompiler compiler;
+		ShaderCache cache (&compiler, argv[2], include_directories);
+		const unsigned core_count = std::thread::hardware_concurrency ();
+		JobSystem jobs (core_count > 1 ? core_count - 1 : 0);
+		std::vector<ShaderResult> results (requests.size ());
+		cache.Build (requests.data (), requests.size (), &jobs, results.data ());
+
+		int failed = 0;
+		for (size_t i = 0; i < requests.size (); i++)
+		{
+			const ShaderResult &result = results[i];
+			printf ("%s %s %s: %s\n", requests[i].file.c_str (), requests[i].entry_point.c_str (), requests[i].target.c_str (),
+					!result.succeeded ? "failed" : result.compiled ? "compiled" : "up to date");
+			if (!result.errors.empty ())
+				printf ("%s\n", result.errors.c_str ());
+			if (!result.succeeded)
+				failed++;
+		}
+		const ShaderCacheStats stats = cache.GetStats ();
+		printf ("%llu shaders: %llu up to date, %llu compiled, %llu failed\n",
+				stats.requests, stats.hits, stats.compiled, stats.failed);
+		if (stats.store_failures)
+			printf ("%llu shaders could not be written to the cache\n", stats.store_failures);
+		return failed || stats.store_failures ? 1 : 0;
+	}
+	catch (const std::exception &err)
+	{
+		printf ("%s\n", err.what ());
+		return 1;
+	}
+}
@@ -0,0 +1,362 @@
+#include "shader_reload.h"
+
+#include <stdio.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+
+//file systems with a coarse time stamp may show no change for a write right after the
+//previous one; files modified this recently are compared by contents on every poll
+static const int64_t recent_modification_seconds = 2;
+
+void FileWatcher::ReadState (const std::string &path, File &file, bool hash_contents)
+{
+	struct stat info;
+	file.exists = stat (path.c_str (), &info) == 0;
+	file.modified = file.exists ? static_cast<int64_t>(info.st_mtime) : 0;
+	file.size = file.exists ? static_cast<int64_t>(info.st_size) : 0;
+	file.hash = 0;
+	if (!file.exists || !hash_contents)
+		return;
+
+	FILE *f = fopen (path.c_str (), "rb");
+	if (!f)
+	{
+		//e.g. locked by the editor while it saves, looks like a change until it can be read
+		file.exists = false;
+		return;
+	}
+	uint8_t buffer[4096];
+	uint64_t hash = PipelineHash (nullptr, 0);
+	size_t read;
+	while ((read = fread (buffer, 1, sizeof (buffer), f)) > 0)
+		hash = PipelineHash (buffer, read, hash);
+	fclose (f);
+	file.hash = hash;
+}
+
+void FileWatcher::Watch (const std::string &path)
+{
+	if (files.count (path))
+		return;
+	ReadState (path, files[path], true);
+}
+
+void FileWatcher::Unwatch (const std::string &path)
+{
+	files.erase (path);
+}
+
+void FileWatcher::Poll (std::vector<std::string> &changed)
+{
+	const int64_t now = static_cast<int64_t>(time (nullptr));
+	for (auto &watched : files)
+	{
+		File &file = watched.second;
+		File state;
+		ReadState (watched.first, state, false);
+		if (state.exists == file.exists && state.modified == file.modified && state.size == file.size &&
+			now - state.modified > recent_modification_seconds)
+			continue;
+		if (state.exists)
+			ReadState (watched.first, state, true);
+		const bool modified = state.exists != file.exists || (state.exists && state.hash != file.hash);
+		file = state;
+		if (modified)
+			changed.push_back (watched.first);
+	}
+}
+
+ShaderReloader::ShaderReloader (ShaderCache *shader_cache, PipelineCache *pipeline_cache, FrameScheduler *frame_scheduler, uint32_t poll_interval_ms) :
+	shaders (shader_cache),
+	pipelines (pipeline_cache),
+	scheduler (frame_scheduler),
+	poll_interval (poll_interval_ms),
+	failures (0),
+	swaps (0),
+	stop (false),
+	polls (0),
+	changes (0),
+	recompiles (0),
+	watched_files (0)
+{
+	thread = std::thread (&ShaderReloader::ReloadThread, this);
+}
+
+ShaderReloader::~ShaderReloader ()
+{
+	{
+		std::lock_guard<std::mutex> lock (mutex);
+		stop = true;
+	}
+	stop_cv.notify_all ();
+	thread.join ();
+}
+
+ReloadablePipeline ShaderReloader::Register (PipelineId pipeline, const PipelineDesc &desc, const std::vector<ReloadableShader> &shader_list)
+{
+	for (const ReloadableShader &shader : shader_list)
+		if (!desc.shaders[shader.stage].bytecode || !desc.shaders[shader.stage].size)
+			throw std::invalid_argument ("Reloadable shader stage has no bytecode");
+	const ReloadablePipeline id = static_cast<ReloadablePipeline>(programs.size ());
+	programs.emplace_back ();
+	Program &program = programs.back ();
+	program.desc = desc;
+	program.current = pipeline;
+	program.pending = pipeline_id_invalid;
+	for (uint32_t stage = 0; stage < PIPELINE_SHADER_STAGE_COUNT; stage++)
+	{
+		const PipelineShader &shader = desc.shaders[stage];
+		if (shader.bytecode && shader.size)
+		{
+			const uint8_t *bytes = static_cast<const uint8_t*>(shader.bytecode);
+			program.bytecode[stage].assign (bytes, bytes + shader.size);
+		}
+	}
+	if (desc.input_elements)
+	{
+		program.input_elements.assign (desc.input_elements, desc.input_elements + desc.input_element_count);
+		for (PipelineInputElement &element : program.input_elements)
+			if (element.semantic_name)
+			{
+				program.semantic_names.push_back (element.semantic_name);
+				element.semantic_name = program.semantic_names.back ().c_str ();
+			}
+		program.desc.input_elements = program.input_elements.data ();
+	}
+
+	std::lock_guard<std::mutex> lock (mutex);
+	sources.push_back (Source ());
+	sources.back ().shaders = shader_list;
+	for (const ReloadableShader &shader : shader_list)
+		for (const std::string &path : shader.dependencies)
+		{
+			std::vector<ReloadablePipeline> &users = dependents[path];
+			if (std::find (users.begin (), users.end (), id) == users.end ())
+				users.push_back (id);
+			watch_queue.push_back (path);
+		}
+	return id;
+}
+
+bool ShaderReloader::IsUsed (PipelineId id) const
+{
+	for (const Program &program : programs)
+		if (program.current == id || program.pending == id)
+			return true;
+	return false;
+}
+
+void ShaderReloader::Retire (PipelineId id)
+{
+	//registered pipelines with equal descriptions share the entry
+	if (id != pipeline_id_invalid && !IsUsed (id))
+		pipelines->Evict (id, scheduler);
+}
+
+void ShaderReloader::Update (std::vector<ShaderReloadEvent> &events)
+{
+	std::vector<Compiled> done;
+	{
+		std::lock_guard<std::mutex> lock (mutex);
+		done.swap (compiled);
+	}
+
+	for (Compiled &result : done)
+	{
+		if (!result.succeeded)
+		{
+			failures++;
+			events.push_back ({ result.pipeline, false, result.errors });
+			continue;
+		}
+		Program &program = programs[result.pipeline];
+		//the cache copies the bytecode, the program keeps the latest for the next reload
+		for (size_t i = 0; i < result.stages.size (); i++)
+			program.bytecode[result.stages[i]].swap (result.bytecode[i]);
+		PipelineDesc desc = program.desc;
+		for (uint32_t stage = 0; stage < PIPELINE_SHADER_STAGE_COUNT; stage++)
+			desc.shaders[stage] = { program.bytecode[stage].data (), program.bytecode[stage].size () };
+
+		const PipelineId id = pipelines->Request (desc, program.current);
+		if (id == program.pending)
+			continue;
+		if (program.pending != pipeline_id_invalid &&
+			std::find (program.replaced.begin (), program.replaced.end (), program.pending) == program.replaced.end ())
+			program.replaced.push_back (program.pending);
+		//unchanged bytecode, e.g. only comments were edited
+		program.pending = id == program.current ? pipeline_id_invalid : id;
+	}
+
+	for (size_t i = 0; i < programs.size (); i++)
+	{
+		Program &program = programs[i];
+		const ReloadablePipeline id = static_cast<ReloadablePipeline>(i);
+		if (program.pending != pipeline_id_invalid)
+		{
+			if (pipelines->IsReady (program.pending))
+			{
+				const PipelineId old = program.current;
+				program.current = program.pending;
+				program.pending = pipeline_id_invalid;
+				Retire (old);
+				swaps++;
+				events.push_back ({ id, true, std::string () });
+			}
+			else if (pipelines->HasFailed (program.pending))
+			{
+				const PipelineId failed = program.pending;
+				program.pending = pipeline_id_invalid;
+				Retire (failed);
+				failures++;
+				events.push_back ({ id, false, "Can not create the pipeline of the reloaded shaders" });
+			}
+		}
+
+		//replaced pipelines are evicted once they are no longer being created
+		size_t kept = 0;
+		for (size_t j = 0; j < program.replaced.size (); j++)
+		{
+			const PipelineId replaced = program.replaced[j];
+			if (!pipelines->IsReady (replaced) && !pipelines->HasFailed (replaced))
+				program.replaced[kept++] = replaced;
+			else
+				Retire (replaced);
+		}
+		program.replaced.resize (kept);
+	}
+}
+
+ShaderReloadStats ShaderReloader::GetStats () const
+{
+	std::lock_guard<std::mutex> lock (mutex);
+	ShaderReloadStats stats;
+	stats.polls = polls;
+	stats.changes = changes;
+	stats.recompiles = recompiles;
+	stats.failures = failures;
+	stats.swaps = swaps;
+	stats.files = watched_files;
+	return stats;
+}
+
+void ShaderReloader::ReloadThread ()
+{
+	std::vector<std::string> changed;
+	std::vector<ReloadablePipeline> affected;
+	std::unique_lock<std::mutex> lock (mutex);
+	while (!stop)
+	{
+		std::vector<std::string> watch;
+		watch.swap (watch_queue);
+		lock.unlock ();
+		for (const std::string &path : watch)
+			watcher.Watch (path);
+		changed.clear ();
+		watcher.Poll (changed);
+		lock.lock ();
+
+		polls++;
+		changes += changed.size ();
+		watched_files = static_cast<uint32_t>(watcher.GetFileCount ());
+		affected.clear ();
+		for (const std::string &path : changed)
+		{
+			auto users = dependents.find (path);
+			if (users == dependents.end ())
+				continue;
+			for (ReloadablePipeline pipeline : users->second)
+				if (std::find (affected.begin (), affected.end (), pipeline) == affected.end ())
+					affected.push_back (pipeline);
+		}
+		lock.unlock ();
+		for (ReloadablePipeline pipeline : affected)
+			Recompile (pipeline);
+		lock.lock ();
+
+		stop_cv.wait_for (lock, std::chrono::milliseconds (poll_interval), [this] { return stop; });
+	}
+}
+
+void ShaderReloader::Recompile (ReloadablePipeline pipeline)
+{
+	std::vector<ShaderRequest> requests;
+	{
+		std::lock_guard<std::mutex> lock (mutex);
+		for (const ReloadableShader &shader : sources[pipeline].shaders)
+			requests.push_back (shader.request);
+	}
+
+	//all stages are built, the unchanged ones come from the shader cache
+	std::vector<ShaderResult> results (requests.size ());
+	Compiled result;
+	result.pipeline = pipeline;
+	result.succeeded = true;
+	bool built = true;
+	try
+	{
+		shaders->Build (requests.data (), requests.size (), nullptr, results.data ());
+	}
+	catch (const std::exception &e)
+	{
+		//a file is missing, e.g. while an editor replaces it; the next change retries
+		built = false;
+		result.succeeded = false;
+		result.errors = e.what ();
+	}
+	for (size_t i = 0; built && i < results.size (); i++)
+		if (!results[i].succeeded)
+		{
+			result.succeeded = false;
+			if (!result.errors.empty () && result.errors.back () != '\n')
+				result.errors += '\n';
+			result.errors += results[i].errors;
+		}
+
+	std::lock_guard<std::mutex> lock (mutex);
+	recompiles++;
+	Source &source = sources[pipeline];
+	if (built)
+	{
+		//includes may have been added or removed, the program depends on the new closure
+		std::vector<std::string> unused;
+		for (size_t i = 0; i < source.shaders.size (); i++)
+		{
+			for (const std::string &path : source.shaders[i].dependencies)
+			{
+				auto users = dependents.find (path);
+				if (users == dependents.end ())
+					continue;
+				users->second.erase (std::remove (users->second.begin (), users->second.end (), pipeline), users->second.end ());
+				if (users->second.empty ())
+				{
+					dependents.erase (users);
+					unused.push_back (path);
+				}
+			}
+			source.shaders[i].dependencies.swap (results[i].dependencies);
+		}
+		for (const ReloadableShader &shader : source.shaders)
+			for (const std::string &path : shader.dependencies)
+			{
+				std::vector<ReloadablePipeline> &users = dependents[path];
+				if (std::find (users.begin (), users.end (), pipeline) == users.end ())
+					users.push_back (pipeline);
+				//files that are watched already keep their state
+				watcher.Watch (path);
+			}
+		for (const std::string &path : unused)
+			if (!dependents.count (path))
+				watcher.Unwatch (path);
+	}
+	if (result.succeeded)
+		for (size_t i = 0; i < results.size (); i++)
+		{
+			result.stages.push_back (source.shaders[i].stage);
+			result.bytecode.push_back (std::move (results[i].bytecode));
+		}
+	compiled.push_back (std::move (result));
+}
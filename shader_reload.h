@@ -0,0 +1,165 @@
+#pragma once
+#include "frame_scheduler.h"
+#include "pipeline_cache.h"
+#include "shader_cache.h"
+
+#include <stdint.h>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+//Shader hot reload. A background thread polls the sources and includes of registered
+//pipelines and recompiles the shaders that depend on a changed file. At the frame
+//boundary Update () requests the new pipeline with the running one as fallback and
+//swaps once it is ready, so frames never wait for a compile; the old pipeline is
+//destroyed after the GPU finished the frames that used it. Shaders that fail to
+//compile leave the running pipeline in place.
+
+//Polls files for changes: a file whose time stamp or size changed is read again and
+//only reported if its contents changed too, saving an unmodified file is ignored.
+class FileWatcher
+{
+public:
+	//watching a file twice has no effect; missing files are reported once they appear
+	void Watch (const std::string &path);
+	void Unwatch (const std::string &path);
+	//appends the files whose contents changed since the last poll
+	void Poll (std::vector<std::string> &changed);
+
+	size_t GetFileCount () const
+	{
+		return files.size ();
+	}
+private:
+	struct File
+	{
+		bool exists;
+		int64_t modified;
+		int64_t size;
+		uint64_t hash;
+	};
+
+	static void ReadState (const std::string &path, File &file, bool hash_contents);
+
+	std::unordered_map<std::string, File> files;
+};
+
+typedef uint32_t ReloadablePipeline;
+
+//shader stage of a reloadable pipeline
+struct ReloadableShader
+{
+	PipelineShaderStage stage;
+	ShaderRequest request;
+	std::vector<std::string> dependencies;    //ShaderResult::dependencies of the running bytecode
+};
+
+struct ShaderReloadEvent
+{
+	ReloadablePipeline pipeline;
+	bool succeeded;         //false if the running pipeline was kept
+	std::string errors;
+};
+
+struct ShaderReloadStats
+{
+	uint64_t polls;
+	uint64_t changes;         //changed files
+	uint64_t recompiles;      //pipelines whose shaders were built again
+	uint64_t failures;        //shader or pipeline errors, the running pipeline was kept
+	uint64_t swaps;
+	uint32_t files;           //watched files
+};
+
+class ShaderReloader
+{
+public:
+	//the caches and the scheduler must outlive the reloader; shaders are compiled on its
+	//own thread, so Build () of the shader cache may block while a reload compiles
+	ShaderReloader (ShaderCache *shader_cache, PipelineCache *pipeline_cache, FrameScheduler *frame_scheduler, uint32_t poll_interval_ms);
+	~ShaderReloader ();
+
+	//pipeline was created from desc, whose shaders are the bytecode of the given stages;
+	//the description is copied and its shaders are replaced on reload
+	ReloadablePipeline Register (PipelineId pipeline, const PipelineDesc &desc, const std::vector<ReloadableShader> &shaders);
+
+	PipelineId GetPipelineId (ReloadablePipeline pipeline) const
+	{
+		return programs.at (pipeline).current;
+	}
+	GpuPipelineHandle Get (ReloadablePipeline pipeline) const
+	{
+		return pipelines->Get (programs.at (pipeline).current);
+	}
+
+	//call at the frame boundary on the thread that requests pipelines; appends an event
+	//for every pipeline that was swapped or failed to reload
+	void Update (std::vector<ShaderReloadEvent> &events);
+
+	ShaderReloadStats GetStats () const;
+private:
+	struct Program
+	{
+		PipelineDesc desc;
+		std::vector<PipelineInputElement> input_elements;
+		std::deque<std::string> semantic_names;
+		std::vector<uint8_t> bytecode[PIPELINE_SHADER_STAGE_COUNT];
+		PipelineId current;
+		PipelineId pending;                  //swapped in once it is ready
+		std::vector<PipelineId> replaced;    //pending pipelines a newer reload replaced
+	};
+
+	//what the reload thread knows about a program
+	struct Source
+	{
+		std::vector<ReloadableShader> shaders;
+	};
+
+	struct Compiled
+	{
+		ReloadablePipeline pipeline;
+		bool succeeded;
+		std::string errors;
+		std::vector<PipelineShaderStage> stages;
+		std::vector<std::vector<uint8_t>> bytecode;
+	};
+
+	ShaderReloader (const ShaderReloader &) = delete;
+	ShaderReloader &operator= (const ShaderReloader &) = delete;
+
+	bool IsUsed (PipelineId id) const;
+	void Retire (PipelineId id);
+	void ReloadThread ();
+	void Recompile (ReloadablePipeline pipeline);
+
+	ShaderCache *shaders;
+	PipelineCache *pipelines;
+	FrameScheduler *scheduler;
+	uint32_t poll_interval;
+
+	//render thread only
+	std::deque<Program> programs;
+	uint64_t failures;
+	uint64_t swaps;
+
+	//reload thread only
+	FileWatcher watcher;
+
+	mutable std::mutex mutex;
+	std::condition_variable stop_cv;
+	bool stop;
+	std::vector<Source> sources;
+	std::unordered_map<std::string, std::vector<ReloadablePipeline>> dependents;    //path to the programs using it
+	std::vector<std::string> watch_queue;    //paths of new programs, watched by the reload thread
+	std::vector<Compiled> compiled;
+	uint64_t polls;
+	uint64_t changes;
+	uint64_t recompiles;
+	uint32_t watched_files;
+	std::thread thread;
+};
@@ -1,14 +1,30 @@
+//dequantization of the mesh positions, set per mesh as root constants
+cbuffer MeshConstants : register(b0)
+{
+	float4 position_scale;
+	float4 position_bias;
+};
+
 struct PSInput
 {
 	float4 position: SV_POSITION;
 	float4 color: COLOR;
 };
 
+//normal of a R16G16_SNORM octahedral encoding, see vertex_format.h
+float3 DecodeOctahedralNormal (float2 encoded)
+{
+	float3 normal = float3 (encoded, 1.0f - abs (encoded.x) - abs (encoded.y));
+	float fold = saturate (-normal.z);
+	normal.xy += normal.xy >= 0.0f ? -fold : fold;
+	return normalize (normal);
+}
+
 PSInput VSMain (float4 position: POSITION, float4 color: COLOR)
 {
 	PSInput result;
 
-	result.position = position;
+	result.position = float4 (position.xyz * position_scale.xyz + position_bias.xyz, 1.0f);
 	result.color = color;
 
 	return result;
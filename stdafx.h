@@ -9,6 +9,21 @@
 
 #include <d3d12.h>
 #include <dxgi1_4.h>
+//tearing presents need the DXGI 1.5 header of the Windows 10 SDK 10.0.14393 or later;
+//define ENABLE_DXGI_TEARING to 0 to build without them
+#ifndef ENABLE_DXGI_TEARING
+#if defined (__has_include)
+#if __has_include (<dxgi1_5.h>)
+#define ENABLE_DXGI_TEARING 1
+#endif
+#endif
+#endif
+#ifndef ENABLE_DXGI_TEARING
+#define ENABLE_DXGI_TEARING 0
+#endif
+#if ENABLE_DXGI_TEARING
+#include <dxgi1_5.h>
+#endif
 #include <d3dcompiler.h>
 #include <DirectXMath.h>
 #pragma comment (lib, "d3d12.lib")
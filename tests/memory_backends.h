@@ -0,0 +1,132 @@
+#pragma once
+#include "descriptor_heap.h"
+#include "upload_allocator.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <map>
+#include <vector>
+
+//Backends over system memory for the tests and benchmarks of the portable modules, in
+//place of the D3D12 ones. Handles and GPU addresses are fake, CPU addresses are real.
+
+//chunks of system memory with fake handles and GPU addresses
+class MemoryUploadBackend : public UploadBackend
+{
+public:
+	MemoryUploadBackend () :
+		next_resource (1),
+		live_chunks (0)
+	{
+	}
+	UploadChunk CreateChunk (uint64_t size) override
+	{
+		const GpuResourceHandle resource = next_resource++;
+		UploadChunk chunk = { resource, static_cast<uint8_t*>(malloc (static_cast<size_t>(size))), 0x100000000ull * resource, size };
+		chunks[chunk.resource] = chunk.cpu_address;
+		live_chunks++;
+		return chunk;
+	}
+	void DestroyChunk (const UploadChunk &chunk) override
+	{
+		chunks.erase (chunk.resource);
+		free (chunk.cpu_address);
+		live_chunks--;
+	}
+
+	GpuResourceHandle next_resource;
+	int live_chunks;
+	std::map<GpuResourceHandle, uint8_t*> chunks;    //live ones, for copies resolved by resource
+};
+
+//Heaps of system memory: CPU handles are the addresses of the descriptors, shader visible
+//heaps get GPU handles at a fixed offset from them, and copies move the bytes. Tests store
+//a value in a descriptor to check where copies put it.
+class MemoryDescriptorBackend : public DescriptorBackend
+{
+public:
+	static const uint32_t increment = 32;
+	static const uint64_t gpu_offset = 0x100000000ull;
+
+	MemoryDescriptorBackend () :
+		next_heap (101),
+		live_heaps (0),
+		copy_calls (0),
+		src_ranges (0),
+		copied (0),
+		copied_count_mismatch (false)
+	{
+	}
+	DescriptorHeapDesc CreateHeap (GpuDescriptorHeapType, uint32_t capacity, bool shader_visible) override
+	{
+		//a gap keeps heaps from following each other
+		std::vector<uint8_t> &memory = heaps[next_heap];
+		memory.resize (static_cast<size_t>(capacity) * increment + 4096);
+		DescriptorHeapDesc desc;
+		desc.heap = next_heap++;
+		desc.cpu_start = reinterpret_cast<GpuDescriptorHandle>(memory.data ());
+		desc.gpu_start = shader_visible ? desc.cpu_start + gpu_offset : 0;
+		desc.increment = increment;
+		desc.capacity = capacity;
+		live_heaps++;
+		return desc;
+	}
+	void DestroyHeap (const DescriptorHeapDesc &desc) override
+	{
+		heaps.erase (desc.heap);
+		live_heaps--;
+	}
+	void CopyDescriptors (GpuDescriptorHeapType,
+						  uint32_t dst_range_count, const GpuDescriptorHandle *dst_starts, const uint32_t *dst_sizes,
+						  uint32_t src_range_count, const GpuDescriptorHandle *src_starts, const uint32_t *src_sizes) override
+	{
+		copy_calls++;
+		src_ranges += src_range_count;
+		copied_count_mismatch = false;
+		uint32_t src = 0, src_done = 0;
+		for (uint32_t dst = 0; dst < dst_range_count; dst++)
+			for (uint32_t i = 0; i < dst_sizes[dst]; i++)
+			{
+				while (src < src_range_count && src_done == src_sizes[src])
+				{
+					src++;
+					src_done = 0;
+				}
+				if (src == src_range_count)
+				{
+					copied_count_mismatch = true;
+					return;
+				}
+				memcpy (reinterpret_cast<void*>(dst_starts[dst] + static_cast<uint64_t>(i) * increment),
+						reinterpret_cast<const void*>(src_starts[src] + static_cast<uint64_t>(src_done) * increment), increment);
+				src_done++;
+				copied++;
+			}
+		while (src < src_range_count && src_done == src_sizes[src])
+		{
+			src++;
+			src_done = 0;
+		}
+		copied_count_mismatch = src != src_range_count;
+	}
+
+	static void SetDescriptor (GpuDescriptorHandle handle, uint64_t value)
+	{
+		memcpy (reinterpret_cast<void*>(handle), &value, sizeof (value));
+	}
+	static uint64_t GetDescriptor (GpuDescriptorHandle handle)
+	{
+		uint64_t value;
+		memcpy (&value, reinterpret_cast<const void*>(handle), sizeof (value));
+		return value;
+	}
+
+	GpuDescriptorHeapHandle next_heap;
+	int live_heaps;
+	uint64_t copy_calls;
+	uint64_t src_ranges;
+	uint64_t copied;                //descriptors
+	bool copied_count_mismatch;     //of the last copy
+	std::map<GpuDescriptorHeapHandle, std::vector<uint8_t>> heaps;
+};
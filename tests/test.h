@@ -0,0 +1,43 @@
+#pragma once
+#include <stdio.h>
+
+#include <vector>
+
+//Minimal test registry of the portable modules. Every TEST runs once in the order of
+//registration; a failed CHECK reports its expression and fails the test without
+//stopping it, an exception escaping a test fails it as well.
+
+struct TestCase
+{
+	const char *name;
+	void (*function) ();
+};
+
+std::vector<TestCase> &GetTests ();
+void ReportFailure (const char *file, int line, const char *expression);
+
+struct TestRegistration
+{
+	TestRegistration (const char *name, void (*function) ())
+	{
+		GetTests ().push_back (TestCase { name, function });
+	}
+};
+
+#define TEST(name) \
+	static void Test_##name (); \
+	static TestRegistration test_registration_##name (#name, Test_##name); \
+	static void Test_##name ()
+
+#define CHECK(expression) \
+	do { if (!(expression)) ReportFailure (__FILE__, __LINE__, #expression); } while (0)
+
+#define CHECK_EQ(a, b) CHECK ((a) == (b))
+
+#define CHECK_THROWS(expression, exception_type) \
+	do \
+	{ \
+		bool thrown = false; \
+		try { expression; } catch (const exception_type &) { thrown = true; } \
+		if (!thrown) ReportFailure (__FILE__, __LINE__, #expression " throws " #exception_type); \
+	} while (0)
@@ -0,0 +1,324 @@
+#include "test.h"
+#include "asset_streamer.h"
+#include "null_device.h"
+#include "memory_backends.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <map>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+struct TextureCopy
+{
+	GpuResourceHandle dst;
+	uint32_t subresource;
+	GpuTextureFootprint footprint;
+	uint8_t first_byte;
+};
+
+//copy queue that carries out the copies out of the staging memory when they are executed,
+//so the destinations hold what the GPU would see once the fence passes
+class CopyQueue : public NullDevice
+{
+public:
+	explicit CopyQueue (MemoryUploadBackend *upload_backend) : backend (upload_backend)
+	{
+	}
+	void ExecuteCommandLists (uint32_t count, GpuCommandList *const *command_lists) override
+	{
+		for (uint32_t i = 0; i < count; i++)
+		{
+			NullCommandReader reader (*static_cast<const NullCommandList*>(command_lists[i]));
+			NullCommandHeader header;
+			const uint8_t *payload;
+			while (reader.Next (header, payload))
+				if (header.type == NULL_COMMAND_COPY_BUFFER_REGION)
+				{
+					const NullCopyPayload copy = NullCommandReader::Read<NullCopyPayload>(payload);
+					std::vector<uint8_t> &buffer = buffers[copy.dst];
+					buffer.resize (std::max<size_t>(buffer.size (), copy.dst_offset + copy.size));
+					memcpy (&buffer[copy.dst_offset], backend->chunks.at (copy.src) + copy.src_offset, copy.size);
+				}
+				else if (header.type == NULL_COMMAND_COPY_BUFFER_TO_TEXTURE)
+				{
+					const NullTextureCopyPayload copy = NullCommandReader::Read<NullTextureCopyPayload>(payload);
+					const TextureCopy texture = { copy.dst, copy.dst_subresource, copy.footprint,
+												  backend->chunks.at (copy.src)[copy.footprint.offset] };
+					textures.push_back (texture);
+				}
+		}
+		NullDevice::ExecuteCommandLists (count, command_lists);
+	}
+
+	MemoryUploadBackend *backend;
+	std::map<GpuResourceHandle, std::vector<uint8_t>> buffers;
+	std::vector<TextureCopy> textures;
+};
+
+static StreamRequest MakeBufferRequest (GpuResourceHandle destination, uint64_t size, uint8_t value, uint64_t deadline = stream_no_deadline,
+										float importance = 0.0f)
+{
+	StreamRequest request;
+	request.destination = destination;
+	request.destination_offset = 0;
+	request.size = size;
+	request.read = [value] (void *data, uint64_t data_size) { memset (data, value, static_cast<size_t>(data_size)); };
+	request.priority.deadline = deadline;
+	request.priority.importance = importance;
+	request.first_subresource = 0;
+	return request;
+}
+
+static bool Holds (const CopyQueue &copy_queue, GpuResourceHandle destination, uint64_t size, uint8_t value)
+{
+	auto buffer = copy_queue.buffers.find (destination);
+	if (buffer == copy_queue.buffers.end () || buffer->second.size () != size)
+		return false;
+	for (uint8_t byte : buffer->second)
+		if (byte != value)
+			return false;
+	return true;
+}
+
+TEST (StreamsThroughTheCopyQueue)
+{
+	MemoryUploadBackend backend;
+	CopyQueue copy_queue (&backend);
+	NullDevice direct_queue;
+	{
+		AssetStreamer streamer (&copy_queue, &backend, 1 << 20, 0);
+		const StreamId first = streamer.Request (MakeBufferRequest (100, 1000, 0x11));
+		const StreamId second = streamer.Request (MakeBufferRequest (101, 70000, 0x22));
+		StreamRequest texture = MakeBufferRequest (102, 4096, 0);
+		texture.read = [] (void *data, uint64_t size)
+		{
+			for (uint64_t i = 0; i < size; i++)
+				static_cast<uint8_t*>(data)[i] = static_cast<uint8_t>(i / 1024 + 1);
+		};
+		for (uint32_t mip = 0; mip < 3; mip++)
+		{
+			const GpuTextureFootprint footprint = { mip * 1024ull, 28, 16u >> mip, 16u >> mip, 1, 256 };
+			texture.footprints.push_back (footprint);
+		}
+		texture.first_subresource = 4;
+		const StreamId third = streamer.Request (texture);
+		CHECK_EQ (streamer.GetStatus (first), STREAM_STATUS_QUEUED);
+		CHECK_EQ (streamer.GetStats ().queued, 3u);
+
+		//read and copied in one batch, not usable before the copy finished
+		streamer.Update (&direct_queue, 0);
+		CHECK_EQ (streamer.GetStatus (first), STREAM_STATUS_COPYING);
+		CHECK_EQ (streamer.GetStatus (third), STREAM_STATUS_COPYING);
+		CHECK_EQ (streamer.GetStats ().batches, 1u);
+		CHECK_EQ (streamer.GetStats ().handovers, 0u);
+		CHECK_EQ (streamer.GetStats ().in_flight, 3u);
+		CHECK (Holds (copy_queue, 100, 1000, 0x11));
+		CHECK (Holds (copy_queue, 101, 70000, 0x22));
+		CHECK_EQ (copy_queue.textures.size (), 3u);
+		for (uint32_t mip = 0; mip < 3; mip++)
+		{
+			CHECK_EQ (copy_queue.textures[mip].dst, 102u);
+			CHECK_EQ (copy_queue.textures[mip].subresource, 4 + mip);
+			CHECK_EQ (copy_queue.textures[mip].footprint.width, 16u >> mip);
+			CHECK_EQ (copy_queue.textures[mip].first_byte, mip + 1);
+		}
+
+		//handed over with a GPU wait once the copy queue is done, nothing blocked on the CPU
+		copy_queue.AdvanceCpuTime (1000000);
+		streamer.Update (&direct_queue, 1);
+		CHECK_EQ (streamer.GetStatus (second), STREAM_STATUS_READY);
+		CHECK_EQ (streamer.GetStats ().handovers, 1u);
+		CHECK_EQ (streamer.GetStats ().urgent_handovers, 0u);
+		CHECK_EQ (direct_queue.GetStats ().queue_waits, 1u);
+		CHECK_EQ (direct_queue.GetStats ().waits, 0u);
+		CHECK_EQ (copy_queue.GetStats ().waits, 0u);
+		CHECK_EQ (streamer.GetStats ().read_bytes, 75096u);
+		CHECK_EQ (streamer.GetStats ().copied_bytes, 75096u);
+
+		//the staging memory comes back the update after the handover
+		streamer.Update (&direct_queue, 2);
+		CHECK_EQ (streamer.GetStats ().staging_used, 0u);
+		CHECK_EQ (streamer.GetStats ().in_flight, 0u);
+		CHECK_EQ (streamer.GetStats ().handovers, 1u);
+		streamer.Release (first);
+		CHECK_THROWS (streamer.GetStatus (first), std::invalid_argument);
+		CHECK_THROWS (streamer.Request (MakeBufferRequest (103, (1 << 20) + 1, 0)), std::invalid_argument);
+	}
+	CHECK_EQ (backend.live_chunks, 0);
+}
+
+TEST (MostUrgentRequestsGoFirstWithinTheBudget)
+{
+	MemoryUploadBackend backend;
+	CopyQueue copy_queue (&backend);
+	NullDevice direct_queue;
+	//room for one request at a time
+	AssetStreamer streamer (&copy_queue, &backend, 4096, 0);
+	std::vector<int> order;
+	std::vector<StreamId> ids;
+	const uint64_t deadlines[5] = { 20, 10, 10, 10, stream_no_deadline };
+	const float importance[5] = { 1.0f, 0.1f, 0.5f, 0.5f, 9.0f };
+	for (int i = 0; i < 5; i++)
+	{
+		StreamRequest request = MakeBufferRequest (100 + i, 4096, static_cast<uint8_t>(i));
+		request.priority.deadline = deadlines[i];
+		request.priority.importance = importance[i];
+		request.read = [&order, i] (void *data, uint64_t size)
+		{
+			order.push_back (i);
+			memset (data, i, static_cast<size_t>(size));
+		};
+		ids.push_back (streamer.Request (request));
+	}
+	//the camera turned: the least important of the equal deadlines is needed first now
+	const StreamPriority urgent = { 5, 0.0f };
+	streamer.SetPriority (ids[1], urgent);
+
+	for (uint64_t frame = 0; frame < 20 && order.size () < 5; frame++)
+	{
+		streamer.Update (&direct_queue, frame);
+		copy_queue.AdvanceCpuTime (1000000);
+	}
+	//deadline, then importance, then request order
+	const int expected[5] = { 1, 2, 3, 0, 4 };
+	CHECK_EQ (order.size (), 5u);
+	for (int i = 0; i < 5 && i < static_cast<int>(order.size ()); i++)
+		CHECK_EQ (order[i], expected[i]);
+	CHECK (streamer.GetStats ().budget_stalls > 0);
+	CHECK_EQ (streamer.GetStats ().staging_peak, 4096u);
+	for (int i = 0; i < 5; i++)
+		CHECK (Holds (copy_queue, 100 + i, 4096, static_cast<uint8_t>(i)));
+}
+
+TEST (DeadlinesHandOverRunningCopies)
+{
+	MemoryUploadBackend backend;
+	CopyQueue copy_queue (&backend);
+	NullDevice direct_queue;
+	AssetStreamer streamer (&copy_queue, &backend, 1 << 20, 0);
+	const StreamId later = streamer.Request (MakeBufferRequest (100, 1 << 19, 1, 50));
+	streamer.Update (&direct_queue, 0);
+	CHECK_EQ (streamer.GetStatus (later), STREAM_STATUS_COPYING);
+
+	//needed this frame while the copy runs: the direct queue waits for it on the GPU
+	const StreamId now = streamer.Request (MakeBufferRequest (101, 1000, 2, 1));
+	streamer.Update (&direct_queue, 1);
+	CHECK (copy_queue.GetCompletedFenceValue () < 2);
+	CHECK_EQ (streamer.GetStatus (now), STREAM_STATUS_READY);
+	//one wait covers the earlier batch as well
+	CHECK_EQ (streamer.GetStatus (later), STREAM_STATUS_READY);
+	CHECK_EQ (streamer.GetStats ().handovers, 1u);
+	CHECK_EQ (streamer.GetStats ().urgent_handovers, 1u);
+	CHECK_EQ (direct_queue.GetStats ().queue_waits, 1u);
+	CHECK_EQ (direct_queue.GetStats ().waits, 0u);
+	//the staging memory stays taken until the copies really finished
+	streamer.Update (&direct_queue, 2);
+	CHECK_EQ (streamer.GetStats ().in_flight, 2u);
+	copy_queue.AdvanceCpuTime (100000000);
+	streamer.Update (&direct_queue, 3);
+	CHECK_EQ (streamer.GetStats ().in_flight, 0u);
+	CHECK_EQ (streamer.GetStats ().handovers, 1u);
+}
+
+TEST (UrgentPrioritiesHandOverRunningCopies)
+{
+	MemoryUploadBackend backend;
+	CopyQueue copy_queue (&backend);
+	NullDevice direct_queue;
+	AssetStreamer streamer (&copy_queue, &backend, 1 << 20, 0);
+	const StreamId id = streamer.Request (MakeBufferRequest (100, 1 << 19, 1, 50));
+	streamer.Update (&direct_queue, 0);
+	CHECK_EQ (streamer.GetStatus (id), STREAM_STATUS_COPYING);
+	streamer.Update (&direct_queue, 1);
+	CHECK_EQ (streamer.GetStatus (id), STREAM_STATUS_COPYING);
+
+	//needed now while the copy runs: the next update hands it over without waiting for it
+	StreamPriority priority;
+	priority.deadline = 2;
+	priority.importance = 0.0f;
+	streamer.SetPriority (id, priority);
+	streamer.Update (&direct_queue, 2);
+	CHECK (copy_queue.GetCompletedFenceValue () < 1);
+	CHECK_EQ (streamer.GetStatus (id), STREAM_STATUS_READY);
+	CHECK_EQ (streamer.GetStats ().urgent_handovers, 1u);
+	CHECK_EQ (direct_queue.GetStats ().queue_waits, 1u);
+	copy_queue.AdvanceCpuTime (100000000);
+	streamer.Update (&direct_queue, 3);
+	CHECK_EQ (streamer.GetStats ().in_flight, 0u);
+	CHECK (Holds (copy_queue, 100, 1 << 19, 1));
+}
+
+TEST (FailuresAndReleases)
+{
+	MemoryUploadBackend backend;
+	CopyQueue copy_queue (&backend);
+	NullDevice direct_queue;
+	AssetStreamer streamer (&copy_queue, &backend, 8192, 0);
+	StreamRequest broken = MakeBufferRequest (100, 4096, 0);
+	broken.read = [] (void *, uint64_t) { throw std::runtime_error ("missing.bin"); };
+	const StreamId failed = streamer.Request (broken);
+	const StreamId copying = streamer.Request (MakeBufferRequest (101, 4096, 1));
+	bool read = false;
+	StreamRequest canceled = MakeBufferRequest (102, 4096, 2);
+	canceled.read = [&read] (void *, uint64_t) { read = true; };
+	const StreamId queued = streamer.Request (canceled);
+
+	streamer.Update (&direct_queue, 0);
+	CHECK_EQ (streamer.GetStatus (failed), STREAM_STATUS_FAILED);
+	CHECK (streamer.GetError (failed) == "missing.bin");
+	CHECK_EQ (streamer.GetStats ().failed, 1u);
+	CHECK_EQ (streamer.GetStatus (copying), STREAM_STATUS_COPYING);
+	//the failed read gave its memory back, the third request waits for the copy
+	CHECK_EQ (streamer.GetStats ().staging_used, 4096u);
+	CHECK_EQ (streamer.GetStatus (queued), STREAM_STATUS_QUEUED);
+
+	streamer.Release (queued);
+	streamer.Release (copying);
+	streamer.Release (failed);
+	CHECK_THROWS (streamer.GetStatus (queued), std::invalid_argument);
+	CHECK_EQ (streamer.GetStats ().queued, 0u);
+	//the copy in flight is dropped once it finished
+	copy_queue.AdvanceCpuTime (1000000);
+	streamer.Update (&direct_queue, 1);
+	streamer.Update (&direct_queue, 2);
+	CHECK_THROWS (streamer.GetStatus (copying), std::invalid_argument);
+	CHECK (!read);
+	CHECK_EQ (streamer.GetStats ().staging_used, 0u);
+	CHECK_EQ (streamer.GetStats ().in_flight, 0u);
+	//released ids are reused
+	const StreamId next = streamer.Request (MakeBufferRequest (103, 100, 3));
+	CHECK (next == queued || next == copying || next == failed);
+}
+
+TEST (IoThreadsReadEverything)
+{
+	MemoryUploadBackend backend;
+	CopyQueue copy_queue (&backend);
+	NullDevice direct_queue;
+	std::vector<StreamId> ids;
+	{
+		AssetStreamer streamer (&copy_queue, &backend, 256 * 1024, 4);
+		for (uint32_t i = 0; i < 200; i++)
+			ids.push_back (streamer.Request (MakeBufferRequest (1000 + i, 1000 + i * 97 % 30000, static_cast<uint8_t>(i), 5 + i / 10, 1.0f)));
+		uint32_t ready = 0;
+		for (uint64_t frame = 0; frame < 100000 && ready < ids.size (); frame++)
+		{
+			streamer.Update (&direct_queue, frame);
+			copy_queue.AdvanceCpuTime (100000);
+			ready = 0;
+			for (StreamId id : ids)
+				ready += streamer.GetStatus (id) == STREAM_STATUS_READY;
+			if (ready < ids.size ())
+				std::this_thread::yield ();
+		}
+		CHECK_EQ (ready, 200u);
+		CHECK (streamer.GetStats ().staging_peak <= 256u * 1024u);
+		CHECK_EQ (streamer.GetStats ().failed, 0u);
+	}
+	for (uint32_t i = 0; i < 200; i++)
+		CHECK (Holds (copy_queue, 1000 + i, 1000 + i * 97 % 30000, static_cast<uint8_t>(i)));
+	CHECK_EQ (backend.live_chunks, 0);
+}
@@ -0,0 +1,120 @@
+#include "test.h"
+#include "bindless.h"
+#include "null_device.h"
+#include "memory_backends.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+TEST (IndicesComeBackOnlyAfterTheirFence)
+{
+	BindlessIndexAllocator allocator (4);
+	CHECK_EQ (allocator.GetCapacity (), 4u);
+	for (uint32_t i = 0; i < 4; i++)
+		CHECK_EQ (allocator.Allocate (), i);
+	CHECK_EQ (allocator.GetAllocatedCount (), 4u);
+	CHECK_THROWS (allocator.Allocate (), std::runtime_error);
+
+	//freed by frames 5 and 6, still read by the GPU until their fences complete
+	allocator.Free (2, 5);
+	allocator.Free (0, 6);
+	CHECK_EQ (allocator.GetAllocatedCount (), 2u);
+	CHECK_EQ (allocator.GetPendingCount (), 2u);
+	CHECK_THROWS (allocator.Allocate (), std::runtime_error);
+	allocator.Recycle (4);
+	CHECK_THROWS (allocator.Allocate (), std::runtime_error);
+	allocator.Recycle (5);
+	CHECK_EQ (allocator.GetPendingCount (), 1u);
+	CHECK_EQ (allocator.Allocate (), 2u);
+	CHECK_THROWS (allocator.Allocate (), std::runtime_error);
+	allocator.Recycle (6);
+	CHECK_EQ (allocator.Allocate (), 0u);
+	CHECK_EQ (allocator.GetAllocatedCount (), 4u);
+
+	//double frees and foreign indices are caught
+	allocator.Free (1, 7);
+	CHECK_THROWS (allocator.Free (1, 7), std::logic_error);
+	CHECK_THROWS (allocator.Free (4, 7), std::logic_error);
+}
+
+TEST (ConcurrentAllocationsAreUnique)
+{
+	const uint32_t per_thread = 5000;
+	BindlessIndexAllocator allocator (4 * per_thread);
+	std::vector<std::vector<uint32_t>> indices (4);
+	std::vector<std::thread> threads;
+	for (uint32_t t = 0; t < 4; t++)
+		threads.push_back (std::thread ([&, t] ()
+		{
+			//churn through frees and recycles of this thread's own indices
+			for (uint32_t i = 0; i < per_thread; i++)
+			{
+				indices[t].push_back (allocator.Allocate ());
+				if (i % 3 == 0)
+				{
+					allocator.Free (indices[t].back (), i);
+					indices[t].pop_back ();
+				}
+			}
+		}));
+	for (std::thread &thread : threads)
+		thread.join ();
+	std::vector<uint32_t> all;
+	for (const std::vector<uint32_t> &list : indices)
+		all.insert (all.end (), list.begin (), list.end ());
+	std::sort (all.begin (), all.end ());
+	CHECK (std::adjacent_find (all.begin (), all.end ()) == all.end ());
+	CHECK_EQ (allocator.GetAllocatedCount (), static_cast<uint32_t>(all.size ()));
+	CHECK_EQ (allocator.GetPendingCount () + allocator.GetAllocatedCount (), 4 * per_thread);
+}
+
+TEST (DescriptorsAreCopiedToTheirIndex)
+{
+	NullDevice device;
+	MemoryDescriptorBackend backend;
+	CpuDescriptorHeap staging (&backend, GPU_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, 16);
+	ShaderDescriptorHeap heap (&device, &backend, 256, 64);
+	{
+		BindlessDescriptors bindless (&heap, 100);
+		CHECK_EQ (bindless.GetHeap (), heap.GetHeap ());
+		//CPU-only descriptors of three textures
+		GpuDescriptorHandle sources[3];
+		for (uint32_t i = 0; i < 3; i++)
+		{
+			sources[i] = staging.Allocate ().handle;
+			MemoryDescriptorBackend::SetDescriptor (sources[i], 1000 + i);
+		}
+		uint32_t indices[3];
+		for (uint32_t i = 0; i < 3; i++)
+			indices[i] = bindless.Add (sources[i]);
+		CHECK_EQ (bindless.GetCount (), 3u);
+		//the copies wait for the flush and go out in one call
+		const uint64_t calls = backend.copy_calls;
+		heap.FlushCopies ();
+		CHECK_EQ (backend.copy_calls, calls + 1);
+
+		//the descriptor at table + index * increment is what a shader reading the index sees
+		const GpuShaderDescriptorHandle table = bindless.GetTable ();
+		CHECK (table != 0);
+		const GpuDescriptorHandle cpu_table = table - MemoryDescriptorBackend::gpu_offset;
+		for (uint32_t i = 0; i < 3; i++)
+			CHECK_EQ (MemoryDescriptorBackend::GetDescriptor (cpu_table + indices[i] * MemoryDescriptorBackend::increment), 1000u + i);
+
+		//a removed index is reused after its frame, with the new descriptor
+		bindless.Remove (indices[1], 3);
+		CHECK_EQ (bindless.GetCount (), 2u);
+		const GpuDescriptorHandle replacement = staging.Allocate ().handle;
+		MemoryDescriptorBackend::SetDescriptor (replacement, 2000);
+		bindless.Recycle (3);
+		const uint32_t reused = bindless.Add (replacement);
+		CHECK_EQ (reused, indices[1]);
+		heap.FlushCopies ();
+		CHECK_EQ (MemoryDescriptorBackend::GetDescriptor (cpu_table + reused * MemoryDescriptorBackend::increment), 2000u);
+		CHECK_THROWS (bindless.Remove (99, 4), std::logic_error);
+	}
+	//the table went back to the heap, so it can be allocated whole again
+	BindlessDescriptors again (&heap, 256);
+	CHECK_EQ (again.GetCount (), 0u);
+}
@@ -0,0 +1,167 @@
+#include "test.h"
+#include "command_recorder.h"
+#include "null_device.h"
+
+#include <stdexcept>
+
+//null device that keeps what every ExecuteCommandLists () call submitted
+class CapturingDevice : public NullDevice
+{
+public:
+	struct SubmittedList
+	{
+		GpuPipelineHandle pipeline;    //first pipeline state set in the list, 0 without one
+		uint32_t barriers;
+		uint32_t draws;
+	};
+
+	void ExecuteCommandLists (uint32_t count, GpuCommandList *const *command_lists) override
+	{
+		std::vector<SubmittedList> lists;
+		for (uint32_t i = 0; i < count; i++)
+		{
+			const NullCommandList &command_list = *static_cast<const NullCommandList*>(command_lists[i]);
+			SubmittedList submitted = { 0, command_list.GetBarrierCount (), command_list.GetDrawCount () };
+			NullCommandReader reader (command_list);
+			NullCommandHeader header;
+			const uint8_t *payload;
+			while (!submitted.pipeline && reader.Next (header, payload))
+				if (header.type == NULL_COMMAND_SET_PIPELINE_STATE)
+					submitted.pipeline = NullCommandReader::Read<GpuPipelineHandle>(payload);
+			lists.push_back (submitted);
+		}
+		submissions.push_back (lists);
+		NullDevice::ExecuteCommandLists (count, command_lists);
+	}
+
+	std::vector<std::vector<SubmittedList>> submissions;
+};
+
+TEST (PoolRecyclesAllocatorsByFence)
+{
+	NullDevice device;
+	CommandAllocatorPool pool (&device);
+	GpuCommandAllocator *first = pool.Acquire (0);
+	GpuCommandAllocator *second = pool.Acquire (0);
+	CHECK (first != second);
+	pool.Release (second, 6);
+	pool.Release (first, 5);
+	//not finished yet, a new allocator is created
+	GpuCommandAllocator *third = pool.Acquire (4);
+	CHECK (third != first && third != second);
+	CHECK_EQ (pool.GetAllocatorCount (), 3u);
+	//the earliest fence comes back first
+	CHECK (pool.Acquire (6) == first);
+	CHECK (pool.Acquire (6) == second);
+	CHECK_EQ (pool.GetAllocatorCount (), 3u);
+}
+
+TEST (SplitsJobsByThreadsAndItems)
+{
+	NullDevice device;
+	CommandAllocatorPool pool (&device);
+	JobSystem job_system (3);
+	ResourceStateRegistry registry;
+	ParallelCommandRecorder recorder (&device, &pool, &job_system, &registry);
+	CHECK_EQ (recorder.GetJobCount (0, 64), 1u);
+	CHECK_EQ (recorder.GetJobCount (100, 64), 1u);
+	CHECK_EQ (recorder.GetJobCount (200, 64), 3u);
+	CHECK_EQ (recorder.GetJobCount (100000, 64), 4u);
+	CHECK_EQ (recorder.GetJobCount (2, 0), 2u);
+}
+
+TEST (SubmitsListsInJobOrder)
+{
+	CapturingDevice device;
+	CommandAllocatorPool pool (&device);
+	JobSystem job_system (3);
+	ResourceStateRegistry registry;
+	ParallelCommandRecorder recorder (&device, &pool, &job_system, &registry);
+	const uint32_t job_count = 16;
+	for (uint64_t frame = 1; frame <= 3; frame++)
+	{
+		recorder.Record (job_count,
+						 [] (uint32_t job, GpuCommandList *command_list, ResourceStateTracker *)
+						 {
+							 command_list->SetPipelineState (100 + job);
+							 for (uint32_t i = 0; i <= job; i++)
+								 command_list->DrawInstanced (3, 1, 0, 0);
+						 },
+						 0, device.GetCompletedFenceValue ());
+		CHECK_EQ (recorder.GetRecordedListCount (), job_count);
+		recorder.Submit (frame);
+		device.Signal (frame);
+		device.WaitForFenceValue (frame);
+	}
+	CHECK_EQ (device.submissions.size (), 3u);
+	for (const std::vector<CapturingDevice::SubmittedList> &lists : device.submissions)
+	{
+		CHECK_EQ (lists.size (), job_count);
+		for (uint32_t job = 0; job < lists.size (); job++)
+			CHECK (lists[job].pipeline == 100 + job && lists[job].draws == job + 1);
+	}
+	//the allocators of finished frames are reused
+	CHECK (pool.GetAllocatorCount () <= 2 * job_count);
+}
+
+TEST (ResolvesStatesAcrossLists)
+{
+	CapturingDevice device;
+	CommandAllocatorPool pool (&device);
+	JobSystem job_system (1);
+	ResourceStateRegistry registry;
+	ParallelCommandRecorder recorder (&device, &pool, &job_system, &registry);
+	const GpuResourceHandle texture = 7;
+	registry.Register (texture, 1, GPU_RESOURCE_STATE_COMMON);
+
+	//the first list renders to the texture, the second one samples it
+	recorder.Record (2,
+					 [texture] (uint32_t job, GpuCommandList *command_list, ResourceStateTracker *tracker)
+					 {
+						 tracker->Transition (texture, job == 0 ? GPU_RESOURCE_STATE_RENDER_TARGET : GPU_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+						 tracker->FlushBarriers (command_list);
+						 command_list->SetPipelineState (100 + job);
+					 },
+					 0, 0);
+	recorder.Submit (1);
+
+	//the first barrier is hoisted in front of everything, the second one goes between the lists
+	CHECK_EQ (device.submissions.size (), 1u);
+	const std::vector<CapturingDevice::SubmittedList> &lists = device.submissions[0];
+	CHECK_EQ (lists.size (), 4u);
+	if (lists.size () == 4)
+	{
+		CHECK (lists[0].pipeline == 0 && lists[0].barriers == 1);
+		CHECK (lists[1].pipeline == 100 && lists[1].barriers == 0);
+		CHECK (lists[2].pipeline == 0 && lists[2].barriers == 1);
+		CHECK (lists[3].pipeline == 101 && lists[3].barriers == 0);
+	}
+	CHECK_EQ (recorder.GetBarrierStats ().fixups, 2u);
+	CHECK_EQ (registry.GetState (texture), static_cast<GpuResourceStates>(GPU_RESOURCE_STATE_PIXEL_SHADER_RESOURCE));
+}
+
+TEST (RethrowsJobExceptions)
+{
+	CapturingDevice device;
+	CommandAllocatorPool pool (&device);
+	JobSystem job_system (2);
+	ResourceStateRegistry registry;
+	ParallelCommandRecorder recorder (&device, &pool, &job_system, &registry);
+	CHECK_THROWS (recorder.Record (8,
+								   [] (uint32_t job, GpuCommandList *command_list, ResourceStateTracker *)
+								   {
+									   command_list->DrawInstanced (3, 1, 0, 0);
+									   if (job == 5)
+										   throw std::runtime_error ("job failed");
+								   },
+								   0, 0),
+				  std::runtime_error);
+	CHECK_EQ (recorder.GetRecordedListCount (), 0u);
+	CHECK (device.submissions.empty ());
+
+	//the failed frame left nothing behind
+	recorder.Record (8, [] (uint32_t, GpuCommandList *command_list, ResourceStateTracker *) { command_list->DrawInstanced (3, 1, 0, 0); }, 0, 0);
+	recorder.Submit (1);
+	CHECK (device.submissions.size () == 1 && device.submissions[0].size () == 8);
+	CHECK_EQ (pool.GetAllocatorCount (), 8u);
+}
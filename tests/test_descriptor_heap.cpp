@@ -0,0 +1,171 @@
+#include "test.h"
+#include "descriptor_heap.h"
+#include "null_device.h"
+#include "memory_backends.h"
+
+#include <stdexcept>
+#include <vector>
+
+TEST (CpuHeapGrowsByWholeHeaps)
+{
+	MemoryDescriptorBackend backend;
+	{
+		CpuDescriptorHeap heap (&backend, GPU_DESCRIPTOR_HEAP_TYPE_RTV, 8);
+		std::vector<CpuDescriptor> descriptors;
+		for (int i = 0; i < 20; i++)
+			descriptors.push_back (heap.Allocate ());
+		CHECK_EQ (heap.GetHeapCount (), 3u);
+		CHECK_EQ (heap.GetAllocatedCount (), 20u);
+		CHECK_EQ (backend.live_heaps, 3);
+		//low indices first, each descriptor at its own address
+		CHECK (descriptors[0].index == 0 && descriptors[1].index == 1);
+		CHECK_EQ (descriptors[1].handle - descriptors[0].handle, uint64_t (MemoryDescriptorBackend::increment));
+		for (size_t i = 1; i < descriptors.size (); i++)
+			CHECK (descriptors[i].handle != descriptors[i - 1].handle);
+	}
+	CHECK_EQ (backend.live_heaps, 0);
+}
+
+TEST (CpuHeapReusesFreedDescriptors)
+{
+	MemoryDescriptorBackend backend;
+	CpuDescriptorHeap heap (&backend, GPU_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, 4);
+	std::vector<CpuDescriptor> descriptors;
+	for (int i = 0; i < 8; i++)
+		descriptors.push_back (heap.Allocate ());
+	heap.Free (descriptors[1]);
+	heap.Free (descriptors[6]);
+	CHECK_EQ (heap.GetAllocatedCount (), 6u);
+	//freed slots are handed out again before a heap is added
+	const CpuDescriptor a = heap.Allocate ();
+	const CpuDescriptor b = heap.Allocate ();
+	CHECK ((a.handle == descriptors[6].handle && b.handle == descriptors[1].handle) ||
+		   (a.handle == descriptors[1].handle && b.handle == descriptors[6].handle));
+	CHECK_EQ (heap.GetHeapCount (), 2u);
+}
+
+TEST (CpuHeapRejectsBadFrees)
+{
+	MemoryDescriptorBackend backend;
+	CHECK_THROWS (CpuDescriptorHeap (&backend, GPU_DESCRIPTOR_HEAP_TYPE_DSV, 0), std::invalid_argument);
+	CpuDescriptorHeap heap (&backend, GPU_DESCRIPTOR_HEAP_TYPE_DSV, 4);
+	const CpuDescriptor descriptor = heap.Allocate ();
+	heap.Free (descriptor);
+	CHECK_THROWS (heap.Free (descriptor), std::logic_error);
+	CpuDescriptor foreign = descriptor;
+	foreign.heap = 5;
+	CHECK_THROWS (heap.Free (foreign), std::logic_error);
+}
+
+TEST (StagedTablesAreCopiedInOneBatch)
+{
+	NullDevice device;
+	MemoryDescriptorBackend backend;
+	CpuDescriptorHeap staging (&backend, GPU_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, 64);
+	std::vector<CpuDescriptor> sources;
+	for (uint64_t i = 0; i < 16; i++)
+	{
+		sources.push_back (staging.Allocate ());
+		MemoryDescriptorBackend::SetDescriptor (sources.back ().handle, 1000 + i);
+	}
+	ShaderDescriptorHeap heap (&device, &backend, 64, 128);
+
+	//contiguous sources, then scattered ones
+	GpuDescriptorHandle run[8];
+	for (int i = 0; i < 8; i++)
+		run[i] = sources[i].handle;
+	GpuDescriptorHandle scattered[4] = { sources[15].handle, sources[9].handle, sources[10].handle, sources[3].handle };
+	const DescriptorTable a = heap.StageTable (8, run);
+	const DescriptorTable b = heap.StageTable (4, scattered);
+	CHECK_EQ (backend.copy_calls, 0u);
+	heap.FlushCopies ();
+	CHECK_EQ (backend.copy_calls, 1u);
+	//the run and 9, 10 are merged into single source ranges
+	CHECK_EQ (backend.src_ranges, 4u);
+	CHECK (!backend.copied_count_mismatch);
+	for (uint64_t i = 0; i < 8; i++)
+		CHECK_EQ (MemoryDescriptorBackend::GetDescriptor (a.cpu_handle + i * MemoryDescriptorBackend::increment), 1000 + i);
+	CHECK_EQ (MemoryDescriptorBackend::GetDescriptor (b.cpu_handle), 1015u);
+	CHECK_EQ (MemoryDescriptorBackend::GetDescriptor (b.cpu_handle + 1 * MemoryDescriptorBackend::increment), 1009u);
+	CHECK_EQ (MemoryDescriptorBackend::GetDescriptor (b.cpu_handle + 2 * MemoryDescriptorBackend::increment), 1010u);
+	CHECK_EQ (MemoryDescriptorBackend::GetDescriptor (b.cpu_handle + 3 * MemoryDescriptorBackend::increment), 1003u);
+	//nothing staged, nothing copied
+	heap.FlushCopies ();
+	CHECK_EQ (backend.copy_calls, 1u);
+
+	const ShaderDescriptorStats stats = heap.GetStats ();
+	CHECK (stats.staged_tables == 2 && stats.copy_batches == 1 && stats.ring_used == 12);
+}
+
+TEST (StagedCopiesMustFitAndBeFlushed)
+{
+	NullDevice device;
+	MemoryDescriptorBackend backend;
+	CpuDescriptorHeap staging (&backend, GPU_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, 4);
+	ShaderDescriptorHeap heap (&device, &backend, 0, 16);
+	GpuDescriptorHandle sources[4];
+	for (GpuDescriptorHandle &source : sources)
+		source = staging.Allocate ().handle;
+	const DescriptorTable table = heap.AllocateFrame (4);
+	CHECK_THROWS (heap.StageCopy (table, 2, 4, sources), std::out_of_range);
+	heap.StageCopy (table, 1, 3, sources);
+	CHECK_THROWS (heap.FinishFrame (1), std::logic_error);
+	heap.FlushCopies ();
+	heap.FinishFrame (1);
+	CHECK_THROWS (heap.AllocatePersistent (1), std::runtime_error);
+}
+
+TEST (PersistentTablesPrecedeTheRing)
+{
+	NullDevice device;
+	MemoryDescriptorBackend backend;
+	ShaderDescriptorHeap heap (&device, &backend, 32, 64);
+	const DescriptorTable a = heap.AllocatePersistent (10);
+	const DescriptorTable b = heap.AllocatePersistent (20);
+	CHECK (a.offset + a.count <= b.offset || b.offset + b.count <= a.offset);
+	CHECK (a.offset + a.count <= 32 && b.offset + b.count <= 32);
+	CHECK_EQ (b.gpu_handle - a.gpu_handle, b.cpu_handle - a.cpu_handle);
+	CHECK_THROWS (heap.AllocatePersistent (8), std::runtime_error);
+	heap.FreePersistent (a);
+	CHECK_EQ (heap.AllocatePersistent (8).offset, a.offset);
+	CHECK_EQ (heap.GetStats ().persistent_used, 28u);
+
+	const DescriptorTable frame = heap.AllocateFrame (64);
+	CHECK_EQ (frame.offset, 32u);
+	CHECK_THROWS (heap.FreePersistent (frame), std::logic_error);
+}
+
+TEST (RingWaitsForTheOldestFrame)
+{
+	NullDeviceDesc desc;
+	desc.real_time_clock = false;
+	NullDevice device (desc);
+	MemoryDescriptorBackend backend;
+	ShaderDescriptorHeap heap (&device, &backend, 0, 100);
+	CHECK_THROWS (heap.AllocateFrame (101), std::runtime_error);
+
+	//frames of 40 descriptors with 1 ms of GPU work each: the third waits for the first
+	uint64_t fence_value = 0;
+	for (int frame = 0; frame < 3; frame++)
+	{
+		heap.AllocateFrame (40);
+		device.AddGpuWork (1000000);
+		device.ExecuteCommandLists (0, nullptr);
+		device.Signal (++fence_value);
+		heap.FinishFrame (fence_value);
+	}
+	CHECK_EQ (heap.GetStats ().stalls, 1u);
+	CHECK (device.GetCompletedFenceValue () >= 1);
+
+	//once the GPU caught up frames are reclaimed at FinishFrame without stalls
+	device.WaitForFenceValue (fence_value);
+	for (int frame = 0; frame < 10; frame++)
+	{
+		heap.AllocateFrame (40);
+		device.Signal (++fence_value);
+		heap.FinishFrame (fence_value);
+	}
+	const ShaderDescriptorStats stats = heap.GetStats ();
+	CHECK_EQ (stats.stalls, 1u);
+	CHECK_EQ (stats.ring_used, 0u);
+}
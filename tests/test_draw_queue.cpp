@@ -0,0 +1,306 @@
+#include "test.h"
+#include "draw_queue.h"
+#include "null_device.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <random>
+#include <stdexcept>
+
+static DrawGeometry MakeGeometry (GpuVirtualAddress vertices, GpuVirtualAddress indices, uint32_t count, uint32_t start)
+{
+	DrawGeometry geometry;
+	memset (&geometry, 0, sizeof (geometry));
+	geometry.vertex_buffer.location = vertices;
+	geometry.vertex_buffer.size = 4096;
+	geometry.vertex_buffer.stride = 20;
+	geometry.index_buffer.location = indices;
+	geometry.index_buffer.size = indices ? 4096 : 0;
+	geometry.index_buffer.format = 57;     //DXGI_FORMAT_R16_UINT
+	geometry.count = count;
+	geometry.start = start;
+	return geometry;
+}
+
+//commands of a recorded list by type, and its draws
+struct RecordedList
+{
+	uint32_t commands[NULL_COMMAND_COUNT];
+	std::vector<NullDrawIndexedPayload> indexed_draws;
+	std::vector<NullDrawPayload> draws;
+	std::vector<NullExecuteIndirectPayload> indirect_calls;
+	std::vector<GpuPipelineHandle> pipelines;
+};
+
+static RecordedList ReadList (const NullCommandList &command_list)
+{
+	RecordedList list;
+	memset (list.commands, 0, sizeof (list.commands));
+	NullCommandReader reader (command_list);
+	NullCommandHeader header;
+	const uint8_t *payload;
+	while (reader.Next (header, payload))
+	{
+		list.commands[header.type]++;
+		if (header.type == NULL_COMMAND_DRAW_INDEXED_INSTANCED)
+			list.indexed_draws.push_back (NullCommandReader::Read<NullDrawIndexedPayload>(payload));
+		else if (header.type == NULL_COMMAND_DRAW_INSTANCED)
+			list.draws.push_back (NullCommandReader::Read<NullDrawPayload>(payload));
+		else if (header.type == NULL_COMMAND_EXECUTE_INDIRECT)
+			list.indirect_calls.push_back (NullCommandReader::Read<NullExecuteIndirectPayload>(payload));
+		else if (header.type == NULL_COMMAND_SET_PIPELINE_STATE)
+			list.pipelines.push_back (NullCommandReader::Read<GpuPipelineHandle>(payload));
+	}
+	return list;
+}
+
+TEST (SortKeysRoundTripAndOrder)
+{
+	const uint64_t key = MakeDrawSortKey (3, DRAW_ORDER_STATE, 5, 1000, 40000, 0.5f);
+	const DrawSortKeyFields fields = DecodeDrawSortKey (key);
+	CHECK_EQ (fields.pass, 3u);
+	CHECK_EQ (fields.order, DRAW_ORDER_STATE);
+	CHECK_EQ (fields.root_signature, 5u);
+	CHECK_EQ (fields.pipeline, 1000u);
+	CHECK_EQ (fields.geometry, 40000u);
+	CHECK_EQ (fields.depth, (1u << draw_depth_bits) / 2);
+	const DrawSortKeyFields blended = DecodeDrawSortKey (MakeDrawSortKey (15, DRAW_ORDER_BACK_TO_FRONT, 63, 4095, 65535, 2.0f));
+	CHECK_EQ (blended.order, DRAW_ORDER_BACK_TO_FRONT);
+	CHECK_EQ (blended.pass, 15u);
+	CHECK_EQ (blended.root_signature, 63u);
+	CHECK_EQ (blended.pipeline, 4095u);
+	CHECK_EQ (blended.geometry, 65535u);
+	CHECK_EQ (blended.depth, (1u << draw_depth_bits) - 1);
+
+	//passes first, then state before depth for opaque draws and depth before state for blended ones
+	CHECK (MakeDrawSortKey (0, DRAW_ORDER_BACK_TO_FRONT, 9, 9, 9, 0.0f) < MakeDrawSortKey (1, DRAW_ORDER_STATE, 0, 0, 0, 0.0f));
+	CHECK (MakeDrawSortKey (0, DRAW_ORDER_STATE, 0, 1, 0, 0.9f) < MakeDrawSortKey (0, DRAW_ORDER_STATE, 0, 2, 0, 0.1f));
+	CHECK (MakeDrawSortKey (0, DRAW_ORDER_STATE, 0, 1, 0, 0.1f) < MakeDrawSortKey (0, DRAW_ORDER_STATE, 0, 1, 0, 0.9f));
+	CHECK (MakeDrawSortKey (0, DRAW_ORDER_BACK_TO_FRONT, 0, 2, 0, 0.9f) < MakeDrawSortKey (0, DRAW_ORDER_BACK_TO_FRONT, 0, 1, 0, 0.1f));
+	CHECK_THROWS (MakeDrawSortKey (16, DRAW_ORDER_STATE, 0, 0, 0, 0.0f), std::out_of_range);
+	CHECK_THROWS (MakeDrawSortKey (0, DRAW_ORDER_STATE, 64, 0, 0, 0.0f), std::out_of_range);
+	CHECK_THROWS (MakeDrawSortKey (0, DRAW_ORDER_STATE, 0, 4096, 0, 0.0f), std::out_of_range);
+	CHECK_THROWS (MakeDrawSortKey (0, DRAW_ORDER_STATE, 0, 0, 65536, 0.0f), std::out_of_range);
+}
+
+TEST (RadixSortIsStable)
+{
+	std::mt19937_64 random (7);
+	std::vector<DrawPacket> packets (20000);
+	for (uint32_t i = 0; i < packets.size (); i++)
+	{
+		//few distinct keys so that stability matters, with bytes that vary and bytes that do not
+		const uint64_t key = (random () % 300) * 0x0001000100010001ull | 0x3000000000000000ull;
+		const DrawPacket packet = { key, i, 0 };
+		packets[i] = packet;
+	}
+	std::vector<DrawPacket> expected = packets;
+	std::stable_sort (expected.begin (), expected.end (), [] (const DrawPacket &a, const DrawPacket &b) { return a.key < b.key; });
+	std::vector<DrawPacket> scratch;
+	SortDrawPackets (packets, scratch);
+	CHECK_EQ (scratch.size (), packets.size ());
+	bool same = true;
+	for (size_t i = 0; i < packets.size (); i++)
+		same = same && packets[i].key == expected[i].key && packets[i].instance == expected[i].instance;
+	CHECK (same);
+
+	std::vector<DrawPacket> one (1, packets[0]);
+	SortDrawPackets (one, scratch);
+	CHECK_EQ (one[0].instance, packets[0].instance);
+}
+
+TEST (MergesPacketsOfTheSameStateIntoInstancedDraws)
+{
+	DrawQueue queue;
+	const uint32_t root_signature = queue.AddRootSignature (100);
+	const uint32_t pipeline = queue.AddPipeline (200, GPU_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	const uint32_t rock = queue.AddGeometry (MakeGeometry (0x10000, 0x20000, 36, 0));
+	const uint32_t tree = queue.AddGeometry (MakeGeometry (0x30000, 0x40000, 600, 0));
+
+	//interleaved submission at decreasing depths
+	for (uint32_t i = 0; i < 10; i++)
+		queue.Submit (MakeDrawSortKey (0, DRAW_ORDER_STATE, root_signature, pipeline, i % 2 ? tree : rock, 1.0f - i * 0.05f), i);
+	queue.Build (false);
+	CHECK_EQ (queue.GetBatchCount (), 2u);
+	CHECK_EQ (queue.GetGroupCount (), 2u);
+	const DrawBatch &rocks = queue.GetBatches ()[0];
+	const DrawBatch &trees = queue.GetBatches ()[1];
+	CHECK_EQ (rocks.geometry, rock);
+	CHECK_EQ (rocks.instance_count, 5u);
+	CHECK_EQ (rocks.start_instance, 0u);
+	CHECK_EQ (trees.instance_count, 5u);
+	CHECK_EQ (trees.start_instance, 5u);
+	//front to back within each batch
+	const uint32_t expected[] = { 8, 6, 4, 2, 0, 9, 7, 5, 3, 1 };
+	CHECK (std::equal (expected, expected + 10, queue.GetInstances ().begin ()));
+
+	//the next frame starts empty
+	queue.Reset ();
+	CHECK_EQ (queue.GetPacketCount (), 0u);
+	queue.Submit (MakeDrawSortKey (0, DRAW_ORDER_STATE, root_signature, pipeline + 1, rock, 0.0f), 0);
+	CHECK_THROWS (queue.Build (false), std::out_of_range);
+}
+
+TEST (RecordsOnlyStateThatChanges)
+{
+	DrawQueue queue;
+	const DrawRootTable table = { 2, 0x9000 };
+	const uint32_t root_signature = queue.AddRootSignature (100, 1, &table);
+	const uint32_t opaque = queue.AddPipeline (200, GPU_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	const uint32_t alpha_tested = queue.AddPipeline (201, GPU_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	const uint32_t lines = queue.AddPipeline (202, GPU_PRIMITIVE_TOPOLOGY_LINELIST);
+	//two submeshes of one mesh share their buffers, a debug line list has no index buffer
+	DrawGeometry body = MakeGeometry (0x10000, 0x20000, 300, 0);
+	body.constants_parameter = 1;
+	body.constant_count = 2;
+	body.constants[0] = 7;
+	DrawGeometry wheels = body;
+	wheels.count = 120;
+	wheels.start = 300;
+	const uint32_t body_id = queue.AddGeometry (body);
+	const uint32_t wheels_id = queue.AddGeometry (wheels);
+	const uint32_t line_id = queue.AddGeometry (MakeGeometry (0x50000, 0, 64, 0));
+
+	std::mt19937 random (3);
+	for (uint32_t i = 0; i < 300; i++)
+	{
+		const uint32_t geometry = i % 3 ? body_id : wheels_id;
+		const uint32_t pipeline = i % 4 ? opaque : alpha_tested;
+		queue.Submit (MakeDrawSortKey (0, DRAW_ORDER_STATE, root_signature, pipeline, geometry, (random () % 1000) / 1000.0f), i);
+	}
+	queue.Submit (MakeDrawSortKey (1, DRAW_ORDER_STATE, root_signature, lines, line_id, 0.0f), 1000);
+	queue.Build (false);
+	//two pipelines times two geometries, and the lines
+	CHECK_EQ (queue.GetBatchCount (), 5u);
+	CHECK_EQ (queue.GetGroupCount (), 3u);
+
+	NullCommandAllocator allocator;
+	NullCommandList command_list (&allocator);
+	const GpuVertexBufferView instance_buffer = { 0x80000, 4 * 301, 4 };
+	const DrawRecordStats stats = queue.Record (&command_list, 0, queue.GetGroupCount (), &instance_buffer, nullptr);
+	command_list.Close ();
+	const RecordedList list = ReadList (command_list);
+
+	CHECK_EQ (stats.root_signatures, 1u);
+	CHECK_EQ (list.commands[NULL_COMMAND_SET_ROOT_SIGNATURE], 1u);
+	CHECK_EQ (list.commands[NULL_COMMAND_SET_ROOT_TABLE], 1u);
+	CHECK_EQ (stats.pipelines, 3u);
+	CHECK (list.pipelines == std::vector<GpuPipelineHandle> ({ 200, 201, 202 }));
+	CHECK_EQ (stats.topologies, 2u);
+	CHECK_EQ (list.commands[NULL_COMMAND_SET_PRIMITIVE_TOPOLOGY], 2u);
+	//instances, the mesh and the lines
+	CHECK_EQ (list.commands[NULL_COMMAND_SET_VERTEX_BUFFERS], 3u);
+	CHECK_EQ (list.commands[NULL_COMMAND_SET_INDEX_BUFFER], 1u);
+	CHECK_EQ (list.commands[NULL_COMMAND_SET_ROOT_CONSTANTS], 1u);
+	CHECK_EQ (stats.draws, 5u);
+	CHECK_EQ (list.indexed_draws.size (), 4u);
+	CHECK_EQ (list.draws.size (), 1u);
+
+	//draws cover every instance once, with the ranges of their geometry
+	uint32_t instances = 0;
+	for (const NullDrawIndexedPayload &draw : list.indexed_draws)
+	{
+		CHECK_EQ (draw.start_instance, instances);
+		CHECK (draw.index_count == 300 || draw.index_count == 120);
+		CHECK_EQ (draw.start_index, draw.index_count == 300 ? 0u : 300u);
+		instances += draw.instance_count;
+	}
+	CHECK_EQ (instances, 300u);
+	CHECK_EQ (list.draws[0].vertex_count, 64u);
+	CHECK_EQ (list.draws[0].start_instance, 300u);
+	CHECK_EQ (queue.GetInstances ()[300], 1000u);
+	CHECK_EQ (command_list.GetCommandCount (), 1 + 1 + 3 + 2 + 3 + 1 + 1 + 5u);
+	CHECK_THROWS (queue.Record (&command_list, 2, 2, nullptr, nullptr), std::out_of_range);
+}
+
+TEST (IndirectModeIssuesOneCallPerGroup)
+{
+	DrawQueue queue;
+	const uint32_t root_signature = queue.AddRootSignature (100);
+	const uint32_t pipeline = queue.AddPipeline (200, GPU_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	const uint32_t lines = queue.AddPipeline (201, GPU_PRIMITIVE_TOPOLOGY_LINELIST);
+	uint32_t submeshes[4];
+	for (uint32_t i = 0; i < 4; i++)
+		submeshes[i] = queue.AddGeometry (MakeGeometry (0x10000, 0x20000, 30 + i, i * 100));
+	const uint32_t line_id = queue.AddGeometry (MakeGeometry (0x50000, 0, 64, 8));
+	for (uint32_t i = 0; i < 40; i++)
+		queue.Submit (MakeDrawSortKey (0, DRAW_ORDER_STATE, root_signature, pipeline, submeshes[i % 4], 0.5f), i);
+	queue.Submit (MakeDrawSortKey (0, DRAW_ORDER_STATE, root_signature, lines, line_id, 0.5f), 40);
+	queue.Build (true);
+	CHECK_EQ (queue.GetBatchCount (), 5u);
+	CHECK_EQ (queue.GetGroupCount (), 2u);
+	CHECK (queue.GetGroups ()[0].indexed);
+	CHECK (!queue.GetGroups ()[1].indexed);
+
+	//arguments of every batch in group order
+	const std::vector<uint8_t> &arguments = queue.GetIndirectArguments ();
+	CHECK_EQ (arguments.size (), 4 * sizeof (GpuDrawIndexedArguments) + sizeof (GpuDrawArguments));
+	for (uint32_t i = 0; i < 4; i++)
+	{
+		GpuDrawIndexedArguments draw;
+		memcpy (&draw, arguments.data () + i * sizeof (draw), sizeof (draw));
+		CHECK_EQ (draw.index_count, 30 + i);
+		CHECK_EQ (draw.instance_count, 10u);
+		CHECK_EQ (draw.start_index, i * 100);
+		CHECK_EQ (draw.start_instance, i * 10);
+	}
+	GpuDrawArguments line_draw;
+	memcpy (&line_draw, arguments.data () + queue.GetGroups ()[1].arguments_offset, sizeof (line_draw));
+	CHECK_EQ (queue.GetGroups ()[1].arguments_offset, 4 * sizeof (GpuDrawIndexedArguments));
+	CHECK_EQ (line_draw.vertex_count, 64u);
+	CHECK_EQ (line_draw.start_vertex, 8u);
+	CHECK_EQ (line_draw.start_instance, 40u);
+
+	NullCommandAllocator allocator;
+	NullCommandList command_list (&allocator);
+	const DrawIndirectBuffers indirect = { 11, 12, 0x7000, 256 };
+	const DrawRecordStats stats = queue.Record (&command_list, 0, queue.GetGroupCount (), nullptr, &indirect);
+	command_list.Close ();
+	const RecordedList list = ReadList (command_list);
+	CHECK_EQ (stats.indirect_calls, 2u);
+	CHECK_EQ (stats.draws, 5u);
+	CHECK (list.indexed_draws.empty () && list.draws.empty ());
+	CHECK_EQ (list.indirect_calls.size (), 2u);
+	CHECK_EQ (list.indirect_calls[0].command_signature, 12u);
+	CHECK_EQ (list.indirect_calls[0].max_command_count, 4u);
+	CHECK_EQ (list.indirect_calls[0].arguments, 0x7000u);
+	CHECK_EQ (list.indirect_calls[0].arguments_offset, 256u);
+	CHECK_EQ (list.indirect_calls[1].command_signature, 11u);
+	CHECK_EQ (list.indirect_calls[1].max_command_count, 1u);
+	CHECK_EQ (list.indirect_calls[1].arguments_offset, 256 + 4 * sizeof (GpuDrawIndexedArguments));
+}
+
+TEST (BlendedPassesDrawBackToFront)
+{
+	DrawQueue queue;
+	const uint32_t root_signature = queue.AddRootSignature (100);
+	const uint32_t glass = queue.AddPipeline (200, GPU_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	const uint32_t smoke = queue.AddPipeline (201, GPU_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	const uint32_t quad = queue.AddGeometry (MakeGeometry (0x10000, 0x20000, 6, 0));
+	const float depths[] = { 0.9f, 0.8f, 0.5f, 0.2f };
+	for (uint32_t i = 0; i < 4; i++)
+		queue.Submit (MakeDrawSortKey (2, DRAW_ORDER_BACK_TO_FRONT, root_signature, i % 2 ? smoke : glass, quad, depths[i]), i);
+	queue.Build (false);
+	//alternating pipelines by depth can not merge
+	CHECK_EQ (queue.GetBatchCount (), 4u);
+	const uint32_t expected[] = { 0, 1, 2, 3 };
+	CHECK (std::equal (expected, expected + 4, queue.GetInstances ().begin ()));
+
+	NullCommandAllocator allocator;
+	NullCommandList command_list (&allocator);
+	queue.Record (&command_list, 0, queue.GetGroupCount (), nullptr, nullptr);
+	command_list.Close ();
+	const RecordedList list = ReadList (command_list);
+	CHECK (list.pipelines == std::vector<GpuPipelineHandle> ({ 200, 201, 200, 201 }));
+	CHECK_EQ (list.commands[NULL_COMMAND_SET_PRIMITIVE_TOPOLOGY], 1u);
+	CHECK_EQ (list.commands[NULL_COMMAND_SET_INDEX_BUFFER], 1u);
+
+	//the same pipeline at neighbouring depths merges
+	queue.Reset ();
+	queue.Submit (MakeDrawSortKey (2, DRAW_ORDER_BACK_TO_FRONT, root_signature, glass, quad, 0.3f), 0);
+	queue.Submit (MakeDrawSortKey (2, DRAW_ORDER_BACK_TO_FRONT, root_signature, glass, quad, 0.6f), 1);
+	queue.Build (false);
+	CHECK_EQ (queue.GetBatchCount (), 1u);
+	CHECK_EQ (queue.GetInstances ()[0], 1u);
+}
@@ -0,0 +1,158 @@
+#include "test.h"
+#include "frame_scheduler.h"
+#include "null_device.h"
+
+#include <stdexcept>
+
+static const uint64_t ms = 1000000;
+
+//frames with a fixed CPU and GPU time on the simulated timeline of a null device
+struct FrameSimulation
+{
+	NullDevice device;
+	FrameScheduler scheduler;
+
+	FrameSimulation (uint32_t frames_in_flight, FramePacingPolicy policy) :
+		device (GetDeviceDesc ()),
+		scheduler (&device, frames_in_flight, policy)
+	{
+		scheduler.SetClock ([this]() { return device.GetCpuTime (); });
+	}
+
+	static NullDeviceDesc GetDeviceDesc ()
+	{
+		NullDeviceDesc desc;
+		desc.gpu_ns_per_list = 0;
+		return desc;
+	}
+
+	void RunFrame (uint64_t cpu_ns, uint64_t gpu_ns)
+	{
+		scheduler.BeginFrame ();
+		device.AdvanceCpuTime (cpu_ns);
+		device.AddGpuWork (gpu_ns);
+		device.ExecuteCommandLists (0, nullptr);
+		scheduler.EndFrame ();
+	}
+};
+
+TEST (RetiresEveryFrameWhenGpuBound)
+{
+	FrameSimulation simulation (2, FRAME_POLICY_MAX_THROUGHPUT);
+	for (int frame = 0; frame < 100; frame++)
+		simulation.RunFrame (2 * ms, 8 * ms);
+	simulation.scheduler.WaitForIdle ();
+
+	const FrameSchedulerStats &stats = simulation.scheduler.GetStats ();
+	CHECK_EQ (stats.frames, 100u);
+	CHECK_EQ (stats.completed_frames, 100u);
+	CHECK_EQ (stats.stalls, 98u);
+	//every frame waits on the GPU behind the one before it
+	const uint64_t average = stats.total_latency_ns / stats.completed_frames;
+	CHECK (average >= 15 * ms && average <= 17 * ms);
+	CHECK (stats.max_latency_ns <= 24 * ms);
+}
+
+TEST (RetiresEveryFrameWhenCpuBound)
+{
+	for (uint32_t frames_in_flight = 1; frames_in_flight <= max_frames_in_flight; frames_in_flight++)
+	{
+		FrameSimulation simulation (frames_in_flight, FRAME_POLICY_MAX_THROUGHPUT);
+		for (int frame = 0; frame < 50; frame++)
+			simulation.RunFrame (8 * ms, 2 * ms);
+		simulation.scheduler.WaitForIdle ();
+		const FrameSchedulerStats &stats = simulation.scheduler.GetStats ();
+		CHECK_EQ (stats.completed_frames, 50u);
+		//observed when the slot is reused at the latest
+		CHECK (stats.max_latency_ns <= 8 * ms * frames_in_flight + 2 * ms);
+		//a single slot waits for the GPU every frame
+		if (frames_in_flight > 1)
+			CHECK_EQ (stats.stalls, 0u);
+		else
+			CHECK_EQ (stats.stall_ns, 49 * 2 * ms);
+	}
+}
+
+TEST (LowLatencyKeepsOneFrameAhead)
+{
+	FrameSimulation throughput (3, FRAME_POLICY_MAX_THROUGHPUT);
+	FrameSimulation low_latency (3, FRAME_POLICY_LOW_LATENCY);
+	for (int frame = 0; frame < 60; frame++)
+	{
+		throughput.RunFrame (2 * ms, 8 * ms);
+		low_latency.RunFrame (2 * ms, 8 * ms);
+	}
+	throughput.scheduler.WaitForIdle ();
+	low_latency.scheduler.WaitForIdle ();
+	const FrameSchedulerStats &a = throughput.scheduler.GetStats ();
+	const FrameSchedulerStats &b = low_latency.scheduler.GetStats ();
+	CHECK_EQ (a.completed_frames, 60u);
+	CHECK_EQ (b.completed_frames, 60u);
+	//three frames queue on the GPU without the limit, two with it
+	CHECK (a.total_latency_ns / a.completed_frames >= 23 * ms);
+	CHECK (b.total_latency_ns / b.completed_frames <= 17 * ms);
+	CHECK (b.max_latency_ns < a.max_latency_ns);
+	//the GPU stays busy either way
+	CHECK (throughput.device.GetCpuTime () == low_latency.device.GetCpuTime ());
+}
+
+TEST (RunsReleasesAfterTheirFrame)
+{
+	FrameSimulation simulation (2, FRAME_POLICY_MAX_THROUGHPUT);
+	std::vector<int> released;
+	for (int frame = 0; frame < 4; frame++)
+	{
+		simulation.scheduler.BeginFrame ();
+		simulation.scheduler.DeferRelease ([&released, frame]() { released.push_back (frame); });
+		simulation.device.AddGpuWork (8 * ms);
+		simulation.device.ExecuteCommandLists (0, nullptr);
+		simulation.scheduler.EndFrame ();
+	}
+	//frames 0 and 1 finished before the slots of frames 2 and 3 were reused
+	CHECK (released.size () == 2 && released[0] == 0 && released[1] == 1);
+	simulation.scheduler.WaitForIdle ();
+	CHECK (released.size () == 4 && released[2] == 2 && released[3] == 3);
+
+	//a value that already passed releases right away
+	bool immediate = false;
+	simulation.scheduler.DeferRelease (1, [&immediate]() { immediate = true; });
+	CHECK (immediate);
+	CHECK_EQ (simulation.scheduler.GetStats ().releases, 5u);
+
+	//a release of the next frame does not wait behind one for a later fence value, past the
+	//values of the frame and of WaitForIdle ()
+	bool next = false, later = false;
+	simulation.scheduler.DeferRelease (simulation.scheduler.GetFrameFenceValue () + 2, [&later]() { later = true; });
+	simulation.scheduler.DeferRelease ([&next]() { next = true; });
+	simulation.RunFrame (ms, 4 * ms);
+	simulation.scheduler.WaitForIdle ();
+	CHECK (next);
+	CHECK (!later);
+}
+
+TEST (ChangesFramesInFlight)
+{
+	FrameSimulation simulation (2, FRAME_POLICY_MAX_THROUGHPUT);
+	CHECK_THROWS (simulation.scheduler.SetFramesInFlight (0), std::out_of_range);
+	CHECK_THROWS (simulation.scheduler.SetFramesInFlight (max_frames_in_flight + 1), std::out_of_range);
+	for (int frame = 0; frame < 5; frame++)
+		simulation.RunFrame (ms, 4 * ms);
+	simulation.scheduler.SetFramesInFlight (3);
+	CHECK_EQ (simulation.scheduler.GetFramesInFlight (), 3u);
+	CHECK_EQ (simulation.scheduler.GetStats ().completed_frames, 5u);
+	for (int frame = 0; frame < 6; frame++)
+	{
+		simulation.RunFrame (ms, 4 * ms);
+		CHECK_EQ (simulation.scheduler.GetSlot (), simulation.scheduler.GetFrameNumber () % 3);
+	}
+	simulation.scheduler.WaitForIdle ();
+	CHECK_EQ (simulation.scheduler.GetStats ().completed_frames, 11u);
+}
+
+TEST (RejectsUnbalancedFrames)
+{
+	FrameSimulation simulation (2, FRAME_POLICY_MAX_THROUGHPUT);
+	CHECK_THROWS (simulation.scheduler.EndFrame (), std::logic_error);
+	simulation.scheduler.BeginFrame ();
+	CHECK_THROWS (simulation.scheduler.BeginFrame (), std::logic_error);
+}
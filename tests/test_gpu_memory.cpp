@@ -0,0 +1,214 @@
+#include "test.h"
+#include "gpu_memory.h"
+#include "null_device.h"
+
+#include <map>
+#include <random>
+#include <stdexcept>
+
+static const uint64_t kb = 1024;
+
+TEST (TlsfSplitsFreeBlocks)
+{
+	TlsfAllocator allocator (64 * kb, 4 * kb);
+	TlsfAllocation a, b;
+	CHECK (allocator.Allocate (4 * kb, 4 * kb, 1, a) && a.offset == 0 && a.size == 4 * kb);
+	//sizes round up to the granularity
+	CHECK (allocator.Allocate (5 * kb, 4 * kb, 2, b) && b.offset == 4 * kb && b.size == 8 * kb);
+	CHECK_EQ (allocator.GetUsedSize (), 12 * kb);
+	CHECK_EQ (allocator.GetAllocationCount (), 2u);
+	CHECK_EQ (allocator.GetLargestFreeBlock (), 52 * kb);
+	CHECK_EQ (allocator.GetUserData (b.block), 2u);
+}
+
+TEST (TlsfMergesFreeNeighbours)
+{
+	TlsfAllocator allocator (64 * kb, 4 * kb);
+	TlsfAllocation blocks[4];
+	for (TlsfAllocation &block : blocks)
+		CHECK (allocator.Allocate (16 * kb, 4 * kb, 0, block));
+	TlsfAllocation full;
+	CHECK (!allocator.Allocate (4 * kb, 4 * kb, 0, full));
+
+	//freeing the middle block last merges it with both neighbours
+	allocator.Free (blocks[0].block);
+	allocator.Free (blocks[2].block);
+	CHECK_EQ (allocator.GetLargestFreeBlock (), 16 * kb);
+	allocator.Free (blocks[1].block);
+	CHECK_EQ (allocator.GetLargestFreeBlock (), 48 * kb);
+	allocator.Free (blocks[3].block);
+	CHECK_EQ (allocator.GetLargestFreeBlock (), 64 * kb);
+	CHECK (allocator.Allocate (64 * kb, 4 * kb, 0, full) && full.offset == 0);
+}
+
+TEST (TlsfAlignsAndReusesThePadding)
+{
+	TlsfAllocator allocator (256 * kb, 4 * kb);
+	TlsfAllocation a, b, c;
+	CHECK (allocator.Allocate (4 * kb, 4 * kb, 0, a) && a.offset == 0);
+	CHECK (allocator.Allocate (4 * kb, 64 * kb, 0, b) && b.offset == 64 * kb);
+	//the padding in front of the aligned block stays free
+	CHECK (allocator.Allocate (60 * kb, 4 * kb, 0, c) && c.offset == 4 * kb);
+	CHECK_EQ (allocator.GetUsedSize (), 68 * kb);
+}
+
+TEST (TlsfRejectsBadRequests)
+{
+	CHECK_THROWS (TlsfAllocator (64 * kb, 3 * kb), std::invalid_argument);
+	CHECK_THROWS (TlsfAllocator (66 * kb, 4 * kb), std::invalid_argument);
+	TlsfAllocator allocator (64 * kb, 4 * kb);
+	TlsfAllocation allocation;
+	CHECK_THROWS (allocator.Allocate (4 * kb, 12 * kb, 0, allocation), std::invalid_argument);
+	CHECK (!allocator.Allocate (68 * kb, 4 * kb, 0, allocation));
+	CHECK (allocator.Allocate (4 * kb, 4 * kb, 0, allocation));
+	allocator.Free (allocation.block);
+	CHECK_THROWS (allocator.Free (allocation.block), std::logic_error);
+}
+
+TEST (TlsfFuzzKeepsBlocksDisjoint)
+{
+	const uint64_t size = 16 * 1024 * kb;
+	TlsfAllocator allocator (size, 4 * kb);
+	std::mt19937 random (99);
+	std::map<uint64_t, TlsfAllocation> live;    //by offset
+	uint64_t used = 0;
+	bool valid = true;
+	for (int step = 0; step < 100000 && valid; step++)
+	{
+		if (live.empty () || random () % 3)
+		{
+			const uint64_t bytes = (1 + random () % 256) * kb;
+			const uint64_t alignment = 4 * kb << (random () % 5);
+			TlsfAllocation allocation;
+			if (!allocator.Allocate (bytes, alignment, step, allocation))
+				continue;
+			valid &= allocation.offset % alignment == 0 && allocation.size >= bytes && allocation.offset + allocation.size <= size;
+			//no overlap with the neighbours in address order
+			auto next = live.lower_bound (allocation.offset);
+			if (next != live.end ())
+				valid &= allocation.offset + allocation.size <= next->first;
+			if (next != live.begin ())
+			{
+				auto prev = std::prev (next);
+				valid &= prev->first + prev->second.size <= allocation.offset;
+			}
+			live[allocation.offset] = allocation;
+			used += allocation.size;
+		}
+		else
+		{
+			auto it = live.begin ();
+			std::advance (it, random () % live.size ());
+			used -= it->second.size;
+			allocator.Free (it->second.block);
+			live.erase (it);
+		}
+		valid &= allocator.GetUsedSize () == used && allocator.GetAllocationCount () == live.size ();
+	}
+	CHECK (valid);
+
+	std::vector<TlsfAllocation> allocations;
+	allocator.GetAllocations (allocations);
+	CHECK_EQ (allocations.size (), live.size ());
+	for (auto &entry : live)
+		allocator.Free (entry.second.block);
+	//everything merged back into one block
+	CHECK_EQ (allocator.GetLargestFreeBlock (), size);
+}
+
+TEST (HeapsAreSeparatedByTier)
+{
+	NullMemory memory (1ull << 40);
+	{
+		GpuMemoryAllocator allocator (&memory, 1024 * kb);
+		const GpuMemoryAllocation buffer = allocator.Allocate (GPU_HEAP_TIER_BUFFERS, 64 * kb, gpu_default_placement_alignment);
+		const GpuMemoryAllocation texture = allocator.Allocate (GPU_HEAP_TIER_TEXTURES, 4 * kb, gpu_small_placement_alignment);
+		CHECK (buffer.heap != texture.heap);
+		CHECK_EQ (memory.GetStats ().heaps, 2u);
+
+		//resources larger than a heap get one of their own, destroyed with them
+		const GpuMemoryAllocation large = allocator.Allocate (GPU_HEAP_TIER_TEXTURES, 2000 * kb, gpu_default_placement_alignment);
+		CHECK_EQ (memory.GetStats ().heaps, 3u);
+		CHECK_EQ (allocator.GetStats (GPU_HEAP_TIER_TEXTURES).reserved_bytes, 1024 * kb + 2048 * kb);
+		allocator.Free (large);
+		CHECK_EQ (memory.GetStats ().heaps, 2u);
+
+		//small resources pack at 4 KB
+		const GpuMemoryAllocation small = allocator.Allocate (GPU_HEAP_TIER_TEXTURES, 4 * kb, gpu_small_placement_alignment);
+		CHECK (small.heap == texture.heap && small.offset == 4 * kb);
+		CHECK_THROWS (allocator.Free (GpuMemoryAllocation { 99, 0, 0, GPU_HEAP_TIER_BUFFERS, 7, 0 }), std::logic_error);
+	}
+	CHECK_EQ (memory.GetStats ().heaps, 0u);
+}
+
+TEST (ReportsUsageAndFragmentation)
+{
+	NullMemory memory (1ull << 40);
+	GpuMemoryAllocator allocator (&memory, 1024 * kb);
+	std::vector<GpuMemoryAllocation> allocations;
+	for (int i = 0; i < 16; i++)
+		allocations.push_back (allocator.Allocate (GPU_HEAP_TIER_BUFFERS, 64 * kb, gpu_default_placement_alignment));
+	GpuMemoryStats stats = allocator.GetStats (GPU_HEAP_TIER_BUFFERS);
+	CHECK (stats.heap_count == 1 && stats.allocation_count == 16 && stats.used_bytes == 1024 * kb);
+	CHECK_EQ (stats.fragmentation, 0.0);
+
+	//every other block free: 8 holes of 64 KB
+	for (int i = 0; i < 16; i += 2)
+		allocator.Free (allocations[i]);
+	stats = allocator.GetStats (GPU_HEAP_TIER_BUFFERS);
+	CHECK_EQ (stats.largest_free_block, 64 * kb);
+	CHECK_EQ (stats.fragmentation, 1.0 - 1.0 / 8.0);
+
+	//a request no hole fits opens a second heap, which is released once empty again
+	const GpuMemoryAllocation wide = allocator.Allocate (GPU_HEAP_TIER_BUFFERS, 128 * kb, gpu_default_placement_alignment);
+	CHECK_EQ (allocator.GetStats (GPU_HEAP_TIER_BUFFERS).heap_count, 2u);
+	allocator.Free (wide);
+	for (int i = 1; i < 16; i += 2)
+		allocator.Free (allocations[i]);
+	allocator.ReleaseEmptyHeaps ();
+	CHECK_EQ (allocator.GetStats (GPU_HEAP_TIER_BUFFERS).heap_count, 1u);
+}
+
+TEST (DefragmentEmptiesTheSparsestHeapAndCompacts)
+{
+	NullMemory memory (1ull << 40);
+	GpuMemoryAllocator allocator (&memory, 1024 * kb);
+	std::vector<GpuMemoryAllocation> allocations;
+	//two full heaps
+	for (int i = 0; i < 32; i++)
+		allocations.push_back (allocator.Allocate (GPU_HEAP_TIER_BUFFERS, 64 * kb, gpu_default_placement_alignment, i));
+	//the first heap keeps 12 blocks, the second one 2
+	for (int i = 0; i < 32; i++)
+		if ((i < 16 && i % 4 == 0) || (i >= 16 && i != 20 && i != 30))
+			allocator.Free (allocations[i]);
+
+	//the blocks of the second heap move into holes of the first one, then the first
+	//heap moves its last blocks into the remaining holes
+	std::vector<GpuMemoryMove> moves;
+	CHECK_EQ (allocator.Defragment (GPU_HEAP_TIER_BUFFERS, 1024 * kb, moves), 4u);
+	const GpuHeapHandle first_heap = allocations[0].heap;
+	const GpuHeapHandle second_heap = allocations[16].heap;
+	for (size_t i = 0; i < moves.size (); i++)
+	{
+		const GpuMemoryMove &move = moves[i];
+		CHECK (move.dst.heap == first_heap);
+		if (i < 2)
+			CHECK (move.src.heap == second_heap && (move.user_data == 20 || move.user_data == 30));
+		else
+			CHECK (move.src.heap == first_heap && move.dst.offset < move.src.offset);
+		allocator.Free (move.src);
+	}
+	const GpuMemoryStats stats = allocator.GetStats (GPU_HEAP_TIER_BUFFERS);
+	CHECK (stats.allocation_count == 14 && stats.used_bytes == 14 * 64 * kb);
+	//the first heap is packed to its start and the second one is empty
+	const GpuMemoryAllocation tail = allocator.Allocate (GPU_HEAP_TIER_BUFFERS, 128 * kb, gpu_default_placement_alignment);
+	CHECK (tail.heap == first_heap && tail.offset == 896 * kb);
+	const GpuMemoryAllocation whole = allocator.Allocate (GPU_HEAP_TIER_BUFFERS, 1024 * kb, gpu_default_placement_alignment);
+	CHECK (whole.heap == second_heap && whole.offset == 0);
+
+	//the byte limit stops the plan
+	allocator.Free (whole);
+	allocator.Free (allocations[1]);
+	moves.clear ();
+	CHECK_EQ (allocator.Defragment (GPU_HEAP_TIER_BUFFERS, 32 * kb, moves), 0u);
+}
@@ -0,0 +1,177 @@
+#include "test.h"
+#include "job_system.h"
+
+#include <stdexcept>
+
+TEST (RunsSpawnedJobs)
+{
+	JobSystem job_system (3);
+	CHECK_EQ (job_system.GetThreadCount (), 4u);
+	std::atomic<uint32_t> sum (0);
+	JobCounter counter;
+	for (uint32_t i = 1; i <= 1000; i++)
+		job_system.Spawn ([&sum, i]() { sum.fetch_add (i, std::memory_order_relaxed); }, counter);
+	job_system.Wait (counter);
+	CHECK (counter.IsDone ());
+	CHECK_EQ (sum.load (), 500500u);
+	CHECK (job_system.GetStats ().executed_jobs >= 1000);
+}
+
+TEST (RunsNestedJobs)
+{
+	JobSystem job_system (2);
+	std::atomic<uint32_t> leaves (0);
+	JobCounter counter;
+	for (int i = 0; i < 16; i++)
+		job_system.Spawn ([&job_system, &leaves]()
+		{
+			//a job waiting for its children keeps running other jobs
+			JobCounter children;
+			for (int j = 0; j < 16; j++)
+				job_system.Spawn ([&leaves]() { leaves.fetch_add (1, std::memory_order_relaxed); }, children);
+			job_system.Wait (children);
+		}, counter);
+	job_system.Wait (counter);
+	CHECK_EQ (leaves.load (), 256u);
+}
+
+TEST (RethrowsTheFirstException)
+{
+	JobSystem job_system (2);
+	std::atomic<uint32_t> finished (0);
+	JobCounter counter;
+	for (int i = 0; i < 100; i++)
+		job_system.Spawn ([&finished, i]()
+		{
+			if (i % 10 == 3)
+				throw std::runtime_error ("job failed");
+			finished.fetch_add (1, std::memory_order_relaxed);
+		}, counter);
+	CHECK_THROWS (job_system.Wait (counter), std::runtime_error);
+	//the other jobs still ran
+	CHECK_EQ (finished.load (), 90u);
+}
+
+TEST (ParallelForCoversTheRangeOnce)
+{
+	JobSystem job_system (3);
+	for (uint32_t count : { 0u, 1u, 7u, 1000u, 100000u })
+		for (uint32_t min_chunk : { 0u, 1u, 64u, 5000u })
+		{
+			std::vector<std::atomic<uint32_t>> hits (count);
+			for (std::atomic<uint32_t> &hit : hits)
+				hit.store (0, std::memory_order_relaxed);
+			std::atomic<bool> small_chunk (false);
+			job_system.ParallelFor (count, min_chunk, [&hits, &small_chunk, count, min_chunk] (uint32_t begin, uint32_t end)
+			{
+				//only a range shorter than the minimum can not be split into two chunks of it
+				if (end - begin < min_chunk && end - begin != count)
+					small_chunk.store (true);
+				for (uint32_t i = begin; i < end; i++)
+					hits[i].fetch_add (1, std::memory_order_relaxed);
+			});
+			bool once = true;
+			for (std::atomic<uint32_t> &hit : hits)
+				once &= hit.load () == 1;
+			CHECK (once);
+			CHECK (!small_chunk.load ());
+		}
+}
+
+TEST (ParallelForPropagatesExceptions)
+{
+	JobSystem job_system (3);
+	CHECK_THROWS (job_system.ParallelFor (10000, 16, [] (uint32_t begin, uint32_t end)
+	{
+		if (begin <= 5000 && 5000 < end)
+			throw std::runtime_error ("range failed");
+	}), std::runtime_error);
+	//the system is still usable
+	std::atomic<uint32_t> count (0);
+	job_system.ParallelFor (1000, 1, [&count] (uint32_t begin, uint32_t end) { count.fetch_add (end - begin); });
+	CHECK_EQ (count.load (), 1000u);
+}
+
+TEST (GraphRunsInDependencyOrder)
+{
+	JobSystem job_system (3);
+	JobGraph graph;
+	//a diamond repeated in a chain: top -> (left, right) -> bottom -> next top
+	std::atomic<uint32_t> clock (0);
+	std::vector<uint32_t> finished (40, 0);
+	std::vector<JobGraph::Node> nodes;
+	for (uint32_t i = 0; i < 40; i++)
+		nodes.push_back (graph.AddNode ([&clock, &finished, i]() { finished[i] = clock.fetch_add (1) + 1; }));
+	for (uint32_t i = 0; i < 40; i += 4)
+	{
+		graph.AddDependency (nodes[i], nodes[i + 1]);
+		graph.AddDependency (nodes[i], nodes[i + 2]);
+		graph.AddDependency (nodes[i + 1], nodes[i + 3]);
+		graph.AddDependency (nodes[i + 2], nodes[i + 3]);
+		if (i + 4 < 40)
+			graph.AddDependency (nodes[i + 3], nodes[i + 4]);
+	}
+	for (int run = 0; run < 3; run++)
+	{
+		clock.store (0);
+		job_system.Run (graph);
+		for (uint32_t i = 0; i < 40; i += 4)
+		{
+			CHECK (finished[i] < finished[i + 1] && finished[i] < finished[i + 2]);
+			CHECK (finished[i + 1] < finished[i + 3] && finished[i + 2] < finished[i + 3]);
+		}
+		CHECK_EQ (clock.load (), 40u);
+	}
+}
+
+TEST (GraphRejectsCyclesAndBadNodes)
+{
+	JobSystem job_system (1);
+	JobGraph graph;
+	const JobGraph::Node a = graph.AddNode ([]() {});
+	const JobGraph::Node b = graph.AddNode ([]() {});
+	const JobGraph::Node c = graph.AddNode ([]() {});
+	CHECK_THROWS (graph.AddDependency (a, a), std::logic_error);
+	CHECK_THROWS (graph.AddDependency (a, 7), std::out_of_range);
+	graph.AddDependency (a, b);
+	graph.AddDependency (b, c);
+	graph.AddDependency (c, a);
+	CHECK_THROWS (job_system.Run (graph), std::logic_error);
+}
+
+TEST (SkipsNodesAfterAFailedOne)
+{
+	JobSystem job_system (2);
+	JobGraph graph;
+	bool after_ran = false;
+	bool independent_ran = false;
+	const JobGraph::Node failing = graph.AddNode ([]() { throw std::runtime_error ("node failed"); });
+	const JobGraph::Node after = graph.AddNode ([&after_ran]() { after_ran = true; });
+	graph.AddNode ([&independent_ran]() { independent_ran = true; });
+	graph.AddDependency (failing, after);
+	CHECK_THROWS (job_system.Run (graph), std::runtime_error);
+	CHECK (!after_ran);
+	CHECK (independent_ran);
+}
+
+TEST (OnlyOneSystemPerThread)
+{
+	JobSystem job_system (1);
+	CHECK_THROWS (JobSystem (1), std::logic_error);
+	//a thread outside the system can not spawn
+	bool thrown = false;
+	std::thread outside ([&job_system, &thrown]()
+	{
+		JobCounter counter;
+		try
+		{
+			job_system.Spawn ([]() {}, counter);
+		}
+		catch (const std::logic_error &)
+		{
+			thrown = true;
+		}
+	});
+	outside.join ();
+	CHECK (thrown);
+}
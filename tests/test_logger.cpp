@@ -0,0 +1,167 @@
+#include "test.h"
+#include "logger.h"
+
+#include <string.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+static const char *const log_file_name = "test_logger.log";
+
+static void WriteMessage (Logger &logger, LogSeverity severity, const char *format_str, ...)
+{
+	va_list args;
+	va_start (args, format_str);
+	logger.Write (severity, format_str, args);
+	va_end (args);
+}
+
+static std::vector<std::string> ReadLines (const char *file_name)
+{
+	std::vector<std::string> lines;
+	FILE *f = fopen (file_name, "r");
+	if (!f)
+		return lines;
+	char line[1024];
+	while (fgets (line, sizeof (line), f))
+		lines.push_back (line);
+	fclose (f);
+	return lines;
+}
+
+static bool Contains (const std::string &line, const char *text)
+{
+	return line.find (text) != std::string::npos;
+}
+
+static LoggerDesc GetTestDesc ()
+{
+	LoggerDesc desc;
+	desc.file_name = log_file_name;
+	desc.min_severity = LOG_SEVERITY_DEBUG;
+	return desc;
+}
+
+TEST (WritesMessagesInOrder)
+{
+	Logger logger;
+	CHECK (logger.Open (GetTestDesc ()));
+	for (int i = 0; i < 100; i++)
+		WriteMessage (logger, LOG_SEVERITY_INFO, "message %d", i);
+	logger.Close ();
+	CHECK_EQ (logger.GetWrittenCount (), 100u);
+
+	const std::vector<std::string> lines = ReadLines (log_file_name);
+	CHECK_EQ (lines.size (), 100u);
+	for (size_t i = 0; i < lines.size (); i++)
+		CHECK (Contains (lines[i], ("message " + std::to_string (i) + "\n").c_str ()));
+}
+
+TEST (FiltersBySeverity)
+{
+	LoggerDesc desc = GetTestDesc ();
+	desc.min_severity = LOG_SEVERITY_WARNING;
+	Logger logger;
+	CHECK (logger.Open (desc));
+	CHECK (!logger.IsEnabled (LOG_SEVERITY_INFO));
+	WriteMessage (logger, LOG_SEVERITY_INFO, "hidden");
+	WriteMessage (logger, LOG_SEVERITY_ERROR, "shown");
+	logger.SetMinSeverity (LOG_SEVERITY_DEBUG);
+	WriteMessage (logger, LOG_SEVERITY_DEBUG, "debug");
+	logger.Close ();
+
+	const std::vector<std::string> lines = ReadLines (log_file_name);
+	CHECK_EQ (lines.size (), 2u);
+	CHECK (lines.size () == 2 && Contains (lines[0], "shown") && Contains (lines[1], "debug"));
+}
+
+TEST (FlushMakesMessagesVisible)
+{
+	LoggerDesc desc = GetTestDesc ();
+	desc.flush_policy = LOG_FLUSH_ON_ERROR;
+	Logger logger;
+	CHECK (logger.Open (desc));
+	WriteMessage (logger, LOG_SEVERITY_INFO, "before flush");
+	logger.Flush ();
+	const std::vector<std::string> lines = ReadLines (log_file_name);
+	CHECK (lines.size () == 1 && Contains (lines[0], "before flush"));
+	logger.Close ();
+}
+
+TEST (MarksTruncatedMessages)
+{
+	Logger logger;
+	CHECK (logger.Open (GetTestDesc ()));
+	const std::string fitting (Logger::max_message_length - 1, 'a');
+	const std::string cut (Logger::max_message_length + 100, 'b');
+	WriteMessage (logger, LOG_SEVERITY_INFO, "%s", fitting.c_str ());
+	WriteMessage (logger, LOG_SEVERITY_INFO, "%s", cut.c_str ());
+	logger.Close ();
+	CHECK_EQ (logger.GetTruncatedCount (), 1u);
+
+	const std::vector<std::string> lines = ReadLines (log_file_name);
+	CHECK_EQ (lines.size (), 2u);
+	if (lines.size () == 2)
+	{
+		CHECK (Contains (lines[0], (fitting + "\n").c_str ()));
+		const std::string expected = std::string (Logger::max_message_length - 4, 'b') + "...\n";
+		CHECK (Contains (lines[1], expected.c_str ()));
+		CHECK (!Contains (lines[1], (std::string (Logger::max_message_length - 3, 'b')).c_str ()));
+	}
+}
+
+TEST (BlockingModeKeepsEveryMessage)
+{
+	LoggerDesc desc = GetTestDesc ();
+	desc.capacity = 4;
+	desc.overflow_mode = LOG_OVERFLOW_BLOCK;
+	Logger logger;
+	CHECK (logger.Open (desc));
+	const int threads_count = 4;
+	const int messages_count = 2000;
+	std::vector<std::thread> threads;
+	for (int t = 0; t < threads_count; t++)
+		threads.emplace_back ([&logger, t]()
+		{
+			for (int i = 0; i < messages_count; i++)
+				WriteMessage (logger, LOG_SEVERITY_INFO, "thread %d message %d", t, i);
+		});
+	for (std::thread &thread : threads)
+		thread.join ();
+	logger.Close ();
+	CHECK_EQ (logger.GetDroppedCount (), 0u);
+	CHECK_EQ (logger.GetWrittenCount (), static_cast<uint64_t>(threads_count * messages_count));
+
+	//the messages of one thread stay in order
+	std::vector<int> next (threads_count, 0);
+	for (const std::string &line : ReadLines (log_file_name))
+	{
+		int t, i;
+		const char *message = strstr (line.c_str (), "thread ");
+		CHECK (message && sscanf (message, "thread %d message %d", &t, &i) == 2);
+		if (message && t >= 0 && t < threads_count)
+			CHECK_EQ (i, next[t]++);
+	}
+}
+
+TEST (DropModeCountsDroppedMessages)
+{
+	LoggerDesc desc = GetTestDesc ();
+	desc.capacity = 2;
+	desc.overflow_mode = LOG_OVERFLOW_DROP;
+	Logger logger;
+	CHECK (logger.Open (desc));
+	const uint64_t messages_count = 100000;
+	for (uint64_t i = 0; i < messages_count; i++)
+		WriteMessage (logger, LOG_SEVERITY_INFO, "message %llu", static_cast<unsigned long long>(i));
+	logger.Close ();
+	CHECK_EQ (logger.GetWrittenCount () + logger.GetDroppedCount (), messages_count);
+	CHECK (logger.GetDroppedCount () > 0);
+
+	//the writer reports the drops in the file
+	bool reported = false;
+	for (const std::string &line : ReadLines (log_file_name))
+		reported |= Contains (line, "log messages dropped");
+	CHECK (reported);
+}
@@ -0,0 +1,46 @@
+#include "test.h"
+
+#include <string.h>
+#include <exception>
+
+static int failures;
+
+std::vector<TestCase> &GetTests ()
+{
+	static std::vector<TestCase> tests;
+	return tests;
+}
+
+void ReportFailure (const char *file, int line, const char *expression)
+{
+	printf ("  %s:%d: CHECK failed: %s\n", file, line, expression);
+	failures++;
+}
+
+//usage: test_<module> [name]; runs the tests whose name contains the argument
+int main (int argc, char **argv)
+{
+	int failed_tests = 0;
+	int run = 0;
+	for (const TestCase &test : GetTests ())
+	{
+		if (argc > 1 && !strstr (test.name, argv[1]))
+			continue;
+		const int previous_failures = failures;
+		try
+		{
+			test.function ();
+		}
+		catch (const std::exception &err)
+		{
+			printf ("  exception: %s\n", err.what ());
+			failures++;
+		}
+		const bool passed = failures == previous_failures;
+		printf ("[%s] %s\n", passed ? "  OK  " : "FAILED", test.name);
+		failed_tests += passed ? 0 : 1;
+		run++;
+	}
+	printf ("%d of %d tests passed\n", run - failed_tests, run);
+	return failed_tests ? 1 : 0;
+}
@@ -0,0 +1,331 @@
+#include "test.h"
+#include "mesh_file.h"
+#include "mesh_import.h"
+#include "vertex_format.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <stdexcept>
+#include <string>
+
+static const char *mesh_file_name = "test_mesh_file.mesh";
+
+//position and colour vertices of two submeshes, the second based at vertex 4
+static MeshData MakeMesh (uint32_t extra_vertices = 0)
+{
+	MeshData mesh;
+	mesh.attributes.push_back ({ MESH_ATTRIBUTE_POSITION, 0, vertex_format_float3, 0 });
+	mesh.attributes.push_back ({ MESH_ATTRIBUTE_COLOR, 0, vertex_format_float4, 12 });
+	mesh.vertex_stride = 28;
+	const uint32_t vertex_count = 7 + extra_vertices;
+	for (uint32_t i = 0; i < vertex_count; i++)
+	{
+		const float vertex[7] = { static_cast<float>(i), -static_cast<float>(i) * 0.5f, 2.0f, 1.0f, 0.5f, 0.25f, 1.0f };
+		const uint8_t *bytes = reinterpret_cast<const uint8_t*>(vertex);
+		mesh.vertices.insert (mesh.vertices.end (), bytes, bytes + sizeof (vertex));
+	}
+	const uint32_t indices[] = { 0, 1, 2, 2, 1, 3, 0, 1, 2 };
+	mesh.indices.assign (indices, indices + 9);
+	MeshSubmesh submeshes[2];
+	memset (submeshes, 0, sizeof (submeshes));
+	submeshes[0].index_count = 6;
+	submeshes[1].start_index = 6;
+	submeshes[1].index_count = 3;
+	submeshes[1].base_vertex = 4;
+	submeshes[1].material = 1;
+	mesh.submeshes.assign (submeshes, submeshes + 2);
+	ComputeMeshBounds (mesh);
+	return mesh;
+}
+
+static uint32_t ReadIndex (const MeshView &view, uint32_t index)
+{
+	if (view.header->index_size == 2)
+	{
+		uint16_t value;
+		memcpy (&value, view.indices + index * 2, sizeof (value));
+		return value;
+	}
+	uint32_t value;
+	memcpy (&value, view.indices + index * 4, sizeof (value));
+	return value;
+}
+
+//the file in 8 byte aligned memory, as ReadMeshFile needs it
+struct AlignedFile
+{
+	explicit AlignedFile (const std::vector<uint8_t> &file) :
+		words ((file.size () + 7) / 8),
+		size (file.size ())
+	{
+		memcpy (words.data (), file.data (), file.size ());
+	}
+	uint8_t *GetData ()
+	{
+		return reinterpret_cast<uint8_t*>(words.data ());
+	}
+	MeshFileHeader *GetHeader ()
+	{
+		return reinterpret_cast<MeshFileHeader*>(words.data ());
+	}
+	bool Read (MeshView &view)
+	{
+		return ReadMeshFile (GetData (), size, view);
+	}
+
+	std::vector<uint64_t> words;
+	size_t size;
+};
+
+TEST (ComputesMeshAndSubmeshBounds)
+{
+	MeshData mesh = MakeMesh ();
+	CHECK_EQ (mesh.submeshes[0].bounds_min[0], 0.0f);
+	CHECK_EQ (mesh.submeshes[0].bounds_max[0], 3.0f);
+	CHECK_EQ (mesh.submeshes[0].bounds_min[1], -1.5f);
+	CHECK_EQ (mesh.submeshes[1].bounds_min[0], 4.0f);
+	CHECK_EQ (mesh.submeshes[1].bounds_max[0], 6.0f);
+	CHECK_EQ (mesh.bounds_min[0], 0.0f);
+	CHECK_EQ (mesh.bounds_max[0], 6.0f);
+	CHECK_EQ (mesh.bounds_min[1], -3.0f);
+	CHECK_EQ (mesh.bounds_min[2], 2.0f);
+	CHECK_EQ (mesh.bounds_max[2], 2.0f);
+
+	//an empty submesh collapses to the origin and is left out of the mesh bounds
+	mesh.submeshes[1].index_count = 0;
+	ComputeMeshBounds (mesh);
+	CHECK_EQ (mesh.submeshes[1].bounds_max[0], 0.0f);
+	CHECK_EQ (mesh.bounds_max[0], 3.0f);
+
+	mesh.submeshes[1].index_count = 3;
+	mesh.submeshes[1].base_vertex = 5;
+	CHECK_THROWS (ComputeMeshBounds (mesh), std::out_of_range);
+	mesh.attributes[0].format = vertex_format_float4;
+	CHECK_THROWS (ComputeMeshBounds (mesh), std::invalid_argument);
+}
+
+TEST (WritesAlignedStreamsAndReadsThemBack)
+{
+	const MeshData mesh = MakeMesh ();
+	std::vector<uint8_t> file;
+	WriteMeshFile (mesh, file);
+	AlignedFile aligned (file);
+	MeshView view;
+	CHECK (aligned.Read (view));
+
+	const MeshFileHeader &header = *view.header;
+	CHECK_EQ (header.vertex_count, 7u);
+	CHECK_EQ (header.vertex_stride, 28u);
+	CHECK_EQ (header.index_count, 9u);
+	CHECK_EQ (header.index_size, 2u);
+	CHECK_EQ (header.submesh_count, 2u);
+	CHECK_EQ (header.attribute_count, 2u);
+	CHECK_EQ (header.attributes[1].semantic, static_cast<uint32_t>(MESH_ATTRIBUTE_COLOR));
+	CHECK_EQ (header.attributes[1].offset, 12u);
+	CHECK_EQ (header.bounds_max[0], 6.0f);
+	CHECK_EQ (header.file_size, file.size ());
+
+	//streams are aligned and point into the file itself
+	CHECK_EQ (header.vertex_offset % mesh_stream_alignment, 0u);
+	CHECK_EQ (header.index_offset % mesh_stream_alignment, 0u);
+	CHECK (view.vertices == aligned.GetData () + header.vertex_offset);
+	CHECK (view.indices == aligned.GetData () + header.index_offset);
+	CHECK_EQ (view.vertex_size, mesh.vertices.size ());
+	CHECK_EQ (view.index_size, 18u);
+	CHECK (memcmp (view.vertices, mesh.vertices.data (), mesh.vertices.size ()) == 0);
+	for (uint32_t i = 0; i < 9; i++)
+		CHECK_EQ (ReadIndex (view, i), mesh.indices[i]);
+	CHECK (memcmp (view.submeshes, mesh.submeshes.data (), 2 * sizeof (MeshSubmesh)) == 0);
+	CHECK_EQ (view.submeshes[1].base_vertex, 4);
+}
+
+TEST (UsesWideIndicesOnlyWhenNeeded)
+{
+	MeshData mesh = MakeMesh (0x10000);
+	mesh.indices[8] = 0xffff;
+	mesh.submeshes[1].base_vertex = 0;
+	std::vector<uint8_t> file;
+	WriteMeshFile (mesh, file);
+	MeshView view;
+	AlignedFile narrow (file);
+	CHECK (narrow.Read (view));
+	CHECK_EQ (view.header->index_size, 2u);
+	CHECK_EQ (ReadIndex (view, 8), 0xffffu);
+
+	mesh.indices[8] = 0x10000;
+	WriteMeshFile (mesh, file);
+	AlignedFile wide (file);
+	CHECK (wide.Read (view));
+	CHECK_EQ (view.header->index_size, 4u);
+	CHECK_EQ (view.index_size, 36u);
+	CHECK_EQ (ReadIndex (view, 8), 0x10000u);
+
+	mesh.vertices.pop_back ();
+	CHECK_THROWS (WriteMeshFile (mesh, file), std::invalid_argument);
+	mesh = MakeMesh ();
+	mesh.attributes.resize (mesh_max_attributes + 1);
+	CHECK_THROWS (WriteMeshFile (mesh, file), std::invalid_argument);
+}
+
+TEST (RejectsDamagedFiles)
+{
+	std::vector<uint8_t> file;
+	WriteMeshFile (MakeMesh (), file);
+	MeshView view;
+	{
+		AlignedFile aligned (file);
+		CHECK (!ReadMeshFile (aligned.GetData (), sizeof (MeshFileHeader) - 1, view));
+		CHECK (!ReadMeshFile (aligned.GetData (), aligned.size - 1, view));
+		//the streams are read in place, so the data must be aligned
+		std::vector<uint64_t> shifted (aligned.words.size () + 1);
+		uint8_t *unaligned = reinterpret_cast<uint8_t*>(shifted.data ()) + 4;
+		memcpy (unaligned, file.data (), file.size ());
+		CHECK (!ReadMeshFile (unaligned, file.size (), view));
+	}
+	struct Damage
+	{
+		void (*apply) (MeshFileHeader &header, MeshSubmesh *submeshes);
+	};
+	const Damage damages[] =
+	{
+		{ [] (MeshFileHeader &header, MeshSubmesh *) { header.magic = 0x4853454e; } },
+		{ [] (MeshFileHeader &header, MeshSubmesh *) { header.version = mesh_file_version - 1; } },
+		{ [] (MeshFileHeader &header, MeshSubmesh *) { header.index_size = 3; } },
+		{ [] (MeshFileHeader &header, MeshSubmesh *) { header.attribute_count = mesh_max_attributes + 1; } },
+		{ [] (MeshFileHeader &header, MeshSubmesh *) { header.attributes[1].offset = header.vertex_stride; } },
+		{ [] (MeshFileHeader &header, MeshSubmesh *) { header.attributes[0].semantic = MESH_ATTRIBUTE_SEMANTIC_COUNT; } },
+		{ [] (MeshFileHeader &header, MeshSubmesh *) { header.vertex_count = 1000; } },
+		{ [] (MeshFileHeader &header, MeshSubmesh *) { header.index_count = 0xffffffff; } },
+		{ [] (MeshFileHeader &header, MeshSubmesh *) { header.vertex_offset += 8; } },
+		{ [] (MeshFileHeader &header, MeshSubmesh *) { header.submesh_count = 0x10000000; } },
+		{ [] (MeshFileHeader &, MeshSubmesh *submeshes) { submeshes[1].start_index = 7; } },
+	};
+	for (const Damage &damage : damages)
+	{
+		AlignedFile aligned (file);
+		CHECK (aligned.Read (view));
+		damage.apply (*aligned.GetHeader (), reinterpret_cast<MeshSubmesh*>(aligned.GetData () + aligned.GetHeader ()->submesh_offset));
+		CHECK (!aligned.Read (view));
+	}
+}
+
+TEST (MapsFilesInPlace)
+{
+	std::vector<uint8_t> file;
+	const MeshData mesh = MakeMesh ();
+	WriteMeshFile (mesh, file);
+	FILE *f = fopen (mesh_file_name, "wb");
+	CHECK (f != nullptr);
+	if (!f)
+		return;
+	fwrite (file.data (), 1, file.size (), f);
+	fclose (f);
+
+	{
+		MappedFile mapped;
+		CHECK (mapped.Open (mesh_file_name));
+		CHECK_EQ (mapped.GetSize (), file.size ());
+		mapped.Prefetch (0, mapped.GetSize ());
+		mapped.Prefetch (mapped.GetSize (), 1);
+		MeshView view;
+		CHECK (ReadMeshFile (mapped.GetData (), mapped.GetSize (), view));
+		CHECK (view.vertices == mapped.GetData () + view.header->vertex_offset);
+		CHECK (memcmp (view.vertices, mesh.vertices.data (), mesh.vertices.size ()) == 0);
+		mapped.Close ();
+		CHECK (mapped.GetData () == nullptr);
+		CHECK_EQ (mapped.GetSize (), 0u);
+	}
+
+	f = fopen (mesh_file_name, "wb");
+	fclose (f);
+	MappedFile mapped;
+	CHECK (mapped.Open (mesh_file_name));
+	CHECK_EQ (mapped.GetSize (), 0u);
+	remove (mesh_file_name);
+	CHECK (!mapped.Open (mesh_file_name));
+	CHECK (mapped.GetData () == nullptr);
+}
+
+static const float *GetVertex (const MeshData &mesh, uint32_t index)
+{
+	return reinterpret_cast<const float*>(mesh.vertices.data () + index * mesh.vertex_stride);
+}
+
+TEST (ImportsObjForDirect3D)
+{
+	//a quad with texcoords and normals, then a triangle of another material
+	const std::string text =
+		"# comment\n"
+		"mtllib scene.mtl\n"
+		"v 0 0 1\nv 1 0 1\nv 1 1 1\nv 0 1 1 \r\n"
+		"vt 0 0\nvt 1 0\nvt 1 1\nvt 0 1\n"
+		"vn 0 0 1\n"
+		"usemtl stone\n"
+		"f 1/1/1 2/2/1 3/3/1 4/4/1\n"
+		"usemtl wood\n"
+		"f -4/1/1 -2/3/1 -1/4/1\n";
+	MeshData mesh;
+	std::vector<std::string> materials;
+	ImportObj (text, mesh, materials);
+
+	CHECK (materials.size () == 2 && materials[0] == "stone" && materials[1] == "wood");
+	CHECK_EQ (mesh.vertex_stride, 48u);
+	CHECK_EQ (mesh.attributes.size (), 4u);
+	CHECK_EQ (mesh.attributes[2].semantic, static_cast<uint32_t>(MESH_ATTRIBUTE_TEXCOORD));
+	CHECK_EQ (mesh.attributes[2].offset, 24u);
+	CHECK_EQ (mesh.submeshes.size (), 2u);
+	CHECK_EQ (mesh.submeshes[0].index_count, 6u);
+	CHECK_EQ (mesh.submeshes[1].index_count, 3u);
+	CHECK_EQ (mesh.submeshes[1].material, 1u);
+	//equal corners of both materials share their vertex
+	CHECK_EQ (mesh.GetVertexCount (), 4u);
+
+	//fan triangles are reversed: 1 3 2, 1 4 3
+	const uint32_t quad[] = { 0, 1, 2, 0, 3, 1 };
+	for (uint32_t i = 0; i < 6; i++)
+		CHECK_EQ (mesh.indices[i], quad[i]);
+	const float *first = GetVertex (mesh, 0);
+	CHECK_EQ (first[2], -1.0f);
+	CHECK_EQ (first[5], -1.0f);
+	CHECK_EQ (first[7], 1.0f);
+	const float *third = GetVertex (mesh, 2);
+	CHECK_EQ (third[0], 1.0f);
+	CHECK_EQ (third[7], 1.0f);
+	CHECK_EQ (third[8], 1.0f);
+	CHECK_EQ (third[11], 1.0f);
+	CHECK_EQ (mesh.bounds_min[2], -1.0f);
+	CHECK_EQ (mesh.bounds_max[1], 1.0f);
+}
+
+TEST (ImportsColoursAndReportsErrorLines)
+{
+	MeshData mesh;
+	std::vector<std::string> materials;
+	ImportObj ("v 0.0 0.5 0.0 1.0 0.0 0.0\nv 0.5 -0.5 0.0 0.0 1.0 0.0\nv -0.5 -0.5 0.0 0.0 0.0 1.0\nf 1 3 2\n", mesh, materials);
+	CHECK (materials.size () == 1 && materials[0] == "default");
+	CHECK_EQ (mesh.vertex_stride, 28u);
+	CHECK_EQ (mesh.GetVertexCount (), 3u);
+	const float *top = GetVertex (mesh, 0);
+	CHECK (top[3] == 1.0f && top[4] == 0.0f && top[5] == 0.0f && top[6] == 1.0f);
+
+	const char *const broken[] =
+	{
+		"v 0 0 0\nv 1 0 0\nf 1 2\n",
+		"v 0 0 0\nv 1 0 0\nv 1 1 0\nf 1 2 4\n",
+		"v 0 0 0\nv 1 0 0\nv 1 1 0\nf 1 2 0\n",
+		"v 0 0 0\nv 1 x 0\n",
+		"v 0 0 0\nv 1 0 0\nv 1 1 0\nf 1 2 3/1\n",
+	};
+	for (const char *text : broken)
+		CHECK_THROWS (ImportObj (text, mesh, materials), std::runtime_error);
+	try
+	{
+		ImportObj ("v 0 0 0\n\n# comment\nf 1 1 x\n", mesh, materials);
+		CHECK (false);
+	}
+	catch (const std::runtime_error &e)
+	{
+		CHECK (strstr (e.what (), "line 4") != nullptr);
+	}
+}
@@ -0,0 +1,346 @@
+#include "test.h"
+#include "mesh_optimize.h"
+#include "vertex_format.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+#include <random>
+#include <stdexcept>
+
+struct Geometry
+{
+	std::vector<float> positions;    //xyz per vertex
+	std::vector<uint32_t> indices;
+
+	uint32_t GetVertexCount () const
+	{
+		return static_cast<uint32_t>(positions.size () / 3);
+	}
+};
+
+//size x size quads in the xy plane, row by row
+static Geometry MakeGrid (uint32_t size)
+{
+	Geometry grid;
+	for (uint32_t y = 0; y <= size; y++)
+		for (uint32_t x = 0; x <= size; x++)
+		{
+			grid.positions.push_back (static_cast<float>(x));
+			grid.positions.push_back (static_cast<float>(y));
+			grid.positions.push_back (0.0f);
+		}
+	for (uint32_t y = 0; y < size; y++)
+		for (uint32_t x = 0; x < size; x++)
+		{
+			const uint32_t a = y * (size + 1) + x;
+			const uint32_t quad[6] = { a, a + size + 1, a + 1, a + 1, a + size + 1, a + size + 2 };
+			grid.indices.insert (grid.indices.end (), quad, quad + 6);
+		}
+	return grid;
+}
+
+static void ShuffleTriangles (std::vector<uint32_t> &indices, uint32_t seed)
+{
+	std::vector<uint32_t> order (indices.size () / 3);
+	for (uint32_t t = 0; t < order.size (); t++)
+		order[t] = t;
+	std::shuffle (order.begin (), order.end (), std::mt19937 (seed));
+	const std::vector<uint32_t> source = indices;
+	for (size_t t = 0; t < order.size (); t++)
+		memcpy (&indices[t * 3], &source[order[t] * 3], 3 * sizeof (uint32_t));
+}
+
+//a UV sphere whose clockwise front faces point outwards
+static void AppendSphere (Geometry &geometry, float radius, uint32_t rings, uint32_t segments)
+{
+	const uint32_t first = geometry.GetVertexCount ();
+	for (uint32_t ring = 0; ring <= rings; ring++)
+	{
+		const float theta = 3.14159265f * ring / rings;
+		for (uint32_t segment = 0; segment <= segments; segment++)
+		{
+			const float phi = 2.0f * 3.14159265f * segment / segments;
+			geometry.positions.push_back (radius * sinf (theta) * cosf (phi));
+			geometry.positions.push_back (radius * cosf (theta));
+			geometry.positions.push_back (radius * sinf (theta) * sinf (phi));
+		}
+	}
+	for (uint32_t ring = 0; ring < rings; ring++)
+		for (uint32_t segment = 0; segment < segments; segment++)
+		{
+			const uint32_t a = first + ring * (segments + 1) + segment;
+			const uint32_t quad[2][3] = { { a, a + 1, a + segments + 1 }, { a + 1, a + segments + 2, a + segments + 1 } };
+			for (const uint32_t *triangle : quad)
+			{
+				const float *p[3];
+				for (uint32_t k = 0; k < 3; k++)
+					p[k] = &geometry.positions[triangle[k] * 3];
+				const float ab[3] = { p[1][0] - p[0][0], p[1][1] - p[0][1], p[1][2] - p[0][2] };
+				const float ac[3] = { p[2][0] - p[0][0], p[2][1] - p[0][1], p[2][2] - p[0][2] };
+				const float normal[3] = { ab[1] * ac[2] - ab[2] * ac[1], ab[2] * ac[0] - ab[0] * ac[2], ab[0] * ac[1] - ab[1] * ac[0] };
+				if (normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2] < 1e-12f)
+					continue;
+				const bool outwards = normal[0] * p[0][0] + normal[1] * p[0][1] + normal[2] * p[0][2] > 0.0f;
+				geometry.indices.push_back (triangle[0]);
+				geometry.indices.push_back (outwards ? triangle[1] : triangle[2]);
+				geometry.indices.push_back (outwards ? triangle[2] : triangle[1]);
+			}
+		}
+}
+
+//triangles rotated to start at their lowest index and sorted, so orders can be compared
+static std::vector<uint32_t> CanonicalTriangles (const uint32_t *indices, size_t index_count)
+{
+	std::vector<std::vector<uint32_t>> triangles;
+	for (size_t i = 0; i < index_count; i += 3)
+	{
+		std::vector<uint32_t> triangle (indices + i, indices + i + 3);
+		std::rotate (triangle.begin (), std::min_element (triangle.begin (), triangle.end ()), triangle.end ());
+		triangles.push_back (triangle);
+	}
+	std::sort (triangles.begin (), triangles.end ());
+	std::vector<uint32_t> result;
+	for (const std::vector<uint32_t> &triangle : triangles)
+		result.insert (result.end (), triangle.begin (), triangle.end ());
+	return result;
+}
+
+TEST (AnalyzesAFifoCache)
+{
+	const uint32_t indices[] = { 0, 1, 2, 2, 1, 3 };
+	VertexCacheStats stats = AnalyzeVertexCache (indices, 6, 4);
+	CHECK_EQ (stats.transformed, 4u);
+	CHECK_EQ (stats.acmr, 2.0f);
+	CHECK_EQ (stats.atvr, 1.0f);
+	//a single entry keeps only the last vertex
+	stats = AnalyzeVertexCache (indices, 6, 4, 1);
+	CHECK_EQ (stats.transformed, 5u);
+	CHECK_EQ (stats.atvr, 1.25f);
+	CHECK_THROWS (AnalyzeVertexCache (indices, 6, 4, 0), std::invalid_argument);
+	CHECK_THROWS (AnalyzeVertexCache (indices, 5, 4), std::invalid_argument);
+	CHECK_THROWS (AnalyzeVertexCache (indices, 6, 3), std::out_of_range);
+}
+
+TEST (VertexCacheOrderBeatsAShuffledGrid)
+{
+	Geometry grid = MakeGrid (64);
+	ShuffleTriangles (grid.indices, 3);
+	const VertexCacheStats before = AnalyzeVertexCache (grid.indices.data (), grid.indices.size (), grid.GetVertexCount ());
+
+	std::vector<uint32_t> optimized (grid.indices.size ());
+	OptimizeVertexCache (optimized.data (), grid.indices.data (), grid.indices.size (), grid.GetVertexCount ());
+	const VertexCacheStats after = AnalyzeVertexCache (optimized.data (), optimized.size (), grid.GetVertexCount ());
+	CHECK (before.acmr > 2.0f);
+	CHECK (after.acmr < 0.8f);
+	CHECK (after.atvr < 1.6f);
+	//the same triangles with the same winding
+	CHECK (CanonicalTriangles (optimized.data (), optimized.size ()) == CanonicalTriangles (grid.indices.data (), grid.indices.size ()));
+
+	//in place gives the same order
+	std::vector<uint32_t> in_place = grid.indices;
+	OptimizeVertexCache (in_place.data (), in_place.data (), in_place.size (), grid.GetVertexCount ());
+	CHECK (in_place == optimized);
+	CHECK_THROWS (OptimizeVertexCache (in_place.data (), grid.indices.data (), grid.indices.size (), grid.GetVertexCount () - 1), std::out_of_range);
+}
+
+TEST (OverdrawOrderDrawsTheOuterShellFirst)
+{
+	//the inner sphere is hidden from every view, drawn first it is shaded for nothing
+	Geometry shells;
+	AppendSphere (shells, 0.5f, 16, 32);
+	const size_t inner_indices = shells.indices.size ();
+	AppendSphere (shells, 1.0f, 16, 32);
+	const uint32_t vertex_count = shells.GetVertexCount ();
+	const OverdrawStats before = AnalyzeOverdraw (shells.indices.data (), shells.indices.size (), shells.positions.data (), 12, vertex_count);
+	const OverdrawStats outer_only = AnalyzeOverdraw (shells.indices.data () + inner_indices, shells.indices.size () - inner_indices,
+													  shells.positions.data (), 12, vertex_count);
+	CHECK (outer_only.overdraw < 1.01f);
+	CHECK (before.overdraw > 1.15f);
+	CHECK_EQ (before.covered, outer_only.covered);
+
+	std::vector<uint32_t> cache_order (shells.indices.size ());
+	OptimizeVertexCache (cache_order.data (), shells.indices.data (), shells.indices.size (), vertex_count);
+	std::vector<uint32_t> optimized (shells.indices.size ());
+	OptimizeOverdraw (optimized.data (), cache_order.data (), cache_order.size (), shells.positions.data (), 12, vertex_count);
+	const OverdrawStats after = AnalyzeOverdraw (optimized.data (), optimized.size (), shells.positions.data (), 12, vertex_count);
+	CHECK (after.overdraw < before.overdraw - 0.1f);
+	CHECK (CanonicalTriangles (optimized.data (), optimized.size ()) == CanonicalTriangles (shells.indices.data (), shells.indices.size ()));
+
+	//the vertex cache loses at most the threshold
+	const float cache_acmr = AnalyzeVertexCache (cache_order.data (), cache_order.size (), vertex_count).acmr;
+	CHECK (AnalyzeVertexCache (optimized.data (), optimized.size (), vertex_count).acmr <= cache_acmr * mesh_overdraw_threshold + 0.01f);
+	CHECK_THROWS (OptimizeOverdraw (optimized.data (), cache_order.data (), cache_order.size (), shells.positions.data (), 12, vertex_count, 0.5f),
+				  std::invalid_argument);
+}
+
+TEST (MeshletsKeepTheirLimitsAndTriangles)
+{
+	Geometry grid = MakeGrid (40);
+	OptimizeVertexCache (grid.indices.data (), grid.indices.data (), grid.indices.size (), grid.GetVertexCount ());
+	MeshletData meshlets;
+	BuildMeshlets (grid.indices.data (), grid.indices.size (), grid.positions.data (), 12, grid.GetVertexCount (),
+				   meshlet_max_vertices, meshlet_max_triangles, meshlets);
+	CHECK (!meshlets.meshlets.empty ());
+	CHECK (meshlets.meshlets.size () < grid.indices.size () / 3 / 60);
+
+	std::vector<uint32_t> rebuilt;
+	for (const Meshlet &meshlet : meshlets.meshlets)
+	{
+		CHECK (meshlet.vertex_count <= meshlet_max_vertices);
+		CHECK (meshlet.triangle_count <= meshlet_max_triangles && meshlet.triangle_count > 0);
+		for (uint32_t i = 0; i < meshlet.triangle_count * 3; i++)
+		{
+			const uint8_t local = meshlets.triangles[meshlet.triangle_offset + i];
+			CHECK (local < meshlet.vertex_count);
+			rebuilt.push_back (meshlets.vertices[meshlet.vertex_offset + local]);
+		}
+		//the bounding sphere holds every vertex
+		for (uint32_t i = 0; i < meshlet.vertex_count; i++)
+		{
+			const float *position = &grid.positions[meshlets.vertices[meshlet.vertex_offset + i] * 3];
+			float distance = 0.0f;
+			for (uint32_t c = 0; c < 3; c++)
+				distance += (position[c] - meshlet.center[c]) * (position[c] - meshlet.center[c]);
+			CHECK (sqrtf (distance) <= meshlet.radius * 1.0001f);
+		}
+	}
+	CHECK (rebuilt == grid.indices);
+	CHECK_THROWS (BuildMeshlets (grid.indices.data (), grid.indices.size (), grid.positions.data (), 12, grid.GetVertexCount (), 257, 124, meshlets),
+				  std::invalid_argument);
+}
+
+//float3 positions and a white float4 colour per vertex
+static MeshData MakeMesh (const Geometry &geometry)
+{
+	MeshData mesh;
+	mesh.attributes.push_back ({ MESH_ATTRIBUTE_POSITION, 0, vertex_format_float3, 0 });
+	mesh.attributes.push_back ({ MESH_ATTRIBUTE_COLOR, 0, vertex_format_float4, 12 });
+	mesh.vertex_stride = 28;
+	for (uint32_t v = 0; v < geometry.GetVertexCount (); v++)
+	{
+		const float vertex[7] = { geometry.positions[v * 3], geometry.positions[v * 3 + 1], geometry.positions[v * 3 + 2], 1.0f, 1.0f, 1.0f, 1.0f };
+		const uint8_t *bytes = reinterpret_cast<const uint8_t*>(vertex);
+		mesh.vertices.insert (mesh.vertices.end (), bytes, bytes + sizeof (vertex));
+	}
+	mesh.indices = geometry.indices;
+	MeshSubmesh submesh;
+	memset (&submesh, 0, sizeof (submesh));
+	submesh.index_count = static_cast<uint32_t>(geometry.indices.size ());
+	mesh.submeshes.push_back (submesh);
+	ComputeMeshBounds (mesh);
+	return mesh;
+}
+
+//positions of every corner of a submesh in index order
+static std::vector<float> GetCorners (const MeshData &mesh, const MeshSubmesh &submesh)
+{
+	std::vector<float> corners;
+	for (uint32_t i = 0; i < submesh.index_count; i++)
+	{
+		const float *position = reinterpret_cast<const float*>(mesh.vertices.data () +
+			(mesh.indices[submesh.start_index + i] + submesh.base_vertex) * mesh.vertex_stride);
+		corners.insert (corners.end (), position, position + 3);
+	}
+	return corners;
+}
+
+//the corners of each triangle rotated to start at the lowest position and the triangles sorted
+static std::vector<float> CanonicalCorners (const MeshData &mesh, const MeshSubmesh &submesh)
+{
+	const std::vector<float> corners = GetCorners (mesh, submesh);
+	std::vector<std::vector<float>> triangles;
+	for (size_t i = 0; i < corners.size (); i += 9)
+	{
+		std::vector<std::vector<float>> triangle;
+		for (size_t k = 0; k < 9; k += 3)
+			triangle.push_back (std::vector<float> (&corners[i + k], &corners[i + k] + 3));
+		std::rotate (triangle.begin (), std::min_element (triangle.begin (), triangle.end ()), triangle.end ());
+		triangles.push_back (std::vector<float> ());
+		for (const std::vector<float> &corner : triangle)
+			triangles.back ().insert (triangles.back ().end (), corner.begin (), corner.end ());
+	}
+	std::sort (triangles.begin (), triangles.end ());
+	std::vector<float> result;
+	for (const std::vector<float> &triangle : triangles)
+		result.insert (result.end (), triangle.begin (), triangle.end ());
+	return result;
+}
+
+TEST (DeduplicatesAndOrdersVerticesByFirstUse)
+{
+	//every quad of the grid with its own 4 vertices, and an unused vertex at the start
+	const Geometry grid = MakeGrid (8);
+	Geometry split;
+	split.positions.insert (split.positions.end (), { 100.0f, 100.0f, 100.0f });
+	for (uint32_t index : grid.indices)
+	{
+		split.indices.push_back (split.GetVertexCount ());
+		split.positions.insert (split.positions.end (), &grid.positions[index * 3], &grid.positions[index * 3 + 3]);
+	}
+	MeshData mesh = MakeMesh (split);
+	const std::vector<float> corners = GetCorners (mesh, mesh.submeshes[0]);
+
+	CHECK_EQ (DeduplicateVertices (mesh), split.GetVertexCount () - grid.GetVertexCount () - 1);
+	CHECK (GetCorners (mesh, mesh.submeshes[0]) == corners);
+	OptimizeVertexFetch (mesh);
+	CHECK_EQ (mesh.GetVertexCount (), grid.GetVertexCount ());
+	CHECK (GetCorners (mesh, mesh.submeshes[0]) == corners);
+	//first uses are in increasing order
+	uint32_t next = 0;
+	for (uint32_t index : mesh.indices)
+	{
+		CHECK (index <= next);
+		if (index == next)
+			next++;
+	}
+}
+
+TEST (OptimizesEverySubmeshAndReportsStats)
+{
+	Geometry geometry = MakeGrid (48);
+	ShuffleTriangles (geometry.indices, 5);
+	const size_t grid_indices = geometry.indices.size ();
+	AppendSphere (geometry, 5.0f, 12, 24);
+	MeshData mesh = MakeMesh (geometry);
+	//two submeshes, the sphere relative to its first vertex
+	const uint32_t sphere_base = 49 * 49;
+	mesh.submeshes[0].index_count = static_cast<uint32_t>(grid_indices);
+	MeshSubmesh sphere = mesh.submeshes[0];
+	sphere.start_index = static_cast<uint32_t>(grid_indices);
+	sphere.index_count = static_cast<uint32_t>(geometry.indices.size () - grid_indices);
+	sphere.base_vertex = sphere_base;
+	sphere.material = 1;
+	for (size_t i = grid_indices; i < mesh.indices.size (); i++)
+		mesh.indices[i] -= sphere_base;
+	mesh.submeshes.push_back (sphere);
+	const std::vector<float> grid_corners = CanonicalCorners (mesh, mesh.submeshes[0]);
+	const std::vector<float> sphere_corners = CanonicalCorners (mesh, mesh.submeshes[1]);
+
+	MeshOptimizeStats stats;
+	OptimizeMesh (mesh, mesh_overdraw_threshold, &stats);
+	CHECK_EQ (stats.vertices_before, geometry.GetVertexCount ());
+	//the seam and the poles of the sphere repeat vertices
+	CHECK (stats.vertices_after < stats.vertices_before);
+	CHECK_EQ (stats.vertices_after, mesh.GetVertexCount ());
+	CHECK (stats.cache_after.acmr < stats.cache_before.acmr * 0.5f);
+	CHECK (stats.cache_after.atvr < stats.cache_before.atvr);
+	CHECK (stats.overdraw_after.overdraw <= stats.overdraw_before.overdraw * 1.01f);
+
+	CHECK_EQ (mesh.submeshes.size (), 2u);
+	CHECK_EQ (mesh.submeshes[0].base_vertex, 0);
+	CHECK (mesh.submeshes[1].base_vertex > 0);
+	CHECK (*std::min_element (mesh.indices.begin () + grid_indices, mesh.indices.end ()) == 0);
+	CHECK (CanonicalCorners (mesh, mesh.submeshes[0]) == grid_corners);
+	CHECK (CanonicalCorners (mesh, mesh.submeshes[1]) == sphere_corners);
+
+	MeshletData meshlets;
+	BuildMeshlets (mesh, meshlet_max_vertices, meshlet_max_triangles, meshlets);
+	uint32_t triangles = 0;
+	for (const Meshlet &meshlet : meshlets.meshlets)
+		triangles += meshlet.triangle_count;
+	CHECK_EQ (triangles, mesh.indices.size () / 3);
+	//meshlet vertices are absolute, the last meshlet is of the sphere
+	CHECK (meshlets.vertices[meshlets.meshlets.back ().vertex_offset] >= static_cast<uint32_t>(mesh.submeshes[1].base_vertex));
+}
@@ -0,0 +1,171 @@
+#include "test.h"
+#include "null_device.h"
+
+#include <stdexcept>
+
+static GpuCommandList *RecordDraws (NullDevice &device, GpuCommandAllocator *allocator, std::unique_ptr<GpuCommandList> &command_list, uint32_t draws)
+{
+	if (!command_list)
+		command_list = device.CreateCommandList (allocator);
+	else
+		command_list->Reset (allocator, 0);
+	for (uint32_t i = 0; i < draws; i++)
+		command_list->DrawInstanced (3, 1, 0, 0);
+	command_list->Close ();
+	return command_list.get ();
+}
+
+TEST (EncodesAndDecodesCommands)
+{
+	NullDevice device;
+	std::unique_ptr<GpuCommandAllocator> allocator = device.CreateCommandAllocator ();
+	std::unique_ptr<GpuCommandList> command_list = device.CreateCommandList (allocator.get ());
+	const uint32_t constants[3] = { 7, 8, 9 };
+	const GpuBarrier barriers[2] = { GpuTransition (5, GPU_RESOURCE_STATE_COMMON, GPU_RESOURCE_STATE_RENDER_TARGET),
+									 GpuTransition (6, GPU_RESOURCE_STATE_COPY_DEST, GPU_RESOURCE_STATE_PIXEL_SHADER_RESOURCE) };
+	command_list->SetPipelineState (42);
+	command_list->SetGraphicsRoot32BitConstants (1, 3, constants, 4);
+	command_list->ResourceBarrier (2, barriers);
+	command_list->DrawIndexedInstanced (36, 2, 6, -3, 1);
+	command_list->CopyBufferRegion (1, 0, 2, 256, 4096);
+	command_list->Close ();
+
+	const NullCommandList &null_list = static_cast<const NullCommandList&>(*command_list);
+	CHECK_EQ (null_list.GetCommandCount (), 5u);
+	CHECK_EQ (null_list.GetDrawCount (), 1u);
+	CHECK_EQ (null_list.GetBarrierCount (), 2u);
+	CHECK_EQ (null_list.GetCopyBytes (), 4096u);
+
+	NullCommandReader reader (null_list);
+	NullCommandHeader header;
+	const uint8_t *payload;
+	CHECK (reader.Next (header, payload) && header.type == NULL_COMMAND_SET_PIPELINE_STATE);
+	CHECK_EQ (NullCommandReader::Read<GpuPipelineHandle>(payload), 42u);
+
+	CHECK (reader.Next (header, payload) && header.type == NULL_COMMAND_SET_ROOT_CONSTANTS);
+	//root parameter, count, destination offset and the values
+	CHECK_EQ (NullCommandReader::Read<uint32_t>(payload), 1u);
+	CHECK_EQ (NullCommandReader::Read<uint32_t>(payload, 4), 4u);
+	CHECK_EQ (NullCommandReader::Read<uint32_t>(payload, 8), 4u);
+	CHECK_EQ (NullCommandReader::Read<uint32_t>(payload, 20), 9u);
+
+	CHECK (reader.Next (header, payload) && header.type == NULL_COMMAND_RESOURCE_BARRIER);
+	CHECK (reader.Next (header, payload) && header.type == NULL_COMMAND_DRAW_INDEXED_INSTANCED);
+	const NullDrawIndexedPayload draw = NullCommandReader::Read<NullDrawIndexedPayload>(payload);
+	CHECK (draw.index_count == 36 && draw.instance_count == 2 && draw.start_index == 6 && draw.base_vertex == -3 && draw.start_instance == 1);
+	CHECK (reader.Next (header, payload) && header.type == NULL_COMMAND_COPY_BUFFER_REGION);
+	CHECK (!reader.Next (header, payload));
+}
+
+TEST (ResetAllocatorReusesItsStream)
+{
+	NullDevice device;
+	std::unique_ptr<GpuCommandAllocator> allocator = device.CreateCommandAllocator ();
+	std::unique_ptr<GpuCommandList> command_list;
+	RecordDraws (device, allocator.get (), command_list, 1000);
+	const std::vector<uint8_t> &stream = static_cast<NullCommandAllocator*>(allocator.get ())->GetStream ();
+	const size_t capacity = stream.capacity ();
+	CHECK (stream.size () > 0);
+	allocator->Reset ();
+	CHECK_EQ (stream.size (), 0u);
+	RecordDraws (device, allocator.get (), command_list, 1000);
+	CHECK_EQ (stream.capacity (), capacity);
+	CHECK_EQ (static_cast<NullCommandList*>(command_list.get ())->GetDrawCount (), 1000u);
+}
+
+TEST (RejectsMisuse)
+{
+	NullDevice device;
+	std::unique_ptr<GpuCommandAllocator> allocator = device.CreateCommandAllocator ();
+	std::unique_ptr<GpuCommandList> command_list = device.CreateCommandList (allocator.get ());
+	GpuCommandList *lists[] = { command_list.get () };
+	CHECK_THROWS (device.ExecuteCommandLists (1, lists), std::logic_error);
+	CHECK_THROWS (command_list->Reset (allocator.get (), 0), std::logic_error);
+	//a second list recording into the same allocator
+	std::unique_ptr<GpuCommandList> other = device.CreateCommandList (allocator.get ());
+	command_list->DrawInstanced (3, 1, 0, 0);
+	CHECK_THROWS (other->DrawInstanced (3, 1, 0, 0), std::logic_error);
+	command_list->Close ();
+	CHECK_THROWS (command_list->Close (), std::logic_error);
+	CHECK_THROWS (command_list->DrawInstanced (3, 1, 0, 0), std::logic_error);
+	CHECK_THROWS (device.WaitForFenceValue (1), std::logic_error);
+}
+
+TEST (SimulatesTheFenceTimeline)
+{
+	NullDeviceDesc desc;
+	desc.gpu_ns_per_list = 1000;
+	desc.gpu_ns_per_command = 10;
+	desc.gpu_ns_per_draw = 100;
+	NullDevice device (desc);
+	std::unique_ptr<GpuCommandAllocator> allocator = device.CreateCommandAllocator ();
+	std::unique_ptr<GpuCommandList> command_list;
+
+	//10 draws cost 1000 + 10 * 10 + 10 * 100 ns
+	GpuCommandList *lists[] = { RecordDraws (device, allocator.get (), command_list, 10) };
+	device.ExecuteCommandLists (1, lists);
+	device.Signal (1);
+	CHECK_EQ (device.GetGpuIdleTime (), 2100u);
+	CHECK_EQ (device.GetCompletedFenceValue (), 0u);
+	device.AdvanceCpuTime (2000);
+	CHECK_EQ (device.GetCompletedFenceValue (), 0u);
+	device.AdvanceCpuTime (100);
+	CHECK_EQ (device.GetCompletedFenceValue (), 1u);
+
+	//the GPU was idle, the next batch starts at submission and the wait jumps the CPU ahead
+	device.AdvanceCpuTime (900);
+	device.AddGpuWork (500);
+	allocator->Reset ();
+	lists[0] = RecordDraws (device, allocator.get (), command_list, 10);
+	device.ExecuteCommandLists (1, lists);
+	device.Signal (2);
+	CHECK_EQ (device.GetGpuIdleTime (), 3000u + 2100u + 500u);
+	device.WaitForFenceValue (2);
+	CHECK_EQ (device.GetCpuTime (), 5600u);
+	CHECK_EQ (device.GetCompletedFenceValue (), 2u);
+
+	const NullDeviceStats stats = device.GetStats ();
+	CHECK_EQ (stats.executed_lists, 2u);
+	CHECK_EQ (stats.draws, 20u);
+	CHECK_EQ (stats.waits, 1u);
+	CHECK_EQ (stats.stall_ns, 2600u);
+	CHECK_EQ (stats.gpu_busy_ns, 4700u);
+}
+
+TEST (QueuesWaitForEachOther)
+{
+	NullDeviceDesc desc;
+	desc.gpu_ns_per_list = 1000;
+	desc.gpu_ns_per_command = 0;
+	desc.gpu_ns_per_draw = 0;
+	NullDevice copy_queue (desc);
+	NullDevice direct_queue (desc);
+	std::unique_ptr<GpuCommandAllocator> copy_allocator = copy_queue.CreateCommandAllocator ();
+	std::unique_ptr<GpuCommandAllocator> direct_allocator = direct_queue.CreateCommandAllocator ();
+	std::unique_ptr<GpuCommandList> copy_list;
+	std::unique_ptr<GpuCommandList> direct_list;
+
+	copy_queue.AddGpuWork (4000);
+	GpuCommandList *lists[] = { RecordDraws (copy_queue, copy_allocator.get (), copy_list, 0) };
+	copy_queue.ExecuteCommandLists (1, lists);
+	copy_queue.Signal (1);
+	CHECK_THROWS (direct_queue.WaitForQueue (&copy_queue, 2), std::logic_error);
+	direct_queue.WaitForQueue (&copy_queue, 1);
+	lists[0] = RecordDraws (direct_queue, direct_allocator.get (), direct_list, 0);
+	direct_queue.ExecuteCommandLists (1, lists);
+	CHECK_EQ (direct_queue.GetGpuIdleTime (), 6000u);
+	CHECK_EQ (direct_queue.GetStats ().queue_wait_ns, 5000u);
+}
+
+TEST (CreatesAlignedFakeResources)
+{
+	NullDevice device;
+	const GpuResourceHandle a = device.CreateResource (100);
+	const GpuResourceHandle b = device.CreateResource (0x10001);
+	const GpuResourceHandle c = device.CreateResource (1);
+	CHECK (a && b && c && a != b && b != c);
+	CHECK_EQ (device.GetGpuVirtualAddress (b) - device.GetGpuVirtualAddress (a), 0x10000u);
+	CHECK_EQ (device.GetGpuVirtualAddress (c) - device.GetGpuVirtualAddress (b), 0x20000u);
+	CHECK_EQ (device.GetGpuVirtualAddress (0), 0u);
+	CHECK_EQ (device.GetGpuVirtualAddress (c + 1), 0u);
+}
@@ -0,0 +1,309 @@
+#include "test.h"
+#include "null_device.h"
+#include "pipeline_cache.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+
+static const char *cache_file = "test_pipeline_cache.bin";
+
+//library of pipeline hashes serialized as their array; creation can be held back to
+//keep requests pending, and fails for descriptions with 7 render targets
+class MockPipelineBackend : public PipelineBackend
+{
+public:
+	explicit MockPipelineBackend (uint64_t key = 42, bool library_support = true) :
+		device_key (key),
+		supports_library (library_support),
+		held (false),
+		next_pipeline (1),
+		live (0)
+	{
+	}
+	uint64_t GetDeviceKey () override
+	{
+		return device_key;
+	}
+	bool OpenLibrary (const void *blob, size_t size) override
+	{
+		if (!supports_library)
+			return false;
+		std::lock_guard<std::mutex> lock (mutex);
+		const uint64_t *hashes = static_cast<const uint64_t*>(blob);
+		library = std::set<uint64_t>(hashes, hashes + size / sizeof (uint64_t));
+		return true;
+	}
+	GpuPipelineHandle CreatePipeline (const PipelineDesc &desc, uint64_t hash, bool &loaded) override
+	{
+		std::unique_lock<std::mutex> lock (mutex);
+		released.wait (lock, [this] { return !held; });
+		if (desc.render_target_count == 7)
+			throw std::runtime_error ("Pipeline does not compile");
+		loaded = supports_library && library.count (hash) != 0;
+		if (supports_library)
+			library.insert (hash);
+		live++;
+		return next_pipeline++;
+	}
+	void DestroyPipeline (GpuPipelineHandle) override
+	{
+		std::lock_guard<std::mutex> lock (mutex);
+		live--;
+	}
+	void SerializeLibrary (std::vector<uint8_t> &blob) override
+	{
+		std::lock_guard<std::mutex> lock (mutex);
+		blob.clear ();
+		for (uint64_t hash : library)
+			blob.insert (blob.end (), reinterpret_cast<const uint8_t*>(&hash), reinterpret_cast<const uint8_t*>(&hash + 1));
+	}
+
+	void Hold (bool hold)
+	{
+		{
+			std::lock_guard<std::mutex> lock (mutex);
+			held = hold;
+		}
+		released.notify_all ();
+	}
+
+	uint64_t device_key;
+	bool supports_library;
+	std::mutex mutex;
+	std::condition_variable released;
+	bool held;
+	std::set<uint64_t> library;
+	GpuPipelineHandle next_pipeline;
+	int live;
+};
+
+static const uint8_t vertex_shader[] = { 0x44, 0x58, 0x42, 0x43, 1, 2, 3, 4 };
+static const uint8_t pixel_shader[] = { 0x44, 0x58, 0x42, 0x43, 5, 6, 7, 8, 9 };
+static const PipelineInputElement input_elements[] =
+{
+	{ "POSITION", 0, 6, 0, 0, 0, 0 },
+	{ "TEXCOORD", 0, 16, 0, pipeline_append_aligned_element, 0, 0 }
+};
+
+static PipelineDesc GetMaterialDesc (int32_t variant = 0)
+{
+	PipelineDesc desc;
+	desc.root_signature = 1;
+	desc.root_signature_key = 0x1234;
+	desc.shaders[PIPELINE_SHADER_VS].bytecode = vertex_shader;
+	desc.shaders[PIPELINE_SHADER_VS].size = sizeof (vertex_shader);
+	desc.shaders[PIPELINE_SHADER_PS].bytecode = pixel_shader;
+	desc.shaders[PIPELINE_SHADER_PS].size = sizeof (pixel_shader);
+	desc.input_elements = input_elements;
+	desc.input_element_count = 2;
+	desc.render_target_count = 1;
+	desc.render_target_formats[0] = 28;
+	desc.raster.depth_bias = variant;
+	return desc;
+}
+
+TEST (NormalizationIgnoresUnusedState)
+{
+	PipelineDesc a = GetMaterialDesc ();
+	PipelineDesc b = GetMaterialDesc ();
+	//unused render targets, blend factors of disabled blending and a disabled stencil test
+	b.render_target_formats[3] = 2;
+	b.blend_targets[5].blend_enable = 1;
+	b.blend_targets[0].src_blend = 5;
+	b.depth_stencil.stencil_read_mask = 0x0f;
+	b.depth_stencil.front_face.func = 3;
+	NormalizePipelineDesc (a);
+	NormalizePipelineDesc (b);
+	std::vector<uint8_t> key_a, key_b;
+	BuildPipelineKey (a, key_a);
+	BuildPipelineKey (b, key_b);
+	CHECK (key_a == key_b);
+
+	//used state and the shader contents change the key
+	PipelineDesc c = GetMaterialDesc ();
+	c.render_target_formats[0] = 29;
+	std::vector<uint8_t> key_c;
+	NormalizePipelineDesc (c);
+	BuildPipelineKey (c, key_c);
+	CHECK (key_a != key_c);
+	uint8_t shader_copy[sizeof (pixel_shader)];
+	memcpy (shader_copy, pixel_shader, sizeof (shader_copy));
+	shader_copy[8] ^= 1;
+	PipelineDesc d = GetMaterialDesc ();
+	d.shaders[PIPELINE_SHADER_PS].bytecode = shader_copy;
+	std::vector<uint8_t> key_d;
+	NormalizePipelineDesc (d);
+	BuildPipelineKey (d, key_d);
+	CHECK (key_a != key_d);
+
+	PipelineDesc too_many = GetMaterialDesc ();
+	too_many.render_target_count = 9;
+	CHECK_THROWS (NormalizePipelineDesc (too_many), std::invalid_argument);
+}
+
+TEST (HashIsStable)
+{
+	//FNV-1a test vectors, the cache file depends on them
+	CHECK_EQ (PipelineHash ("", 0), 0xcbf29ce484222325ull);
+	CHECK_EQ (PipelineHash ("a", 1), 0xaf63dc4c8601ec8cull);
+	CHECK_EQ (PipelineHash ("foobar", 6), 0x85944171f73967e8ull);
+}
+
+TEST (IdenticalRequestsShareAnEntry)
+{
+	MockPipelineBackend backend;
+	PipelineCache cache (&backend, 0);
+	const PipelineId a = cache.Request (GetMaterialDesc ());
+	PipelineDesc same = GetMaterialDesc ();
+	same.depth_stencil.stencil_write_mask = 0;
+	same.blend_targets[2].dest_blend = 4;
+	CHECK_EQ (cache.Request (same), a);
+	const PipelineId b = cache.Request (GetMaterialDesc (1));
+	CHECK (b != a);
+	//the cache owns copies of what the description points to
+	CHECK (cache.IsReady (a) && cache.IsReady (b) && cache.Get (a) != cache.Get (b));
+
+	const PipelineCacheStats stats = cache.GetStats ();
+	CHECK (stats.requests == 3 && stats.deduplicated == 1 && stats.compiled == 2 && stats.pipelines == 2);
+}
+
+TEST (PendingPipelinesDrawWithTheFallback)
+{
+	MockPipelineBackend backend;
+	PipelineCache cache (&backend, 2);
+	const PipelineId fallback = cache.Create (GetMaterialDesc ());
+	backend.Hold (true);
+	const PipelineId id = cache.Request (GetMaterialDesc (1), fallback);
+	PipelineDesc broken = GetMaterialDesc (2);
+	broken.render_target_count = 7;
+	const PipelineId failing = cache.Request (broken, id);
+	CHECK (!cache.IsReady (id));
+	CHECK_EQ (cache.Get (id), cache.Get (fallback));
+	CHECK_EQ (cache.Get (failing), cache.Get (fallback));
+	CHECK_EQ (cache.GetStats ().pending, 2u);
+
+	backend.Hold (false);
+	cache.WaitAll ();
+	CHECK (cache.IsReady (id) && cache.Get (id) != cache.Get (fallback));
+	//a failed pipeline keeps drawing with its fallback
+	CHECK (cache.HasFailed (failing));
+	CHECK_EQ (cache.Get (failing), cache.Get (id));
+	CHECK_THROWS (cache.Create (broken), std::runtime_error);
+	CHECK_THROWS (cache.Request (GetMaterialDesc (3), 99), std::out_of_range);
+	const PipelineCacheStats stats = cache.GetStats ();
+	CHECK (stats.failed == 1 && stats.pending == 0);
+}
+
+TEST (SavedLibraryIsLoadedOnTheNextRun)
+{
+	remove (cache_file);
+	{
+		MockPipelineBackend backend;
+		PipelineCache cache (&backend, 2);
+		CHECK (!cache.Load (cache_file));
+		for (int32_t variant = 0; variant < 8; variant++)
+			cache.Request (GetMaterialDesc (variant));
+		cache.Save (cache_file);
+	}
+	{
+		MockPipelineBackend backend;
+		PipelineCache cache (&backend, 2);
+		CHECK (cache.Load (cache_file));
+		//pipelines of the library are created right away
+		for (int32_t variant = 0; variant < 8; variant++)
+			CHECK (cache.IsReady (cache.Request (GetMaterialDesc (variant))));
+		const PipelineId added = cache.Request (GetMaterialDesc (8));
+		cache.WaitAll ();
+		CHECK (cache.IsReady (added));
+		PipelineCacheStats stats = cache.GetStats ();
+		CHECK (stats.loaded == 8 && stats.compiled == 1);
+		CHECK_THROWS (cache.Load (cache_file), std::logic_error);
+	}
+	//another device or driver version does not take the file
+	{
+		MockPipelineBackend backend (43);
+		PipelineCache cache (&backend, 0);
+		CHECK (!cache.Load (cache_file));
+	}
+	remove (cache_file);
+}
+
+TEST (DamagedCacheFilesAreRejected)
+{
+	std::vector<uint64_t> pipelines;
+	pipelines.push_back (3);
+	pipelines.push_back (9);
+	const uint8_t blob[] = { 1, 2, 3, 4, 5 };
+	std::vector<uint8_t> file;
+	WritePipelineCacheFile (42, pipelines, blob, sizeof (blob), file);
+	CHECK_EQ (file.size (), sizeof (PipelineCacheFileHeader) + 2 * sizeof (uint64_t) + sizeof (blob));
+
+	std::vector<uint64_t> read_pipelines;
+	size_t blob_offset, blob_size;
+	CHECK (ReadPipelineCacheFile (file.data (), file.size (), 42, read_pipelines, blob_offset, blob_size));
+	CHECK (read_pipelines == pipelines && blob_size == sizeof (blob));
+	CHECK (memcmp (file.data () + blob_offset, blob, sizeof (blob)) == 0);
+
+	CHECK (!ReadPipelineCacheFile (file.data (), file.size (), 41, read_pipelines, blob_offset, blob_size));
+	CHECK (!ReadPipelineCacheFile (file.data (), file.size () - 1, 42, read_pipelines, blob_offset, blob_size));
+	CHECK (!ReadPipelineCacheFile (file.data (), 10, 42, read_pipelines, blob_offset, blob_size));
+	std::vector<uint8_t> damaged (file);
+	damaged.back () ^= 0x40;
+	CHECK (!ReadPipelineCacheFile (damaged.data (), damaged.size (), 42, read_pipelines, blob_offset, blob_size));
+	damaged = file;
+	damaged[4] = 2;    //version
+	CHECK (!ReadPipelineCacheFile (damaged.data (), damaged.size (), 42, read_pipelines, blob_offset, blob_size));
+}
+
+TEST (WithoutLibrarySupportEveryRunCompiles)
+{
+	//like the D3D12 backend built with an SDK before ID3D12PipelineLibrary
+	remove (cache_file);
+	{
+		MockPipelineBackend backend (42, false);
+		PipelineCache cache (&backend, 0);
+		cache.Request (GetMaterialDesc ());
+		cache.Save (cache_file);
+	}
+	FILE *f = fopen (cache_file, "rb");
+	CHECK (!f);
+	if (f)
+		fclose (f);
+	MockPipelineBackend backend (42, false);
+	PipelineCache cache (&backend, 0);
+	CHECK (!cache.Load (cache_file));
+	cache.Request (GetMaterialDesc ());
+	CHECK (cache.GetStats ().compiled == 1 && cache.GetStats ().loaded == 0);
+}
+
+TEST (EvictedPipelinesLiveUntilTheGpuIsDone)
+{
+	NullDevice device;
+	FrameScheduler scheduler (&device, 2, FRAME_POLICY_MAX_THROUGHPUT);
+	MockPipelineBackend backend;
+	{
+		PipelineCache cache (&backend, 0);
+		const PipelineId fallback = cache.Create (GetMaterialDesc ());
+		const PipelineId id = cache.Request (GetMaterialDesc (1), fallback);
+		const PipelineId child = cache.Request (GetMaterialDesc (2), id);
+		scheduler.BeginFrame ();
+		cache.Evict (id, &scheduler);
+		CHECK_EQ (backend.live, 3);
+		CHECK_THROWS (cache.Evict (id, &scheduler), std::logic_error);
+		scheduler.EndFrame ();
+		scheduler.WaitForIdle ();
+		CHECK_EQ (backend.live, 2);
+		CHECK_EQ (cache.GetStats ().pipelines, 2u);
+
+		//the description gets a new entry
+		const PipelineId again = cache.Request (GetMaterialDesc (1));
+		CHECK (again != id && cache.IsReady (again));
+		CHECK (cache.IsReady (child));
+	}
+	CHECK_EQ (backend.live, 0);
+}
@@ -0,0 +1,218 @@
+#include "test.h"
+#include "present_controller.h"
+#include "null_device.h"
+
+#include <stdexcept>
+#include <vector>
+
+static const uint64_t ms = 1000000;
+static const uint64_t refresh = 16666667;
+
+//frames with a fixed CPU and GPU time presented to a simulated 60 Hz swap chain
+struct PresentSimulation
+{
+	NullDevice device;
+	NullPresentBackend backend;
+	PresentController controller;
+
+	PresentSimulation (const PresentOptions &options, bool tearing_supported = true) :
+		device (GetDeviceDesc ()),
+		backend (&device, GetPresentDesc (tearing_supported)),
+		controller (&backend, options)
+	{
+	}
+
+	static NullDeviceDesc GetDeviceDesc ()
+	{
+		NullDeviceDesc desc;
+		desc.gpu_ns_per_list = 0;
+		return desc;
+	}
+
+	static NullPresentDesc GetPresentDesc (bool tearing_supported)
+	{
+		NullPresentDesc desc;
+		desc.refresh_interval = refresh;
+		desc.tearing_supported = tearing_supported;
+		return desc;
+	}
+
+	void RunFrame (uint64_t cpu_ns, uint64_t gpu_ns)
+	{
+		controller.BeginFrame ();
+		device.AdvanceCpuTime (cpu_ns);
+		device.AddGpuWork (gpu_ns);
+		device.ExecuteCommandLists (0, nullptr);
+		controller.Present ();
+	}
+
+	uint64_t GetAverageDisplayLatency () const
+	{
+		const PresentStats &stats = controller.GetStats ();
+		return stats.displayed_frames ? stats.total_display_latency_ns / stats.displayed_frames : 0;
+	}
+};
+
+static PresentOptions MakeOptions (PresentMode mode, bool low_latency)
+{
+	PresentOptions options;
+	options.mode = mode;
+	options.low_latency = low_latency;
+	return options;
+}
+
+TEST (VsyncShowsOneFramePerRefresh)
+{
+	PresentSimulation simulation (MakeOptions (PRESENT_MODE_VSYNC, false));
+	for (uint32_t frame = 0; frame < 200; frame++)
+		simulation.RunFrame (2 * ms, 4 * ms);
+	const PresentStats &stats = simulation.controller.GetStats ();
+	CHECK_EQ (stats.frames, 200u);
+	CHECK (stats.displayed_frames >= 195);
+	CHECK_EQ (stats.late_frames, 0u);
+	CHECK_EQ (stats.refresh_interval_ns, refresh);
+	//without pacing the CPU runs ahead until the three queued presents block it
+	CHECK (simulation.GetAverageDisplayLatency () > 2 * refresh);
+	CHECK (stats.total_wait_ns > 150 * refresh);
+
+	std::vector<PresentFrameTiming> timings;
+	simulation.controller.GetTimings (timings);
+	CHECK_EQ (timings.size (), static_cast<size_t>(PresentController::history_size));
+	CHECK_EQ (timings.back ().present_count, 200u);
+	for (size_t i = 1; i < timings.size (); i++)
+		if (timings[i - 1].display_time && timings[i].display_time)
+		{
+			CHECK_EQ (timings[i].display_time % refresh, 0u);
+			CHECK_EQ (timings[i].display_time - timings[i - 1].display_time, refresh);
+		}
+}
+
+TEST (LowLatencyPacingStartsFramesLateInTheRefresh)
+{
+	PresentSimulation queued (MakeOptions (PRESENT_MODE_VSYNC, false));
+	PresentSimulation paced (MakeOptions (PRESENT_MODE_VSYNC, true));
+	paced.controller.SetMaximumFrameLatency (1);
+	for (uint32_t frame = 0; frame < 600; frame++)
+	{
+		queued.RunFrame (2 * ms, 4 * ms);
+		paced.RunFrame (2 * ms, 4 * ms);
+	}
+	//the delay grows until a frame misses its refresh, then backs off below it
+	const PresentStats &stats = paced.controller.GetStats ();
+	CHECK (stats.pacing_delay_ns > refresh / 4 && stats.pacing_delay_ns + 6 * ms <= refresh);
+	CHECK (stats.total_pace_ns > 0);
+	//the last present is reported by the next BeginFrame ()
+	CHECK_EQ (stats.displayed_frames + 1, stats.frames);
+	CHECK (stats.late_frames <= 2);
+	//the input of a frame is sampled less than a refresh before it is shown
+	CHECK (paced.GetAverageDisplayLatency () < refresh);
+	CHECK (paced.GetAverageDisplayLatency () * 2 < queued.GetAverageDisplayLatency ());
+
+	//paced frames start on the refresh grid plus the delay
+	std::vector<PresentFrameTiming> timings;
+	paced.controller.GetTimings (timings);
+	for (const PresentFrameTiming &timing : timings)
+		if (timing.target_vblank)
+		{
+			CHECK_EQ (timing.target_vblank % refresh, 0u);
+			CHECK (timing.start_time >= timing.target_vblank && timing.start_time < timing.target_vblank + refresh);
+		}
+}
+
+TEST (LateFramesBackOffAndHold)
+{
+	PresentSimulation simulation (MakeOptions (PRESENT_MODE_VSYNC, true));
+	simulation.controller.SetMaximumFrameLatency (1);
+	//10 ms of work misses the refresh once the delay passes 6.7 ms
+	for (uint32_t frame = 0; frame < 1000; frame++)
+		simulation.RunFrame (4 * ms, 6 * ms);
+	const PresentStats &stats = simulation.controller.GetStats ();
+	CHECK (stats.late_frames >= 1 && stats.late_frames <= 8);
+	CHECK (stats.pacing_delay_ns + 10 * ms <= refresh);
+	CHECK (stats.max_display_latency_ns < 2 * refresh);
+
+	//SetOptions () starts the pacing over
+	simulation.controller.SetOptions (simulation.controller.GetOptions ());
+	CHECK_EQ (simulation.controller.GetStats ().pacing_delay_ns, 0u);
+	simulation.controller.ResetStats ();
+	CHECK_EQ (simulation.controller.GetStats ().frames, 0u);
+	CHECK_EQ (simulation.controller.GetStats ().refresh_interval_ns, refresh);
+}
+
+TEST (TearingPresentsWhenTheFrameIsDone)
+{
+	PresentSimulation tearing (MakeOptions (PRESENT_MODE_TEARING, false));
+	tearing.controller.SetMaximumFrameLatency (1);
+	for (uint32_t frame = 0; frame < 100; frame++)
+		tearing.RunFrame (2 * ms, 5 * ms);
+	//a frame every 7 ms, as a latency of 1 waits for the GPU of the last frame, shown as
+	//soon as the GPU is done with it
+	CHECK (tearing.device.GetCpuTime () <= 100 * 7 * ms);
+	CHECK_EQ (tearing.GetAverageDisplayLatency (), 7 * ms);
+	std::vector<PresentFrameTiming> timings;
+	tearing.controller.GetTimings (timings);
+	uint32_t off_vblank = 0;
+	for (const PresentFrameTiming &timing : timings)
+		off_vblank += timing.display_time && timing.display_time % refresh != 0;
+	CHECK (off_vblank > 50);
+
+	//without tearing support the flips wait for the vblank, but not one per refresh
+	PresentSimulation no_tearing (MakeOptions (PRESENT_MODE_TEARING, false), false);
+	no_tearing.controller.SetMaximumFrameLatency (1);
+	for (uint32_t frame = 0; frame < 100; frame++)
+		no_tearing.RunFrame (2 * ms, 5 * ms);
+	no_tearing.controller.GetTimings (timings);
+	for (const PresentFrameTiming &timing : timings)
+		if (timing.display_time)
+			CHECK_EQ (timing.display_time % refresh, 0u);
+	CHECK (no_tearing.device.GetCpuTime () < 100 * refresh);
+}
+
+TEST (CappedFramesStartAtTheRate)
+{
+	PresentOptions options = MakeOptions (PRESENT_MODE_CAPPED, false);
+	options.fps_cap = 100.0f;
+	PresentSimulation simulation (options);
+	simulation.controller.SetMaximumFrameLatency (1);
+	for (uint32_t frame = 0; frame < 20; frame++)
+		simulation.RunFrame (2 * ms, 3 * ms);
+	//one long frame restarts the grid instead of rushing the next frames
+	simulation.RunFrame (25 * ms, 3 * ms);
+	for (uint32_t frame = 0; frame < 10; frame++)
+		simulation.RunFrame (2 * ms, 3 * ms);
+	std::vector<PresentFrameTiming> timings;
+	simulation.controller.GetTimings (timings);
+	CHECK_EQ (timings.size (), 31u);
+	for (size_t i = 1; i < timings.size (); i++)
+		if (i != 21)
+			CHECK_EQ (timings[i].start_time - timings[i - 1].start_time, 10 * ms);
+	CHECK (timings[21].start_time - timings[20].start_time > 25 * ms);
+	CHECK (simulation.controller.GetStats ().total_pace_ns >= 29 * 4 * ms);
+}
+
+TEST (MisuseAndTimeouts)
+{
+	PresentSimulation simulation (MakeOptions (PRESENT_MODE_VSYNC, false));
+	CHECK_THROWS (simulation.controller.Present (), std::logic_error);
+	simulation.controller.BeginFrame ();
+	CHECK (simulation.controller.IsInFrame ());
+	CHECK_THROWS (simulation.controller.BeginFrame (), std::logic_error);
+	simulation.controller.Present ();
+	CHECK (!simulation.controller.IsInFrame ());
+	CHECK_THROWS (simulation.controller.SetMaximumFrameLatency (0), std::invalid_argument);
+	PresentOptions options = MakeOptions (PRESENT_MODE_CAPPED, false);
+	options.fps_cap = 0.0f;
+	CHECK_THROWS (simulation.controller.SetOptions (options), std::invalid_argument);
+	NullPresentDesc desc;
+	desc.refresh_interval = 0;
+	CHECK_THROWS (NullPresentBackend (&simulation.device, desc), std::invalid_argument);
+
+	//a GPU hang of 300 ms: the wait gives up after its timeout and the frame starts anyway
+	simulation.controller.SetMaximumFrameLatency (1);
+	simulation.RunFrame (1 * ms, 300 * ms);
+	const uint64_t before = simulation.device.GetCpuTime ();
+	simulation.controller.BeginFrame ();
+	CHECK_EQ (simulation.controller.GetStats ().wait_timeouts, 1u);
+	CHECK_EQ (simulation.device.GetCpuTime () - before, 100 * ms);
+	simulation.controller.Present ();
+}
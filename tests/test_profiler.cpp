@@ -0,0 +1,178 @@
+#include "test.h"
+#include "profiler.h"
+
+#include <math.h>
+
+#include <string>
+#include <thread>
+
+static const ProfileZone zone_a = { "ZoneA", __FILE__, __LINE__ };
+static const ProfileZone zone_b = { "Zone \"B\"", __FILE__, __LINE__ };
+
+static void ResetProfiler (bool enable)
+{
+	Profiler &profiler = Profiler::Get ();
+	profiler.SetEnabled (enable);
+	profiler.SetHistorySize (16);
+	profiler.Clear ();
+}
+
+static const ProfileZoneStats *FindStats (const std::vector<ProfileZoneStats> &stats, const ProfileZone *zone)
+{
+	for (const ProfileZoneStats &zone_stats : stats)
+		if (zone_stats.zone == zone)
+			return &zone_stats;
+	return nullptr;
+}
+
+static bool IsNear (double value, double expected)
+{
+	return fabs (value - expected) <= expected * 1e-6;
+}
+
+TEST (DisabledProfilerRecordsNothing)
+{
+	ResetProfiler (false);
+	{
+		PROFILE_SCOPE ("Disabled");
+		CHECK_EQ (Profiler::ThreadDepth (), 0u);
+	}
+	PROFILE_END_FRAME ();
+	CHECK_EQ (Profiler::Get ().GetFrameCount (), 0u);
+}
+
+TEST (ScopesNestAndRecord)
+{
+	ResetProfiler (true);
+	{
+		PROFILE_SCOPE ("Outer");
+		CHECK_EQ (Profiler::ThreadDepth (), 1u);
+		{
+			PROFILE_SCOPE ("Inner");
+			CHECK_EQ (Profiler::ThreadDepth (), 2u);
+		}
+	}
+	CHECK_EQ (Profiler::ThreadDepth (), 0u);
+	PROFILE_END_FRAME ();
+
+	std::vector<ProfileZoneStats> stats;
+	Profiler::Get ().GetZoneStats (stats);
+	CHECK_EQ (stats.size (), 2u);
+	for (const ProfileZoneStats &zone_stats : stats)
+	{
+		CHECK_EQ (zone_stats.calls, 1u);
+		CHECK_EQ (zone_stats.frames, 1u);
+	}
+	//the outer zone contains the inner one and sorts first
+	CHECK (stats.size () == 2 && stats[0].avg_us >= stats[1].avg_us && std::string (stats[0].zone->name) == "Outer");
+	Profiler::Get ().SetEnabled (false);
+}
+
+TEST (AggregatesPerFrameTotals)
+{
+	ResetProfiler (true);
+	Profiler &profiler = Profiler::Get ();
+	//zone A: 1, 2 and 3 units per frame, the last one from two calls
+	profiler.Record (&zone_a, 0, 1000, 0);
+	profiler.EndFrame ();
+	profiler.Record (&zone_a, 0, 2000, 0);
+	profiler.Record (&zone_b, 0, 500, 1);
+	profiler.EndFrame ();
+	profiler.Record (&zone_a, 0, 1000, 0);
+	profiler.Record (&zone_a, 0, 2000, 0);
+	profiler.EndFrame ();
+	CHECK_EQ (profiler.GetFrameCount (), 3u);
+
+	std::vector<ProfileZoneStats> stats;
+	profiler.GetZoneStats (stats);
+	const ProfileZoneStats *a = FindStats (stats, &zone_a);
+	const ProfileZoneStats *b = FindStats (stats, &zone_b);
+	CHECK (a && b);
+	if (a && b)
+	{
+		CHECK_EQ (a->calls, 4u);
+		CHECK_EQ (a->frames, 3u);
+		CHECK (a->min_us > 0.0);
+		CHECK (IsNear (a->avg_us, a->min_us * 2.0));
+		CHECK (IsNear (a->max_us, a->min_us * 3.0));
+		CHECK (IsNear (a->p99_us, a->max_us));
+		//zones only count the frames they appear in
+		CHECK_EQ (b->frames, 1u);
+		CHECK (IsNear (b->avg_us, a->min_us * 0.5));
+	}
+	profiler.SetEnabled (false);
+}
+
+TEST (KeepsOnlyTheHistoryWindow)
+{
+	ResetProfiler (true);
+	Profiler &profiler = Profiler::Get ();
+	profiler.SetHistorySize (4);
+	for (uint64_t frame = 1; frame <= 10; frame++)
+	{
+		profiler.Record (&zone_a, 0, frame * 1000, 0);
+		profiler.EndFrame ();
+	}
+	CHECK_EQ (profiler.GetFrameCount (), 4u);
+
+	std::vector<ProfileZoneStats> stats;
+	profiler.GetZoneStats (stats);
+	const ProfileZoneStats *a = FindStats (stats, &zone_a);
+	CHECK (a && a->frames == 4 && a->calls == 4);
+	if (a)
+		CHECK (IsNear (a->max_us, a->min_us * 10.0 / 7.0));
+	profiler.SetEnabled (false);
+}
+
+TEST (GathersEventsOfAllThreads)
+{
+	ResetProfiler (true);
+	std::vector<std::thread> threads;
+	for (int t = 0; t < 4; t++)
+		threads.emplace_back ([]()
+		{
+			for (int i = 0; i < 100; i++)
+				Profiler::Get ().Record (&zone_a, 0, 100, 0);
+		});
+	for (std::thread &thread : threads)
+		thread.join ();
+	//events of exited threads stay with the profiler
+	Profiler::Get ().EndFrame ();
+
+	std::vector<ProfileZoneStats> stats;
+	Profiler::Get ().GetZoneStats (stats);
+	const ProfileZoneStats *a = FindStats (stats, &zone_a);
+	CHECK (a && a->calls == 400 && a->frames == 1);
+	Profiler::Get ().SetEnabled (false);
+}
+
+TEST (ExportsChromeTrace)
+{
+	ResetProfiler (true);
+	Profiler &profiler = Profiler::Get ();
+	PROFILE_THREAD_NAME ("Test \"main\"");
+	profiler.Record (&zone_a, Profiler::GetTimestamp (), Profiler::GetTimestamp () + 10, 0);
+	profiler.Record (&zone_b, Profiler::GetTimestamp (), Profiler::GetTimestamp () + 10, 0);
+	profiler.EndFrame ();
+	const char *const file_name = "test_profiler.json";
+	CHECK (profiler.ExportChromeTrace (file_name));
+
+	std::string json;
+	FILE *f = fopen (file_name, "r");
+	CHECK (f != nullptr);
+	if (f)
+	{
+		char buffer[4096];
+		size_t size;
+		while ((size = fread (buffer, 1, sizeof (buffer), f)) > 0)
+			json.append (buffer, size);
+		fclose (f);
+	}
+	CHECK (json.find ("\"traceEvents\":[") != std::string::npos);
+	CHECK (json.find ("\"name\":\"Frame\"") != std::string::npos);
+	CHECK (json.find ("\"name\":\"ZoneA\"") != std::string::npos);
+	CHECK (json.find ("\"name\":\"Zone \\\"B\\\"\"") != std::string::npos);
+	CHECK (json.find ("{\"name\":\"Test \\\"main\\\"\"}") != std::string::npos);
+	CHECK (json.size () > 4 && json.compare (json.size () - 4, 4, "\n]}\n") == 0);
+	profiler.SetEnabled (false);
+}
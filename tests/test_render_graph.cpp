@@ -0,0 +1,339 @@
+#include "test.h"
+#include "null_device.h"
+#include "render_graph.h"
+
+#include <string.h>
+
+#include <map>
+#include <stdexcept>
+#include <string>
+
+static const uint64_t mb = 1024 * 1024;
+static const GpuResourceStates render_target = GPU_RESOURCE_STATE_RENDER_TARGET;
+static const GpuResourceStates shader_resource = GPU_RESOURCE_STATE_PIXEL_SHADER_RESOURCE;
+static const GpuResourceHandle back_buffer = 1;
+
+//placed resources of 4 bytes per texel; keeps where and in which state they were created
+class MockGraphBackend : public RenderGraphBackend
+{
+public:
+	struct Placed
+	{
+		GpuHeapHandle heap;
+		uint64_t offset;
+		uint64_t size;
+		GpuResourceStates initial_state;
+	};
+
+	MockGraphBackend () :
+		next_handle (100),
+		created (0),
+		live (0)
+	{
+	}
+	void GetAllocationInfo (const RenderGraphResourceDesc &desc, uint64_t &size, uint64_t &alignment) override
+	{
+		size = desc.type == RENDER_GRAPH_RESOURCE_BUFFER ? desc.width : desc.width * desc.height * 4;
+		size = (size + gpu_default_placement_alignment - 1) / gpu_default_placement_alignment * gpu_default_placement_alignment;
+		alignment = gpu_default_placement_alignment;
+	}
+	GpuResourceHandle CreatePlacedResource (const RenderGraphResourceDesc &desc, GpuHeapHandle heap, uint64_t offset, GpuResourceStates initial_state) override
+	{
+		Placed resource = { heap, offset, 0, initial_state };
+		uint64_t alignment;
+		GetAllocationInfo (desc, resource.size, alignment);
+		placed[++next_handle] = resource;
+		created++;
+		live++;
+		return next_handle;
+	}
+	void DestroyResource (GpuResourceHandle) override
+	{
+		live--;
+	}
+
+	GpuResourceHandle next_handle;
+	std::map<GpuResourceHandle, Placed> placed;
+	int created;
+	int live;
+};
+
+//list that keeps every ResourceBarrier call
+class BarrierList : public NullCommandList
+{
+public:
+	explicit BarrierList (NullCommandAllocator *allocator) :
+		NullCommandList (allocator)
+	{
+	}
+	void ResourceBarrier (uint32_t count, const GpuBarrier *barriers) override
+	{
+		batches.push_back (std::vector<GpuBarrier>(barriers, barriers + count));
+	}
+
+	std::vector<std::vector<GpuBarrier>> batches;
+};
+
+//members in the order they must be destroyed last to first
+struct GraphFixture
+{
+	GraphFixture () :
+		scheduler (&device, 2, FRAME_POLICY_MAX_THROUGHPUT),
+		memory (1ull << 40),
+		allocator (&memory, 64 * mb),
+		graph (&backend, &allocator, &scheduler),
+		list (&command_allocator)
+	{
+	}
+
+	NullDevice device;
+	FrameScheduler scheduler;
+	NullMemory memory;
+	GpuMemoryAllocator allocator;
+	MockGraphBackend backend;
+	RenderGraph graph;
+	NullCommandAllocator command_allocator;
+	BarrierList list;
+	std::vector<std::string> executed;
+};
+
+static RenderGraphResourceDesc GetTextureDesc (uint32_t size)
+{
+	RenderGraphResourceDesc desc;
+	memset (&desc, 0, sizeof (desc));
+	desc.type = RENDER_GRAPH_RESOURCE_TEXTURE_2D;
+	desc.width = size;
+	desc.height = size;
+	desc.array_size = 1;
+	desc.mip_levels = 1;
+	desc.format = 28;
+	desc.flags = GPU_RESOURCE_FLAG_ALLOW_RENDER_TARGET;
+	return desc;
+}
+
+static RenderGraph::ExecuteFunction Record (std::vector<std::string> &executed, const char *name)
+{
+	return [&executed, name] (uint32_t job, GpuCommandList *)
+	{
+		executed.push_back (std::string (name) + std::to_string (job));
+	};
+}
+
+struct DeferredFrame
+{
+	RenderGraphResource albedo;
+	RenderGraphResource normal;
+	RenderGraphResource light;
+	RenderGraphResource bloom;
+	RenderGraphResource debug;
+};
+
+//gbuffer -> light (2 jobs) -> bloom -> post into the back buffer; the debug view of
+//the albedo is never read and culled. 1024 x 1024 textures take 4 MB each
+static DeferredFrame DeclareFrame (GraphFixture &fixture, uint32_t bloom_size = 1024)
+{
+	RenderGraph &graph = fixture.graph;
+	std::vector<std::string> &executed = fixture.executed;
+	graph.Reset ();
+	DeferredFrame frame;
+	const RenderGraphResource back = graph.Import ("back", back_buffer, GPU_RESOURCE_STATE_PRESENT, GPU_RESOURCE_STATE_PRESENT);
+	frame.albedo = graph.CreateTransient ("albedo", GetTextureDesc (1024));
+	frame.normal = graph.CreateTransient ("normal", GetTextureDesc (1024));
+	frame.light = graph.CreateTransient ("light", GetTextureDesc (1024));
+	frame.bloom = graph.CreateTransient ("bloom", GetTextureDesc (bloom_size));
+	frame.debug = graph.CreateTransient ("debug", GetTextureDesc (2048));
+
+	const RenderGraphPass gbuffer = graph.AddPass ("gbuffer", 1, Record (executed, "gbuffer"));
+	graph.Write (gbuffer, frame.albedo, render_target);
+	graph.Write (gbuffer, frame.normal, render_target);
+	const RenderGraphPass debug = graph.AddPass ("debug", 1, Record (executed, "debug"));
+	graph.Read (debug, frame.albedo, shader_resource);
+	graph.Write (debug, frame.debug, render_target);
+	const RenderGraphPass light = graph.AddPass ("light", 2, Record (executed, "light"));
+	graph.Read (light, frame.albedo, shader_resource);
+	graph.Read (light, frame.normal, shader_resource);
+	graph.Write (light, frame.light, render_target);
+	const RenderGraphPass bloom = graph.AddPass ("bloom", 1, Record (executed, "bloom"));
+	graph.Read (bloom, frame.light, shader_resource);
+	graph.Write (bloom, frame.bloom, render_target);
+	const RenderGraphPass post = graph.AddPass ("post", 1, Record (executed, "post"));
+	graph.Read (post, frame.light, shader_resource);
+	graph.Read (post, frame.bloom, shader_resource | GPU_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+	graph.Read (post, frame.bloom, shader_resource);
+	graph.Write (post, back, render_target);
+	return frame;
+}
+
+static void RecordFrame (GraphFixture &fixture)
+{
+	fixture.executed.clear ();
+	fixture.list.batches.clear ();
+	for (uint32_t job = 0; job < fixture.graph.GetJobCount (); job++)
+		fixture.graph.RecordJob (job, &fixture.list);
+}
+
+TEST (CullsPassesWithoutUsedResults)
+{
+	GraphFixture fixture;
+	const DeferredFrame frame = DeclareFrame (fixture);
+	fixture.graph.Compile ();
+	RecordFrame (fixture);
+
+	const RenderGraphStats &stats = fixture.graph.GetStats ();
+	CHECK (stats.passes == 5 && stats.culled_passes == 1);
+	CHECK_EQ (fixture.graph.GetJobCount (), 5u);
+	const char *expected[] = { "gbuffer0", "light0", "light1", "bloom0", "post0" };
+	CHECK_EQ (fixture.executed.size (), 5u);
+	for (size_t i = 0; i < fixture.executed.size (); i++)
+		CHECK (fixture.executed[i] == expected[i]);
+	//the culled pass leaves its output without memory
+	CHECK_EQ (stats.transient_resources, 4u);
+	CHECK_EQ (fixture.graph.GetHandle (frame.debug), GpuResourceHandle (0));
+	CHECK_EQ (fixture.backend.live, 4);
+}
+
+TEST (SideEffectsKeepPasses)
+{
+	GraphFixture fixture;
+	RenderGraph &graph = fixture.graph;
+	const RenderGraphResource buffer = graph.CreateTransient ("readback", GetTextureDesc (256));
+	const RenderGraphPass write = graph.AddPass ("write", 1, Record (fixture.executed, "write"));
+	graph.Write (write, buffer, GPU_RESOURCE_STATE_COPY_DEST);
+	const RenderGraphPass copy = graph.AddPass ("copy", 1, Record (fixture.executed, "copy"));
+	graph.Read (copy, buffer, GPU_RESOURCE_STATE_COPY_SOURCE);
+	graph.Compile ();
+	CHECK_EQ (graph.GetJobCount (), 0u);
+
+	graph.SetSideEffect (copy);
+	graph.Compile ();
+	RecordFrame (fixture);
+	CHECK (fixture.executed.size () == 2 && fixture.executed[0] == "write0" && fixture.executed[1] == "copy0");
+	CHECK_EQ (graph.GetStats ().culled_passes, 0u);
+}
+
+TEST (AliasesTransientsWithDisjointLifetimes)
+{
+	GraphFixture fixture;
+	const DeferredFrame frame = DeclareFrame (fixture);
+	fixture.graph.Compile ();
+	RecordFrame (fixture);
+
+	//albedo and normal die in the light pass, bloom is born after it
+	const RenderGraphStats &stats = fixture.graph.GetStats ();
+	CHECK_EQ (stats.unaliased_bytes, 16 * mb);
+	CHECK_EQ (stats.transient_bytes, 12 * mb);
+	const MockGraphBackend::Placed &albedo = fixture.backend.placed[fixture.graph.GetHandle (frame.albedo)];
+	const MockGraphBackend::Placed &normal = fixture.backend.placed[fixture.graph.GetHandle (frame.normal)];
+	const MockGraphBackend::Placed &light = fixture.backend.placed[fixture.graph.GetHandle (frame.light)];
+	const MockGraphBackend::Placed &bloom = fixture.backend.placed[fixture.graph.GetHandle (frame.bloom)];
+	CHECK (albedo.heap == bloom.heap && albedo.offset == bloom.offset);
+	CHECK (normal.offset != albedo.offset && light.offset != albedo.offset && light.offset != normal.offset);
+	std::vector<GpuHeapHandle> heaps;
+	fixture.graph.GetTransientHeaps (heaps);
+	CHECK (heaps.size () == 1 && heaps[0] == albedo.heap);
+
+	//each of the two takes over the memory from the other one with an aliasing barrier
+	CHECK_EQ (stats.aliasing_barriers, 2u);
+	uint32_t aliasing = 0;
+	for (const std::vector<GpuBarrier> &batch : fixture.list.batches)
+		for (const GpuBarrier &barrier : batch)
+			if (barrier.type == GPU_BARRIER_TYPE_ALIASING)
+			{
+				aliasing++;
+				const bool to_bloom = barrier.resource == fixture.graph.GetHandle (frame.bloom) &&
+									  barrier.resource_before == fixture.graph.GetHandle (frame.albedo);
+				const bool to_albedo = barrier.resource == fixture.graph.GetHandle (frame.albedo) &&
+									   barrier.resource_before == fixture.graph.GetHandle (frame.bloom);
+				CHECK (to_bloom || to_albedo);
+			}
+	CHECK_EQ (aliasing, 2u);
+}
+
+TEST (BarriersFollowTheStatesAcrossFrames)
+{
+	GraphFixture fixture;
+	std::map<GpuResourceHandle, GpuResourceStates> states;
+	states[back_buffer] = GPU_RESOURCE_STATE_PRESENT;
+	for (int frame = 0; frame < 3; frame++)
+	{
+		fixture.scheduler.BeginFrame ();
+		DeclareFrame (fixture);
+		fixture.graph.Compile ();
+		RecordFrame (fixture);
+		//placed resources start in the state they are created in
+		for (const auto &placed : fixture.backend.placed)
+			if (!states.count (placed.first))
+				states[placed.first] = placed.second.initial_state;
+
+		//one call per pass with barriers and one after the last pass, which all start
+		//from the state the resource is in
+		const RenderGraphStats &stats = fixture.graph.GetStats ();
+		CHECK_EQ (fixture.list.batches.size (), size_t (stats.barrier_batches));
+		uint32_t transitions = 0;
+		for (const std::vector<GpuBarrier> &batch : fixture.list.batches)
+			for (const GpuBarrier &barrier : batch)
+			{
+				if (barrier.type != GPU_BARRIER_TYPE_TRANSITION)
+					continue;
+				transitions++;
+				CHECK_EQ (states[barrier.resource], barrier.state_before);
+				CHECK (barrier.state_before != barrier.state_after);
+				states[barrier.resource] = barrier.state_after;
+			}
+		CHECK_EQ (transitions, stats.transitions);
+		//two per transient and the back buffer, the combined read of bloom needs none
+		CHECK_EQ (stats.transitions, 10u);
+		CHECK_EQ (states[back_buffer], GpuResourceStates (GPU_RESOURCE_STATE_PRESENT));
+		fixture.scheduler.EndFrame ();
+	}
+}
+
+TEST (CompilationIsCachedWhileTheStructureStays)
+{
+	GraphFixture fixture;
+	for (int frame = 0; frame < 4; frame++)
+	{
+		fixture.scheduler.BeginFrame ();
+		DeclareFrame (fixture);
+		fixture.graph.Compile ();
+		fixture.scheduler.EndFrame ();
+	}
+	RenderGraphStats stats = fixture.graph.GetStats ();
+	CHECK (stats.compilations == 1 && stats.cache_hits == 3);
+	CHECK_EQ (fixture.backend.created, 4);
+
+	//a resized bloom target compiles again; the old resources live until the GPU is done
+	fixture.scheduler.BeginFrame ();
+	const DeferredFrame frame = DeclareFrame (fixture, 512);
+	fixture.graph.Compile ();
+	fixture.scheduler.EndFrame ();
+	stats = fixture.graph.GetStats ();
+	CHECK_EQ (stats.compilations, 2u);
+	CHECK_EQ (fixture.backend.created, 8);
+	CHECK_EQ (fixture.backend.placed[fixture.graph.GetHandle (frame.bloom)].size, 1 * mb);
+	fixture.scheduler.WaitForIdle ();
+	CHECK_EQ (fixture.backend.live, 4);
+	CHECK_EQ (fixture.allocator.GetStats (GPU_HEAP_TIER_RENDER_TARGETS).allocation_count, 1u);
+}
+
+TEST (RejectsInvalidDeclarations)
+{
+	GraphFixture fixture;
+	RenderGraph &graph = fixture.graph;
+	RenderGraphResourceDesc empty = GetTextureDesc (0);
+	CHECK_THROWS (graph.CreateTransient ("empty", empty), std::invalid_argument);
+	CHECK_THROWS (graph.AddPass ("none", 0, Record (fixture.executed, "none")), std::invalid_argument);
+	const RenderGraphResource back = graph.Import ("back", back_buffer, GPU_RESOURCE_STATE_PRESENT, GPU_RESOURCE_STATE_PRESENT);
+	const RenderGraphPass pass = graph.AddPass ("pass", 1, Record (fixture.executed, "pass"));
+	CHECK_THROWS (graph.Write (pass, back + 1, render_target), std::out_of_range);
+	CHECK_THROWS (graph.Read (pass + 1, back, shader_resource), std::out_of_range);
+
+	//a write and a read of the same resource in one pass
+	graph.Write (pass, back, render_target);
+	graph.Read (pass, back, shader_resource);
+	CHECK_THROWS (graph.Compile (), std::logic_error);
+
+	graph.Reset ();
+	graph.Compile ();
+	CHECK_THROWS (graph.RecordJob (0, &fixture.list), std::out_of_range);
+}
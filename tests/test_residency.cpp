@@ -0,0 +1,227 @@
+#include "test.h"
+#include "residency.h"
+#include "null_device.h"
+
+#include <stdexcept>
+#include <vector>
+
+static const uint64_t mb = 1024 * 1024;
+
+static ResidencyOptions MakeOptions (float evict_ratio, float target_ratio)
+{
+	ResidencyOptions options;
+	options.evict_ratio = evict_ratio;
+	options.target_ratio = target_ratio;
+	return options;
+}
+
+TEST (EvictsLeastRecentlyUsedDownToTheTarget)
+{
+	NullMemory memory (100 * mb);
+	ResidencyManager manager (&memory, &memory, MakeOptions (1.0f, 0.8f));
+	std::vector<GpuHeapHandle> heaps;
+	//heap i is last used by fence i + 1
+	for (uint64_t i = 0; i < 10; i++)
+	{
+		heaps.push_back (manager.CreateHeap (GPU_HEAP_TIER_TEXTURES, 10 * mb));
+		manager.Use (heaps[i]);
+		manager.Submit (i + 1, i);
+	}
+	CHECK_EQ (manager.GetStats ().eviction_batches, 0u);
+	CHECK_EQ (memory.GetStats ().usage, 100 * mb);
+
+	//130 MB: the five oldest heaps go in one batch, down to 80 MB
+	for (uint32_t i = 0; i < 3; i++)
+	{
+		heaps.push_back (manager.CreateHeap (GPU_HEAP_TIER_TEXTURES, 10 * mb));
+		manager.Use (heaps.back ());
+	}
+	manager.Submit (11, 10);
+	const ResidencyStats stats = manager.GetStats ();
+	CHECK_EQ (stats.budget, 100 * mb);
+	CHECK_EQ (stats.usage, 80 * mb);
+	CHECK_EQ (stats.over_budget_bytes, 0u);
+	CHECK_EQ (stats.used_heaps, 3u);
+	CHECK_EQ (stats.used_bytes, 30 * mb);
+	CHECK_EQ (stats.made_resident_heaps, 0u);
+	CHECK_EQ (stats.evicted_heaps, 5u);
+	CHECK_EQ (stats.evicted_bytes, 50 * mb);
+	CHECK_EQ (stats.eviction_batches, 1u);
+	CHECK_EQ (stats.total_evicted_bytes, 50 * mb);
+	CHECK_EQ (stats.heaps, 13u);
+	CHECK_EQ (stats.resident_heaps, 8u);
+	CHECK_EQ (stats.tracked_bytes, 130 * mb);
+	CHECK_EQ (stats.resident_bytes, 80 * mb);
+	CHECK_EQ (stats.submissions, 11u);
+	for (size_t i = 0; i < heaps.size (); i++)
+	{
+		CHECK_EQ (manager.IsResident (heaps[i]), i >= 5);
+		CHECK_EQ (memory.IsResident (heaps[i]), i >= 5);
+	}
+	CHECK_EQ (memory.GetStats ().usage, 80 * mb);
+	CHECK_EQ (memory.GetStats ().evict_calls, 1u);
+}
+
+TEST (HeapsTheGpuMayUseStayResident)
+{
+	NullMemory memory (100 * mb);
+	ResidencyManager manager (&memory, &memory, MakeOptions (1.0f, 0.8f));
+	std::vector<GpuHeapHandle> heaps;
+	for (uint32_t i = 0; i < 10; i++)
+	{
+		heaps.push_back (manager.CreateHeap (GPU_HEAP_TIER_BUFFERS, 10 * mb));
+		manager.Use (heaps[i]);
+	}
+	manager.Submit (1, 0);
+
+	//fence 1 has not completed, so nothing can go and the overshoot is reported
+	for (uint32_t i = 0; i < 2; i++)
+	{
+		heaps.push_back (manager.CreateHeap (GPU_HEAP_TIER_BUFFERS, 10 * mb));
+		manager.Use (heaps.back ());
+	}
+	manager.Submit (2, 0);
+	ResidencyStats stats = manager.GetStats ();
+	CHECK_EQ (stats.evicted_heaps, 0u);
+	CHECK_EQ (stats.eviction_batches, 0u);
+	CHECK_EQ (stats.usage, 120 * mb);
+	CHECK_EQ (stats.over_budget_bytes, 20 * mb);
+	CHECK_EQ (memory.GetStats ().evict_calls, 0u);
+
+	//once it has, the heaps of fence 1 are evicted but not those of fence 2
+	manager.Submit (3, 1);
+	stats = manager.GetStats ();
+	CHECK_EQ (stats.used_heaps, 0u);
+	CHECK_EQ (stats.evicted_heaps, 4u);
+	CHECK_EQ (stats.usage, 80 * mb);
+	CHECK_EQ (stats.over_budget_bytes, 0u);
+	CHECK (manager.IsResident (heaps[10]) && manager.IsResident (heaps[11]));
+
+	//memory the manager does not track counts against the budget as well
+	memory.SetExternalUsage (30 * mb);
+	manager.Submit (4, 3);
+	stats = manager.GetStats ();
+	CHECK_EQ (stats.evicted_heaps, 3u);
+	CHECK_EQ (stats.resident_bytes, 50 * mb);
+	CHECK_EQ (stats.usage, 80 * mb);
+	CHECK_EQ (memory.GetStats ().usage, 80 * mb);
+}
+
+TEST (HysteresisBatchesEvictions)
+{
+	//a heap streamed in every frame: without a gap below the threshold every frame evicts
+	//one heap, with a target of 75% one batch of four makes room for four frames
+	const float targets[2] = { 1.0f, 0.75f };
+	const uint64_t batches[2] = { 12, 3 };
+	for (uint32_t t = 0; t < 2; t++)
+	{
+		NullMemory memory (100 * mb);
+		ResidencyManager manager (&memory, &memory, MakeOptions (1.0f, targets[t]));
+		for (uint32_t i = 0; i < 10; i++)
+			manager.CreateHeap (GPU_HEAP_TIER_TEXTURES, 10 * mb);
+		for (uint64_t frame = 1; frame <= 12; frame++)
+		{
+			manager.Use (manager.CreateHeap (GPU_HEAP_TIER_TEXTURES, 10 * mb));
+			manager.Submit (frame, frame - 1);
+			const ResidencyStats stats = manager.GetStats ();
+			CHECK (stats.usage <= 100 * mb);
+			//between the target and the threshold nothing is evicted
+			if (t == 1 && frame % 4 != 1)
+				CHECK_EQ (stats.evicted_heaps, 0u);
+		}
+		const ResidencyStats stats = manager.GetStats ();
+		CHECK_EQ (stats.eviction_batches, batches[t]);
+		CHECK_EQ (stats.total_evicted_bytes, 120 * mb);
+		CHECK_EQ (memory.GetStats ().evict_calls, batches[t]);
+		CHECK_EQ (memory.GetStats ().redundant, 0u);
+	}
+}
+
+TEST (EvictedHeapsComeBackWhenUsed)
+{
+	NullMemory memory (100 * mb);
+	ResidencyManager manager (&memory, &memory, MakeOptions (1.0f, 0.8f));
+	std::vector<GpuHeapHandle> heaps;
+	for (uint64_t i = 0; i < 12; i++)
+	{
+		heaps.push_back (manager.CreateHeap (GPU_HEAP_TIER_TEXTURES, 10 * mb));
+		manager.Use (heaps[i]);
+		manager.Submit (i + 1, i);
+	}
+	//fence 11 overshot: heaps 0 to 2 were evicted
+	CHECK_EQ (manager.GetStats ().total_evicted_bytes, 30 * mb);
+	CHECK (!manager.IsResident (heaps[2]) && manager.IsResident (heaps[3]));
+
+	//one fits in the budget
+	manager.Use (heaps[0]);
+	manager.Submit (13, 12);
+	ResidencyStats stats = manager.GetStats ();
+	CHECK_EQ (stats.made_resident_heaps, 1u);
+	CHECK_EQ (stats.made_resident_bytes, 10 * mb);
+	CHECK_EQ (stats.evicted_heaps, 0u);
+	CHECK_EQ (stats.usage, 100 * mb);
+	CHECK (manager.IsResident (heaps[0]) && memory.IsResident (heaps[0]));
+	CHECK_EQ (memory.GetStats ().make_resident_calls, 1u);
+
+	//two more make room by evicting the oldest heaps first, never the ones coming back
+	for (uint32_t i = 1; i < 3; i++)
+		manager.Use (heaps[i]);
+	manager.Use (heaps[11]);
+	manager.Submit (14, 13);
+	stats = manager.GetStats ();
+	CHECK_EQ (stats.used_heaps, 3u);
+	CHECK_EQ (stats.made_resident_heaps, 2u);
+	CHECK_EQ (stats.made_resident_bytes, 20 * mb);
+	CHECK_EQ (stats.evicted_heaps, 4u);
+	CHECK_EQ (stats.usage, 80 * mb);
+	CHECK_EQ (stats.total_made_resident_bytes, 30 * mb);
+	for (size_t i = 0; i < heaps.size (); i++)
+		CHECK_EQ (memory.IsResident (heaps[i]), i < 3 || i > 6);
+	CHECK_EQ (memory.GetStats ().make_resident_calls, 2u);
+	CHECK_EQ (memory.GetStats ().redundant, 0u);
+	CHECK_EQ (memory.GetStats ().usage, 80 * mb);
+}
+
+TEST (DestroyingAndMisuse)
+{
+	NullMemory memory (100 * mb);
+	ResidencyManager manager (&memory, &memory, MakeOptions (1.0f, 0.5f));
+	std::vector<GpuHeapHandle> heaps;
+	for (uint32_t i = 0; i < 11; i++)
+		heaps.push_back (manager.CreateHeap (GPU_HEAP_TIER_RENDER_TARGETS, 10 * mb));
+	manager.Submit (1, 0);
+	CHECK_EQ (manager.GetStats ().evicted_heaps, 6u);
+	CHECK (!manager.IsResident (heaps[0]));
+
+	//an evicted heap and a resident one
+	manager.DestroyHeap (heaps[0]);
+	manager.DestroyHeap (heaps[10]);
+	ResidencyStats stats = manager.GetStats ();
+	CHECK_EQ (stats.heaps, 9u);
+	CHECK_EQ (stats.resident_heaps, 4u);
+	CHECK_EQ (stats.tracked_bytes, 90 * mb);
+	CHECK_EQ (stats.resident_bytes, 40 * mb);
+	CHECK_EQ (memory.GetStats ().heaps, 9u);
+	CHECK_EQ (memory.GetStats ().usage, 40 * mb);
+	CHECK_THROWS (manager.Use (heaps[0]), std::invalid_argument);
+	CHECK_THROWS (manager.IsResident (heaps[10]), std::invalid_argument);
+
+	//a heap destroyed between Use () and Submit () is dropped, even when its slot is reused
+	manager.Use (heaps[1]);
+	manager.Use (heaps[2]);
+	manager.DestroyHeap (heaps[1]);
+	const GpuHeapHandle reused = manager.CreateHeap (GPU_HEAP_TIER_BUFFERS, 5 * mb);
+	manager.Submit (2, 1);
+	stats = manager.GetStats ();
+	CHECK_EQ (stats.used_heaps, 1u);
+	CHECK_EQ (stats.made_resident_heaps, 1u);
+	CHECK_EQ (stats.made_resident_bytes, 10 * mb);
+	CHECK (manager.IsResident (heaps[2]) && manager.IsResident (reused));
+
+	//unknown heaps, fence values that do not grow and a target above the threshold
+	CHECK_THROWS (manager.Use (12345), std::invalid_argument);
+	CHECK_THROWS (manager.Submit (2, 1), std::invalid_argument);
+	CHECK_THROWS (manager.Submit (3, 3), std::invalid_argument);
+	CHECK_THROWS (ResidencyManager (&memory, &memory, MakeOptions (0.8f, 0.9f)), std::invalid_argument);
+	CHECK_THROWS (ResidencyManager (&memory, &memory, MakeOptions (1.0f, 0.0f)), std::invalid_argument);
+}
@@ -0,0 +1,250 @@
+#include "test.h"
+#include "null_device.h"
+#include "resource_state.h"
+
+#include <stdexcept>
+
+//list that keeps every ResourceBarrier call
+class BarrierList : public NullCommandList
+{
+public:
+	explicit BarrierList (NullCommandAllocator *allocator) :
+		NullCommandList (allocator)
+	{
+	}
+	void ResourceBarrier (uint32_t count, const GpuBarrier *barriers) override
+	{
+		batches.push_back (std::vector<GpuBarrier>(barriers, barriers + count));
+	}
+
+	std::vector<std::vector<GpuBarrier>> batches;
+};
+
+static bool IsTransition (const GpuBarrier &barrier, GpuResourceHandle resource, GpuResourceStates before, GpuResourceStates after,
+						  uint32_t subresource = gpu_all_subresources, uint32_t flags = GPU_BARRIER_FLAG_NONE)
+{
+	return barrier.type == GPU_BARRIER_TYPE_TRANSITION && barrier.resource == resource && barrier.subresource == subresource &&
+		   barrier.state_before == before && barrier.state_after == after && barrier.flags == flags;
+}
+
+TEST (FirstUseIsResolvedAtSubmit)
+{
+	NullCommandAllocator allocator;
+	BarrierList list (&allocator);
+	ResourceStateRegistry registry;
+	registry.Register (1, 1, GPU_RESOURCE_STATE_COMMON);
+	ResourceStateTracker tracker (&registry);
+
+	//the list does not know the state before it runs, nothing is recorded
+	tracker.Transition (1, GPU_RESOURCE_STATE_RENDER_TARGET);
+	tracker.FlushBarriers (&list);
+	CHECK (list.batches.empty ());
+
+	std::vector<GpuBarrier> hoisted, fixups;
+	tracker.Resolve (1, hoisted, fixups);
+	CHECK_EQ (hoisted.size (), 1u);
+	CHECK (IsTransition (hoisted[0], 1, GPU_RESOURCE_STATE_COMMON, GPU_RESOURCE_STATE_RENDER_TARGET));
+	CHECK (fixups.empty ());
+	CHECK_EQ (registry.GetState (1), GpuResourceStates (GPU_RESOURCE_STATE_RENDER_TARGET));
+}
+
+TEST (BarriersBetweenDrawsAreOneBatch)
+{
+	NullCommandAllocator allocator;
+	BarrierList list (&allocator);
+	ResourceStateRegistry registry;
+	ResourceStateTracker tracker (&registry);
+	for (GpuResourceHandle resource = 1; resource <= 3; resource++)
+	{
+		registry.Register (resource, 1, GPU_RESOURCE_STATE_RENDER_TARGET);
+		tracker.Transition (resource, GPU_RESOURCE_STATE_RENDER_TARGET);
+	}
+	for (GpuResourceHandle resource = 1; resource <= 3; resource++)
+		tracker.Transition (resource, GPU_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+	tracker.FlushBarriers (&list);
+	tracker.Transition (2, GPU_RESOURCE_STATE_COPY_SOURCE);
+	tracker.FlushBarriers (&list);
+	//nothing queued, no call
+	tracker.FlushBarriers (&list);
+
+	CHECK_EQ (list.batches.size (), 2u);
+	CHECK_EQ (list.batches[0].size (), 3u);
+	for (GpuResourceHandle resource = 1; resource <= 3; resource++)
+		CHECK (IsTransition (list.batches[0][resource - 1], resource, GPU_RESOURCE_STATE_RENDER_TARGET, GPU_RESOURCE_STATE_PIXEL_SHADER_RESOURCE));
+	CHECK (IsTransition (list.batches[1][0], 2, GPU_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, GPU_RESOURCE_STATE_COPY_SOURCE));
+
+	const ResourceStateStats &stats = tracker.GetStats ();
+	CHECK (stats.transitions == 7 && stats.barriers == 4 && stats.batches == 2 && stats.max_batch == 3);
+}
+
+TEST (RepeatedTransitionsCollapseBeforeTheFlush)
+{
+	NullCommandAllocator allocator;
+	BarrierList list (&allocator);
+	ResourceStateRegistry registry;
+	registry.Register (1, 1, GPU_RESOURCE_STATE_RENDER_TARGET);
+	registry.Register (2, 1, GPU_RESOURCE_STATE_RENDER_TARGET);
+	ResourceStateTracker tracker (&registry);
+	tracker.Transition (1, GPU_RESOURCE_STATE_RENDER_TARGET);
+	tracker.Transition (2, GPU_RESOURCE_STATE_RENDER_TARGET);
+
+	//RT -> SRV -> COPY_SOURCE becomes one barrier, RT -> SRV -> RT none
+	tracker.Transition (1, GPU_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+	tracker.Transition (2, GPU_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+	tracker.Transition (1, GPU_RESOURCE_STATE_COPY_SOURCE);
+	tracker.Transition (2, GPU_RESOURCE_STATE_RENDER_TARGET);
+	tracker.FlushBarriers (&list);
+	CHECK_EQ (list.batches.size (), 1u);
+	CHECK_EQ (list.batches[0].size (), 1u);
+	CHECK (IsTransition (list.batches[0][0], 1, GPU_RESOURCE_STATE_RENDER_TARGET, GPU_RESOURCE_STATE_COPY_SOURCE));
+}
+
+TEST (RedundantTransitionsAreDropped)
+{
+	NullCommandAllocator allocator;
+	BarrierList list (&allocator);
+	ResourceStateRegistry registry;
+	registry.Register (1, 1, GPU_RESOURCE_STATE_COMMON);
+	ResourceStateTracker tracker (&registry);
+	const GpuResourceStates shader_resource = GPU_RESOURCE_STATE_PIXEL_SHADER_RESOURCE | GPU_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE;
+	tracker.Transition (1, shader_resource);
+	//the same state and a read state included in the combined one need no barrier
+	tracker.Transition (1, shader_resource);
+	tracker.Transition (1, GPU_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+	tracker.FlushBarriers (&list);
+	CHECK (list.batches.empty ());
+	CHECK_EQ (tracker.GetStats ().redundant, 2u);
+
+	//a write state is left for another one
+	tracker.Transition (1, GPU_RESOURCE_STATE_COPY_DEST);
+	tracker.Transition (1, GPU_RESOURCE_STATE_COPY_DEST | GPU_RESOURCE_STATE_COPY_SOURCE);
+	tracker.FlushBarriers (&list);
+	CHECK_EQ (list.batches.size (), 1u);
+	CHECK (IsTransition (list.batches[0][0], 1, shader_resource, GPU_RESOURCE_STATE_COPY_DEST | GPU_RESOURCE_STATE_COPY_SOURCE));
+}
+
+TEST (SubresourcesAreTrackedApart)
+{
+	NullCommandAllocator allocator;
+	BarrierList list (&allocator);
+	ResourceStateRegistry registry;
+	registry.Register (1, 4, GPU_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+	ResourceStateTracker tracker (&registry);
+	tracker.Transition (1, GPU_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+	//mip by mip downsampling: each mip is a render target once
+	tracker.Transition (1, GPU_RESOURCE_STATE_RENDER_TARGET, 1);
+	tracker.FlushBarriers (&list);
+	tracker.Transition (1, GPU_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, 1);
+	tracker.Transition (1, GPU_RESOURCE_STATE_RENDER_TARGET, 2);
+	tracker.FlushBarriers (&list);
+	CHECK_EQ (list.batches.size (), 2u);
+	CHECK (IsTransition (list.batches[0][0], 1, GPU_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, GPU_RESOURCE_STATE_RENDER_TARGET, 1));
+	CHECK_EQ (list.batches[1].size (), 2u);
+	CHECK_THROWS (tracker.Transition (1, GPU_RESOURCE_STATE_COPY_SOURCE, 4), std::out_of_range);
+
+	//the whole resource from mixed states needs a barrier per subresource that changes
+	tracker.Transition (1, GPU_RESOURCE_STATE_COPY_SOURCE);
+	tracker.FlushBarriers (&list);
+	CHECK_EQ (list.batches[2].size (), 4u);
+	CHECK (IsTransition (list.batches[2][2], 1, GPU_RESOURCE_STATE_RENDER_TARGET, GPU_RESOURCE_STATE_COPY_SOURCE, 2));
+	//from one state to one state it is a single barrier
+	tracker.Transition (1, GPU_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+	tracker.FlushBarriers (&list);
+	CHECK_EQ (list.batches[3].size (), 1u);
+	CHECK (IsTransition (list.batches[3][0], 1, GPU_RESOURCE_STATE_COPY_SOURCE, GPU_RESOURCE_STATE_PIXEL_SHADER_RESOURCE));
+
+	std::vector<GpuBarrier> hoisted, fixups;
+	tracker.Resolve (1, hoisted, fixups);
+	CHECK (hoisted.empty () && fixups.empty ());
+	for (uint32_t i = 0; i < 4; i++)
+		CHECK_EQ (registry.GetState (1, i), GpuResourceStates (GPU_RESOURCE_STATE_PIXEL_SHADER_RESOURCE));
+}
+
+TEST (SplitBarriersBeginAndEndAtLaterFlushes)
+{
+	NullCommandAllocator allocator;
+	BarrierList list (&allocator);
+	ResourceStateRegistry registry;
+	registry.Register (1, 1, GPU_RESOURCE_STATE_RENDER_TARGET);
+	ResourceStateTracker tracker (&registry);
+	CHECK_THROWS (tracker.BeginTransition (1, GPU_RESOURCE_STATE_PIXEL_SHADER_RESOURCE), std::logic_error);
+	tracker.Transition (1, GPU_RESOURCE_STATE_RENDER_TARGET);
+
+	tracker.BeginTransition (1, GPU_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+	tracker.FlushBarriers (&list);
+	//the resource can not be used while the transition runs
+	CHECK_THROWS (tracker.Transition (1, GPU_RESOURCE_STATE_COPY_SOURCE), std::logic_error);
+	std::vector<GpuBarrier> hoisted, fixups;
+	CHECK_THROWS (tracker.Resolve (1, hoisted, fixups), std::logic_error);
+	tracker.EndTransition (1);
+	tracker.FlushBarriers (&list);
+
+	CHECK_EQ (list.batches.size (), 2u);
+	CHECK (IsTransition (list.batches[0][0], 1, GPU_RESOURCE_STATE_RENDER_TARGET, GPU_RESOURCE_STATE_PIXEL_SHADER_RESOURCE,
+						 gpu_all_subresources, GPU_BARRIER_FLAG_BEGIN_ONLY));
+	CHECK (IsTransition (list.batches[1][0], 1, GPU_RESOURCE_STATE_RENDER_TARGET, GPU_RESOURCE_STATE_PIXEL_SHADER_RESOURCE,
+						 gpu_all_subresources, GPU_BARRIER_FLAG_END_ONLY));
+	tracker.Resolve (1, hoisted, fixups);
+	CHECK_EQ (registry.GetState (1), GpuResourceStates (GPU_RESOURCE_STATE_PIXEL_SHADER_RESOURCE));
+}
+
+TEST (LaterListsOfASubmissionGetFixups)
+{
+	NullCommandAllocator allocator;
+	BarrierList list (&allocator);
+	ResourceStateRegistry registry;
+	registry.Register (1, 1, GPU_RESOURCE_STATE_COMMON);
+	registry.Register (2, 1, GPU_RESOURCE_STATE_COPY_DEST);
+	ResourceStateTracker first (&registry);
+	ResourceStateTracker second (&registry);
+
+	//the first list renders to 1, the second samples it and reads 2
+	first.Transition (1, GPU_RESOURCE_STATE_RENDER_TARGET);
+	second.Transition (1, GPU_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+	second.Transition (2, GPU_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+
+	std::vector<GpuBarrier> hoisted, fixups;
+	first.Resolve (7, hoisted, fixups);
+	CHECK (hoisted.size () == 1 && fixups.empty ());
+	hoisted.clear ();
+	second.Resolve (7, hoisted, fixups);
+	//2 was not touched by the first list and can change before both of them
+	CHECK_EQ (hoisted.size (), 1u);
+	CHECK (IsTransition (hoisted[0], 2, GPU_RESOURCE_STATE_COPY_DEST, GPU_RESOURCE_STATE_PIXEL_SHADER_RESOURCE));
+	CHECK_EQ (fixups.size (), 1u);
+	CHECK (IsTransition (fixups[0], 1, GPU_RESOURCE_STATE_RENDER_TARGET, GPU_RESOURCE_STATE_PIXEL_SHADER_RESOURCE));
+	CHECK_EQ (second.GetStats ().fixups, 2u);
+
+	//the next submission starts from the registry, the read state stays as it is
+	ResourceStateTracker third (&registry);
+	third.Transition (1, GPU_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+	hoisted.clear ();
+	fixups.clear ();
+	third.Resolve (8, hoisted, fixups);
+	CHECK (hoisted.empty () && fixups.empty ());
+}
+
+TEST (ResolveChecksTheList)
+{
+	NullCommandAllocator allocator;
+	BarrierList list (&allocator);
+	ResourceStateRegistry registry;
+	CHECK_THROWS (registry.Register (1, 0, GPU_RESOURCE_STATE_COMMON), std::invalid_argument);
+	registry.Register (1, 1, GPU_RESOURCE_STATE_COMMON);
+	ResourceStateTracker tracker (&registry);
+	CHECK_THROWS (tracker.Transition (9, GPU_RESOURCE_STATE_COMMON), std::invalid_argument);
+
+	std::vector<GpuBarrier> hoisted, fixups;
+	tracker.Transition (1, GPU_RESOURCE_STATE_COPY_DEST);
+	tracker.Transition (1, GPU_RESOURCE_STATE_COPY_SOURCE);
+	CHECK_THROWS (tracker.Resolve (1, hoisted, fixups), std::logic_error);
+	tracker.FlushBarriers (&list);
+	registry.Unregister (1);
+	CHECK_THROWS (tracker.Resolve (1, hoisted, fixups), std::logic_error);
+	CHECK_THROWS (registry.Unregister (1), std::logic_error);
+
+	tracker.Reset ();
+	CHECK_EQ (tracker.GetStats ().transitions, 0u);
+	tracker.Resolve (1, hoisted, fixups);
+	CHECK (hoisted.empty () && fixups.empty ());
+}
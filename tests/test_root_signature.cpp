@@ -0,0 +1,158 @@
+#include "test.h"
+#include "root_signature.h"
+#include "bindless.h"
+
+#include <string.h>
+
+#include <atomic>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+//hands out increasing handles and counts what is alive
+class CountingRootSignatureBackend : public RootSignatureBackend
+{
+public:
+	CountingRootSignatureBackend () : next_handle (1), created (0), live (0)
+	{
+	}
+	RootSignature CreateRootSignature (const RootSignatureDesc &desc) override
+	{
+		created++;
+		live++;
+		RootSignature root_signature = { next_handle++, HashRootSignatureDesc (desc) };
+		return root_signature;
+	}
+	void DestroyRootSignature (GpuRootSignatureHandle) override
+	{
+		live--;
+	}
+
+	std::atomic<uint64_t> next_handle;
+	std::atomic<int> created;
+	std::atomic<int> live;
+};
+
+static RootSignatureDesc MakeTableDesc ()
+{
+	RootSignatureDesc desc;
+	memset (&desc, 0, sizeof (desc));
+	desc.parameter_count = 2;
+	desc.parameters[0].type = ROOT_PARAMETER_CBV;
+	desc.parameters[0].shader_register = 1;
+	desc.parameters[1].type = ROOT_PARAMETER_TABLE;
+	desc.parameters[1].range_count = 1;
+	desc.parameters[1].ranges[0].type = ROOT_RANGE_SRV;
+	desc.parameters[1].ranges[0].count = 8;
+	return desc;
+}
+
+TEST (NormalizationIgnoresUnusedFields)
+{
+	RootSignatureDesc desc = MakeTableDesc ();
+	RootSignatureDesc noisy = desc;
+	//fields the parameter types do not read and entries past the counts
+	noisy.parameters[0].constant_count = 7;
+	noisy.parameters[0].ranges[2].count = 3;
+	noisy.parameters[1].shader_register = 9;
+	noisy.parameters[1].ranges[3].base_register = 4;
+	noisy.parameters[5].type = ROOT_PARAMETER_UAV;
+	noisy.static_samplers[0].filter = 0x15;
+	NormalizeRootSignatureDesc (desc);
+	NormalizeRootSignatureDesc (noisy);
+	CHECK (memcmp (&desc, &noisy, sizeof (desc)) == 0);
+	CHECK_EQ (HashRootSignatureDesc (desc), HashRootSignatureDesc (noisy));
+
+	//every field a parameter uses changes the hash
+	RootSignatureDesc other = desc;
+	other.parameters[1].ranges[0].count = 9;
+	CHECK (HashRootSignatureDesc (other) != HashRootSignatureDesc (desc));
+	other = desc;
+	other.parameters[0].shader_register = 2;
+	CHECK (HashRootSignatureDesc (other) != HashRootSignatureDesc (desc));
+	other = desc;
+	other.flags = 1;
+	CHECK (HashRootSignatureDesc (other) != HashRootSignatureDesc (desc));
+
+	RootSignatureDesc bad = MakeTableDesc ();
+	bad.parameters[1].range_count = 0;
+	CHECK_THROWS (NormalizeRootSignatureDesc (bad), std::invalid_argument);
+	bad = MakeTableDesc ();
+	bad.parameter_count = root_max_parameters + 1;
+	CHECK_THROWS (NormalizeRootSignatureDesc (bad), std::invalid_argument);
+	bad = MakeTableDesc ();
+	bad.static_sampler_count = root_max_static_samplers + 1;
+	CHECK_THROWS (NormalizeRootSignatureDesc (bad), std::invalid_argument);
+}
+
+TEST (CacheCreatesEveryLayoutOnce)
+{
+	CountingRootSignatureBackend backend;
+	{
+		RootSignatureCache cache (&backend);
+		const RootSignature first = cache.Get (MakeTableDesc ());
+		RootSignatureDesc same = MakeTableDesc ();
+		same.parameters[1].shader_register = 5;
+		const RootSignature second = cache.Get (same);
+		CHECK_EQ (first.handle, second.handle);
+		CHECK_EQ (first.key, second.key);
+		CHECK_EQ (backend.created.load (), 1);
+
+		const RootSignature graphics = cache.Get (MakeBindlessRootSignatureDesc (BINDLESS_ROOT_SIGNATURE_GRAPHICS));
+		const RootSignature compute = cache.Get (MakeBindlessRootSignatureDesc (BINDLESS_ROOT_SIGNATURE_COMPUTE));
+		CHECK (graphics.handle != compute.handle && graphics.handle != first.handle);
+		CHECK (graphics.key != compute.key);
+		CHECK_EQ (cache.Get (MakeBindlessRootSignatureDesc (BINDLESS_ROOT_SIGNATURE_GRAPHICS)).handle, graphics.handle);
+		CHECK_EQ (cache.GetCount (), 3u);
+		CHECK_EQ (cache.GetStats ().lookups, 5u);
+		CHECK_EQ (cache.GetStats ().creations, 3u);
+		CHECK_EQ (backend.live.load (), 3);
+	}
+	//the cache owns what it created
+	CHECK_EQ (backend.live.load (), 0);
+}
+
+TEST (ConcurrentLookupsShareOneRootSignature)
+{
+	CountingRootSignatureBackend backend;
+	RootSignatureCache cache (&backend);
+	std::vector<GpuRootSignatureHandle> handles (8 * 1000);
+	std::vector<std::thread> threads;
+	for (uint32_t t = 0; t < 8; t++)
+		threads.push_back (std::thread ([&, t] ()
+		{
+			for (uint32_t i = 0; i < 1000; i++)
+				handles[t * 1000 + i] = cache.Get (MakeBindlessRootSignatureDesc (i % 2 ? BINDLESS_ROOT_SIGNATURE_COMPUTE : BINDLESS_ROOT_SIGNATURE_GRAPHICS)).handle;
+		}));
+	for (std::thread &thread : threads)
+		thread.join ();
+	CHECK_EQ (backend.created.load (), 2);
+	for (uint32_t i = 2; i < handles.size (); i++)
+		CHECK_EQ (handles[i], handles[i % 2]);
+}
+
+TEST (BindlessLayoutIsTheDocumentedOne)
+{
+	const RootSignatureDesc graphics = MakeBindlessRootSignatureDesc (BINDLESS_ROOT_SIGNATURE_GRAPHICS);
+	const RootSignatureDesc compute = MakeBindlessRootSignatureDesc (BINDLESS_ROOT_SIGNATURE_COMPUTE);
+	CHECK (graphics.flags != 0);
+	CHECK_EQ (compute.flags, 0u);
+	CHECK_EQ (graphics.parameter_count, 2u);
+	const RootParameter &constants = graphics.parameters[bindless_constants_parameter];
+	CHECK_EQ (constants.type, static_cast<uint32_t>(ROOT_PARAMETER_CONSTANTS));
+	CHECK_EQ (constants.constant_count, bindless_root_constant_count);
+	CHECK_EQ (constants.shader_register, 0u);
+	const RootParameter &table = graphics.parameters[bindless_table_parameter];
+	CHECK_EQ (table.type, static_cast<uint32_t>(ROOT_PARAMETER_TABLE));
+	CHECK_EQ (table.range_count, 1u);
+	CHECK_EQ (table.ranges[0].type, static_cast<uint32_t>(ROOT_RANGE_SRV));
+	CHECK_EQ (table.ranges[0].count, root_unbounded_range);
+	CHECK_EQ (table.ranges[0].space, bindless_table_space);
+	CHECK_EQ (graphics.static_sampler_count, static_cast<uint32_t>(BINDLESS_SAMPLER_COUNT));
+	for (uint32_t i = 0; i < graphics.static_sampler_count; i++)
+		CHECK_EQ (graphics.static_samplers[i].shader_register, i);
+	//already normalized
+	RootSignatureDesc normalized = graphics;
+	NormalizeRootSignatureDesc (normalized);
+	CHECK (memcmp (&normalized, &graphics, sizeof (graphics)) == 0);
+}
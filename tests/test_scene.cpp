@@ -0,0 +1,228 @@
+#include "test.h"
+#include "scene.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <random>
+#include <stdexcept>
+
+static SceneTransform MakeTransform (float x, float y, float z, float angle_z = 0.0f, float scale = 1.0f)
+{
+	SceneTransform transform = MakeIdentityTransform ();
+	transform.translation[0] = x;
+	transform.translation[1] = y;
+	transform.translation[2] = z;
+	transform.rotation[2] = sinf (angle_z * 0.5f);
+	transform.rotation[3] = cosf (angle_z * 0.5f);
+	transform.scale[0] = transform.scale[1] = transform.scale[2] = scale;
+	return transform;
+}
+
+//point transformed by a world matrix, row vector times matrix
+static void TransformPoint (const SceneMatrix &matrix, const float point[3], float result[3])
+{
+	for (uint32_t c = 0; c < 3; c++)
+		result[c] = point[0] * matrix.m[c] + point[1] * matrix.m[4 + c] + point[2] * matrix.m[8 + c] + matrix.m[12 + c];
+}
+
+//the same point through the local transforms from the entity up to its root
+static void TransformPointReference (const Scene &scene, SceneEntity entity, const float point[3], float result[3])
+{
+	double p[3] = { point[0], point[1], point[2] };
+	for (; entity != scene_invalid_entity; entity = scene.GetParent (entity))
+	{
+		const SceneTransform local = scene.GetLocalTransform (entity);
+		const double x = local.rotation[0], y = local.rotation[1], z = local.rotation[2], w = local.rotation[3];
+		const double s[3] = { p[0] * local.scale[0], p[1] * local.scale[1], p[2] * local.scale[2] };
+		//v + 2 w (q x v) + 2 q x (q x v)
+		const double t[3] = { 2.0 * (y * s[2] - z * s[1]), 2.0 * (z * s[0] - x * s[2]), 2.0 * (x * s[1] - y * s[0]) };
+		p[0] = s[0] + w * t[0] + (y * t[2] - z * t[1]) + local.translation[0];
+		p[1] = s[1] + w * t[1] + (z * t[0] - x * t[2]) + local.translation[1];
+		p[2] = s[2] + w * t[2] + (x * t[1] - y * t[0]) + local.translation[2];
+	}
+	for (uint32_t c = 0; c < 3; c++)
+		result[c] = static_cast<float>(p[c]);
+}
+
+static bool MatchesReference (const Scene &scene, SceneEntity entity)
+{
+	const float point[3] = { 0.3f, -1.7f, 2.2f };
+	float actual[3], expected[3];
+	TransformPoint (scene.GetWorldMatrix (entity), point, actual);
+	TransformPointReference (scene, entity, point, expected);
+	for (uint32_t c = 0; c < 3; c++)
+		if (fabsf (actual[c] - expected[c]) > 1e-3f * (1.0f + fabsf (expected[c])))
+			return false;
+	return true;
+}
+
+TEST (ComposesWorldMatricesDownTheHierarchy)
+{
+	Scene scene;
+	const SceneEntity root = scene.Create (scene_invalid_entity, MakeTransform (10.0f, 0.0f, 0.0f));
+	const SceneEntity arm = scene.Create (root, MakeTransform (0.0f, 2.0f, 0.0f, 1.5707963f, 2.0f));
+	const SceneEntity hand = scene.Create (arm, MakeTransform (1.0f, 0.0f, 0.0f));
+	scene.Update (nullptr);
+
+	//the hand is one unit along the arm's x axis, which is rotated onto y and scaled by 2
+	const float origin[3] = { 0.0f, 0.0f, 0.0f };
+	float position[3];
+	TransformPoint (scene.GetWorldMatrix (hand), origin, position);
+	CHECK (fabsf (position[0] - 10.0f) < 1e-5f);
+	CHECK (fabsf (position[1] - 4.0f) < 1e-5f);
+	CHECK (fabsf (position[2]) < 1e-5f);
+	CHECK_EQ (scene.GetWorldMatrix (root).m[12], 10.0f);
+	CHECK_EQ (scene.GetWorldMatrix (root).m[15], 1.0f);
+	CHECK (MatchesReference (scene, arm));
+	CHECK (MatchesReference (scene, hand));
+	CHECK_EQ (scene.GetParent (hand), arm);
+	CHECK_EQ (scene.GetParent (root), scene_invalid_entity);
+
+	//parents come before their children in the dense order
+	for (uint32_t node = 0; node < scene.GetNodeCount (); node++)
+	{
+		const SceneEntity parent = scene.GetParent (scene.GetNodeEntity (node));
+		if (parent == scene_invalid_entity)
+			continue;
+		bool before = false;
+		for (uint32_t other = 0; other < node; other++)
+			before = before || scene.GetNodeEntity (other) == parent;
+		CHECK (before);
+	}
+}
+
+TEST (HandlesAreGenerational)
+{
+	Scene scene;
+	const SceneEntity first = scene.Create (scene_invalid_entity, MakeIdentityTransform ());
+	const SceneEntity child = scene.Create (first, MakeIdentityTransform ());
+	CHECK (first != scene_invalid_entity);
+	CHECK (scene.IsAlive (first));
+	CHECK_EQ (scene.GetEntityCount (), 2u);
+
+	//destroying a parent destroys its subtree
+	scene.Destroy (first);
+	CHECK (!scene.IsAlive (first));
+	CHECK (!scene.IsAlive (child));
+	CHECK_EQ (scene.GetEntityCount (), 0u);
+	CHECK_THROWS (scene.GetLocalTransform (first), std::invalid_argument);
+	CHECK_THROWS (scene.SetLocalTransform (child, MakeIdentityTransform ()), std::invalid_argument);
+	CHECK_THROWS (scene.Destroy (first), std::invalid_argument);
+
+	//a reused slot gets a new handle, the old one stays dead
+	const SceneEntity second = scene.Create (scene_invalid_entity, MakeTransform (1.0f, 0.0f, 0.0f));
+	CHECK (second != first && second != child);
+	CHECK (!scene.IsAlive (first));
+	CHECK (scene.IsAlive (second));
+	scene.Update (nullptr);
+	CHECK_EQ (scene.GetNodeCount (), 1u);
+	CHECK_EQ (scene.GetNodeEntity (0), second);
+	CHECK_EQ (scene.GetWorldMatrix (second).m[12], 1.0f);
+	CHECK (!scene.IsAlive (scene_invalid_entity));
+}
+
+TEST (UpdatesOnlyChangedSubtrees)
+{
+	Scene scene;
+	//ten trees of one root and ten children of ten leaves each
+	std::vector<SceneEntity> roots, children;
+	for (uint32_t r = 0; r < 10; r++)
+	{
+		roots.push_back (scene.Create (scene_invalid_entity, MakeTransform (r * 10.0f, 0.0f, 0.0f)));
+		for (uint32_t c = 0; c < 10; c++)
+		{
+			children.push_back (scene.Create (roots.back (), MakeTransform (0.0f, c * 1.0f, 0.0f, 0.1f * c)));
+			for (uint32_t l = 0; l < 10; l++)
+				scene.Create (children.back (), MakeTransform (0.0f, 0.0f, l * 0.5f));
+		}
+	}
+	scene.Update (nullptr);
+	CHECK_EQ (scene.GetStats ().updated_nodes, 1110u);
+
+	scene.Update (nullptr);
+	CHECK_EQ (scene.GetStats ().updated_nodes, 0u);
+	CHECK (!scene.GetStats ().reordered);
+
+	//a root and a child inside it cover one subtree, a child elsewhere another
+	scene.SetLocalTransform (roots[3], MakeTransform (0.0f, 0.0f, 5.0f));
+	scene.SetLocalTransform (children[35], MakeTransform (0.0f, 0.0f, 1.0f));
+	scene.SetLocalTransform (children[72], MakeTransform (1.0f, 0.0f, 1.0f, 0.3f));
+	scene.SetLocalTransform (children[72], MakeTransform (2.0f, 0.0f, 1.0f, 0.3f));
+	scene.Update (nullptr);
+	CHECK_EQ (scene.GetStats ().dirty_entities, 3u);
+	CHECK_EQ (scene.GetStats ().updated_subtrees, 2u);
+	CHECK_EQ (scene.GetStats ().updated_nodes, 111u + 11u);
+	for (uint32_t node = 0; node < scene.GetNodeCount (); node++)
+		CHECK (MatchesReference (scene, scene.GetNodeEntity (node)));
+}
+
+TEST (ReparentingMovesTheSubtree)
+{
+	Scene scene;
+	const SceneEntity left = scene.Create (scene_invalid_entity, MakeTransform (-5.0f, 0.0f, 0.0f));
+	const SceneEntity right = scene.Create (scene_invalid_entity, MakeTransform (5.0f, 0.0f, 0.0f, 0.7f));
+	const SceneEntity item = scene.Create (left, MakeTransform (0.0f, 1.0f, 0.0f));
+	const SceneEntity part = scene.Create (item, MakeTransform (0.0f, 0.0f, 1.0f));
+	scene.Update (nullptr);
+	CHECK_EQ (scene.GetWorldMatrix (part).m[12], -5.0f);
+
+	scene.SetParent (item, right);
+	CHECK_EQ (scene.GetParent (item), right);
+	scene.Update (nullptr);
+	CHECK (scene.GetStats ().reordered);
+	CHECK (MatchesReference (scene, item));
+	CHECK (MatchesReference (scene, part));
+	//the subtree is contiguous behind its new parent
+	uint32_t right_node = 0;
+	while (scene.GetNodeEntity (right_node) != right)
+		right_node++;
+	CHECK_EQ (scene.GetNodeEntity (right_node + 1), item);
+	CHECK_EQ (scene.GetNodeEntity (right_node + 2), part);
+
+	CHECK_THROWS (scene.SetParent (right, part), std::invalid_argument);
+	CHECK_THROWS (scene.SetParent (item, item), std::invalid_argument);
+	scene.SetParent (item, scene_invalid_entity);
+	scene.Update (nullptr);
+	CHECK_EQ (scene.GetWorldMatrix (part).m[12], 0.0f);
+	CHECK (MatchesReference (scene, part));
+}
+
+TEST (ParallelUpdateMatchesSerial)
+{
+	//the same random forest, one scene updated on the job system
+	Scene serial, parallel;
+	JobSystem job_system (4);
+	std::mt19937 random (9);
+	std::uniform_real_distribution<float> unit (-1.0f, 1.0f);
+	std::vector<SceneEntity> entities;
+	for (uint32_t i = 0; i < 20000; i++)
+	{
+		const SceneTransform local = MakeTransform (unit (random), unit (random), unit (random), unit (random), 1.0f + 0.1f * unit (random));
+		//a few deep chains and many wide trees
+		const SceneEntity parent = i < 8 || i % 500 == 0 ? scene_invalid_entity : entities[i % 7 == 0 ? i - 1 : random () % i];
+		const SceneEntity a = serial.Create (parent, local);
+		const SceneEntity b = parallel.Create (parent, local);
+		CHECK_EQ (a, b);
+		entities.push_back (a);
+	}
+	for (int frame = 0; frame < 3; frame++)
+	{
+		//everything in the first frame, then random changes
+		for (uint32_t i = 0; frame && i < 3000; i++)
+		{
+			const SceneEntity entity = entities[random () % entities.size ()];
+			const SceneTransform local = MakeTransform (unit (random), unit (random), unit (random), unit (random));
+			serial.SetLocalTransform (entity, local);
+			parallel.SetLocalTransform (entity, local);
+		}
+		serial.Update (nullptr);
+		parallel.Update (&job_system);
+		CHECK (parallel.GetStats ().updated_nodes > scene_job_size);
+		CHECK_EQ (parallel.GetStats ().updated_nodes, serial.GetStats ().updated_nodes);
+		CHECK_EQ (parallel.GetNodeCount (), serial.GetNodeCount ());
+		CHECK (memcmp (parallel.GetWorldMatrices (), serial.GetWorldMatrices (), serial.GetNodeCount () * sizeof (SceneMatrix)) == 0);
+	}
+	for (uint32_t i = 0; i < entities.size (); i += 97)
+		CHECK (MatchesReference (parallel, entities[i]));
+}
@@ -0,0 +1,284 @@
+#include "test.h"
+#include "shader_cache.h"
+
+#include <stdio.h>
+#include <time.h>
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#include <atomic>
+#include <stdexcept>
+
+//bytecode is the entry point followed by every loaded file, so it changes with any input
+class StubCompiler : public ShaderCompiler
+{
+public:
+	StubCompiler () :
+		calls (0)
+	{
+	}
+	std::string GetIdentity () override
+	{
+		return "stub 1.0";
+	}
+	bool Compile (const ShaderRequest &request, const std::vector<ShaderSourceFile> &files, std::vector<uint8_t> &bytecode, std::string &errors) override
+	{
+		calls++;
+		if (request.entry_point == "Broken")
+		{
+			errors = "error X3000: syntax error";
+			return false;
+		}
+		std::string output = request.entry_point + "|" + request.target;
+		for (const ShaderSourceFile &file : files)
+			output += "|" + file.contents;
+		bytecode.assign (output.begin (), output.end ());
+		return true;
+	}
+
+	std::atomic<int> calls;
+};
+
+static void MakeDirectory (const std::string &path)
+{
+#ifdef _WIN32
+	_mkdir (path.c_str ());
+#else
+	mkdir (path.c_str (), 0755);
+#endif
+}
+
+static void WriteFile (const std::string &path, const std::string &contents)
+{
+	FILE *f = fopen (path.c_str (), "wb");
+	fwrite (contents.data (), 1, contents.size (), f);
+	fclose (f);
+}
+
+//sources in the working directory; a stamp in the shared header keeps entries of
+//earlier runs from being hit
+struct ShaderTree
+{
+	ShaderTree () :
+		root ("shader_cache_test/"),
+		cache (root + "cache/"),
+		stamp (std::to_string (time (nullptr)) + "_" + std::to_string (clock ()))
+	{
+		MakeDirectory (root);
+		MakeDirectory (root + "include");
+		MakeDirectory (cache);
+		WriteFile (root + "include/common.hlsli", "//" + stamp + "\nfloat4 Tint;\n");
+		WriteFile (root + "include/lighting.hlsli", "#include \"common.hlsli\"\nfloat3 Light;\n");
+		WriteFile (root + "lit.hlsl", "#include \"lighting.hlsli\"\n#include <common.hlsli>\nfloat4 VSMain () : SV_Position { return Tint; }\n");
+		WriteFile (root + "unlit.hlsl", "#include \"common.hlsli\"\nfloat4 PSMain () : SV_Target { return 1; }\n");
+	}
+	~ShaderTree ()
+	{
+		for (uint64_t key_hash : entries)
+		{
+			char name[24];
+			snprintf (name, sizeof (name), "%016llx.cso", static_cast<unsigned long long>(key_hash));
+			remove ((cache + name).c_str ());
+		}
+		remove ((root + "include/common.hlsli").c_str ());
+		remove ((root + "include/lighting.hlsli").c_str ());
+		remove ((root + "lit.hlsl").c_str ());
+		remove ((root + "unlit.hlsl").c_str ());
+	}
+
+	std::vector<ShaderRequest> GetRequests () const
+	{
+		std::vector<ShaderRequest> requests (4);
+		requests[0].file = root + "lit.hlsl";
+		requests[0].entry_point = "VSMain";
+		requests[0].target = "vs_5_0";
+		requests[0].flags = 0;
+		requests[1] = requests[0];
+		requests[1].defines.push_back (ShaderDefine { "SHADOWS", "1" });
+		requests[2].file = root + "unlit.hlsl";
+		requests[2].entry_point = "PSMain";
+		requests[2].target = "ps_5_0";
+		requests[2].flags = 0;
+		requests[3] = requests[2];
+		requests[3].flags = 1;
+		return requests;
+	}
+	void Build (ShaderCache &shader_cache, const std::vector<ShaderRequest> &requests, JobSystem *jobs, std::vector<ShaderResult> &results)
+	{
+		results.assign (requests.size (), ShaderResult ());
+		shader_cache.Build (requests.data (), requests.size (), jobs, results.data ());
+		for (const ShaderResult &result : results)
+			entries.push_back (result.key_hash);
+	}
+
+	std::string root;
+	std::string cache;
+	std::string stamp;
+	std::vector<uint64_t> entries;
+};
+
+TEST (ScansIncludesOutsideComments)
+{
+	std::vector<std::string> names;
+	ScanShaderIncludes ("#include \"a.hlsli\"\n"
+						"// #include \"commented.hlsli\"\n"
+						"static const char *s = \"#include \\\"string\\\"\";\n"
+						"  #  include <b.hlsli>\n"
+						"#define X #include \"macro\"\n"
+						"/*\n#include \"block.hlsli\"\n*/\n"
+						"#if 0\n#include \"inactive.hlsli\"\n#endif\n", names);
+	CHECK_EQ (names.size (), 3u);
+	CHECK (names[0] == "a.hlsli" && names[1] == "b.hlsli" && names[2] == "inactive.hlsli");
+}
+
+TEST (ParsesTheManifest)
+{
+	std::vector<ShaderRequest> requests;
+	ParseShaderManifest ("# shaders of the scene\n"
+						 "shaders.hlsl VSMain vs_5_0\n"
+						 "\n"
+						 "  shaders.hlsl PSMain ps_5_0 0x801 SHADOWS=2 FOG  # trailing comment\n", requests);
+	CHECK_EQ (requests.size (), 2u);
+	CHECK (requests[0].file == "shaders.hlsl" && requests[0].entry_point == "VSMain" && requests[0].flags == 0);
+	CHECK (requests[1].target == "ps_5_0" && requests[1].flags == 0x801 && requests[1].defines.size () == 2);
+	CHECK (requests[1].defines[0].name == "SHADOWS" && requests[1].defines[0].value == "2");
+	CHECK (requests[1].defines[1].name == "FOG" && requests[1].defines[1].value == "1");
+	CHECK_THROWS (ParseShaderManifest ("shaders.hlsl VSMain\n", requests), std::invalid_argument);
+	CHECK_THROWS (ParseShaderManifest ("shaders.hlsl VSMain vs_5_0 0xzz\n", requests), std::invalid_argument);
+}
+
+TEST (KeyCoversEveryInput)
+{
+	ShaderRequest request;
+	request.file = "lit.hlsl";
+	request.entry_point = "VSMain";
+	request.target = "vs_5_0";
+	request.flags = 0;
+	std::vector<ShaderSourceFile> files (2);
+	files[0].name = "lit.hlsl";
+	files[0].path = "shaders/lit.hlsl";
+	files[0].contents = "#include \"common.hlsli\"\n";
+	files[0].hash = 1;
+	files[0].includes.push_back (std::make_pair (std::string ("common.hlsli"), 1u));
+	files[1].name = "common.hlsli";
+	files[1].path = "shaders/common.hlsli";
+	files[1].contents = "float4 Tint;\n";
+	files[1].hash = 2;
+
+	std::vector<uint8_t> base, same, key;
+	BuildShaderKey (request, "stub 1.0", files, base);
+	BuildShaderKey (request, "stub 1.0", files, same);
+	CHECK (base == same);
+
+	ShaderRequest changed = request;
+	changed.defines.push_back (ShaderDefine { "FOG", "1" });
+	BuildShaderKey (changed, "stub 1.0", files, key);
+	CHECK (key != base);
+	changed = request;
+	changed.entry_point = "PSMain";
+	BuildShaderKey (changed, "stub 1.0", files, key);
+	CHECK (key != base);
+	changed = request;
+	changed.flags = 4;
+	BuildShaderKey (changed, "stub 1.0", files, key);
+	CHECK (key != base);
+	BuildShaderKey (request, "stub 1.1", files, key);
+	CHECK (key != base);
+	std::vector<ShaderSourceFile> edited (files);
+	edited[1].contents = "float4 Tint2;\n";
+	edited[1].hash = 3;
+	BuildShaderKey (request, "stub 1.0", edited, key);
+	CHECK (key != base);
+}
+
+TEST (CacheEntriesCheckTheirKey)
+{
+	const std::vector<uint8_t> key (40, 7);
+	const std::vector<uint8_t> bytecode (100, 9);
+	std::vector<uint8_t> entry, read;
+	WriteShaderCacheEntry (key, bytecode, entry);
+	CHECK (ReadShaderCacheEntry (entry.data (), entry.size (), key, read));
+	CHECK (read == bytecode);
+
+	std::vector<uint8_t> other_key (key);
+	other_key[3] = 8;
+	CHECK (!ReadShaderCacheEntry (entry.data (), entry.size (), other_key, read));
+	CHECK (!ReadShaderCacheEntry (entry.data (), entry.size () - 1, key, read));
+	std::vector<uint8_t> damaged (entry);
+	damaged[damaged.size () - 10] ^= 1;
+	CHECK (!ReadShaderCacheEntry (damaged.data (), damaged.size (), key, read));
+}
+
+TEST (UnchangedShadersLoadFromTheCache)
+{
+	ShaderTree tree;
+	StubCompiler compiler;
+	JobSystem jobs (3);
+	const std::vector<ShaderRequest> requests = tree.GetRequests ();
+	std::vector<ShaderResult> cold, warm;
+	{
+		ShaderCache cache (&compiler, tree.cache, std::vector<std::string> (1, tree.root + "include/"));
+		tree.Build (cache, requests, &jobs, cold);
+		const ShaderCacheStats stats = cache.GetStats ();
+		CHECK (stats.requests == 4 && stats.compiled == 4 && stats.hits == 0 && stats.store_failures == 0);
+	}
+	for (const ShaderResult &result : cold)
+		CHECK (result.succeeded && result.compiled);
+	//the closure of lit.hlsl, each file once and the shader first
+	CHECK_EQ (cold[0].dependencies.size (), 3u);
+	CHECK (cold[0].dependencies[0] == tree.root + "lit.hlsl");
+	CHECK (cold[0].dependencies[1] == tree.root + "include/lighting.hlsli");
+	CHECK (cold[0].dependencies[2] == tree.root + "include/common.hlsli");
+	//defines and flags make separate entries
+	CHECK (cold[0].key_hash != cold[1].key_hash && cold[2].key_hash != cold[3].key_hash);
+
+	//a new cache, like the next launch, only reads the entries
+	ShaderCache cache (&compiler, tree.cache, std::vector<std::string> (1, tree.root + "include/"));
+	tree.Build (cache, requests, nullptr, warm);
+	CHECK_EQ (compiler.calls.load (), 4);
+	CHECK_EQ (cache.GetStats ().hits, 4u);
+	for (size_t i = 0; i < warm.size (); i++)
+		CHECK (warm[i].succeeded && !warm[i].compiled && warm[i].bytecode == cold[i].bytecode && warm[i].key_hash == cold[i].key_hash);
+}
+
+TEST (EditedIncludesInvalidateTheirShaders)
+{
+	ShaderTree tree;
+	StubCompiler compiler;
+	const std::vector<ShaderRequest> requests = tree.GetRequests ();
+	std::vector<ShaderResult> before, after;
+	ShaderCache cache (&compiler, tree.cache, std::vector<std::string> (1, tree.root + "include/"));
+	tree.Build (cache, requests, nullptr, before);
+
+	//only lit.hlsl includes lighting.hlsli
+	WriteFile (tree.root + "include/lighting.hlsli", "#include \"common.hlsli\"\nfloat3 Light;\nfloat3 Ambient;\n");
+	tree.Build (cache, requests, nullptr, after);
+	CHECK (after[0].compiled && after[1].compiled && !after[2].compiled && !after[3].compiled);
+	CHECK (after[0].key_hash != before[0].key_hash && after[2].key_hash == before[2].key_hash);
+	const ShaderCacheStats stats = cache.GetStats ();
+	CHECK (stats.compiled == 6 && stats.hits == 2);
+}
+
+TEST (ReportsErrorsAndMissingFiles)
+{
+	ShaderTree tree;
+	StubCompiler compiler;
+	std::vector<ShaderRequest> requests = tree.GetRequests ();
+	requests[1].entry_point = "Broken";
+	std::vector<ShaderResult> results;
+	ShaderCache cache (&compiler, tree.cache, std::vector<std::string> (1, tree.root + "include/"));
+	tree.Build (cache, requests, nullptr, results);
+	CHECK (!results[1].succeeded && results[1].errors == "error X3000: syntax error");
+	CHECK (results[0].succeeded && results[2].succeeded);
+	CHECK_EQ (cache.GetStats ().failed, 1u);
+	//failures are not stored, the next build tries again
+	tree.Build (cache, requests, nullptr, results);
+	CHECK_EQ (cache.GetStats ().failed, 2u);
+
+	requests.resize (1);
+	requests[0].file = tree.root + "missing.hlsl";
+	CHECK_THROWS (cache.Build (requests.data (), 1, nullptr, results.data ()), std::runtime_error);
+}
@@ -0,0 +1,354 @@
+#include "test.h"
+#include "null_device.h"
+#include "shader_reload.h"
+
+#include <stdio.h>
+#include <time.h>
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+static const char *root = "shader_reload_test/";
+
+static void MakeDirectory (const std::string &path)
+{
+#ifdef _WIN32
+	_mkdir (path.c_str ());
+#else
+	mkdir (path.c_str (), 0755);
+#endif
+}
+
+static void WriteFile (const std::string &path, const std::string &contents)
+{
+	FILE *f = fopen (path.c_str (), "wb");
+	fwrite (contents.data (), 1, contents.size (), f);
+	fclose (f);
+}
+
+//bytecode is the entry point followed by every loaded file; a file containing ERROR
+//fails. The compiler remembers the cache entries its bytecode is stored under.
+class StubCompiler : public ShaderCompiler
+{
+public:
+	std::string GetIdentity () override
+	{
+		return "stub 1.0";
+	}
+	bool Compile (const ShaderRequest &request, const std::vector<ShaderSourceFile> &files, std::vector<uint8_t> &bytecode, std::string &errors) override
+	{
+		std::string output = request.entry_point;
+		for (const ShaderSourceFile &file : files)
+		{
+			if (file.contents.find ("ERROR") != std::string::npos)
+			{
+				errors = file.path + "(2): error X3000: syntax error";
+				return false;
+			}
+			output += "|" + file.contents;
+		}
+		bytecode.assign (output.begin (), output.end ());
+
+		//the cache names an entry by the FNV-1a hash of its key
+		std::vector<uint8_t> key;
+		BuildShaderKey (request, GetIdentity (), files, key);
+		std::lock_guard<std::mutex> lock (mutex);
+		entries.push_back (PipelineHash (key.data (), key.size ()));
+		return true;
+	}
+
+	std::mutex mutex;
+	std::vector<uint64_t> entries;
+};
+
+//pipelines are counted while they live; creation can be held back
+class CountingPipelineBackend : public PipelineBackend
+{
+public:
+	CountingPipelineBackend () :
+		held (false),
+		next_pipeline (1),
+		live (0)
+	{
+	}
+	uint64_t GetDeviceKey () override
+	{
+		return 1;
+	}
+	bool OpenLibrary (const void *, size_t) override
+	{
+		return false;
+	}
+	GpuPipelineHandle CreatePipeline (const PipelineDesc &, uint64_t, bool &loaded) override
+	{
+		std::unique_lock<std::mutex> lock (mutex);
+		released.wait (lock, [this] { return !held; });
+		loaded = false;
+		live++;
+		return next_pipeline++;
+	}
+	void DestroyPipeline (GpuPipelineHandle) override
+	{
+		live--;
+	}
+	void SerializeLibrary (std::vector<uint8_t> &blob) override
+	{
+		blob.clear ();
+	}
+
+	void Hold (bool hold)
+	{
+		{
+			std::lock_guard<std::mutex> lock (mutex);
+			held = hold;
+		}
+		released.notify_all ();
+	}
+
+	std::mutex mutex;
+	std::condition_variable released;
+	bool held;
+	GpuPipelineHandle next_pipeline;
+	std::atomic<int> live;
+};
+
+//a pipeline of a vertex and a pixel shader in one source with an include; frames carry
+//GPU work so the fence of a frame completes only when a later frame waits for its slot
+struct ReloadFixture
+{
+	ReloadFixture () :
+		scheduler (&device, 2, FRAME_POLICY_MAX_THROUGHPUT),
+		shader_cache (&compiler, std::string (root) + "cache/", std::vector<std::string> ()),
+		pipelines (&backend, 1),
+		shader (std::string (root) + "shader.hlsl"),
+		common (std::string (root) + "common.hlsli"),
+		lighting (std::string (root) + "lighting.hlsli"),
+		stamp ("//" + std::to_string (time (nullptr)) + "_" + std::to_string (clock ()) + "\n")
+	{
+		MakeDirectory (root);
+		MakeDirectory (std::string (root) + "cache");
+		WriteFile (shader, "#include \"common.hlsli\"\nfloat4 VSMain () : SV_Position { return Tint; }\n");
+		WriteFile (common, stamp + "float4 Tint;\n");
+
+		requests[0] = ShaderRequest { shader, "VSMain", "vs_5_0", std::vector<ShaderDefine> (), 0 };
+		requests[1] = ShaderRequest { shader, "PSMain", "ps_5_0", std::vector<ShaderDefine> (), 0 };
+		shader_cache.Build (requests, 2, nullptr, results);
+
+		static const PipelineInputElement position = { "POSITION", 0, 6, 0, 0, 0, 0 };
+		desc.shaders[PIPELINE_SHADER_VS] = { results[0].bytecode.data (), results[0].bytecode.size () };
+		desc.shaders[PIPELINE_SHADER_PS] = { results[1].bytecode.data (), results[1].bytecode.size () };
+		desc.input_elements = &position;
+		desc.input_element_count = 1;
+		desc.render_target_count = 1;
+		desc.render_target_formats[0] = 28;
+
+		reloader.reset (new ShaderReloader (&shader_cache, &pipelines, &scheduler, 2));
+		pipeline = reloader->Register (pipelines.Create (desc), desc, {
+			{ PIPELINE_SHADER_VS, requests[0], results[0].dependencies },
+			{ PIPELINE_SHADER_PS, requests[1], results[1].dependencies } });
+		//edits before the reload thread watched the files are its starting state
+		const auto deadline = std::chrono::steady_clock::now () + std::chrono::seconds (5);
+		while (reloader->GetStats ().files < 2 && std::chrono::steady_clock::now () < deadline)
+			std::this_thread::sleep_for (std::chrono::milliseconds (1));
+	}
+	~ReloadFixture ()
+	{
+		reloader.reset ();
+		for (uint64_t key_hash : compiler.entries)
+		{
+			char name[24];
+			snprintf (name, sizeof (name), "%016llx.cso", static_cast<unsigned long long>(key_hash));
+			remove ((std::string (root) + "cache/" + name).c_str ());
+		}
+		remove (shader.c_str ());
+		remove (common.c_str ());
+		remove (lighting.c_str ());
+	}
+
+	void RunFrame (std::vector<ShaderReloadEvent> &events)
+	{
+		scheduler.BeginFrame ();
+		reloader->Update (events);
+		device.AddGpuWork (1000000);
+		device.ExecuteCommandLists (0, nullptr);
+		scheduler.EndFrame ();
+		std::this_thread::sleep_for (std::chrono::milliseconds (1));
+	}
+	//frames until the reloader reports an event, at most a few seconds
+	std::vector<ShaderReloadEvent> WaitForEvents ()
+	{
+		std::vector<ShaderReloadEvent> events;
+		const auto deadline = std::chrono::steady_clock::now () + std::chrono::seconds (5);
+		while (events.empty () && std::chrono::steady_clock::now () < deadline)
+			RunFrame (events);
+		return events;
+	}
+	//frames while the reload thread polls a number of times
+	std::vector<ShaderReloadEvent> RunPolls (uint64_t count)
+	{
+		std::vector<ShaderReloadEvent> events;
+		const uint64_t end = reloader->GetStats ().polls + count;
+		const auto deadline = std::chrono::steady_clock::now () + std::chrono::seconds (5);
+		while (reloader->GetStats ().polls < end && std::chrono::steady_clock::now () < deadline)
+			RunFrame (events);
+		RunFrame (events);
+		return events;
+	}
+
+	CountingPipelineBackend backend;
+	NullDevice device;
+	FrameScheduler scheduler;
+	StubCompiler compiler;
+	ShaderCache shader_cache;
+	PipelineCache pipelines;
+	std::unique_ptr<ShaderReloader> reloader;
+
+	std::string shader;
+	std::string common;
+	std::string lighting;
+	std::string stamp;
+	ShaderRequest requests[2];
+	ShaderResult results[2];
+	PipelineDesc desc;
+	ReloadablePipeline pipeline;
+};
+
+TEST (WatcherReportsChangedContentsOnly)
+{
+	MakeDirectory (root);
+	const std::string path = std::string (root) + "watched.hlsl";
+	const std::string missing = std::string (root) + "missing.hlsl";
+	remove (missing.c_str ());
+	WriteFile (path, "float4 Tint;\n");
+
+	FileWatcher watcher;
+	watcher.Watch (path);
+	watcher.Watch (path);
+	watcher.Watch (missing);
+	CHECK_EQ (watcher.GetFileCount (), 2u);
+
+	std::vector<std::string> changed;
+	watcher.Poll (changed);
+	CHECK (changed.empty ());
+
+	//saving without an edit changes the time stamp only
+	WriteFile (path, "float4 Tint;\n");
+	watcher.Poll (changed);
+	CHECK (changed.empty ());
+
+	//an edit of the same size right after the previous write
+	WriteFile (path, "float4 Tone;\n");
+	watcher.Poll (changed);
+	CHECK (changed.size () == 1 && changed[0] == path);
+	changed.clear ();
+	watcher.Poll (changed);
+	CHECK (changed.empty ());
+
+	WriteFile (missing, "float3 Light;\n");
+	remove (path.c_str ());
+	watcher.Poll (changed);
+	CHECK_EQ (changed.size (), 2u);
+
+	watcher.Unwatch (path);
+	watcher.Unwatch (missing);
+	CHECK_EQ (watcher.GetFileCount (), 0u);
+	remove (missing.c_str ());
+}
+
+TEST (RegisterNeedsTheBytecodeOfEveryStage)
+{
+	ReloadFixture fixture;
+	PipelineDesc desc = fixture.desc;
+	desc.shaders[PIPELINE_SHADER_PS] = { nullptr, 0 };
+	CHECK_THROWS (fixture.reloader->Register (fixture.pipelines.Create (desc), desc,
+					{ { PIPELINE_SHADER_PS, fixture.requests[1], fixture.results[1].dependencies } }),
+				  std::invalid_argument);
+}
+
+TEST (EditedIncludesSwapWithoutBlockingFrames)
+{
+	ReloadFixture fixture;
+	const GpuPipelineHandle original = fixture.reloader->Get (fixture.pipeline);
+	CHECK (fixture.RunPolls (1).empty ());
+	CHECK_EQ (fixture.backend.live.load (), 1);
+
+	//frames keep running on the old pipeline while the new one is created
+	fixture.backend.Hold (true);
+	WriteFile (fixture.common, fixture.stamp + "float4 Tint;\nfloat Exposure;\n");
+	CHECK (fixture.RunPolls (4).empty ());
+	CHECK_EQ (fixture.reloader->GetStats ().recompiles, 1u);
+	CHECK_EQ (fixture.reloader->Get (fixture.pipeline), original);
+	fixture.backend.Hold (false);
+
+	std::vector<ShaderReloadEvent> events = fixture.WaitForEvents ();
+	CHECK (events.size () == 1 && events[0].pipeline == fixture.pipeline && events[0].succeeded);
+	const GpuPipelineHandle reloaded = fixture.reloader->Get (fixture.pipeline);
+	CHECK (reloaded != original && reloaded != 0);
+
+	//the old pipeline lives until the GPU finished the frame of the swap
+	CHECK_EQ (fixture.backend.live.load (), 2);
+	fixture.scheduler.WaitForIdle ();
+	CHECK_EQ (fixture.backend.live.load (), 1);
+
+	const ShaderReloadStats stats = fixture.reloader->GetStats ();
+	CHECK_EQ (stats.changes, 1u);
+	CHECK_EQ (stats.swaps, 1u);
+	CHECK_EQ (stats.failures, 0u);
+	CHECK_EQ (stats.files, 2u);
+}
+
+TEST (CompileErrorsKeepTheRunningPipeline)
+{
+	ReloadFixture fixture;
+	const GpuPipelineHandle original = fixture.reloader->Get (fixture.pipeline);
+	WriteFile (fixture.shader, "#include \"common.hlsli\"\nERROR\n");
+
+	std::vector<ShaderReloadEvent> events = fixture.WaitForEvents ();
+	CHECK (events.size () == 1 && !events[0].succeeded);
+	CHECK (!events.empty () && events[0].errors.find ("X3000") != std::string::npos);
+	CHECK_EQ (fixture.reloader->Get (fixture.pipeline), original);
+	CHECK_EQ (fixture.reloader->GetStats ().failures, 1u);
+
+	//the fix reloads as usual
+	WriteFile (fixture.shader, "#include \"common.hlsli\"\nfloat4 VSMain () : SV_Position { return 0; }\n");
+	events = fixture.WaitForEvents ();
+	CHECK (events.size () == 1 && events[0].succeeded);
+	CHECK (fixture.reloader->Get (fixture.pipeline) != original);
+}
+
+TEST (FollowsIncludesAddedByAnEdit)
+{
+	ReloadFixture fixture;
+	WriteFile (fixture.lighting, "float3 Light;\n");
+	WriteFile (fixture.shader, "#include \"common.hlsli\"\n#include \"lighting.hlsli\"\nfloat4 VSMain () : SV_Position { return Tint; }\n");
+	std::vector<ShaderReloadEvent> events = fixture.WaitForEvents ();
+	CHECK (events.size () == 1 && events[0].succeeded);
+	CHECK (fixture.RunPolls (1).empty ());
+	CHECK_EQ (fixture.reloader->GetStats ().files, 3u);
+
+	const GpuPipelineHandle before = fixture.reloader->Get (fixture.pipeline);
+	WriteFile (fixture.lighting, "float3 Light;\nfloat3 Ambient;\n");
+	events = fixture.WaitForEvents ();
+	CHECK (events.size () == 1 && events[0].succeeded);
+	CHECK (fixture.reloader->Get (fixture.pipeline) != before);
+}
+
+TEST (UnmodifiedSavesDoNotReload)
+{
+	ReloadFixture fixture;
+	const GpuPipelineHandle original = fixture.reloader->Get (fixture.pipeline);
+	WriteFile (fixture.common, fixture.stamp + "float4 Tint;\n");
+	CHECK (fixture.RunPolls (4).empty ());
+	CHECK_EQ (fixture.reloader->GetStats ().recompiles, 0u);
+	CHECK_EQ (fixture.reloader->Get (fixture.pipeline), original);
+}
@@ -0,0 +1,187 @@
+#include "test.h"
+#include "texture_compress.h"
+
+#include <math.h>
+
+#include <random>
+#include <stdexcept>
+
+//smooth gradients with a little noise and a soft alpha ramp, like most colour textures
+static TextureImage MakePhoto (uint32_t width, uint32_t height, uint32_t seed)
+{
+	TextureImage image;
+	image.Resize (width, height);
+	std::mt19937 random (seed);
+	for (uint32_t y = 0; y < height; y++)
+		for (uint32_t x = 0; x < width; x++)
+		{
+			uint8_t *pixel = image.GetPixel (x, y);
+			const float u = static_cast<float>(x) / width, v = static_cast<float>(y) / height;
+			const float values[4] = { 255.0f * u, 255.0f * (0.5f + 0.5f * sinf (6.0f * v)), 255.0f * (1.0f - u * v),
+									  255.0f * (0.5f + 0.5f * cosf (4.0f * u + 2.0f * v)) };
+			for (uint32_t c = 0; c < 4; c++)
+			{
+				const float value = values[c] + static_cast<float>(random () % 7) - 3.0f;
+				pixel[c] = static_cast<uint8_t>(value < 0.0f ? 0.0f : value > 255.0f ? 255.0f : value);
+			}
+		}
+	return image;
+}
+
+static double RoundTripPsnr (const TextureImage &image, TextureEncoding encoding, TextureQuality quality)
+{
+	std::vector<uint8_t> blocks;
+	EncodeTextureBlocks (image, encoding, quality, nullptr, blocks);
+	TextureImage decoded;
+	DecodeTextureBlocks (blocks.data (), image.width, image.height, encoding, decoded);
+	return ComputeTexturePsnr (image, decoded, GetTextureEncodingChannels (encoding));
+}
+
+TEST (FormatsAndBlockSizes)
+{
+	CHECK_EQ (GetTextureEncodingFormat (TEXTURE_ENCODING_BC1, false), texture_format_bc1);
+	CHECK_EQ (GetTextureEncodingFormat (TEXTURE_ENCODING_BC3, true), texture_format_bc3_srgb);
+	CHECK_EQ (GetTextureEncodingFormat (TEXTURE_ENCODING_BC7, true), texture_format_bc7_srgb);
+	CHECK_EQ (GetTextureEncodingFormat (TEXTURE_ENCODING_BC5, false), texture_format_bc5);
+	CHECK_THROWS (GetTextureEncodingFormat (TEXTURE_ENCODING_BC4, true), std::invalid_argument);
+	CHECK_EQ (GetTextureEncodingChannels (TEXTURE_ENCODING_BC1), 0x7u);
+	CHECK_EQ (GetTextureEncodingChannels (TEXTURE_ENCODING_BC5), 0x3u);
+	CHECK_EQ (GetTextureEncodingChannels (TEXTURE_ENCODING_BC7), 0xfu);
+
+	//5x7 is 2x2 blocks with the edges repeated
+	const TextureImage image = MakePhoto (5, 7, 1);
+	const uint32_t block_sizes[TEXTURE_ENCODING_COUNT] = { 0, 8, 16, 8, 16, 16 };
+	std::vector<uint8_t> blocks;
+	for (uint32_t e = 0; e < TEXTURE_ENCODING_COUNT; e++)
+	{
+		EncodeTextureBlocks (image, static_cast<TextureEncoding>(e), TEXTURE_QUALITY_NORMAL, nullptr, blocks);
+		CHECK_EQ (blocks.size (), e == TEXTURE_ENCODING_RGBA8 ? image.pixels.size () : 4u * block_sizes[e]);
+	}
+	TextureImage empty;
+	CHECK_THROWS (EncodeTextureBlocks (empty, TEXTURE_ENCODING_BC1, TEXTURE_QUALITY_FAST, nullptr, blocks), std::invalid_argument);
+}
+
+TEST (FlatBlocksAreExact)
+{
+	//colours on the 565 grid for BC1, any colour for the others
+	const uint8_t colours[3][4] = { { 255, 0, 0, 255 }, { 0, 255, 255, 255 }, { 132, 130, 66, 255 } };
+	for (uint32_t i = 0; i < 3; i++)
+	{
+		TextureImage image;
+		image.Resize (8, 4);
+		for (size_t p = 0; p < image.pixels.size (); p++)
+			image.pixels[p] = colours[i][p % 4];
+		for (uint32_t q = 0; q < TEXTURE_QUALITY_COUNT; q++)
+		{
+			CHECK_EQ (RoundTripPsnr (image, TEXTURE_ENCODING_BC1, static_cast<TextureQuality>(q)), 999.0);
+			CHECK_EQ (RoundTripPsnr (image, TEXTURE_ENCODING_BC4, static_cast<TextureQuality>(q)), 999.0);
+			CHECK_EQ (RoundTripPsnr (image, TEXTURE_ENCODING_BC5, static_cast<TextureQuality>(q)), 999.0);
+		}
+	}
+	//BC7 keeps flat colours off the 565 grid within a step
+	TextureImage image;
+	image.Resize (4, 4);
+	for (size_t p = 0; p < image.pixels.size (); p++)
+		image.pixels[p] = static_cast<uint8_t>(37 + 50 * (p % 4));
+	CHECK (RoundTripPsnr (image, TEXTURE_ENCODING_BC7, TEXTURE_QUALITY_NORMAL) > 48.0);
+}
+
+TEST (QualityOfEveryEncoding)
+{
+	//BC1 has no alpha channel, its transparent pixels are black
+	const TextureImage image = MakePhoto (64, 64, 2);
+	TextureImage opaque = image;
+	for (size_t i = 3; i < opaque.pixels.size (); i += 4)
+		opaque.pixels[i] = 255;
+	//dB floors for smooth content with noise of +-3
+	const double floors[TEXTURE_ENCODING_COUNT] = { 999.0, 34.0, 35.0, 48.0, 46.0, 34.0 };
+	for (uint32_t e = 0; e < TEXTURE_ENCODING_COUNT; e++)
+	{
+		double previous = 0.0;
+		for (uint32_t q = 0; q < TEXTURE_QUALITY_COUNT; q++)
+		{
+			const double psnr = RoundTripPsnr (e == TEXTURE_ENCODING_BC1 ? opaque : image, static_cast<TextureEncoding>(e),
+											   static_cast<TextureQuality>(q));
+			CHECK (psnr >= floors[e]);
+			//a higher level never loses more than noise
+			CHECK (psnr >= previous - 0.05);
+			previous = psnr;
+		}
+	}
+	//BC7 with its 4 bit indices beats the BC1 colour of BC3
+	CHECK (RoundTripPsnr (image, TEXTURE_ENCODING_BC7, TEXTURE_QUALITY_HIGH) > RoundTripPsnr (image, TEXTURE_ENCODING_BC3, TEXTURE_QUALITY_HIGH));
+	CHECK (RoundTripPsnr (opaque, TEXTURE_ENCODING_BC7, TEXTURE_QUALITY_HIGH) > RoundTripPsnr (opaque, TEXTURE_ENCODING_BC1, TEXTURE_QUALITY_HIGH) + 1.0);
+}
+
+TEST (Bc1KeepsCutoutAlpha)
+{
+	TextureImage image = MakePhoto (16, 16, 3);
+	for (uint32_t y = 0; y < 16; y++)
+		for (uint32_t x = 0; x < 16; x++)
+			image.GetPixel (x, y)[3] = (x + y) % 3 ? 255 : 20;
+	std::vector<uint8_t> blocks;
+	EncodeTextureBlocks (image, TEXTURE_ENCODING_BC1, TEXTURE_QUALITY_NORMAL, nullptr, blocks);
+	TextureImage decoded;
+	DecodeTextureBlocks (blocks.data (), 16, 16, TEXTURE_ENCODING_BC1, decoded);
+	for (uint32_t y = 0; y < 16; y++)
+		for (uint32_t x = 0; x < 16; x++)
+			CHECK_EQ (decoded.GetPixel (x, y)[3], (x + y) % 3 ? 255u : 0u);
+}
+
+TEST (ParallelEncodingMatchesSerial)
+{
+	JobSystem job_system (4);
+	const TextureImage image = MakePhoto (130, 66, 4);
+	for (uint32_t e = 1; e < TEXTURE_ENCODING_COUNT; e++)
+	{
+		std::vector<uint8_t> serial, parallel;
+		EncodeTextureBlocks (image, static_cast<TextureEncoding>(e), TEXTURE_QUALITY_HIGH, nullptr, serial);
+		EncodeTextureBlocks (image, static_cast<TextureEncoding>(e), TEXTURE_QUALITY_HIGH, &job_system, parallel);
+		CHECK (serial == parallel);
+	}
+}
+
+TEST (CompressesWholeTextures)
+{
+	JobSystem job_system (2);
+	const TextureImage image = MakePhoto (40, 24, 5);
+	TextureCompressOptions options;
+	TextureData texture;
+	CompressTexture (image, options, &job_system, texture);
+	CHECK_EQ (texture.format, texture_format_bc7_srgb);
+	CHECK_EQ (texture.mip_count, 6u);
+	CHECK_EQ (texture.subresources.size (), 6u);
+	CHECK (texture.flags & TEXTURE_FILE_FLAG_ALPHA);
+	//the 1x1 mip still takes a whole block
+	CHECK_EQ (texture.subresources[5].size (), 16u);
+	CHECK_EQ (texture.subresources[0].size (), 10u * 6u * 16u);
+
+	options.encoding = TEXTURE_ENCODING_BC5;
+	options.mip_flags = TEXTURE_MIP_NORMAL_MAP;
+	options.max_mip_count = 2;
+	CompressTexture (image, options, nullptr, texture);
+	CHECK_EQ (texture.format, texture_format_bc5);
+	CHECK_EQ (texture.mip_count, 2u);
+	CHECK (texture.flags & TEXTURE_FILE_FLAG_NORMAL_MAP);
+	options.mip_flags = TEXTURE_MIP_SRGB;
+	CHECK_THROWS (CompressTexture (image, options, nullptr, texture), std::invalid_argument);
+}
+
+TEST (DecodingAndPsnrChecks)
+{
+	//mode 0 of BC7 is not written by the encoder
+	uint8_t block[16] = { 1 };
+	TextureImage image;
+	CHECK_THROWS (DecodeTextureBlocks (block, 4, 4, TEXTURE_ENCODING_BC7, image), std::invalid_argument);
+
+	const TextureImage reference = MakePhoto (8, 8, 6);
+	CHECK_EQ (ComputeTexturePsnr (reference, reference, 0xf), 999.0);
+	//green off by 2 everywhere: 10 log10 (255^2 / 4)
+	TextureImage changed = reference;
+	for (size_t i = 1; i < changed.pixels.size (); i += 4)
+		changed.pixels[i] = static_cast<uint8_t>(changed.pixels[i] < 128 ? changed.pixels[i] + 2 : changed.pixels[i] - 2);
+	CHECK (fabs (ComputeTexturePsnr (reference, changed, 0x2) - 42.11) < 0.01);
+	CHECK_EQ (ComputeTexturePsnr (reference, changed, 0x5), 999.0);
+	const TextureImage other = MakePhoto (8, 4, 6);
+	CHECK_THROWS (ComputeTexturePsnr (reference, other, 0xf), std::invalid_argument);
+}
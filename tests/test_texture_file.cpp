@@ -0,0 +1,158 @@
+#include "test.h"
+#include "texture_file.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+//texture whose subresource bytes tell their index and position
+static TextureData MakeTexture (uint32_t format, uint32_t width, uint32_t height, uint32_t mip_count, uint32_t array_size)
+{
+	TextureData texture;
+	texture.format = format;
+	texture.width = width;
+	texture.height = height;
+	texture.mip_count = mip_count;
+	texture.array_size = array_size;
+	texture.flags = TEXTURE_FILE_FLAG_ALPHA;
+	for (uint32_t i = 0; i < mip_count * array_size; i++)
+	{
+		const uint32_t mip = i % mip_count;
+		uint32_t row_size, row_count;
+		GetTextureMipLayout (format, std::max (width >> mip, 1u), std::max (height >> mip, 1u), row_size, row_count);
+		std::vector<uint8_t> subresource (static_cast<size_t>(row_size) * row_count);
+		for (size_t b = 0; b < subresource.size (); b++)
+			subresource[b] = static_cast<uint8_t>(i * 31 + b);
+		texture.subresources.push_back (subresource);
+	}
+	return texture;
+}
+
+TEST (FormatsAndLayouts)
+{
+	CHECK_EQ (GetTextureFormatBlockSize (texture_format_bc1_srgb), 8u);
+	CHECK_EQ (GetTextureFormatBlockSize (texture_format_bc7), 16u);
+	CHECK_EQ (GetTextureFormatBlockSize (texture_format_rgba8), 4u);
+	CHECK_EQ (GetTextureFormatBlockSize (1), 0u);
+	CHECK (IsBlockCompressedFormat (texture_format_bc4));
+	CHECK (!IsBlockCompressedFormat (texture_format_rgba8_srgb));
+	CHECK (IsSrgbFormat (texture_format_bc3_srgb));
+	CHECK (!IsSrgbFormat (texture_format_bc5));
+	CHECK (strcmp (GetTextureFormatName (texture_format_bc7_srgb), "BC7_UNORM_SRGB") == 0);
+
+	uint32_t row_size, row_count;
+	GetTextureMipLayout (texture_format_bc1, 10, 3, row_size, row_count);
+	CHECK_EQ (row_size, 24u);
+	CHECK_EQ (row_count, 1u);
+	GetTextureMipLayout (texture_format_rgba8, 10, 3, row_size, row_count);
+	CHECK_EQ (row_size, 40u);
+	CHECK_EQ (row_count, 3u);
+	CHECK_THROWS (GetTextureMipLayout (1, 4, 4, row_size, row_count), std::invalid_argument);
+	CHECK_EQ (GetTextureMipCount (1, 1), 1u);
+	CHECK_EQ (GetTextureMipCount (640, 17), 10u);
+	CHECK_EQ (GetTextureMipCount (1024, 1024), 11u);
+}
+
+TEST (FilesAreReadyForUpload)
+{
+	const TextureData texture = MakeTexture (texture_format_bc1, 100, 36, 7, 2);
+	std::vector<uint8_t> file;
+	WriteTextureFile (texture, file);
+	TextureView view;
+	CHECK (ReadTextureFile (file.data (), file.size (), view));
+	CHECK_EQ (view.header->format, texture_format_bc1);
+	CHECK_EQ (view.header->mip_count, 7u);
+	CHECK_EQ (view.header->array_size, 2u);
+	CHECK_EQ (view.header->flags, static_cast<uint32_t>(TEXTURE_FILE_FLAG_ALPHA));
+	CHECK_EQ (view.header->data_offset % texture_placement_alignment, 0u);
+	CHECK_EQ (view.header->file_size, file.size ());
+
+	//every row of every subresource at its pitch, in D3D12 order
+	for (uint32_t i = 0; i < 14; i++)
+	{
+		const TextureSubresource &subresource = view.subresources[i];
+		const uint32_t mip = i % 7;
+		CHECK_EQ (subresource.width, std::max (100u >> mip, 1u));
+		CHECK_EQ (subresource.height, std::max (36u >> mip, 1u));
+		CHECK_EQ (subresource.offset % texture_placement_alignment, 0u);
+		CHECK_EQ (subresource.row_pitch % texture_row_pitch_alignment, 0u);
+		const size_t row_size = texture.subresources[i].size () / subresource.row_count;
+		for (uint32_t row = 0; row < subresource.row_count; row++)
+			CHECK (memcmp (view.data + subresource.offset + static_cast<size_t>(row) * subresource.row_pitch,
+						   texture.subresources[i].data () + row * row_size, row_size) == 0);
+	}
+
+	std::vector<GpuTextureFootprint> footprints;
+	GetTextureUploadFootprints (view, 4096, footprints);
+	CHECK_EQ (footprints.size (), 14u);
+	CHECK_EQ (footprints[0].offset, 4096 + view.subresources[0].offset);
+	CHECK_EQ (footprints[0].width, 100u);
+	//copies of block compressed mips cover whole blocks
+	CHECK_EQ (footprints[0].height, 36u);
+	CHECK_EQ (footprints[3].width, 12u);
+	CHECK_EQ (footprints[3].height, 4u);
+	CHECK_EQ (footprints[6].width, 4u);
+	CHECK_EQ (footprints[9].row_pitch, view.subresources[9].row_pitch);
+	CHECK_EQ (footprints[9].depth, 1u);
+	CHECK_THROWS (GetTextureUploadFootprints (view, 100, footprints), std::invalid_argument);
+}
+
+TEST (DamagedFilesAreRejected)
+{
+	const TextureData texture = MakeTexture (texture_format_rgba8, 33, 9, 3, 1);
+	std::vector<uint8_t> file;
+	WriteTextureFile (texture, file);
+	TextureView view;
+	CHECK (!ReadTextureFile (file.data (), file.size () - 1, view));
+	CHECK (!ReadTextureFile (file.data (), 32, view));
+
+	//damage the header, then one subresource at a time
+	const size_t fields[] = { offsetof (TextureFileHeader, magic), offsetof (TextureFileHeader, version), offsetof (TextureFileHeader, format),
+							  offsetof (TextureFileHeader, mip_count), offsetof (TextureFileHeader, data_offset),
+							  sizeof (TextureFileHeader) + offsetof (TextureSubresource, offset),
+							  sizeof (TextureFileHeader) + sizeof (TextureSubresource) + offsetof (TextureSubresource, row_pitch),
+							  sizeof (TextureFileHeader) + 2 * sizeof (TextureSubresource) + offsetof (TextureSubresource, width) };
+	for (size_t field : fields)
+	{
+		std::vector<uint8_t> damaged = file;
+		damaged[field] ^= 0x41;
+		CHECK (!ReadTextureFile (damaged.data (), damaged.size (), view));
+	}
+
+	//subresources must have the size of their mip
+	TextureData wrong = texture;
+	wrong.subresources[1].pop_back ();
+	CHECK_THROWS (WriteTextureFile (wrong, file), std::invalid_argument);
+	wrong = texture;
+	wrong.mip_count = 8;
+	CHECK_THROWS (WriteTextureFile (wrong, file), std::invalid_argument);
+}
+
+TEST (DdsFilesCarryTheDx10Header)
+{
+	const TextureData texture = MakeTexture (texture_format_bc7_srgb, 16, 8, 5, 1);
+	std::vector<uint8_t> file;
+	WriteDdsFile (texture, file);
+	uint32_t words[37];
+	CHECK (file.size () > sizeof (words));
+	memcpy (words, file.data (), sizeof (words));
+	CHECK (memcmp (file.data (), "DDS ", 4) == 0);
+	CHECK_EQ (words[1], 124u);
+	CHECK_EQ (words[3], 8u);
+	CHECK_EQ (words[4], 16u);
+	CHECK_EQ (words[7], 5u);
+	CHECK (memcmp (file.data () + 84, "DX10", 4) == 0);
+	CHECK_EQ (words[32], texture_format_bc7_srgb);
+	CHECK_EQ (words[33], 3u);
+	//packed mips follow the headers
+	size_t size = sizeof (words);
+	for (const std::vector<uint8_t> &subresource : texture.subresources)
+	{
+		CHECK (memcmp (file.data () + size, subresource.data (), subresource.size ()) == 0);
+		size += subresource.size ();
+	}
+	CHECK_EQ (file.size (), size);
+}
@@ -0,0 +1,171 @@
+#include "test.h"
+#include "texture_import.h"
+
+#include <string.h>
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+static void Put16 (std::vector<uint8_t> &data, size_t offset, uint32_t value)
+{
+	data[offset] = static_cast<uint8_t>(value);
+	data[offset + 1] = static_cast<uint8_t>(value >> 8);
+}
+
+static void Put32 (std::vector<uint8_t> &data, size_t offset, uint32_t value)
+{
+	Put16 (data, offset, value & 0xffff);
+	Put16 (data, offset + 2, value >> 16);
+}
+
+static std::vector<uint8_t> MakeTgaHeader (uint32_t image_type, uint32_t width, uint32_t height, uint32_t bits, uint32_t descriptor)
+{
+	std::vector<uint8_t> data (18, 0);
+	data[2] = static_cast<uint8_t>(image_type);
+	Put16 (data, 12, width);
+	Put16 (data, 14, height);
+	data[16] = static_cast<uint8_t>(bits);
+	data[17] = static_cast<uint8_t>(descriptor);
+	return data;
+}
+
+static bool PixelIs (const TextureImage &image, uint32_t x, uint32_t y, uint8_t r, uint8_t g, uint8_t b, uint8_t a)
+{
+	const uint8_t *pixel = image.GetPixel (x, y);
+	return pixel[0] == r && pixel[1] == g && pixel[2] == b && pixel[3] == a;
+}
+
+static std::string ImportError (const std::vector<uint8_t> &data)
+{
+	TextureImage image;
+	try
+	{
+		ImportImage (data.data (), data.size (), image);
+	}
+	catch (const std::runtime_error &err)
+	{
+		return err.what ();
+	}
+	return "";
+}
+
+TEST (ImportsTga)
+{
+	//24 bit bottom-up BGR, 2x2
+	std::vector<uint8_t> data = MakeTgaHeader (2, 2, 2, 24, 0);
+	const uint8_t rows[12] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12 };
+	data.insert (data.end (), rows, rows + 12);
+	TextureImage image;
+	ImportImage (data.data (), data.size (), image);
+	CHECK_EQ (image.width, 2u);
+	CHECK_EQ (image.height, 2u);
+	//the first stored row is the bottom one
+	CHECK (PixelIs (image, 0, 1, 3, 2, 1, 255));
+	CHECK (PixelIs (image, 1, 0, 12, 11, 10, 255));
+	CHECK (image.IsOpaque ());
+
+	//32 bit RLE top-down: a run of 3 and a raw pixel
+	data = MakeTgaHeader (10, 4, 1, 32, 0x28);
+	const uint8_t packets[] = { 0x82, 10, 20, 30, 40, 0x00, 50, 60, 70, 80 };
+	data.insert (data.end (), packets, packets + sizeof (packets));
+	ImportImage (data.data (), data.size (), image);
+	for (uint32_t x = 0; x < 3; x++)
+		CHECK (PixelIs (image, x, 0, 30, 20, 10, 40));
+	CHECK (PixelIs (image, 3, 0, 70, 60, 50, 80));
+	CHECK (!image.IsOpaque ());
+
+	//16 bit with an alpha bit, right to left, and 8 bit grey
+	data = MakeTgaHeader (2, 2, 1, 16, 0x31);
+	const uint8_t pixels16[4] = { 0x1f, 0x80, 0x00, 0x7c };
+	data.insert (data.end (), pixels16, pixels16 + 4);
+	ImportImage (data.data (), data.size (), image);
+	CHECK (PixelIs (image, 1, 0, 0, 0, 255, 255));
+	CHECK (PixelIs (image, 0, 0, 255, 0, 0, 0));
+	data = MakeTgaHeader (3, 1, 1, 8, 0);
+	data.push_back (99);
+	ImportImage (data.data (), data.size (), image);
+	CHECK (PixelIs (image, 0, 0, 99, 99, 99, 255));
+}
+
+TEST (ImportsPnm)
+{
+	const char header[] = "P6\n# comment\n3 1\n255\n";
+	std::vector<uint8_t> data (header, header + strlen (header));
+	const uint8_t pixels[9] = { 255, 0, 0, 0, 255, 0, 1, 2, 3 };
+	data.insert (data.end (), pixels, pixels + 9);
+	TextureImage image;
+	ImportImage (data.data (), data.size (), image);
+	CHECK_EQ (image.width, 3u);
+	CHECK (PixelIs (image, 0, 0, 255, 0, 0, 255));
+	CHECK (PixelIs (image, 2, 0, 1, 2, 3, 255));
+
+	//16 bit grey samples are scaled from their maximum
+	const char grey[] = "P5 2 1 1000 ";
+	data.assign (grey, grey + strlen (grey));
+	const uint8_t samples[4] = { 0x03, 0xe8, 0x01, 0xf4 };
+	data.insert (data.end (), samples, samples + 4);
+	ImportImage (data.data (), data.size (), image);
+	CHECK (PixelIs (image, 0, 0, 255, 255, 255, 255));
+	CHECK (PixelIs (image, 1, 0, 128, 128, 128, 255));
+}
+
+TEST (ImportsBmp)
+{
+	//24 bit bottom-up 3x2, rows padded to 12 bytes
+	std::vector<uint8_t> data (54 + 24, 0);
+	data[0] = 'B';
+	data[1] = 'M';
+	Put32 (data, 10, 54);
+	Put32 (data, 14, 40);
+	Put32 (data, 18, 3);
+	Put32 (data, 22, 2);
+	Put16 (data, 28, 24);
+	for (uint32_t i = 0; i < 9; i++)
+	{
+		data[54 + i] = static_cast<uint8_t>(10 + i);
+		data[66 + i] = static_cast<uint8_t>(100 + i);
+	}
+	TextureImage image;
+	ImportImage (data.data (), data.size (), image);
+	CHECK_EQ (image.width, 3u);
+	CHECK_EQ (image.height, 2u);
+	CHECK (PixelIs (image, 0, 1, 12, 11, 10, 255));
+	CHECK (PixelIs (image, 2, 0, 108, 107, 106, 255));
+
+	//32 bit top-down whose fourth bytes are all zero is opaque
+	std::vector<uint8_t> top_down (54 + 8, 0);
+	memcpy (top_down.data (), data.data (), 54);
+	Put32 (top_down, 18, 1);
+	Put32 (top_down, 22, static_cast<uint32_t>(-2));
+	Put16 (top_down, 28, 32);
+	top_down[54] = 1;
+	top_down[58] = 2;
+	ImportImage (top_down.data (), top_down.size (), image);
+	CHECK (PixelIs (image, 0, 0, 0, 0, 1, 255));
+	CHECK (PixelIs (image, 0, 1, 0, 0, 2, 255));
+}
+
+TEST (ErrorsNameTheFormat)
+{
+	//truncated pixel data
+	std::vector<uint8_t> data = MakeTgaHeader (2, 4, 4, 24, 0);
+	data.resize (data.size () + 10);
+	CHECK (ImportError (data) == "TGA: unexpected end of file");
+	CHECK (ImportError (MakeTgaHeader (1, 4, 4, 8, 0)) == "TGA: only true colour and grey images are supported");
+	CHECK (ImportError (MakeTgaHeader (2, 0, 4, 24, 0)) == "TGA: empty image");
+
+	const char huge[] = "P6 20000 1 255 ";
+	CHECK (ImportError (std::vector<uint8_t>(huge, huge + strlen (huge))) == "PNM: image is too large");
+	const char bad[] = "P5 1 1 100 \xff";
+	CHECK (ImportError (std::vector<uint8_t>(bad, bad + strlen (bad))) == "PNM: sample exceeds the maximum value");
+
+	std::vector<uint8_t> bmp (54, 0);
+	bmp[0] = 'B';
+	bmp[1] = 'M';
+	Put32 (bmp, 14, 40);
+	Put32 (bmp, 18, 1);
+	Put32 (bmp, 22, 1);
+	Put16 (bmp, 28, 8);
+	CHECK (ImportError (bmp) == "BMP: only uncompressed 24 and 32 bit bitmaps are supported");
+}
@@ -0,0 +1,183 @@
+#include "test.h"
+#include "texture_mips.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+#include <random>
+#include <stdexcept>
+
+static TextureImage MakeNoise (uint32_t width, uint32_t height, uint32_t seed)
+{
+	TextureImage image;
+	image.Resize (width, height);
+	std::mt19937 random (seed);
+	for (uint8_t &value : image.pixels)
+		value = static_cast<uint8_t>(random ());
+	return image;
+}
+
+static TextureImage MakeSolid (uint32_t width, uint32_t height, const uint8_t colour[4])
+{
+	TextureImage image;
+	image.Resize (width, height);
+	for (size_t i = 0; i < image.pixels.size (); i++)
+		image.pixels[i] = colour[i % 4];
+	return image;
+}
+
+TEST (SrgbConversionRoundTrips)
+{
+	for (uint32_t value = 0; value < 256; value++)
+		CHECK_EQ (LinearToSrgb (SrgbToLinear (static_cast<uint8_t>(value))), value);
+	CHECK_EQ (SrgbToLinear (0), 0.0f);
+	CHECK_EQ (SrgbToLinear (255), 1.0f);
+	//middle grey in linear light
+	CHECK (fabsf (SrgbToLinear (188) - 0.5029f) < 1e-3f);
+	CHECK_EQ (LinearToSrgb (0.5f), 188u);
+	CHECK_EQ (LinearToSrgb (-1.0f), 0u);
+	CHECK_EQ (LinearToSrgb (2.0f), 255u);
+	CHECK_EQ (LinearToSrgb (NAN), 0u);
+}
+
+TEST (ChainsHalveDownToOnePixel)
+{
+	std::vector<TextureImage> mips;
+	GenerateMips (MakeNoise (13, 6, 1), 0, 0, nullptr, mips);
+	const uint32_t sizes[4][2] = { { 13, 6 }, { 6, 3 }, { 3, 1 }, { 1, 1 } };
+	CHECK_EQ (mips.size (), 4u);
+	for (uint32_t m = 0; m < 4 && m < mips.size (); m++)
+	{
+		CHECK_EQ (mips[m].width, sizes[m][0]);
+		CHECK_EQ (mips[m].height, sizes[m][1]);
+		CHECK_EQ (mips[m].pixels.size (), static_cast<size_t>(sizes[m][0]) * sizes[m][1] * 4);
+	}
+	GenerateMips (MakeNoise (64, 64, 2), 0, 3, nullptr, mips);
+	CHECK_EQ (mips.size (), 3u);
+	CHECK_EQ (mips[2].width, 16u);
+
+	//flat colour stays flat at every size
+	const uint8_t colour[4] = { 200, 10, 77, 128 };
+	GenerateMips (MakeSolid (37, 5, colour), TEXTURE_MIP_SRGB, 0, nullptr, mips);
+	for (const TextureImage &mip : mips)
+		for (size_t i = 0; i < mip.pixels.size (); i++)
+			CHECK_EQ (mip.pixels[i], colour[i % 4]);
+
+	TextureImage empty;
+	CHECK_THROWS (GenerateMips (empty, 0, 0, nullptr, mips), std::invalid_argument);
+	CHECK_THROWS (GenerateMips (MakeSolid (4, 4, colour), TEXTURE_MIP_SRGB | TEXTURE_MIP_NORMAL_MAP, 0, nullptr, mips),
+				  std::invalid_argument);
+}
+
+TEST (FiltersInLinearLight)
+{
+	//a checkerboard of black and white averages to half the light
+	TextureImage checker;
+	checker.Resize (2, 2);
+	for (uint32_t i = 0; i < 4; i++)
+	{
+		const uint8_t value = (i == 0 || i == 3) ? 255 : 0;
+		uint8_t *pixel = checker.pixels.data () + i * 4;
+		pixel[0] = pixel[1] = pixel[2] = value;
+		pixel[3] = value;
+	}
+	std::vector<TextureImage> mips;
+	GenerateMips (checker, TEXTURE_MIP_SRGB, 0, nullptr, mips);
+	CHECK_EQ (mips[1].pixels[0], 188u);
+	//alpha is linear in both cases
+	CHECK_EQ (mips[1].pixels[3], 128u);
+	GenerateMips (checker, 0, 0, nullptr, mips);
+	CHECK_EQ (mips[1].pixels[0], 128u);
+}
+
+TEST (OddSizesKeepEveryPixelsWeight)
+{
+	//the 3 tap filter of 7 pixels down to 3: every source pixel contributes 3/7 of a mip
+	//pixel in total, wherever it is
+	std::vector<TextureImage> mips;
+	for (uint32_t spike = 0; spike < 7; spike++)
+	{
+		TextureImage line;
+		line.Resize (7, 1);
+		for (uint32_t x = 0; x < 7; x++)
+		{
+			line.GetPixel (x, 0)[0] = x == spike ? 255 : 0;
+			line.GetPixel (x, 0)[3] = 255;
+		}
+		GenerateMips (line, 0, 2, nullptr, mips);
+		CHECK_EQ (mips[1].width, 3u);
+		uint32_t sum = 0;
+		for (uint32_t x = 0; x < 3; x++)
+			sum += mips[1].GetPixel (x, 0)[0];
+		CHECK (sum >= 108 && sum <= 110);
+	}
+
+	//a ramp stays a ramp with the same mean and no shift
+	TextureImage ramp;
+	ramp.Resize (7, 1);
+	for (uint32_t x = 0; x < 7; x++)
+	{
+		ramp.GetPixel (x, 0)[1] = static_cast<uint8_t>(x * 40);
+		ramp.GetPixel (x, 0)[3] = 255;
+	}
+	GenerateMips (ramp, 0, 2, nullptr, mips);
+	const double mean = (0 + 40 + 80 + 120 + 160 + 200 + 240) / 7.0;
+	double mip_mean = 0.0;
+	for (uint32_t x = 0; x < 3; x++)
+		mip_mean += mips[1].GetPixel (x, 0)[1] / 3.0;
+	CHECK (fabs (mip_mean - mean) < 1.0);
+	CHECK (mips[1].GetPixel (0, 0)[1] < mips[1].GetPixel (1, 0)[1] && mips[1].GetPixel (1, 0)[1] < mips[1].GetPixel (2, 0)[1]);
+	CHECK (abs (mips[1].GetPixel (1, 0)[1] - 120) <= 1);
+	//symmetric around the centre
+	CHECK_EQ (mips[1].GetPixel (0, 0)[1] + mips[1].GetPixel (2, 0)[1], 2 * mips[1].GetPixel (1, 0)[1]);
+}
+
+TEST (NormalMapsStayUnitLength)
+{
+	TextureImage normals;
+	normals.Resize (16, 16);
+	std::mt19937 random (4);
+	std::uniform_real_distribution<float> unit (-1.0f, 1.0f);
+	for (uint32_t i = 0; i < 256; i++)
+	{
+		float vector[3] = { unit (random), unit (random), 1.0f };
+		const float length = sqrtf (vector[0] * vector[0] + vector[1] * vector[1] + vector[2] * vector[2]);
+		for (uint32_t c = 0; c < 3; c++)
+			normals.pixels[i * 4 + c] = static_cast<uint8_t>(lrintf ((vector[c] / length * 0.5f + 0.5f) * 255.0f));
+		normals.pixels[i * 4 + 3] = 255;
+	}
+	std::vector<TextureImage> mips;
+	GenerateMips (normals, TEXTURE_MIP_NORMAL_MAP, 0, nullptr, mips);
+	for (size_t m = 1; m < mips.size (); m++)
+		for (size_t i = 0; i < mips[m].pixels.size (); i += 4)
+		{
+			float length = 0.0f;
+			for (uint32_t c = 0; c < 3; c++)
+			{
+				const float value = mips[m].pixels[i + c] / 255.0f * 2.0f - 1.0f;
+				length += value * value;
+			}
+			CHECK (fabsf (sqrtf (length) - 1.0f) < 0.02f);
+		}
+}
+
+TEST (EverySimdLevelAndThreadCountWritesTheSameBits)
+{
+	JobSystem job_system (4);
+	const uint32_t sizes[3][2] = { { 256, 256 }, { 333, 97 }, { 1, 200 } };
+	for (uint32_t s = 0; s < 3; s++)
+		for (uint32_t flags = 0; flags < 2; flags++)
+		{
+			const TextureImage image = MakeNoise (sizes[s][0], sizes[s][1], 10 + s);
+			std::vector<TextureImage> reference, mips;
+			GenerateMips (image, flags, 0, nullptr, reference, TEXTURE_SIMD_SCALAR);
+			const TextureSimdLevel levels[] = { TEXTURE_SIMD_SSE2, TEXTURE_SIMD_AVX };
+			for (TextureSimdLevel level : levels)
+			{
+				GenerateMips (image, flags, 0, &job_system, mips, level);
+				CHECK_EQ (mips.size (), reference.size ());
+				for (size_t m = 0; m < mips.size () && m < reference.size (); m++)
+					CHECK (mips[m].pixels == reference[m].pixels);
+			}
+		}
+}
@@ -0,0 +1,191 @@
+#include "test.h"
+#include "null_device.h"
+#include "upload_allocator.h"
+#include "memory_backends.h"
+
+#include <random>
+#include <stdexcept>
+
+//list that keeps the copies recorded into it
+class CopyList : public NullCommandList
+{
+public:
+	explicit CopyList (NullCommandAllocator *allocator) :
+		NullCommandList (allocator)
+	{
+	}
+	void CopyBufferRegion (GpuResourceHandle dst, uint64_t dst_offset, GpuResourceHandle src, uint64_t src_offset, uint64_t size) override
+	{
+		const NullCopyPayload copy = { dst, dst_offset, src, src_offset, size };
+		copies.push_back (copy);
+	}
+
+	std::vector<NullCopyPayload> copies;
+};
+
+TEST (RingHandsOutAlignedSpace)
+{
+	UploadRing ring (1024);
+	uint64_t a, b, c;
+	CHECK (ring.Allocate (100, 1, a) && a == 0);
+	CHECK (ring.Allocate (10, 256, b) && b == 256);
+	CHECK_EQ (ring.GetUsedSize (), 266u);
+	CHECK_THROWS (ring.Allocate (10, 3, c), std::invalid_argument);
+	CHECK (!ring.Allocate (2000, 1, c));
+	CHECK_THROWS (UploadRing (0), std::invalid_argument);
+}
+
+TEST (RingWrapsAroundAndReclaimsByFence)
+{
+	UploadRing ring (1000);
+	uint64_t offset;
+	CHECK (ring.Allocate (400, 1, offset) && offset == 0);
+	ring.FinishFrame (1);
+	CHECK (ring.Allocate (400, 1, offset) && offset == 400);
+	ring.FinishFrame (2);
+	//300 bytes left at the end, but the first frame still holds the start
+	CHECK (!ring.Allocate (300, 1, offset));
+	CHECK (ring.Allocate (200, 1, offset) && offset == 800);
+	CHECK (!ring.Allocate (1, 1, offset));
+	ring.FinishFrame (3);
+	CHECK_EQ (ring.GetOldestFence (), 1u);
+
+	ring.Reclaim (1);
+	CHECK_EQ (ring.GetUsedSize (), 600u);
+	CHECK_EQ (ring.GetOldestFence (), 2u);
+	CHECK (ring.Allocate (300, 1, offset) && offset == 0);
+	//a wrap pads to the end of the ring, which is reclaimed with the allocation
+	ring.FinishFrame (4);
+	ring.Reclaim (4);
+	CHECK_EQ (ring.GetUsedSize (), 0u);
+	CHECK_EQ (ring.GetOldestFence (), 0u);
+	CHECK (ring.Allocate (1000, 1, offset) && offset == 0);
+}
+
+TEST (RingFuzzNeverOverlapsLiveAllocations)
+{
+	const uint64_t capacity = 4096;
+	UploadRing ring (capacity);
+	std::mt19937 random (1234);
+	//bytes of the ring owned by the frame that allocated them, 0 when free
+	std::vector<uint64_t> owner (capacity, 0);
+	uint64_t frame = 1;
+	uint64_t completed = 0;
+	bool valid = true;
+	for (int step = 0; step < 200000 && valid; step++)
+	{
+		const uint32_t action = random () % 16;
+		if (action == 0)
+		{
+			ring.FinishFrame (frame++);
+		}
+		else if (action == 1 && completed + 1 < frame)
+		{
+			completed += 1 + random () % (frame - completed - 1);
+			ring.Reclaim (completed);
+			for (uint64_t &byte : owner)
+				if (byte && byte <= completed)
+					byte = 0;
+		}
+		else
+		{
+			const uint64_t size = 1 + random () % 512;
+			const uint64_t alignment = 1ull << (random () % 9);
+			uint64_t offset;
+			if (ring.Allocate (size, alignment, offset))
+			{
+				valid &= offset % alignment == 0 && offset + size <= capacity;
+				for (uint64_t i = offset; i < offset + size && valid; i++)
+				{
+					valid &= owner[i] == 0;
+					owner[i] = frame;
+				}
+			}
+		}
+	}
+	CHECK (valid);
+}
+
+TEST (UploadsAndMergesCopies)
+{
+	NullDevice device;
+	MemoryUploadBackend backend;
+	{
+		UploadAllocator upload (&device, &backend, 64 * 1024);
+		CHECK_EQ (backend.live_chunks, 1);
+		const uint8_t data[32] = { 1, 2, 3, 4 };
+		//three copies into continuing ranges of one buffer, aligned to 16 bytes in the ring
+		upload.UploadBuffer (7, 0, data, 16);
+		upload.UploadBuffer (7, 16, data, 16);
+		upload.UploadBuffer (7, 32, data, 32);
+		upload.UploadBuffer (8, 0, data, 4);
+		upload.UploadBuffer (7, 64, data, 4);
+
+		NullCommandAllocator allocator;
+		CopyList command_list (&allocator);
+		upload.FlushCopies (&command_list);
+		CHECK_EQ (command_list.copies.size (), 3u);
+		if (command_list.copies.size () == 3)
+		{
+			CHECK (command_list.copies[0].dst == 7 && command_list.copies[0].dst_offset == 0 && command_list.copies[0].size == 64);
+			CHECK (command_list.copies[1].dst == 8 && command_list.copies[1].size == 4);
+			CHECK (command_list.copies[2].dst == 7 && command_list.copies[2].dst_offset == 64);
+		}
+		const UploadStats stats = upload.GetStats ();
+		CHECK_EQ (stats.copies, 5u);
+		CHECK_EQ (stats.recorded_copies, 3u);
+		upload.FinishFrame (1);
+	}
+	CHECK_EQ (backend.live_chunks, 0);
+}
+
+TEST (SpillsLargeAllocationsIntoChunks)
+{
+	NullDevice device;
+	MemoryUploadBackend backend;
+	UploadAllocator upload (&device, &backend, 1024);
+	const UploadAllocation large = upload.Allocate (600, 16);
+	CHECK (large.offset == 0 && large.size == 600);
+	CHECK_EQ (backend.live_chunks, 2);
+	upload.FinishFrame (1);
+	device.Signal (1);
+	//the chunk is destroyed once the fence of its frame passed
+	upload.Allocate (16, 16);
+	upload.FinishFrame (2);
+	CHECK_EQ (backend.live_chunks, 1);
+	CHECK_EQ (upload.GetStats ().dedicated_chunks, 1u);
+}
+
+TEST (WaitsForTheGpuWhenTheRingIsFull)
+{
+	NullDeviceDesc desc;
+	desc.gpu_ns_per_list = 1000;
+	NullDevice device (desc);
+	MemoryUploadBackend backend;
+	UploadAllocator upload (&device, &backend, 1024);
+	NullCommandAllocator command_allocator;
+	std::unique_ptr<GpuCommandList> command_list = device.CreateCommandList (&command_allocator);
+	command_list->Close ();
+	GpuCommandList *lists[] = { command_list.get () };
+	for (uint64_t frame = 1; frame <= 8; frame++)
+	{
+		upload.Allocate (400, 16);
+		device.ExecuteCommandLists (1, lists);
+		upload.FinishFrame (frame);
+		device.Signal (frame);
+	}
+	//two frames fit into the ring, every later one waits for the frame two before it
+	CHECK_EQ (upload.GetStats ().stalls, 6u);
+	CHECK_EQ (upload.GetStats ().dedicated_chunks, 0u);
+	CHECK_EQ (device.GetStats ().waits, 6u);
+}
+
+TEST (RejectsUnflushedCopies)
+{
+	NullDevice device;
+	MemoryUploadBackend backend;
+	UploadAllocator upload (&device, &backend, 1024);
+	const uint8_t data[4] = {};
+	upload.UploadBuffer (1, 0, data, sizeof (data));
+	CHECK_THROWS (upload.FinishFrame (1), std::logic_error);
+}
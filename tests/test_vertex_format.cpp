@@ -0,0 +1,306 @@
+#include "test.h"
+#include "vertex_format.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+#include <limits>
+#include <random>
+#include <stdexcept>
+
+static const VertexSimdLevel levels[] = { VERTEX_SIMD_SCALAR, VERTEX_SIMD_SSE2, VERTEX_SIMD_AVX2 };
+
+//float vertices of position, normal, texcoord and colour with a padding float, random
+//unit normals and some values every kernel has to clamp or saturate
+struct FloatVertex
+{
+	float position[3];
+	float normal[3];
+	float texcoord[2];
+	float color[4];
+	float padding;
+};
+
+static std::vector<FloatVertex> MakeVertices (uint32_t count, uint32_t seed)
+{
+	std::mt19937 random (seed);
+	std::uniform_real_distribution<float> unit (-1.0f, 1.0f);
+	std::vector<FloatVertex> vertices (count);
+	for (FloatVertex &vertex : vertices)
+	{
+		float length = 0.0f;
+		for (uint32_t c = 0; c < 3; c++)
+		{
+			vertex.position[c] = unit (random) * 50.0f + 10.0f * c;
+			vertex.normal[c] = unit (random);
+			length += vertex.normal[c] * vertex.normal[c];
+		}
+		for (uint32_t c = 0; c < 3; c++)
+			vertex.normal[c] /= sqrtf (length);
+		vertex.texcoord[0] = unit (random) * 4.0f;
+		vertex.texcoord[1] = unit (random) * 0.001f;
+		for (uint32_t c = 0; c < 4; c++)
+			vertex.color[c] = unit (random) * 0.75f + 0.5f;
+		vertex.padding = 0.0f;
+	}
+	//normals on the axes, the fold diagonals and zero; texcoords that saturate or are not numbers
+	const float special_normals[][3] = { { 0, 0, 1 }, { 0, 0, -1 }, { 1, 0, 0 }, { 0, -1, 0 }, { 0.6f, 0.8f, 0 }, { 0, 0, 0 } };
+	for (uint32_t i = 0; i < 6 && i < count; i++)
+		memcpy (vertices[i].normal, special_normals[i], sizeof (vertices[i].normal));
+	if (count > 3)
+	{
+		vertices[1].texcoord[0] = 70000.0f;
+		vertices[2].texcoord[0] = std::numeric_limits<float>::quiet_NaN ();
+		vertices[3].texcoord[1] = -std::numeric_limits<float>::infinity ();
+		vertices[3].color[0] = std::numeric_limits<float>::quiet_NaN ();
+	}
+	return vertices;
+}
+
+TEST (FormatSizes)
+{
+	CHECK_EQ (GetVertexFormatSize (vertex_format_float4), 16u);
+	CHECK_EQ (GetVertexFormatSize (vertex_format_float3), 12u);
+	CHECK_EQ (GetVertexFormatSize (vertex_format_snorm16x4), 8u);
+	CHECK_EQ (GetVertexFormatSize (vertex_format_half2), 4u);
+	CHECK_EQ (GetVertexFormatSize (vertex_format_unorm8x4), 4u);
+	CHECK_EQ (GetVertexFormatSize (vertex_format_snorm16x2), 4u);
+	CHECK_EQ (GetVertexFormatSize (1), 0u);
+}
+
+TEST (HalfConversionsRoundToNearestEven)
+{
+	CHECK_EQ (FloatToHalf (1.0f), 0x3c00);
+	CHECK_EQ (FloatToHalf (-2.0f), 0xc000);
+	CHECK_EQ (FloatToHalf (-0.0f), 0x8000);
+	CHECK_EQ (FloatToHalf (65504.0f), 0x7bff);
+	CHECK_EQ (FloatToHalf (65520.0f), 0x7c00);
+	CHECK_EQ (FloatToHalf (std::numeric_limits<float>::infinity ()), 0x7c00);
+	CHECK_EQ (FloatToHalf (std::numeric_limits<float>::quiet_NaN ()), 0x7e00);
+	CHECK_EQ (FloatToHalf (ldexpf (1.0f, -24)), 0x0001);
+	CHECK_EQ (FloatToHalf (ldexpf (1.0f, -26)), 0x0000);
+	//ties between two halves go to the even one
+	CHECK_EQ (FloatToHalf (1.0f + ldexpf (1.0f, -11)), 0x3c00);
+	CHECK_EQ (FloatToHalf (1.0f + 3.0f * ldexpf (1.0f, -11)), 0x3c02);
+	CHECK_EQ (FloatToHalf (3.0f * ldexpf (1.0f, -25)), 0x0002);
+
+	//every half survives the round trip, NaNs stay NaNs
+	for (uint32_t half = 0; half <= 0xffff; half++)
+	{
+		const float value = HalfToFloat (static_cast<uint16_t>(half));
+		const bool is_nan = (half & 0x7c00) == 0x7c00 && (half & 0x3ff);
+		if (is_nan)
+			CHECK (value != value);
+		else if (FloatToHalf (value) != half)
+		{
+			CHECK_EQ (FloatToHalf (value), half);
+			break;
+		}
+	}
+}
+
+TEST (EveryLevelWritesTheSameBits)
+{
+	//an odd count leaves a remainder after every SIMD width
+	const uint32_t count = 1037;
+	const std::vector<FloatVertex> vertices = MakeVertices (count, 7);
+	const uint32_t stride = sizeof (FloatVertex);
+	const float scale[3] = { 50.0f, 50.0f, 50.0f };
+	const float bias[3] = { 0.0f, 10.0f, 20.0f };
+
+	std::vector<uint8_t> reference[5];
+	for (VertexSimdLevel level : levels)
+	{
+		//outputs are interleaved with a gap the kernels must not write
+		std::vector<uint8_t> outputs[5];
+		for (std::vector<uint8_t> &output : outputs)
+			output.assign (count * 12, 0xcd);
+		EncodeSnorm16Positions (vertices[0].position, stride, count, scale, bias, outputs[0].data (), 12, level);
+		EncodeHalfs (vertices[0].texcoord, stride, 2, count, outputs[1].data (), 12, level);
+		EncodeHalfs (vertices[0].position, stride, 3, count, outputs[2].data (), 12, level);
+		EncodeUnorm8Colors (vertices[0].color, stride, count, outputs[3].data (), 12, level);
+		EncodeOctahedralNormals (vertices[0].normal, stride, count, outputs[4].data (), 12, level);
+		for (uint32_t kernel = 0; kernel < 5; kernel++)
+		{
+			if (level == VERTEX_SIMD_SCALAR)
+				reference[kernel] = outputs[kernel];
+			else
+				CHECK (outputs[kernel] == reference[kernel]);
+		}
+	}
+	CHECK_EQ (reference[0][8], 0xcd);
+	CHECK_EQ (reference[1][4], 0xcd);
+	CHECK_EQ (reference[4][4], 0xcd);
+	CHECK_THROWS (EncodeHalfs (vertices[0].texcoord, stride, 1, count, reference[1].data (), 12), std::invalid_argument);
+}
+
+TEST (Snorm16PositionsRoundTripWithinHalfAStep)
+{
+	const uint32_t count = 4096;
+	const std::vector<FloatVertex> vertices = MakeVertices (count, 11);
+	const float scale[3] = { 50.0f, 50.0f, 50.0f };
+	const float bias[3] = { 0.0f, 10.0f, 20.0f };
+	std::vector<int16_t> encoded (count * 4);
+	EncodeSnorm16Positions (vertices[0].position, sizeof (FloatVertex), count, scale, bias, encoded.data (), 8);
+	std::vector<float> decoded (count * 3);
+	DecodeSnorm16Positions (encoded.data (), 8, count, scale, bias, decoded.data (), 12);
+
+	float max_error = 0.0f;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		CHECK_EQ (encoded[i * 4 + 3], 32767);
+		for (uint32_t c = 0; c < 3; c++)
+			max_error = std::max (max_error, fabsf (decoded[i * 3 + c] - vertices[i].position[c]));
+	}
+	CHECK (max_error <= 0.5f * 50.0f / 32767.0f * 1.01f);
+	CHECK (max_error > 0.0f);
+}
+
+TEST (OctahedralNormalsRoundTripWithinASmallAngle)
+{
+	const uint32_t count = 8192;
+	const std::vector<FloatVertex> vertices = MakeVertices (count, 13);
+	std::vector<int16_t> encoded (count * 2);
+	EncodeOctahedralNormals (vertices[0].normal, sizeof (FloatVertex), count, encoded.data (), 4);
+	std::vector<float> decoded (count * 3);
+	DecodeOctahedralNormals (encoded.data (), 4, count, decoded.data (), 12);
+
+	//the zero vector decodes as +z, the axes exactly
+	CHECK (decoded[15] == 0.0f && decoded[16] == 0.0f && decoded[17] == 1.0f);
+	CHECK (decoded[3] == 0.0f && decoded[4] == 0.0f && decoded[5] == -1.0f);
+	CHECK (decoded[6] == 1.0f && decoded[10] == -1.0f);
+	double max_angle = 0.0;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		const float *normal = vertices[i].normal;
+		const float *result = &decoded[i * 3];
+		const double dot = normal[0] * result[0] + normal[1] * result[1] + normal[2] * result[2];
+		const double cross[3] = { normal[1] * result[2] - normal[2] * result[1], normal[2] * result[0] - normal[0] * result[2], normal[0] * result[1] - normal[1] * result[0] };
+		if (i != 5)
+			max_angle = std::max (max_angle, atan2 (sqrt (cross[0] * cross[0] + cross[1] * cross[1] + cross[2] * cross[2]), dot));
+		const float length = sqrtf (result[0] * result[0] + result[1] * result[1] + result[2] * result[2]);
+		CHECK (fabsf (length - 1.0f) < 1e-5f);
+	}
+	//below 0.01 degrees
+	CHECK (max_angle < 0.01 * 3.14159265358979 / 180.0);
+}
+
+TEST (Unorm8ColorsClampAndRound)
+{
+	const float colors[3][4] = { { -0.5f, 1.5f, 0.5f, 1.0f }, { 0.0f, 1.0f / 255.0f, 0.49f / 255.0f, 0.51f / 255.0f }, { 0.25f, 0.75f, 0.3f, 0.9f } };
+	uint8_t encoded[3][4];
+	EncodeUnorm8Colors (colors, 16, 3, encoded, 4);
+	CHECK (encoded[0][0] == 0 && encoded[0][1] == 255 && encoded[0][2] == 128 && encoded[0][3] == 255);
+	CHECK (encoded[1][0] == 0 && encoded[1][1] == 1 && encoded[1][2] == 0 && encoded[1][3] == 1);
+	float decoded[3][4];
+	DecodeUnorm8Colors (encoded, 4, 3, decoded, 16);
+	for (uint32_t c = 0; c < 4; c++)
+		CHECK (fabsf (decoded[2][c] - colors[2][c]) <= 0.5f / 255.0f + 1e-6f);
+}
+
+static MeshData MakeFloatMesh (uint32_t count)
+{
+	const std::vector<FloatVertex> vertices = MakeVertices (count, 17);
+	MeshData mesh;
+	mesh.attributes.push_back ({ MESH_ATTRIBUTE_POSITION, 0, vertex_format_float3, 0 });
+	mesh.attributes.push_back ({ MESH_ATTRIBUTE_NORMAL, 0, vertex_format_float3, 12 });
+	mesh.attributes.push_back ({ MESH_ATTRIBUTE_TEXCOORD, 0, vertex_format_float2, 24 });
+	mesh.attributes.push_back ({ MESH_ATTRIBUTE_COLOR, 0, vertex_format_float4, 32 });
+	mesh.vertex_stride = sizeof (FloatVertex);
+	const uint8_t *bytes = reinterpret_cast<const uint8_t*>(vertices.data ());
+	mesh.vertices.assign (bytes, bytes + vertices.size () * sizeof (FloatVertex));
+	for (uint32_t i = 0; i + 2 < count; i++)
+	{
+		mesh.indices.push_back (i);
+		mesh.indices.push_back (i + 1);
+		mesh.indices.push_back (i + 2);
+	}
+	MeshSubmesh submesh;
+	memset (&submesh, 0, sizeof (submesh));
+	submesh.index_count = static_cast<uint32_t>(mesh.indices.size ());
+	mesh.submeshes.push_back (submesh);
+	ComputeMeshBounds (mesh);
+	return mesh;
+}
+
+TEST (QuantizesMeshesIntoTheCompactLayout)
+{
+	const MeshData source = MakeFloatMesh (300);
+	MeshData mesh;
+	QuantizeMesh (source, GetCompactVertexQuantization (), mesh);
+
+	//8 + 4 + 4 + 4 bytes instead of 48
+	CHECK_EQ (mesh.vertex_stride, 20u);
+	CHECK_EQ (mesh.GetVertexCount (), 300u);
+	const uint32_t formats[] = { vertex_format_snorm16x4, vertex_format_snorm16x2, vertex_format_half2, vertex_format_unorm8x4 };
+	const uint32_t offsets[] = { 0, 8, 12, 16 };
+	CHECK_EQ (mesh.attributes.size (), 4u);
+	for (uint32_t a = 0; a < 4 && a < mesh.attributes.size (); a++)
+	{
+		CHECK_EQ (mesh.attributes[a].format, formats[a]);
+		CHECK_EQ (mesh.attributes[a].offset, offsets[a]);
+		CHECK_EQ (mesh.attributes[a].semantic, source.attributes[a].semantic);
+	}
+	CHECK (mesh.indices == source.indices);
+	CHECK_EQ (mesh.submeshes.size (), 1u);
+	CHECK_EQ (mesh.bounds_max[0], source.bounds_max[0]);
+
+	//the scale and bias map the position bounds to [-1, 1]
+	std::vector<float> positions (300 * 3);
+	DecodeSnorm16Positions (mesh.vertices.data (), mesh.vertex_stride, 300, mesh.position_scale, mesh.position_bias, positions.data (), 12);
+	for (uint32_t c = 0; c < 3; c++)
+	{
+		CHECK (fabsf (mesh.position_bias[c] - 0.5f * (source.bounds_min[c] + source.bounds_max[c])) < 1e-4f);
+		CHECK (fabsf (mesh.position_scale[c] - 0.5f * (source.bounds_max[c] - source.bounds_min[c])) < 1e-4f);
+	}
+	float max_error = 0.0f;
+	for (uint32_t i = 0; i < 300; i++)
+		for (uint32_t c = 0; c < 3; c++)
+		{
+			float original;
+			memcpy (&original, source.vertices.data () + i * source.vertex_stride + c * sizeof (float), sizeof (original));
+			max_error = std::max (max_error, fabsf (positions[i * 3 + c] - original));
+		}
+	CHECK (max_error <= 0.5f * 50.0f / 32767.0f * 1.01f);
+
+	//the same result at every level
+	for (VertexSimdLevel level : levels)
+	{
+		MeshData at_level;
+		QuantizeMesh (source, GetCompactVertexQuantization (), at_level, level);
+		CHECK (at_level.vertices == mesh.vertices);
+	}
+}
+
+TEST (FloatQuantizationKeepsTheVertices)
+{
+	const MeshData source = MakeFloatMesh (50);
+	MeshData mesh;
+	QuantizeMesh (source, GetFloatVertexQuantization (), mesh);
+	//the padding float is dropped
+	CHECK_EQ (mesh.vertex_stride, 48u);
+	CHECK_EQ (mesh.position_scale[0], 1.0f);
+	for (uint32_t i = 0; i < 50; i++)
+		CHECK (memcmp (mesh.vertices.data () + i * 48, source.vertices.data () + i * source.vertex_stride, 48) == 0);
+}
+
+TEST (RejectsEncodingsThatDoNotFit)
+{
+	const MeshData source = MakeFloatMesh (10);
+	MeshData mesh;
+	VertexQuantization quantization = GetCompactVertexQuantization ();
+	quantization.encodings[MESH_ATTRIBUTE_TEXCOORD] = VERTEX_ENCODING_SNORM16;
+	CHECK_THROWS (QuantizeMesh (source, quantization, mesh), std::invalid_argument);
+	quantization = GetCompactVertexQuantization ();
+	quantization.encodings[MESH_ATTRIBUTE_POSITION] = VERTEX_ENCODING_UNORM8;
+	CHECK_THROWS (QuantizeMesh (source, quantization, mesh), std::invalid_argument);
+	quantization.encodings[MESH_ATTRIBUTE_POSITION] = VERTEX_ENCODING_HALF;
+	QuantizeMesh (source, quantization, mesh);
+	CHECK_EQ (mesh.attributes[0].format, vertex_format_half4);
+	CHECK_EQ (mesh.vertex_stride, 20u);
+
+	MeshData broken = source;
+	broken.attributes[3].offset = 40;
+	CHECK_THROWS (QuantizeMesh (broken, GetCompactVertexQuantization (), mesh), std::invalid_argument);
+}
@@ -0,0 +1,278 @@
+#include "test.h"
+#include "visibility.h"
+
+#include <math.h>
+
+#include <algorithm>
+#include <random>
+#include <stdexcept>
+
+struct TestBounds
+{
+	float center[3];
+	float extent[3];
+};
+
+//perspective projection in the layout of XMMatrixPerspectiveFovLH with the camera at
+//the origin looking along +z
+static Frustum MakeFrustum (float fov_y, float aspect, float near_z, float far_z)
+{
+	const float y_scale = 1.0f / tanf (fov_y * 0.5f);
+	const float range = far_z / (far_z - near_z);
+	const float view_projection[16] =
+	{
+		y_scale / aspect, 0.0f, 0.0f, 0.0f,
+		0.0f, y_scale, 0.0f, 0.0f,
+		0.0f, 0.0f, range, 1.0f,
+		0.0f, 0.0f, -range * near_z, 0.0f
+	};
+	return ExtractFrustum (view_projection);
+}
+
+static std::vector<TestBounds> MakeObjects (uint32_t count, uint32_t seed)
+{
+	std::mt19937 random (seed);
+	std::uniform_real_distribution<float> position (-200.0f, 200.0f);
+	std::uniform_real_distribution<float> size (0.1f, 8.0f);
+	std::vector<TestBounds> objects (count);
+	for (TestBounds &object : objects)
+		for (uint32_t c = 0; c < 3; c++)
+		{
+			object.center[c] = position (random);
+			object.extent[c] = size (random);
+		}
+	return objects;
+}
+
+static void SetBoxes (VisibilityScene &scene, const std::vector<TestBounds> &objects)
+{
+	for (uint32_t i = 0; i < objects.size (); i++)
+	{
+		float box_min[3], box_max[3];
+		for (uint32_t c = 0; c < 3; c++)
+		{
+			box_min[c] = objects[i].center[c] - objects[i].extent[c];
+			box_max[c] = objects[i].center[c] + objects[i].extent[c];
+		}
+		scene.SetBox (i, box_min, box_max);
+	}
+}
+
+//objects not entirely outside a plane, in double so borderline objects differ from the float kernels
+//only when they touch a plane within rounding
+static std::vector<uint32_t> ReferenceCull (const Frustum &frustum, const std::vector<TestBounds> &objects, CullVolume volume)
+{
+	std::vector<uint32_t> visible;
+	for (uint32_t i = 0; i < objects.size (); i++)
+	{
+		const TestBounds &object = objects[i];
+		const double radius = sqrt (static_cast<double>(object.extent[0]) * object.extent[0] + static_cast<double>(object.extent[1]) * object.extent[1] +
+									static_cast<double>(object.extent[2]) * object.extent[2]);
+		bool inside = true;
+		for (uint32_t p = 0; p < 6 && inside; p++)
+		{
+			const float *plane = frustum.planes[p];
+			double value = plane[0] * static_cast<double>(object.center[0]) + plane[1] * static_cast<double>(object.center[1]) +
+						   plane[2] * static_cast<double>(object.center[2]) + plane[3];
+			if (volume == CULL_VOLUME_SPHERE)
+				value += radius;
+			else
+				for (uint32_t c = 0; c < 3; c++)
+					value += fabs (plane[c]) * object.extent[c];
+			inside = value >= 0.0;
+		}
+		if (inside)
+			visible.push_back (i);
+	}
+	return visible;
+}
+
+static std::vector<uint32_t> Sorted (std::vector<uint32_t> values)
+{
+	std::sort (values.begin (), values.end ());
+	return values;
+}
+
+TEST (ExtractsNormalizedPlanes)
+{
+	const Frustum frustum = MakeFrustum (1.5707963f, 1.0f, 1.0f, 100.0f);
+	for (uint32_t p = 0; p < 6; p++)
+	{
+		const float *plane = frustum.planes[p];
+		CHECK (fabsf (plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2] - 1.0f) < 1e-5f);
+	}
+	//distance of a point to each plane, positive inside
+	auto distance = [&] (uint32_t p, float x, float y, float z)
+	{
+		const float *plane = frustum.planes[p];
+		return plane[0] * x + plane[1] * y + plane[2] * z + plane[3];
+	};
+	//near at z = 1, far at z = 100, the 90 degree sides through the diagonals
+	CHECK (fabsf (distance (4, 0.0f, 0.0f, 3.0f) - 2.0f) < 1e-4f);
+	CHECK (fabsf (distance (5, 0.0f, 0.0f, 40.0f) - 60.0f) < 1e-3f);
+	for (uint32_t p = 0; p < 4; p++)
+		CHECK (fabsf (distance (p, 0.0f, 0.0f, 10.0f) - 10.0f * sqrtf (0.5f)) < 1e-4f);
+	CHECK (distance (0, -11.0f, 0.0f, 10.0f) < 0.0f);
+	CHECK (distance (1, 11.0f, 0.0f, 10.0f) < 0.0f);
+	CHECK (distance (2, 0.0f, -11.0f, 10.0f) < 0.0f);
+	CHECK (distance (3, 0.0f, 11.0f, 10.0f) < 0.0f);
+}
+
+TEST (EveryLevelFindsTheSameObjects)
+{
+	const std::vector<TestBounds> objects = MakeObjects (10007, 1);
+	VisibilityScene scene;
+	scene.Resize (static_cast<uint32_t>(objects.size ()));
+	SetBoxes (scene, objects);
+	const Frustum frustum = MakeFrustum (1.2f, 1.5f, 0.5f, 150.0f);
+	CullOptions options;
+	options.hierarchy = false;
+	const CullVolume volumes[] = { CULL_VOLUME_SPHERE, CULL_VOLUME_BOX };
+	for (CullVolume volume : volumes)
+	{
+		options.volume = volume;
+		const std::vector<uint32_t> expected = ReferenceCull (frustum, objects, volume);
+		CHECK (expected.size () > 500 && expected.size () < objects.size () / 2);
+		std::vector<uint32_t> scalar;
+		options.level = CULL_SIMD_SCALAR;
+		CHECK_EQ (scene.Cull (frustum, options, scalar), expected.size ());
+		//without the hierarchy the objects come out in their order
+		CHECK (scalar == expected);
+		const CullSimdLevel levels[] = { CULL_SIMD_SSE2, CULL_SIMD_AVX };
+		for (CullSimdLevel level : levels)
+		{
+			if (level > GetCullSimdLevel ())
+				continue;
+			std::vector<uint32_t> visible;
+			options.level = level;
+			scene.Cull (frustum, options, visible);
+			CHECK (visible == scalar);
+		}
+	}
+	//boxes are tighter than their spheres
+	options.volume = CULL_VOLUME_SPHERE;
+	std::vector<uint32_t> spheres, boxes;
+	scene.Cull (frustum, options, spheres);
+	options.volume = CULL_VOLUME_BOX;
+	scene.Cull (frustum, options, boxes);
+	CHECK (boxes.size () < spheres.size ());
+	CHECK (std::includes (spheres.begin (), spheres.end (), boxes.begin (), boxes.end ()));
+}
+
+TEST (HierarchyRejectsSubtreesWithTheSameResult)
+{
+	const std::vector<TestBounds> objects = MakeObjects (20000, 2);
+	VisibilityScene scene;
+	scene.Resize (static_cast<uint32_t>(objects.size ()));
+	SetBoxes (scene, objects);
+	CHECK (!scene.IsHierarchyCurrent ());
+	scene.BuildHierarchy ();
+	CHECK (scene.IsHierarchyCurrent ());
+	CHECK (scene.GetNodeCount () >= 2 * (20000 / visibility_leaf_size) - 1);
+
+	//a narrow frustum sees a small part of the scene
+	const Frustum frustum = MakeFrustum (0.5f, 1.0f, 0.5f, 120.0f);
+	CullOptions options;
+	options.volume = CULL_VOLUME_BOX;
+	const std::vector<uint32_t> expected = ReferenceCull (frustum, objects, CULL_VOLUME_BOX);
+	std::vector<uint32_t> visible;
+	CullStats stats;
+	scene.Cull (frustum, options, visible, &stats);
+	CHECK (Sorted (visible) == expected);
+	CHECK_EQ (stats.visible, expected.size ());
+	//most objects are never looked at
+	CHECK (stats.tested_objects + stats.accepted_objects < objects.size () / 10);
+	CHECK (stats.tested_nodes < scene.GetNodeCount () / 4);
+
+	//spheres with the hierarchy land between boxes and spheres without it
+	options.volume = CULL_VOLUME_SPHERE;
+	scene.Cull (frustum, options, visible);
+	const std::vector<uint32_t> sphere_visible = Sorted (visible);
+	const std::vector<uint32_t> spheres = ReferenceCull (frustum, objects, CULL_VOLUME_SPHERE);
+	CHECK (std::includes (sphere_visible.begin (), sphere_visible.end (), expected.begin (), expected.end ()));
+	CHECK (std::includes (spheres.begin (), spheres.end (), sphere_visible.begin (), sphere_visible.end ()));
+
+	//a frustum around everything accepts whole subtrees without testing their objects
+	const Frustum wide = MakeFrustum (3.0f, 1.0f, 0.01f, 10000.0f);
+	std::vector<uint32_t> all;
+	VisibilityScene distant;
+	std::vector<TestBounds> ahead = objects;
+	for (TestBounds &object : ahead)
+		object.center[2] += 1000.0f;
+	distant.Resize (static_cast<uint32_t>(ahead.size ()));
+	SetBoxes (distant, ahead);
+	distant.BuildHierarchy ();
+	distant.Cull (wide, options, all, &stats);
+	CHECK_EQ (all.size (), objects.size ());
+	CHECK_EQ (stats.accepted_objects, objects.size ());
+	CHECK_EQ (stats.tested_objects, 0u);
+	CHECK_THROWS (scene.BuildHierarchy (0), std::invalid_argument);
+}
+
+TEST (RefitFollowsMovedObjects)
+{
+	std::vector<TestBounds> objects = MakeObjects (5000, 3);
+	VisibilityScene scene;
+	scene.Resize (static_cast<uint32_t>(objects.size ()));
+	SetBoxes (scene, objects);
+	scene.BuildHierarchy ();
+	const Frustum frustum = MakeFrustum (1.0f, 1.0f, 0.5f, 200.0f);
+	CullOptions options;
+	options.volume = CULL_VOLUME_BOX;
+
+	//move every object a little, the stale hierarchy is not used
+	std::mt19937 random (4);
+	std::uniform_real_distribution<float> step (-20.0f, 20.0f);
+	for (TestBounds &object : objects)
+		for (uint32_t c = 0; c < 3; c++)
+			object.center[c] += step (random);
+	SetBoxes (scene, objects);
+	CHECK (!scene.IsHierarchyCurrent ());
+	std::vector<uint32_t> visible;
+	CullStats stats;
+	scene.Cull (frustum, options, visible, &stats);
+	//the slots stay in hierarchy order
+	CHECK (Sorted (visible) == ReferenceCull (frustum, objects, CULL_VOLUME_BOX));
+	CHECK_EQ (stats.tested_objects, objects.size ());
+
+	scene.RefitHierarchy ();
+	CHECK (scene.IsHierarchyCurrent ());
+	scene.Cull (frustum, options, visible, &stats);
+	CHECK (Sorted (visible) == ReferenceCull (frustum, objects, CULL_VOLUME_BOX));
+	CHECK (stats.tested_objects < objects.size ());
+
+	//shrinking keeps the remaining objects
+	scene.Resize (1000);
+	objects.resize (1000);
+	CHECK (!scene.IsHierarchyCurrent ());
+	scene.Cull (frustum, options, visible);
+	CHECK (Sorted (visible) == ReferenceCull (frustum, objects, CULL_VOLUME_BOX));
+	const float center[3] = { 0.0f, 0.0f, 0.0f };
+	CHECK_THROWS (scene.SetSphere (1000, center, 1.0f), std::out_of_range);
+}
+
+TEST (ParallelCullingKeepsTheOrder)
+{
+	const std::vector<TestBounds> objects = MakeObjects (100000, 5);
+	VisibilityScene scene;
+	scene.Resize (static_cast<uint32_t>(objects.size ()));
+	SetBoxes (scene, objects);
+	JobSystem job_system (4);
+	const Frustum frustum = MakeFrustum (1.2f, 1.5f, 0.5f, 200.0f);
+	for (int hierarchy = 0; hierarchy < 2; hierarchy++)
+	{
+		if (hierarchy)
+			scene.BuildHierarchy ();
+		CullOptions options;
+		options.volume = CULL_VOLUME_BOX;
+		std::vector<uint32_t> serial, parallel;
+		CullStats serial_stats, parallel_stats;
+		scene.Cull (frustum, options, serial, &serial_stats);
+		options.job_system = &job_system;
+		scene.Cull (frustum, options, parallel, &parallel_stats);
+		CHECK (parallel == serial);
+		CHECK_EQ (parallel_stats.tested_objects, serial_stats.tested_objects);
+		CHECK_EQ (parallel_stats.tested_nodes, serial_stats.tested_nodes);
+		CHECK (Sorted (parallel) == ReferenceCull (frustum, objects, CULL_VOLUME_BOX));
+	}
+}
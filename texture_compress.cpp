@@ -0,0 +1,1180 @@
+#include "texture_compress.h"
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <stdexcept>
+
+//power iterations of the principal axis and least squares passes by quality; the fast
+//level fits a bounding box instead of the axis
+static const uint32_t axis_iterations[TEXTURE_QUALITY_COUNT] = { 0, 6, 10 };
+static const uint32_t refine_iterations[TEXTURE_QUALITY_COUNT] = { 0, 1, 3 };
+//passes of the neighbouring endpoint search of the high level
+static const uint32_t search_passes = 2;
+//range of the BC4 endpoint search of the high level
+static const int bc4_search_range = 4;
+
+//BC7 interpolation weights of 2 and 4 bit indices, out of 64
+static const int bc7_weights2[4] = { 0, 21, 43, 64 };
+static const int bc7_weights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+const char *GetTextureEncodingName (TextureEncoding encoding)
+{
+	static const char *const names[TEXTURE_ENCODING_COUNT] = { "RGBA8", "BC1", "BC3", "BC4", "BC5", "BC7" };
+	if (encoding >= TEXTURE_ENCODING_COUNT)
+		throw std::out_of_range ("Unknown texture encoding");
+	return names[encoding];
+}
+
+const char *GetTextureQualityName (TextureQuality quality)
+{
+	static const char *const names[TEXTURE_QUALITY_COUNT] = { "fast", "normal", "high" };
+	if (quality >= TEXTURE_QUALITY_COUNT)
+		throw std::out_of_range ("Unknown texture quality");
+	return names[quality];
+}
+
+uint32_t GetTextureEncodingFormat (TextureEncoding encoding, bool srgb)
+{
+	switch (encoding)
+	{
+	case TEXTURE_ENCODING_RGBA8:
+		return srgb ? texture_format_rgba8_srgb : texture_format_rgba8;
+	case TEXTURE_ENCODING_BC1:
+		return srgb ? texture_format_bc1_srgb : texture_format_bc1;
+	case TEXTURE_ENCODING_BC3:
+		return srgb ? texture_format_bc3_srgb : texture_format_bc3;
+	case TEXTURE_ENCODING_BC4:
+	case TEXTURE_ENCODING_BC5:
+		if (srgb)
+			throw std::invalid_argument ("BC4 and BC5 have no sRGB formats");
+		return encoding == TEXTURE_ENCODING_BC4 ? texture_format_bc4 : texture_format_bc5;
+	case TEXTURE_ENCODING_BC7:
+		return srgb ? texture_format_bc7_srgb : texture_format_bc7;
+	default:
+		throw std::out_of_range ("Unknown texture encoding");
+	}
+}
+
+uint32_t GetTextureEncodingChannels (TextureEncoding encoding)
+{
+	switch (encoding)
+	{
+	case TEXTURE_ENCODING_BC1:
+		return 0x7;
+	case TEXTURE_ENCODING_BC4:
+		return 0x1;
+	case TEXTURE_ENCODING_BC5:
+		return 0x3;
+	default:
+		return 0xf;
+	}
+}
+
+namespace
+{
+	struct PixelBlock
+	{
+		uint8_t pixels[16][4];
+	};
+
+	//BC blocks store their fields from the lowest bit up
+	class BlockWriter
+	{
+	public:
+		BlockWriter () :
+			position (0)
+		{
+			memset (bytes, 0, sizeof (bytes));
+		}
+		void Write (uint32_t value, uint32_t count)
+		{
+			for (uint32_t i = 0; i < count; i++, position++)
+				bytes[position >> 3] |= ((value >> i) & 1) << (position & 7);
+		}
+		const uint8_t *GetBytes () const
+		{
+			return bytes;
+		}
+	private:
+		uint8_t bytes[16];
+		uint32_t position;
+	};
+
+	class BlockReader
+	{
+	public:
+		explicit BlockReader (const uint8_t *block_bytes) :
+			bytes (block_bytes),
+			position (0)
+		{
+		}
+		uint32_t Read (uint32_t count)
+		{
+			uint32_t value = 0;
+			for (uint32_t i = 0; i < count; i++, position++)
+				value |= ((bytes[position >> 3] >> (position & 7)) & 1u) << i;
+			return value;
+		}
+	private:
+		const uint8_t *bytes;
+		uint32_t position;
+	};
+
+	//quantized endpoints and indices of a BC1 colour block, endpoints in either order
+	struct ColorFit
+	{
+		uint16_t c0;
+		uint16_t c1;
+		uint8_t indices[16];
+		int error;
+	};
+
+	//BC7 mode 6: rgba endpoints of 7 bits and a p-bit each, as 8 bit values
+	struct Mode6Fit
+	{
+		int endpoints[2][4];
+		uint8_t indices[16];
+		int error;
+	};
+
+	//BC7 mode 5: rgb endpoints of 7 bits and alpha endpoints of 8 bits
+	struct Mode5Fit
+	{
+		int colors[2][3];           //7 bit values
+		int alphas[2];
+		uint8_t color_indices[16];
+		uint8_t alpha_indices[16];
+		int error;
+	};
+}
+
+static void LoadBlock (const TextureImage &image, uint32_t block_x, uint32_t block_y, PixelBlock &block)
+{
+	for (uint32_t y = 0; y < 4; y++)
+	{
+		const uint32_t source_y = std::min (block_y * 4 + y, image.height - 1);
+		for (uint32_t x = 0; x < 4; x++)
+			memcpy (block.pixels[y * 4 + x], image.GetPixel (std::min (block_x * 4 + x, image.width - 1), source_y), 4);
+	}
+}
+
+static float Clamp255 (float value)
+{
+	value = value > 0.0f ? value : 0.0f;
+	return value < 255.0f ? value : 255.0f;
+}
+
+//Endpoint fitting over count points of dims channels
+
+//mean and unit principal axis by power iteration; a zero axis for constant points
+static void FitAxis (const float points[16][4], uint32_t count, uint32_t dims, uint32_t iterations, float mean[4], float axis[4])
+{
+	for (uint32_t c = 0; c < 4; c++)
+		mean[c] = axis[c] = 0.0f;
+	for (uint32_t i = 0; i < count; i++)
+		for (uint32_t c = 0; c < dims; c++)
+			mean[c] += points[i][c];
+	for (uint32_t c = 0; c < dims; c++)
+		mean[c] /= count;
+
+	float covariance[4][4] = {};
+	for (uint32_t i = 0; i < count; i++)
+		for (uint32_t a = 0; a < dims; a++)
+			for (uint32_t b = a; b < dims; b++)
+				covariance[a][b] += (points[i][a] - mean[a]) * (points[i][b] - mean[b]);
+	for (uint32_t a = 0; a < dims; a++)
+		for (uint32_t b = 0; b < a; b++)
+			covariance[a][b] = covariance[b][a];
+
+	//the covariance row of the channel of largest variance starts close to the axis
+	uint32_t largest = 0;
+	for (uint32_t c = 1; c < dims; c++)
+		if (covariance[c][c] > covariance[largest][largest])
+			largest = c;
+	if (covariance[largest][largest] <= 0.0f)
+		return;
+	float vector[4];
+	for (uint32_t c = 0; c < 4; c++)
+		vector[c] = covariance[largest][c];
+	for (uint32_t iteration = 0; iteration < iterations; iteration++)
+	{
+		float next[4] = {};
+		float scale = 0.0f;
+		for (uint32_t a = 0; a < dims; a++)
+		{
+			for (uint32_t b = 0; b < dims; b++)
+				next[a] += covariance[a][b] * vector[b];
+			scale = std::max (scale, fabsf (next[a]));
+		}
+		if (scale <= 0.0f)
+			break;
+		for (uint32_t c = 0; c < dims; c++)
+			vector[c] = next[c] / scale;
+	}
+	float length = 0.0f;
+	for (uint32_t c = 0; c < dims; c++)
+		length += vector[c] * vector[c];
+	length = sqrtf (length);
+	if (length <= 0.0f)
+		return;
+	for (uint32_t c = 0; c < dims; c++)
+		axis[c] = vector[c] / length;
+}
+
+//the extreme projections of the points on their principal axis
+static void FitAxisEndpoints (const float points[16][4], uint32_t count, uint32_t dims, uint32_t iterations, float e0[4], float e1[4])
+{
+	float mean[4], axis[4];
+	FitAxis (points, count, dims, iterations, mean, axis);
+	float low = 0.0f, high = 0.0f;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		float t = 0.0f;
+		for (uint32_t c = 0; c < dims; c++)
+			t += (points[i][c] - mean[c]) * axis[c];
+		low = std::min (low, t);
+		high = std::max (high, t);
+	}
+	for (uint32_t c = 0; c < 4; c++)
+	{
+		e0[c] = Clamp255 (mean[c] + axis[c] * low);
+		e1[c] = Clamp255 (mean[c] + axis[c] * high);
+	}
+}
+
+//the bounding box diagonal that follows the correlation of each channel with the first,
+//inset by 1/16 of the box since the extremes are rarely hit exactly
+static void FitBoxEndpoints (const float points[16][4], uint32_t count, uint32_t dims, float e0[4], float e1[4])
+{
+	float low[4], high[4], mean[4];
+	for (uint32_t c = 0; c < 4; c++)
+	{
+		low[c] = 255.0f;
+		high[c] = mean[c] = 0.0f;
+	}
+	for (uint32_t i = 0; i < count; i++)
+		for (uint32_t c = 0; c < dims; c++)
+		{
+			low[c] = std::min (low[c], points[i][c]);
+			high[c] = std::max (high[c], points[i][c]);
+			mean[c] += points[i][c];
+		}
+	for (uint32_t c = 0; c < dims; c++)
+		mean[c] /= count;
+	for (uint32_t c = 1; c < dims; c++)
+	{
+		float covariance = 0.0f;
+		for (uint32_t i = 0; i < count; i++)
+			covariance += (points[i][0] - mean[0]) * (points[i][c] - mean[c]);
+		if (covariance < 0.0f)
+			std::swap (low[c], high[c]);
+	}
+	for (uint32_t c = 0; c < 4; c++)
+	{
+		const float inset = c < dims ? (high[c] - low[c]) / 16.0f : 0.0f;
+		e0[c] = c < dims ? low[c] + inset : 0.0f;
+		e1[c] = c < dims ? high[c] - inset : 0.0f;
+	}
+}
+
+//endpoints minimizing the squared error of the points reconstructed as
+//e0 * (1 - t) + e1 * t with the interpolation position t of each point; false if the
+//positions do not determine them
+static bool SolveEndpoints (const float points[16][4], const float t[16], uint32_t count, uint32_t dims, float e0[4], float e1[4])
+{
+	float a = 0.0f, b = 0.0f, c = 0.0f;
+	float d0[4] = {}, d1[4] = {};
+	for (uint32_t i = 0; i < count; i++)
+	{
+		const float s = 1.0f - t[i];
+		a += s * s;
+		b += s * t[i];
+		c += t[i] * t[i];
+		for (uint32_t k = 0; k < dims; k++)
+		{
+			d0[k] += s * points[i][k];
+			d1[k] += t[i] * points[i][k];
+		}
+	}
+	const float determinant = a * c - b * b;
+	if (fabsf (determinant) < 1e-6f)
+		return false;
+	for (uint32_t k = 0; k < dims; k++)
+	{
+		e0[k] = Clamp255 ((c * d0[k] - b * d1[k]) / determinant);
+		e1[k] = Clamp255 ((a * d1[k] - b * d0[k]) / determinant);
+	}
+	return true;
+}
+
+static int Square (int value)
+{
+	return value * value;
+}
+
+//BC1 colour blocks
+
+static uint16_t Pack565 (const float color[3])
+{
+	const uint32_t r = static_cast<uint32_t>(Clamp255 (color[0]) * (31.0f / 255.0f) + 0.5f);
+	const uint32_t g = static_cast<uint32_t>(Clamp255 (color[1]) * (63.0f / 255.0f) + 0.5f);
+	const uint32_t b = static_cast<uint32_t>(Clamp255 (color[2]) * (31.0f / 255.0f) + 0.5f);
+	return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+}
+
+static void Unpack565 (uint16_t packed, int color[3])
+{
+	const int r = packed >> 11;
+	const int g = (packed >> 5) & 0x3f;
+	const int b = packed & 0x1f;
+	color[0] = (r << 3) | (r >> 2);
+	color[1] = (g << 2) | (g >> 4);
+	color[2] = (b << 3) | (b >> 2);
+}
+
+//4 colours, or 3 and transparent black
+static void MakeBc1Palette (uint16_t c0, uint16_t c1, bool four_colors, int palette[4][3])
+{
+	Unpack565 (c0, palette[0]);
+	Unpack565 (c1, palette[1]);
+	for (uint32_t c = 0; c < 3; c++)
+	{
+		if (four_colors)
+		{
+			palette[2][c] = (2 * palette[0][c] + palette[1][c] + 1) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c] + 1) / 3;
+		}
+		else
+		{
+			palette[2][c] = (palette[0][c] + palette[1][c] + 1) / 2;
+			palette[3][c] = 0;
+		}
+	}
+}
+
+//picks the indices of fit.c0 and fit.c1 and returns the error; transparent pixels get index 3
+static int EvaluateBc1 (const PixelBlock &block, uint32_t transparent_mask, bool four_colors, ColorFit &fit)
+{
+	int palette[4][3];
+	MakeBc1Palette (fit.c0, fit.c1, four_colors, palette);
+	const uint32_t palette_size = four_colors ? 4 : 3;
+	int error = 0;
+	for (uint32_t i = 0; i < 16; i++)
+	{
+		if (transparent_mask & (1u << i))
+		{
+			fit.indices[i] = 3;
+			continue;
+		}
+		int best = 0x7fffffff;
+		for (uint32_t p = 0; p < palette_size; p++)
+		{
+			const int distance = Square (block.pixels[i][0] - palette[p][0]) + Square (block.pixels[i][1] - palette[p][1]) +
+								 Square (block.pixels[i][2] - palette[p][2]);
+			if (distance < best)
+			{
+				best = distance;
+				fit.indices[i] = static_cast<uint8_t>(p);
+			}
+		}
+		error += best;
+	}
+	fit.error = error;
+	return error;
+}
+
+//tries every 565 component of the endpoints one step up and down, keeping improvements
+static void SearchBc1 (const PixelBlock &block, uint32_t transparent_mask, bool four_colors, ColorFit &fit)
+{
+	static const uint16_t fields[3][2] = { { 11, 0x1f }, { 5, 0x3f }, { 0, 0x1f } };
+	for (uint32_t pass = 0; pass < search_passes; pass++)
+	{
+		bool improved = false;
+		for (uint32_t endpoint = 0; endpoint < 2; endpoint++)
+			for (uint32_t field = 0; field < 3; field++)
+				for (int step = -1; step <= 1; step += 2)
+				{
+					ColorFit candidate = fit;
+					uint16_t &color = endpoint ? candidate.c1 : candidate.c0;
+					const int value = ((color >> fields[field][0]) & fields[field][1]) + step;
+					if (value < 0 || value > fields[field][1])
+						continue;
+					color = static_cast<uint16_t>((color & ~(fields[field][1] << fields[field][0])) | (value << fields[field][0]));
+					if (EvaluateBc1 (block, transparent_mask, four_colors, candidate) < fit.error)
+					{
+						fit = candidate;
+						improved = true;
+					}
+				}
+		if (!improved)
+			break;
+	}
+}
+
+//the encoder of BC1 blocks and of the colour half of BC3 blocks, which never use
+//transparency
+static void EncodeBc1Color (const PixelBlock &block, TextureQuality quality, bool allow_transparency, uint8_t *dst)
+{
+	float points[16][4];
+	uint32_t point_pixels[16];
+	uint32_t count = 0;
+	uint32_t transparent_mask = 0;
+	for (uint32_t i = 0; i < 16; i++)
+	{
+		if (allow_transparency && block.pixels[i][3] < 128)
+		{
+			transparent_mask |= 1u << i;
+			continue;
+		}
+		for (uint32_t c = 0; c < 4; c++)
+			points[count][c] = block.pixels[i][c];
+		point_pixels[count++] = i;
+	}
+
+	ColorFit fit;
+	const bool four_colors = !transparent_mask;
+	if (!count)
+	{
+		fit.c0 = fit.c1 = 0;
+		memset (fit.indices, 3, sizeof (fit.indices));
+	}
+	else
+	{
+		float e0[4], e1[4];
+		if (quality == TEXTURE_QUALITY_FAST)
+			FitBoxEndpoints (points, count, 3, e0, e1);
+		else
+			FitAxisEndpoints (points, count, 3, axis_iterations[quality], e0, e1);
+		fit.c0 = Pack565 (e0);
+		fit.c1 = Pack565 (e1);
+		EvaluateBc1 (block, transparent_mask, four_colors, fit);
+
+		//interpolation position of each index between c0 and c1
+		static const float positions[2][4] = { { 0.0f, 1.0f, 0.5f, 0.0f }, { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f } };
+		for (uint32_t iteration = 0; iteration < refine_iterations[quality] && fit.error; iteration++)
+		{
+			float t[16];
+			for (uint32_t i = 0; i < count; i++)
+				t[i] = positions[four_colors][fit.indices[point_pixels[i]]];
+			if (!SolveEndpoints (points, t, count, 3, e0, e1))
+				break;
+			ColorFit candidate = fit;
+			candidate.c0 = Pack565 (e0);
+			candidate.c1 = Pack565 (e1);
+			if (EvaluateBc1 (block, transparent_mask, four_colors, candidate) >= fit.error)
+				break;
+			fit = candidate;
+		}
+		if (quality == TEXTURE_QUALITY_HIGH && fit.error)
+			SearchBc1 (block, transparent_mask, four_colors, fit);
+	}
+
+	//4 colour blocks need c0 > c1 and 3 colour blocks c0 <= c1; swapping the endpoints
+	//swaps index 0 with 1 and 2 with 3 of 4 colours
+	if (four_colors && fit.c0 < fit.c1)
+	{
+		std::swap (fit.c0, fit.c1);
+		for (uint32_t i = 0; i < 16; i++)
+			fit.indices[i] ^= 1;
+	}
+	else if (four_colors && fit.c0 == fit.c1)
+		memset (fit.indices, 0, sizeof (fit.indices));
+	else if (!four_colors && fit.c0 > fit.c1)
+	{
+		std::swap (fit.c0, fit.c1);
+		for (uint32_t i = 0; i < 16; i++)
+			if (fit.indices[i] < 2)
+				fit.indices[i] ^= 1;
+	}
+	uint32_t indices = 0;
+	for (uint32_t i = 0; i < 16; i++)
+		indices |= static_cast<uint32_t>(fit.indices[i]) << (i * 2);
+	memcpy (dst, &fit.c0, 2);
+	memcpy (dst + 2, &fit.c1, 2);
+	memcpy (dst + 4, &indices, 4);
+}
+
+static void DecodeBc1Color (const uint8_t *src, bool allow_transparency, uint8_t pixels[16][4])
+{
+	uint16_t c0, c1;
+	uint32_t indices;
+	memcpy (&c0, src, 2);
+	memcpy (&c1, src + 2, 2);
+	memcpy (&indices, src + 4, 4);
+	const bool four_colors = !allow_transparency || c0 > c1;
+	int palette[4][3];
+	MakeBc1Palette (c0, c1, four_colors, palette);
+	for (uint32_t i = 0; i < 16; i++)
+	{
+		const uint32_t index = (indices >> (i * 2)) & 3;
+		for (uint32_t c = 0; c < 3; c++)
+			pixels[i][c] = static_cast<uint8_t>(palette[index][c]);
+		pixels[i][3] = !four_colors && index == 3 ? 0 : 255;
+	}
+}
+
+//BC4 single channel blocks
+
+//8 values if a0 > a1, else 6 values, 0 and 255
+static void MakeBc4Palette (int a0, int a1, int palette[8])
+{
+	palette[0] = a0;
+	palette[1] = a1;
+	if (a0 > a1)
+	{
+		for (int i = 1; i < 7; i++)
+			palette[i + 1] = ((7 - i) * a0 + i * a1 + 3) / 7;
+	}
+	else
+	{
+		for (int i = 1; i < 5; i++)
+			palette[i + 1] = ((5 - i) * a0 + i * a1 + 2) / 5;
+		palette[6] = 0;
+		palette[7] = 255;
+	}
+}
+
+static int EvaluateBc4 (const uint8_t values[16], int a0, int a1, uint8_t indices[16])
+{
+	int palette[8];
+	MakeBc4Palette (a0, a1, palette);
+	int error = 0;
+	for (uint32_t i = 0; i < 16; i++)
+	{
+		int best = 0x7fffffff;
+		for (uint32_t p = 0; p < 8; p++)
+		{
+			const int distance = Square (values[i] - palette[p]);
+			if (distance < best)
+			{
+				best = distance;
+				indices[i] = static_cast<uint8_t>(p);
+			}
+		}
+		error += best;
+	}
+	return error;
+}
+
+static void EncodeBc4 (const uint8_t values[16], TextureQuality quality, uint8_t *dst)
+{
+	int low = 255, high = 0;
+	//without the extremes, for the 6 value mode that has 0 and 255 in its palette
+	int inner_low = 255, inner_high = 0;
+	for (uint32_t i = 0; i < 16; i++)
+	{
+		low = std::min<int> (low, values[i]);
+		high = std::max<int> (high, values[i]);
+		if (values[i] != 0 && values[i] != 255)
+		{
+			inner_low = std::min<int> (inner_low, values[i]);
+			inner_high = std::max<int> (inner_high, values[i]);
+		}
+	}
+
+	uint8_t indices[16], candidate[16];
+	int a0 = high, a1 = low;
+	int error = EvaluateBc4 (values, a0, a1, indices);
+	if (quality != TEXTURE_QUALITY_FAST && error && inner_low <= inner_high)
+	{
+		const int six_error = EvaluateBc4 (values, inner_low, inner_high, candidate);
+		if (six_error < error)
+		{
+			error = six_error;
+			a0 = inner_low;
+			a1 = inner_high;
+			memcpy (indices, candidate, sizeof (indices));
+		}
+	}
+	if (quality == TEXTURE_QUALITY_HIGH && error)
+	{
+		//moves the endpoints of the chosen mode inwards
+		const bool eight = a0 > a1;
+		const int base0 = a0, base1 = a1;
+		for (int d0 = 0; d0 <= bc4_search_range; d0++)
+			for (int d1 = 0; d1 <= bc4_search_range; d1++)
+			{
+				const int c0 = eight ? base0 - d0 : base0 + d0;
+				const int c1 = eight ? base1 + d1 : base1 - d1;
+				if (eight ? c0 <= c1 : c0 > c1)
+					continue;
+				const int candidate_error = EvaluateBc4 (values, c0, c1, candidate);
+				if (candidate_error < error)
+				{
+					error = candidate_error;
+					a0 = c0;
+					a1 = c1;
+					memcpy (indices, candidate, sizeof (indices));
+				}
+			}
+	}
+
+	uint64_t bits = 0;
+	for (uint32_t i = 0; i < 16; i++)
+		bits |= static_cast<uint64_t>(indices[i]) << (i * 3);
+	dst[0] = static_cast<uint8_t>(a0);
+	dst[1] = static_cast<uint8_t>(a1);
+	for (uint32_t i = 0; i < 6; i++)
+		dst[2 + i] = static_cast<uint8_t>(bits >> (i * 8));
+}
+
+static void DecodeBc4 (const uint8_t *src, uint8_t values[16])
+{
+	int palette[8];
+	MakeBc4Palette (src[0], src[1], palette);
+	uint64_t bits = 0;
+	for (uint32_t i = 0; i < 6; i++)
+		bits |= static_cast<uint64_t>(src[2 + i]) << (i * 8);
+	for (uint32_t i = 0; i < 16; i++)
+		values[i] = static_cast<uint8_t>(palette[(bits >> (i * 3)) & 7]);
+}
+
+//BC7
+
+static int Bc7Interpolate (int e0, int e1, int weight)
+{
+	return ((64 - weight) * e0 + weight * e1 + 32) >> 6;
+}
+
+static int EvaluateMode6 (const PixelBlock &block, Mode6Fit &fit)
+{
+	int palette[16][4];
+	for (uint32_t p = 0; p < 16; p++)
+		for (uint32_t c = 0; c < 4; c++)
+			palette[p][c] = Bc7Interpolate (fit.endpoints[0][c], fit.endpoints[1][c], bc7_weights4[p]);
+	int error = 0;
+	for (uint32_t i = 0; i < 16; i++)
+	{
+		int best = 0x7fffffff;
+		for (uint32_t p = 0; p < 16; p++)
+		{
+			int distance = 0;
+			for (uint32_t c = 0; c < 4; c++)
+				distance += Square (block.pixels[i][c] - palette[p][c]);
+			if (distance < best)
+			{
+				best = distance;
+				fit.indices[i] = static_cast<uint8_t>(p);
+			}
+		}
+		error += best;
+	}
+	fit.error = error;
+	return error;
+}
+
+//a 7 bit value and p-bit per channel as an 8 bit value; returns the squared error
+static int QuantizeMode6Endpoint (const float value[4], int p_bit, int endpoint[4])
+{
+	int error = 0;
+	for (uint32_t c = 0; c < 4; c++)
+	{
+		const int quantized = std::min (std::max (static_cast<int>((value[c] - p_bit) * 0.5f + 0.5f), 0), 127);
+		endpoint[c] = (quantized << 1) | p_bit;
+		error += Square (endpoint[c] - static_cast<int>(value[c] + 0.5f));
+	}
+	return error;
+}
+
+//the p-bits of each endpoint on their own, or all four combinations on the whole block
+static void QuantizeMode6 (const PixelBlock &block, const float e0[4], const float e1[4], bool search_p_bits, Mode6Fit &fit)
+{
+	const float *const values[2] = { e0, e1 };
+	if (!search_p_bits)
+	{
+		for (uint32_t e = 0; e < 2; e++)
+		{
+			int zero[4], one[4];
+			if (QuantizeMode6Endpoint (values[e], 0, zero) <= QuantizeMode6Endpoint (values[e], 1, one))
+				memcpy (fit.endpoints[e], zero, sizeof (zero));
+			else
+				memcpy (fit.endpoints[e], one, sizeof (one));
+		}
+		EvaluateMode6 (block, fit);
+		return;
+	}
+	fit.error = 0x7fffffff;
+	for (int p = 0; p < 4; p++)
+	{
+		Mode6Fit candidate;
+		QuantizeMode6Endpoint (e0, p & 1, candidate.endpoints[0]);
+		QuantizeMode6Endpoint (e1, p >> 1, candidate.endpoints[1]);
+		if (EvaluateMode6 (block, candidate) < fit.error)
+			fit = candidate;
+	}
+}
+
+static void FitMode6 (const PixelBlock &block, TextureQuality quality, Mode6Fit &fit)
+{
+	float points[16][4];
+	for (uint32_t i = 0; i < 16; i++)
+		for (uint32_t c = 0; c < 4; c++)
+			points[i][c] = block.pixels[i][c];
+	float e0[4], e1[4];
+	if (quality == TEXTURE_QUALITY_FAST)
+		FitBoxEndpoints (points, 16, 4, e0, e1);
+	else
+		FitAxisEndpoints (points, 16, 4, axis_iterations[quality], e0, e1);
+	const bool search_p_bits = quality != TEXTURE_QUALITY_FAST;
+	QuantizeMode6 (block, e0, e1, search_p_bits, fit);
+
+	for (uint32_t iteration = 0; iteration < refine_iterations[quality] && fit.error; iteration++)
+	{
+		float t[16];
+		for (uint32_t i = 0; i < 16; i++)
+			t[i] = bc7_weights4[fit.indices[i]] / 64.0f;
+		if (!SolveEndpoints (points, t, 16, 4, e0, e1))
+			break;
+		Mode6Fit candidate;
+		QuantizeMode6 (block, e0, e1, search_p_bits, candidate);
+		if (candidate.error >= fit.error)
+			break;
+		fit = candidate;
+	}
+
+	if (quality != TEXTURE_QUALITY_HIGH)
+		return;
+	//one 7 bit step keeps the p-bit
+	for (uint32_t pass = 0; pass < search_passes && fit.error; pass++)
+	{
+		bool improved = false;
+		for (uint32_t e = 0; e < 2; e++)
+			for (uint32_t c = 0; c < 4; c++)
+				for (int step = -2; step <= 2; step += 4)
+				{
+					Mode6Fit candidate = fit;
+					const int value = candidate.endpoints[e][c] + step;
+					if (value < 0 || value > 255)
+						continue;
+					candidate.endpoints[e][c] = value;
+					if (EvaluateMode6 (block, candidate) < fit.error)
+					{
+						fit = candidate;
+						improved = true;
+					}
+				}
+		if (!improved)
+			break;
+	}
+}
+
+static void PackMode6 (Mode6Fit fit, uint8_t *dst)
+{
+	//the anchor index is stored without its top bit, which must be 0
+	if (fit.indices[0] & 8)
+	{
+		for (uint32_t c = 0; c < 4; c++)
+			std::swap (fit.endpoints[0][c], fit.endpoints[1][c]);
+		for (uint32_t i = 0; i < 16; i++)
+			fit.indices[i] = static_cast<uint8_t>(15 - fit.indices[i]);
+	}
+	BlockWriter writer;
+	writer.Write (1 << 6, 7);
+	for (uint32_t c = 0; c < 4; c++)
+	{
+		writer.Write (fit.endpoints[0][c] >> 1, 7);
+		writer.Write (fit.endpoints[1][c] >> 1, 7);
+	}
+	writer.Write (fit.endpoints[0][0] & 1, 1);
+	writer.Write (fit.endpoints[1][0] & 1, 1);
+	writer.Write (fit.indices[0], 3);
+	for (uint32_t i = 1; i < 16; i++)
+		writer.Write (fit.indices[i], 4);
+	memcpy (dst, writer.GetBytes (), 16);
+}
+
+static int Expand7 (int value)
+{
+	return (value << 1) | (value >> 6);
+}
+
+static int EvaluateMode5Color (const PixelBlock &block, Mode5Fit &fit)
+{
+	int palette[4][3];
+	for (uint32_t p = 0; p < 4; p++)
+		for (uint32_t c = 0; c < 3; c++)
+			palette[p][c] = Bc7Interpolate (Expand7 (fit.colors[0][c]), Expand7 (fit.colors[1][c]), bc7_weights2[p]);
+	int error = 0;
+	for (uint32_t i = 0; i < 16; i++)
+	{
+		int best = 0x7fffffff;
+		for (uint32_t p = 0; p < 4; p++)
+		{
+			const int distance = Square (block.pixels[i][0] - palette[p][0]) + Square (block.pixels[i][1] - palette[p][1]) +
+								 Square (block.pixels[i][2] - palette[p][2]);
+			if (distance < best)
+			{
+				best = distance;
+				fit.color_indices[i] = static_cast<uint8_t>(p);
+			}
+		}
+		error += best;
+	}
+	return error;
+}
+
+static int EvaluateMode5Alpha (const PixelBlock &block, Mode5Fit &fit)
+{
+	int error = 0;
+	for (uint32_t i = 0; i < 16; i++)
+	{
+		int best = 0x7fffffff;
+		for (uint32_t p = 0; p < 4; p++)
+		{
+			const int distance = Square (block.pixels[i][3] - Bc7Interpolate (fit.alphas[0], fit.alphas[1], bc7_weights2[p]));
+			if (distance < best)
+			{
+				best = distance;
+				fit.alpha_indices[i] = static_cast<uint8_t>(p);
+			}
+		}
+		error += best;
+	}
+	return error;
+}
+
+static void QuantizeMode5Colors (const float e0[4], const float e1[4], Mode5Fit &fit)
+{
+	for (uint32_t c = 0; c < 3; c++)
+	{
+		fit.colors[0][c] = static_cast<int>(Clamp255 (e0[c]) * (127.0f / 255.0f) + 0.5f);
+		fit.colors[1][c] = static_cast<int>(Clamp255 (e1[c]) * (127.0f / 255.0f) + 0.5f);
+	}
+}
+
+//colour and alpha are fitted separately; only used by the high level
+static void FitMode5 (const PixelBlock &block, TextureQuality quality, Mode5Fit &fit)
+{
+	float points[16][4];
+	int alpha_low = 255, alpha_high = 0;
+	for (uint32_t i = 0; i < 16; i++)
+	{
+		for (uint32_t c = 0; c < 4; c++)
+			points[i][c] = block.pixels[i][c];
+		alpha_low = std::min<int> (alpha_low, block.pixels[i][3]);
+		alpha_high = std::max<int> (alpha_high, block.pixels[i][3]);
+	}
+	float e0[4], e1[4];
+	FitAxisEndpoints (points, 16, 3, axis_iterations[quality], e0, e1);
+	QuantizeMode5Colors (e0, e1, fit);
+	int color_error = EvaluateMode5Color (block, fit);
+	for (uint32_t iteration = 0; iteration < refine_iterations[quality] && color_error; iteration++)
+	{
+		float t[16];
+		for (uint32_t i = 0; i < 16; i++)
+			t[i] = bc7_weights2[fit.color_indices[i]] / 64.0f;
+		if (!SolveEndpoints (points, t, 16, 3, e0, e1))
+			break;
+		Mode5Fit candidate = fit;
+		QuantizeMode5Colors (e0, e1, candidate);
+		const int candidate_error = EvaluateMode5Color (block, candidate);
+		if (candidate_error >= color_error)
+			break;
+		fit = candidate;
+		color_error = candidate_error;
+	}
+
+	fit.alphas[0] = alpha_low;
+	fit.alphas[1] = alpha_high;
+	int alpha_error = EvaluateMode5Alpha (block, fit);
+	if (alpha_error)
+	{
+		float alpha_points[16][4];
+		float t[16];
+		for (uint32_t i = 0; i < 16; i++)
+		{
+			alpha_points[i][0] = block.pixels[i][3];
+			t[i] = bc7_weights2[fit.alpha_indices[i]] / 64.0f;
+		}
+		if (SolveEndpoints (alpha_points, t, 16, 1, e0, e1))
+		{
+			Mode5Fit candidate = fit;
+			candidate.alphas[0] = static_cast<int>(e0[0] + 0.5f);
+			candidate.alphas[1] = static_cast<int>(e1[0] + 0.5f);
+			const int candidate_error = EvaluateMode5Alpha (block, candidate);
+			if (candidate_error < alpha_error)
+			{
+				fit = candidate;
+				alpha_error = candidate_error;
+			}
+		}
+	}
+	//the indices of the evaluations above that were kept
+	EvaluateMode5Color (block, fit);
+	EvaluateMode5Alpha (block, fit);
+	fit.error = color_error + alpha_error;
+}
+
+static void PackMode5 (Mode5Fit fit, uint8_t *dst)
+{
+	//both anchor indices are stored without their top bit
+	if (fit.color_indices[0] & 2)
+	{
+		for (uint32_t c = 0; c < 3; c++)
+			std::swap (fit.colors[0][c], fit.colors[1][c]);
+		for (uint32_t i = 0; i < 16; i++)
+			fit.color_indices[i] = static_cast<uint8_t>(3 - fit.color_indices[i]);
+	}
+	if (fit.alpha_indices[0] & 2)
+	{
+		std::swap (fit.alphas[0], fit.alphas[1]);
+		for (uint32_t i = 0; i < 16; i++)
+			fit.alpha_indices[i] = static_cast<uint8_t>(3 - fit.alpha_indices[i]);
+	}
+	BlockWriter writer;
+	writer.Write (1 << 5, 6);
+	//no channel rotation
+	writer.Write (0, 2);
+	for (uint32_t c = 0; c < 3; c++)
+	{
+		writer.Write (fit.colors[0][c], 7);
+		writer.Write (fit.colors[1][c], 7);
+	}
+	writer.Write (fit.alphas[0], 8);
+	writer.Write (fit.alphas[1], 8);
+	writer.Write (fit.color_indices[0], 1);
+	for (uint32_t i = 1; i < 16; i++)
+		writer.Write (fit.color_indices[i], 2);
+	writer.Write (fit.alpha_indices[0], 1);
+	for (uint32_t i = 1; i < 16; i++)
+		writer.Write (fit.alpha_indices[i], 2);
+	memcpy (dst, writer.GetBytes (), 16);
+}
+
+static void EncodeBc7 (const PixelBlock &block, TextureQuality quality, uint8_t *dst)
+{
+	Mode6Fit mode6;
+	FitMode6 (block, quality, mode6);
+	if (quality == TEXTURE_QUALITY_HIGH && mode6.error)
+	{
+		Mode5Fit mode5;
+		FitMode5 (block, quality, mode5);
+		if (mode5.error < mode6.error)
+		{
+			PackMode5 (mode5, dst);
+			return;
+		}
+	}
+	PackMode6 (mode6, dst);
+}
+
+static void DecodeBc7 (const uint8_t *src, uint8_t pixels[16][4])
+{
+	BlockReader reader (src);
+	uint32_t mode = 0;
+	while (mode < 8 && !reader.Read (1))
+		mode++;
+	if (mode == 6)
+	{
+		int endpoints[2][4];
+		for (uint32_t c = 0; c < 4; c++)
+		{
+			endpoints[0][c] = reader.Read (7) << 1;
+			endpoints[1][c] = reader.Read (7) << 1;
+		}
+		const int p0 = reader.Read (1);
+		const int p1 = reader.Read (1);
+		for (uint32_t c = 0; c < 4; c++)
+		{
+			endpoints[0][c] |= p0;
+			endpoints[1][c] |= p1;
+		}
+		for (uint32_t i = 0; i < 16; i++)
+		{
+			const uint32_t index = reader.Read (i ? 4 : 3);
+			for (uint32_t c = 0; c < 4; c++)
+				pixels[i][c] = static_cast<uint8_t>(Bc7Interpolate (endpoints[0][c], endpoints[1][c], bc7_weights4[index]));
+		}
+	}
+	else if (mode == 5)
+	{
+		const uint32_t rotation = reader.Read (2);
+		int colors[2][3], alphas[2];
+		for (uint32_t c = 0; c < 3; c++)
+		{
+			colors[0][c] = Expand7 (reader.Read (7));
+			colors[1][c] = Expand7 (reader.Read (7));
+		}
+		alphas[0] = reader.Read (8);
+		alphas[1] = reader.Read (8);
+		for (uint32_t i = 0; i < 16; i++)
+		{
+			const uint32_t index = reader.Read (i ? 2 : 1);
+			for (uint32_t c = 0; c < 3; c++)
+				pixels[i][c] = static_cast<uint8_t>(Bc7Interpolate (colors[0][c], colors[1][c], bc7_weights2[index]));
+		}
+		for (uint32_t i = 0; i < 16; i++)
+		{
+			const uint32_t index = reader.Read (i ? 2 : 1);
+			pixels[i][3] = static_cast<uint8_t>(Bc7Interpolate (alphas[0], alphas[1], bc7_weights2[index]));
+			//rotations 1 to 3 exchange alpha with red, green or blue
+			if (rotation)
+				std::swap (pixels[i][3], pixels[i][rotation - 1]);
+		}
+	}
+	else
+		throw std::invalid_argument ("Only BC7 blocks of modes 5 and 6 are decoded");
+}
+
+static void EncodeBlock (const PixelBlock &block, TextureEncoding encoding, TextureQuality quality, uint8_t *dst)
+{
+	uint8_t values[16];
+	switch (encoding)
+	{
+	case TEXTURE_ENCODING_BC1:
+		EncodeBc1Color (block, quality, true, dst);
+		break;
+	case TEXTURE_ENCODING_BC3:
+		for (uint32_t i = 0; i < 16; i++)
+			values[i] = block.pixels[i][3];
+		EncodeBc4 (values, quality, dst);
+		EncodeBc1Color (block, quality, false, dst + 8);
+		break;
+	case TEXTURE_ENCODING_BC4:
+	case TEXTURE_ENCODING_BC5:
+		for (uint32_t c = 0; c < (encoding == TEXTURE_ENCODING_BC4 ? 1u : 2u); c++)
+		{
+			for (uint32_t i = 0; i < 16; i++)
+				values[i] = block.pixels[i][c];
+			EncodeBc4 (values, quality, dst + c * 8);
+		}
+		break;
+	case TEXTURE_ENCODING_BC7:
+		EncodeBc7 (block, quality, dst);
+		break;
+	default:
+		throw std::out_of_range ("Unknown texture encoding");
+	}
+}
+
+void EncodeTextureBlocks (const TextureImage &image, TextureEncoding encoding, TextureQuality quality, JobSystem *job_system,
+						  std::vector<uint8_t> &blocks)
+{
+	if (!image.width || !image.height || image.pixels.size () != static_cast<size_t>(image.width) * image.height * 4)
+		throw std::invalid_argument ("Block compression needs a non-empty RGBA8 image");
+	if (quality >= TEXTURE_QUALITY_COUNT)
+		throw std::out_of_range ("Unknown texture quality");
+	if (encoding == TEXTURE_ENCODING_RGBA8)
+	{
+		blocks = image.pixels;
+		return;
+	}
+	const uint32_t block_size = GetTextureFormatBlockSize (GetTextureEncodingFormat (encoding, false));
+	const uint32_t blocks_x = (image.width + 3) / 4;
+	const uint32_t block_count = blocks_x * ((image.height + 3) / 4);
+	blocks.resize (static_cast<size_t>(block_count) * block_size);
+	const JobSystem::RangeFunction body = [&] (uint32_t begin, uint32_t end)
+	{
+		PixelBlock block;
+		for (uint32_t i = begin; i < end; i++)
+		{
+			LoadBlock (image, i % blocks_x, i / blocks_x, block);
+			EncodeBlock (block, encoding, quality, blocks.data () + static_cast<size_t>(i) * block_size);
+		}
+	};
+	if (job_system)
+		job_system->ParallelFor (block_count, texture_job_blocks, body);
+	else
+		body (0, block_count);
+}
+
+void DecodeTextureBlocks (const uint8_t *blocks, uint32_t width, uint32_t height, TextureEncoding encoding, TextureImage &image)
+{
+	image.Resize (width, height);
+	if (encoding == TEXTURE_ENCODING_RGBA8)
+	{
+		memcpy (image.pixels.data (), blocks, image.pixels.size ());
+		return;
+	}
+	const uint32_t block_size = GetTextureFormatBlockSize (GetTextureEncodingFormat (encoding, false));
+	const uint32_t blocks_x = (width + 3) / 4;
+	const uint32_t block_count = blocks_x * ((height + 3) / 4);
+	for (uint32_t b = 0; b < block_count; b++)
+	{
+		const uint8_t *src = blocks + static_cast<size_t>(b) * block_size;
+		PixelBlock block;
+		uint8_t values[16];
+		switch (encoding)
+		{
+		case TEXTURE_ENCODING_BC1:
+			DecodeBc1Color (src, true, block.pixels);
+			break;
+		case TEXTURE_ENCODING_BC3:
+			DecodeBc1Color (src + 8, false, block.pixels);
+			DecodeBc4 (src, values);
+			for (uint32_t i = 0; i < 16; i++)
+				block.pixels[i][3] = values[i];
+			break;
+		case TEXTURE_ENCODING_BC4:
+		case TEXTURE_ENCODING_BC5:
+			memset (block.pixels, 0, sizeof (block.pixels));
+			for (uint32_t c = 0; c < (encoding == TEXTURE_ENCODING_BC4 ? 1u : 2u); c++)
+			{
+				DecodeBc4 (src + c * 8, values);
+				for (uint32_t i = 0; i < 16; i++)
+					block.pixels[i][c] = values[i];
+			}
+			for (uint32_t i = 0; i < 16; i++)
+				block.pixels[i][3] = 255;
+			break;
+		case TEXTURE_ENCODING_BC7:
+			DecodeBc7 (src, block.pixels);
+			break;
+		default:
+			throw std::out_of_range ("Unknown texture encoding");
+		}
+		//pixels of edge blocks outside the image are dropped
+		const uint32_t block_x = b % blocks_x * 4;
+		const uint32_t block_y = b / blocks_x * 4;
+		for (uint32_t y = 0; y < 4 && block_y + y < height; y++)
+			for (uint32_t x = 0; x < 4 && block_x + x < width; x++)
+				memcpy (image.GetPixel (block_x + x, block_y + y), block.pixels[y * 4 + x], 4);
+	}
+}
+
+TextureCompressOptions::TextureCompressOptions () :
+	encoding (TEXTURE_ENCODING_BC7),
+	quality (TEXTURE_QUALITY_NORMAL),
+	mip_flags (TEXTURE_MIP_SRGB),
+	max_mip_count (0)
+{
+}
+
+void CompressTexture (const TextureImage &image, const TextureCompressOptions &options, JobSystem *job_system, TextureData &texture)
+{
+	texture.format = GetTextureEncodingFormat (options.encoding, (options.mip_flags & TEXTURE_MIP_SRGB) != 0);
+	std::vector<TextureImage> mips;
+	GenerateMips (image, options.mip_flags, options.max_mip_count, job_system, mips);
+
+	texture.width = image.width;
+	texture.height = image.height;
+	texture.mip_count = static_cast<uint32_t>(mips.size ());
+	texture.array_size = 1;
+	texture.flags = 0;
+	if (options.mip_flags & TEXTURE_MIP_NORMAL_MAP)
+		texture.flags |= TEXTURE_FILE_FLAG_NORMAL_MAP;
+	if (!image.IsOpaque ())
+		texture.flags |= TEXTURE_FILE_FLAG_ALPHA;
+	texture.subresources.resize (mips.size ());
+	for (size_t m = 0; m < mips.size (); m++)
+		EncodeTextureBlocks (mips[m], options.encoding, options.quality, job_system, texture.subresources[m]);
+}
+
+double ComputeTexturePsnr (const TextureImage &reference, const TextureImage &image, uint32_t channels)
+{
+	if (reference.width != image.width || reference.height != image.height || reference.pixels.size () != image.pixels.size ())
+		throw std::invalid_argument ("PSNR needs images of the same size");
+	uint64_t sum = 0;
+	uint64_t count = 0;
+	for (size_t i = 0; i < reference.pixels.size (); i++)
+		if (channels & (1u << (i & 3)))
+		{
+			sum += Square (reference.pixels[i] - image.pixels[i]);
+			count++;
+		}
+	if (!sum || !count)
+		return 999.0;
+	const double mse = static_cast<double>(sum) / count;
+	return 10.0 * log10 (255.0 * 255.0 / mse);
+}
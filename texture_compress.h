@@ -0,0 +1,78 @@
+#pragma once
+#include "job_system.h"
+#include "texture_file.h"
+#include "texture_import.h"
+#include "texture_mips.h"
+
+#include <stdint.h>
+
+#include <vector>
+
+//Block compression of RGBA8 images. Every encoder fits endpoints to the principal axis
+//of a 4x4 block (a bounding box diagonal at the fast level), picks the nearest palette
+//entry per pixel and then refines the endpoints by least squares on the chosen indices;
+//the high level also searches the neighbouring quantized endpoints. Blocks are encoded
+//in parallel.
+//
+//  BC1  rgb, 4 bpp; blocks with alpha below 128 use the 3 colour mode with transparency
+//  BC3  rgba, 8 bpp; BC1 colour and a BC4 alpha block
+//  BC4  red, 4 bpp
+//  BC5  red and green, 8 bpp, e.g. the xy of normal maps
+//  BC7  rgba, 8 bpp; mode 6 (one subset, 4 bit indices, rgba endpoints); the high level
+//       also tries mode 5 (separate colour and alpha indices) and keeps the better one.
+//       The partitioned modes are not used.
+
+enum TextureEncoding
+{
+	TEXTURE_ENCODING_RGBA8,         //uncompressed
+	TEXTURE_ENCODING_BC1,
+	TEXTURE_ENCODING_BC3,
+	TEXTURE_ENCODING_BC4,
+	TEXTURE_ENCODING_BC5,
+	TEXTURE_ENCODING_BC7,
+	TEXTURE_ENCODING_COUNT
+};
+
+enum TextureQuality
+{
+	TEXTURE_QUALITY_FAST,
+	TEXTURE_QUALITY_NORMAL,
+	TEXTURE_QUALITY_HIGH,
+	TEXTURE_QUALITY_COUNT
+};
+
+//blocks encoded by one job at least
+static const uint32_t texture_job_blocks = 64;
+
+//e.g. "BC7"
+const char *GetTextureEncodingName (TextureEncoding encoding);
+const char *GetTextureQualityName (TextureQuality quality);
+//DXGI_FORMAT value; BC4 and BC5 have no sRGB formats, srgb must be false for them
+uint32_t GetTextureEncodingFormat (TextureEncoding encoding, bool srgb);
+//channels the encoding stores, bit 0 is red and bit 3 alpha
+uint32_t GetTextureEncodingChannels (TextureEncoding encoding);
+
+//rows of blocks (or pixels for RGBA8) without padding; edge blocks of sizes that are not
+//multiples of 4 repeat the last row and column. job_system may be null.
+void EncodeTextureBlocks (const TextureImage &image, TextureEncoding encoding, TextureQuality quality, JobSystem *job_system,
+						  std::vector<uint8_t> &blocks);
+//Scalar decoder for tools and validation. Channels the encoding does not store are 0,
+//alpha 255. Throws std::invalid_argument for BC7 blocks of modes other than 5 and 6.
+void DecodeTextureBlocks (const uint8_t *blocks, uint32_t width, uint32_t height, TextureEncoding encoding, TextureImage &image);
+
+struct TextureCompressOptions
+{
+	TextureEncoding encoding;
+	TextureQuality quality;
+	uint32_t mip_flags;         //TextureMipFlags; sRGB selects the sRGB format
+	uint32_t max_mip_count;     //0 for the whole chain
+
+	TextureCompressOptions ();
+};
+
+//generates the mips and encodes them into a texture for WriteTextureFile
+void CompressTexture (const TextureImage &image, const TextureCompressOptions &options, JobSystem *job_system, TextureData &texture);
+
+//peak signal to noise ratio in dB over the channels of the mask, e.g. to compare an
+//image with its decoded blocks; 999 for equal images
+double ComputeTexturePsnr (const TextureImage &reference, const TextureImage &image, uint32_t channels);
@@ -0,0 +1,210 @@
+#include "job_system.h"
+#include "texture_compress.h"
+#include "texture_file.h"
+#include "texture_import.h"
+#include "texture_mips.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+//Offline texture converter. Imports an image, generates its mips in linear space,
+//block compresses them and writes a texture container that the framework maps and
+//uploads without parsing, or a DDS file for other tools.
+//usage: texture_convert [-format rgba|bc1|bc3|bc4|bc5|bc7] [-quality fast|normal|high]
+//                       [-linear] [-normal-map] [-no-mips] [-benchmark] <input> <output.tex|.dds>
+//  -format      BC7 by default, BC5 for normal maps
+//  -quality     normal by default
+//  -linear      the image is not sRGB encoded, e.g. masks or roughness
+//  -normal-map  rgb is a normal; mips are renormalized, implies -linear
+//  -no-mips     only the top level
+//  -benchmark   also prints the throughput and quality of every level and the mip
+//               generation time of every SIMD level
+
+static bool ReadBinary (const char *file_name, std::vector<uint8_t> &data)
+{
+	FILE *f = fopen (file_name, "rb");
+	if (!f)
+		return false;
+	uint8_t buffer[65536];
+	size_t read;
+	while ((read = fread (buffer, 1, sizeof (buffer), f)) > 0)
+		data.insert (data.end (), buffer, buffer + read);
+	const bool failed = ferror (f) != 0;
+	fclose (f);
+	return !failed;
+}
+
+static bool WriteFile (const char *file_name, const std::vector<uint8_t> &data)
+{
+	FILE *f = fopen (file_name, "wb");
+	if (!f)
+		return false;
+	bool written = fwrite (data.data (), 1, data.size (), f) == data.size ();
+	written = fclose (f) == 0 && written;
+	return written;
+}
+
+static bool HasExtension (const char *file_name, const char *extension)
+{
+	const size_t length = strlen (file_name);
+	const size_t extension_length = strlen (extension);
+	if (length < extension_length)
+		return false;
+	for (size_t i = 0; i < extension_length; i++)
+	{
+		char c = file_name[length - extension_length + i];
+		if (c >= 'A' && c <= 'Z')
+			c = c - 'A' + 'a';
+		if (c != extension[i])
+			return false;
+	}
+	return true;
+}
+
+static double GetSeconds ()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now ().time_since_epoch ()).count ();
+}
+
+//encodes the top level at every quality and decodes it again for the PSNR
+static void Benchmark (const TextureImage &image, TextureEncoding encoding, uint32_t mip_flags, JobSystem *job_system)
+{
+	const double megapixels = static_cast<double>(image.width) * image.height / 1e6;
+	for (uint32_t q = 0; q < TEXTURE_QUALITY_COUNT; q++)
+	{
+		const TextureQuality quality = static_cast<TextureQuality>(q);
+		std::vector<uint8_t> blocks;
+		const double start = GetSeconds ();
+		EncodeTextureBlocks (image, encoding, quality, job_system, blocks);
+		const double seconds = GetSeconds () - start;
+		TextureImage decoded;
+		DecodeTextureBlocks (blocks.data (), image.width, image.height, encoding, decoded);
+		printf ("  %s %-6s %8.2f MPix/s, PSNR %.2f dB\n", GetTextureEncodingName (encoding), GetTextureQualityName (quality),
+				megapixels / std::max (seconds, 1e-9), ComputeTexturePsnr (image, decoded, GetTextureEncodingChannels (encoding)));
+	}
+	const uint32_t best = GetTextureSimdLevel ();
+	for (uint32_t level = TEXTURE_SIMD_SCALAR; level <= best; level++)
+	{
+		std::vector<TextureImage> mips;
+		const double start = GetSeconds ();
+		GenerateMips (image, mip_flags, 0, job_system, mips, static_cast<TextureSimdLevel>(level));
+		printf ("  mips %-6s %8.2f ms\n", GetTextureSimdLevelName (static_cast<TextureSimdLevel>(level)), (GetSeconds () - start) * 1000.0);
+	}
+}
+
+int main (int argc, char **argv)
+{
+	static const char *const encoding_options[TEXTURE_ENCODING_COUNT] = { "rgba", "bc1", "bc3", "bc4", "bc5", "bc7" };
+	static const char *const quality_options[TEXTURE_QUALITY_COUNT] = { "fast", "normal", "high" };
+	TextureCompressOptions options;
+	bool encoding_set = false;
+	bool linear = false;
+	bool normal_map = false;
+	bool benchmark = false;
+	bool usage = false;
+	for (; argc > 3 && argv[1][0] == '-'; argv++, argc--)
+	{
+		if (strcmp (argv[1], "-format") == 0 || strcmp (argv[1], "-quality") == 0)
+		{
+			const bool format = argv[1][1] == 'f';
+			const char *const *names = format ? encoding_options : quality_options;
+			const uint32_t count = format ? static_cast<uint32_t>(TEXTURE_ENCODING_COUNT) : static_cast<uint32_t>(TEXTURE_QUALITY_COUNT);
+			uint32_t value = 0;
+			while (value < count && strcmp (argv[2], names[value]) != 0)
+				value++;
+			if (value == count)
+			{
+				usage = true;
+				break;
+			}
+			if (format)
+			{
+				options.encoding = static_cast<TextureEncoding>(value);
+				encoding_set = true;
+			}
+			else
+				options.quality = static_cast<TextureQuality>(value);
+			argv++;
+			argc--;
+		}
+		else if (strcmp (argv[1], "-linear") == 0)
+			linear = true;
+		else if (strcmp (argv[1], "-normal-map") == 0)
+			normal_map = true;
+		else if (strcmp (argv[1], "-no-mips") == 0)
+			options.max_mip_count = 1;
+		else if (strcmp (argv[1], "-benchmark") == 0)
+			benchmark = true;
+		else
+			break;
+	}
+	if (usage || argc != 3)
+	{
+		printf ("usage: texture_convert [-format rgba|bc1|bc3|bc4|bc5|bc7] [-quality fast|normal|high] [-linear] [-normal-map] [-no-mips] [-benchmark] <input> <output.tex|.dds>\n");
+		return 2;
+	}
+	if (!HasExtension (argv[1], ".ppm") && !HasExtension (argv[1], ".pgm") && !HasExtension (argv[1], ".bmp") &&
+		!HasExtension (argv[1], ".tga"))
+	{
+		printf ("Unsupported input format %s, only .ppm, .pgm, .bmp and .tga files are imported\n", argv[1]);
+		return 2;
+	}
+	if (normal_map)
+	{
+		options.mip_flags = TEXTURE_MIP_NORMAL_MAP;
+		if (!encoding_set)
+			options.encoding = TEXTURE_ENCODING_BC5;
+	}
+	else if (linear || options.encoding == TEXTURE_ENCODING_BC4 || options.encoding == TEXTURE_ENCODING_BC5)
+		options.mip_flags = 0;
+
+	try
+	{
+		std::vector<uint8_t> data;
+		if (!ReadBinary (argv[1], data))
+		{
+			printf ("Can not read %s\n", argv[1]);
+			return 1;
+		}
+		TextureImage image;
+		ImportImage (data.data (), data.size (), image);
+
+		//the calling thread works as well
+		JobSystem job_system (std::max (std::thread::hardware_concurrency (), 1u) - 1);
+		const double start = GetSeconds ();
+		TextureData texture;
+		CompressTexture (image, options, &job_system, texture);
+		const double seconds = GetSeconds () - start;
+		std::vector<uint8_t> file;
+		if (HasExtension (argv[2], ".dds"))
+			WriteDdsFile (texture, file);
+		else
+			WriteTextureFile (texture, file);
+		if (!WriteFile (argv[2], file))
+		{
+			printf ("Can not write %s\n", argv[2]);
+			return 1;
+		}
+
+		printf ("%s: %ux%u %s, %u mips, %zu bytes (%zu as RGBA8), %.1f ms\n", argv[2], texture.width, texture.height,
+				GetTextureFormatName (texture.format), texture.mip_count, file.size (), image.pixels.size (), seconds * 1000.0);
+		TextureImage decoded;
+		DecodeTextureBlocks (texture.subresources[0].data (), image.width, image.height, options.encoding, decoded);
+		printf ("  PSNR %.2f dB at %s quality\n", ComputeTexturePsnr (image, decoded, GetTextureEncodingChannels (options.encoding)),
+				GetTextureQualityName (options.quality));
+		if (benchmark)
+			Benchmark (image, options.encoding, options.mip_flags, &job_system);
+	}
+	catch (const std::exception &err)
+	{
+		printf ("%s: %s\n", argv[1], err.what ());
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,309 @@
+#include "texture_file.h"
+
+#include <string.h>
+#include <algorithm>
+#include <stdexcept>
+
+static_assert (sizeof (TextureFileHeader) == 64, "Texture file header must not have padding");
+static_assert (sizeof (TextureSubresource) == 32, "Texture subresource must not have padding");
+
+uint32_t GetTextureFormatBlockSize (uint32_t format)
+{
+	switch (format)
+	{
+	case texture_format_rgba8:
+	case texture_format_rgba8_srgb:
+		return 4;
+	case texture_format_bc1:
+	case texture_format_bc1_srgb:
+	case texture_format_bc4:
+		return 8;
+	case texture_format_bc3:
+	case texture_format_bc3_srgb:
+	case texture_format_bc5:
+	case texture_format_bc7:
+	case texture_format_bc7_srgb:
+		return 16;
+	default:
+		return 0;
+	}
+}
+
+bool IsBlockCompressedFormat (uint32_t format)
+{
+	return format != texture_format_rgba8 && format != texture_format_rgba8_srgb && GetTextureFormatBlockSize (format);
+}
+
+bool IsSrgbFormat (uint32_t format)
+{
+	return format == texture_format_rgba8_srgb || format == texture_format_bc1_srgb ||
+		   format == texture_format_bc3_srgb || format == texture_format_bc7_srgb;
+}
+
+const char *GetTextureFormatName (uint32_t format)
+{
+	switch (format)
+	{
+	case texture_format_rgba8:
+		return "R8G8B8A8_UNORM";
+	case texture_format_rgba8_srgb:
+		return "R8G8B8A8_UNORM_SRGB";
+	case texture_format_bc1:
+		return "BC1_UNORM";
+	case texture_format_bc1_srgb:
+		return "BC1_UNORM_SRGB";
+	case texture_format_bc3:
+		return "BC3_UNORM";
+	case texture_format_bc3_srgb:
+		return "BC3_UNORM_SRGB";
+	case texture_format_bc4:
+		return "BC4_UNORM";
+	case texture_format_bc5:
+		return "BC5_UNORM";
+	case texture_format_bc7:
+		return "BC7_UNORM";
+	case texture_format_bc7_srgb:
+		return "BC7_UNORM_SRGB";
+	default:
+		return "unknown";
+	}
+}
+
+void GetTextureMipLayout (uint32_t format, uint32_t width, uint32_t height, uint32_t &row_size, uint32_t &row_count)
+{
+	const uint32_t block_size = GetTextureFormatBlockSize (format);
+	if (!block_size)
+		throw std::invalid_argument ("Unsupported texture format");
+	if (IsBlockCompressedFormat (format))
+	{
+		row_size = (width + 3) / 4 * block_size;
+		row_count = (height + 3) / 4;
+	}
+	else
+	{
+		row_size = width * block_size;
+		row_count = height;
+	}
+}
+
+uint32_t GetTextureMipCount (uint32_t width, uint32_t height)
+{
+	uint32_t count = 1;
+	for (uint32_t size = std::max (width, height); size > 1; size >>= 1)
+		count++;
+	return count;
+}
+
+TextureData::TextureData () :
+	format (0),
+	width (0),
+	height (0),
+	mip_count (0),
+	array_size (1),
+	flags (0)
+{
+}
+
+static uint64_t AlignOffset (uint64_t offset, uint64_t alignment)
+{
+	return (offset + alignment - 1) & ~(alignment - 1);
+}
+
+static uint32_t GetMipSize (uint32_t size, uint32_t mip)
+{
+	return std::max (size >> mip, 1u);
+}
+
+//checks the description and the sizes of the subresources; returns the subresource count
+static uint32_t ValidateTextureData (const TextureData &texture)
+{
+	if (!GetTextureFormatBlockSize (texture.format))
+		throw std::invalid_argument ("Unsupported texture format");
+	if (!texture.width || !texture.height || !texture.array_size)
+		throw std::invalid_argument ("Empty texture");
+	if (!texture.mip_count || texture.mip_count > GetTextureMipCount (texture.width, texture.height))
+		throw std::invalid_argument ("Invalid texture mip count");
+	const uint32_t count = texture.mip_count * texture.array_size;
+	if (texture.subresources.size () != count)
+		throw std::invalid_argument ("Texture subresource count does not match its mips and slices");
+	for (uint32_t i = 0; i < count; i++)
+	{
+		const uint32_t mip = i % texture.mip_count;
+		uint32_t row_size, row_count;
+		GetTextureMipLayout (texture.format, GetMipSize (texture.width, mip), GetMipSize (texture.height, mip), row_size, row_count);
+		if (texture.subresources[i].size () != static_cast<size_t>(row_size) * row_count)
+			throw std::invalid_argument ("Texture subresource does not have the size of its mip");
+	}
+	return count;
+}
+
+void WriteTextureFile (const TextureData &texture, std::vector<uint8_t> &file)
+{
+	const uint32_t count = ValidateTextureData (texture);
+
+	TextureFileHeader header;
+	memset (&header, 0, sizeof (header));
+	header.magic = texture_file_magic;
+	header.version = texture_file_version;
+	header.format = texture.format;
+	header.width = texture.width;
+	header.height = texture.height;
+	header.mip_count = texture.mip_count;
+	header.array_size = texture.array_size;
+	header.flags = texture.flags;
+	header.subresource_offset = sizeof (header);
+
+	std::vector<TextureSubresource> subresources (count);
+	uint64_t data_size = 0;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		const uint32_t mip = i % texture.mip_count;
+		TextureSubresource &subresource = subresources[i];
+		uint32_t row_size;
+		subresource.width = GetMipSize (texture.width, mip);
+		subresource.height = GetMipSize (texture.height, mip);
+		GetTextureMipLayout (texture.format, subresource.width, subresource.height, row_size, subresource.row_count);
+		subresource.row_pitch = static_cast<uint32_t>(AlignOffset (row_size, texture_row_pitch_alignment));
+		subresource.offset = AlignOffset (data_size, texture_placement_alignment);
+		subresource.size = static_cast<uint64_t>(subresource.row_pitch) * subresource.row_count;
+		data_size = subresource.offset + subresource.size;
+	}
+	header.data_offset = AlignOffset (header.subresource_offset + count * sizeof (TextureSubresource), texture_placement_alignment);
+	header.data_size = data_size;
+	header.file_size = header.data_offset + data_size;
+
+	file.assign (static_cast<size_t>(header.file_size), 0);
+	memcpy (file.data (), &header, sizeof (header));
+	memcpy (file.data () + header.subresource_offset, subresources.data (), count * sizeof (TextureSubresource));
+	uint8_t *data = file.data () + header.data_offset;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		const TextureSubresource &subresource = subresources[i];
+		const size_t row_size = texture.subresources[i].size () / subresource.row_count;
+		for (uint32_t row = 0; row < subresource.row_count; row++)
+			memcpy (data + subresource.offset + static_cast<size_t>(row) * subresource.row_pitch,
+					texture.subresources[i].data () + row * row_size, row_size);
+	}
+}
+
+//the range lies inside a file of file_size bytes
+static bool IsInside (uint64_t offset, uint64_t size, uint64_t file_size)
+{
+	return offset <= file_size && size <= file_size - offset;
+}
+
+bool ReadTextureFile (const void *file, size_t file_size, TextureView &view)
+{
+	const uint8_t *bytes = static_cast<const uint8_t*>(file);
+	if (file_size < sizeof (TextureFileHeader) || reinterpret_cast<uintptr_t>(bytes) % 8)
+		return false;
+	const TextureFileHeader *header = reinterpret_cast<const TextureFileHeader*>(bytes);
+	if (header->magic != texture_file_magic || header->version != texture_file_version || header->file_size != file_size)
+		return false;
+	if (!GetTextureFormatBlockSize (header->format) || !header->width || !header->height || !header->array_size)
+		return false;
+	if (!header->mip_count || header->mip_count > GetTextureMipCount (header->width, header->height) || header->array_size > 2048)
+		return false;
+
+	const uint32_t count = header->mip_count * header->array_size;
+	if (header->subresource_offset % 8 || header->data_offset % texture_placement_alignment)
+		return false;
+	if (!IsInside (header->subresource_offset, static_cast<uint64_t>(count) * sizeof (TextureSubresource), file_size) ||
+		!IsInside (header->data_offset, header->data_size, file_size))
+		return false;
+
+	//the copies read exactly the described rows, so they must lie inside the data
+	const TextureSubresource *subresources = reinterpret_cast<const TextureSubresource*>(bytes + header->subresource_offset);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		const TextureSubresource &subresource = subresources[i];
+		const uint32_t mip = i % header->mip_count;
+		uint32_t row_size, row_count;
+		GetTextureMipLayout (header->format, GetMipSize (header->width, mip), GetMipSize (header->height, mip), row_size, row_count);
+		if (subresource.width != GetMipSize (header->width, mip) || subresource.height != GetMipSize (header->height, mip) ||
+			subresource.row_count != row_count || subresource.row_pitch < row_size ||
+			subresource.row_pitch % texture_row_pitch_alignment || subresource.offset % texture_placement_alignment ||
+			subresource.size != static_cast<uint64_t>(subresource.row_pitch) * row_count ||
+			!IsInside (subresource.offset, subresource.size, header->data_size))
+			return false;
+	}
+
+	view.header = header;
+	view.subresources = subresources;
+	view.data = bytes + header->data_offset;
+	return true;
+}
+
+void GetTextureUploadFootprints (const TextureView &view, uint64_t base_offset, std::vector<GpuTextureFootprint> &footprints)
+{
+	if (base_offset % texture_placement_alignment)
+		throw std::invalid_argument ("Texture upload offset is not aligned");
+	const uint32_t count = view.header->mip_count * view.header->array_size;
+	footprints.resize (count);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		const TextureSubresource &subresource = view.subresources[i];
+		GpuTextureFootprint &footprint = footprints[i];
+		footprint.offset = base_offset + subresource.offset;
+		footprint.format = view.header->format;
+		//block compressed copies cover whole blocks
+		footprint.width = subresource.width;
+		footprint.height = subresource.height;
+		if (IsBlockCompressedFormat (view.header->format))
+		{
+			footprint.width = (footprint.width + 3) & ~3u;
+			footprint.height = (footprint.height + 3) & ~3u;
+		}
+		footprint.depth = 1;
+		footprint.row_pitch = subresource.row_pitch;
+	}
+}
+
+//DDS_HEADER and DDS_HEADER_DXT10 as 32 bit words
+static const uint32_t dds_magic = 0x20534444;              //"DDS "
+static const uint32_t dds_header_words = 31;
+static const uint32_t dds_dx10_words = 5;
+static const uint32_t dds_fourcc_dx10 = 0x30315844;        //"DX10"
+
+void WriteDdsFile (const TextureData &texture, std::vector<uint8_t> &file)
+{
+	const uint32_t count = ValidateTextureData (texture);
+
+	uint32_t row_size, row_count;
+	GetTextureMipLayout (texture.format, texture.width, texture.height, row_size, row_count);
+	uint32_t header[1 + dds_header_words + dds_dx10_words];
+	memset (header, 0, sizeof (header));
+	header[0] = dds_magic;
+	uint32_t *dds = header + 1;
+	dds[0] = 124;
+	//CAPS, HEIGHT, WIDTH, PIXELFORMAT, MIPMAPCOUNT and PITCH or LINEARSIZE
+	dds[1] = 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000 | (IsBlockCompressedFormat (texture.format) ? 0x80000 : 0x8);
+	dds[2] = texture.height;
+	dds[3] = texture.width;
+	dds[4] = IsBlockCompressedFormat (texture.format) ? row_size * row_count : row_size;
+	dds[6] = texture.mip_count;
+	//pixel format: size, DDPF_FOURCC, fourcc
+	dds[18] = 32;
+	dds[19] = 0x4;
+	dds[20] = dds_fourcc_dx10;
+	//caps: TEXTURE, COMPLEX and MIPMAP for mip chains
+	dds[26] = 0x1000 | (texture.mip_count > 1 ? 0x8 | 0x400000 : 0);
+	uint32_t *dx10 = dds + dds_header_words;
+	dx10[0] = texture.format;
+	dx10[1] = 3;                //D3D10_RESOURCE_DIMENSION_TEXTURE2D
+	dx10[3] = texture.array_size;
+
+	size_t size = sizeof (header);
+	for (const std::vector<uint8_t> &subresource : texture.subresources)
+		size += subresource.size ();
+	file.resize (size);
+	memcpy (file.data (), header, sizeof (header));
+	//DDS stores the mips of slice 0 first as well
+	size_t offset = sizeof (header);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		if (!texture.subresources[i].empty ())
+			memcpy (file.data () + offset, texture.subresources[i].data (), texture.subresources[i].size ());
+		offset += texture.subresources[i].size ();
+	}
+}
@@ -0,0 +1,113 @@
+#pragma once
+#include "gpu_device.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+//Binary texture container. Like the mesh container it is laid out for upload: after the
+//header and the subresource table comes one data section in which every subresource
+//starts at the placement alignment of D3D12 texture copies and every row of pixels or
+//blocks at the row pitch alignment. The data section therefore is the upload buffer as
+//it is: one copy from a memory mapping into upload memory, then one texture copy per
+//subresource with the footprints of GetTextureUploadFootprints. Loading only validates
+//the header and the subresource table.
+//
+//file: header | subresources | data, subresources in D3D12 order (mips of slice 0 first)
+
+static const uint32_t texture_file_magic = 0x52545854;     //"TXTR"
+static const uint32_t texture_file_version = 1;
+//D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT and D3D12_TEXTURE_DATA_PITCH_ALIGNMENT
+static const uint32_t texture_placement_alignment = 512;
+static const uint32_t texture_row_pitch_alignment = 256;
+
+//DXGI_FORMAT values of texture data
+static const uint32_t texture_format_rgba8 = 28;           //R8G8B8A8_UNORM
+static const uint32_t texture_format_rgba8_srgb = 29;      //R8G8B8A8_UNORM_SRGB
+static const uint32_t texture_format_bc1 = 71;             //BC1_UNORM
+static const uint32_t texture_format_bc1_srgb = 72;        //BC1_UNORM_SRGB
+static const uint32_t texture_format_bc3 = 77;             //BC3_UNORM
+static const uint32_t texture_format_bc3_srgb = 78;        //BC3_UNORM_SRGB
+static const uint32_t texture_format_bc4 = 80;             //BC4_UNORM
+static const uint32_t texture_format_bc5 = 83;             //BC5_UNORM
+static const uint32_t texture_format_bc7 = 98;             //BC7_UNORM
+static const uint32_t texture_format_bc7_srgb = 99;        //BC7_UNORM_SRGB
+
+//bytes of a 4x4 block of block compressed formats and of a pixel of the others, 0 for
+//formats that are not listed above
+uint32_t GetTextureFormatBlockSize (uint32_t format);
+bool IsBlockCompressedFormat (uint32_t format);
+bool IsSrgbFormat (uint32_t format);
+//e.g. "BC7_UNORM_SRGB"
+const char *GetTextureFormatName (uint32_t format);
+//unpacked bytes of a row of pixels or blocks of a mip and the number of rows
+void GetTextureMipLayout (uint32_t format, uint32_t width, uint32_t height, uint32_t &row_size, uint32_t &row_count);
+//1 + floor (log2 (max (width, height)))
+uint32_t GetTextureMipCount (uint32_t width, uint32_t height);
+
+enum TextureFileFlags
+{
+	TEXTURE_FILE_FLAG_NORMAL_MAP = 0x1,     //xy in red and green, z is reconstructed
+	TEXTURE_FILE_FLAG_ALPHA = 0x2           //alpha is not 255 everywhere
+};
+
+struct TextureFileHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t format;            //DXGI_FORMAT value
+	uint32_t width;
+	uint32_t height;
+	uint32_t mip_count;
+	uint32_t array_size;
+	uint32_t flags;             //TextureFileFlags
+	uint64_t subresource_offset;
+	uint64_t data_offset;
+	uint64_t data_size;
+	uint64_t file_size;
+};
+
+struct TextureSubresource
+{
+	uint64_t offset;            //from the start of the data section
+	uint64_t size;              //row_pitch * row_count
+	uint32_t width;             //of the mip in pixels
+	uint32_t height;
+	uint32_t row_pitch;
+	uint32_t row_count;         //rows of pixels or blocks
+};
+
+//texture in memory, the input of WriteTextureFile
+struct TextureData
+{
+	uint32_t format;
+	uint32_t width;
+	uint32_t height;
+	uint32_t mip_count;
+	uint32_t array_size;
+	uint32_t flags;
+	//unpacked rows of every subresource, in D3D12 order
+	std::vector<std::vector<uint8_t>> subresources;
+
+	TextureData ();
+};
+
+//pointers into a loaded file
+struct TextureView
+{
+	const TextureFileHeader *header;
+	const TextureSubresource *subresources;
+	const uint8_t *data;        //the data section, header->data_size bytes
+};
+
+//throws std::invalid_argument if a subresource does not have the size of its mip
+void WriteTextureFile (const TextureData &texture, std::vector<uint8_t> &file);
+//false if the file is damaged or of another version; the data must stay 8 byte aligned
+bool ReadTextureFile (const void *file, size_t file_size, TextureView &view);
+//footprints of the subresources for data copied to base_offset of an upload buffer,
+//base_offset must be a multiple of texture_placement_alignment
+void GetTextureUploadFootprints (const TextureView &view, uint64_t base_offset, std::vector<GpuTextureFootprint> &footprints);
+
+//DDS file with the DX10 header for other tools; rows are packed as DDS requires
+void WriteDdsFile (const TextureData &texture, std::vector<uint8_t> &file);
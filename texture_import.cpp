@@ -0,0 +1,339 @@
+#include "texture_import.h"
+
+#include <string.h>
+#include <stdexcept>
+#include <string>
+
+TextureImage::TextureImage () :
+	width (0),
+	height (0)
+{
+}
+
+void TextureImage::Resize (uint32_t image_width, uint32_t image_height)
+{
+	width = image_width;
+	height = image_height;
+	pixels.assign (static_cast<size_t>(width) * height * 4, 0);
+}
+
+bool TextureImage::IsOpaque () const
+{
+	for (size_t i = 3; i < pixels.size (); i += 4)
+		if (pixels[i] != 255)
+			return false;
+	return true;
+}
+
+namespace
+{
+	//bounds-checked little-endian reads; every error names the format
+	class ImageReader
+	{
+	public:
+		ImageReader (const void *data, size_t data_size, const char *format_name) :
+			bytes (static_cast<const uint8_t*>(data)),
+			size (data_size),
+			format (format_name)
+		{
+		}
+
+		const uint8_t *Get (size_t offset, size_t count) const
+		{
+			if (offset > size || count > size - offset)
+				Fail ("unexpected end of file");
+			return bytes + offset;
+		}
+		uint32_t U8 (size_t offset) const
+		{
+			return *Get (offset, 1);
+		}
+		uint32_t U16 (size_t offset) const
+		{
+			const uint8_t *p = Get (offset, 2);
+			return p[0] | (p[1] << 8);
+		}
+		uint32_t U32 (size_t offset) const
+		{
+			const uint8_t *p = Get (offset, 4);
+			return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+		}
+		size_t GetSize () const
+		{
+			return size;
+		}
+
+		void Fail (const char *message) const
+		{
+			throw std::runtime_error (std::string (format) + ": " + message);
+		}
+		void CheckDimensions (int64_t width, int64_t height) const
+		{
+			if (width <= 0 || height <= 0)
+				Fail ("empty image");
+			if (width > texture_max_dimension || height > texture_max_dimension)
+				Fail ("image is too large");
+		}
+	private:
+		const uint8_t *bytes;
+		size_t size;
+		const char *format;
+	};
+}
+
+//5 bit channel to 8 bits
+static uint8_t Expand5 (uint32_t value)
+{
+	return static_cast<uint8_t>((value << 3) | (value >> 2));
+}
+
+static void ImportTga (const ImageReader &reader, TextureImage &image)
+{
+	const uint32_t id_length = reader.U8 (0);
+	const uint32_t colormap_type = reader.U8 (1);
+	const uint32_t image_type = reader.U8 (2);
+	const uint32_t colormap_length = reader.U16 (5);
+	const uint32_t colormap_entry_bits = reader.U8 (7);
+	const uint32_t width = reader.U16 (12);
+	const uint32_t height = reader.U16 (14);
+	const uint32_t bits = reader.U8 (16);
+	const uint32_t descriptor = reader.U8 (17);
+
+	const bool grey = image_type == 3 || image_type == 11;
+	const bool rle = image_type == 10 || image_type == 11;
+	if (image_type != 2 && image_type != 3 && !rle)
+		reader.Fail ("only true colour and grey images are supported");
+	if (colormap_type > 1)
+		reader.Fail ("invalid colour map type");
+	if (grey ? bits != 8 && bits != 16 : bits != 15 && bits != 16 && bits != 24 && bits != 32)
+		reader.Fail ("unsupported bits per pixel");
+	reader.CheckDimensions (width, height);
+
+	//true colour images may still carry a colour map, it is skipped
+	size_t offset = 18 + id_length;
+	if (colormap_type == 1)
+		offset += (static_cast<size_t>(colormap_length) * colormap_entry_bits + 7) / 8;
+	const uint32_t pixel_size = (bits + 7) / 8;
+	const bool alpha_bit = bits == 16 && !grey && (descriptor & 0x0f) != 0;
+	const bool top_down = (descriptor & 0x20) != 0;
+	const bool right_to_left = (descriptor & 0x10) != 0;
+
+	image.Resize (width, height);
+	const uint32_t pixel_count = width * height;
+	uint32_t run = 0;           //pixels left in the current RLE packet
+	bool repeat = false;
+	const uint8_t *source = nullptr;
+	for (uint32_t i = 0; i < pixel_count; i++)
+	{
+		if (rle && !run)
+		{
+			const uint32_t packet = reader.U8 (offset++);
+			run = (packet & 0x7f) + 1;
+			repeat = (packet & 0x80) != 0;
+			if (repeat)
+			{
+				source = reader.Get (offset, pixel_size);
+				offset += pixel_size;
+			}
+		}
+		if (!rle || !repeat)
+		{
+			source = reader.Get (offset, pixel_size);
+			offset += pixel_size;
+		}
+		if (rle)
+			run--;
+
+		const uint32_t row = i / width;
+		const uint32_t column = i % width;
+		uint8_t *pixel = image.GetPixel (right_to_left ? width - 1 - column : column, top_down ? row : height - 1 - row);
+		if (grey)
+		{
+			pixel[0] = pixel[1] = pixel[2] = source[0];
+			pixel[3] = bits == 16 ? source[1] : 255;
+		}
+		else if (pixel_size == 2)
+		{
+			const uint32_t value = source[0] | (source[1] << 8);
+			pixel[0] = Expand5 ((value >> 10) & 0x1f);
+			pixel[1] = Expand5 ((value >> 5) & 0x1f);
+			pixel[2] = Expand5 (value & 0x1f);
+			pixel[3] = !alpha_bit || (value & 0x8000) ? 255 : 0;
+		}
+		else
+		{
+			pixel[0] = source[2];
+			pixel[1] = source[1];
+			pixel[2] = source[0];
+			pixel[3] = pixel_size == 4 ? source[3] : 255;
+		}
+	}
+}
+
+//skips whitespace and comments, then reads a decimal number
+static uint32_t ReadPnmNumber (const ImageReader &reader, size_t &offset)
+{
+	for (;;)
+	{
+		const uint32_t c = reader.U8 (offset);
+		if (c == '#')
+		{
+			while (reader.U8 (offset) != '\n')
+				offset++;
+		}
+		else if (c == ' ' || c == '\t' || c == '\r' || c == '\n')
+			offset++;
+		else
+			break;
+	}
+	uint32_t c = reader.U8 (offset);
+	if (c < '0' || c > '9')
+		reader.Fail ("number expected");
+	uint64_t value = 0;
+	do
+	{
+		value = value * 10 + (c - '0');
+		if (value > 0xffffffffull)
+			reader.Fail ("number is too large");
+		c = ++offset < reader.GetSize () ? reader.U8 (offset) : 0;
+	} while (c >= '0' && c <= '9');
+	return static_cast<uint32_t>(value);
+}
+
+static void ImportPnm (const ImageReader &reader, TextureImage &image)
+{
+	const bool grey = reader.U8 (1) == '5';
+	size_t offset = 2;
+	const uint32_t width = ReadPnmNumber (reader, offset);
+	const uint32_t height = ReadPnmNumber (reader, offset);
+	const uint32_t max_value = ReadPnmNumber (reader, offset);
+	if (!max_value || max_value > 65535)
+		reader.Fail ("invalid maximum value");
+	reader.CheckDimensions (width, height);
+	//a single whitespace character ends the header
+	offset++;
+
+	const uint32_t channels = grey ? 1 : 3;
+	const uint32_t sample_size = max_value > 255 ? 2 : 1;
+	const uint8_t *source = reader.Get (offset, static_cast<size_t>(width) * height * channels * sample_size);
+	image.Resize (width, height);
+	for (size_t i = 0; i < static_cast<size_t>(width) * height; i++)
+	{
+		uint8_t *pixel = image.pixels.data () + i * 4;
+		for (uint32_t c = 0; c < channels; c++)
+		{
+			uint32_t value = source[0];
+			if (sample_size == 2)
+				value = (value << 8) | source[1];
+			source += sample_size;
+			if (value > max_value)
+				reader.Fail ("sample exceeds the maximum value");
+			pixel[c] = static_cast<uint8_t>((value * 255 + max_value / 2) / max_value);
+		}
+		if (grey)
+			pixel[1] = pixel[2] = pixel[0];
+		pixel[3] = 255;
+	}
+}
+
+//position and width of a channel mask of a bitfield bitmap
+struct BmpChannel
+{
+	uint32_t mask;
+	uint32_t shift;
+	uint32_t max_value;
+};
+
+static BmpChannel MakeBmpChannel (uint32_t mask)
+{
+	BmpChannel channel = { mask, 0, 0 };
+	if (!mask)
+		return channel;
+	while (!(mask & 1))
+	{
+		mask >>= 1;
+		channel.shift++;
+	}
+	channel.max_value = mask;
+	return channel;
+}
+
+static uint8_t ReadBmpChannel (const BmpChannel &channel, uint32_t value)
+{
+	const uint64_t bits = (value & channel.mask) >> channel.shift;
+	return static_cast<uint8_t>((bits * 255 + channel.max_value / 2) / channel.max_value);
+}
+
+static void ImportBmp (const ImageReader &reader, TextureImage &image)
+{
+	const uint32_t data_offset = reader.U32 (10);
+	const uint32_t header_size = reader.U32 (14);
+	if (header_size < 40)
+		reader.Fail ("only Windows bitmaps with an info header of 40 or more bytes are supported");
+	const int32_t width = static_cast<int32_t>(reader.U32 (18));
+	const int32_t signed_height = static_cast<int32_t>(reader.U32 (22));
+	const uint32_t bits = reader.U16 (28);
+	const uint32_t compression = reader.U32 (30);
+	const bool top_down = signed_height < 0;
+	const int64_t height = top_down ? -static_cast<int64_t>(signed_height) : signed_height;
+	reader.CheckDimensions (width, height);
+
+	//BI_RGB or BI_BITFIELDS
+	BmpChannel channels[4];
+	if (compression == 0 && (bits == 24 || bits == 32))
+	{
+		channels[0] = MakeBmpChannel (0x00ff0000);
+		channels[1] = MakeBmpChannel (0x0000ff00);
+		channels[2] = MakeBmpChannel (0x000000ff);
+		channels[3] = MakeBmpChannel (bits == 32 ? 0xff000000 : 0);
+	}
+	else if (compression == 3 && bits == 32)
+	{
+		//the masks follow a 40 byte header and are part of larger ones
+		for (uint32_t c = 0; c < 3; c++)
+			channels[c] = MakeBmpChannel (reader.U32 (54 + c * 4));
+		channels[3] = MakeBmpChannel (header_size >= 56 ? reader.U32 (66) : 0);
+		if (!channels[0].mask || !channels[1].mask || !channels[2].mask)
+			reader.Fail ("empty colour mask");
+	}
+	else
+		reader.Fail ("only uncompressed 24 and 32 bit bitmaps are supported");
+
+	const uint32_t pixel_size = bits / 8;
+	const size_t row_pitch = (static_cast<size_t>(width) * pixel_size + 3) & ~static_cast<size_t>(3);
+	const uint32_t image_height = static_cast<uint32_t>(height);
+	const uint8_t *rows = reader.Get (data_offset, row_pitch * image_height);
+	image.Resize (width, image_height);
+	bool any_alpha = false;
+	for (uint32_t y = 0; y < image_height; y++)
+	{
+		const uint8_t *source = rows + row_pitch * (top_down ? y : image_height - 1 - y);
+		for (int32_t x = 0; x < width; x++, source += pixel_size)
+		{
+			uint32_t value = source[0] | (source[1] << 8) | (source[2] << 16);
+			if (pixel_size == 4)
+				value |= static_cast<uint32_t>(source[3]) << 24;
+			uint8_t *pixel = image.GetPixel (x, y);
+			for (uint32_t c = 0; c < 3; c++)
+				pixel[c] = ReadBmpChannel (channels[c], value);
+			pixel[3] = channels[3].mask ? ReadBmpChannel (channels[3], value) : 255;
+			any_alpha = any_alpha || pixel[3];
+		}
+	}
+	//many writers leave the fourth byte of 32 bit pixels at zero
+	if (!any_alpha)
+		for (size_t i = 3; i < image.pixels.size (); i += 4)
+			image.pixels[i] = 255;
+}
+
+void ImportImage (const void *data, size_t size, TextureImage &image)
+{
+	const uint8_t *bytes = static_cast<const uint8_t*>(data);
+	if (size >= 2 && bytes[0] == 'P' && (bytes[1] == '5' || bytes[1] == '6'))
+		ImportPnm (ImageReader (data, size, "PNM"), image);
+	else if (size >= 2 && bytes[0] == 'B' && bytes[1] == 'M')
+		ImportBmp (ImageReader (data, size, "BMP"), image);
+	else
+		//TGA has no signature
+		ImportTga (ImageReader (data, size, "TGA"), image);
+}
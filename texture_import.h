@@ -0,0 +1,40 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+//Conversion of source images into TextureImage for the texture pipeline.
+
+//RGBA8 pixels, rows top to bottom without padding
+struct TextureImage
+{
+	uint32_t width;
+	uint32_t height;
+	std::vector<uint8_t> pixels;
+
+	TextureImage ();
+	void Resize (uint32_t image_width, uint32_t image_height);
+	uint8_t *GetPixel (uint32_t x, uint32_t y)
+	{
+		return pixels.data () + (static_cast<size_t>(y) * width + x) * 4;
+	}
+	const uint8_t *GetPixel (uint32_t x, uint32_t y) const
+	{
+		return pixels.data () + (static_cast<size_t>(y) * width + x) * 4;
+	}
+	//every alpha value is 255
+	bool IsOpaque () const;
+};
+
+//largest width and height of imported images
+static const uint32_t texture_max_dimension = 16384;
+
+//The format is detected from the data:
+//  TGA: true colour and grey images of 8, 15, 16, 24 and 32 bits, raw or RLE, any origin
+//  PNM: binary grey (P5) and colour (P6) maps, 16 bit samples keep their high byte
+//  BMP: uncompressed 24 and 32 bit bitmaps, bottom-up or top-down; 32 bit bitmaps whose
+//       alpha is zero everywhere are opaque
+//Grey images are replicated to rgb, images without alpha are opaque.
+//Throws std::runtime_error naming the format of the first error.
+void ImportImage (const void *data, size_t size, TextureImage &image);
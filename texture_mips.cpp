@@ -0,0 +1,454 @@
+#include "texture_mips.h"
+#include "cpu_features.h"
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <stdexcept>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define TEXTURE_MIPS_X64
+#include <immintrin.h>
+#ifdef _MSC_VER
+#define TEXTURE_TARGET_AVX
+#else
+#define TEXTURE_TARGET_AVX __attribute__ ((target ("avx")))
+#endif
+#endif
+
+//float values of a row filtered by one job at least, about a 64 KB slice of the source
+static const uint32_t mip_job_floats = 16384;
+//shorter vectors of normal maps become +z
+static const float normal_min_length = 1e-6f;
+
+static uint32_t FloatBits (float value)
+{
+	uint32_t bits;
+	memcpy (&bits, &value, sizeof (bits));
+	return bits;
+}
+
+static float BitsFloat (uint32_t bits)
+{
+	float value;
+	memcpy (&value, &bits, sizeof (value));
+	return value;
+}
+
+static double SrgbToLinearExact (double value)
+{
+	return value <= 0.04045 ? value / 12.92 : pow ((value + 0.055) / 1.055, 2.4);
+}
+
+namespace
+{
+	//Decoding is a table lookup. Encoding compares against the linear value at which each
+	//code begins, the midpoint to the code below, which rounds exactly; a table indexed by
+	//the exponent and the top 8 mantissa bits of the value gives a start one code away.
+	struct SrgbTables
+	{
+		static const uint32_t guess_shift = 15;
+		static const uint32_t guess_count = (0x3f800000 >> guess_shift) + 1;
+
+		float to_linear[256];
+		float unorm[256];
+		float thresholds[256];          //smallest linear value encoded as the code
+		uint8_t guesses[guess_count];
+
+		SrgbTables ()
+		{
+			for (uint32_t i = 0; i < 256; i++)
+			{
+				to_linear[i] = static_cast<float>(SrgbToLinearExact (i / 255.0));
+				unorm[i] = i / 255.0f;
+				thresholds[i] = i ? static_cast<float>(SrgbToLinearExact ((i - 0.5) / 255.0)) : 0.0f;
+			}
+			for (uint32_t i = 0; i < guess_count; i++)
+			{
+				const float value = BitsFloat (i << guess_shift);
+				guesses[i] = static_cast<uint8_t>(std::upper_bound (thresholds + 1, thresholds + 256, value) - thresholds - 1);
+			}
+		}
+	};
+}
+
+static const SrgbTables &GetSrgbTables ()
+{
+	static const SrgbTables tables;
+	return tables;
+}
+
+float SrgbToLinear (uint8_t value)
+{
+	return GetSrgbTables ().to_linear[value];
+}
+
+static uint8_t LinearToSrgb (const SrgbTables &tables, float value)
+{
+	//NaN gives 0
+	if (!(value > 0.0f))
+		return 0;
+	if (value >= 1.0f)
+		return 255;
+	uint32_t code = tables.guesses[FloatBits (value) >> SrgbTables::guess_shift];
+	while (code < 255 && value >= tables.thresholds[code + 1])
+		code++;
+	while (code > 0 && value < tables.thresholds[code])
+		code--;
+	return static_cast<uint8_t>(code);
+}
+
+uint8_t LinearToSrgb (float value)
+{
+	return LinearToSrgb (GetSrgbTables (), value);
+}
+
+static uint8_t ToUnorm8 (float value)
+{
+	value = value > 0.0f ? value : 0.0f;
+	value = value < 1.0f ? value : 1.0f;
+	return static_cast<uint8_t>(value * 255.0f + 0.5f);
+}
+
+static TextureSimdLevel DetectSimdLevel ()
+{
+#ifdef TEXTURE_MIPS_X64
+	return GetCpuFeatures ().avx ? TEXTURE_SIMD_AVX : TEXTURE_SIMD_SSE2;
+#else
+	return TEXTURE_SIMD_SCALAR;
+#endif
+}
+
+TextureSimdLevel GetTextureSimdLevel ()
+{
+	static const TextureSimdLevel level = DetectSimdLevel ();
+	return level;
+}
+
+const char *GetTextureSimdLevelName (TextureSimdLevel level)
+{
+	switch (level)
+	{
+	case TEXTURE_SIMD_SSE2:
+		return "SSE2";
+	case TEXTURE_SIMD_AVX:
+		return "AVX";
+	default:
+		return "scalar";
+	}
+}
+
+namespace
+{
+	//source pixels of one output pixel along one axis
+	struct MipTaps
+	{
+		uint32_t first;
+		float weights[3];
+	};
+
+	//1 tap for sources of size 1, 2 for even sizes and 3 for odd ones
+	struct MipAxis
+	{
+		uint32_t tap_count;
+		std::vector<MipTaps> taps;
+	};
+}
+
+static void MakeMipAxis (uint32_t source_size, uint32_t size, MipAxis &axis)
+{
+	axis.taps.resize (size);
+	if (source_size == 1)
+		axis.tap_count = 1;
+	else if (source_size % 2 == 0)
+		axis.tap_count = 2;
+	else
+		axis.tap_count = 3;
+	const float scale = 1.0f / (2 * size + 1);
+	for (uint32_t i = 0; i < size; i++)
+	{
+		MipTaps &taps = axis.taps[i];
+		taps.first = source_size == 1 ? 0 : 2 * i;
+		if (axis.tap_count == 1)
+		{
+			taps.weights[0] = 1.0f;
+			taps.weights[1] = taps.weights[2] = 0.0f;
+		}
+		else if (axis.tap_count == 2)
+		{
+			taps.weights[0] = taps.weights[1] = 0.5f;
+			taps.weights[2] = 0.0f;
+		}
+		else
+		{
+			taps.weights[0] = (size - i) * scale;
+			taps.weights[1] = size * scale;
+			taps.weights[2] = (i + 1) * scale;
+		}
+	}
+}
+
+//Filter kernels. They return how many values (vertical) or pixels (horizontal) they
+//processed, the next lower level does the rest; every level computes
+//(a * w0 + b * w1) + c * w2 in the same order, so all write the same bits.
+
+#ifdef TEXTURE_MIPS_X64
+
+static uint32_t FilterVerticalSse2 (const float *const rows[3], const float weights[3], uint32_t tap_count, uint32_t count, float *dst)
+{
+	const __m128 w0 = _mm_set1_ps (weights[0]);
+	const __m128 w1 = _mm_set1_ps (weights[1]);
+	const __m128 w2 = _mm_set1_ps (weights[2]);
+	uint32_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 value = _mm_mul_ps (_mm_loadu_ps (rows[0] + i), w0);
+		if (tap_count > 1)
+			value = _mm_add_ps (value, _mm_mul_ps (_mm_loadu_ps (rows[1] + i), w1));
+		if (tap_count > 2)
+			value = _mm_add_ps (value, _mm_mul_ps (_mm_loadu_ps (rows[2] + i), w2));
+		_mm_storeu_ps (dst + i, value);
+	}
+	return i;
+}
+
+//one RGBA pixel per vector, pixels begin to count
+static uint32_t FilterHorizontalSse2 (const float *src, const MipAxis &axis, uint32_t begin, uint32_t count, float *dst)
+{
+	for (uint32_t i = begin; i < count; i++)
+	{
+		const MipTaps &taps = axis.taps[i];
+		const float *pixel = src + taps.first * 4;
+		__m128 value = _mm_mul_ps (_mm_loadu_ps (pixel), _mm_set1_ps (taps.weights[0]));
+		if (axis.tap_count > 1)
+			value = _mm_add_ps (value, _mm_mul_ps (_mm_loadu_ps (pixel + 4), _mm_set1_ps (taps.weights[1])));
+		if (axis.tap_count > 2)
+			value = _mm_add_ps (value, _mm_mul_ps (_mm_loadu_ps (pixel + 8), _mm_set1_ps (taps.weights[2])));
+		_mm_storeu_ps (dst + i * 4, value);
+	}
+	return count;
+}
+
+TEXTURE_TARGET_AVX static uint32_t FilterVerticalAvx (const float *const rows[3], const float weights[3], uint32_t tap_count, uint32_t count, float *dst)
+{
+	const __m256 w0 = _mm256_set1_ps (weights[0]);
+	const __m256 w1 = _mm256_set1_ps (weights[1]);
+	const __m256 w2 = _mm256_set1_ps (weights[2]);
+	uint32_t i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256 value = _mm256_mul_ps (_mm256_loadu_ps (rows[0] + i), w0);
+		if (tap_count > 1)
+			value = _mm256_add_ps (value, _mm256_mul_ps (_mm256_loadu_ps (rows[1] + i), w1));
+		if (tap_count > 2)
+			value = _mm256_add_ps (value, _mm256_mul_ps (_mm256_loadu_ps (rows[2] + i), w2));
+		_mm256_storeu_ps (dst + i, value);
+	}
+	return i;
+}
+
+//two output pixels per vector; only the 2 tap box of even sizes, whose weights are the
+//same for every pixel, odd sizes are left to SSE2
+TEXTURE_TARGET_AVX static uint32_t FilterHorizontalAvx (const float *src, const MipAxis &axis, uint32_t count, float *dst)
+{
+	if (axis.tap_count != 2)
+		return 0;
+	const __m256 weight = _mm256_set1_ps (0.5f);
+	uint32_t i = 0;
+	for (; i + 2 <= count; i += 2)
+	{
+		//source pixels 2i to 2i + 3
+		const __m256 low = _mm256_loadu_ps (src + i * 8);
+		const __m256 high = _mm256_loadu_ps (src + i * 8 + 8);
+		const __m256 even = _mm256_permute2f128_ps (low, high, 0x20);
+		const __m256 odd = _mm256_permute2f128_ps (low, high, 0x31);
+		_mm256_storeu_ps (dst + i * 4, _mm256_add_ps (_mm256_mul_ps (even, weight), _mm256_mul_ps (odd, weight)));
+	}
+	return i;
+}
+
+#endif
+
+static TextureSimdLevel ClampSimdLevel (TextureSimdLevel level)
+{
+	return std::min (level, GetTextureSimdLevel ());
+}
+
+//weighted sum of up to 3 rows of count floats
+static void FilterVertical (const float *const rows[3], const float weights[3], uint32_t tap_count, uint32_t count, float *dst,
+							TextureSimdLevel level)
+{
+	uint32_t i = 0;
+#ifdef TEXTURE_MIPS_X64
+	if (level == TEXTURE_SIMD_AVX)
+		i = FilterVerticalAvx (rows, weights, tap_count, count, dst);
+	if (level >= TEXTURE_SIMD_SSE2)
+	{
+		const float *const rest[3] = { rows[0] + i, rows[1] + i, rows[2] + i };
+		i += FilterVerticalSse2 (rest, weights, tap_count, count - i, dst + i);
+	}
+#endif
+	for (; i < count; i++)
+	{
+		float value = rows[0][i] * weights[0];
+		if (tap_count > 1)
+			value = value + rows[1][i] * weights[1];
+		if (tap_count > 2)
+			value = value + rows[2][i] * weights[2];
+		dst[i] = value;
+	}
+}
+
+//count RGBA pixels from the taps of the axis
+static void FilterHorizontal (const float *src, const MipAxis &axis, uint32_t count, float *dst, TextureSimdLevel level)
+{
+	uint32_t i = 0;
+#ifdef TEXTURE_MIPS_X64
+	if (level == TEXTURE_SIMD_AVX)
+		i = FilterHorizontalAvx (src, axis, count, dst);
+	if (level >= TEXTURE_SIMD_SSE2)
+		i = FilterHorizontalSse2 (src, axis, i, count, dst);
+#endif
+	for (; i < count; i++)
+	{
+		const MipTaps &taps = axis.taps[i];
+		const float *pixel = src + taps.first * 4;
+		for (uint32_t c = 0; c < 4; c++)
+		{
+			float value = pixel[c] * taps.weights[0];
+			if (axis.tap_count > 1)
+				value = value + pixel[4 + c] * taps.weights[1];
+			if (axis.tap_count > 2)
+				value = value + pixel[8 + c] * taps.weights[2];
+			dst[i * 4 + c] = value;
+		}
+	}
+}
+
+namespace
+{
+	//float RGBA pixels of one mip, colour linear
+	struct MipLevel
+	{
+		uint32_t width;
+		uint32_t height;
+		std::vector<float> pixels;
+	};
+}
+
+//runs body on ranges of rows, in parallel if there is a job system
+static void ForEachRowRange (JobSystem *job_system, uint32_t height, uint32_t width, const JobSystem::RangeFunction &body)
+{
+	if (job_system)
+		job_system->ParallelFor (height, std::max (1u, mip_job_floats / (width * 4)), body);
+	else
+		body (0, height);
+}
+
+static void DecodeRows (const TextureImage &image, uint32_t flags, const SrgbTables &tables, uint32_t begin, uint32_t end, MipLevel &level)
+{
+	const float *colour = flags & TEXTURE_MIP_SRGB ? tables.to_linear : tables.unorm;
+	for (size_t i = static_cast<size_t>(begin) * image.width * 4; i < static_cast<size_t>(end) * image.width * 4; i += 4)
+	{
+		const uint8_t *pixel = image.pixels.data () + i;
+		float *value = level.pixels.data () + i;
+		value[0] = colour[pixel[0]];
+		value[1] = colour[pixel[1]];
+		value[2] = colour[pixel[2]];
+		value[3] = tables.unorm[pixel[3]];
+	}
+}
+
+static void NormalizeRow (float *pixels, uint32_t width)
+{
+	for (uint32_t x = 0; x < width; x++, pixels += 4)
+	{
+		float vector[3];
+		for (uint32_t c = 0; c < 3; c++)
+			vector[c] = pixels[c] * 2.0f - 1.0f;
+		const float length = sqrtf (vector[0] * vector[0] + vector[1] * vector[1] + vector[2] * vector[2]);
+		if (length < normal_min_length)
+		{
+			vector[0] = vector[1] = 0.0f;
+			vector[2] = 1.0f;
+		}
+		else
+			for (uint32_t c = 0; c < 3; c++)
+				vector[c] /= length;
+		for (uint32_t c = 0; c < 3; c++)
+			pixels[c] = vector[c] * 0.5f + 0.5f;
+	}
+}
+
+static void EncodeRow (const float *pixels, uint32_t width, uint32_t flags, const SrgbTables &tables, uint8_t *dst)
+{
+	for (uint32_t x = 0; x < width; x++, pixels += 4, dst += 4)
+	{
+		for (uint32_t c = 0; c < 3; c++)
+			dst[c] = flags & TEXTURE_MIP_SRGB ? LinearToSrgb (tables, pixels[c]) : ToUnorm8 (pixels[c]);
+		dst[3] = ToUnorm8 (pixels[3]);
+	}
+}
+
+void GenerateMips (const TextureImage &image, uint32_t flags, uint32_t max_mip_count, JobSystem *job_system,
+				   std::vector<TextureImage> &mips, TextureSimdLevel level)
+{
+	if (!image.width || !image.height || image.pixels.size () != static_cast<size_t>(image.width) * image.height * 4)
+		throw std::invalid_argument ("Mips need a non-empty RGBA8 image");
+	if ((flags & TEXTURE_MIP_SRGB) && (flags & TEXTURE_MIP_NORMAL_MAP))
+		throw std::invalid_argument ("Normal maps are not sRGB encoded");
+	level = ClampSimdLevel (level);
+	const SrgbTables &tables = GetSrgbTables ();
+
+	uint32_t mip_count = 1;
+	for (uint32_t size = std::max (image.width, image.height); size > 1; size >>= 1)
+		mip_count++;
+	if (max_mip_count)
+		mip_count = std::min (mip_count, max_mip_count);
+	mips.resize (mip_count);
+	mips[0] = image;
+	if (mip_count == 1)
+		return;
+
+	MipLevel source;
+	source.width = image.width;
+	source.height = image.height;
+	source.pixels.resize (static_cast<size_t>(image.width) * image.height * 4);
+	ForEachRowRange (job_system, image.height, image.width, [&] (uint32_t begin, uint32_t end)
+	{
+		DecodeRows (image, flags, tables, begin, end, source);
+	});
+
+	MipLevel mip;
+	MipAxis horizontal, vertical;
+	for (uint32_t m = 1; m < mip_count; m++)
+	{
+		mip.width = std::max (source.width / 2, 1u);
+		mip.height = std::max (source.height / 2, 1u);
+		mip.pixels.resize (static_cast<size_t>(mip.width) * mip.height * 4);
+		MakeMipAxis (source.width, mip.width, horizontal);
+		MakeMipAxis (source.height, mip.height, vertical);
+		TextureImage &output = mips[m];
+		output.Resize (mip.width, mip.height);
+
+		ForEachRowRange (job_system, mip.height, source.width, [&] (uint32_t begin, uint32_t end)
+		{
+			std::vector<float> row (static_cast<size_t>(source.width) * 4);
+			const size_t source_pitch = static_cast<size_t>(source.width) * 4;
+			for (uint32_t y = begin; y < end; y++)
+			{
+				const MipTaps &taps = vertical.taps[y];
+				const float *rows[3];
+				for (uint32_t i = 0; i < 3; i++)
+					rows[i] = source.pixels.data () + (taps.first + std::min (i, vertical.tap_count - 1)) * source_pitch;
+				FilterVertical (rows, taps.weights, vertical.tap_count, source.width * 4, row.data (), level);
+				float *pixels = mip.pixels.data () + static_cast<size_t>(y) * mip.width * 4;
+				FilterHorizontal (row.data (), horizontal, mip.width, pixels, level);
+				if (flags & TEXTURE_MIP_NORMAL_MAP)
+					NormalizeRow (pixels, mip.width);
+				EncodeRow (pixels, mip.width, flags, tables, output.GetPixel (0, y));
+			}
+		});
+		std::swap (source, mip);
+	}
+}
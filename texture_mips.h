@@ -0,0 +1,42 @@
+#pragma once
+#include "job_system.h"
+#include "texture_import.h"
+
+#include <stdint.h>
+
+#include <vector>
+
+//Mip chain generation. Every mip is filtered from the previous one at float precision
+//and only rounded to 8 bits for the output, so errors do not accumulate down the chain.
+//Colour is filtered in linear space: sRGB images are decoded before and encoded after
+//filtering, alpha is always linear. Even sizes halve with a 2x2 box; odd sizes use the
+//3 tap polyphase box whose weights keep every source pixel's total contribution equal,
+//so textures that are not powers of two do not shift or blur unevenly. The filter
+//kernels use SSE2 or AVX when the CPU supports them and write the same bits at every
+//level.
+
+enum TextureMipFlags
+{
+	TEXTURE_MIP_SRGB = 0x1,         //rgb is sRGB encoded
+	TEXTURE_MIP_NORMAL_MAP = 0x2    //rgb is a unit vector mapped to [0, 1], renormalized per mip
+};
+
+enum TextureSimdLevel
+{
+	TEXTURE_SIMD_SCALAR,
+	TEXTURE_SIMD_SSE2,
+	TEXTURE_SIMD_AVX
+};
+
+//best level of the CPU; kernels clamp requested levels to it
+TextureSimdLevel GetTextureSimdLevel ();
+const char *GetTextureSimdLevelName (TextureSimdLevel level);
+
+//mips[0] is the image itself; max_mip_count 0 generates the whole chain down to 1x1.
+//Rows of a mip are filtered in parallel if job_system is not null.
+void GenerateMips (const TextureImage &image, uint32_t flags, uint32_t max_mip_count, JobSystem *job_system,
+				   std::vector<TextureImage> &mips, TextureSimdLevel level = GetTextureSimdLevel ());
+
+//sRGB transfer function of 8 bit values, exact to the rounding of the output
+float SrgbToLinear (uint8_t value);
+uint8_t LinearToSrgb (float value);
@@ -0,0 +1,225 @@
+#include "upload_allocator.h"
+
+#include <string.h>
+#include <stdexcept>
+
+//copies of UploadBuffer () are aligned for fast memcpy; buffer copies need no more
+static const uint64_t upload_buffer_alignment = 16;
+
+static uint64_t AlignUp (uint64_t value, uint64_t alignment)
+{
+	return (value + alignment - 1) & ~(alignment - 1);
+}
+
+UploadRing::UploadRing (uint64_t ring_capacity) :
+	capacity (ring_capacity),
+	head (0),
+	tail (0),
+	allocated (0),
+	freed (0)
+{
+	if (!capacity)
+		throw std::invalid_argument ("Upload ring can not be empty");
+}
+
+bool UploadRing::Allocate (uint64_t size, uint64_t alignment, uint64_t &offset)
+{
+	if (!alignment || (alignment & (alignment - 1)))
+		throw std::invalid_argument ("Upload alignment must be a power of two");
+	if (size > capacity)
+		return false;
+
+	const uint64_t used = allocated - freed;
+	if (used == capacity)
+		return false;
+	if (!used && head)
+	{
+		//nothing is in flight, start over to get the whole ring in one piece; pending
+		//frames are all empty and must not move the tail back
+		head = tail = 0;
+		for (Frame &frame : frames)
+			frame.head = 0;
+	}
+
+	const uint64_t aligned = AlignUp (head, alignment);
+	if (head >= tail)
+	{
+		//free space is [head, capacity) and [0, tail)
+		if (aligned + size <= capacity)
+		{
+			offset = aligned;
+			allocated += aligned + size - head;
+			head = aligned + size == capacity ? 0 : aligned + size;
+			return true;
+		}
+		if (size <= tail)
+		{
+			//wrap around, the rest of the ring is padding of this allocation
+			offset = 0;
+			allocated += capacity - head + size;
+			head = size;
+			return true;
+		}
+		return false;
+	}
+	if (aligned + size <= tail)
+	{
+		offset = aligned;
+		allocated += aligned + size - head;
+		head = aligned + size;
+		return true;
+	}
+	return false;
+}
+
+void UploadRing::FinishFrame (uint64_t fence_value)
+{
+	//frames without allocations have nothing to reclaim
+	const uint64_t frame_begin = frames.empty () ? freed : frames.back ().allocated;
+	if (allocated == frame_begin)
+		return;
+	Frame frame = { fence_value, head, allocated };
+	frames.push_back (frame);
+}
+
+void UploadRing::Reclaim (uint64_t completed_fence_value)
+{
+	while (!frames.empty () && frames.front ().fence_value <= completed_fence_value)
+	{
+		tail = frames.front ().head;
+		freed = frames.front ().allocated;
+		frames.pop_front ();
+	}
+}
+
+uint64_t UploadRing::GetOldestFence () const
+{
+	return frames.empty () ? 0 : frames.front ().fence_value;
+}
+
+UploadAllocator::UploadAllocator (GpuDevice *gpu_device, UploadBackend *upload_backend, uint64_t ring_size) :
+	device (gpu_device),
+	backend (upload_backend),
+	ring (ring_size)
+{
+	memset (&stats, 0, sizeof (stats));
+	ring_chunk = backend->CreateChunk (ring_size);
+}
+
+UploadAllocator::~UploadAllocator ()
+{
+	for (auto &chunk : retired_chunks)
+		backend->DestroyChunk (chunk.second);
+	for (auto &chunk : frame_chunks)
+		backend->DestroyChunk (chunk);
+	backend->DestroyChunk (ring_chunk);
+}
+
+UploadAllocation UploadAllocator::Allocate (uint64_t size, uint64_t alignment)
+{
+	std::lock_guard<std::mutex> lock (mutex);
+	stats.allocations++;
+	stats.allocated_bytes += size;
+	//large uploads would stall the ring for frames, they get their own memory
+	if (size > ring.GetCapacity () / 2)
+		return AllocateDedicated (size);
+
+	uint64_t offset;
+	while (!ring.Allocate (size, alignment, offset))
+	{
+		const uint64_t oldest = ring.GetOldestFence ();
+		if (!oldest)
+			return AllocateDedicated (size);    //the open frame filled the ring by itself
+
+		uint64_t completed = device->GetCompletedFenceValue ();
+		if (completed < oldest)
+		{
+			stats.stalls++;
+			device->WaitForFenceValue (oldest);
+			completed = oldest;
+		}
+		Reclaim (completed);
+	}
+
+	UploadAllocation allocation;
+	allocation.resource = ring_chunk.resource;
+	allocation.offset = offset;
+	allocation.cpu_address = ring_chunk.cpu_address + offset;
+	allocation.gpu_address = ring_chunk.gpu_address + offset;
+	allocation.size = size;
+	return allocation;
+}
+
+void UploadAllocator::UploadBuffer (GpuResourceHandle dst, uint64_t dst_offset, const void *data, uint64_t size)
+{
+	UploadAllocation allocation = Allocate (size, upload_buffer_alignment);
+	memcpy (allocation.cpu_address, data, static_cast<size_t>(size));
+	QueueCopy (dst, dst_offset, allocation);
+}
+
+void UploadAllocator::QueueCopy (GpuResourceHandle dst, uint64_t dst_offset, const UploadAllocation &src)
+{
+	Copy copy = { dst, dst_offset, src.resource, src.offset, src.size };
+	std::lock_guard<std::mutex> lock (mutex);
+	copies.push_back (copy);
+	stats.copies++;
+}
+
+void UploadAllocator::FlushCopies (GpuCommandList *command_list)
+{
+	std::lock_guard<std::mutex> lock (mutex);
+	for (size_t i = 0; i < copies.size ();)
+	{
+		Copy merged = copies[i++];
+		while (i < copies.size () &&
+			   copies[i].dst == merged.dst && copies[i].dst_offset == merged.dst_offset + merged.size &&
+			   copies[i].src == merged.src && copies[i].src_offset == merged.src_offset + merged.size)
+			merged.size += copies[i++].size;
+		command_list->CopyBufferRegion (merged.dst, merged.dst_offset, merged.src, merged.src_offset, merged.size);
+		stats.recorded_copies++;
+	}
+	copies.clear ();
+}
+
+void UploadAllocator::FinishFrame (uint64_t fence_value)
+{
+	std::lock_guard<std::mutex> lock (mutex);
+	if (!copies.empty ())
+		throw std::logic_error ("Queued upload copies were not flushed");
+	ring.FinishFrame (fence_value);
+	for (auto &chunk : frame_chunks)
+		retired_chunks.push_back (std::make_pair (fence_value, chunk));
+	frame_chunks.clear ();
+	Reclaim (device->GetCompletedFenceValue ());
+}
+
+UploadStats UploadAllocator::GetStats () const
+{
+	std::lock_guard<std::mutex> lock (mutex);
+	return stats;
+}
+
+UploadAllocation UploadAllocator::AllocateDedicated (uint64_t size)
+{
+	UploadChunk chunk = backend->CreateChunk (size);
+	frame_chunks.push_back (chunk);
+	stats.dedicated_chunks++;
+
+	UploadAllocation allocation;
+	allocation.resource = chunk.resource;
+	allocation.offset = 0;
+	allocation.cpu_address = chunk.cpu_address;
+	allocation.gpu_address = chunk.gpu_address;
+	allocation.size = size;
+	return allocation;
+}
+
+void UploadAllocator::Reclaim (uint64_t completed_fence_value)
+{
+	ring.Reclaim (completed_fence_value);
+	while (!retired_chunks.empty () && retired_chunks.front ().first <= completed_fence_value)
+	{
+		backend->DestroyChunk (retired_chunks.front ().second);
+		retired_chunks.pop_front ();
+	}
+}
@@ -0,0 +1,135 @@
+#pragma once
+#include "gpu_device.h"
+
+#include <stdint.h>
+
+#include <deque>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+//Upload memory for CPU to GPU copies. A single persistently mapped ring is handed out in
+//aligned linear sub-allocations; everything allocated between two FinishFrame () calls is
+//reclaimed together once the GPU passes that frame's fence. Allocations too large for the
+//ring get a dedicated chunk that is retired the same way.
+
+//offset bookkeeping of the ring, independent of any memory
+class UploadRing
+{
+public:
+	explicit UploadRing (uint64_t capacity);
+
+	//false when the free space can not hold the allocation right now
+	bool Allocate (uint64_t size, uint64_t alignment, uint64_t &offset);
+	//closes the current frame; its allocations are reclaimed when the fence reaches the value
+	void FinishFrame (uint64_t fence_value);
+	void Reclaim (uint64_t completed_fence_value);
+
+	//fence of the oldest frame still holding memory, 0 if there is none
+	uint64_t GetOldestFence () const;
+	uint64_t GetCapacity () const
+	{
+		return capacity;
+	}
+	//bytes in use including alignment and wrap-around padding
+	uint64_t GetUsedSize () const
+	{
+		return allocated - freed;
+	}
+private:
+	struct Frame
+	{
+		uint64_t fence_value;
+		uint64_t head;         //ring position after the last allocation of the frame
+		uint64_t allocated;    //running total of allocated bytes at the end of the frame
+	};
+
+	uint64_t capacity;
+	uint64_t head;
+	uint64_t tail;
+	uint64_t allocated;
+	uint64_t freed;
+	std::deque<Frame> frames;
+};
+
+//memory block that upload allocations point into
+struct UploadChunk
+{
+	GpuResourceHandle resource;
+	uint8_t *cpu_address;
+	GpuVirtualAddress gpu_address;
+	uint64_t size;
+};
+
+//creates persistently mapped chunks of upload memory for a backend
+class UploadBackend
+{
+public:
+	virtual ~UploadBackend () {}
+	virtual UploadChunk CreateChunk (uint64_t size) = 0;
+	virtual void DestroyChunk (const UploadChunk &chunk) = 0;
+};
+
+struct UploadAllocation
+{
+	GpuResourceHandle resource;
+	uint64_t offset;               //inside resource
+	uint8_t *cpu_address;
+	GpuVirtualAddress gpu_address;
+	uint64_t size;
+};
+
+struct UploadStats
+{
+	uint64_t allocations;
+	uint64_t allocated_bytes;
+	uint64_t dedicated_chunks;
+	uint64_t stalls;               //waits for the GPU because the ring was full
+	uint64_t copies;               //queued copies
+	uint64_t recorded_copies;      //CopyBufferRegion calls after merging
+};
+
+class UploadAllocator
+{
+public:
+	//the device is used to wait for the GPU when the ring is full
+	UploadAllocator (GpuDevice *device, UploadBackend *backend, uint64_t ring_size);
+	//destroys all chunks; the GPU must be done with them
+	~UploadAllocator ();
+
+	UploadAllocation Allocate (uint64_t size, uint64_t alignment);
+	//copies data into upload memory and queues a copy of it into dst
+	void UploadBuffer (GpuResourceHandle dst, uint64_t dst_offset, const void *data, uint64_t size);
+	void QueueCopy (GpuResourceHandle dst, uint64_t dst_offset, const UploadAllocation &src);
+	//records the queued copies in order, merging copies that continue each other
+	void FlushCopies (GpuCommandList *command_list);
+	//memory allocated since the previous call is reused once the fence reaches the value
+	void FinishFrame (uint64_t fence_value);
+
+	UploadStats GetStats () const;
+private:
+	struct Copy
+	{
+		GpuResourceHandle dst;
+		uint64_t dst_offset;
+		GpuResourceHandle src;
+		uint64_t src_offset;
+		uint64_t size;
+	};
+
+	UploadAllocator (const UploadAllocator &) = delete;
+	UploadAllocator &operator= (const UploadAllocator &) = delete;
+
+	UploadAllocation AllocateDedicated (uint64_t size);
+	void Reclaim (uint64_t completed_fence_value);
+
+	GpuDevice *device;
+	UploadBackend *backend;
+	mutable std::mutex mutex;
+	UploadRing ring;
+	UploadChunk ring_chunk;
+	std::vector<UploadChunk> frame_chunks;                         //dedicated chunks of the open frame
+	std::deque<std::pair<uint64_t, UploadChunk>> retired_chunks;   //ordered by fence value
+	std::vector<Copy> copies;
+	UploadStats stats;
+};
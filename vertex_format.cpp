@@ -0,0 +1,825 @@
+#include "vertex_format.h"
+#include "cpu_features.h"
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define VERTEX_FORMAT_X64
+#include <immintrin.h>
+#ifdef _MSC_VER
+#define VERTEX_TARGET_AVX2
+#else
+#define VERTEX_TARGET_AVX2 __attribute__ ((target ("avx2,f16c")))
+#endif
+#endif
+
+static const float snorm16_max = 32767.0f;
+static const float unorm8_max = 255.0f;
+//smallest octahedral L1 length, zero vectors end up as +z
+static const float octahedral_min_length = 1e-20f;
+
+uint32_t GetVertexFormatSize (uint32_t format)
+{
+	switch (format)
+	{
+	case vertex_format_float4:
+		return 16;
+	case vertex_format_float3:
+		return 12;
+	case vertex_format_half4:
+	case vertex_format_snorm16x4:
+	case vertex_format_float2:
+		return 8;
+	case vertex_format_unorm8x4:
+	case vertex_format_half2:
+	case vertex_format_snorm16x2:
+		return 4;
+	default:
+		return 0;
+	}
+}
+
+VertexQuantization GetCompactVertexQuantization ()
+{
+	VertexQuantization quantization;
+	quantization.encodings[MESH_ATTRIBUTE_POSITION] = VERTEX_ENCODING_SNORM16;
+	quantization.encodings[MESH_ATTRIBUTE_NORMAL] = VERTEX_ENCODING_OCTAHEDRAL;
+	quantization.encodings[MESH_ATTRIBUTE_TEXCOORD] = VERTEX_ENCODING_HALF;
+	quantization.encodings[MESH_ATTRIBUTE_COLOR] = VERTEX_ENCODING_UNORM8;
+	return quantization;
+}
+
+VertexQuantization GetFloatVertexQuantization ()
+{
+	VertexQuantization quantization;
+	for (uint32_t i = 0; i < MESH_ATTRIBUTE_SEMANTIC_COUNT; i++)
+		quantization.encodings[i] = VERTEX_ENCODING_FLOAT;
+	return quantization;
+}
+
+static VertexSimdLevel DetectSimdLevel ()
+{
+#ifdef VERTEX_FORMAT_X64
+	//F16C comes with every AVX2 CPU but is checked anyway
+	const CpuFeatures &features = GetCpuFeatures ();
+	return features.avx2 && features.f16c ? VERTEX_SIMD_AVX2 : VERTEX_SIMD_SSE2;
+#else
+	return VERTEX_SIMD_SCALAR;
+#endif
+}
+
+VertexSimdLevel GetVertexSimdLevel ()
+{
+	static const VertexSimdLevel level = DetectSimdLevel ();
+	return level;
+}
+
+const char *GetVertexSimdLevelName (VertexSimdLevel level)
+{
+	switch (level)
+	{
+	case VERTEX_SIMD_SSE2:
+		return "SSE2";
+	case VERTEX_SIMD_AVX2:
+		return "AVX2";
+	default:
+		return "scalar";
+	}
+}
+
+//Scalar conversions. They use the same operations in the same order as the SIMD
+//kernels, so every level writes the same bits.
+
+static float LoadFloat (const uint8_t *src)
+{
+	float value;
+	memcpy (&value, src, sizeof (value));
+	return value;
+}
+
+static void StoreFloat (uint8_t *dst, float value)
+{
+	memcpy (dst, &value, sizeof (value));
+}
+
+//as maxps then minps, NaN gives low
+static float Clamp (float value, float low, float high)
+{
+	value = value > low ? value : low;
+	return value < high ? value : high;
+}
+
+//rounds to nearest even like cvtps2dq
+static int32_t RoundToInt (float value)
+{
+	return static_cast<int32_t>(nearbyintf (value));
+}
+
+static int16_t ToSnorm16 (float value)
+{
+	return static_cast<int16_t>(RoundToInt (Clamp (value, -1.0f, 1.0f) * snorm16_max));
+}
+
+static float FromSnorm16 (int16_t value)
+{
+	return std::max (value / snorm16_max, -1.0f);
+}
+
+static uint32_t FloatBits (float value)
+{
+	uint32_t bits;
+	memcpy (&bits, &value, sizeof (bits));
+	return bits;
+}
+
+static float BitsFloat (uint32_t bits)
+{
+	float value;
+	memcpy (&value, &bits, sizeof (value));
+	return value;
+}
+
+//float to half without tables: out of range values saturate to infinity, NaNs become quiet NaNs
+uint16_t FloatToHalf (float value)
+{
+	const uint32_t half_max_bits = (127 + 16) << 23;           //first float that is infinite as a half
+	const uint32_t half_denormal_bits = 113 << 23;             //smallest normal half
+	const float denormal_magic = BitsFloat (((127 - 15) + (23 - 10) + 1) << 23);
+
+	uint32_t bits = FloatBits (value);
+	const uint32_t sign = bits & 0x80000000u;
+	bits ^= sign;
+	uint32_t half;
+	if (bits >= half_max_bits)
+		half = bits > 0x7f800000u ? 0x7e00 : 0x7c00;
+	else if (bits < half_denormal_bits)
+	{
+		//the addition shifts the mantissa into place and rounds it
+		half = FloatBits (BitsFloat (bits) + denormal_magic) - FloatBits (denormal_magic);
+	}
+	else
+	{
+		//rebias the exponent and round the mantissa to nearest even
+		const uint32_t mantissa_odd = (bits >> 13) & 1;
+		bits += (static_cast<uint32_t>(15 - 127) << 23) + 0xfff + mantissa_odd;
+		half = bits >> 13;
+	}
+	return static_cast<uint16_t>(half | (sign >> 16));
+}
+
+float HalfToFloat (uint16_t value)
+{
+	const uint32_t exponent_mask = 0x7c00 << 13;
+	uint32_t bits = (value & 0x7fff) << 13;
+	const uint32_t exponent = bits & exponent_mask;
+	bits += (127 - 15) << 23;
+	if (exponent == exponent_mask)
+		bits += (128 - 16) << 23;    //infinity or NaN
+	else if (!exponent)
+	{
+		//zero or denormal, renormalized by the subtraction
+		bits += 1 << 23;
+		bits = FloatBits (BitsFloat (bits) - BitsFloat (113 << 23));
+	}
+	return BitsFloat (bits | (static_cast<uint32_t>(value & 0x8000) << 16));
+}
+
+static void EncodeOctahedral (float x, float y, float z, int16_t encoded[2])
+{
+	const float length = fabsf (x) + fabsf (y) + fabsf (z);
+	const float inverse_length = 1.0f / (length > octahedral_min_length ? length : octahedral_min_length);
+	float u = x * inverse_length;
+	float v = y * inverse_length;
+	if (z < 0.0f)
+	{
+		//fold the lower hemisphere over the diagonals
+		const float folded_u = copysignf (1.0f - fabsf (v), u);
+		v = copysignf (1.0f - fabsf (u), v);
+		u = folded_u;
+	}
+	encoded[0] = ToSnorm16 (u);
+	encoded[1] = ToSnorm16 (v);
+}
+
+static void DecodeOctahedral (const int16_t encoded[2], float normal[3])
+{
+	float x = FromSnorm16 (encoded[0]);
+	float y = FromSnorm16 (encoded[1]);
+	const float z = 1.0f - fabsf (x) - fabsf (y);
+	const float fold = std::max (-z, 0.0f);
+	x += x >= 0.0f ? -fold : fold;
+	y += y >= 0.0f ? -fold : fold;
+	const float inverse_length = 1.0f / sqrtf (x * x + y * y + z * z);
+	normal[0] = x * inverse_length;
+	normal[1] = y * inverse_length;
+	normal[2] = z * inverse_length;
+}
+
+#ifdef VERTEX_FORMAT_X64
+
+//SSE2 kernels. Each converts a prefix of the stream and returns the number of vertices
+//it wrote, the rest is done by the scalar loop. A float3 is loaded with 16 bytes, so
+//the last vertex of a stream is never loaded that way.
+
+static __m128 LoadFloat2x2 (const uint8_t *first, const uint8_t *second)
+{
+	return _mm_castpd_ps (_mm_loadh_pd (_mm_load_sd (reinterpret_cast<const double*>(first)), reinterpret_cast<const double*>(second)));
+}
+
+//one 8 byte vertex from each half
+static void StoreQwords2 (uint8_t *dst, uint32_t dst_stride, __m128i values)
+{
+	_mm_storel_epi64 (reinterpret_cast<__m128i*>(dst), values);
+	_mm_storel_epi64 (reinterpret_cast<__m128i*>(dst + dst_stride), _mm_unpackhi_epi64 (values, values));
+}
+
+//one 4 byte vertex from each quarter
+static void StoreDwords4 (uint8_t *dst, uint32_t dst_stride, __m128i values)
+{
+	if (dst_stride == 4)
+	{
+		_mm_storeu_si128 (reinterpret_cast<__m128i*>(dst), values);
+		return;
+	}
+	for (uint32_t i = 0; i < 4; i++)
+	{
+		const int32_t value = _mm_cvtsi128_si32 (values);
+		memcpy (dst + i * dst_stride, &value, sizeof (value));
+		values = _mm_srli_si128 (values, 4);
+	}
+}
+
+//x y z w of 4 vertices to x y z of 4 vertices
+static void Transpose4 (__m128 r0, __m128 r1, __m128 r2, __m128 r3, __m128 &x, __m128 &y, __m128 &z)
+{
+	const __m128 t0 = _mm_unpacklo_ps (r0, r1);
+	const __m128 t1 = _mm_unpacklo_ps (r2, r3);
+	const __m128 t2 = _mm_unpackhi_ps (r0, r1);
+	const __m128 t3 = _mm_unpackhi_ps (r2, r3);
+	x = _mm_shuffle_ps (t0, t1, _MM_SHUFFLE (1, 0, 1, 0));
+	y = _mm_shuffle_ps (t0, t1, _MM_SHUFFLE (3, 2, 3, 2));
+	z = _mm_shuffle_ps (t2, t3, _MM_SHUFFLE (1, 0, 1, 0));
+}
+
+static __m128i ToSnorm16Sse2 (__m128 values)
+{
+	values = _mm_min_ps (_mm_max_ps (values, _mm_set1_ps (-1.0f)), _mm_set1_ps (1.0f));
+	return _mm_cvtps_epi32 (_mm_mul_ps (values, _mm_set1_ps (snorm16_max)));
+}
+
+//halves in the low 16 bits of each lane, the same steps as FloatToHalf
+static __m128i FloatToHalfSse2 (__m128 values)
+{
+	const __m128i sign_mask = _mm_set1_epi32 (static_cast<int32_t>(0x80000000u));
+	const __m128 denormal_magic = _mm_castsi128_ps (_mm_set1_epi32 (((127 - 15) + (23 - 10) + 1) << 23));
+
+	__m128i bits = _mm_castps_si128 (values);
+	const __m128i sign = _mm_and_si128 (bits, sign_mask);
+	bits = _mm_xor_si128 (bits, sign);
+
+	const __m128i infinite = _mm_cmpgt_epi32 (bits, _mm_set1_epi32 (((127 + 16) << 23) - 1));
+	const __m128i nan = _mm_cmpgt_epi32 (bits, _mm_set1_epi32 (0x7f800000));
+	const __m128i infinite_half = _mm_or_si128 (_mm_set1_epi32 (0x7c00), _mm_and_si128 (nan, _mm_set1_epi32 (0x0200)));
+
+	const __m128i denormal = _mm_cmplt_epi32 (bits, _mm_set1_epi32 (113 << 23));
+	const __m128i denormal_half = _mm_sub_epi32 (_mm_castps_si128 (_mm_add_ps (_mm_castsi128_ps (bits), denormal_magic)),
+												 _mm_castps_si128 (denormal_magic));
+
+	const __m128i mantissa_odd = _mm_and_si128 (_mm_srli_epi32 (bits, 13), _mm_set1_epi32 (1));
+	const __m128i rounded = _mm_add_epi32 (_mm_add_epi32 (bits, _mm_set1_epi32 (static_cast<int32_t>((static_cast<uint32_t>(15 - 127) << 23) + 0xfff))), mantissa_odd);
+	const __m128i normal_half = _mm_srli_epi32 (rounded, 13);
+
+	__m128i half = _mm_or_si128 (_mm_and_si128 (denormal, denormal_half), _mm_andnot_si128 (denormal, normal_half));
+	half = _mm_or_si128 (_mm_and_si128 (infinite, infinite_half), _mm_andnot_si128 (infinite, half));
+	return _mm_or_si128 (half, _mm_srli_epi32 (sign, 16));
+}
+
+//16 bit values of two vectors; packs saturates signed, so the halves are sign extended first
+static __m128i PackHalvesSse2 (__m128i low, __m128i high)
+{
+	return _mm_packs_epi32 (_mm_srai_epi32 (_mm_slli_epi32 (low, 16), 16), _mm_srai_epi32 (_mm_slli_epi32 (high, 16), 16));
+}
+
+static uint32_t EncodeSnorm16PositionsSse2 (const uint8_t *src, uint32_t src_stride, uint32_t count, const float inverse_scale[3],
+											const float bias[3], uint8_t *dst, uint32_t dst_stride)
+{
+	const __m128 bias_vector = _mm_setr_ps (bias[0], bias[1], bias[2], 0.0f);
+	const __m128 scale_vector = _mm_setr_ps (inverse_scale[0], inverse_scale[1], inverse_scale[2], 0.0f);
+	const __m128i xyz_mask = _mm_setr_epi32 (-1, -1, -1, 0);
+	const __m128i w_one = _mm_setr_epi32 (0, 0, 0, static_cast<int32_t>(snorm16_max));
+	uint32_t i = 0;
+	for (; i + 2 < count; i += 2)
+	{
+		__m128i encoded[2];
+		for (uint32_t j = 0; j < 2; j++)
+		{
+			const __m128 position = _mm_loadu_ps (reinterpret_cast<const float*>(src + (i + j) * src_stride));
+			const __m128i quantized = ToSnorm16Sse2 (_mm_mul_ps (_mm_sub_ps (position, bias_vector), scale_vector));
+			encoded[j] = _mm_or_si128 (_mm_and_si128 (quantized, xyz_mask), w_one);
+		}
+		StoreQwords2 (dst + i * dst_stride, dst_stride, _mm_packs_epi32 (encoded[0], encoded[1]));
+	}
+	return i;
+}
+
+static uint32_t EncodeHalfsSse2 (const uint8_t *src, uint32_t src_stride, uint32_t components, uint32_t count,
+								 uint8_t *dst, uint32_t dst_stride)
+{
+	uint32_t i = 0;
+	if (components == 2)
+	{
+		for (; i + 4 <= count; i += 4)
+		{
+			const uint8_t *vertex = src + i * src_stride;
+			const __m128i low = FloatToHalfSse2 (LoadFloat2x2 (vertex, vertex + src_stride));
+			const __m128i high = FloatToHalfSse2 (LoadFloat2x2 (vertex + 2 * src_stride, vertex + 3 * src_stride));
+			StoreDwords4 (dst + i * dst_stride, dst_stride, PackHalvesSse2 (low, high));
+		}
+		return i;
+	}
+
+	const __m128 xyz_mask = _mm_castsi128_ps (_mm_setr_epi32 (-1, -1, -1, components == 3 ? 0 : -1));
+	const __m128 w_one = _mm_setr_ps (0.0f, 0.0f, 0.0f, components == 3 ? 1.0f : 0.0f);
+	const uint32_t end = components == 3 && count ? count - 1 : count;
+	for (; i + 2 <= end; i += 2)
+	{
+		__m128i halves[2];
+		for (uint32_t j = 0; j < 2; j++)
+		{
+			const __m128 values = _mm_loadu_ps (reinterpret_cast<const float*>(src + (i + j) * src_stride));
+			halves[j] = FloatToHalfSse2 (_mm_or_ps (_mm_and_ps (values, xyz_mask), w_one));
+		}
+		StoreQwords2 (dst + i * dst_stride, dst_stride, PackHalvesSse2 (halves[0], halves[1]));
+	}
+	return i;
+}
+
+static uint32_t EncodeUnorm8ColorsSse2 (const uint8_t *src, uint32_t src_stride, uint32_t count, uint8_t *dst, uint32_t dst_stride)
+{
+	uint32_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128i encoded[4];
+		for (uint32_t j = 0; j < 4; j++)
+		{
+			__m128 color = _mm_loadu_ps (reinterpret_cast<const float*>(src + (i + j) * src_stride));
+			color = _mm_min_ps (_mm_max_ps (color, _mm_setzero_ps ()), _mm_set1_ps (1.0f));
+			encoded[j] = _mm_cvtps_epi32 (_mm_mul_ps (color, _mm_set1_ps (unorm8_max)));
+		}
+		const __m128i packed = _mm_packus_epi16 (_mm_packs_epi32 (encoded[0], encoded[1]), _mm_packs_epi32 (encoded[2], encoded[3]));
+		StoreDwords4 (dst + i * dst_stride, dst_stride, packed);
+	}
+	return i;
+}
+
+static __m128 CopySignSse2 (__m128 magnitude, __m128 sign)
+{
+	const __m128 sign_mask = _mm_set1_ps (-0.0f);
+	return _mm_or_ps (_mm_and_ps (sign, sign_mask), _mm_andnot_ps (sign_mask, magnitude));
+}
+
+static uint32_t EncodeOctahedralNormalsSse2 (const uint8_t *src, uint32_t src_stride, uint32_t count, uint8_t *dst, uint32_t dst_stride)
+{
+	const __m128 abs_mask = _mm_castsi128_ps (_mm_set1_epi32 (0x7fffffff));
+	const __m128 one = _mm_set1_ps (1.0f);
+	uint32_t i = 0;
+	for (; i + 4 < count; i += 4)
+	{
+		const uint8_t *vertex = src + i * src_stride;
+		__m128 x, y, z;
+		Transpose4 (_mm_loadu_ps (reinterpret_cast<const float*>(vertex)),
+					_mm_loadu_ps (reinterpret_cast<const float*>(vertex + src_stride)),
+					_mm_loadu_ps (reinterpret_cast<const float*>(vertex + 2 * src_stride)),
+					_mm_loadu_ps (reinterpret_cast<const float*>(vertex + 3 * src_stride)),
+					x, y, z);
+		const __m128 length = _mm_add_ps (_mm_add_ps (_mm_and_ps (x, abs_mask), _mm_and_ps (y, abs_mask)), _mm_and_ps (z, abs_mask));
+		const __m128 inverse_length = _mm_div_ps (one, _mm_max_ps (length, _mm_set1_ps (octahedral_min_length)));
+		__m128 u = _mm_mul_ps (x, inverse_length);
+		__m128 v = _mm_mul_ps (y, inverse_length);
+		const __m128 folded_u = CopySignSse2 (_mm_sub_ps (one, _mm_and_ps (v, abs_mask)), u);
+		const __m128 folded_v = CopySignSse2 (_mm_sub_ps (one, _mm_and_ps (u, abs_mask)), v);
+		const __m128 lower = _mm_cmplt_ps (z, _mm_setzero_ps ());
+		u = _mm_or_ps (_mm_and_ps (lower, folded_u), _mm_andnot_ps (lower, u));
+		v = _mm_or_ps (_mm_and_ps (lower, folded_v), _mm_andnot_ps (lower, v));
+		const __m128i encoded_u = ToSnorm16Sse2 (u);
+		const __m128i encoded_v = ToSnorm16Sse2 (v);
+		StoreDwords4 (dst + i * dst_stride, dst_stride, _mm_packs_epi32 (_mm_unpacklo_epi32 (encoded_u, encoded_v), _mm_unpackhi_epi32 (encoded_u, encoded_v)));
+	}
+	return i;
+}
+
+//AVX2 kernels, twice the vertices of the SSE2 ones. Vertices are loaded into the two
+//128 bit lanes so the in-lane packs write them back in order.
+
+VERTEX_TARGET_AVX2 static __m256 LoadLanes (const uint8_t *low, const uint8_t *high)
+{
+	return _mm256_insertf128_ps (_mm256_castps128_ps256 (_mm_loadu_ps (reinterpret_cast<const float*>(low))),
+								 _mm_loadu_ps (reinterpret_cast<const float*>(high)), 1);
+}
+
+VERTEX_TARGET_AVX2 static __m256i ToSnorm16Avx2 (__m256 values)
+{
+	values = _mm256_min_ps (_mm256_max_ps (values, _mm256_set1_ps (-1.0f)), _mm256_set1_ps (1.0f));
+	return _mm256_cvtps_epi32 (_mm256_mul_ps (values, _mm256_set1_ps (snorm16_max)));
+}
+
+VERTEX_TARGET_AVX2 static uint32_t EncodeSnorm16PositionsAvx2 (const uint8_t *src, uint32_t src_stride, uint32_t count, const float inverse_scale[3],
+															   const float bias[3], uint8_t *dst, uint32_t dst_stride)
+{
+	const __m256 bias_vector = _mm256_setr_ps (bias[0], bias[1], bias[2], 0.0f, bias[0], bias[1], bias[2], 0.0f);
+	const __m256 scale_vector = _mm256_setr_ps (inverse_scale[0], inverse_scale[1], inverse_scale[2], 0.0f,
+												inverse_scale[0], inverse_scale[1], inverse_scale[2], 0.0f);
+	const __m256i xyz_mask = _mm256_setr_epi32 (-1, -1, -1, 0, -1, -1, -1, 0);
+	const __m256i w_one = _mm256_setr_epi32 (0, 0, 0, static_cast<int32_t>(snorm16_max), 0, 0, 0, static_cast<int32_t>(snorm16_max));
+	uint32_t i = 0;
+	for (; i + 4 < count; i += 4)
+	{
+		const uint8_t *vertex = src + i * src_stride;
+		__m256i encoded[2];
+		for (uint32_t j = 0; j < 2; j++)
+		{
+			const __m256 position = LoadLanes (vertex + j * src_stride, vertex + (j + 2) * src_stride);
+			const __m256i quantized = ToSnorm16Avx2 (_mm256_mul_ps (_mm256_sub_ps (position, bias_vector), scale_vector));
+			encoded[j] = _mm256_or_si256 (_mm256_and_si256 (quantized, xyz_mask), w_one);
+		}
+		const __m256i packed = _mm256_packs_epi32 (encoded[0], encoded[1]);
+		if (dst_stride == 8)
+			_mm256_storeu_si256 (reinterpret_cast<__m256i*>(dst + i * dst_stride), packed);
+		else
+		{
+			StoreQwords2 (dst + i * dst_stride, dst_stride, _mm256_castsi256_si128 (packed));
+			StoreQwords2 (dst + (i + 2) * dst_stride, dst_stride, _mm256_extracti128_si256 (packed, 1));
+		}
+	}
+	return i;
+}
+
+VERTEX_TARGET_AVX2 static uint32_t EncodeHalfsAvx2 (const uint8_t *src, uint32_t src_stride, uint32_t components, uint32_t count,
+													uint8_t *dst, uint32_t dst_stride)
+{
+	uint32_t i = 0;
+	if (components == 2)
+	{
+		for (; i + 4 <= count; i += 4)
+		{
+			const uint8_t *vertex = src + i * src_stride;
+			const __m256 values = _mm256_insertf128_ps (_mm256_castps128_ps256 (LoadFloat2x2 (vertex, vertex + src_stride)),
+														LoadFloat2x2 (vertex + 2 * src_stride, vertex + 3 * src_stride), 1);
+			StoreDwords4 (dst + i * dst_stride, dst_stride, _mm256_cvtps_ph (values, _MM_FROUND_TO_NEAREST_INT));
+		}
+		return i;
+	}
+
+	const __m256 xyz_mask = _mm256_castsi256_ps (_mm256_setr_epi32 (-1, -1, -1, components == 3 ? 0 : -1, -1, -1, -1, components == 3 ? 0 : -1));
+	const float w = components == 3 ? 1.0f : 0.0f;
+	const __m256 w_one = _mm256_setr_ps (0.0f, 0.0f, 0.0f, w, 0.0f, 0.0f, 0.0f, w);
+	const uint32_t end = components == 3 && count ? count - 1 : count;
+	for (; i + 4 <= end; i += 4)
+	{
+		const uint8_t *vertex = src + i * src_stride;
+		for (uint32_t j = 0; j < 4; j += 2)
+		{
+			const __m256 values = LoadLanes (vertex + j * src_stride, vertex + (j + 1) * src_stride);
+			const __m128i halves = _mm256_cvtps_ph (_mm256_or_ps (_mm256_and_ps (values, xyz_mask), w_one), _MM_FROUND_TO_NEAREST_INT);
+			StoreQwords2 (dst + (i + j) * dst_stride, dst_stride, halves);
+		}
+	}
+	return i;
+}
+
+VERTEX_TARGET_AVX2 static uint32_t EncodeUnorm8ColorsAvx2 (const uint8_t *src, uint32_t src_stride, uint32_t count, uint8_t *dst, uint32_t dst_stride)
+{
+	uint32_t i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		const uint8_t *vertex = src + i * src_stride;
+		__m256i encoded[4];
+		for (uint32_t j = 0; j < 4; j++)
+		{
+			__m256 color = LoadLanes (vertex + j * src_stride, vertex + (j + 4) * src_stride);
+			color = _mm256_min_ps (_mm256_max_ps (color, _mm256_setzero_ps ()), _mm256_set1_ps (1.0f));
+			encoded[j] = _mm256_cvtps_epi32 (_mm256_mul_ps (color, _mm256_set1_ps (unorm8_max)));
+		}
+		const __m256i packed = _mm256_packus_epi16 (_mm256_packs_epi32 (encoded[0], encoded[1]), _mm256_packs_epi32 (encoded[2], encoded[3]));
+		if (dst_stride == 4)
+			_mm256_storeu_si256 (reinterpret_cast<__m256i*>(dst + i * dst_stride), packed);
+		else
+		{
+			StoreDwords4 (dst + i * dst_stride, dst_stride, _mm256_castsi256_si128 (packed));
+			StoreDwords4 (dst + (i + 4) * dst_stride, dst_stride, _mm256_extracti128_si256 (packed, 1));
+		}
+	}
+	return i;
+}
+
+VERTEX_TARGET_AVX2 static __m256 CopySignAvx2 (__m256 magnitude, __m256 sign)
+{
+	const __m256 sign_mask = _mm256_set1_ps (-0.0f);
+	return _mm256_or_ps (_mm256_and_ps (sign, sign_mask), _mm256_andnot_ps (sign_mask, magnitude));
+}
+
+VERTEX_TARGET_AVX2 static uint32_t EncodeOctahedralNormalsAvx2 (const uint8_t *src, uint32_t src_stride, uint32_t count, uint8_t *dst, uint32_t dst_stride)
+{
+	const __m256 abs_mask = _mm256_castsi256_ps (_mm256_set1_epi32 (0x7fffffff));
+	const __m256 one = _mm256_set1_ps (1.0f);
+	uint32_t i = 0;
+	for (; i + 8 < count; i += 8)
+	{
+		const uint8_t *vertex = src + i * src_stride;
+		const __m256 r0 = LoadLanes (vertex, vertex + 4 * src_stride);
+		const __m256 r1 = LoadLanes (vertex + src_stride, vertex + 5 * src_stride);
+		const __m256 r2 = LoadLanes (vertex + 2 * src_stride, vertex + 6 * src_stride);
+		const __m256 r3 = LoadLanes (vertex + 3 * src_stride, vertex + 7 * src_stride);
+		const __m256 t0 = _mm256_unpacklo_ps (r0, r1);
+		const __m256 t1 = _mm256_unpacklo_ps (r2, r3);
+		const __m256 t2 = _mm256_unpackhi_ps (r0, r1);
+		const __m256 t3 = _mm256_unpackhi_ps (r2, r3);
+		const __m256 x = _mm256_shuffle_ps (t0, t1, _MM_SHUFFLE (1, 0, 1, 0));
+		const __m256 y = _mm256_shuffle_ps (t0, t1, _MM_SHUFFLE (3, 2, 3, 2));
+		const __m256 z = _mm256_shuffle_ps (t2, t3, _MM_SHUFFLE (1, 0, 1, 0));
+
+		const __m256 length = _mm256_add_ps (_mm256_add_ps (_mm256_and_ps (x, abs_mask), _mm256_and_ps (y, abs_mask)), _mm256_and_ps (z, abs_mask));
+		const __m256 inverse_length = _mm256_div_ps (one, _mm256_max_ps (length, _mm256_set1_ps (octahedral_min_length)));
+		__m256 u = _mm256_mul_ps (x, inverse_length);
+		__m256 v = _mm256_mul_ps (y, inverse_length);
+		const __m256 folded_u = CopySignAvx2 (_mm256_sub_ps (one, _mm256_and_ps (v, abs_mask)), u);
+		const __m256 folded_v = CopySignAvx2 (_mm256_sub_ps (one, _mm256_and_ps (u, abs_mask)), v);
+		const __m256 lower = _mm256_cmp_ps (z, _mm256_setzero_ps (), _CMP_LT_OQ);
+		u = _mm256_blendv_ps (u, folded_u, lower);
+		v = _mm256_blendv_ps (v, folded_v, lower);
+		const __m256i encoded_u = ToSnorm16Avx2 (u);
+		const __m256i encoded_v = ToSnorm16Avx2 (v);
+		const __m256i packed = _mm256_packs_epi32 (_mm256_unpacklo_epi32 (encoded_u, encoded_v), _mm256_unpackhi_epi32 (encoded_u, encoded_v));
+		if (dst_stride == 4)
+			_mm256_storeu_si256 (reinterpret_cast<__m256i*>(dst + i * dst_stride), packed);
+		else
+		{
+			StoreDwords4 (dst + i * dst_stride, dst_stride, _mm256_castsi256_si128 (packed));
+			StoreDwords4 (dst + (i + 4) * dst_stride, dst_stride, _mm256_extracti128_si256 (packed, 1));
+		}
+	}
+	return i;
+}
+
+#endif
+
+static VertexSimdLevel ClampSimdLevel (VertexSimdLevel level)
+{
+	return std::min (level, GetVertexSimdLevel ());
+}
+
+void EncodeSnorm16Positions (const void *src, uint32_t src_stride, uint32_t count, const float scale[3], const float bias[3],
+							 void *dst, uint32_t dst_stride, VertexSimdLevel level)
+{
+	const uint8_t *src_bytes = static_cast<const uint8_t*>(src);
+	uint8_t *dst_bytes = static_cast<uint8_t*>(dst);
+	float inverse_scale[3];
+	for (uint32_t c = 0; c < 3; c++)
+		inverse_scale[c] = 1.0f / scale[c];
+
+	uint32_t i = 0;
+	level = ClampSimdLevel (level);
+#ifdef VERTEX_FORMAT_X64
+	if (level == VERTEX_SIMD_AVX2)
+		i = EncodeSnorm16PositionsAvx2 (src_bytes, src_stride, count, inverse_scale, bias, dst_bytes, dst_stride);
+	if (level >= VERTEX_SIMD_SSE2)
+		i += EncodeSnorm16PositionsSse2 (src_bytes + i * src_stride, src_stride, count - i, inverse_scale, bias, dst_bytes + i * dst_stride, dst_stride);
+#endif
+	for (; i < count; i++)
+	{
+		int16_t encoded[4];
+		for (uint32_t c = 0; c < 3; c++)
+			encoded[c] = ToSnorm16 ((LoadFloat (src_bytes + i * src_stride + c * sizeof (float)) - bias[c]) * inverse_scale[c]);
+		encoded[3] = static_cast<int16_t>(snorm16_max);
+		memcpy (dst_bytes + i * dst_stride, encoded, sizeof (encoded));
+	}
+}
+
+void EncodeHalfs (const void *src, uint32_t src_stride, uint32_t components, uint32_t count,
+				  void *dst, uint32_t dst_stride, VertexSimdLevel level)
+{
+	if (components < 2 || components > 4)
+		throw std::invalid_argument ("Half encoding needs 2 to 4 components");
+	const uint8_t *src_bytes = static_cast<const uint8_t*>(src);
+	uint8_t *dst_bytes = static_cast<uint8_t*>(dst);
+
+	uint32_t i = 0;
+	level = ClampSimdLevel (level);
+#ifdef VERTEX_FORMAT_X64
+	if (level == VERTEX_SIMD_AVX2)
+		i = EncodeHalfsAvx2 (src_bytes, src_stride, components, count, dst_bytes, dst_stride);
+	if (level >= VERTEX_SIMD_SSE2)
+		i += EncodeHalfsSse2 (src_bytes + i * src_stride, src_stride, components, count - i, dst_bytes + i * dst_stride, dst_stride);
+#endif
+	const uint32_t encoded_components = components == 2 ? 2 : 4;
+	for (; i < count; i++)
+	{
+		uint16_t encoded[4];
+		for (uint32_t c = 0; c < components; c++)
+			encoded[c] = FloatToHalf (LoadFloat (src_bytes + i * src_stride + c * sizeof (float)));
+		if (components == 3)
+			encoded[3] = FloatToHalf (1.0f);
+		memcpy (dst_bytes + i * dst_stride, encoded, encoded_components * sizeof (uint16_t));
+	}
+}
+
+void EncodeUnorm8Colors (const void *src, uint32_t src_stride, uint32_t count,
+						 void *dst, uint32_t dst_stride, VertexSimdLevel level)
+{
+	const uint8_t *src_bytes = static_cast<const uint8_t*>(src);
+	uint8_t *dst_bytes = static_cast<uint8_t*>(dst);
+
+	uint32_t i = 0;
+	level = ClampSimdLevel (level);
+#ifdef VERTEX_FORMAT_X64
+	if (level == VERTEX_SIMD_AVX2)
+		i = EncodeUnorm8ColorsAvx2 (src_bytes, src_stride, count, dst_bytes, dst_stride);
+	if (level >= VERTEX_SIMD_SSE2)
+		i += EncodeUnorm8ColorsSse2 (src_bytes + i * src_stride, src_stride, count - i, dst_bytes + i * dst_stride, dst_stride);
+#endif
+	for (; i < count; i++)
+	{
+		uint8_t encoded[4];
+		for (uint32_t c = 0; c < 4; c++)
+		{
+			const float value = Clamp (LoadFloat (src_bytes + i * src_stride + c * sizeof (float)), 0.0f, 1.0f);
+			encoded[c] = static_cast<uint8_t>(RoundToInt (value * unorm8_max));
+		}
+		memcpy (dst_bytes + i * dst_stride, encoded, sizeof (encoded));
+	}
+}
+
+void EncodeOctahedralNormals (const void *src, uint32_t src_stride, uint32_t count,
+							  void *dst, uint32_t dst_stride, VertexSimdLevel level)
+{
+	const uint8_t *src_bytes = static_cast<const uint8_t*>(src);
+	uint8_t *dst_bytes = static_cast<uint8_t*>(dst);
+
+	uint32_t i = 0;
+	level = ClampSimdLevel (level);
+#ifdef VERTEX_FORMAT_X64
+	if (level == VERTEX_SIMD_AVX2)
+		i = EncodeOctahedralNormalsAvx2 (src_bytes, src_stride, count, dst_bytes, dst_stride);
+	if (level >= VERTEX_SIMD_SSE2)
+		i += EncodeOctahedralNormalsSse2 (src_bytes + i * src_stride, src_stride, count - i, dst_bytes + i * dst_stride, dst_stride);
+#endif
+	for (; i < count; i++)
+	{
+		const uint8_t *normal = src_bytes + i * src_stride;
+		int16_t encoded[2];
+		EncodeOctahedral (LoadFloat (normal), LoadFloat (normal + sizeof (float)), LoadFloat (normal + 2 * sizeof (float)), encoded);
+		memcpy (dst_bytes + i * dst_stride, encoded, sizeof (encoded));
+	}
+}
+
+void DecodeSnorm16Positions (const void *src, uint32_t src_stride, uint32_t count, const float scale[3], const float bias[3],
+							 void *dst, uint32_t dst_stride)
+{
+	const uint8_t *src_bytes = static_cast<const uint8_t*>(src);
+	uint8_t *dst_bytes = static_cast<uint8_t*>(dst);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		int16_t encoded[3];
+		memcpy (encoded, src_bytes + i * src_stride, sizeof (encoded));
+		for (uint32_t c = 0; c < 3; c++)
+			StoreFloat (dst_bytes + i * dst_stride + c * sizeof (float), FromSnorm16 (encoded[c]) * scale[c] + bias[c]);
+	}
+}
+
+void DecodeHalfs (const void *src, uint32_t src_stride, uint32_t components, uint32_t count, void *dst, uint32_t dst_stride)
+{
+	const uint8_t *src_bytes = static_cast<const uint8_t*>(src);
+	uint8_t *dst_bytes = static_cast<uint8_t*>(dst);
+	for (uint32_t i = 0; i < count; i++)
+		for (uint32_t c = 0; c < components; c++)
+		{
+			uint16_t encoded;
+			memcpy (&encoded, src_bytes + i * src_stride + c * sizeof (encoded), sizeof (encoded));
+			StoreFloat (dst_bytes + i * dst_stride + c * sizeof (float), HalfToFloat (encoded));
+		}
+}
+
+void DecodeUnorm8Colors (const void *src, uint32_t src_stride, uint32_t count, void *dst, uint32_t dst_stride)
+{
+	const uint8_t *src_bytes = static_cast<const uint8_t*>(src);
+	uint8_t *dst_bytes = static_cast<uint8_t*>(dst);
+	for (uint32_t i = 0; i < count; i++)
+		for (uint32_t c = 0; c < 4; c++)
+			StoreFloat (dst_bytes + i * dst_stride + c * sizeof (float), src_bytes[i * src_stride + c] / unorm8_max);
+}
+
+void DecodeOctahedralNormals (const void *src, uint32_t src_stride, uint32_t count, void *dst, uint32_t dst_stride)
+{
+	const uint8_t *src_bytes = static_cast<const uint8_t*>(src);
+	uint8_t *dst_bytes = static_cast<uint8_t*>(dst);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		int16_t encoded[2];
+		memcpy (encoded, src_bytes + i * src_stride, sizeof (encoded));
+		float normal[3];
+		DecodeOctahedral (encoded, normal);
+		memcpy (dst_bytes + i * dst_stride, normal, sizeof (normal));
+	}
+}
+
+//format of a float attribute after encoding, 0 if the encoding does not apply
+static uint32_t GetEncodedFormat (const MeshAttribute &attribute, uint32_t encoding)
+{
+	switch (encoding)
+	{
+	case VERTEX_ENCODING_FLOAT:
+		return attribute.format;
+	case VERTEX_ENCODING_HALF:
+		if (attribute.format == vertex_format_float2)
+			return vertex_format_half2;
+		return attribute.format == vertex_format_float3 || attribute.format == vertex_format_float4 ? vertex_format_half4 : 0;
+	case VERTEX_ENCODING_SNORM16:
+		//the scale and bias are per mesh, so only the position can use them
+		return attribute.semantic == MESH_ATTRIBUTE_POSITION && attribute.semantic_index == 0 &&
+			attribute.format == vertex_format_float3 ? vertex_format_snorm16x4 : 0;
+	case VERTEX_ENCODING_UNORM8:
+		return attribute.format == vertex_format_float4 ? vertex_format_unorm8x4 : 0;
+	case VERTEX_ENCODING_OCTAHEDRAL:
+		return attribute.format == vertex_format_float3 ? vertex_format_snorm16x2 : 0;
+	default:
+		return 0;
+	}
+}
+
+void QuantizeMesh (const MeshData &source, const VertexQuantization &quantization, MeshData &mesh, VertexSimdLevel level)
+{
+	MeshData result;
+	result.indices = source.indices;
+	result.submeshes = source.submeshes;
+	memcpy (result.bounds_min, source.bounds_min, sizeof (result.bounds_min));
+	memcpy (result.bounds_max, source.bounds_max, sizeof (result.bounds_max));
+
+	//packed layout, every format is a multiple of 4 bytes
+	std::vector<uint32_t> encodings;
+	for (const MeshAttribute &attribute : source.attributes)
+	{
+		if (attribute.semantic >= MESH_ATTRIBUTE_SEMANTIC_COUNT || !GetVertexFormatSize (attribute.format) ||
+			attribute.offset + GetVertexFormatSize (attribute.format) > source.vertex_stride)
+			throw std::invalid_argument ("Mesh attribute does not fit its vertex");
+		const uint32_t encoding = quantization.encodings[attribute.semantic];
+		const uint32_t format = GetEncodedFormat (attribute, encoding);
+		if (!format)
+			throw std::invalid_argument (std::string ("Vertex encoding does not apply to ") + GetMeshSemanticName (attribute.semantic));
+		result.attributes.push_back ({ attribute.semantic, attribute.semantic_index, format, result.vertex_stride });
+		result.vertex_stride += GetVertexFormatSize (format);
+		encodings.push_back (encoding);
+	}
+
+	const uint32_t vertex_count = source.GetVertexCount ();
+	result.vertices.resize (static_cast<size_t>(vertex_count) * result.vertex_stride);
+	for (size_t a = 0; a < encodings.size () && vertex_count; a++)
+	{
+		const MeshAttribute &attribute = source.attributes[a];
+		const uint8_t *src = source.vertices.data () + attribute.offset;
+		uint8_t *dst = result.vertices.data () + result.attributes[a].offset;
+		switch (encodings[a])
+		{
+		case VERTEX_ENCODING_FLOAT:
+			for (uint32_t i = 0; i < vertex_count; i++)
+				memcpy (dst + i * result.vertex_stride, src + i * source.vertex_stride, GetVertexFormatSize (attribute.format));
+			break;
+		case VERTEX_ENCODING_HALF:
+			EncodeHalfs (src, source.vertex_stride, GetVertexFormatSize (attribute.format) / sizeof (float), vertex_count,
+						 dst, result.vertex_stride, level);
+			break;
+		case VERTEX_ENCODING_SNORM16:
+		{
+			//the bounds of every vertex map to [-1, 1], flat axes keep a unit scale
+			float position_min[3], position_max[3];
+			for (uint32_t c = 0; c < 3; c++)
+			{
+				position_min[c] = position_max[c] = LoadFloat (src + c * sizeof (float));
+				for (uint32_t i = 1; i < vertex_count; i++)
+				{
+					const float value = LoadFloat (src + i * source.vertex_stride + c * sizeof (float));
+					position_min[c] = std::min (position_min[c], value);
+					position_max[c] = std::max (position_max[c], value);
+				}
+				result.position_bias[c] = 0.5f * (position_min[c] + position_max[c]);
+				const float extent = 0.5f * (position_max[c] - position_min[c]);
+				result.position_scale[c] = extent > 0.0f ? extent : 1.0f;
+			}
+			EncodeSnorm16Positions (src, source.vertex_stride, vertex_count, result.position_scale, result.position_bias,
+									dst, result.vertex_stride, level);
+			break;
+		}
+		case VERTEX_ENCODING_UNORM8:
+			EncodeUnorm8Colors (src, source.vertex_stride, vertex_count, dst, result.vertex_stride, level);
+			break;
+		case VERTEX_ENCODING_OCTAHEDRAL:
+			EncodeOctahedralNormals (src, source.vertex_stride, vertex_count, dst, result.vertex_stride, level);
+			break;
+		}
+	}
+	mesh = std::move (result);
+}
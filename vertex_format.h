@@ -0,0 +1,90 @@
+#pragma once
+#include "mesh_file.h"
+
+#include <stdint.h>
+
+//Compact vertex formats. Importers produce 32 bit float attributes; QuantizeMesh
+//converts them to formats the input assembler expands while fetching: positions as
+//half floats or as snorm16 relative to the mesh bounds, with the per-mesh scale and
+//bias applied by the vertex shader, normals octahedral-encoded into two snorm16,
+//texcoords as half floats and colours as unorm8. The encode kernels convert
+//interleaved float streams with SSE2 or AVX2 when the CPU supports them and write
+//the same bits at every level.
+
+//DXGI_FORMAT values of the vertex attributes
+static const uint32_t vertex_format_float4 = 2;         //R32G32B32A32_FLOAT
+static const uint32_t vertex_format_float3 = 6;         //R32G32B32_FLOAT
+static const uint32_t vertex_format_half4 = 10;         //R16G16B16A16_FLOAT
+static const uint32_t vertex_format_snorm16x4 = 13;     //R16G16B16A16_SNORM
+static const uint32_t vertex_format_float2 = 16;        //R32G32_FLOAT
+static const uint32_t vertex_format_unorm8x4 = 28;      //R8G8B8A8_UNORM
+static const uint32_t vertex_format_half2 = 34;         //R16G16_FLOAT
+static const uint32_t vertex_format_snorm16x2 = 37;     //R16G16_SNORM
+
+//bytes of a vertex attribute format, 0 for formats that are not listed above
+uint32_t GetVertexFormatSize (uint32_t format);
+
+enum VertexEncoding
+{
+	VERTEX_ENCODING_FLOAT,          //unchanged
+	VERTEX_ENCODING_HALF,           //positions and texcoords
+	VERTEX_ENCODING_SNORM16,        //positions inside the mesh bounds
+	VERTEX_ENCODING_UNORM8,         //colours, clamped to [0, 1]
+	VERTEX_ENCODING_OCTAHEDRAL      //unit normals
+};
+
+//encoding of each attribute, indexed by MeshAttributeSemantic
+struct VertexQuantization
+{
+	uint32_t encodings[MESH_ATTRIBUTE_SEMANTIC_COUNT];
+};
+
+//snorm16 positions, octahedral normals, half texcoords and unorm8 colours
+VertexQuantization GetCompactVertexQuantization ();
+//float attributes, the layout of the importers
+VertexQuantization GetFloatVertexQuantization ();
+
+enum VertexSimdLevel
+{
+	VERTEX_SIMD_SCALAR,
+	VERTEX_SIMD_SSE2,
+	VERTEX_SIMD_AVX2        //with F16C
+};
+
+//best level of the CPU; kernels clamp requested levels to it
+VertexSimdLevel GetVertexSimdLevel ();
+const char *GetVertexSimdLevelName (VertexSimdLevel level);
+
+//Converts a mesh with float3 positions, float3 unit normals, float2 texcoords and float4
+//colours. Attributes are packed in their source order, the layout of the pipeline comes
+//from the attributes of the result. Snorm16 positions set the position scale and bias of
+//the mesh. Throws std::invalid_argument if an encoding does not fit its attribute.
+void QuantizeMesh (const MeshData &source, const VertexQuantization &quantization, MeshData &mesh,
+				   VertexSimdLevel level = GetVertexSimdLevel ());
+
+//Batch kernels. Strides are in bytes, sources are float streams.
+
+//xyz to R16G16B16A16_SNORM with w = 1, position = xyz * scale + bias
+void EncodeSnorm16Positions (const void *src, uint32_t src_stride, uint32_t count, const float scale[3], const float bias[3],
+							 void *dst, uint32_t dst_stride, VertexSimdLevel level = GetVertexSimdLevel ());
+//2 to 4 components; 2 give R16G16_FLOAT, 3 and 4 give R16G16B16A16_FLOAT with w = 1 for 3
+void EncodeHalfs (const void *src, uint32_t src_stride, uint32_t components, uint32_t count,
+				  void *dst, uint32_t dst_stride, VertexSimdLevel level = GetVertexSimdLevel ());
+//rgba to R8G8B8A8_UNORM
+void EncodeUnorm8Colors (const void *src, uint32_t src_stride, uint32_t count,
+						 void *dst, uint32_t dst_stride, VertexSimdLevel level = GetVertexSimdLevel ());
+//unit xyz to R16G16_SNORM; a zero vector gives +z
+void EncodeOctahedralNormals (const void *src, uint32_t src_stride, uint32_t count,
+							  void *dst, uint32_t dst_stride, VertexSimdLevel level = GetVertexSimdLevel ());
+
+//Scalar decoders of the same formats for tools and validation; the GPU decodes while fetching.
+void DecodeSnorm16Positions (const void *src, uint32_t src_stride, uint32_t count, const float scale[3], const float bias[3],
+							 void *dst, uint32_t dst_stride);
+void DecodeHalfs (const void *src, uint32_t src_stride, uint32_t components, uint32_t count, void *dst, uint32_t dst_stride);
+void DecodeUnorm8Colors (const void *src, uint32_t src_stride, uint32_t count, void *dst, uint32_t dst_stride);
+//normalized xyz
+void DecodeOctahedralNormals (const void *src, uint32_t src_stride, uint32_t count, void *dst, uint32_t dst_stride);
+
+//IEEE half conversions, rounding to nearest even
+uint16_t FloatToHalf (float value);
+float HalfToFloat (uint16_t value);
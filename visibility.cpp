@@ -0,0 +1,633 @@
+#include "visibility.h"
+#include "cpu_features.h"
+
+#include <math.h>
+#include <algorithm>
+#include <stdexcept>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define VISIBILITY_X64
+#include <immintrin.h>
+#ifdef _MSC_VER
+#define CULL_TARGET_AVX
+#else
+#define CULL_TARGET_AVX __attribute__ ((target ("avx")))
+#endif
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+static const uint32_t all_planes = 0x3f;
+static const uint32_t no_node = 0xffffffff;
+//floats read past the last slot by the widest kernel
+static const uint32_t slot_padding = 8;
+
+//planes in the form the tests use, absolute normals for box extents
+struct VisibilityScene::Planes
+{
+	float normal[6][3];
+	float abs_normal[6][3];
+	float distance[6];
+};
+
+//planes of a plane mask, packed
+struct ActivePlanes
+{
+	uint32_t count;
+	float normal[6][3];
+	float abs_normal[6][3];
+	float distance[6];
+};
+
+//slot arrays and the object of each slot
+struct CullStreams
+{
+	const float *center_x;
+	const float *center_y;
+	const float *center_z;
+	const float *extent_x;
+	const float *extent_y;
+	const float *extent_z;
+	const float *radius;
+	const uint32_t *objects;
+};
+
+static uint32_t FindFirstSet (uint32_t value)
+{
+	#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward (&index, value);
+	return index;
+	#else
+	return __builtin_ctz (value);
+	#endif
+}
+
+static CullSimdLevel DetectSimdLevel ()
+{
+#ifdef VISIBILITY_X64
+	return GetCpuFeatures ().avx ? CULL_SIMD_AVX : CULL_SIMD_SSE2;
+#else
+	return CULL_SIMD_SCALAR;
+#endif
+}
+
+CullSimdLevel GetCullSimdLevel ()
+{
+	static const CullSimdLevel level = DetectSimdLevel ();
+	return level;
+}
+
+const char *GetCullSimdLevelName (CullSimdLevel level)
+{
+	switch (level)
+	{
+	case CULL_SIMD_SCALAR:
+		return "scalar";
+	case CULL_SIMD_SSE2:
+		return "SSE2";
+	case CULL_SIMD_AVX:
+		return "AVX";
+	}
+	return "unknown";
+}
+
+Frustum ExtractFrustum (const float view_projection[16])
+{
+	//clip = p * m, so clip component c is column c of m
+	const float *m = view_projection;
+	float column[4][4];
+	for (uint32_t c = 0; c < 4; c++)
+		for (uint32_t r = 0; r < 4; r++)
+			column[c][r] = m[r * 4 + c];
+
+	//-w <= x <= w, -w <= y <= w, 0 <= z <= w
+	Frustum frustum;
+	for (uint32_t r = 0; r < 4; r++)
+	{
+		frustum.planes[0][r] = column[3][r] + column[0][r];
+		frustum.planes[1][r] = column[3][r] - column[0][r];
+		frustum.planes[2][r] = column[3][r] + column[1][r];
+		frustum.planes[3][r] = column[3][r] - column[1][r];
+		frustum.planes[4][r] = column[2][r];
+		frustum.planes[5][r] = column[3][r] - column[2][r];
+	}
+	for (uint32_t p = 0; p < 6; p++)
+	{
+		float *plane = frustum.planes[p];
+		const float length = sqrtf (plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+		if (length > 0.0f)
+			for (uint32_t c = 0; c < 4; c++)
+				plane[c] /= length;
+	}
+	return frustum;
+}
+
+CullOptions::CullOptions () : volume (CULL_VOLUME_SPHERE), level (GetCullSimdLevel ()), hierarchy (true), job_system (nullptr)
+{
+}
+
+//the kernels evaluate the same expressions in the same order without fused multiply-adds,
+//so every level finds the same objects visible
+static uint32_t CullSlotsScalar (const CullStreams &streams, const ActivePlanes &planes, CullVolume volume, uint32_t begin,
+								 uint32_t end, uint32_t *visible)
+{
+	uint32_t count = 0;
+	for (uint32_t slot = begin; slot < end; slot++)
+	{
+		const float cx = streams.center_x[slot], cy = streams.center_y[slot], cz = streams.center_z[slot];
+		bool inside = true;
+		for (uint32_t p = 0; p < planes.count && inside; p++)
+		{
+			const float *n = planes.normal[p];
+			const float d = n[0] * cx + n[1] * cy + n[2] * cz + planes.distance[p];
+			float value;
+			if (volume == CULL_VOLUME_SPHERE)
+				value = d + streams.radius[slot];
+			else
+			{
+				const float *a = planes.abs_normal[p];
+				value = d + a[0] * streams.extent_x[slot] + a[1] * streams.extent_y[slot] + a[2] * streams.extent_z[slot];
+			}
+			inside = value >= 0.0f;
+		}
+		if (inside)
+			visible[count++] = streams.objects[slot];
+	}
+	return count;
+}
+
+#ifdef VISIBILITY_X64
+static uint32_t CullSlotsSse2 (const CullStreams &streams, const ActivePlanes &planes, CullVolume volume, uint32_t begin,
+							   uint32_t end, uint32_t *visible)
+{
+	const __m128 zero = _mm_setzero_ps ();
+	const __m128 all = _mm_castsi128_ps (_mm_set1_epi32 (-1));
+	uint32_t count = 0;
+	for (uint32_t slot = begin; slot < end; slot += 4)
+	{
+		const __m128 cx = _mm_loadu_ps (streams.center_x + slot);
+		const __m128 cy = _mm_loadu_ps (streams.center_y + slot);
+		const __m128 cz = _mm_loadu_ps (streams.center_z + slot);
+		__m128 inside = all;
+		if (volume == CULL_VOLUME_SPHERE)
+		{
+			const __m128 r = _mm_loadu_ps (streams.radius + slot);
+			for (uint32_t p = 0; p < planes.count; p++)
+			{
+				const float *n = planes.normal[p];
+				__m128 d = _mm_add_ps (_mm_mul_ps (_mm_set1_ps (n[0]), cx), _mm_mul_ps (_mm_set1_ps (n[1]), cy));
+				d = _mm_add_ps (_mm_add_ps (d, _mm_mul_ps (_mm_set1_ps (n[2]), cz)), _mm_set1_ps (planes.distance[p]));
+				inside = _mm_and_ps (inside, _mm_cmpge_ps (_mm_add_ps (d, r), zero));
+			}
+		}
+		else
+		{
+			const __m128 ex = _mm_loadu_ps (streams.extent_x + slot);
+			const __m128 ey = _mm_loadu_ps (streams.extent_y + slot);
+			const __m128 ez = _mm_loadu_ps (streams.extent_z + slot);
+			for (uint32_t p = 0; p < planes.count; p++)
+			{
+				const float *n = planes.normal[p];
+				const float *a = planes.abs_normal[p];
+				__m128 d = _mm_add_ps (_mm_mul_ps (_mm_set1_ps (n[0]), cx), _mm_mul_ps (_mm_set1_ps (n[1]), cy));
+				d = _mm_add_ps (_mm_add_ps (d, _mm_mul_ps (_mm_set1_ps (n[2]), cz)), _mm_set1_ps (planes.distance[p]));
+				d = _mm_add_ps (d, _mm_mul_ps (_mm_set1_ps (a[0]), ex));
+				d = _mm_add_ps (d, _mm_mul_ps (_mm_set1_ps (a[1]), ey));
+				d = _mm_add_ps (d, _mm_mul_ps (_mm_set1_ps (a[2]), ez));
+				inside = _mm_and_ps (inside, _mm_cmpge_ps (d, zero));
+			}
+		}
+		uint32_t mask = static_cast<uint32_t>(_mm_movemask_ps (inside));
+		if (end - slot < 4)
+			mask &= (1u << (end - slot)) - 1;
+		for (; mask != 0; mask &= mask - 1)
+			visible[count++] = streams.objects[slot + FindFirstSet (mask)];
+	}
+	return count;
+}
+
+CULL_TARGET_AVX static uint32_t CullSlotsAvx (const CullStreams &streams, const ActivePlanes &planes, CullVolume volume,
+											  uint32_t begin, uint32_t end, uint32_t *visible)
+{
+	const __m256 zero = _mm256_setzero_ps ();
+	const __m256 all = _mm256_castsi256_ps (_mm256_set1_epi32 (-1));
+	uint32_t count = 0;
+	for (uint32_t slot = begin; slot < end; slot += 8)
+	{
+		const __m256 cx = _mm256_loadu_ps (streams.center_x + slot);
+		const __m256 cy = _mm256_loadu_ps (streams.center_y + slot);
+		const __m256 cz = _mm256_loadu_ps (streams.center_z + slot);
+		__m256 inside = all;
+		if (volume == CULL_VOLUME_SPHERE)
+		{
+			const __m256 r = _mm256_loadu_ps (streams.radius + slot);
+			for (uint32_t p = 0; p < planes.count; p++)
+			{
+				const float *n = planes.normal[p];
+				__m256 d = _mm256_add_ps (_mm256_mul_ps (_mm256_set1_ps (n[0]), cx), _mm256_mul_ps (_mm256_set1_ps (n[1]), cy));
+				d = _mm256_add_ps (_mm256_add_ps (d, _mm256_mul_ps (_mm256_set1_ps (n[2]), cz)), _mm256_set1_ps (planes.distance[p]));
+				inside = _mm256_and_ps (inside, _mm256_cmp_ps (_mm256_add_ps (d, r), zero, _CMP_GE_OQ));
+			}
+		}
+		else
+		{
+			const __m256 ex = _mm256_loadu_ps (streams.extent_x + slot);
+			const __m256 ey = _mm256_loadu_ps (streams.extent_y + slot);
+			const __m256 ez = _mm256_loadu_ps (streams.extent_z + slot);
+			for (uint32_t p = 0; p < planes.count; p++)
+			{
+				const float *n = planes.normal[p];
+				const float *a = planes.abs_normal[p];
+				__m256 d = _mm256_add_ps (_mm256_mul_ps (_mm256_set1_ps (n[0]), cx), _mm256_mul_ps (_mm256_set1_ps (n[1]), cy));
+				d = _mm256_add_ps (_mm256_add_ps (d, _mm256_mul_ps (_mm256_set1_ps (n[2]), cz)), _mm256_set1_ps (planes.distance[p]));
+				d = _mm256_add_ps (d, _mm256_mul_ps (_mm256_set1_ps (a[0]), ex));
+				d = _mm256_add_ps (d, _mm256_mul_ps (_mm256_set1_ps (a[1]), ey));
+				d = _mm256_add_ps (d, _mm256_mul_ps (_mm256_set1_ps (a[2]), ez));
+				inside = _mm256_and_ps (inside, _mm256_cmp_ps (d, zero, _CMP_GE_OQ));
+			}
+		}
+		uint32_t mask = static_cast<uint32_t>(_mm256_movemask_ps (inside));
+		if (end - slot < 8)
+			mask &= (1u << (end - slot)) - 1;
+		for (; mask != 0; mask &= mask - 1)
+			visible[count++] = streams.objects[slot + FindFirstSet (mask)];
+	}
+	return count;
+}
+#endif
+
+//clears the planes the box is inside of from the mask; false if it is outside of one
+static bool ClipBox (const float (*normals)[3], const float *distances, const float box_min[3], const float box_max[3], uint32_t &mask)
+{
+	for (uint32_t planes = mask; planes != 0; planes &= planes - 1)
+	{
+		const uint32_t p = FindFirstSet (planes);
+		const float *n = normals[p];
+		float farthest = distances[p], nearest = distances[p];
+		for (uint32_t c = 0; c < 3; c++)
+		{
+			farthest += n[c] * (n[c] >= 0.0f ? box_max[c] : box_min[c]);
+			nearest += n[c] * (n[c] >= 0.0f ? box_min[c] : box_max[c]);
+		}
+		if (farthest < 0.0f)
+			return false;
+		if (nearest >= 0.0f)
+			mask &= ~(1u << p);
+	}
+	return true;
+}
+
+VisibilityScene::VisibilityScene () : object_count (0), bounds_changed (false)
+{
+	Resize (0);
+}
+
+void VisibilityScene::Resize (uint32_t count)
+{
+	const uint32_t padded_count = count + slot_padding;
+	center_x.resize (padded_count);
+	center_y.resize (padded_count);
+	center_z.resize (padded_count);
+	extent_x.resize (padded_count);
+	extent_y.resize (padded_count);
+	extent_z.resize (padded_count);
+	radius.resize (padded_count);
+
+	//removed objects may sit anywhere in the hierarchy order, so compact the survivors
+	//into the first slots and reset everything after them
+	if (count < object_count)
+	{
+		std::vector<uint32_t> order;
+		order.reserve (count);
+		for (uint32_t slot = 0; slot < object_count; slot++)
+			if (objects[slot] < count)
+				order.push_back (slot);
+		std::vector<float> *streams[] = { &center_x, &center_y, &center_z, &extent_x, &extent_y, &extent_z, &radius };
+		for (std::vector<float> *stream : streams)
+			for (uint32_t slot = 0; slot < count; slot++)
+				(*stream)[slot] = (*stream)[order[slot]];
+		for (uint32_t slot = 0; slot < count; slot++)
+			objects[slot] = objects[order[slot]];
+	}
+	objects.resize (count);
+	slots.resize (count);
+	for (uint32_t slot = 0; slot < count; slot++)
+		slots[objects[slot]] = slot;
+	for (uint32_t object = object_count; object < count; object++)
+	{
+		objects[object] = object;
+		slots[object] = object;
+	}
+	for (uint32_t slot = std::min (count, object_count); slot < padded_count; slot++)
+	{
+		center_x[slot] = center_y[slot] = center_z[slot] = 0.0f;
+		extent_x[slot] = extent_y[slot] = extent_z[slot] = radius[slot] = 0.0f;
+	}
+	object_count = count;
+	nodes.clear ();
+	bounds_changed = false;
+}
+
+void VisibilityScene::SetBounds (uint32_t object, const float center[3], const float extent[3], float sphere_radius)
+{
+	if (object >= object_count)
+		throw std::out_of_range ("Visibility object out of range");
+	const uint32_t slot = slots[object];
+	center_x[slot] = center[0];
+	center_y[slot] = center[1];
+	center_z[slot] = center[2];
+	extent_x[slot] = extent[0];
+	extent_y[slot] = extent[1];
+	extent_z[slot] = extent[2];
+	radius[slot] = sphere_radius;
+	bounds_changed = true;
+}
+
+void VisibilityScene::SetSphere (uint32_t object, const float center[3], float sphere_radius)
+{
+	const float extent[3] = { sphere_radius, sphere_radius, sphere_radius };
+	SetBounds (object, center, extent, sphere_radius);
+}
+
+void VisibilityScene::SetBox (uint32_t object, const float box_min[3], const float box_max[3])
+{
+	float center[3], extent[3];
+	for (uint32_t c = 0; c < 3; c++)
+	{
+		center[c] = (box_min[c] + box_max[c]) * 0.5f;
+		extent[c] = (box_max[c] - box_min[c]) * 0.5f;
+	}
+	SetBounds (object, center, extent, sqrtf (extent[0] * extent[0] + extent[1] * extent[1] + extent[2] * extent[2]));
+}
+
+void VisibilityScene::BuildHierarchy (uint32_t leaf_size)
+{
+	if (leaf_size == 0)
+		throw std::invalid_argument ("Hierarchy leaves need at least one object");
+	nodes.clear ();
+	if (object_count == 0)
+		return;
+
+	//order lists the current slots in their new order
+	std::vector<uint32_t> order (object_count);
+	for (uint32_t slot = 0; slot < object_count; slot++)
+		order[slot] = slot;
+	nodes.resize (1);
+	BuildNode (0, 0, object_count, leaf_size, order);
+
+	std::vector<float> reordered (center_x.size ());
+	std::vector<float> *streams[] = { &center_x, &center_y, &center_z, &extent_x, &extent_y, &extent_z, &radius };
+	for (std::vector<float> *stream : streams)
+	{
+		for (uint32_t slot = 0; slot < object_count; slot++)
+			reordered[slot] = (*stream)[order[slot]];
+		std::copy (reordered.begin (), reordered.begin () + object_count, stream->begin ());
+	}
+	std::vector<uint32_t> reordered_objects (object_count);
+	for (uint32_t slot = 0; slot < object_count; slot++)
+	{
+		reordered_objects[slot] = objects[order[slot]];
+		slots[reordered_objects[slot]] = slot;
+	}
+	objects.swap (reordered_objects);
+
+	RefitHierarchy ();
+}
+
+void VisibilityScene::BuildNode (uint32_t node, uint32_t first_slot, uint32_t slot_count, uint32_t leaf_size, std::vector<uint32_t> &order)
+{
+	nodes[node].child = 0;
+	nodes[node].first_slot = first_slot;
+	nodes[node].slot_count = slot_count;
+	if (slot_count <= leaf_size)
+		return;
+
+	//median split across the longest axis of the centers, so the tree stays balanced
+	//and the leaves full
+	const float *centers[3] = { center_x.data (), center_y.data (), center_z.data () };
+	float center_min[3], center_max[3];
+	for (uint32_t c = 0; c < 3; c++)
+		center_min[c] = center_max[c] = centers[c][order[first_slot]];
+	for (uint32_t i = first_slot + 1; i < first_slot + slot_count; i++)
+		for (uint32_t c = 0; c < 3; c++)
+		{
+			center_min[c] = std::min (center_min[c], centers[c][order[i]]);
+			center_max[c] = std::max (center_max[c], centers[c][order[i]]);
+		}
+	uint32_t axis = 0;
+	for (uint32_t c = 1; c < 3; c++)
+		if (center_max[c] - center_min[c] > center_max[axis] - center_min[axis])
+			axis = c;
+
+	const float *keys = centers[axis];
+	const uint32_t half = slot_count / 2;
+	std::nth_element (order.begin () + first_slot, order.begin () + first_slot + half, order.begin () + first_slot + slot_count,
+					  [keys] (uint32_t a, uint32_t b) { return keys[a] < keys[b] || (keys[a] == keys[b] && a < b); });
+
+	const uint32_t child = static_cast<uint32_t>(nodes.size ());
+	nodes[node].child = child;
+	nodes.resize (child + 2);
+	BuildNode (child, first_slot, half, leaf_size, order);
+	BuildNode (child + 1, first_slot + half, slot_count - half, leaf_size, order);
+}
+
+void VisibilityScene::RefitHierarchy ()
+{
+	//children come after their parents
+	for (size_t i = nodes.size (); i-- > 0;)
+	{
+		Node &node = nodes[i];
+		if (node.child != 0)
+		{
+			const Node &left = nodes[node.child];
+			const Node &right = nodes[node.child + 1];
+			for (uint32_t c = 0; c < 3; c++)
+			{
+				node.box_min[c] = std::min (left.box_min[c], right.box_min[c]);
+				node.box_max[c] = std::max (left.box_max[c], right.box_max[c]);
+			}
+			continue;
+		}
+		const float *centers[3] = { center_x.data (), center_y.data (), center_z.data () };
+		const float *extents[3] = { extent_x.data (), extent_y.data (), extent_z.data () };
+		for (uint32_t c = 0; c < 3; c++)
+		{
+			float box_min = centers[c][node.first_slot] - extents[c][node.first_slot];
+			float box_max = centers[c][node.first_slot] + extents[c][node.first_slot];
+			for (uint32_t slot = node.first_slot + 1; slot < node.first_slot + node.slot_count; slot++)
+			{
+				box_min = std::min (box_min, centers[c][slot] - extents[c][slot]);
+				box_max = std::max (box_max, centers[c][slot] + extents[c][slot]);
+			}
+			node.box_min[c] = box_min;
+			node.box_max[c] = box_max;
+		}
+	}
+	bounds_changed = false;
+}
+
+uint32_t VisibilityScene::CullSlots (const Planes &planes, uint32_t plane_mask, uint32_t begin, uint32_t end, CullVolume volume,
+									 CullSimdLevel level, uint32_t *visible) const
+{
+	ActivePlanes active;
+	active.count = 0;
+	for (uint32_t mask = plane_mask; mask != 0; mask &= mask - 1)
+	{
+		const uint32_t p = FindFirstSet (mask);
+		for (uint32_t c = 0; c < 3; c++)
+		{
+			active.normal[active.count][c] = planes.normal[p][c];
+			active.abs_normal[active.count][c] = planes.abs_normal[p][c];
+		}
+		active.distance[active.count] = planes.distance[p];
+		active.count++;
+	}
+	const CullStreams streams =
+	{
+		center_x.data (), center_y.data (), center_z.data (), extent_x.data (), extent_y.data (), extent_z.data (), radius.data (),
+		objects.data ()
+	};
+
+#ifdef VISIBILITY_X64
+	if (level == CULL_SIMD_AVX)
+		return CullSlotsAvx (streams, active, volume, begin, end, visible);
+	if (level == CULL_SIMD_SSE2)
+		return CullSlotsSse2 (streams, active, volume, begin, end, visible);
+#else
+	(void)level;
+#endif
+	return CullSlotsScalar (streams, active, volume, begin, end, visible);
+}
+
+uint32_t VisibilityScene::CullTaskSlots (const Planes &planes, const CullTask &task, CullVolume volume, CullSimdLevel level,
+										 uint32_t *visible, CullStats &stats) const
+{
+	if (task.node == no_node)
+	{
+		stats.tested_objects += task.slot_count;
+		return CullSlots (planes, task.plane_mask, task.first_slot, task.first_slot + task.slot_count, volume, level, visible);
+	}
+
+	//depth first, left to right, so the objects come out in slot order; entries are
+	//already clipped
+	struct Entry
+	{
+		uint32_t node;
+		uint32_t plane_mask;
+	};
+	Entry stack[64];
+	uint32_t stack_size = 0;
+	stack[stack_size++] = { task.node, task.plane_mask };
+	uint32_t count = 0;
+	while (stack_size > 0)
+	{
+		const Entry entry = stack[--stack_size];
+		const Node &node = nodes[entry.node];
+		if (entry.plane_mask == 0)
+		{
+			std::copy (objects.begin () + node.first_slot, objects.begin () + node.first_slot + node.slot_count, visible + count);
+			count += node.slot_count;
+			stats.accepted_objects += node.slot_count;
+		}
+		else if (node.child == 0)
+		{
+			count += CullSlots (planes, entry.plane_mask, node.first_slot, node.first_slot + node.slot_count, volume, level, visible + count);
+			stats.tested_objects += node.slot_count;
+		}
+		else
+			for (uint32_t i = 2; i-- > 0;)
+			{
+				const uint32_t child = node.child + i;
+				uint32_t plane_mask = entry.plane_mask;
+				stats.tested_nodes++;
+				if (ClipBox (planes.normal, planes.distance, nodes[child].box_min, nodes[child].box_max, plane_mask))
+					stack[stack_size++] = { child, plane_mask };
+			}
+	}
+	return count;
+}
+
+uint32_t VisibilityScene::Cull (const Frustum &frustum, const CullOptions &options, std::vector<uint32_t> &visible, CullStats *stats) const
+{
+	Planes planes;
+	for (uint32_t p = 0; p < 6; p++)
+	{
+		for (uint32_t c = 0; c < 3; c++)
+		{
+			planes.normal[p][c] = frustum.planes[p][c];
+			planes.abs_normal[p][c] = fabsf (frustum.planes[p][c]);
+		}
+		planes.distance[p] = frustum.planes[p][3];
+	}
+	const CullSimdLevel level = std::min (options.level, GetCullSimdLevel ());
+
+	//split the scene into jobs: without the hierarchy into blocks of slots, with it into
+	//subtrees of up to a job's size, clipping the nodes above them on the way
+	std::vector<CullTask> tasks;
+	CullStats total = {};
+	if (options.hierarchy && IsHierarchyCurrent ())
+	{
+		std::vector<CullTask> stack (1);
+		stack[0].node = 0;
+		stack[0].plane_mask = all_planes;
+		total.tested_nodes++;
+		if (!ClipBox (planes.normal, planes.distance, nodes[0].box_min, nodes[0].box_max, stack[0].plane_mask))
+			stack.clear ();
+		while (!stack.empty ())
+		{
+			const CullTask task = stack.back ();
+			stack.pop_back ();
+			const Node &node = nodes[task.node];
+			if (node.child == 0 || node.slot_count <= visibility_job_size || task.plane_mask == 0)
+			{
+				tasks.push_back ({ task.node, task.plane_mask, node.first_slot, node.slot_count });
+				continue;
+			}
+			for (uint32_t i = 2; i-- > 0;)
+			{
+				CullTask child = { node.child + i, task.plane_mask, 0, 0 };
+				total.tested_nodes++;
+				if (ClipBox (planes.normal, planes.distance, nodes[child.node].box_min, nodes[child.node].box_max, child.plane_mask))
+					stack.push_back (child);
+			}
+		}
+	}
+	else
+		for (uint32_t first_slot = 0; first_slot < object_count; first_slot += visibility_job_size)
+			tasks.push_back ({ no_node, all_planes, first_slot, std::min (visibility_job_size, object_count - first_slot) });
+
+	//every task writes at its first slot, then the lists are moved together
+	visible.resize (object_count);
+	std::vector<uint32_t> counts (tasks.size ());
+	std::vector<CullStats> task_stats (tasks.size ());
+	auto cull_tasks = [&] (uint32_t begin, uint32_t end)
+	{
+		for (uint32_t i = begin; i < end; i++)
+			counts[i] = CullTaskSlots (planes, tasks[i], options.volume, level, visible.data () + tasks[i].first_slot, task_stats[i]);
+	};
+	const uint32_t task_count = static_cast<uint32_t>(tasks.size ());
+	if (options.job_system && task_count > 1)
+		options.job_system->ParallelFor (task_count, 1, cull_tasks);
+	else
+		cull_tasks (0, task_count);
+
+	uint32_t visible_count = 0;
+	for (uint32_t i = 0; i < task_count; i++)
+	{
+		const uint32_t *first = visible.data () + tasks[i].first_slot;
+		if (visible_count != tasks[i].first_slot)
+			std::copy (first, first + counts[i], visible.data () + visible_count);
+		visible_count += counts[i];
+		total.tested_nodes += task_stats[i].tested_nodes;
+		total.tested_objects += task_stats[i].tested_objects;
+		total.accepted_objects += task_stats[i].accepted_objects;
+	}
+	visible.resize (visible_count);
+	total.visible = visible_count;
+	if (stats)
+		*stats = total;
+	return visible_count;
+}
@@ -0,0 +1,145 @@
+#pragma once
+#include "job_system.h"
+
+#include <stdint.h>
+
+#include <vector>
+
+//View frustum culling. Object bounds are kept as structure of arrays (box centers,
+//box extents and sphere radii) and tested 4 (SSE2) or 8 (AVX) objects at a time. A
+//bounding volume hierarchy over the objects rejects or accepts whole subtrees and only
+//tests the planes a subtree straddles; its leaves are runs of objects in memory, so the
+//tests inside them stay in SIMD. Subtrees are culled in parallel on the job system and
+//the visible objects come out as one compact index list in hierarchy order.
+
+//objects per hierarchy leaf
+static const uint32_t visibility_leaf_size = 32;
+//objects per culling job; subtrees up to this size are culled by one job
+static const uint32_t visibility_job_size = 2048;
+
+enum CullSimdLevel
+{
+	CULL_SIMD_SCALAR,
+	CULL_SIMD_SSE2,
+	CULL_SIMD_AVX
+};
+
+//best level of the CPU; culling clamps requested levels to it
+CullSimdLevel GetCullSimdLevel ();
+const char *GetCullSimdLevelName (CullSimdLevel level);
+
+enum CullVolume
+{
+	CULL_VOLUME_SPHERE,     //cheapest test
+	CULL_VOLUME_BOX         //tighter for elongated objects
+};
+
+//planes as normal and distance, inside where dot (normal, p) + distance >= 0
+struct Frustum
+{
+	float planes[6][4];
+};
+
+//normalized planes of a row-major view projection matrix for row vectors (the DirectXMath
+//layout) with a clip space depth of [0, 1]
+Frustum ExtractFrustum (const float view_projection[16]);
+
+struct CullOptions
+{
+	CullVolume volume;
+	CullSimdLevel level;
+	//use the hierarchy if it is current, test every object otherwise. Nodes bound the
+	//object boxes, so sphere culling with the hierarchy also drops objects whose sphere
+	//crosses a plane their box does not.
+	bool hierarchy;
+	JobSystem *job_system;      //null culls on the calling thread
+
+	CullOptions ();
+};
+
+struct CullStats
+{
+	uint32_t visible;
+	uint32_t tested_nodes;
+	uint32_t tested_objects;    //tested one by one
+	uint32_t accepted_objects;  //visible because their subtree was inside every plane
+};
+
+class VisibilityScene
+{
+public:
+	VisibilityScene ();
+
+	//new objects are points at the origin; invalidates the hierarchy
+	void Resize (uint32_t count);
+	uint32_t GetObjectCount () const
+	{
+		return object_count;
+	}
+	//the box of a sphere is its bounding cube, the sphere of a box its circumscribed sphere
+	void SetSphere (uint32_t object, const float center[3], float radius);
+	void SetBox (uint32_t object, const float box_min[3], const float box_max[3]);
+
+	//builds the hierarchy over the current bounds and stores the objects in its order
+	void BuildHierarchy (uint32_t leaf_size = visibility_leaf_size);
+	//recomputes the node bounds after objects moved; the topology is kept, so the tree
+	//loosens as objects move far and should be rebuilt then
+	void RefitHierarchy ();
+	//built and refitted since the last bounds change
+	bool IsHierarchyCurrent () const
+	{
+		return !nodes.empty () && !bounds_changed;
+	}
+	uint32_t GetNodeCount () const
+	{
+		return static_cast<uint32_t>(nodes.size ());
+	}
+
+	//writes the visible objects to visible, resized to their count, and returns the count.
+	//Safe to call from several threads at once.
+	uint32_t Cull (const Frustum &frustum, const CullOptions &options, std::vector<uint32_t> &visible, CullStats *stats = nullptr) const;
+private:
+	struct Node
+	{
+		float box_min[3];
+		float box_max[3];
+		uint32_t child;         //first of two adjacent children, 0 for leaves
+		uint32_t first_slot;    //objects of the subtree are slots [first_slot, first_slot + slot_count)
+		uint32_t slot_count;
+	};
+
+	//slots culled by one job and written at their first slot; a subtree or, without the
+	//hierarchy, a block of slots
+	struct CullTask
+	{
+		uint32_t node;
+		uint32_t plane_mask;        //planes the node crosses
+		uint32_t first_slot;
+		uint32_t slot_count;
+	};
+
+	struct Planes;
+
+	void SetBounds (uint32_t object, const float center[3], const float extent[3], float radius);
+	void BuildNode (uint32_t node, uint32_t first_slot, uint32_t slot_count, uint32_t leaf_size, std::vector<uint32_t> &order);
+	//tests slots [begin, end) against the planes of the mask and writes the visible objects
+	uint32_t CullSlots (const Planes &planes, uint32_t plane_mask, uint32_t begin, uint32_t end, CullVolume volume,
+						CullSimdLevel level, uint32_t *visible) const;
+	uint32_t CullTaskSlots (const Planes &planes, const CullTask &task, CullVolume volume, CullSimdLevel level,
+							uint32_t *visible, CullStats &stats) const;
+
+	uint32_t object_count;
+	//by slot, padded so SIMD loads may read a full register past the last slot
+	std::vector<float> center_x;
+	std::vector<float> center_y;
+	std::vector<float> center_z;
+	std::vector<float> extent_x;
+	std::vector<float> extent_y;
+	std::vector<float> extent_z;
+	std::vector<float> radius;
+	std::vector<uint32_t> objects;      //object of each slot
+	std::vector<uint32_t> slots;        //slot of each object
+
+	std::vector<Node> nodes;
+	bool bounds_changed;
+};